@@ -12,6 +12,10 @@
 %newobject ::recvEvent();
 %newobject ::sendEvent();
 %newobject ESLconnection::recvEventTimed();
+%newobject ESLconnection::recvReply();
+%newobject ESLpool::sendRecv();
+%newobject ESLpool::api();
+%newobject ESLpool::bgapi();
 #else
 %newobject ESLconnection::sendRecv;
 %newobject ESLconnection::api;
@@ -23,6 +27,10 @@
 %newobject ESLconnection::recvEventTimed;
 %newobject ESLconnection::execute;
 %newobject ESLconnection::executeAsync;
+%newobject ESLconnection::recvReply;
+%newobject ESLpool::sendRecv;
+%newobject ESLpool::api;
+%newobject ESLpool::bgapi;
 #endif
 
 
@@ -58,6 +66,12 @@
 %rename (SetAsyncExecute) ESLconnection::setAsyncExecute;
 %rename (SetEventLock) ESLconnection::setEventLock;
 %rename (Disconnect) ESLconnection::disconnect;
+%rename (SendPipelined) ESLconnection::sendPipelined;
+%rename (RecvReply) ESLconnection::recvReply;
+%rename (Connected) ESLpool::connected;
+%rename (SendRecv) ESLpool::sendRecv;
+%rename (Api) ESLpool::api;
+%rename (Bgapi) ESLpool::bgapi;
 #endif
 
 %include "esl_oop.h"
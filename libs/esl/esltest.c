@@ -0,0 +1,337 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <esl.h>
+
+/*
+ * Checks for the event arena and the connection pool.
+ *
+ * usage: esltest
+ *
+ * The pool checks talk to a fake server on 127.0.0.1 that accepts "auth", answers
+ * "api conn" and "api slow" with the number of the connection and hangs up on "api drop".
+ */
+
+static int failures;
+
+#define STR_NIL(_s) ((_s) ? (_s) : "(null)")
+#define check(_expr, ...) do { if (!(_expr)) { fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); fprintf(stderr, __VA_ARGS__); fprintf(stderr, "\n"); failures++; } } while (0)
+
+static char *plain_event(const char *name, esl_size_t value_len)
+{
+	char *value, *data;
+	esl_size_t len = value_len + strlen(name) + 128;
+
+	value = malloc(value_len + 1);
+	esl_assert(value);
+	memset(value, 'v', value_len);
+	value[value_len] = '\0';
+
+	data = malloc(len);
+	esl_assert(data);
+	snprintf(data, len, "Event-Name: CUSTOM\nEvent-Subclass: %s\nvariable_big: %s\nvariable_list: one\n\n", name, value);
+	free(value);
+
+	return data;
+}
+
+/* an event too big for the first chunk grows the arena, the reset drops the extra chunks and the next
+   event is built in the original one again */
+static void test_arena_oversized(void)
+{
+	esl_event_arena_t *arena = NULL;
+	esl_event_t *event = NULL;
+	char *small = plain_event("test::small", 16), *big = plain_event("test::big", 64 * 1024);
+	void *first;
+	const char *val;
+
+	esl_event_arena_create(&arena, 1024);
+
+	check(esl_event_create_plain_arena(&event, small, arena) == ESL_SUCCESS, "small event did not parse");
+	first = event;
+	arena = esl_event_release_arena(&event);
+	check(arena && !event, "release did not hand the arena back");
+
+	check(esl_event_create_plain_arena(&event, big, arena) == ESL_SUCCESS, "big event did not parse");
+	val = esl_event_get_header(event, "variable_big");
+	check(val && strlen(val) == 64 * 1024, "big value came back %d bytes long", val ? (int) strlen(val) : -1);
+	arena = esl_event_release_arena(&event);
+
+	check(esl_event_create_plain_arena(&event, small, arena) == ESL_SUCCESS, "small event after the big one did not parse");
+	check((void *) event == first, "the arena did not go back to its first chunk");
+	check(!strcmp(esl_event_get_header(event, "event-subclass"), "test::small"), "the small event came back wrong");
+	check(strlen(esl_event_get_header(event, "variable_big")) == 16, "a value of the big event leaked into the small one");
+	esl_event_destroy(&event);
+
+	free(small);
+	free(big);
+}
+
+/* headers added to a parsed event are malloced or carved from the arena, either way deleting them,
+   releasing and destroying the event frees exactly what was malloced */
+static void test_arena_added_headers(void)
+{
+	esl_event_arena_t *arena = NULL;
+	esl_event_t *event = NULL;
+	char *data = plain_event("test::added", 32);
+	int round;
+
+	esl_event_arena_create(&arena, 0);
+
+	for (round = 0; round < 3; round++) {
+		const char *val;
+		char body[32];
+
+		check(esl_event_create_plain_arena(&event, data, arena) == ESL_SUCCESS, "round %d: did not parse", round);
+
+		esl_event_add_header_string(event, ESL_STACK_BOTTOM, "X-Added", "later");
+		esl_event_add_header_string(event, ESL_STACK_PUSH, "variable_list", "two");
+		esl_event_add_header_string(event, ESL_STACK_PUSH, "variable_list", "three");
+		esl_event_add_header(event, ESL_STACK_BOTTOM, "X-Printf", "%d", round);
+		esl_event_add_body(event, "body %d", round);
+
+		check((val = esl_event_get_header(event, "x-added")) && !strcmp(val, "later"), "round %d: X-Added is %s", round, STR_NIL(val));
+		check((val = esl_event_get_header_idx(event, "variable_list", 2)) && !strcmp(val, "three"), "round %d: variable_list[2] is %s",
+			  round, STR_NIL(val));
+		snprintf(body, sizeof(body), "body %d", round);
+		check(event->body && !strcmp(event->body, body), "round %d: body is %s", round, STR_NIL(event->body));
+
+		/* one parsed header, one added one and the array that replaced a parsed value */
+		esl_event_del_header(event, "event-subclass");
+		esl_event_del_header(event, "x-added");
+		esl_event_del_header(event, "variable_list");
+
+		check(!esl_event_get_header(event, "x-added") && !esl_event_get_header(event, "variable_list"), "round %d: deleted headers are still there",
+			  round);
+		check((val = esl_event_get_header(event, "x-printf")) && !strcmp(val, body + 5), "round %d: X-Printf is %s", round, STR_NIL(val));
+
+		if (round < 2) {
+			arena = esl_event_release_arena(&event);
+		} else {
+			esl_event_destroy(&event);
+		}
+	}
+
+	free(data);
+}
+
+#define POOL_CONNS 16
+
+static struct {
+	int sock;
+	esl_port_t port;
+	esl_mutex_t *mutex;
+	int conns;
+	int accepting;
+} server;
+
+static int read_command(int sock, char *buf, size_t len)
+{
+	size_t n = 0;
+
+	while (n + 1 < len && recv(sock, buf + n, 1, 0) == 1) {
+		n++;
+		if (n >= 2 && buf[n - 1] == '\n' && buf[n - 2] == '\n') {
+			buf[n] = '\0';
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static void send_str(int sock, const char *str)
+{
+	esl_size_t len = strlen(str);
+
+	if (send(sock, str, len, 0) != (ssize_t) len) {
+		fprintf(stderr, "fake server: short write\n");
+	}
+}
+
+static void *server_conn_run(esl_thread_t *thread, void *obj)
+{
+	int sock = (int) (intptr_t) obj, id;
+	char buf[1024], reply[256], body[32];
+
+	esl_mutex_lock(server.mutex);
+	id = server.conns++;
+	esl_mutex_unlock(server.mutex);
+
+	send_str(sock, "Content-Type: auth/request\n\n");
+
+	while (read_command(sock, buf, sizeof(buf))) {
+		if (!strncmp(buf, "auth ", 5)) {
+			send_str(sock, "Content-Type: command/reply\nReply-Text: +OK accepted\n\n");
+		} else if (!strncmp(buf, "api drop", 8)) {
+			break;
+		} else if (!strncmp(buf, "api ", 4)) {
+			if (!strncmp(buf, "api slow", 8)) {
+				usleep(300000);
+			}
+			snprintf(body, sizeof(body), "%d", id);
+			snprintf(reply, sizeof(reply), "Content-Type: api/response\nContent-Length: %d\n\n%s", (int) strlen(body), body);
+			send_str(sock, reply);
+		} else {
+			send_str(sock, "Content-Type: command/reply\nReply-Text: -ERR command not found\n\n");
+		}
+	}
+
+	close(sock);
+
+	return NULL;
+}
+
+static void *server_run(esl_thread_t *thread, void *obj)
+{
+	int sock;
+
+	while (server.accepting && (sock = accept(server.sock, NULL, NULL)) >= 0) {
+		esl_thread_create_detached(server_conn_run, (void *) (intptr_t) sock);
+	}
+
+	return NULL;
+}
+
+static int server_start(void)
+{
+	struct sockaddr_in sin;
+	socklen_t slen = sizeof(sin);
+	int on = 1;
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if ((server.sock = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+		return 0;
+	}
+
+	setsockopt(server.sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+	if (bind(server.sock, (struct sockaddr *) &sin, sizeof(sin)) || listen(server.sock, POOL_CONNS) ||
+		getsockname(server.sock, (struct sockaddr *) &sin, &slen)) {
+		close(server.sock);
+		return 0;
+	}
+
+	server.port = ntohs(sin.sin_port);
+	server.accepting = 1;
+	esl_mutex_create(&server.mutex);
+	esl_thread_create_detached(server_run, NULL);
+
+	return 1;
+}
+
+static int pool_conn(esl_pool_t *pool, const char *cmd)
+{
+	esl_event_t *reply = NULL;
+	int id = -1;
+
+	if (esl_pool_send_recv(pool, cmd, 5000, &reply) == ESL_SUCCESS && reply) {
+		check(!strcmp(STR_NIL(esl_event_get_header(reply, "content-type")), "api/response"), "%s: the reply is not an api/response", cmd);
+		id = reply->body ? atoi(reply->body) : -1;
+		esl_event_destroy(&reply);
+	}
+
+	return id;
+}
+
+static struct {
+	esl_pool_t *pool;
+	volatile int id;
+	volatile int done;
+} slow;
+
+static void *slow_run(esl_thread_t *thread, void *obj)
+{
+	slow.id = pool_conn(slow.pool, "api slow");
+	slow.done = 1;
+
+	return NULL;
+}
+
+/* a busy connection is skipped, it serves again once it is returned, a dropped one is replaced */
+static void test_pool(void)
+{
+	esl_pool_t *pool = NULL;
+	int a, b, i, id, seen_new = 0;
+
+	if (!server_start()) {
+		check(0, "cannot start the fake server");
+		return;
+	}
+
+	check(esl_pool_create(&pool, "127.0.0.1", server.port, NULL, "ClueCon", 2, 2000) == ESL_SUCCESS, "cannot create the pool");
+
+	if (!pool) {
+		return;
+	}
+
+	check(server.conns == 2, "the pool opened %d connections", server.conns);
+
+	a = pool_conn(pool, "api conn");
+	b = pool_conn(pool, "api conn");
+	check(a >= 0 && b >= 0 && a != b, "two commands in a row went to connections %d and %d", a, b);
+
+	/* while one connection is checked out every command goes to the other one */
+	slow.pool = pool;
+	esl_thread_create_detached(slow_run, NULL);
+	usleep(100000);
+
+	for (i = 0; i < 4; i++) {
+		id = pool_conn(pool, "api conn");
+		check(id >= 0 && id != slow.id, "command %d went to %d while the slow one was running", i, id);
+		check(!slow.done, "the slow command finished too early to check anything");
+	}
+
+	while (!slow.done) {
+		usleep(10000);
+	}
+
+	check(slow.id == a || slow.id == b, "the slow command ran on connection %d", slow.id);
+
+	/* returned, it takes commands again */
+	a = pool_conn(pool, "api conn");
+	b = pool_conn(pool, "api conn");
+	check((a == slow.id) != (b == slow.id), "the returned connection did not serve again, got %d and %d", a, b);
+
+	check(esl_pool_send_recv(pool, "api drop", 1000, NULL) != ESL_SUCCESS, "a dropped command reported success");
+
+	for (i = 0; i < 2; i++) {
+		id = pool_conn(pool, "api conn");
+		check(id >= 0, "command %d after the drop failed", i);
+		if (id == 2) {
+			seen_new = 1;
+		}
+	}
+
+	check(seen_new && server.conns == 3, "the dropped connection was not replaced, %d connections", server.conns);
+
+	esl_pool_destroy(&pool);
+	check(!pool, "destroy left the pool pointer set");
+
+	server.accepting = 0;
+	shutdown(server.sock, SHUT_RDWR);
+	close(server.sock);
+}
+
+int main(int argc, char *argv[])
+{
+	test_arena_oversized();
+	test_arena_added_headers();
+	test_pool();
+
+	if (failures) {
+		fprintf(stderr, "esltest: %d check(s) failed\n", failures);
+		return 1;
+	}
+
+	printf("esltest: ok\n");
+	return 0;
+}
@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <esl.h>
+
+/*
+ * Parse and serialize throughput of text/event-plain against text/event-binary,
+ * with and without an event arena.
+ *
+ * usage: eventbench [capture] [rounds]
+ *
+ * The capture is what a client reads after "event plain ALL", Content-Length framed
+ * text/event-plain packets back to back (eventbench.events by default).
+ */
+
+typedef struct {
+	char *plain;
+	esl_size_t plain_len;
+	char *binary;
+	esl_size_t binary_len;
+	esl_event_t *event;
+} bench_event_t;
+
+static double now_sec(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static char *load_file(const char *path, size_t *len)
+{
+	FILE *fp;
+	char *data;
+	long size;
+
+	if (!(fp = fopen(path, "rb"))) {
+		return NULL;
+	}
+
+	fseek(fp, 0, SEEK_END);
+	size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+
+	data = malloc(size + 1);
+	esl_assert(data);
+
+	if (fread(data, 1, size, fp) != (size_t) size) {
+		free(data);
+		fclose(fp);
+		return NULL;
+	}
+
+	data[size] = '\0';
+	*len = size;
+	fclose(fp);
+
+	return data;
+}
+
+/* Split the capture on its envelopes, only text/event-plain bodies are kept */
+static int load_events(char *data, size_t len, bench_event_t **events)
+{
+	char *p = data, *end = data + len, *hdr_end;
+	const char *cl, *ct;
+	bench_event_t *list = NULL;
+	int count = 0, alloc = 0;
+
+	while (p < end && (hdr_end = strstr(p, "\n\n"))) {
+		long blen;
+
+		*hdr_end = '\0';
+		cl = esl_stristr("Content-Length:", p);
+		ct = esl_stristr("Content-Type:", p);
+
+		if (!cl || (blen = atol(cl + 15)) <= 0 || hdr_end + 2 + blen > end) {
+			break;
+		}
+
+		if (ct && strstr(ct, "text/event-plain")) {
+			if (count == alloc) {
+				alloc = alloc ? alloc * 2 : 256;
+				list = realloc(list, alloc * sizeof(*list));
+				esl_assert(list);
+			}
+
+			memset(&list[count], 0, sizeof(list[count]));
+			list[count].plain = malloc(blen + 1);
+			esl_assert(list[count].plain);
+			memcpy(list[count].plain, hdr_end + 2, blen);
+			list[count].plain[blen] = '\0';
+			list[count].plain_len = blen;
+			count++;
+		}
+
+		p = hdr_end + 2 + blen;
+	}
+
+	*events = list;
+	return count;
+}
+
+static void report(const char *what, int n, double secs, double bytes)
+{
+	printf("%-20s %10.0f events/s %10.1f MB/s\n", what, n / secs, bytes / secs / (1024 * 1024));
+}
+
+int main(int argc, char *argv[])
+{
+	const char *path = argc > 1 ? argv[1] : "eventbench.events";
+	int rounds = argc > 2 ? atoi(argv[2]) : 200;
+	bench_event_t *events = NULL;
+	esl_event_arena_t *arena;
+	double start, plain_bytes = 0, binary_bytes = 0;
+	size_t len;
+	char *data, *str;
+	esl_size_t slen;
+	esl_event_t *event;
+	int count, i, r, n;
+
+	if (!(data = load_file(path, &len))) {
+		fprintf(stderr, "cannot read %s\n", path);
+		return 1;
+	}
+
+	if (!(count = load_events(data, len, &events))) {
+		fprintf(stderr, "no text/event-plain packets in %s\n", path);
+		return 1;
+	}
+
+	if (rounds <= 0) {
+		rounds = 1;
+	}
+
+	for (i = 0; i < count; i++) {
+		esl_event_create_plain(&events[i].event, events[i].plain);
+		esl_event_serialize_binary(events[i].event, &events[i].binary, &events[i].binary_len);
+		plain_bytes += events[i].plain_len;
+		binary_bytes += events[i].binary_len;
+
+		/* both forms must describe the same event */
+		if (esl_event_create_binary(&event, events[i].binary, events[i].binary_len) != ESL_SUCCESS) {
+			fprintf(stderr, "event %d does not survive the binary round trip\n", i);
+			return 1;
+		} else {
+			esl_event_header_t *a = events[i].event->headers, *b = event->headers;
+
+			for (; a && b; a = a->next, b = b->next) {
+				if (strcmp(a->name, b->name) || strcmp(a->value, b->value)) {
+					break;
+				}
+			}
+
+			if (a || b || (events[i].event->body && (!event->body || strcmp(events[i].event->body, event->body)))) {
+				fprintf(stderr, "event %d differs after the binary round trip\n", i);
+				return 1;
+			}
+		}
+		esl_event_destroy(&event);
+	}
+
+	n = count * rounds;
+
+	printf("%d events, %d rounds, average size plain %.0f bytes binary %.0f bytes\n", count, rounds, plain_bytes / count, binary_bytes / count);
+
+	start = now_sec();
+	for (r = 0; r < rounds; r++) {
+		for (i = 0; i < count; i++) {
+			esl_event_create_plain(&event, events[i].plain);
+			esl_event_destroy(&event);
+		}
+	}
+	report("parse plain", n, now_sec() - start, plain_bytes * rounds);
+
+	start = now_sec();
+	for (r = 0; r < rounds; r++) {
+		for (i = 0; i < count; i++) {
+			esl_event_create_binary(&event, events[i].binary, events[i].binary_len);
+			esl_event_destroy(&event);
+		}
+	}
+	report("parse binary", n, now_sec() - start, binary_bytes * rounds);
+
+	/* the way esl_recv_event parses, each event reuses the arena of the one before */
+	esl_event_arena_create(&arena, ESL_EVENT_ARENA_SIZE);
+	start = now_sec();
+	for (r = 0; r < rounds; r++) {
+		for (i = 0; i < count; i++) {
+			esl_event_create_plain_arena(&event, events[i].plain, arena);
+			arena = esl_event_release_arena(&event);
+		}
+	}
+	report("parse plain arena", n, now_sec() - start, plain_bytes * rounds);
+
+	start = now_sec();
+	for (r = 0; r < rounds; r++) {
+		for (i = 0; i < count; i++) {
+			esl_event_create_binary_arena(&event, events[i].binary, events[i].binary_len, arena);
+			arena = esl_event_release_arena(&event);
+		}
+	}
+	report("parse binary arena", n, now_sec() - start, binary_bytes * rounds);
+	esl_event_arena_destroy(&arena);
+
+	start = now_sec();
+	for (r = 0; r < rounds; r++) {
+		for (i = 0; i < count; i++) {
+			esl_event_serialize(events[i].event, &str, ESL_TRUE);
+			free(str);
+		}
+	}
+	report("serialize plain", n, now_sec() - start, plain_bytes * rounds);
+
+	start = now_sec();
+	for (r = 0; r < rounds; r++) {
+		for (i = 0; i < count; i++) {
+			esl_event_serialize_binary(events[i].event, &str, &slen);
+			free(str);
+		}
+	}
+	report("serialize binary", n, now_sec() - start, binary_bytes * rounds);
+
+	for (i = 0; i < count; i++) {
+		esl_event_destroy(&events[i].event);
+		free(events[i].plain);
+		free(events[i].binary);
+	}
+	free(events);
+	free(data);
+
+	return 0;
+}
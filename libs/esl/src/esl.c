@@ -612,6 +612,8 @@ ESL_DECLARE(esl_status_t) esl_events(esl_handle_t *handle, esl_event_type_t etyp
 		type = "xml";
 	} else if (etype == ESL_EVENT_TYPE_JSON) {
 		type = "json";
+	} else if (etype == ESL_EVENT_TYPE_BINARY) {
+		type = "binary";
 	}
 
 	snprintf(send_buf, sizeof(send_buf), "event %s %s\n\n", type, value);
@@ -1004,6 +1006,77 @@ ESL_DECLARE(esl_status_t) esl_connect_timeout(esl_handle_t *handle, const char *
 	return ESL_FAIL;
 }
 
+static esl_event_arena_t *handle_arena(esl_handle_t *handle)
+{
+	esl_event_arena_t *arena;
+
+	if (handle->arena_count) {
+		return handle->arenas[--handle->arena_count];
+	}
+
+	esl_event_arena_create(&arena, ESL_EVENT_ARENA_SIZE);
+
+	return arena;
+}
+
+/* Called with the handle mutex held */
+static void handle_event_destroy(esl_handle_t *handle, esl_event_t **event)
+{
+	esl_event_arena_t *arena;
+
+	if (*event && (arena = esl_event_release_arena(event))) {
+		if (handle->arena_count < ESL_HANDLE_ARENAS) {
+			handle->arenas[handle->arena_count++] = arena;
+		} else {
+			esl_event_arena_destroy(&arena);
+		}
+	}
+}
+
+static void event_list_append(esl_event_t **list, esl_event_t *event)
+{
+	esl_event_t *ep;
+
+	for (ep = *list; ep && ep->next; ep = ep->next);
+
+	if (ep) {
+		ep->next = event;
+	} else {
+		*list = event;
+	}
+}
+
+static void event_list_destroy(esl_event_t **list)
+{
+	esl_event_t *ep, *next;
+
+	for (ep = *list; ep; ep = next) {
+		next = ep->next;
+		esl_event_destroy(&ep);
+	}
+
+	*list = NULL;
+}
+
+static int is_reply(esl_event_t *event)
+{
+	const char *ct = esl_event_get_header(event, "content-type");
+
+	return !esl_safe_strcasecmp(ct, "api/response") || !esl_safe_strcasecmp(ct, "command/reply");
+}
+
+ESL_DECLARE(void) esl_recycle_event(esl_handle_t *handle, esl_event_t **event)
+{
+	if (handle->destroyed || !handle->mutex) {
+		esl_event_safe_destroy(event);
+		return;
+	}
+
+	esl_mutex_lock(handle->mutex);
+	handle_event_destroy(handle, event);
+	esl_mutex_unlock(handle->mutex);
+}
+
 ESL_DECLARE(esl_status_t) esl_disconnect(esl_handle_t *handle)
 {
 	esl_mutex_t *mutex = handle->mutex;
@@ -1020,12 +1093,17 @@ ESL_DECLARE(esl_status_t) esl_disconnect(esl_handle_t *handle)
 	handle->destroyed = 1;
 	handle->connected = 0;
 
-	esl_event_safe_destroy(&handle->race_event);
+	event_list_destroy(&handle->race_event);
+	event_list_destroy(&handle->pipeline_replies);
 	esl_event_safe_destroy(&handle->last_event);
 	esl_event_safe_destroy(&handle->last_sr_event);
 	esl_event_safe_destroy(&handle->last_ievent);
 	esl_event_safe_destroy(&handle->info_event);
 
+	while (handle->arena_count) {
+		esl_event_arena_destroy(&handle->arenas[--handle->arena_count]);
+	}
+
 	if (handle->sock != ESL_SOCK_INVALID) {
 		closesocket(handle->sock);
 		handle->sock = ESL_SOCK_INVALID;
@@ -1121,12 +1199,9 @@ static esl_ssize_t handle_recv(esl_handle_t *handle, void *data, esl_size_t data
 
 ESL_DECLARE(esl_status_t) esl_recv_event(esl_handle_t *handle, int check_q, esl_event_t **save_event)
 {
-	char *c;
 	esl_ssize_t rrval;
 	esl_event_t *revent = NULL;
-	char *beg;
 	char *hname, *hval;
-	char *col;
 	char *cl;
 	esl_ssize_t len;
 	int zc = 0;
@@ -1141,7 +1216,7 @@ ESL_DECLARE(esl_status_t) esl_recv_event(esl_handle_t *handle, int check_q, esl_
 		goto fail;
 	}
 
-	esl_event_safe_destroy(&handle->last_ievent);
+	handle_event_destroy(handle, &handle->last_ievent);
 	
 	if (check_q && handle->race_event) {
 		revent = handle->race_event;
@@ -1161,7 +1236,8 @@ ESL_DECLARE(esl_status_t) esl_recv_event(esl_handle_t *handle, int check_q, esl_
 
 			*(data + len1) = '\0';
 			
-			esl_event_create(&revent, ESL_EVENT_CLONE);
+			/* the envelope and everything in it live in one arena, reused from an event that is gone */
+			esl_event_create_arena(&revent, ESL_EVENT_CLONE, handle_arena(handle));
 			revent->event_id = ESL_EVENT_SOCKET_DATA;
 			esl_event_add_header_string(revent, ESL_STACK_BOTTOM, "Event-Name", "SOCKET_DATA");
 			
@@ -1224,8 +1300,7 @@ ESL_DECLARE(esl_status_t) esl_recv_event(esl_handle_t *handle, int check_q, esl_
 		esl_ssize_t sofar = 0;
 		
 		len = atol(cl);
-		body = malloc(len+1);
-		esl_assert(body);
+		body = esl_event_arena_alloc(revent->arena, len+1);
 		*(body + len) = '\0';
 		
 		do {
@@ -1263,7 +1338,7 @@ ESL_DECLARE(esl_status_t) esl_recv_event(esl_handle_t *handle, int check_q, esl_
 		*save_event = revent;
 		revent = NULL;
 	} else {
-		esl_event_safe_destroy(&handle->last_event);
+		handle_event_destroy(handle, &handle->last_event);
 		handle->last_event = revent;
 	}
 	
@@ -1285,57 +1360,7 @@ ESL_DECLARE(esl_status_t) esl_recv_event(esl_handle_t *handle, int check_q, esl_
 		
 		if (revent->body) {
 			if (!esl_safe_strcasecmp(hval, "text/event-plain")) {
-				esl_event_types_t et = ESL_EVENT_CLONE;
-				char *body = strdup(revent->body);
-			
-				esl_event_create(&handle->last_ievent, et);
-
-				beg = body;
-
-				while(beg) {
-					if (!(c = strchr(beg, '\n'))) {
-						break;
-					}
-
-					hname = beg;
-					hval = col = NULL;
-			
-					if (hname && (col = strchr(hname, ':'))) {
-						hval = col + 1;
-						*col = '\0';
-						while(*hval == ' ') hval++;
-					}
-				
-					*c = '\0';
-			
-					if (hname && hval) {
-						esl_url_decode(hval);
-						esl_log(ESL_LOG_DEBUG, "RECV INNER HEADER [%s] = [%s]\n", hname, hval);
-						if (!strcasecmp(hname, "event-name")) {
-							esl_event_del_header(handle->last_ievent, "event-name");
-						        esl_name_event(hval, &handle->last_ievent->event_id);
-						}
-
-						if (!strncmp(hval, "ARRAY::", 7)) {
-							esl_event_add_array(handle->last_ievent, hname, hval);
-						} else {
-							esl_event_add_header_string(handle->last_ievent, ESL_STACK_BOTTOM, hname, hval);
-						}
-					}
-				
-					beg = c + 1;
-
-					if (*beg == '\n') {
-						beg++;
-						break;
-					}
-				}
-			
-				if ((cl = esl_event_get_header(handle->last_ievent, "content-length"))) {
-					handle->last_ievent->body = strdup(beg);
-				}
-			
-				free(body);			
+				esl_event_create_plain_arena(&handle->last_ievent, revent->body, handle_arena(handle));
 
 				if (esl_log_level >= 7) {
 					char *foo;
@@ -1345,6 +1370,12 @@ ESL_DECLARE(esl_status_t) esl_recv_event(esl_handle_t *handle, int check_q, esl_
 				}
 			} else if (!esl_safe_strcasecmp(hval, "text/event-json")) {
 				esl_event_create_json(&handle->last_ievent, revent->body);
+			} else if (!esl_safe_strcasecmp(hval, "text/event-binary")) {
+				/* the body may hold NULs, its length comes from the envelope */
+				cl = esl_event_get_header(revent, "content-length");
+				if (!cl || esl_event_create_binary_arena(&handle->last_ievent, revent->body, atol(cl), handle_arena(handle)) != ESL_SUCCESS) {
+					esl_log(ESL_LOG_ERROR, "Malformed binary event\n");
+				}
 			}
 		}
 
@@ -1418,7 +1449,7 @@ ESL_DECLARE(esl_status_t) esl_send_recv_timed(esl_handle_t *handle, const char *
 		return ESL_FAIL;
 	}
 
-	esl_event_safe_destroy(&handle->last_sr_event);
+	handle_event_destroy(handle, &handle->last_sr_event);
 
 	*handle->last_sr_reply = '\0';
 
@@ -1432,19 +1463,15 @@ ESL_DECLARE(esl_status_t) esl_send_recv_timed(esl_handle_t *handle, const char *
 	status = esl_recv_event_timed(handle, ms, 0, &handle->last_sr_event);
 
 	if (handle->last_sr_event) {
-		char *ct = esl_event_get_header(handle->last_sr_event,"content-type");
-
-		if (strcasecmp(ct, "api/response") && strcasecmp(ct, "command/reply")) {
-			esl_event_t *ep;
+		/* replies to pipelined commands sent earlier come first */
+		int pipelined = is_reply(handle->last_sr_event) && handle->pipeline_recvd != handle->pipeline_sent;
 
-			for(ep = handle->race_event; ep && ep->next; ep = ep->next);
-			
-			if (ep) {
-				ep->next = handle->last_sr_event;
-			} else {
-				handle->race_event = handle->last_sr_event;
-			}
+		if (pipelined) {
+			handle->pipeline_recvd++;
+		}
 
+		if (pipelined || !is_reply(handle->last_sr_event)) {
+			event_list_append(pipelined ? &handle->pipeline_replies : &handle->race_event, handle->last_sr_event);
 			handle->last_sr_event = NULL;
 			
 			esl_mutex_unlock(handle->mutex);
@@ -1474,6 +1501,277 @@ ESL_DECLARE(esl_status_t) esl_send_recv_timed(esl_handle_t *handle, const char *
 }
 
 
+ESL_DECLARE(esl_status_t) esl_send_pipelined(esl_handle_t *handle, const char *cmd, uint32_t *id)
+{
+	esl_status_t status;
+
+	if (!handle || !handle->connected || handle->sock == ESL_SOCK_INVALID) {
+		return ESL_FAIL;
+	}
+
+	esl_mutex_lock(handle->mutex);
+
+	if ((status = esl_send(handle, cmd)) == ESL_SUCCESS) {
+		handle->pipeline_sent++;
+
+		if (id) {
+			*id = handle->pipeline_sent;
+		}
+	}
+
+	esl_mutex_unlock(handle->mutex);
+
+	return status;
+}
+
+ESL_DECLARE(esl_status_t) esl_recv_reply_timed(esl_handle_t *handle, uint32_t ms, uint32_t *id, esl_event_t **reply)
+{
+	esl_status_t status = ESL_SUCCESS;
+	esl_event_t *revent;
+
+	*reply = NULL;
+
+	if (!handle || !handle->mutex || handle->destroyed) {
+		return ESL_FAIL;
+	}
+
+	esl_mutex_lock(handle->mutex);
+
+	while (!handle->pipeline_replies) {
+		if (handle->pipeline_recvd == handle->pipeline_sent) {
+			status = ESL_FAIL;
+			break;
+		}
+
+		revent = NULL;
+
+		if ((status = esl_recv_event_timed(handle, ms, 0, &revent)) != ESL_SUCCESS || !revent) {
+			if (status == ESL_SUCCESS) {
+				status = ESL_FAIL;
+			}
+			break;
+		}
+
+		if (is_reply(revent)) {
+			handle->pipeline_recvd++;
+			event_list_append(&handle->pipeline_replies, revent);
+		} else {
+			event_list_append(&handle->race_event, revent);
+		}
+	}
+
+	if (handle->pipeline_replies) {
+		*reply = handle->pipeline_replies;
+		handle->pipeline_replies = (*reply)->next;
+		(*reply)->next = NULL;
+
+		if (id) {
+			*id = ++handle->pipeline_done;
+		} else {
+			handle->pipeline_done++;
+		}
+
+		status = ESL_SUCCESS;
+	}
+
+	esl_mutex_unlock(handle->mutex);
+
+	return status;
+}
+
+typedef struct esl_pool_member {
+	esl_handle_t handle;
+	/* held while a command runs on this connection */
+	esl_mutex_t *mutex;
+} esl_pool_member_t;
+
+struct esl_pool {
+	char *host;
+	esl_port_t port;
+	char *user;
+	char *password;
+	uint32_t timeout;
+	uint32_t size;
+	uint32_t next;
+	esl_mutex_t *mutex;
+	esl_pool_member_t *members;
+};
+
+static esl_status_t pool_connect(esl_pool_t *pool, esl_pool_member_t *member)
+{
+	if (member->handle.mutex) {
+		esl_disconnect(&member->handle);
+	}
+
+	memset(&member->handle, 0, sizeof(member->handle));
+
+	return esl_connect_timeout(&member->handle, pool->host, pool->port, pool->user, pool->password, pool->timeout);
+}
+
+/* A connection nobody is using, starting from the next one in turn. When all of them are busy
+   the caller waits for that one. Returned locked. */
+static esl_pool_member_t *pool_acquire(esl_pool_t *pool)
+{
+	esl_pool_member_t *member = NULL;
+	uint32_t i, start;
+
+	esl_mutex_lock(pool->mutex);
+	start = pool->next++ % pool->size;
+	esl_mutex_unlock(pool->mutex);
+
+	for (i = 0; i < pool->size; i++) {
+		esl_pool_member_t *mp = &pool->members[(start + i) % pool->size];
+
+		if (esl_mutex_trylock(mp->mutex) == ESL_SUCCESS) {
+			member = mp;
+			break;
+		}
+	}
+
+	if (!member) {
+		member = &pool->members[start];
+		esl_mutex_lock(member->mutex);
+	}
+
+	if (!member->handle.connected && pool_connect(pool, member) != ESL_SUCCESS) {
+		esl_log(ESL_LOG_ERROR, "Pool connection to %s:%d failed: %s\n", pool->host, pool->port, member->handle.err);
+		esl_mutex_unlock(member->mutex);
+		return NULL;
+	}
+
+	return member;
+}
+
+ESL_DECLARE(esl_status_t) esl_pool_create(esl_pool_t **pool, const char *host, esl_port_t port, const char *user, const char *password, uint32_t size, uint32_t timeout)
+{
+	esl_pool_t *new_pool;
+	uint32_t i;
+
+	*pool = NULL;
+
+	if (!size || esl_strlen_zero(host) || !password) {
+		return ESL_FAIL;
+	}
+
+	new_pool = calloc(1, sizeof(*new_pool));
+	esl_assert(new_pool);
+	new_pool->members = calloc(size, sizeof(*new_pool->members));
+	esl_assert(new_pool->members);
+
+	new_pool->host = strdup(host);
+	new_pool->port = port;
+	new_pool->user = user ? strdup(user) : NULL;
+	new_pool->password = strdup(password);
+	new_pool->timeout = timeout;
+	new_pool->size = size;
+	esl_mutex_create(&new_pool->mutex);
+
+	for (i = 0; i < size; i++) {
+		esl_mutex_create(&new_pool->members[i].mutex);
+	}
+
+	for (i = 0; i < size; i++) {
+		if (pool_connect(new_pool, &new_pool->members[i]) != ESL_SUCCESS) {
+			esl_log(ESL_LOG_ERROR, "Pool connection %u to %s:%d failed: %s\n", i, host, port, new_pool->members[i].handle.err);
+			esl_pool_destroy(&new_pool);
+			return ESL_FAIL;
+		}
+	}
+
+	*pool = new_pool;
+
+	return ESL_SUCCESS;
+}
+
+ESL_DECLARE(void) esl_pool_destroy(esl_pool_t **pool)
+{
+	esl_pool_t *pp = *pool;
+	uint32_t i;
+
+	if (!pp) {
+		return;
+	}
+
+	for (i = 0; i < pp->size; i++) {
+		if (pp->members[i].handle.mutex) {
+			esl_disconnect(&pp->members[i].handle);
+		}
+		esl_mutex_destroy(&pp->members[i].mutex);
+	}
+
+	esl_mutex_destroy(&pp->mutex);
+	esl_safe_free(pp->members);
+	esl_safe_free(pp->host);
+	esl_safe_free(pp->user);
+	esl_safe_free(pp->password);
+	free(pp);
+
+	*pool = NULL;
+}
+
+ESL_DECLARE(esl_status_t) esl_pool_send_recv(esl_pool_t *pool, const char *cmd, uint32_t ms, esl_event_t **reply)
+{
+	esl_pool_member_t *member;
+	esl_status_t status;
+
+	if (reply) {
+		*reply = NULL;
+	}
+
+	if (!(member = pool_acquire(pool))) {
+		return ESL_FAIL;
+	}
+
+	if ((status = esl_send_recv_timed(&member->handle, cmd, ms)) == ESL_SUCCESS && reply) {
+		/* the reply changes hands instead of being copied */
+		*reply = member->handle.last_sr_event;
+		member->handle.last_sr_event = NULL;
+	}
+
+	esl_mutex_unlock(member->mutex);
+
+	return status;
+}
+
+ESL_DECLARE(esl_status_t) esl_pool_bgapi(esl_pool_t *pool, const char *cmd, char *job_uuid, esl_size_t len)
+{
+	esl_event_t *reply = NULL;
+	esl_status_t status;
+	const char *hval;
+	char *bgcmd;
+
+	if (esl_strlen_zero(cmd)) {
+		return ESL_FAIL;
+	}
+
+	if (job_uuid && len) {
+		*job_uuid = '\0';
+	}
+
+	bgcmd = malloc(strlen(cmd) + 7);
+	esl_assert(bgcmd);
+	sprintf(bgcmd, "bgapi %s", cmd);
+	status = esl_pool_send_recv(pool, bgcmd, 0, &reply);
+	free(bgcmd);
+
+	if (status != ESL_SUCCESS) {
+		return status;
+	}
+
+	hval = esl_event_get_header(reply, "reply-text");
+
+	if (esl_strlen_zero(hval) || strncmp(hval, "+OK", 3)) {
+		status = ESL_FAIL;
+	} else if (job_uuid && len && (hval = esl_event_get_header(reply, "job-uuid"))) {
+		esl_copy_string(job_uuid, hval, len);
+		job_uuid[len - 1] = '\0';
+	}
+
+	esl_event_destroy(&reply);
+
+	return status;
+}
+
 ESL_DECLARE(unsigned int) esl_separate_string_string(char *buf, const char *delim, char **array, unsigned int arraylen)
 {
 	unsigned int count = 0;
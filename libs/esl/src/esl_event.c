@@ -54,6 +54,151 @@ static char *my_dup(const char *s)
 #define FREE(ptr) esl_safe_free(ptr)
 #endif
 
+typedef struct esl_event_arena_chunk {
+	struct esl_event_arena_chunk *next;
+	esl_size_t size;
+	esl_size_t used;
+	char *data;
+} esl_event_arena_chunk_t;
+
+struct esl_event_arena {
+	/* the chunk allocations come from, older full ones follow it */
+	esl_event_arena_chunk_t *chunks;
+	esl_size_t chunk_size;
+};
+
+#define ARENA_ALIGN(_l) (((_l) + sizeof(void *) - 1) & ~(sizeof(void *) - 1))
+
+static esl_event_arena_chunk_t *arena_chunk_create(esl_size_t size)
+{
+	esl_event_arena_chunk_t *chunk;
+
+	/* the chunk header and its data share one allocation */
+	chunk = malloc(ARENA_ALIGN(sizeof(*chunk)) + size);
+	esl_assert(chunk);
+	chunk->next = NULL;
+	chunk->size = size;
+	chunk->used = 0;
+	chunk->data = (char *) chunk + ARENA_ALIGN(sizeof(*chunk));
+
+	return chunk;
+}
+
+ESL_DECLARE(esl_status_t) esl_event_arena_create(esl_event_arena_t **arena, esl_size_t size)
+{
+	esl_event_arena_t *new_arena;
+
+	if (!size) {
+		size = 8192;
+	}
+
+	new_arena = malloc(sizeof(*new_arena));
+	esl_assert(new_arena);
+	new_arena->chunk_size = ARENA_ALIGN(size);
+	new_arena->chunks = arena_chunk_create(new_arena->chunk_size);
+
+	*arena = new_arena;
+
+	return ESL_SUCCESS;
+}
+
+ESL_DECLARE(void) esl_event_arena_destroy(esl_event_arena_t **arena)
+{
+	esl_event_arena_t *ap = *arena;
+	esl_event_arena_chunk_t *chunk, *next;
+
+	if (ap) {
+		for (chunk = ap->chunks; chunk; chunk = next) {
+			next = chunk->next;
+			free(chunk);
+		}
+		free(ap);
+	}
+
+	*arena = NULL;
+}
+
+ESL_DECLARE(void *) esl_event_arena_alloc(esl_event_arena_t *arena, esl_size_t len)
+{
+	esl_event_arena_chunk_t *chunk = arena->chunks;
+	void *ptr;
+
+	len = ARENA_ALIGN(len ? len : 1);
+
+	if (chunk->used + len > chunk->size) {
+		chunk = arena_chunk_create(len > arena->chunk_size ? len : arena->chunk_size);
+		chunk->next = arena->chunks;
+		arena->chunks = chunk;
+	}
+
+	ptr = chunk->data + chunk->used;
+	chunk->used += len;
+
+	return ptr;
+}
+
+/* Empty the arena for the next event. Chunks added for an event that did not fit are freed, only the
+   first one of the default size is kept, so one oversized event does not grow the arena for good */
+static void arena_reset(esl_event_arena_t *arena)
+{
+	esl_event_arena_chunk_t *chunk, *next;
+
+	for (chunk = arena->chunks; chunk->next; chunk = next) {
+		next = chunk->next;
+		free(chunk);
+	}
+
+	arena->chunks = chunk;
+	arena->chunks->used = 0;
+}
+
+static int arena_owns(esl_event_arena_t *arena, const void *ptr)
+{
+	esl_event_arena_chunk_t *chunk;
+
+	for (chunk = arena->chunks; chunk; chunk = chunk->next) {
+		if ((const char *) ptr >= chunk->data && (const char *) ptr < chunk->data + chunk->size) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/* Anything an arena event points at may come from the arena or from malloc (arrays, values set later on) */
+static void event_free(esl_event_t *event, void *ptr)
+{
+	if (ptr && !(event->arena && arena_owns(event->arena, ptr))) {
+		free(ptr);
+	}
+}
+
+static void *event_alloc(esl_event_t *event, esl_size_t len)
+{
+	void *ptr;
+
+	if (event->arena) {
+		return esl_event_arena_alloc(event->arena, len);
+	}
+
+	ptr = ALLOC(len);
+	esl_assert(ptr);
+
+	return ptr;
+}
+
+static char *event_dup(esl_event_t *event, const char *s)
+{
+	size_t len;
+
+	if (!event->arena) {
+		return DUP(s);
+	}
+
+	len = strlen(s) + 1;
+	return (char *) memcpy(esl_event_arena_alloc(event->arena, len), s, len);
+}
+
 /* make sure this is synced with the esl_event_types_t enum in esl_types.h
    also never put any new ones before EVENT_ALL
 */
@@ -161,7 +306,7 @@ ESL_DECLARE(esl_status_t) esl_name_event(const char *name, esl_event_types_t *ty
 }
 
 
-ESL_DECLARE(esl_status_t) esl_event_create_subclass(esl_event_t **event, esl_event_types_t event_id, const char *subclass_name)
+static esl_status_t event_create(esl_event_t **event, esl_event_types_t event_id, const char *subclass_name, esl_event_arena_t *arena)
 {
 	*event = NULL;
 
@@ -169,11 +314,16 @@ ESL_DECLARE(esl_status_t) esl_event_create_subclass(esl_event_t **event, esl_eve
 		return ESL_FAIL;
 	}
 
-	*event = ALLOC(sizeof(esl_event_t));
+	if (arena) {
+		*event = esl_event_arena_alloc(arena, sizeof(esl_event_t));
+	} else {
+		*event = ALLOC(sizeof(esl_event_t));
+	}
 	esl_assert(*event);
 
 
 	memset(*event, 0, sizeof(esl_event_t));
+	(*event)->arena = arena;
 
 	if (event_id != ESL_EVENT_CLONE) {
 		(*event)->event_id = event_id;
@@ -181,13 +331,23 @@ ESL_DECLARE(esl_status_t) esl_event_create_subclass(esl_event_t **event, esl_eve
 	}
 
 	if (subclass_name) {
-		(*event)->subclass_name = DUP(subclass_name);
+		(*event)->subclass_name = event_dup(*event, subclass_name);
 		esl_event_add_header_string(*event, ESL_STACK_BOTTOM, "Event-Subclass", subclass_name);
 	}	
 	
 	return ESL_SUCCESS;
 }
 
+ESL_DECLARE(esl_status_t) esl_event_create_subclass(esl_event_t **event, esl_event_types_t event_id, const char *subclass_name)
+{
+	return event_create(event, event_id, subclass_name, NULL);
+}
+
+ESL_DECLARE(esl_status_t) esl_event_create_arena(esl_event_t **event, esl_event_types_t event_id, esl_event_arena_t *arena)
+{
+	return event_create(event, event_id, ESL_EVENT_SUBCLASS_ANY, arena);
+}
+
 
 ESL_DECLARE(const char *)esl_priority_name(esl_priority_t priority)
 {
@@ -308,26 +468,26 @@ ESL_DECLARE(esl_status_t) esl_event_del_header_val(esl_event_t *event, const cha
 			if (hp == event->last_header || !hp->next) {
 				event->last_header = lp;
 			}
-			FREE(hp->name);
+			event_free(event, hp->name);
 
 			if (hp->idx) {
 				int i = 0;
 
 				for (i = 0; i < hp->idx; i++) {
-					FREE(hp->array[i]);
+					event_free(event, hp->array[i]);
 				}
 				FREE(hp->array);
 			}
 
-			FREE(hp->value);
+			event_free(event, hp->value);
 			
 			memset(hp, 0, sizeof(*hp));
 #ifdef ESL_EVENT_RECYCLE
-			if (esl_queue_trypush(EVENT_HEADER_RECYCLE_QUEUE, hp) != ESL_SUCCESS) {
-				FREE(hp);
+			if (event->arena || esl_queue_trypush(EVENT_HEADER_RECYCLE_QUEUE, hp) != ESL_SUCCESS) {
+				event_free(event, hp);
 			}
 #else
-			FREE(hp);
+			event_free(event, hp);
 #endif
 			status = ESL_SUCCESS;
 		} else {
@@ -338,24 +498,23 @@ ESL_DECLARE(esl_status_t) esl_event_del_header_val(esl_event_t *event, const cha
 	return status;
 }
 
-static esl_event_header_t *new_header(const char *header_name)
+static esl_event_header_t *new_header(esl_event_t *event, const char *header_name)
 {
 	esl_event_header_t *header;
 
 #ifdef ESL_EVENT_RECYCLE
 		void *pop;
-		if (esl_queue_trypop(EVENT_HEADER_RECYCLE_QUEUE, &pop) == ESL_SUCCESS) {
+		if (!event->arena && esl_queue_trypop(EVENT_HEADER_RECYCLE_QUEUE, &pop) == ESL_SUCCESS) {
 			header = (esl_event_header_t *) pop;
 		} else {
 #endif
-			header = ALLOC(sizeof(*header));
-			esl_assert(header);
+			header = event_alloc(event, sizeof(*header));
 #ifdef ESL_EVENT_RECYCLE
 		}
 #endif	
 
 		memset(header, 0, sizeof(*header));
-		header->name = DUP(header_name);
+		header->name = event_dup(event, header_name);
 
 		return header;
 
@@ -433,7 +592,7 @@ static esl_status_t esl_event_base_add_header(esl_event_t *event, esl_stack_t st
 		
 		if (!(header = esl_event_get_header_ptr(event, header_name)) && index_ptr) {
 
-			header = new_header(header_name);
+			header = new_header(event, header_name);
 
 			if (esl_test_flag(event, ESL_EF_UNIQ_HEADERS)) {
 				esl_event_del_header(event, header_name);
@@ -447,8 +606,8 @@ static esl_status_t esl_event_base_add_header(esl_event_t *event, esl_stack_t st
 			if (index_ptr) {
 				if (index > -1 && index <= 4000) {
 					if (index < header->idx) {
-						FREE(header->array[index]);
-						header->array[index] = DUP(data);
+						event_free(event, header->array[index]);
+						header->array[index] = event_dup(event, data);
 					} else {
 						int i;
 						char **m;
@@ -457,9 +616,9 @@ static esl_status_t esl_event_base_add_header(esl_event_t *event, esl_stack_t st
 						esl_assert(m);
 						header->array = m;
 						for (i = header->idx; i < index; i++) {
-							m[i] = DUP("");
+							m[i] = event_dup(event, "");
 						}
-						m[index] = DUP(data);
+						m[index] = event_dup(event, data);
 						header->idx = index + 1;
 						if (!fly) {
 							exists = 1;
@@ -485,7 +644,7 @@ static esl_status_t esl_event_base_add_header(esl_event_t *event, esl_stack_t st
 
 		if (esl_strlen_zero(data)) {
 			esl_event_del_header(event, header_name);
-			FREE(data);
+			event_free(event, data);
 			goto end;
 		}
 
@@ -495,12 +654,12 @@ static esl_status_t esl_event_base_add_header(esl_event_t *event, esl_stack_t st
 
 		if (strstr(data, "ARRAY::")) {
 			esl_event_add_array(event, header_name, data);
-			FREE(data);
+			event_free(event, data);
 			goto end;
 		}
 
 
-		header = new_header(header_name);
+		header = new_header(event, header_name);
 	}
 	
 	if ((stack & ESL_STACK_PUSH) || (stack & ESL_STACK_UNSHIFT)) {
@@ -543,6 +702,10 @@ static esl_status_t esl_event_base_add_header(esl_event_t *event, esl_stack_t st
 
 		if (len) {
 			len += 8;
+			/* a value out of the arena can not be grown in place, the array rendering replaces it anyway */
+			if (event->arena && header->value && arena_owns(event->arena, header->value)) {
+				header->value = NULL;
+			}
 			hv = realloc(header->value, len);
 			esl_assert(hv);
 			header->value = hv;
@@ -604,17 +767,18 @@ ESL_DECLARE(esl_status_t) esl_event_add_header(esl_event_t *event, esl_stack_t s
 ESL_DECLARE(esl_status_t) esl_event_add_header_string(esl_event_t *event, esl_stack_t stack, const char *header_name, const char *data)
 {
 	if (data) {
-		return esl_event_base_add_header(event, stack, header_name, DUP(data));
+		return esl_event_base_add_header(event, stack, header_name, event_dup(event, data));
 	}
 	return ESL_FAIL;
 }
 
 ESL_DECLARE(esl_status_t) esl_event_set_body(esl_event_t *event, const char *body)
 {
-	esl_safe_free(event->body);
+	event_free(event, event->body);
+	event->body = NULL;
 
 	if (body) {
-		event->body = DUP(body);
+		event->body = event_dup(event, body);
 	}
 	
 	return ESL_SUCCESS;
@@ -634,7 +798,7 @@ ESL_DECLARE(esl_status_t) esl_event_add_body(esl_event_t *event, const char *fmt
 		if (ret == -1) {
 			return ESL_FAIL;
 		} else {
-			esl_safe_free(event->body);
+			event_free(event, event->body);
 			event->body = data;
 			return ESL_SUCCESS;
 		}
@@ -644,53 +808,84 @@ ESL_DECLARE(esl_status_t) esl_event_add_body(esl_event_t *event, const char *fmt
 }
 
 
-ESL_DECLARE(void) esl_event_destroy(esl_event_t **event)
+/* Frees everything the event points at, for an arena event that is only what was malloced after all */
+static void event_destroy_contents(esl_event_t *ep)
 {
-	esl_event_t *ep = *event;
 	esl_event_header_t *hp, *this;
 
-	if (ep) {
-		for (hp = ep->headers; hp;) {
-			this = hp;
-			hp = hp->next;
-			FREE(this->name);
+	for (hp = ep->headers; hp;) {
+		this = hp;
+		hp = hp->next;
+		event_free(ep, this->name);
 
-			if (this->idx) {
-				int i = 0;
+		if (this->idx) {
+			int i = 0;
 
-				for (i = 0; i < this->idx; i++) {
-					FREE(this->array[i]);
-				}
-				FREE(this->array);
+			for (i = 0; i < this->idx; i++) {
+				event_free(ep, this->array[i]);
 			}
+			FREE(this->array);
+		}
 
-			FREE(this->value);
+		event_free(ep, this->value);
 			
 
 #ifdef ESL_EVENT_RECYCLE
-			if (esl_queue_trypush(EVENT_HEADER_RECYCLE_QUEUE, this) != ESL_SUCCESS) {
-				FREE(this);
-			}
+		if (ep->arena || esl_queue_trypush(EVENT_HEADER_RECYCLE_QUEUE, this) != ESL_SUCCESS) {
+			event_free(ep, this);
+		}
 #else
-			FREE(this);
+		event_free(ep, this);
 #endif
 
 
-		}
-		FREE(ep->body);
-		FREE(ep->subclass_name);
+	}
+	event_free(ep, ep->body);
+	event_free(ep, ep->subclass_name);
+}
+
+ESL_DECLARE(void) esl_event_destroy(esl_event_t **event)
+{
+	esl_event_t *ep = *event;
+
+	if (ep) {
+		event_destroy_contents(ep);
+
+		if (ep->arena) {
+			/* the event itself lives in the arena */
+			esl_event_arena_t *arena = ep->arena;
+			esl_event_arena_destroy(&arena);
+		} else {
 #ifdef ESL_EVENT_RECYCLE
-		if (esl_queue_trypush(EVENT_RECYCLE_QUEUE, ep) != ESL_SUCCESS) {
-			FREE(ep);
-		}
+			if (esl_queue_trypush(EVENT_RECYCLE_QUEUE, ep) != ESL_SUCCESS) {
+				FREE(ep);
+			}
 #else
-		FREE(ep);
+			FREE(ep);
 #endif
+		}
 
 	}
 	*event = NULL;
 }
 
+ESL_DECLARE(esl_event_arena_t *) esl_event_release_arena(esl_event_t **event)
+{
+	esl_event_t *ep = *event;
+	esl_event_arena_t *arena = NULL;
+
+	if (ep && ep->arena) {
+		event_destroy_contents(ep);
+		arena = ep->arena;
+		arena_reset(arena);
+		*event = NULL;
+	} else {
+		esl_event_destroy(event);
+	}
+
+	return arena;
+}
+
 ESL_DECLARE(void) esl_event_merge(esl_event_t *event, esl_event_t *tomerge)
 {
 	esl_event_header_t *hp;
@@ -868,6 +1063,346 @@ ESL_DECLARE(esl_status_t) esl_event_serialize(esl_event_t *event, char **str, es
 	return ESL_SUCCESS;
 }
 
+ESL_DECLARE(esl_status_t) esl_event_create_plain(esl_event_t **event, const char *data)
+{
+	return esl_event_create_plain_arena(event, data, NULL);
+}
+
+ESL_DECLARE(esl_status_t) esl_event_create_plain_arena(esl_event_t **event, const char *data, esl_event_arena_t *arena)
+{
+	esl_event_t *new_event;
+	char *body, *beg, *c, *col, *hname, *hval;
+
+	if (esl_event_create_arena(&new_event, ESL_EVENT_CLONE, arena) != ESL_SUCCESS) {
+		return ESL_FAIL;
+	}
+
+	/* parsed in place, in an arena the decoded values are handed to the event as they are */
+	body = event_dup(new_event, data);
+	beg = body;
+
+	while(beg) {
+		if (!(c = strchr(beg, '\n'))) {
+			break;
+		}
+
+		hname = beg;
+		hval = col = NULL;
+
+		if (hname && (col = strchr(hname, ':'))) {
+			hval = col + 1;
+			*col = '\0';
+			while(*hval == ' ') hval++;
+		}
+
+		*c = '\0';
+
+		if (hname && hval) {
+			esl_url_decode(hval);
+			esl_log(ESL_LOG_DEBUG, "RECV INNER HEADER [%s] = [%s]\n", hname, hval);
+			if (!strcasecmp(hname, "event-name")) {
+				esl_event_del_header(new_event, "event-name");
+				esl_name_event(hval, &new_event->event_id);
+			}
+
+			if (!strncmp(hval, "ARRAY::", 7)) {
+				esl_event_add_array(new_event, hname, hval);
+			} else if (arena) {
+				esl_event_base_add_header(new_event, ESL_STACK_BOTTOM, hname, hval);
+			} else {
+				esl_event_add_header_string(new_event, ESL_STACK_BOTTOM, hname, hval);
+			}
+		}
+
+		beg = c + 1;
+
+		if (*beg == '\n') {
+			beg++;
+			break;
+		}
+	}
+
+	if (esl_event_get_header(new_event, "content-length")) {
+		new_event->body = arena ? beg : strdup(beg);
+	}
+
+	event_free(new_event, body);
+
+	*event = new_event;
+	return ESL_SUCCESS;
+}
+
+/* Header names the binary format sends as a one byte code (the index into this table).
+   Keep it identical to BINARY_HEADER_NAMES in src/switch_event.c and only ever append to it.
+*/
+static const char *BINARY_HEADER_NAMES[] = {
+	NULL,
+	"Event-Name", "Core-UUID", "FreeSWITCH-Hostname", "FreeSWITCH-Switchname", "FreeSWITCH-IPv4", "FreeSWITCH-IPv6",
+	"Event-Date-Local", "Event-Date-GMT", "Event-Date-Timestamp", "Event-Calling-File", "Event-Calling-Function",
+	"Event-Calling-Line-Number", "Event-Sequence", "Event-Subclass", "Event-Info", "Unique-ID", "Channel-State",
+	"Channel-Call-State", "Channel-State-Number", "Channel-Name", "Channel-Call-UUID", "Call-Direction",
+	"Presence-Call-Direction", "Channel-HIT-Dialplan", "Channel-Presence-ID", "Channel-Presence-Data", "Answer-State",
+	"Original-Channel-Call-State", "Channel-Read-Codec-Name", "Channel-Read-Codec-Rate", "Channel-Read-Codec-Bit-Rate",
+	"Channel-Write-Codec-Name", "Channel-Write-Codec-Rate", "Channel-Write-Codec-Bit-Rate", "Caller-Direction",
+	"Caller-Username", "Caller-Dialplan", "Caller-Caller-ID-Name", "Caller-Caller-ID-Number", "Caller-Callee-ID-Name",
+	"Caller-Callee-ID-Number", "Caller-Network-Addr", "Caller-ANI", "Caller-ANI-II", "Caller-Destination-Number",
+	"Caller-Unique-ID", "Caller-Source", "Caller-Transfer-Source", "Caller-Context", "Caller-RDNIS",
+	"Caller-Channel-Name", "Caller-Profile-Index", "Caller-Profile-Created-Time", "Caller-Channel-Created-Time",
+	"Caller-Channel-Answered-Time", "Caller-Channel-Progress-Time", "Caller-Channel-Progress-Media-Time",
+	"Caller-Channel-Hangup-Time", "Caller-Channel-Transfer-Time", "Caller-Screen-Bit", "Caller-Privacy-Hide-Name",
+	"Caller-Privacy-Hide-Number", "Other-Type", "Other-Leg-Direction", "Other-Leg-Unique-ID",
+	"Other-Leg-Caller-ID-Name", "Other-Leg-Caller-ID-Number", "Other-Leg-Destination-Number", "Other-Leg-Channel-Name",
+	"Bridge-A-Unique-ID", "Bridge-B-Unique-ID", "Hangup-Cause", "Application", "Application-Data",
+	"Application-Response", "Application-UUID", "Job-UUID", "Job-Command", "Job-Command-Arg", "DTMF-Digit",
+	"DTMF-Duration", "Up-Time", "Session-Count", "Max-Sessions", "Session-Per-Sec", "Session-Since-Startup",
+	"Idle-CPU", "Heartbeat-Interval"
+};
+
+#define BINARY_HEADER_COUNT (sizeof(BINARY_HEADER_NAMES) / sizeof(BINARY_HEADER_NAMES[0]))
+#define BINARY_HEADER_SLOTS 512
+
+static struct {
+	unsigned long hash;
+	unsigned char code;
+} BINARY_HEADER_INDEX[BINARY_HEADER_SLOTS];
+
+static int BINARY_HEADER_INDEX_READY = 0;
+
+static void binary_header_index_init(void)
+{
+	unsigned char code;
+
+	/* every caller builds the same table so a concurrent first use is harmless */
+	for (code = 1; code < BINARY_HEADER_COUNT; code++) {
+		esl_ssize_t hlen = -1;
+		unsigned long hash = esl_ci_hashfunc_default(BINARY_HEADER_NAMES[code], &hlen);
+		unsigned int slot = hash % BINARY_HEADER_SLOTS;
+
+		while (BINARY_HEADER_INDEX[slot].code && BINARY_HEADER_INDEX[slot].code != code) {
+			slot = (slot + 1) % BINARY_HEADER_SLOTS;
+		}
+
+		BINARY_HEADER_INDEX[slot].hash = hash;
+		BINARY_HEADER_INDEX[slot].code = code;
+	}
+
+	BINARY_HEADER_INDEX_READY = 1;
+}
+
+static unsigned char binary_header_code(esl_event_header_t *hp)
+{
+	unsigned int slot = hp->hash % BINARY_HEADER_SLOTS;
+	unsigned char code;
+
+	while ((code = BINARY_HEADER_INDEX[slot].code)) {
+		if (BINARY_HEADER_INDEX[slot].hash == hp->hash && !strcasecmp(BINARY_HEADER_NAMES[code], hp->name)) {
+			return code;
+		}
+		slot = (slot + 1) % BINARY_HEADER_SLOTS;
+	}
+
+	return 0;
+}
+
+static unsigned char *binary_put_len(unsigned char *p, esl_size_t len)
+{
+	while (len >= 0x80) {
+		*p++ = (unsigned char) (len | 0x80);
+		len >>= 7;
+	}
+	*p++ = (unsigned char) len;
+
+	return p;
+}
+
+static int binary_get_len(const unsigned char **pp, const unsigned char *end, esl_size_t *len)
+{
+	const unsigned char *p = *pp;
+	esl_size_t val = 0;
+	int shift = 0;
+
+	while (p < end && shift < 35) {
+		val |= (esl_size_t) (*p & 0x7f) << shift;
+		if (!(*p++ & 0x80)) {
+			if (val > (esl_size_t) (end - p)) {
+				return -1;
+			}
+			*pp = p;
+			*len = val;
+			return 0;
+		}
+		shift += 7;
+	}
+
+	return -1;
+}
+
+ESL_DECLARE(esl_status_t) esl_event_serialize_binary(esl_event_t *event, char **str, esl_size_t *len)
+{
+	esl_event_header_t *hp;
+	esl_size_t size = 4 + 10 + 10, count = 0, blen = 0;
+	unsigned char *buf, *p;
+
+	*str = NULL;
+	*len = 0;
+
+	if (!BINARY_HEADER_INDEX_READY) {
+		binary_header_index_init();
+	}
+
+	for (hp = event->headers; hp; hp = hp->next) {
+		size += 1 + 10 + strlen(hp->name) + 10 + strlen(hp->value);
+		count++;
+	}
+
+	if (event->body) {
+		blen = strlen(event->body);
+		size += blen;
+	}
+
+	buf = malloc(size);
+	esl_assert(buf);
+
+	p = buf;
+	*p++ = 'F';
+	*p++ = 'S';
+	*p++ = 'B';
+	*p++ = 1;
+	p = binary_put_len(p, count);
+
+	for (hp = event->headers; hp; hp = hp->next) {
+		esl_size_t vlen = strlen(hp->value);
+		unsigned char code = binary_header_code(hp);
+
+		*p++ = code;
+
+		if (!code) {
+			esl_size_t nlen = strlen(hp->name);
+
+			p = binary_put_len(p, nlen);
+			memcpy(p, hp->name, nlen);
+			p += nlen;
+		}
+
+		p = binary_put_len(p, vlen);
+		memcpy(p, hp->value, vlen);
+		p += vlen;
+	}
+
+	p = binary_put_len(p, blen);
+	if (blen) {
+		memcpy(p, event->body, blen);
+		p += blen;
+	}
+
+	*str = (char *) buf;
+	*len = p - buf;
+
+	return ESL_SUCCESS;
+}
+
+ESL_DECLARE(esl_status_t) esl_event_create_binary(esl_event_t **event, const char *data, esl_size_t len)
+{
+	return esl_event_create_binary_arena(event, data, len, NULL);
+}
+
+ESL_DECLARE(esl_status_t) esl_event_create_binary_arena(esl_event_t **event, const char *data, esl_size_t len, esl_event_arena_t *arena)
+{
+	const unsigned char *p = (const unsigned char *) data, *end = p + len;
+	esl_event_t *new_event;
+	esl_size_t count, i, vlen, nlen;
+	char name[256];
+	char *val;
+
+	*event = NULL;
+
+	if (len < 5 || p[0] != 'F' || p[1] != 'S' || p[2] != 'B' || p[3] != 1) {
+		esl_event_arena_destroy(&arena);
+		return ESL_FAIL;
+	}
+	p += 4;
+
+	if (binary_get_len(&p, end, &count)) {
+		esl_event_arena_destroy(&arena);
+		return ESL_FAIL;
+	}
+
+	if (esl_event_create_arena(&new_event, ESL_EVENT_CLONE, arena) != ESL_SUCCESS) {
+		return ESL_FAIL;
+	}
+
+	for (i = 0; i < count; i++) {
+		const char *hname;
+		unsigned char code;
+
+		if (p >= end) {
+			goto fail;
+		}
+
+		if ((code = *p++)) {
+			if (code >= BINARY_HEADER_COUNT) {
+				goto fail;
+			}
+			hname = BINARY_HEADER_NAMES[code];
+		} else {
+			if (binary_get_len(&p, end, &nlen) || !nlen || nlen >= sizeof(name)) {
+				goto fail;
+			}
+			memcpy(name, p, nlen);
+			name[nlen] = '\0';
+			p += nlen;
+			hname = name;
+		}
+
+		if (binary_get_len(&p, end, &vlen)) {
+			goto fail;
+		}
+
+		/* the value is already the exact length so the event takes this copy instead of duplicating it again */
+		val = event_alloc(new_event, vlen + 1);
+		memcpy(val, p, vlen);
+		val[vlen] = '\0';
+		p += vlen;
+
+		if (code == 1) {
+			esl_name_event(val, &new_event->event_id);
+		}
+
+		if (!strncmp(val, "ARRAY::", 7)) {
+			esl_event_add_array(new_event, hname, val);
+			event_free(new_event, val);
+		} else {
+			esl_event_base_add_header(new_event, ESL_STACK_BOTTOM, hname, val);
+		}
+	}
+
+	if (binary_get_len(&p, end, &vlen)) {
+		goto fail;
+	}
+
+	if (vlen) {
+		char tmp[25];
+
+		new_event->body = event_alloc(new_event, vlen + 1);
+		memcpy(new_event->body, p, vlen);
+		new_event->body[vlen] = '\0';
+
+		/* text/event-plain carries the body length as a header, keep that for callers looking for it */
+		if (!esl_event_get_header(new_event, "content-length")) {
+			esl_snprintf(tmp, sizeof(tmp), "%d", (int) vlen);
+			esl_event_add_header_string(new_event, ESL_STACK_BOTTOM, "Content-Length", tmp);
+		}
+	}
+
+	*event = new_event;
+	return ESL_SUCCESS;
+
+ fail:
+
+	esl_event_destroy(&new_event);
+	return ESL_FAIL;
+}
+
 ESL_DECLARE(esl_status_t) esl_event_create_json(esl_event_t **event, const char *json)
 {
 	esl_event_t *new_event;
@@ -4,6 +4,54 @@
 #define connection_construct_common() memset(&handle, 0, sizeof(handle))
 #define event_construct_common() event = NULL; serialized_string = NULL; mine = 0; hp = NULL
 
+static char *api_cmd(const char *cmd, const char *arg)
+{
+	size_t len;
+	char *cmd_buf;
+
+	len = strlen(cmd) + (arg ? strlen(arg) : 0) + 10;
+
+	cmd_buf = (char *) malloc(len + 1);
+	assert(cmd_buf);
+
+	snprintf(cmd_buf, len, "api %s %s", cmd, arg ? arg : "");
+	*(cmd_buf + (len)) = '\0';
+
+	return cmd_buf;
+}
+
+static char *bgapi_cmd(const char *cmd, const char *arg, const char *job_uuid)
+{
+	size_t len;
+	char *cmd_buf;
+
+	len = strlen(cmd) + (arg ? strlen(arg) : 0) + (job_uuid ? strlen(job_uuid) + 12 : 0) + 10;
+
+	cmd_buf = (char *) malloc(len + 1);
+	assert(cmd_buf);
+	
+	if (job_uuid) {
+		snprintf(cmd_buf, len, "bgapi %s%s%s\nJob-UUID: %s", cmd, arg ? " " : "", arg ? arg : "", job_uuid);
+	} else {
+		snprintf(cmd_buf, len, "bgapi %s%s%s", cmd, arg ? " " : "", arg ? arg : "");
+	}
+
+	*(cmd_buf + (len)) = '\0';
+
+	return cmd_buf;
+}
+
+/* Received events were built in one of the handle's arenas, the wrapper takes them over instead of copying
+   and destroying the event frees its arena. The handle makes a new one for the next event. */
+static ESLevent *take_event(esl_event_t **event)
+{
+	esl_event_t *e = *event;
+
+	*event = NULL;
+
+	return new ESLevent(e, 1);
+}
+
 void eslSetLogLevel(int level)
 {
 	esl_global_set_default_logger(level);
@@ -71,10 +119,8 @@ int ESLconnection::send(const char *cmd)
 
 ESLevent *ESLconnection::sendRecv(const char *cmd)
 {
-	if (esl_send_recv(&handle, cmd) == ESL_SUCCESS) {
-		esl_event_t *event;
-		esl_event_dup(&event, handle.last_sr_event);
-		return new ESLevent(event, 1);
+	if (esl_send_recv(&handle, cmd) == ESL_SUCCESS && handle.last_sr_event) {
+		return take_event(&handle.last_sr_event);
 	}
 	
 	return NULL;
@@ -82,7 +128,6 @@ ESLevent *ESLconnection::sendRecv(const char *cmd)
 
 ESLevent *ESLconnection::api(const char *cmd, const char *arg)
 {
-	size_t len;
 	char *cmd_buf;
 	ESLevent *event;
 	
@@ -90,15 +135,7 @@ ESLevent *ESLconnection::api(const char *cmd, const char *arg)
 		return NULL;
 	}
 
-	len = strlen(cmd) + (arg ? strlen(arg) : 0) + 10;
-
-	cmd_buf = (char *) malloc(len + 1);
-	assert(cmd_buf);
-
-	snprintf(cmd_buf, len, "api %s %s", cmd, arg ? arg : "");
-	*(cmd_buf + (len)) = '\0';
-
-
+	cmd_buf = api_cmd(cmd, arg);
 	event = sendRecv(cmd_buf);
 	free(cmd_buf);
 
@@ -107,7 +144,6 @@ ESLevent *ESLconnection::api(const char *cmd, const char *arg)
 
 ESLevent *ESLconnection::bgapi(const char *cmd, const char *arg, const char *job_uuid)
 {
-	size_t len;
 	char *cmd_buf;
 	ESLevent *event;
 	
@@ -115,19 +151,7 @@ ESLevent *ESLconnection::bgapi(const char *cmd, const char *arg, const char *job
 		return NULL;
 	}
 
-	len = strlen(cmd) + (arg ? strlen(arg) : 0) + (job_uuid ? strlen(job_uuid) + 12 : 0) + 10;
-
-	cmd_buf = (char *) malloc(len + 1);
-	assert(cmd_buf);
-	
-	if (job_uuid) {
-		snprintf(cmd_buf, len, "bgapi %s%s%s\nJob-UUID: %s", cmd, arg ? " " : "", arg ? arg : "", job_uuid);
-	} else {
-		snprintf(cmd_buf, len, "bgapi %s%s%s", cmd, arg ? " " : "", arg ? arg : "");
-	}
-
-	*(cmd_buf + (len)) = '\0';
-
+	cmd_buf = bgapi_cmd(cmd, arg, job_uuid);
 	event = sendRecv(cmd_buf);
 	free(cmd_buf);
 	
@@ -163,10 +187,8 @@ int ESLconnection::setEventLock(const char *val)
 
 ESLevent *ESLconnection::execute(const char *app, const char *arg, const char *uuid)
 {
-	if (esl_execute(&handle, app, arg, uuid) == ESL_SUCCESS) {
-		esl_event_t *event;
-		esl_event_dup(&event, handle.last_sr_event);
-		return new ESLevent(event, 1);
+	if (esl_execute(&handle, app, arg, uuid) == ESL_SUCCESS && handle.last_sr_event) {
+		return take_event(&handle.last_sr_event);
 	}
 
 	return NULL;
@@ -182,10 +204,8 @@ ESLevent *ESLconnection::executeAsync(const char *app, const char *arg, const ch
 	r = esl_execute(&handle, app, arg, uuid);
 	handle.async_execute = async;
 
-	if (r == ESL_SUCCESS) {
-		esl_event_t *event;
-		esl_event_dup(&event, handle.last_sr_event);
-		return new ESLevent(event, 1);
+	if (r == ESL_SUCCESS && handle.last_sr_event) {
+		return take_event(&handle.last_sr_event);
 	}
 
 	return NULL;
@@ -194,11 +214,9 @@ ESLevent *ESLconnection::executeAsync(const char *app, const char *arg, const ch
 ESLevent *ESLconnection::sendEvent(ESLevent *send_me)
 {
 	if (esl_sendevent(&handle, send_me->event) == ESL_SUCCESS) {
-		esl_event_t *e = handle.last_ievent ? handle.last_ievent : handle.last_event;
-		if (e) {
-			esl_event_t *event;
-			esl_event_dup(&event, e);
-			return new ESLevent(event, 1);
+		esl_event_t **e = handle.last_ievent ? &handle.last_ievent : &handle.last_event;
+		if (*e) {
+			return take_event(e);
 		}
 	}
 
@@ -217,11 +235,9 @@ int ESLconnection::sendMSG(ESLevent *send_me, const char *uuid)
 ESLevent *ESLconnection::recvEvent()
 {
 	if (esl_recv_event(&handle, 1, NULL) == ESL_SUCCESS) {
-		esl_event_t *e = handle.last_ievent ? handle.last_ievent : handle.last_event;
-		if (e) {
-			esl_event_t *event;
-			esl_event_dup(&event, e);
-			return new ESLevent(event, 1);
+		esl_event_t **e = handle.last_ievent ? &handle.last_ievent : &handle.last_event;
+		if (*e) {
+			return take_event(e);
 		}
 	}
 
@@ -232,11 +248,9 @@ ESLevent *ESLconnection::recvEventTimed(int ms)
 {
 
 	if (esl_recv_event_timed(&handle, ms, 1, NULL) == ESL_SUCCESS) {
-		esl_event_t *e = handle.last_ievent ? handle.last_ievent : handle.last_event;
-		if (e) {
-			esl_event_t *event;
-			esl_event_dup(&event, e);
-			return new ESLevent(event, 1);
+		esl_event_t **e = handle.last_ievent ? &handle.last_ievent : &handle.last_event;
+		if (*e) {
+			return take_event(e);
 		}
     }
 	
@@ -248,9 +262,7 @@ ESLevent *ESLconnection::filter(const char *header, const char *value)
 	esl_status_t status = esl_filter(&handle, header, value);
 
 	if (status == ESL_SUCCESS && handle.last_sr_event) {
-		esl_event_t *event;
-		esl_event_dup(&event, handle.last_sr_event);
-		return new ESLevent(event, 1);
+		return take_event(&handle.last_sr_event);
 	}
 
 	return NULL;
@@ -265,11 +277,102 @@ int ESLconnection::events(const char *etype, const char *value)
 		type_id = ESL_EVENT_TYPE_XML;
 	} else if (!strcmp(etype, "json")) {
         type_id = ESL_EVENT_TYPE_JSON;
+	} else if (!strcmp(etype, "binary")) {
+		type_id = ESL_EVENT_TYPE_BINARY;
 	}
 
 	return esl_events(&handle, type_id, value);
 }
 
+int ESLconnection::sendPipelined(const char *cmd)
+{
+	uint32_t id = 0;
+
+	if (esl_send_pipelined(&handle, cmd, &id) == ESL_SUCCESS) {
+		return (int) id;
+	}
+
+	return 0;
+}
+
+ESLevent *ESLconnection::recvReply(int ms)
+{
+	esl_event_t *reply = NULL;
+
+	if (esl_recv_reply_timed(&handle, ms > 0 ? ms : 0, NULL, &reply) == ESL_SUCCESS && reply) {
+		return new ESLevent(reply, 1);
+	}
+
+	return NULL;
+}
+
+// ESLpool
+///////////////////////////////////////////////////////////////////////
+
+ESLpool::ESLpool(const char *host, const char *port, const char *user, const char *password, int size, int timeout)
+{
+	pool = NULL;
+
+	if (esl_pool_create(&pool, host, atoi(port), user, password, size > 0 ? size : 1, timeout > 0 ? timeout : 0) != ESL_SUCCESS) {
+		pool = NULL;
+	}
+}
+
+ESLpool::~ESLpool()
+{
+	if (pool) {
+		esl_pool_destroy(&pool);
+	}
+}
+
+int ESLpool::connected()
+{
+	return pool ? 1 : 0;
+}
+
+ESLevent *ESLpool::sendRecv(const char *cmd, int ms)
+{
+	esl_event_t *reply = NULL;
+
+	if (pool && esl_pool_send_recv(pool, cmd, ms > 0 ? ms : 0, &reply) == ESL_SUCCESS && reply) {
+		return new ESLevent(reply, 1);
+	}
+
+	return NULL;
+}
+
+ESLevent *ESLpool::api(const char *cmd, const char *arg)
+{
+	char *cmd_buf;
+	ESLevent *event;
+	
+	if (!cmd) {
+		return NULL;
+	}
+
+	cmd_buf = api_cmd(cmd, arg);
+	event = sendRecv(cmd_buf);
+	free(cmd_buf);
+
+	return event;
+}
+
+ESLevent *ESLpool::bgapi(const char *cmd, const char *arg, const char *job_uuid)
+{
+	char *cmd_buf;
+	ESLevent *event;
+	
+	if (!cmd) {
+		return NULL;
+	}
+
+	cmd_buf = bgapi_cmd(cmd, arg, job_uuid);
+	event = sendRecv(cmd_buf);
+	free(cmd_buf);
+	
+	return event;
+}
+
 // ESLevent
 ///////////////////////////////////////////////////////////////////////
 
@@ -46,6 +46,7 @@ extern "C" {
 
 typedef struct esl_event_header esl_event_header_t;
 typedef struct esl_event esl_event_t;
+typedef struct esl_event_arena esl_event_arena_t;
 
 typedef enum {
 	ESL_POLL_READ = (1 << 0),
@@ -56,7 +57,8 @@ typedef enum {
 typedef enum {
 	ESL_EVENT_TYPE_PLAIN,
 	ESL_EVENT_TYPE_XML,
-	ESL_EVENT_TYPE_JSON
+	ESL_EVENT_TYPE_JSON,
+	ESL_EVENT_TYPE_BINARY
 } esl_event_type_t;
 
 #ifdef WIN32
@@ -279,6 +281,8 @@ typedef enum {
 
 #define BUF_CHUNK 65536 * 50
 #define BUF_START 65536 * 100
+#define ESL_EVENT_ARENA_SIZE 16384
+#define ESL_HANDLE_ARENAS 4
 
 #include <esl_threadmutex.h>
 #include <esl_buffer.h>
@@ -319,8 +323,20 @@ typedef struct {
 	int async_execute;
 	int event_lock;
 	int destroyed;
+	/*! Arenas of destroyed events kept for the next ones received. Used only internally. */
+	esl_event_arena_t *arenas[ESL_HANDLE_ARENAS];
+	int arena_count;
+	/*! Replies to pipelined commands read off the socket but not collected yet, oldest first */
+	esl_event_t *pipeline_replies;
+	/*! Pipelined commands sent, replies read and replies collected */
+	uint32_t pipeline_sent;
+	uint32_t pipeline_recvd;
+	uint32_t pipeline_done;
 } esl_handle_t;
 
+struct esl_pool;
+typedef struct esl_pool esl_pool_t;
+
 #define esl_test_flag(obj, flag) ((obj)->flags & flag)
 #define esl_set_flag(obj, flag) (obj)->flags |= (flag)
 #define esl_clear_flag(obj, flag) (obj)->flags &= ~(flag)
@@ -460,6 +476,65 @@ ESL_DECLARE(esl_status_t) esl_recv_event_timed(esl_handle_t *handle, uint32_t ms
 */
 ESL_DECLARE(esl_status_t) esl_send_recv_timed(esl_handle_t *handle, const char *cmd, uint32_t ms);
 #define esl_send_recv(_handle, _cmd) esl_send_recv_timed(_handle, _cmd, 0)
+/*!
+    \brief Send a command without waiting for its reply, any number of them may be outstanding
+    \param handle Handle to be used
+    \param cmd Raw command to send
+    \param[out] id If not NULL, the number of the command on this handle, its reply is collected with the same number
+    \note The server answers the commands of one connection in order. Replies are matched up by esl_recv_reply_timed
+           and esl_send_recv, a thread reading events on the same handle with esl_recv_event must not consume them.
+*/
+ESL_DECLARE(esl_status_t) esl_send_pipelined(esl_handle_t *handle, const char *cmd, uint32_t *id);
+/*!
+    \brief Collect the reply to the oldest pipelined command, events read in the meantime are queued for esl_recv_event
+    \param handle Handle to be used
+    \param ms Maximum time to wait, 0 waits for the reply
+    \param[out] id If not NULL, the number esl_send_pipelined gave the command
+    \param[out] reply The api/response or command/reply event, destroy it with esl_event_destroy or esl_recycle_event
+    \return ESL_SUCCESS, ESL_BREAK when ms expired or ESL_FAIL when no command is outstanding or the connection failed
+*/
+ESL_DECLARE(esl_status_t) esl_recv_reply_timed(esl_handle_t *handle, uint32_t ms, uint32_t *id, esl_event_t **reply);
+#define esl_recv_reply(_handle, _id, _reply) esl_recv_reply_timed(_handle, 0, _id, _reply)
+/*!
+    \brief Hand an event received on a handle back so its arena is reused for the next one
+    \param handle Handle the event was received on
+    \param event Event to destroy
+*/
+ESL_DECLARE(void) esl_recycle_event(esl_handle_t *handle, esl_event_t **event);
+
+/*!
+    \brief Connect a pool of handles to spread commands over, each command goes to a connection no other thread is using
+    \param[out] pool The new pool
+    \param host Host to be connected
+    \param port Port to be connected
+    \param user FreeSWITCH server username (optional)
+    \param password FreeSWITCH server password
+    \param size Number of connections
+    \param timeout Connection timeout, in miliseconds
+*/
+ESL_DECLARE(esl_status_t) esl_pool_create(esl_pool_t **pool, const char *host, esl_port_t port, const char *user, const char *password, uint32_t size, uint32_t timeout);
+/*!
+    \brief Disconnect and free a pool, no other thread may be using it
+    \param pool The pool to destroy
+*/
+ESL_DECLARE(void) esl_pool_destroy(esl_pool_t **pool);
+/*!
+    \brief Send a command on a free connection of the pool and wait for its reply, connections that dropped are reconnected
+    \param pool The pool to use
+    \param cmd Raw command to send
+    \param ms Maximum time to wait for the reply, 0 waits for it
+    \param[out] reply If not NULL, the reply event which the caller destroys
+*/
+ESL_DECLARE(esl_status_t) esl_pool_send_recv(esl_pool_t *pool, const char *cmd, uint32_t ms, esl_event_t **reply);
+/*!
+    \brief Start a background job on a free connection of the pool
+    \param pool The pool to use
+    \param cmd The api command and its arguments
+    \param[out] job_uuid If not NULL, receives the Job-UUID of the BACKGROUND_JOB event that will carry the result
+    \param len Size of job_uuid
+    \note The pool connections subscribe to no events, the results are read on a handle listening for BACKGROUND_JOB
+*/
+ESL_DECLARE(esl_status_t) esl_pool_bgapi(esl_pool_t *pool, const char *cmd, char *job_uuid, esl_size_t len);
 /*!
     \brief Applies a filter to received events
     \param handle Handle to apply the filter to
@@ -177,6 +177,8 @@ struct esl_event {
 	unsigned long key;
 	struct esl_event *next;
 	int flags;
+	/*! when set the event, its headers and its body were carved out of this arena and go away with it */
+	esl_event_arena_t *arena;
 };
 
 typedef enum {
@@ -290,6 +292,91 @@ ESL_DECLARE(esl_status_t) esl_name_event(const char *name, esl_event_types_t *ty
 ESL_DECLARE(esl_status_t) esl_event_serialize(esl_event_t *event, char **str, esl_bool_t encode);
 ESL_DECLARE(esl_status_t) esl_event_serialize_json(esl_event_t *event, char **str);
 ESL_DECLARE(esl_status_t) esl_event_create_json(esl_event_t **event, const char *json);
+
+/*!
+  \brief Parse the url encoded "Name: value" text of a text/event-plain body
+  \param event a NULL pointer on which to create the event
+  \param data the body, it is not modified
+  \return ESL_SUCCESS if the event was created
+*/
+ESL_DECLARE(esl_status_t) esl_event_create_plain(esl_event_t **event, const char *data);
+
+/*!
+  \brief Render an event in the binary form of text/event-binary (see switch_event_serialize_binary)
+  \param event the event to render
+  \param str a pointer to point at the allocated data
+  \param len the length of the rendered data, it is not NUL terminated
+  \return ESL_SUCCESS if the operation was successful
+  \note you must free the resulting data when you are finished with it
+*/
+ESL_DECLARE(esl_status_t) esl_event_serialize_binary(esl_event_t *event, char **str, esl_size_t *len);
+
+/*!
+  \brief Parse a text/event-binary body
+  \param event a NULL pointer on which to create the event
+  \param data the body
+  \param len the length of the body
+  \return ESL_SUCCESS if the event was created, ESL_FAIL on a truncated or malformed body
+*/
+ESL_DECLARE(esl_status_t) esl_event_create_binary(esl_event_t **event, const char *data, esl_size_t len);
+
+/*!
+  \brief Create an arena to build events in, headers and bodies are bump allocated from it instead of one malloc each
+  \param arena a NULL pointer on which to create the arena
+  \param size the size of the first chunk, the arena grows by whole chunks
+  \return ESL_SUCCESS if the arena was created
+*/
+ESL_DECLARE(esl_status_t) esl_event_arena_create(esl_event_arena_t **arena, esl_size_t size);
+
+/*!
+  \brief Destroy an arena that no event owns
+  \param arena pointer to the pointer to the arena to destroy
+*/
+ESL_DECLARE(void) esl_event_arena_destroy(esl_event_arena_t **arena);
+
+/*!
+  \brief Allocate from an arena, the memory lives until the arena is reset or destroyed
+  \param arena the arena
+  \param len the number of bytes wanted
+  \return the memory
+*/
+ESL_DECLARE(void *) esl_event_arena_alloc(esl_event_arena_t *arena, esl_size_t len);
+
+/*!
+  \brief Create an event inside an arena, the event owns the arena from then on
+  \param event a NULL pointer on which to create the event
+  \param event_id the event id enumeration of the desired event
+  \param arena an unused or reset arena, NULL creates a plain event
+  \return ESL_SUCCESS on success
+  \note esl_event_destroy destroys the arena as well, esl_event_release_arena hands it back for another event
+*/
+ESL_DECLARE(esl_status_t) esl_event_create_arena(esl_event_t **event, esl_event_types_t event_id, esl_event_arena_t *arena);
+
+/*!
+  \brief Destroy an event and keep its arena
+  \param event pointer to the pointer to the event to destroy
+  \return the arena of the event reset for reuse, NULL when the event did not have one
+*/
+ESL_DECLARE(esl_event_arena_t *) esl_event_release_arena(esl_event_t **event);
+
+/*!
+  \brief Parse a text/event-plain body into an event built in an arena
+  \param event a NULL pointer on which to create the event
+  \param data the body, it is not modified
+  \param arena an unused or reset arena the event takes over, NULL behaves like esl_event_create_plain
+  \return ESL_SUCCESS if the event was created
+*/
+ESL_DECLARE(esl_status_t) esl_event_create_plain_arena(esl_event_t **event, const char *data, esl_event_arena_t *arena);
+
+/*!
+  \brief Parse a text/event-binary body into an event built in an arena
+  \param event a NULL pointer on which to create the event
+  \param data the body
+  \param len the length of the body
+  \param arena an unused or reset arena the event takes over, NULL behaves like esl_event_create_binary
+  \return ESL_SUCCESS if the event was created, ESL_FAIL on a truncated or malformed body (the arena is destroyed)
+*/
+ESL_DECLARE(esl_status_t) esl_event_create_binary_arena(esl_event_t **event, const char *data, esl_size_t len, esl_event_arena_t *arena);
 /*!
   \brief Add a body to an event
   \param event the event to add to body to
@@ -96,6 +96,20 @@ class ESLconnection {
 	int setAsyncExecute(const char *val);
 	int setEventLock(const char *val);
 	int disconnect(void);
+	int sendPipelined(const char *cmd);
+	ESLevent *recvReply(int ms = 0);
+};
+
+class ESLpool {
+ private:
+	esl_pool_t *pool;
+ public:
+	ESLpool(const char *host, const char *port, const char *user, const char *password, int size, int timeout = 0);
+	virtual ~ESLpool();
+	int connected();
+	ESLevent *sendRecv(const char *cmd, int ms = 0);
+	ESLevent *api(const char *cmd, const char *arg = NULL);
+	ESLevent *bgapi(const char *cmd, const char *arg = NULL, const char *job_uuid = NULL);
 };
 
 void eslSetLogLevel(int level);
@@ -60,6 +60,17 @@ struct stfu_queue {
 };
 typedef struct stfu_queue stfu_queue_t;
 
+/* a slot of the indexed ring, its data is sized to the packets it has held rather than STFU_DATALEN */
+struct stfu_slot {
+	uint32_t ts;
+	uint32_t pt;
+	uint8_t *data;
+	size_t dlen;
+	size_t alloc;
+	uint8_t was_read;
+};
+typedef struct stfu_slot stfu_slot_t;
+
 struct stfu_instance {
 	struct stfu_queue a_queue;
 	struct stfu_queue b_queue;
@@ -121,12 +132,36 @@ struct stfu_instance {
     uint8_t ready;
     uint8_t debug;
 
+    uint32_t flags;
+
+    /* STFU_FLAG_INDEXED: frames live in slot ((ts - base_ts) / samples_per_packet) & slot_mask */
+    struct stfu_slot *slots;
+    uint32_t slot_count;
+    uint32_t slot_mask;
+    uint32_t base_ts;
+    uint32_t play_ts;
+    uint32_t high_ts;
+    uint32_t buffered;
+    uint32_t target_qlen;
+    uint8_t playing;
+
+    uint32_t last_arrival;
+    uint32_t last_arrival_ts;
+    uint32_t jitter_q4;
+    uint32_t min_transit;
+    uint32_t peak_spread;
+
+    uint32_t session_plc_count;
+    uint32_t session_late_count;
+    uint32_t session_discard_count;
+
     char *name;
     stfu_n_call_me_t callback;
     void *udata;
 };
 
 static void stfu_n_reset_counters(stfu_instance_t *i);
+static void stfu_n_reset_indexed(stfu_instance_t *i);
 static void null_logger(const char *file, const char *func, int line, int level, const char *fmt, ...);
 static void default_logger(const char *file, const char *func, int line, int level, const char *fmt, ...);
 
@@ -212,6 +247,14 @@ void stfu_n_destroy(stfu_instance_t **i)
 		free(ii->a_queue.array);
 		free(ii->b_queue.array);
 		free(ii->c_queue.array);
+		if (ii->slots) {
+			uint32_t x;
+
+			for (x = 0; x < ii->slot_count; x++) {
+				free(ii->slots[x].data);
+			}
+			free(ii->slots);
+		}
 		free(ii);
 	}
 }
@@ -237,6 +280,10 @@ void stfu_n_report(stfu_instance_t *i, stfu_report_t *r)
 	r->clean_count = i->period_clean_count;
 	r->consecutive_good_count = i->consecutive_good_count;
 	r->consecutive_bad_count = i->consecutive_bad_count;
+	r->plc_count = i->session_plc_count;
+	r->late_count = i->session_late_count;
+	r->discard_count = i->session_discard_count;
+	r->jitter = i->jitter_q4 >> 4;
 }
 
 stfu_status_t stfu_n_resize(stfu_instance_t *i, uint32_t qlen) 
@@ -255,6 +302,18 @@ stfu_status_t stfu_n_resize(stfu_instance_t *i, uint32_t qlen)
         }
     }
 
+    if ((i->flags & STFU_FLAG_INDEXED)) {
+        /* the slots are sized for max_qlen up front, this only moves the minimum delay */
+        i->qlen = i->orig_qlen = qlen;
+        if (i->target_qlen < qlen) {
+            i->target_qlen = qlen;
+        }
+        if (qlen > i->most_qlen) {
+            i->most_qlen = qlen;
+        }
+        return STFU_IT_WORKED;
+    }
+
     if ((s = stfu_n_resize_aqueue(&i->a_queue, qlen)) == STFU_IT_WORKED) {
         s = stfu_n_resize_aqueue(&i->b_queue, qlen);
         s = stfu_n_resize_aqueue(&i->c_queue, qlen);
@@ -272,6 +331,11 @@ stfu_status_t stfu_n_resize(stfu_instance_t *i, uint32_t qlen)
 }
 
 stfu_instance_t *stfu_n_init(uint32_t qlen, uint32_t max_qlen, uint32_t samples_per_packet, uint32_t samples_per_second, uint32_t max_drift_ms)
+{
+    return stfu_n_init_ex(qlen, max_qlen, samples_per_packet, samples_per_second, max_drift_ms, STFU_FLAG_NONE);
+}
+
+stfu_instance_t *stfu_n_init_ex(uint32_t qlen, uint32_t max_qlen, uint32_t samples_per_packet, uint32_t samples_per_second, uint32_t max_drift_ms, uint32_t flags)
 {
 	struct stfu_instance *i;
 
@@ -285,10 +349,26 @@ stfu_instance_t *stfu_n_init(uint32_t qlen, uint32_t max_qlen, uint32_t samples_
     i->max_qlen = max_qlen;
     i->orig_qlen = qlen;
     i->samples_per_packet = samples_per_packet;
+    i->flags = flags;
 
-	stfu_n_init_aqueue(&i->a_queue, qlen);
-	stfu_n_init_aqueue(&i->b_queue, qlen);
-	stfu_n_init_aqueue(&i->c_queue, qlen);
+    if ((flags & STFU_FLAG_INDEXED)) {
+        /* room for the largest delay plus the same again for reordered and early packets */
+        i->slot_count = 1;
+        while (i->slot_count < (least1(max_qlen) + qlen) * 2) {
+            i->slot_count <<= 1;
+        }
+        i->slot_mask = i->slot_count - 1;
+        i->slots = calloc(i->slot_count, sizeof(struct stfu_slot));
+        assert(i->slots != NULL);
+        stfu_n_reset_indexed(i);
+        i->target_qlen = i->most_qlen = qlen;
+        i->b_queue.int_frame.plc = 1;
+        memset(i->b_queue.int_frame.data, 255, sizeof(i->b_queue.int_frame.data));
+    } else {
+        stfu_n_init_aqueue(&i->a_queue, qlen);
+        stfu_n_init_aqueue(&i->b_queue, qlen);
+        stfu_n_init_aqueue(&i->c_queue, qlen);
+    }
 
     i->max_drift = (int32_t)(max_drift_ms * (samples_per_second / 1000) * -1);
 
@@ -303,6 +383,10 @@ stfu_instance_t *stfu_n_init(uint32_t qlen, uint32_t max_qlen, uint32_t samples_
     
     i->max_plc = i->qlen / 2;
 
+    if ((flags & STFU_FLAG_INDEXED) && i->max_plc < 5) {
+        i->max_plc = 5;
+    }
+
     i->samples_per_second = samples_per_second ? samples_per_second : 8000;
     
     i->period_time = ((i->samples_per_second * 20) / i->samples_per_packet);
@@ -359,6 +443,10 @@ void stfu_n_reset(stfu_instance_t *i)
 
     stfu_n_reset_counters(i);
     stfu_n_sync(i, 1);
+
+    if ((i->flags & STFU_FLAG_INDEXED)) {
+        stfu_n_reset_indexed(i);
+    }
     
     i->cur_ts = 0;
 	i->last_wr_ts = 0;
@@ -402,6 +490,285 @@ static void stfu_n_swap(stfu_instance_t *i)
     i->out_queue->last_jitter = 0;
 }
 
+static void stfu_n_reset_indexed(stfu_instance_t *i)
+{
+    uint32_t x;
+
+    for (x = 0; x < i->slot_count; x++) {
+        i->slots[x].was_read = 1;
+    }
+
+    i->playing = 0;
+    i->buffered = 0;
+    i->last_arrival = 0;
+    i->last_arrival_ts = 0;
+    i->peak_spread = 0;
+}
+
+static inline stfu_slot_t *stfu_n_slot(stfu_instance_t *i, uint32_t ts)
+{
+    return &i->slots[((ts - i->base_ts) / i->samples_per_packet) & i->slot_mask];
+}
+
+static inline uint32_t stfu_n_depth(stfu_instance_t *i)
+{
+    return ((i->high_ts - i->play_ts) / i->samples_per_packet) + 1;
+}
+
+static void stfu_n_update_target(stfu_instance_t *i, uint32_t ts, uint32_t timer_ts)
+{
+    uint32_t target;
+
+    /* RFC 3550 A.8 interarrival jitter, kept in samples scaled by 16 */
+    if (timer_ts && i->last_arrival && (int32_t)(ts - i->last_arrival_ts) > 0) {
+        int32_t d = (int32_t)(timer_ts - i->last_arrival) - (int32_t)(ts - i->last_arrival_ts);
+
+        if (d < 0) {
+            d = -d;
+        }
+        i->jitter_q4 += d - ((i->jitter_q4 + 8) >> 4);
+    }
+
+    if (timer_ts) {
+        uint32_t transit = timer_ts - ts;
+        int32_t spread;
+
+        if (!i->last_arrival) {
+            i->min_transit = transit;
+        }
+
+        /* the earliest transit seen is the baseline, it creeps up so clock drift does not look like jitter forever */
+        if ((spread = (int32_t)(transit - i->min_transit)) < 0) {
+            i->min_transit = transit;
+            spread = 0;
+        } else if (spread > 0) {
+            i->min_transit++;
+        }
+
+        if ((uint32_t) spread > i->peak_spread) {
+            i->peak_spread = spread;
+        } else {
+            i->peak_spread -= i->peak_spread >> 8;
+        }
+
+        if (!i->last_arrival || (int32_t)(ts - i->last_arrival_ts) > 0) {
+            i->last_arrival = timer_ts;
+            i->last_arrival_ts = ts;
+        }
+    }
+
+    /* hold enough frames to cover the recent worst case spread of arrivals */
+    target = 1 + (i->peak_spread + i->samples_per_packet - 1) / i->samples_per_packet;
+
+    if (target < i->orig_qlen) {
+        target = i->orig_qlen;
+    }
+
+    if (i->max_qlen && target > i->max_qlen) {
+        target = i->max_qlen;
+    }
+
+    i->target_qlen = i->qlen = target;
+
+    if (target > i->most_qlen) {
+        i->most_qlen = target;
+    }
+}
+
+static stfu_status_t stfu_n_add_data_indexed(stfu_instance_t *i, uint32_t ts, uint32_t pt, void *data, size_t datalen, uint32_t timer_ts)
+{
+    uint32_t window = i->slot_count * i->samples_per_packet;
+    stfu_slot_t *frame;
+    size_t cplen;
+    int32_t delta;
+
+    if (!i->playing && !i->buffered) {
+        i->base_ts = i->play_ts = i->high_ts = ts;
+    }
+
+    delta = (int32_t)(ts - i->play_ts);
+
+    if (delta < 0) {
+        if ((uint32_t)(-delta) > window * 2) {
+            /* the stream jumped backwards, start over */
+            stfu_n_reset_indexed(i);
+            i->base_ts = i->play_ts = i->high_ts = ts;
+            delta = 0;
+        } else if (i->playing || (uint32_t)(i->high_ts - ts) >= window) {
+            i->session_late_count++;
+            if (stfu_log != null_logger && i->debug) {
+                stfu_log(STFU_LOG_EMERG, "%s TOO LATE !!! %u \n\n\n", i->name, ts);
+            }
+            return STFU_ITS_TOO_LATE;
+        } else {
+            /* reordered before playout started, begin from the earlier frame */
+            i->play_ts = ts;
+            delta = 0;
+        }
+    }
+
+    if ((uint32_t) delta >= window) {
+        if ((uint32_t) delta >= window * 2) {
+            stfu_n_reset_indexed(i);
+            i->base_ts = i->play_ts = i->high_ts = ts;
+        } else {
+            /* slide the playout point forward so the new frame fits, anything passed over is lost */
+            while ((uint32_t)(ts - i->play_ts) >= window) {
+                frame = stfu_n_slot(i, i->play_ts);
+                if (!frame->was_read && frame->ts == i->play_ts) {
+                    frame->was_read = 1;
+                    i->buffered--;
+                    i->session_discard_count++;
+                }
+                i->play_ts += i->samples_per_packet;
+            }
+        }
+    }
+
+    i->period_packet_in_count++;
+    i->session_packet_in_count++;
+
+    if (ts == i->last_rd_ts + i->samples_per_packet) {
+        i->period_clean_count++;
+        i->session_clean_count++;
+    }
+
+    i->last_rd_ts = ts;
+    i->packet_count++;
+
+    stfu_n_update_target(i, ts, timer_ts);
+
+    frame = stfu_n_slot(i, ts);
+
+    if (!frame->was_read) {
+        if (frame->ts == ts) {
+            /* duplicate */
+            i->session_discard_count++;
+            return STFU_IT_FAILED;
+        }
+        i->buffered--;
+        i->session_discard_count++;
+    }
+
+    if ((cplen = datalen) > STFU_DATALEN) {
+        cplen = STFU_DATALEN;
+    }
+
+    if (cplen > frame->alloc) {
+        frame->data = realloc(frame->data, cplen);
+        assert(frame->data != NULL);
+        frame->alloc = cplen;
+    }
+
+    memcpy(frame->data, data, cplen);
+    frame->pt = pt;
+    frame->ts = ts;
+    frame->dlen = cplen;
+    frame->was_read = 0;
+    i->buffered++;
+
+    if ((int32_t)(ts - i->high_ts) > 0) {
+        i->high_ts = ts;
+    }
+
+    if (!i->playing && stfu_n_depth(i) >= i->target_qlen) {
+        i->playing = 1;
+        i->ready = 1;
+    }
+
+    if (stfu_log != null_logger && i->debug) {
+        stfu_log(STFU_LOG_EMERG, "I: %s %u/%u depth:%u buffered:%u jitter:%u - %u:%u\n", i->name,
+                 i->target_qlen, i->max_qlen, stfu_n_depth(i), i->buffered, i->jitter_q4 >> 4, ts, ts / i->samples_per_packet);
+    }
+
+    return STFU_IT_WORKED;
+}
+
+static stfu_frame_t *stfu_n_read_a_frame_indexed(stfu_instance_t *i)
+{
+    stfu_frame_t *frame;
+    stfu_slot_t *slot;
+
+    if (!i->playing) {
+        return NULL;
+    }
+
+    /* more delay than the jitter calls for, skip a frame to pull it back in */
+    if (stfu_n_depth(i) > i->target_qlen + 2 && i->buffered > i->target_qlen) {
+        slot = stfu_n_slot(i, i->play_ts);
+        if (!slot->was_read && slot->ts == i->play_ts) {
+            slot->was_read = 1;
+            i->buffered--;
+            i->session_discard_count++;
+        }
+        i->play_ts += i->samples_per_packet;
+    }
+
+    slot = stfu_n_slot(i, i->play_ts);
+
+    if (!slot->was_read && slot->ts == i->play_ts) {
+        /* the a queue is unused in this mode, its frame carries what is played out */
+        frame = &i->a_queue.int_frame;
+        memcpy(frame->data, slot->data, slot->dlen);
+        frame->dlen = slot->dlen;
+        frame->ts = slot->ts;
+        frame->pt = slot->pt;
+        frame->plc = 0;
+        frame->was_read = 1;
+
+        slot->was_read = 1;
+        i->buffered--;
+        i->period_packet_out_count++;
+        i->session_packet_out_count++;
+        i->consecutive_good_count++;
+        i->period_good_count++;
+        i->consecutive_bad_count = 0;
+        i->miss_count = 0;
+        i->last_frame = frame;
+        i->last_wr_ts = frame->ts;
+
+        if (frame->dlen) {
+            i->plc_len = frame->dlen;
+        }
+        i->plc_pt = frame->pt;
+        i->play_ts += i->samples_per_packet;
+    } else {
+        i->consecutive_bad_count++;
+        i->period_bad_count++;
+        i->consecutive_good_count = 0;
+        i->period_missing_count++;
+        i->session_missing_count++;
+        i->session_plc_count++;
+
+        frame = &i->out_queue->int_frame;
+        frame->dlen = i->plc_len;
+        frame->pt = i->plc_pt;
+        frame->ts = i->play_ts;
+        i->last_wr_ts = i->play_ts;
+
+        if (stfu_log != null_logger && i->debug) {
+            stfu_log(STFU_LOG_EMERG, "%s PLC %u:%u buffered:%u\n", i->name, frame->ts, frame->ts / i->samples_per_packet, i->buffered);
+        }
+
+        if (++i->miss_count > i->max_plc) {
+            stfu_n_reset(i);
+            return NULL;
+        }
+
+        /* an empty buffer means the frames are late rather than lost, hold position to grow the delay */
+        if (i->buffered) {
+            i->play_ts += i->samples_per_packet;
+        }
+    }
+
+    /* keep the slot arithmetic away from the 32 bit wrap, slot positions do not move */
+    if ((uint32_t)(i->play_ts - i->base_ts) > 0x40000000) {
+        i->base_ts += ((i->play_ts - i->base_ts) / (i->samples_per_packet * i->slot_count)) * i->samples_per_packet * i->slot_count;
+    }
+
+    return frame;
+}
+
 stfu_status_t stfu_n_add_data(stfu_instance_t *i, uint32_t ts, uint32_t pt, void *data, size_t datalen, uint32_t timer_ts, int last)
 {
 	uint32_t index = 0;
@@ -430,6 +797,19 @@ stfu_status_t stfu_n_add_data(stfu_instance_t *i, uint32_t ts, uint32_t pt, void
             return STFU_IT_FAILED;
         }
     }
+
+    if ((i->flags & STFU_FLAG_INDEXED)) {
+        if (last) {
+            return STFU_IM_DONE;
+        }
+
+        if (!i->samples_per_packet) {
+            i->last_rd_ts = ts;
+            return STFU_IT_FAILED;
+        }
+
+        return stfu_n_add_data_indexed(i, ts, pt, data, datalen, timer_ts);
+    }
  
     if (timer_ts) {
         if (ts && !i->ts_offset) {
@@ -635,6 +1015,10 @@ stfu_frame_t *stfu_n_read_a_frame(stfu_instance_t *i)
 	if (!i->samples_per_packet) {
         return NULL;
     }
+
+    if ((i->flags & STFU_FLAG_INDEXED)) {
+        return stfu_n_read_a_frame_indexed(i);
+    }
     
     if (!i->ready) {
         if (stfu_log != null_logger && i->debug) {
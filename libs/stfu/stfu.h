@@ -174,12 +174,23 @@ typedef struct stfu_frame stfu_frame_t;
 struct stfu_instance;
 typedef struct stfu_instance stfu_instance_t;
 
+typedef enum {
+	STFU_FLAG_NONE = 0,
+	/* timestamp indexed ring with an adaptive delay instead of the swapping queues */
+	STFU_FLAG_INDEXED = (1 << 0)
+} stfu_flag_t;
+
 typedef struct {
 	uint32_t qlen;
 	uint32_t packet_in_count;
 	uint32_t clean_count;
 	uint32_t consecutive_good_count;
 	uint32_t consecutive_bad_count;
+	/* session totals, only kept by indexed instances */
+	uint32_t plc_count;
+	uint32_t late_count;
+	uint32_t discard_count;
+	uint32_t jitter;
 } stfu_report_t;
 
 typedef void (*stfu_n_call_me_t)(stfu_instance_t *i, void *);
@@ -187,6 +198,7 @@ typedef void (*stfu_n_call_me_t)(stfu_instance_t *i, void *);
 void stfu_n_report(stfu_instance_t *i, stfu_report_t *r);
 void stfu_n_destroy(stfu_instance_t **i);
 stfu_instance_t *stfu_n_init(uint32_t qlen, uint32_t max_qlen, uint32_t samples_per_packet, uint32_t samples_per_second, uint32_t max_drift_ms);
+stfu_instance_t *stfu_n_init_ex(uint32_t qlen, uint32_t max_qlen, uint32_t samples_per_packet, uint32_t samples_per_second, uint32_t max_drift_ms, uint32_t flags);
 stfu_status_t stfu_n_resize(stfu_instance_t *i, uint32_t qlen);
 stfu_status_t stfu_n_add_data(stfu_instance_t *i, uint32_t ts, uint32_t pt, void *data, size_t datalen, uint32_t timer_ts, int last);
 stfu_frame_t *stfu_n_read_a_frame(stfu_instance_t *i);
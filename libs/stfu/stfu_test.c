@@ -0,0 +1,193 @@
+/*
+ * stfu_test.c -- replay an impaired packet stream through the indexed jitter buffer
+ *
+ * A 20ms 8kHz stream is sent through a deterministic network model (jitter, loss,
+ * reordering and duplicates) and the buffer is read once per 20ms tick, the way
+ * switch_rtp does.  Every frame played out has to be the one its timestamp names,
+ * timestamps have to move forward, and the counters have to add up.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stfu.h"
+
+#define SPP 160
+#define PACKETS 3000
+#define PAYLOAD 160
+
+typedef struct {
+	uint32_t ts;
+	uint32_t arrival;
+} test_packet_t;
+
+typedef struct {
+	const char *name;
+	uint32_t jitter_ms;
+	uint32_t loss_pct;
+	uint32_t reorder_pct;
+	uint32_t dup_pct;
+	uint32_t min_played_pct;
+} test_case_t;
+
+static uint32_t seed;
+
+static uint32_t test_rand(uint32_t range)
+{
+	seed = seed * 1103515245 + 12345;
+	return range ? ((seed >> 16) & 0x7fff) % range : 0;
+}
+
+static void fill_payload(uint8_t *data, uint32_t ts)
+{
+	int x;
+
+	for (x = 0; x < PAYLOAD; x++) {
+		data[x] = (uint8_t) ((ts / SPP) + x);
+	}
+}
+
+static int check_payload(stfu_frame_t *frame)
+{
+	uint8_t expect[PAYLOAD];
+
+	fill_payload(expect, frame->ts);
+	return frame->dlen == PAYLOAD && !memcmp(frame->data, expect, PAYLOAD);
+}
+
+static int cmp_arrival(const void *a, const void *b)
+{
+	const test_packet_t *pa = a, *pb = b;
+
+	if (pa->arrival != pb->arrival) {
+		return pa->arrival < pb->arrival ? -1 : 1;
+	}
+	return pa->ts < pb->ts ? -1 : pa->ts > pb->ts;
+}
+
+static int run_case(const test_case_t *tc)
+{
+	test_packet_t *packets = calloc(PACKETS * 2, sizeof(*packets));
+	stfu_instance_t *jb;
+	stfu_report_t r = { 0 };
+	uint32_t count = 0, next = 0, now, x, played = 0, plc = 0, lost = 0, last_ts = 0;
+	uint8_t data[PAYLOAD];
+	int errors = 0, have_last = 0, tail_plc = 0;
+
+	seed = 0x5eed;
+
+	/* the network: a base delay of 40ms plus jitter, with reordering pushing a packet back behind the next ones */
+	for (x = 0; x < PACKETS; x++) {
+		uint32_t ts = 1000 + x * SPP, arrival = x * SPP + 320 + test_rand(tc->jitter_ms * 8 + 1);
+
+		if (test_rand(100) < tc->loss_pct) {
+			lost++;
+			continue;
+		}
+
+		if (test_rand(100) < tc->reorder_pct) {
+			arrival += SPP * (1 + test_rand(3));
+		}
+
+		packets[count].ts = ts;
+		packets[count].arrival = arrival;
+		count++;
+
+		if (test_rand(100) < tc->dup_pct) {
+			packets[count].ts = ts;
+			packets[count].arrival = arrival + test_rand(SPP);
+			count++;
+		}
+	}
+
+	qsort(packets, count, sizeof(*packets), cmp_arrival);
+
+	jb = stfu_n_init_ex(3, 20, SPP, 8000, 0, STFU_FLAG_INDEXED);
+
+	for (now = 0; now < (PACKETS + 100) * SPP; now += SPP) {
+		stfu_frame_t *frame;
+
+		while (next < count && packets[next].arrival <= now) {
+			fill_payload(data, packets[next].ts);
+			stfu_n_add_data(jb, packets[next].ts, 0, data, PAYLOAD, packets[next].arrival, 0);
+			next++;
+		}
+
+		if (!(frame = stfu_n_read_a_frame(jb))) {
+			continue;
+		}
+
+		if (frame->plc) {
+			/* the stream is over, this concealment is not part of it */
+			if ((int32_t) (frame->ts - (1000 + (PACKETS - 1) * SPP)) > 0) {
+				tail_plc = 1;
+				break;
+			}
+			plc++;
+			continue;
+		}
+
+		if (!check_payload(frame)) {
+			printf("%s: frame %u carries the wrong payload\n", tc->name, frame->ts);
+			errors++;
+		}
+
+		if (have_last && (int32_t) (frame->ts - last_ts) <= 0) {
+			printf("%s: frame %u played after %u\n", tc->name, frame->ts, last_ts);
+			errors++;
+		}
+
+		last_ts = frame->ts;
+		have_last = 1;
+		played++;
+	}
+
+	stfu_n_report(jb, &r);
+
+	if (played * 100 < (PACKETS - lost) * tc->min_played_pct) {
+		printf("%s: only %u of %u frames that arrived were played\n", tc->name, played, PACKETS - lost);
+		errors++;
+	}
+
+	if (r.plc_count != plc + tail_plc) {
+		printf("%s: %u PLC frames played but %u reported\n", tc->name, plc, r.plc_count);
+		errors++;
+	}
+
+	if (tc->dup_pct && !r.discard_count) {
+		printf("%s: duplicates were not discarded\n", tc->name);
+		errors++;
+	}
+
+	if (!tc->loss_pct && !tc->jitter_ms && !tc->reorder_pct && (plc || r.late_count)) {
+		printf("%s: a clean stream had %u PLC and %u late frames\n", tc->name, plc, r.late_count);
+		errors++;
+	}
+
+	printf("%-10s played %4u plc %3u late %3u discard %3u jitter %3u lost %3u %s\n", tc->name, played, plc, r.late_count,
+		   r.discard_count, r.jitter, lost, errors ? "FAIL" : "ok");
+
+	stfu_n_destroy(&jb);
+	free(packets);
+
+	return errors;
+}
+
+int main(int argc, char *argv[])
+{
+	static const test_case_t cases[] = {
+		{"clean", 0, 0, 0, 0, 99},
+		{"jitter", 60, 0, 0, 0, 97},
+		{"loss", 20, 5, 0, 0, 97},
+		{"reorder", 20, 0, 10, 0, 95},
+		{"duplicate", 20, 0, 0, 5, 97},
+		{"mixed", 60, 3, 5, 2, 90}
+	};
+	int x, errors = 0;
+
+	for (x = 0; x < (int) (sizeof(cases) / sizeof(cases[0])); x++) {
+		errors += run_case(&cases[x]);
+	}
+
+	return errors ? 1 : 0;
+}
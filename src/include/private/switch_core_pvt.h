@@ -171,6 +171,13 @@ struct switch_core_session {
 	uint32_t soft_lock;
 	switch_ivr_dmachine_t *dmachine[2];
 	plc_state_t *plc;
+	uint32_t silence_threshold;
+	const switch_codec_implementation_t *silence_read_impl;
+	uint32_t silence_read_len;
+	uint8_t silence_read_buf[SWITCH_RECOMMENDED_BUFFER_SIZE];
+	const switch_codec_implementation_t *silence_write_impl;
+	uint32_t silence_write_len;
+	uint8_t silence_write_buf[SWITCH_RECOMMENDED_BUFFER_SIZE];
 };
 
 struct switch_media_bug {
@@ -199,6 +206,8 @@ struct switch_media_bug {
 	uint32_t record_pre_buffer_count;
 	uint32_t record_pre_buffer_max;
 	switch_frame_t *ping_frame;
+	switch_size_t read_silence;
+	switch_size_t write_silence;
 	struct switch_media_bug *next;
 };
 
@@ -473,6 +473,16 @@ SWITCH_DECLARE(void) switch_atomic_inc(volatile switch_atomic_t *mem);
  */
 SWITCH_DECLARE(int)  switch_atomic_dec(volatile switch_atomic_t *mem);
 
+/**
+ * Compare the value at the specified memory location with cmp and, if equal,
+ * replace it with with, as one atomic operation.
+ * @param mem The location of the value.
+ * @param with The value to store.
+ * @param cmp The value expected at mem.
+ * @return the value found at mem before the operation
+ */
+SWITCH_DECLARE(uint32_t) switch_atomic_cas(volatile switch_atomic_t *mem, uint32_t with, uint32_t cmp);
+
 /** @} */
 
 /**
@@ -1196,6 +1206,16 @@ SWITCH_DECLARE(switch_status_t) switch_sockaddr_create(switch_sockaddr_t **sa, s
  */
 SWITCH_DECLARE(switch_status_t) switch_socket_send(switch_socket_t *sock, const char *buf, switch_size_t *len);
 
+/**
+ * Send several buffers as one stream write (writev), blocking like switch_socket_send until all of it is sent
+ * @param sock The socket to send the data over.
+ * @param bufs The buffers to send, in order
+ * @param lens The length of each buffer
+ * @param count The number of buffers, at most 16
+ * @param len On exit, the number of bytes sent.
+ */
+SWITCH_DECLARE(switch_status_t) switch_socket_sendv(switch_socket_t *sock, const char **bufs, const switch_size_t *lens, uint32_t count, switch_size_t *len);
+
 /**
  * @param sock The socket to send from
  * @param where The apr_sockaddr_t describing where to send the data
@@ -1205,6 +1225,19 @@ SWITCH_DECLARE(switch_status_t) switch_socket_send(switch_socket_t *sock, const
  */
 SWITCH_DECLARE(switch_status_t) switch_socket_sendto(switch_socket_t *sock, switch_sockaddr_t *where, int32_t flags, const char *buf,
 													 switch_size_t *len);
+
+/**
+ * Send a burst of datagrams to the same destination, with one system call where the platform allows (sendmmsg)
+ * @param sock The socket to send from
+ * @param where The apr_sockaddr_t describing where to send the data
+ * @param flags The flags to use
+ * @param bufs The datagrams to send
+ * @param lens The length of each datagram
+ * @param count The number of datagrams
+ * @param sent The number of datagrams actually sent
+ */
+SWITCH_DECLARE(switch_status_t) switch_socket_sendto_multi(switch_socket_t *sock, switch_sockaddr_t *where, int32_t flags, const char **bufs,
+														   const switch_size_t *lens, uint32_t count, uint32_t *sent);
 													
 SWITCH_DECLARE(switch_status_t) switch_socket_send_nonblock(switch_socket_t *sock, const char *buf, switch_size_t *len);
 
@@ -70,6 +70,17 @@ SWITCH_DECLARE(switch_status_t) switch_buffer_create(_In_ switch_memory_pool_t *
 SWITCH_DECLARE(switch_status_t) switch_buffer_create_dynamic(_Out_ switch_buffer_t **buffer, _In_ switch_size_t blocksize, _In_ switch_size_t start_len,
 															 _In_ switch_size_t max_len);
 
+/*! \brief Allocate a new fixed size ring switch_buffer
+ * A ring buffer may be shared by exactly one writing and one reading thread without any locking.
+ * Reads, peeks, toss and zero belong to the reader, writes to the writer; a write that does not fit returns 0,
+ * switch_buffer_slide_write makes room by discarding the oldest data instead.
+ * \param pool Pool to allocate the buffer from or NULL to malloc it (it is then freed by switch_buffer_destroy)
+ * \param buffer returned pointer to the new buffer
+ * \param max_len length required by the buffer, rounded up to a power of two
+ * \return status
+ */
+SWITCH_DECLARE(switch_status_t) switch_buffer_create_ring(_In_opt_ switch_memory_pool_t *pool, _Out_ switch_buffer_t **buffer, _In_ switch_size_t max_len);
+
 SWITCH_DECLARE(void) switch_buffer_add_mutex(_In_ switch_buffer_t *buffer, _In_ switch_mutex_t *mutex);
 SWITCH_DECLARE(void) switch_buffer_lock(_In_ switch_buffer_t *buffer);
 SWITCH_DECLARE(switch_status_t) switch_buffer_trylock(_In_ switch_buffer_t *buffer);
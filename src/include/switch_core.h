@@ -226,6 +226,14 @@ SWITCH_DECLARE(void) switch_core_media_bug_set_read_replace_frame(_In_ switch_me
 SWITCH_DECLARE(switch_status_t) switch_core_media_bug_remove(_In_ switch_core_session_t *session, _Inout_ switch_media_bug_t **bug);
 SWITCH_DECLARE(uint32_t) switch_core_media_bug_prune(switch_core_session_t *session);
 
+/*!
+  \brief Count the media bugs on a session
+  \param session the session to check
+  \param function only count bugs added by this function (NULL for all)
+  \return the number of matching bugs
+*/
+SWITCH_DECLARE(uint32_t) switch_core_media_bug_count(switch_core_session_t *session, const char *function);
+
 /*!
   \brief Remove media bug callback
   \param bug bug to remove
@@ -250,6 +258,13 @@ SWITCH_DECLARE(switch_status_t) switch_core_media_bug_remove_all(_In_ switch_cor
 SWITCH_DECLARE(switch_status_t) switch_core_media_bug_enumerate(switch_core_session_t *session, switch_stream_handle_t *stream);
 SWITCH_DECLARE(switch_status_t) switch_core_media_bug_transfer_recordings(switch_core_session_t *orig_session, switch_core_session_t *new_session);
 
+/*!
+  \brief Check if anything on the session needs to see its media frames
+  \param session the session to check
+  \return SWITCH_TRUE if there are media bugs, frame or dtmf hooks, digit bindings or a temporary codec on the session
+*/
+SWITCH_DECLARE(switch_bool_t) switch_core_session_media_tapped(_In_ switch_core_session_t *session);
+
 /*!
   \brief Read a frame from the bug
   \param bug the bug to read from
@@ -283,6 +298,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_media_bug_set_pre_buffer_framecount(
   \param start the starting port
   \param end the ending port
   \param flags flags to change allocator behaviour (e.g. only even/odd portnumbers)
+  \note with SPF_EVEN only the port is handed out but the odd port above it is kept free for RTCP
   \param new_allocator new pointer for the return value
   \return SWITCH_STATUS_SUCCESS if the operation was a success
 */
@@ -306,6 +322,21 @@ SWITCH_DECLARE(switch_status_t) switch_core_port_allocator_request_port(_In_ swi
 */
 SWITCH_DECLARE(switch_status_t) switch_core_port_allocator_free_port(_In_ switch_core_port_allocator_t *alloc, _In_ switch_port_t port);
 
+/*!
+  \brief Set how long a returned port is held back before it can be handed out again
+  \param alloc the allocator object
+  \param ms the quarantine time in milliseconds
+  \note the oldest quarantined port is reused early if nothing else is free
+*/
+SWITCH_DECLARE(void) switch_core_port_allocator_set_quarantine(_In_ switch_core_port_allocator_t *alloc, _In_ uint32_t ms);
+
+/*!
+  \brief Get the utilisation counters of the port allocator
+  \param alloc the allocator object
+  \param stats the structure to fill in
+*/
+SWITCH_DECLARE(void) switch_core_port_allocator_get_stats(_In_ switch_core_port_allocator_t *alloc, _Out_ switch_port_allocator_stats_t *stats);
+
 /*!
   \brief destroythe port allocator
   \param alloc the allocator object
@@ -1134,6 +1165,64 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_read_video_frame(_In_ switch
 SWITCH_DECLARE(switch_status_t) switch_core_session_write_video_frame(_In_ switch_core_session_t *session, switch_frame_t *frame, switch_io_flag_t flags,
 																	  int stream_id);
 
+/*!
+  \brief Write a whole video access unit to a session in one call
+  \param session the session to write to
+  \param train the access unit to write
+  \param flags I/O flags to modify behavior (i.e. non blocking)
+  \param stream_id which logical media channel to use
+  \return SWITCH_STATUS_SUCCESS a if the access unit was written
+  \note endpoints without a train writer get the packets one at a time
+*/
+SWITCH_DECLARE(switch_status_t) switch_core_session_write_video_train(_In_ switch_core_session_t *session, switch_video_train_t *train, switch_io_flag_t flags,
+																	  int stream_id);
+
+/*!
+  \brief Allocate an empty video train
+  \param train a NULL pointer to aim at the new train
+  \param pool the pool to allocate from
+  \return SWITCH_STATUS_SUCCESS if the train was allocated
+*/
+SWITCH_DECLARE(switch_status_t) switch_core_video_train_create(switch_video_train_t **train, switch_memory_pool_t *pool);
+
+/*!
+  \brief Empty a video train so it can collect the next access unit
+  \param train the train to reset
+*/
+SWITCH_DECLARE(void) switch_core_video_train_reset(switch_video_train_t *train);
+
+/*!
+  \brief Copy a read video packet onto the end of a train
+  \param train the train to append to
+  \param frame the packet to copy (it may be reused by the reader as soon as this returns)
+  \return SWITCH_STATUS_SUCCESS if more packets are expected, SWITCH_STATUS_BREAK when the access unit is complete
+  and SWITCH_STATUS_MEMERR if the packet does not fit (write the train out and push it again)
+*/
+SWITCH_DECLARE(switch_status_t) switch_core_video_train_push(switch_video_train_t *train, switch_frame_t *frame);
+
+/*!
+  \brief Tell if an unfinished train has to be written out before the next packet
+  \param train the train to check
+  \param next the packet about to be pushed (NULL when none was read)
+  \return SWITCH_TRUE when the marker of the access unit was lost, the next packet belongs to another picture or
+  the train has waited longer than SWITCH_VIDEO_TRAIN_TIMEOUT
+*/
+SWITCH_DECLARE(switch_bool_t) switch_core_video_train_stale(switch_video_train_t *train, switch_frame_t *next);
+
+/*!
+  \brief Copy a whole train (e.g. to keep a keyframe around)
+  \param dst the train to copy to
+  \param src the train to copy from
+*/
+SWITCH_DECLARE(void) switch_core_video_train_copy(switch_video_train_t *dst, const switch_video_train_t *src);
+
+/*!
+  \brief Check whether a video packet starts a keyframe (H.264 IDR/SPS or VP8 key frame)
+  \param frame the packet to check
+  \return SWITCH_TRUE if the packet carries keyframe data
+*/
+SWITCH_DECLARE(switch_bool_t) switch_core_video_frame_is_keyframe(switch_frame_t *frame);
+
 SWITCH_DECLARE(switch_status_t) switch_core_session_set_read_impl(switch_core_session_t *session, const switch_codec_implementation_t *impp);
 SWITCH_DECLARE(switch_status_t) switch_core_session_set_write_impl(switch_core_session_t *session, const switch_codec_implementation_t *impp);
 SWITCH_DECLARE(switch_status_t) switch_core_session_set_video_read_impl(switch_core_session_t *session, const switch_codec_implementation_t *impp);
@@ -1456,6 +1545,17 @@ SWITCH_DECLARE(switch_status_t) switch_core_codec_decode(switch_codec_t *codec,
 														 uint32_t encoded_rate,
 														 void *decoded_data, uint32_t *decoded_data_len, uint32_t *decoded_rate, unsigned int *flag);
 
+/*!
+  \brief Classify an encoded frame as silence without decoding it
+  \param impl the implementation the frame was encoded with (PCMU, PCMA and L16 are understood)
+  \param data the encoded payload
+  \param datalen the size of the payload in bytes
+  \param threshold linear amplitude a sample must exceed to count as audible (0 for the default)
+  \return SWITCH_TRUE if no more than 1/16th of the samples exceed the threshold, SWITCH_FALSE otherwise or for unsupported codecs
+*/
+SWITCH_DECLARE(switch_bool_t) switch_core_codec_frame_is_silent(const switch_codec_implementation_t *impl, const void *data, uint32_t datalen,
+																uint32_t threshold);
+
 /*! 
   \brief Destroy an initalized codec handle
   \param codec the codec handle to destroy
@@ -297,6 +297,28 @@ SWITCH_DECLARE(switch_status_t) switch_event_free_subclass_detailed(const char *
 */
 SWITCH_DECLARE(switch_status_t) switch_event_serialize(switch_event_t *event, char **str, switch_bool_t encode);
 SWITCH_DECLARE(switch_status_t) switch_event_serialize_json(switch_event_t *event, char **str);
+
+#define SWITCH_EVENT_BINARY_VERSION 1
+
+/*!
+  \brief Render an event in the compact binary form offered to event socket clients
+  \param event the event to render
+  \param str a string pointer to point at the allocated data
+  \param len the length of the rendered data, it is not NUL terminated text
+  \return SWITCH_STATUS_SUCCESS if the operation was successful
+  \note the layout is "FSB" plus a version byte, a header count, then per header a name code (0 for a literal name
+  followed by its length and bytes) and the value length and bytes, then the body length and bytes. Lengths are
+  7 bit varints and values are sent as is, without url encoding. You must free the resulting data.
+*/
+SWITCH_DECLARE(switch_status_t) switch_event_serialize_binary(switch_event_t *event, char **str, switch_size_t *len);
+/*!
+  \brief Rebuild an event from the output of switch_event_serialize_binary
+  \param event a NULL pointer on which to create the event
+  \param data the rendered event
+  \param len the length of data
+  \return SWITCH_STATUS_SUCCESS if the event was created, SWITCH_STATUS_FALSE when data is truncated or malformed
+*/
+SWITCH_DECLARE(switch_status_t) switch_event_create_binary(switch_event_t **event, const char *data, switch_size_t len);
 SWITCH_DECLARE(switch_status_t) switch_event_create_json(switch_event_t **event, const char *json);
 SWITCH_DECLARE(switch_status_t) switch_event_create_brackets(char *data, char a, char b, char c, switch_event_t **event, char **new_data, switch_bool_t dup);
 
@@ -317,6 +339,48 @@ SWITCH_DECLARE(switch_xml_t) switch_event_xmlize(switch_event_t *event, const ch
 */
 SWITCH_DECLARE(switch_status_t) switch_event_running(void);
 
+/*!
+  \brief Attach a sink to the event export stage
+  \param name a unique name for the sink
+  \param event_id the type of event to export (SWITCH_EVENT_ALL for all)
+  \param queue_size how many records may wait for the sink before new ones are dropped
+  \param batch_size the most records handed to the write callback at once
+  \param write the callback run on the sink's own thread with each batch
+  \param user_data a pointer passed to the callback
+  \param sink a pointer to the new sink
+  \return SWITCH_STATUS_SUCCESS if the sink was started
+  \note Each delivered event is serialized once with switch_event_serialize_binary and offered to every sink without
+  blocking, a sink that falls behind loses records instead of holding up delivery.
+*/
+SWITCH_DECLARE(switch_status_t) switch_event_export_add_sink(const char *name, switch_event_types_t event_id, uint32_t queue_size,
+															 uint32_t batch_size, switch_event_export_write_t write, void *user_data,
+															 switch_event_export_sink_t **sink);
+
+/*!
+  \brief Detach a sink from the event export stage, records already queued for it are written first
+  \param sink the sink to remove
+  \return SWITCH_STATUS_SUCCESS if the sink was removed
+*/
+SWITCH_DECLARE(switch_status_t) switch_event_export_remove_sink(switch_event_export_sink_t **sink);
+
+/*!
+  \brief Export events to a file, as records framed by a 4 byte network order length
+  \param path the file to write
+  \param max_size rotate the file once it grows past this many bytes (0 to never rotate)
+  \param keep how many rotated files (path.1 .. path.keep) to keep
+  \param queue_size the queue size of the sink
+  \return SWITCH_STATUS_SUCCESS if the sink was started
+*/
+SWITCH_DECLARE(switch_status_t) switch_event_export_file(const char *path, switch_size_t max_size, uint32_t keep, uint32_t queue_size);
+
+/*!
+  \brief Export events to a UNIX stream socket, framed the same way as switch_event_export_file
+  \param path the socket to connect to, the connection is retried while it is down
+  \param queue_size the queue size of the sink
+  \return SWITCH_STATUS_SUCCESS if the sink was started
+*/
+SWITCH_DECLARE(switch_status_t) switch_event_export_socket(const char *path, uint32_t queue_size);
+
 #ifndef SWIG
 /*!
   \brief Add a body to an event
@@ -72,6 +72,31 @@ SWITCH_BEGIN_EXTERN_C
 	switch_frame_flag_t flags;
 };
 
+/*! the most RTP packets a single video access unit may span */
+#define SWITCH_VIDEO_TRAIN_MAX_PACKETS 128
+/*! storage reserved for the packets of one access unit */
+#define SWITCH_VIDEO_TRAIN_ARENA_SIZE (SWITCH_VIDEO_TRAIN_MAX_PACKETS * 1500)
+/*! how long (us) an access unit whose marker never arrived is held before it goes out anyway */
+#define SWITCH_VIDEO_TRAIN_TIMEOUT 100000
+
+/*! \brief A video access unit (every RTP packet of one picture, up to the marker) moved as one unit */
+struct switch_video_train {
+	/*! the packets of the access unit in send order */
+	switch_frame_t frames[SWITCH_VIDEO_TRAIN_MAX_PACKETS];
+	/*! the number of packets in use */
+	uint32_t count;
+	/*! backing store for the packet data */
+	uint8_t *arena;
+	/*! the number of arena bytes in use */
+	uint32_t arena_used;
+	/*! the access unit is complete (marker seen) */
+	switch_bool_t complete;
+	/*! the access unit carries a keyframe */
+	switch_bool_t keyframe;
+	/*! when the first packet was pushed */
+	switch_time_t started;
+};
+
 SWITCH_END_EXTERN_C
 #endif
 /* For Emacs:
@@ -118,6 +118,7 @@ typedef switch_status_t (*switch_io_state_change_t) (switch_core_session_t *);
 typedef switch_status_t (*switch_io_state_run_t) (switch_core_session_t *);
 typedef switch_status_t (*switch_io_read_video_frame_t) (switch_core_session_t *, switch_frame_t **, switch_io_flag_t, int);
 typedef switch_status_t (*switch_io_write_video_frame_t) (switch_core_session_t *, switch_frame_t *, switch_io_flag_t, int);
+typedef switch_status_t (*switch_io_write_video_train_t) (switch_core_session_t *, switch_video_train_t *, switch_io_flag_t, int);
 typedef switch_call_cause_t (*switch_io_resurrect_session_t) (switch_core_session_t **, switch_memory_pool_t **, void *);
 
 typedef enum {
@@ -160,7 +161,9 @@ struct switch_io_routines {
 	switch_io_state_run_t state_run;
 	/*! resurrect a session */
 	switch_io_resurrect_session_t resurrect_session;
-	void *padding[10];
+	/*! write a whole video access unit to a session */
+	switch_io_write_video_train_t write_video_train;
+	void *padding[9];
 };
 
 /*! \brief Abstraction of an module endpoint interface
@@ -49,6 +49,23 @@ SWITCH_DECLARE(int) switch_regex_copy_substring(const char *subject, int *ovecto
 
 SWITCH_DECLARE(void) switch_regex_free(void *data);
 
+/*!
+ \brief Compile an expression the way switch_regex_perform does, for matching many times
+ \param expression a pattern, /pattern/flags (i, s) or an _asterisk style pattern
+ \return the compiled expression, free it with switch_regex_safe_free, or NULL when it does not compile
+*/
+SWITCH_DECLARE(switch_regex_t *) switch_regex_compile_expression(const char *expression);
+
+/*!
+ \brief Match a string against a compiled expression
+ \param re the expression from switch_regex_compile_expression
+ \param field the string to match
+ \param ovector vector of integers for substring information
+ \param olen the number of elements in ovector
+ \return the match count, 0 if it did not match
+*/
+SWITCH_DECLARE(int) switch_regex_exec(switch_regex_t *re, const char *field, int *ovector, uint32_t olen);
+
 SWITCH_DECLARE(int) switch_regex_perform(const char *field, const char *expression, switch_regex_t **new_re, int *ovector, uint32_t olen);
 SWITCH_DECLARE(void) switch_perform_substitution(switch_regex_t *re, int match_count, const char *data, const char *field_data,
 												 char *substituted, switch_size_t len, int *ovector);
@@ -167,6 +167,23 @@ SWITCH_DECLARE(void) switch_change_sln_volume(int16_t *data, uint32_t samples, i
   \param vol the volume factor -12 -> 12
  */
 SWITCH_DECLARE(void) switch_change_sln_volume_granular(int16_t *data, uint32_t samples, int32_t vol);
+
+/*!
+  \brief Compute the energy of a signed linear audio frame
+  \param data the audio data
+  \param samples the number of samples per channel
+  \param channels the number of interleaved channels, only the first one is measured
+  \return the mean absolute sample value
+ */
+SWITCH_DECLARE(uint32_t) switch_sln_energy(const int16_t *data, uint32_t samples, uint32_t channels);
+
+/*!
+  \brief Feed the energy of one frame to a noise floor estimate
+  \param nf the estimate, zeroed before the first frame
+  \param energy the frame energy from switch_sln_energy
+  \return the updated noise floor
+ */
+SWITCH_DECLARE(uint32_t) switch_sln_noise_floor_update(switch_noise_floor_t *nf, uint32_t energy);
 ///\}
 
 SWITCH_DECLARE(uint32_t) switch_merge_sln(int16_t *data, uint32_t samples, int16_t *other_data, uint32_t other_samples);
@@ -46,6 +46,8 @@ SWITCH_BEGIN_EXTERN_C
 #define SWITCH_RTP_KEY_LEN 30
 #define SWITCH_RTP_CRYPTO_KEY_32 "AES_CM_128_HMAC_SHA1_32"
 #define SWITCH_RTP_CRYPTO_KEY_80 "AES_CM_128_HMAC_SHA1_80"
+#define SWITCH_RTP_QUALITY_EVENT "rtp::quality"
+#define SWITCH_RTP_AUDIO_PRIVATE "__rtcp_audio_rtp_session"
 	typedef enum {
 	SWITCH_RTP_CRYPTO_SEND,
 	SWITCH_RTP_CRYPTO_RECV,
@@ -90,6 +92,24 @@ SWITCH_DECLARE(void) switch_rtp_get_random(void *buf, uint32_t len);
 SWITCH_DECLARE(void) switch_rtp_init(switch_memory_pool_t *pool);
 SWITCH_DECLARE(void) switch_rtp_shutdown(void);
 
+/*!
+  \brief Get the name of the engine new SRTP streams use for AES_CM (set with the srtp_engine global variable)
+  \return the engine name ("openssl" or "builtin")
+*/
+SWITCH_DECLARE(const char *) switch_rtp_get_srtp_engine(void);
+
+/*!
+  \brief Measure single core srtp_protect throughput of an SRTP engine
+  \param engine the engine to benchmark ("openssl" or "builtin")
+  \param type the crypto suite to protect with
+  \param packets the number of packets to protect
+  \param payload_len the RTP payload length of each packet
+  \param pps the measured packets per second
+  \return SWITCH_STATUS_SUCCESS or SWITCH_STATUS_FALSE if the engine is not available
+*/
+SWITCH_DECLARE(switch_status_t) switch_rtp_srtp_bench(const char *engine, switch_rtp_crypto_key_type_t type,
+													  uint32_t packets, switch_size_t payload_len, double *pps);
+
 /*!
   \brief Set/Get RTP start port
   \param port new value (if > 0)
@@ -114,6 +134,24 @@ SWITCH_DECLARE(switch_port_t) switch_rtp_set_end_port(switch_port_t port);
 SWITCH_DECLARE(switch_port_t) switch_rtp_request_port(const char *ip);
 SWITCH_DECLARE(void) switch_rtp_release_port(const char *ip, switch_port_t port);
 
+/*!
+  \brief Set how long a released RTP port is held back before it is handed out again
+  \param ms the quarantine time in milliseconds
+  \return the current quarantine time
+*/
+SWITCH_DECLARE(uint32_t) switch_rtp_set_port_quarantine(uint32_t ms);
+
+typedef void (*switch_rtp_port_stats_callback_t) (const char *ip, switch_port_allocator_stats_t *stats, void *user_data);
+
+/*!
+  \brief Report the utilisation of the RTP port allocators
+  \param ip the ip to report on or NULL for every ip ports were requested from
+  \param callback function called with the counters of each allocator
+  \param user_data passed to the callback
+  \return the number of allocators reported
+*/
+SWITCH_DECLARE(int) switch_rtp_port_stats(const char *ip, switch_rtp_port_stats_callback_t callback, void *user_data);
+
 SWITCH_DECLARE(switch_status_t) switch_rtp_set_interval(switch_rtp_t *rtp_session, uint32_t ms_per_packet, uint32_t samples_per_interval);
 
 SWITCH_DECLARE(switch_status_t) switch_rtp_change_interval(switch_rtp_t *rtp_session, uint32_t ms_per_packet, uint32_t samples_per_interval);
@@ -234,6 +272,19 @@ SWITCH_DECLARE(switch_status_t) switch_rtp_activate_jitter_buffer(switch_rtp_t *
 																  uint32_t max_queue_frames,
 																  uint32_t samples_per_packet, uint32_t samples_per_second, uint32_t max_drift);
 
+/*!
+  \brief Acvite a jitter buffer on an RTP session, choosing its implementation
+  \param rtp_session the rtp session
+  \param queue_frames the number of frames to delay
+  \param jb_mode which jitter buffer implementation to use when a new one is created
+  \return SWITCH_STATUS_SUCCESS
+*/
+SWITCH_DECLARE(switch_status_t) switch_rtp_activate_jitter_buffer_ex(switch_rtp_t *rtp_session,
+																	 uint32_t queue_frames,
+																	 uint32_t max_queue_frames,
+																	 uint32_t samples_per_packet, uint32_t samples_per_second, uint32_t max_drift,
+																	 switch_rtp_jb_mode_t jb_mode);
+
 SWITCH_DECLARE(switch_status_t) switch_rtp_debug_jitter_buffer(switch_rtp_t *rtp_session, const char *name);
 
 SWITCH_DECLARE(switch_status_t) switch_rtp_deactivate_jitter_buffer(switch_rtp_t *rtp_session);
@@ -402,6 +453,16 @@ SWITCH_DECLARE(switch_status_t) switch_rtp_disable_vad(switch_rtp_t *rtp_session
 */
 SWITCH_DECLARE(int) switch_rtp_write_frame(switch_rtp_t *rtp_session, switch_frame_t *frame);
 
+/*! 
+  \brief Write a train of frames (e.g. every packet of a video access unit) to a given RTP session
+  \param rtp_session the RTP session to write to
+  \param frames the frames to write in order
+  \param count the number of frames
+  \return the number of bytes written or -1 on error
+  \note the write lock is taken once and the packets leave in one burst (sendmmsg where available)
+*/
+SWITCH_DECLARE(int) switch_rtp_write_frames(switch_rtp_t *rtp_session, switch_frame_t *frames, uint32_t count);
+
 /*! 
   \brief Write data with a specified payload and sequence number to a given RTP session
   \param rtp_session the RTP session to write to
@@ -458,7 +519,75 @@ SWITCH_DECLARE(switch_status_t) switch_rtp_activate_stun_ping(switch_rtp_t *rtp_
 
 SWITCH_DECLARE(void) switch_rtp_intentional_bugs(switch_rtp_t *rtp_session, switch_rtp_bug_flag_t bugs);
 
+
+/*!
+  \brief Fire a SWITCH_RTP_QUALITY_EVENT with the receive quality of the session periodically
+  \param rtp_session the RTP session
+  \param seconds the time between events, 0 to stop them
+*/
+SWITCH_DECLARE(void) switch_rtp_set_quality_event_interval(switch_rtp_t *rtp_session, uint32_t seconds);
+
+/*!
+  \brief Add an RTCP-XR VoIP metrics block (RFC 3611) to the RTCP reports we send
+  \param rtp_session the RTP session
+  \param enable SWITCH_TRUE to send the metrics
+*/
+SWITCH_DECLARE(void) switch_rtp_enable_rtcp_xr(switch_rtp_t *rtp_session, switch_bool_t enable);
+
+/*!
+  \brief Get the packet counters and receive quality of the session
+  \param rtp_session the RTP session
+  \param pool pool to copy the stats into or NULL to get the live ones
+  \return the stats
+*/
 SWITCH_DECLARE(switch_rtp_stats_t *) switch_rtp_get_stats(switch_rtp_t *rtp_session, switch_memory_pool_t *pool);
+
+/*!
+  \brief Copy the per stage latency histograms of the read and write loops
+  \param rtp_session the RTP session or NULL for the process wide totals of every leg, past and present
+  \param latency the histograms to fill in
+  \return SWITCH_STATUS_SUCCESS or SWITCH_STATUS_FALSE if the build was made with SWITCH_RTP_NO_LATENCY_STATS
+*/
+SWITCH_DECLARE(switch_status_t) switch_rtp_get_latency(switch_rtp_t *rtp_session, switch_rtp_latency_t *latency);
+
+/*!
+  \brief Read a percentile back from a latency histogram
+  \param histogram the histogram
+  \param percentile the percentile (0-100)
+  \return the upper bound in microseconds of the bucket holding the percentile, capped at the largest sample
+*/
+SWITCH_DECLARE(uint32_t) switch_rtp_histogram_percentile(const switch_rtp_histogram_t *histogram, double percentile);
+SWITCH_DECLARE(const char *) switch_rtp_latency_stage_name(switch_rtp_latency_stage_t stage);
+
+/*!
+  \brief Relay the RTP received on one session straight out of another on the shared relay thread
+  \param from the session to receive on (it hands back comfort noise to its own reader while relaying)
+  \param to the session to send on (its own writes are dropped while relaying)
+  \return SWITCH_STATUS_SUCCESS if the packets are relayed, SWITCH_STATUS_FALSE if the sessions need the media path
+  \note only the payload type, SSRC, sequence and timestamp are rewritten so the codecs must be identical
+*/
+SWITCH_DECLARE(switch_status_t) switch_rtp_relay_start(switch_rtp_t *from, switch_rtp_t *to);
+
+/*!
+  \brief Stop relaying what the session receives, it returns once the relay thread has let go of the socket
+  \param rtp_session the RTP session
+*/
+SWITCH_DECLARE(void) switch_rtp_relay_stop(switch_rtp_t *rtp_session);
+SWITCH_DECLARE(switch_bool_t) switch_rtp_relay_active(switch_rtp_t *rtp_session);
+SWITCH_DECLARE(void) switch_rtp_relay_get_stats(uint32_t *legs, switch_size_t *packets);
+
+/*!
+  \brief Measure how many packets the relay thread forwards per second over the loopback
+  \param ip the local address to bind the legs to
+  \param calls the number of relayed calls (each one an inbound and an outbound leg)
+  \param seconds how long to run
+  \param packets the number of packets relayed
+  \param errors the number of relayed packets with a bad header
+  \param pps the measured packets per second
+  \return SWITCH_STATUS_SUCCESS or SWITCH_STATUS_FALSE if the legs could not be set up
+*/
+SWITCH_DECLARE(switch_status_t) switch_rtp_relay_bench(const char *ip, uint32_t calls, uint32_t seconds,
+													   switch_size_t *packets, switch_size_t *errors, double *pps);
 SWITCH_DECLARE(switch_byte_t) switch_rtp_check_auto_adj(switch_rtp_t *rtp_session);
 
 /*!
@@ -474,6 +474,7 @@ SWITCH_DECLARE_DATA extern switch_directories SWITCH_GLOBAL_dirs;
 #define SWITCH_MAX_SAMPLE_LEN 48
 #define SWITCH_BYTES_PER_SAMPLE 2	/* slin is 2 bytes per sample */
 #define SWITCH_RECOMMENDED_BUFFER_SIZE 4096	/* worst case of 32khz @60ms we only do 48khz @10ms which is 960 */
+#define SWITCH_DEFAULT_SILENCE_THRESHOLD 100	/* linear amplitude below which a sample counts as silence */
 #define SWITCH_MAX_CODECS 50
 #define SWITCH_MAX_STATE_HANDLERS 30
 #define SWITCH_CORE_QUEUE_LEN 100000
@@ -540,6 +541,9 @@ typedef struct {
 	switch_size_t cng_packet_count;
 	switch_size_t flush_packet_count;
 	switch_size_t largest_jb_size;
+	switch_size_t jb_plc_packet_count;
+	switch_size_t jb_late_packet_count;
+	switch_size_t jb_discard_packet_count;
 } switch_rtp_numbers_t;
 
 
@@ -548,12 +552,99 @@ typedef struct {
 	uint32_t octet_count;
 } switch_rtcp_numbers_t;
 
+/*!
+  \brief Receive quality of an RTP leg
+  The loss figures follow the RFC 3611 VoIP metrics, MOS and R factor come from a simplified ITU-T G.107 E-model.
+  The remote_* members are what the far end reported about the stream we send.
+*/
+typedef struct {
+	double mos;
+	double mos_lq;
+	double r_factor;
+	double loss_rate;
+	double discard_rate;
+	double burst_density;
+	double gap_density;
+	uint32_t burst_duration;
+	uint32_t gap_duration;
+	double burst_ratio;
+	uint32_t expected_packet_count;
+	uint32_t lost_packet_count;
+	double jitter;
+	uint32_t jitter_p50;
+	uint32_t jitter_p95;
+	uint32_t jitter_p99;
+	uint32_t round_trip_delay;
+	double remote_loss_rate;
+	double remote_jitter;
+	double remote_mos;
+	uint32_t remote_r_factor;
+} switch_rtp_quality_t;
+
+/*!
+  \enum switch_rtp_jb_mode_t
+  \brief Jitter buffer implementations
+<pre>
+	SWITCH_RTP_JB_DEFAULT - Resizing frame queues
+	SWITCH_RTP_JB_INDEXED - Timestamp indexed ring with a jitter driven adaptive delay
+</pre>
+ */
+typedef enum {
+	SWITCH_RTP_JB_DEFAULT,
+	SWITCH_RTP_JB_INDEXED
+} switch_rtp_jb_mode_t;
+
 typedef struct {
 	switch_rtp_numbers_t inbound;
 	switch_rtp_numbers_t outbound;
 	switch_rtcp_numbers_t rtcp;
+	switch_rtp_quality_t quality;
 } switch_rtp_stats_t;
 
+/*!
+  \enum switch_rtp_latency_stage_t
+  \brief Stages of the RTP read and write loops that are timed
+<pre>
+	SWITCH_RTP_LAT_SOCKET_WAIT    - Waiting on and reading from the media socket
+	SWITCH_RTP_LAT_JITTER_BUFFER  - Feeding and draining the jitter buffer
+	SWITCH_RTP_LAT_SRTP_UNPROTECT - SRTP/SRTCP decryption of received packets
+	SWITCH_RTP_LAT_DTMF           - RFC2833 receive and send processing
+	SWITCH_RTP_LAT_TIMER_SLIP     - How late the media timer woke the read loop up
+	SWITCH_RTP_LAT_SRTP_PROTECT   - SRTP encryption of sent packets
+	SWITCH_RTP_LAT_SEND           - Handing a packet to the socket
+	SWITCH_RTP_LAT_WRITE          - A whole write from frame to socket
+</pre>
+ */
+typedef enum {
+	SWITCH_RTP_LAT_SOCKET_WAIT,
+	SWITCH_RTP_LAT_JITTER_BUFFER,
+	SWITCH_RTP_LAT_SRTP_UNPROTECT,
+	SWITCH_RTP_LAT_DTMF,
+	SWITCH_RTP_LAT_TIMER_SLIP,
+	SWITCH_RTP_LAT_SRTP_PROTECT,
+	SWITCH_RTP_LAT_SEND,
+	SWITCH_RTP_LAT_WRITE,
+	SWITCH_RTP_LAT_MAX
+} switch_rtp_latency_stage_t;
+
+#define SWITCH_RTP_HISTOGRAM_BUCKETS 96
+
+/*!
+  \brief Log-linear latency histogram in microseconds
+  Every power of two is split into 4 linear sub-buckets so a percentile read back is within 25% of the measured value,
+  the last bucket collects everything from about 29 seconds up.
+*/
+typedef struct {
+	uint32_t counts[SWITCH_RTP_HISTOGRAM_BUCKETS];
+	uint64_t count;
+	uint64_t total_usec;
+	uint32_t max_usec;
+} switch_rtp_histogram_t;
+
+typedef struct {
+	switch_rtp_histogram_t stage[SWITCH_RTP_LAT_MAX];
+} switch_rtp_latency_t;
+
 typedef enum {
 	SWITCH_RTP_FLUSH_ONCE,
 	SWITCH_RTP_FLUSH_STICK,
@@ -1208,6 +1299,7 @@ typedef enum {
 	CF_VIDEO_REFRESH_REQ,
 	CF_SERVICE_AUDIO,
 	CF_SERVICE_VIDEO,
+	CF_SILENCE_AWARE,
 	/* WARNING: DO NOT ADD ANY FLAGS BELOW THIS LINE */
 	/* IF YOU ADD NEW ONES CHECK IF THEY SHOULD PERSIST OR ZERO THEM IN switch_core_session.c switch_core_session_request_xml() */
 	CF_FLAG_MAX
@@ -1234,6 +1326,7 @@ SFF_RTP_HEADER = (1 << 2)  - Get the rtp header from the frame header
 SFF_PLC        = (1 << 3)  - Frame has generated PLC data
 SFF_RFC2833    = (1 << 4)  - Frame has rfc2833 dtmf data
 SFF_DYNAMIC    = (1 << 5)  - Frame is dynamic and should be freed
+SFF_SILENCE    = (1 << 10) - Frame was classified as silence and carries no audible payload
 </pre>
  */
 typedef enum {
@@ -1247,7 +1340,8 @@ typedef enum {
 	SFF_DYNAMIC = (1 << 6),
 	SFF_ZRTP = (1 << 7),
 	SFF_UDPTL_PACKET = (1 << 8),
-	SFF_NOT_AUDIO = (1 << 9)
+	SFF_NOT_AUDIO = (1 << 9),
+	SFF_SILENCE = (1 << 10)
 } switch_frame_flag_enum_t;
 typedef uint32_t switch_frame_flag_t;
 
@@ -1750,6 +1844,28 @@ typedef enum {
 
 typedef struct apr_pool_t switch_memory_pool_t;
 typedef uint16_t switch_port_t;
+
+typedef struct {
+	switch_port_t start;
+	switch_port_t end;
+	uint32_t total;
+	uint32_t used;
+	uint32_t quarantined;
+	uint32_t available;
+	uint32_t high_water;
+	uint64_t requests;
+	uint64_t failures;
+	uint64_t reclaimed;
+} switch_port_allocator_stats_t;
+
+/*! \brief Background noise estimate of an audio stream, see switch_sln_noise_floor_update */
+typedef struct {
+	/*! current estimate as a mean absolute sample value */
+	uint32_t level;
+	/*! frames seen so far */
+	uint32_t frames;
+} switch_noise_floor_t;
+
 typedef uint8_t switch_payload_t;
 typedef struct switch_app_log switch_app_log_t;
 typedef struct switch_rtp switch_rtp_t;
@@ -1759,8 +1875,20 @@ typedef struct switch_event_header switch_event_header_t;
 typedef struct switch_event switch_event_t;
 typedef struct switch_event_subclass switch_event_subclass_t;
 typedef struct switch_event_node switch_event_node_t;
+typedef struct switch_event_export_sink switch_event_export_sink_t;
+
+/*! \brief An event serialized once by the export stage and shared by every sink */
+typedef struct {
+	/*! the type of the event */
+	switch_event_types_t event_id;
+	/*! the event in the format of switch_event_serialize_binary */
+	char *data;
+	/*! the length of data */
+	switch_size_t len;
+} switch_event_export_record_t;
 typedef struct switch_loadable_module switch_loadable_module_t;
 typedef struct switch_frame switch_frame_t;
+typedef struct switch_video_train switch_video_train_t;
 typedef struct switch_rtcp_frame switch_rtcp_frame_t;
 typedef struct switch_channel switch_channel_t;
 typedef struct switch_file_handle switch_file_handle_t;
@@ -1847,6 +1975,7 @@ typedef void (*switch_application_function_t) (switch_core_session_t *, const ch
 #define SWITCH_STANDARD_APP(name) static void name (switch_core_session_t *session, const char *data)
 
 typedef void (*switch_event_callback_t) (switch_event_t *);
+typedef switch_status_t (*switch_event_export_write_t) (switch_event_export_sink_t *, switch_event_export_record_t **, uint32_t, void *);
 typedef switch_caller_extension_t *(*switch_dialplan_hunt_function_t) (switch_core_session_t *, void *, switch_caller_profile_t *);
 #define SWITCH_STANDARD_DIALPLAN(name) static switch_caller_extension_t *name (switch_core_session_t *session, void *arg, switch_caller_profile_t *caller_profile)
 
@@ -481,6 +481,285 @@ SWITCH_STANDARD_API(time_test_function)
 	return SWITCH_STATUS_SUCCESS;
 }
 
+#define SRTP_BENCH_SYNTAX "[<packets>] [<payload_bytes>]"
+
+SWITCH_STANDARD_API(srtp_bench_function)
+{
+	const char *engines[] = { "builtin", "openssl" };
+	switch_rtp_crypto_key_type_t types[] = { AES_CM_128_HMAC_SHA1_80, AES_CM_128_HMAC_SHA1_32 };
+	const char *type_names[] = { SWITCH_RTP_CRYPTO_KEY_80, SWITCH_RTP_CRYPTO_KEY_32 };
+	uint32_t packets = 100000;
+	switch_size_t payload_len = 160;
+	char *mydata = NULL, *argv[2] = { 0 };
+	int argc = 0, x, y;
+	double pps;
+
+	if (!zstr(cmd) && (mydata = strdup(cmd))) {
+		argc = switch_separate_string(mydata, ' ', argv, (sizeof(argv) / sizeof(argv[0])));
+	}
+
+	if (argc > 0 && atoi(argv[0]) > 0) {
+		packets = atoi(argv[0]);
+		if (packets > 10000000) {
+			packets = 10000000;
+		}
+	}
+
+	if (argc > 1 && atoi(argv[1]) > 0) {
+		payload_len = atoi(argv[1]);
+		if (payload_len > 1400) {
+			payload_len = 1400;
+		}
+	}
+
+	stream->write_function(stream, "srtp_engine %s, %u packets of %d bytes per test\n", switch_rtp_get_srtp_engine(), packets, (int) payload_len);
+
+	for (x = 0; x < (int) (sizeof(engines) / sizeof(engines[0])); x++) {
+		for (y = 0; y < (int) (sizeof(types) / sizeof(types[0])); y++) {
+			if (switch_rtp_srtp_bench(engines[x], types[y], packets, payload_len, &pps) == SWITCH_STATUS_SUCCESS) {
+				stream->write_function(stream, "%-8s %s %.0f pps\n", engines[x], type_names[y], pps);
+			} else {
+				stream->write_function(stream, "%-8s %s unavailable\n", engines[x], type_names[y]);
+			}
+		}
+	}
+
+	switch_safe_free(mydata);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+#define RTP_RELAY_BENCH_SYNTAX "[<calls>] [<seconds>] [<ip>]"
+
+SWITCH_STANDARD_API(rtp_relay_bench_function)
+{
+	uint32_t calls = 100, seconds = 5, legs = 0;
+	const char *ip = "127.0.0.1";
+	char *mydata = NULL, *argv[3] = { 0 };
+	int argc = 0;
+	switch_size_t packets = 0, errors = 0, relayed = 0;
+	double pps = 0;
+
+	if (!zstr(cmd) && (mydata = strdup(cmd))) {
+		argc = switch_separate_string(mydata, ' ', argv, (sizeof(argv) / sizeof(argv[0])));
+	}
+
+	if (argc > 0 && atoi(argv[0]) > 0) {
+		calls = atoi(argv[0]);
+		if (calls > 4000) {
+			calls = 4000;
+		}
+	}
+
+	if (argc > 1 && atoi(argv[1]) > 0) {
+		seconds = atoi(argv[1]);
+		if (seconds > 60) {
+			seconds = 60;
+		}
+	}
+
+	if (argc > 2 && !zstr(argv[2])) {
+		ip = argv[2];
+	}
+
+	if (switch_rtp_relay_bench(ip, calls, seconds, &packets, &errors, &pps) == SWITCH_STATUS_SUCCESS) {
+		/* a 20ms call is relayed in both directions at 50 packets per second each */
+		stream->write_function(stream, "%u calls for %us on %s: %" SWITCH_SIZE_T_FMT " packets relayed, %" SWITCH_SIZE_T_FMT
+							   " bad, %.0f pps, %.0f calls per relay core\n", calls, seconds, ip, packets, errors, pps, pps / 100);
+	} else {
+		stream->write_function(stream, "-ERR relay bench failed on %s\n", ip);
+	}
+
+	switch_rtp_relay_get_stats(&legs, &relayed);
+	stream->write_function(stream, "relay thread: %u active legs, %" SWITCH_SIZE_T_FMT " packets relayed since start\n", legs, relayed);
+
+	switch_safe_free(mydata);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+#define RTP_STATS_SYNTAX "[<uuid>]"
+SWITCH_STANDARD_API(rtp_stats_function)
+{
+	switch_rtp_latency_t latency;
+	switch_core_session_t *rsession = NULL;
+	switch_rtp_t *rtp_session = NULL;
+	switch_status_t status;
+	int x;
+
+	if (!zstr(cmd)) {
+		if (!(rsession = switch_core_session_locate(cmd))) {
+			stream->write_function(stream, "-ERR No such channel!\n");
+			return SWITCH_STATUS_SUCCESS;
+		}
+
+		if (!(rtp_session = switch_channel_get_private(switch_core_session_get_channel(rsession), SWITCH_RTP_AUDIO_PRIVATE))) {
+			stream->write_function(stream, "-ERR Channel has no RTP session!\n");
+			switch_core_session_rwunlock(rsession);
+			return SWITCH_STATUS_SUCCESS;
+		}
+	}
+
+	status = switch_rtp_get_latency(rtp_session, &latency);
+
+	if (rsession) {
+		switch_core_session_rwunlock(rsession);
+	}
+
+	if (status != SWITCH_STATUS_SUCCESS) {
+		stream->write_function(stream, "-ERR RTP latency statistics are not compiled in\n");
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	stream->write_function(stream, "%-16s %12s %8s %8s %8s %8s %8s %9s (usec)\n", "stage", "count", "mean", "p50", "p90", "p99", "p99.9", "max");
+
+	for (x = 0; x < SWITCH_RTP_LAT_MAX; x++) {
+		switch_rtp_histogram_t *h = &latency.stage[x];
+
+		stream->write_function(stream, "%-16s %12" SWITCH_UINT64_T_FMT " %8u %8u %8u %8u %8u %9u\n",
+							   switch_rtp_latency_stage_name(x), h->count, h->count ? (uint32_t) (h->total_usec / h->count) : 0,
+							   switch_rtp_histogram_percentile(h, 50), switch_rtp_histogram_percentile(h, 90),
+							   switch_rtp_histogram_percentile(h, 99), switch_rtp_histogram_percentile(h, 99.9), h->max_usec);
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+#define SILENCE_BENCH_SYNTAX "[<seconds of audio>] [<threshold>]"
+SWITCH_STANDARD_API(silence_bench_function)
+{
+	uint32_t seconds = 600, threshold = SWITCH_DEFAULT_SILENCE_THRESHOLD, frames, x, y, silent = 0, talking = 1, seed = 0x5eed;
+	char *mydata = NULL, *argv[2] = { 0 };
+	int argc = 0;
+	switch_codec_t codec = { 0 };
+	uint8_t *encoded = NULL, silence[SWITCH_RECOMMENDED_BUFFER_SIZE];
+	int16_t pcm[SWITCH_RECOMMENDED_BUFFER_SIZE / 2];
+	uint8_t out[SWITCH_RECOMMENDED_BUFFER_SIZE];
+	uint32_t silence_len = sizeof(silence), len, rate, flag, ebytes, dbytes, samples;
+	switch_time_t start, full_usec, aware_usec;
+
+	if (!zstr(cmd) && (mydata = strdup(cmd))) {
+		argc = switch_separate_string(mydata, ' ', argv, (sizeof(argv) / sizeof(argv[0])));
+	}
+
+	if (argc > 0 && atoi(argv[0]) > 0) {
+		seconds = atoi(argv[0]);
+		if (seconds > 3600) {
+			seconds = 3600;
+		}
+	}
+
+	if (argc > 1 && atoi(argv[1]) > 0) {
+		threshold = atoi(argv[1]);
+	}
+
+	if (switch_core_codec_init(&codec, "PCMU", NULL, 8000, 20, 1, SWITCH_CODEC_FLAG_ENCODE | SWITCH_CODEC_FLAG_DECODE, NULL, NULL) != SWITCH_STATUS_SUCCESS) {
+		stream->write_function(stream, "-ERR cannot load PCMU\n");
+		goto end;
+	}
+
+	ebytes = codec.implementation->encoded_bytes_per_packet;
+	dbytes = codec.implementation->decoded_bytes_per_packet;
+	samples = codec.implementation->samples_per_packet;
+	frames = seconds * 50;
+
+	if (!(encoded = malloc(frames * ebytes))) {
+		stream->write_function(stream, "-ERR out of memory\n");
+		goto end;
+	}
+
+	/* Two state talk spurt model in the spirit of ITU-T P.59: 20ms frames, talk spurts
+	   average 1.0s and pauses 1.5s, pauses carry low level line noise. */
+	for (x = 0; x < frames; x++) {
+		seed = seed * 1103515245 + 12345;
+		if (talking && ((seed >> 16) % 50) == 0) {
+			talking = 0;
+		} else if (!talking && ((seed >> 16) % 75) == 0) {
+			talking = 1;
+		}
+
+		for (y = 0; y < samples; y++) {
+			seed = seed * 1103515245 + 12345;
+			if (talking) {
+				pcm[y] = (int16_t) (((int) ((x * samples + y) * 37 % 200) - 100) * 40 + (int) ((seed >> 16) % 2001) - 1000);
+			} else {
+				pcm[y] = (int16_t) ((int) ((seed >> 16) % 41) - 20);
+			}
+		}
+
+		len = ebytes;
+		rate = 8000;
+		flag = 0;
+		switch_core_codec_encode(&codec, NULL, pcm, dbytes, 8000, encoded + (x * ebytes), &len, &rate, &flag);
+	}
+
+	memset(pcm, 0, dbytes);
+	rate = 8000;
+	flag = 0;
+	switch_core_codec_encode(&codec, NULL, pcm, dbytes, 8000, silence, &silence_len, &rate, &flag);
+
+	/* every frame decoded and re-encoded, as a transcoding leg or conference member does today */
+	start = switch_time_now();
+	for (x = 0; x < frames; x++) {
+		len = sizeof(pcm);
+		flag = 0;
+		switch_core_codec_decode(&codec, NULL, encoded + (x * ebytes), ebytes, 8000, pcm, &len, &rate, &flag);
+		y = sizeof(out);
+		switch_core_codec_encode(&codec, NULL, pcm, len, 8000, out, &y, &rate, &flag);
+	}
+	full_usec = switch_time_now() - start;
+
+	/* silent frames are classified in the compressed domain and replaced by the cached encoded silence */
+	start = switch_time_now();
+	for (x = 0; x < frames; x++) {
+		if (switch_core_codec_frame_is_silent(codec.implementation, encoded + (x * ebytes), ebytes, threshold)) {
+			memcpy(out, silence, silence_len);
+			silent++;
+			continue;
+		}
+		len = sizeof(pcm);
+		flag = 0;
+		switch_core_codec_decode(&codec, NULL, encoded + (x * ebytes), ebytes, 8000, pcm, &len, &rate, &flag);
+		y = sizeof(out);
+		switch_core_codec_encode(&codec, NULL, pcm, len, 8000, out, &y, &rate, &flag);
+	}
+	aware_usec = switch_time_now() - start;
+
+	stream->write_function(stream, "%u frames (%us), %u silent (%.1f%%) at threshold %u\n", frames, seconds, silent, frames ? (silent * 100.0) / frames : 0.0,
+						   threshold);
+	stream->write_function(stream, "full transcode %" SWITCH_TIME_T_FMT " usec, silence-aware %" SWITCH_TIME_T_FMT " usec, %.1f%% CPU saved\n",
+						   full_usec, aware_usec, full_usec ? ((double) (full_usec - aware_usec) * 100.0) / full_usec : 0.0);
+
+  end:
+	if (switch_core_codec_ready(&codec)) {
+		switch_core_codec_destroy(&codec);
+	}
+	switch_safe_free(encoded);
+	switch_safe_free(mydata);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+static void rtp_port_stats_callback(const char *ip, switch_port_allocator_stats_t *stats, void *user_data)
+{
+	switch_stream_handle_t *stream = (switch_stream_handle_t *) user_data;
+	uint32_t pct = stats->total ? (stats->used * 100) / stats->total : 0;
+
+	stream->write_function(stream, "%s %d-%d total %u used %u (%u%%) quarantined %u available %u high-water %u requests %" SWITCH_UINT64_T_FMT
+						   " failures %" SWITCH_UINT64_T_FMT " early-reuse %" SWITCH_UINT64_T_FMT "\n",
+						   ip, stats->start, stats->end, stats->total, stats->used, pct, stats->quarantined, stats->available, stats->high_water,
+						   stats->requests, stats->failures, stats->reclaimed);
+}
+
+SWITCH_STANDARD_API(rtp_port_stats_function)
+{
+	if (!switch_rtp_port_stats(zstr(cmd) ? NULL : cmd, rtp_port_stats_callback, stream)) {
+		stream->write_function(stream, "-ERR no port allocator%s%s\n", zstr(cmd) ? "" : " for ", zstr(cmd) ? "" : cmd);
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
 SWITCH_STANDARD_API(msleep_function)
 {
 	if (cmd) {
@@ -5407,6 +5686,11 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_commands_load)
 	SWITCH_ADD_API(commands_api_interface, "system", "Execute a system command", system_function, SYSTEM_SYNTAX);
 	SWITCH_ADD_API(commands_api_interface, "time_test", "time_test", time_test_function, "<mss> [count]");
 	SWITCH_ADD_API(commands_api_interface, "timer_test", "timer_test", timer_test_function, TIMER_TEST_SYNTAX);
+	SWITCH_ADD_API(commands_api_interface, "srtp_bench", "Benchmark SRTP engines", srtp_bench_function, SRTP_BENCH_SYNTAX);
+	SWITCH_ADD_API(commands_api_interface, "rtp_port_stats", "Show RTP port allocator utilisation", rtp_port_stats_function, "[<ip>]");
+	SWITCH_ADD_API(commands_api_interface, "rtp_relay_bench", "Benchmark the RTP relay thread", rtp_relay_bench_function, RTP_RELAY_BENCH_SYNTAX);
+	SWITCH_ADD_API(commands_api_interface, "rtp_stats", "Show RTP read/write loop latency histograms", rtp_stats_function, RTP_STATS_SYNTAX);
+	SWITCH_ADD_API(commands_api_interface, "silence_bench", "Benchmark silence-aware media against full transcoding", silence_bench_function, SILENCE_BENCH_SYNTAX);
 	SWITCH_ADD_API(commands_api_interface, "tone_detect", "Start Tone Detection on a channel", tone_detect_session_function, TONE_DETECT_SYNTAX);
 	SWITCH_ADD_API(commands_api_interface, "unload", "Unload Module", unload_function, UNLOAD_SYNTAX);
 	SWITCH_ADD_API(commands_api_interface, "unsched_api", "Unschedule an api command", unsched_api_function, UNSCHED_SYNTAX);
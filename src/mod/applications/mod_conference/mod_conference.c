@@ -68,6 +68,40 @@ static int EC = 0;
 #define CONF_BUFFER_SIZE 1024 * 128
 #define CONF_EVENT_MAINT "conference::maintenance"
 #define CONF_DEFAULT_LEADIN 20
+/* at most one refresh request (FIR) to the video floor holder in this many usec */
+#define CONF_VIDEO_REFRESH_INTERVAL 1000000
+/* a cached keyframe older than this is not replayed to new members */
+#define CONF_VIDEO_KEYFRAME_MAX_AGE 10000000
+/* refresh requests from a member this soon after it got a keyframe are absorbed */
+#define CONF_VIDEO_PRIME_GRACE 1000000
+/* encoded frames a shared mix group keeps for members whose output clock lags the mixer */
+#define CONF_MIX_GROUP_DEPTH 8
+/* how long an active speaker keeps its slot after it goes quiet, in ms */
+#define CONF_ACTIVE_SPEAKER_HOLD 500
+/* how much louder in percent a member has to be than the weakest active speaker to take its slot */
+#define CONF_ACTIVE_SPEAKER_MARGIN 25
+/* below this many listeners the mixer builds their mixes itself instead of waking the worker pool */
+#define CONF_MIX_PARALLEL_MIN 32
+/* upper bound on mixer-threads */
+#define CONF_MIX_MAX_THREADS 32
+/* threads writing and encoding conference recordings unless a conference asks for more with record-encoder-threads */
+#define CONF_RECORD_ENCODERS 2
+/* upper bound on record-encoder-threads */
+#define CONF_RECORD_MAX_ENCODERS 16
+/* seconds of audio a recording may fall behind its encoder before samples are dropped */
+#define CONF_RECORD_BACKLOG 30
+/* mixer ticks captured before a recording is handed to the encoders */
+#define CONF_RECORD_BATCH 5
+/* samples an encoder writes at once */
+#define CONF_RECORD_CHUNK 4096
+/* RTP payload type and limits of the inter-node cascade link */
+#define CONF_CASCADE_PT 118
+#define CONF_CASCADE_MAX_PEERS 16
+#define CONF_CASCADE_PACKET_MAX (SWITCH_RECOMMENDED_BUFFER_SIZE + 512)
+/* frames of a peer's audio buffered before further packets from it are dropped */
+#define CONF_CASCADE_MAX_DELAY 5
+/* seconds between warnings about a member whose input the conference thread is not keeping up with */
+#define CONF_INPUT_DROP_LOG_INTERVAL 10
 
 #define CONF_DBLOCK_SIZE CONF_BUFFER_SIZE
 #define CONF_DBUFFER_SIZE CONF_BUFFER_SIZE
@@ -80,6 +114,8 @@ static int EC = 0;
 
 /* the rate at which the infinite impulse response filter on speaker score will decay. */
 #define SCORE_DECAY 0.8
+/* talk detection requires this percentage of a member's background noise, off unless a profile sets noise-floor-ratio */
+#define CONF_DEFAULT_NOISE_FLOOR_RATIO 0
 /* the maximum value for the IIR score [keeps loud & longwinded people from getting overweighted] */
 #define SCORE_MAX_IIR 25000
 /* the minimum score for which you can be considered to be loud enough to now have the floor */
@@ -108,6 +144,16 @@ static struct {
 	int32_t running;
 	uint32_t threads;
 	switch_event_node_t *node;
+	switch_queue_t *record_queue;
+	/* the encoder pool is shared by every conference, it grows to the largest record-encoder-threads asked for */
+	switch_thread_t *record_encoders[CONF_RECORD_MAX_ENCODERS];
+	uint32_t record_encoder_count;
+	switch_mutex_t *record_mutex;
+	/* cascade links by local ip:port, shared by every conference bound to the same address */
+	switch_hash_t *cascade_links;
+	switch_mutex_t *cascade_mutex;
+	/* ssrc of this node on cascade links */
+	uint32_t cascade_node_id;
 } globals;
 
 /* forward declaration for conference_obj and caller_control */
@@ -156,7 +202,11 @@ typedef enum {
 	MFLAG_INDICATE_UNMUTE = (1 << 18),
 	MFLAG_NOMOH = (1 << 19),
 	MFLAG_VIDEO_BRIDGE = (1 << 20),
-	MFLAG_INDICATE_MUTE_DETECT = (1 << 21)
+	MFLAG_INDICATE_MUTE_DETECT = (1 << 21),
+	/* set by the mixer while the member is fed from its group instead of its own mix */
+	MFLAG_SHARED_MIX = (1 << 22),
+	/* set by the output thread while nothing member specific has to be done to its audio */
+	MFLAG_SHARED_OK = (1 << 23)
 } member_flag_t;
 
 typedef enum {
@@ -174,7 +224,8 @@ typedef enum {
 	CFLAG_INHASH = (1 << 11),
 	CFLAG_EXIT_SOUND = (1 << 12),
 	CFLAG_ENTER_SOUND = (1 << 13),
-	CFLAG_VIDEO_BRIDGE = (1 << 14)
+	CFLAG_VIDEO_BRIDGE = (1 << 14),
+	CFLAG_SHARED_MIX = (1 << 15)
 } conf_flag_t;
 
 typedef enum {
@@ -216,7 +267,8 @@ typedef enum {
 	EFLAG_FLOOR_CHANGE = (1 << 25),
 	EFLAG_MUTE_DETECT = (1 << 26),
 	EFLAG_RECORD = (1 << 27),
-	EFLAG_HUP_MEMBER = (1 << 28)
+	EFLAG_HUP_MEMBER = (1 << 28),
+	EFLAG_ACTIVE_SPEAKERS = (1 << 29)
 } event_type_t;
 
 typedef struct conference_file_node {
@@ -243,6 +295,91 @@ struct vid_helper {
 	int up;
 };
 
+/* Members that are only listening and share a codec, rate and ptime get one mix encoded once for all of them */
+typedef struct conference_mix_group {
+	switch_codec_t codec;
+	/* the fmtp every member of the group negotiated */
+	char *fmtp;
+	switch_audio_resampler_t *resampler;
+	switch_mutex_t *mutex;
+	/* members attached to the group */
+	uint32_t refs;
+	/* members fed from the group on the current tick */
+	uint32_t active;
+	/* frames published so far, frame n lives in slot n % CONF_MIX_GROUP_DEPTH */
+	uint32_t tick;
+	uint32_t samples;
+	uint32_t lens[CONF_MIX_GROUP_DEPTH];
+	uint8_t frames[CONF_MIX_GROUP_DEPTH][SWITCH_RECOMMENDED_BUFFER_SIZE];
+	struct conference_mix_group *next;
+} conference_mix_group_t;
+
+/* Immutable copy of the member list with an id index, rebuilt on every join and leave.
+   Readers take a reference with conference_member_snapshot_get() and walk it without member_mutex,
+   conference_del_member() does not return before every snapshot still listing the member is released.
+ */
+typedef struct conference_member_snapshot {
+	uint32_t refs;
+	/* publish order, conference_member_snapshot_sync() only waits for lower ones */
+	uint32_t gen;
+	/* next replaced snapshot still held by a reader */
+	struct conference_member_snapshot *next_retired;
+	uint32_t count;
+	uint32_t hash_mask;
+	struct conference_member **members;
+	/* open addressing on the member id, hash_mask + 1 slots */
+	struct conference_member **hash;
+} conference_member_snapshot_t;
+
+/* UDP endpoint of the cascade, one receive thread demultiplexes packets to conferences by name */
+typedef struct conference_cascade_link {
+	char *key;
+	switch_memory_pool_t *pool;
+	switch_sockaddr_t *local_addr;
+	switch_socket_t *sock;
+	switch_thread_t *thread;
+	uint32_t refs;
+	int running;
+} conference_cascade_link_t;
+
+/* Another node mixing the same conference, its audio enters the local mix through a member without a channel */
+typedef struct conference_cascade_peer {
+	char *name;
+	switch_sockaddr_t *addr;
+	struct conference_member *member;
+	uint16_t last_seq;
+	int have_seq;
+	uint8_t talkers;
+	uint32_t rx_packets;
+	uint32_t rx_lost;
+	uint32_t rx_dropped;
+	switch_time_t last_rx;
+} conference_cascade_peer_t;
+
+/* Workers building the per listener mixes of one conference, the sum stage stays on the conference thread.
+   Member n of the snapshot always goes to slice n * (thread_count + 1) / count so the output does not depend on scheduling.
+ */
+typedef struct conference_mix_pool {
+	switch_thread_t **threads;
+	uint32_t thread_count;
+	switch_mutex_t *mutex;
+	switch_thread_cond_t *start_cond;
+	switch_thread_cond_t *done_cond;
+	/* bumped by the conference thread to hand out a tick */
+	uint32_t gen;
+	uint32_t pending;
+	int running;
+	conference_member_snapshot_t *snapshot;
+	const int32_t *main_frame;
+	int16_t *shared_pcm;
+	uint32_t bytes;
+} conference_mix_pool_t;
+
+typedef struct conference_mix_worker {
+	conference_mix_pool_t *pool;
+	uint32_t slice;
+} conference_mix_worker_t;
+
 /* Conference Object */
 typedef struct conference_obj {
 	char *name;
@@ -269,6 +406,8 @@ typedef struct conference_obj {
 	char *special_announce;
 	char *auto_record;
 	char *record_filename;
+	/* split recordings into files of this many seconds */
+	uint32_t record_segment_time;
 	uint32_t terminate_on_silence;
 	uint32_t max_members;
 	char *maxmember_sound;
@@ -291,12 +430,19 @@ typedef struct conference_obj {
 	conference_member_t *members;
 	conference_member_t *floor_holder;
 	switch_mutex_t *member_mutex;
+	conference_member_snapshot_t *member_snapshot;
+	/* guards member_snapshot and the reference counts, never held for more than a pointer swap */
+	switch_mutex_t *snapshot_mutex;
+	/* replaced snapshots some reader still holds */
+	conference_member_snapshot_t *member_snapshots_retired;
+	uint32_t member_snapshot_gen;
 	conference_file_node_t *fnode;
 	conference_file_node_t *async_fnode;
 	switch_memory_pool_t *pool;
 	switch_thread_rwlock_t *rwlock;
 	uint32_t count;
 	int32_t energy_level;
+	uint32_t noise_floor_ratio;
 	uint8_t min;
 	switch_speech_handle_t lsh;
 	switch_speech_handle_t *sh;
@@ -317,6 +463,9 @@ typedef struct conference_obj {
 	int endconf_grace_time;
 
 	uint32_t relationship_total;
+	/* bumped whenever membership or relationships change, the mixer rebuilds the exclusion lists when it moves */
+	uint32_t relationship_gen;
+	uint32_t relationship_built;
 	uint32_t score;
 	int mux_loop_count;
 	int member_loop_count;
@@ -334,6 +483,40 @@ typedef struct conference_obj {
 	switch_time_t end_time;
 	char *log_dir;
 	struct vid_helper vh[2];
+	switch_video_train_t *video_train;
+	switch_video_train_t *video_keyframe;
+	uint32_t video_keyframe_member_id;
+	switch_time_t video_keyframe_time;
+	switch_bool_t video_keyframe_fresh;
+	switch_time_t video_refresh_next;
+	int video_refresh_pending;
+	conference_mix_group_t *mix_groups;
+	/* 0 mixes everybody with audio, otherwise only this many members make it into the mix */
+	uint32_t max_active_speakers;
+	/* mixer ticks an active speaker is held after it goes quiet */
+	uint32_t active_speaker_hold;
+	uint32_t active_speaker_count;
+	int active_speakers_changed;
+	/* mixer-threads, 0 or 1 keeps all mixing on the conference thread */
+	uint32_t mix_threads;
+	conference_mix_pool_t *mix_pool;
+	/* usec the mixer spent on the last tick, a smoothed average, the worst tick and the ticks that overran the interval */
+	uint32_t mix_time_last;
+	uint32_t mix_time_avg;
+	uint32_t mix_time_max;
+	uint32_t mix_deadline_misses;
+	/* cascade-local and cascade-peers, see conference_cascade_start */
+	char *cascade_local;
+	char *cascade_peer_list;
+	conference_cascade_link_t *cascade_link;
+	conference_cascade_peer_t *cascade_peers;
+	uint32_t cascade_peer_count;
+	/* guards cascade_running and the peer counters against the link thread */
+	switch_mutex_t *cascade_mutex;
+	int cascade_running;
+	uint16_t cascade_seq;
+	uint32_t cascade_ts;
+	uint32_t cascade_tx_packets;
 } conference_obj_t;
 
 /* Relationship with another member */
@@ -356,6 +539,7 @@ struct conference_member {
 	uint32_t score;
 	uint32_t last_score;
 	uint32_t score_iir;
+	switch_noise_floor_t noise_floor;
 	switch_mutex_t *flag_mutex;
 	switch_mutex_t *write_mutex;
 	switch_mutex_t *audio_in_mutex;
@@ -399,6 +583,24 @@ struct conference_member {
 	switch_ivr_dmachine_t *dmachine;
 	conference_cdr_node_t *cdr_node;
 	char *kicked_sound;
+	switch_time_t video_primed;
+	conference_mix_group_t *mix_group;
+	/* members this member must not hear, derived from the relationships of both sides */
+	struct conference_member **mix_exclude;
+	uint32_t mix_exclude_count;
+	uint32_t mix_exclude_size;
+	/* the next group frame this member plays */
+	uint32_t shared_next;
+	/* set by the mixer while the member holds one of the max-active-speakers slots */
+	uint8_t active_speaker;
+	uint32_t active_hold;
+	/* the recording a NOCHANNEL member feeds */
+	struct conference_record *rec;
+	/* the node a NOCHANNEL member plays the audio of */
+	conference_cascade_peer_t *cascade_peer;
+	/* input frames that pushed older audio out of audio_buffer, and when that was last logged */
+	uint32_t input_dropped;
+	time_t input_dropped_logged;
 };
 
 /* Record Node */
@@ -406,6 +608,24 @@ typedef struct conference_record {
 	conference_obj_t *conference;
 	char *path;
 	switch_memory_pool_t *pool;
+	switch_file_handle_t fh;
+	/* held by an encoder while it replaces fh with the next segment */
+	switch_mutex_t *fh_mutex;
+	/* backlog from the record thread to the encoders, one writer and one reader */
+	switch_buffer_t *ring;
+	switch_mutex_t *mutex;
+	/* set while the recording waits in globals.record_queue or an encoder works on it */
+	int queued;
+	int failed;
+	/* seconds per file, 0 records everything into path */
+	uint32_t segment_time;
+	uint32_t segment;
+	char *segment_path;
+	switch_size_t segment_samples;
+	switch_size_t samples_written;
+	/* added to by the record thread and the encoders, under mutex */
+	switch_size_t samples_dropped;
+	switch_size_t backlog_max;
 } conference_record_t;
 
 typedef enum {
@@ -753,25 +973,146 @@ static conference_relationship_t *member_get_relationship(conference_member_t *m
 }
 
 /* traverse the conference member list for the specified member id and return it's pointer */
+#define conference_member_hash_slot(_snap, _id) (((_id) * 2654435761U) & (_snap)->hash_mask)
+
+/* Replace the member snapshot with one built from the current list, caller holds member_mutex.
+   Returns the generation of the new snapshot for conference_member_snapshot_sync().
+ */
+static uint32_t conference_member_snapshot_publish(conference_obj_t *conference)
+{
+	conference_member_snapshot_t *snap, *old;
+	conference_member_t *member;
+	uint32_t count = 0, size = 16, i = 0, slot, gen;
+
+	for (member = conference->members; member; member = member->next) {
+		count++;
+	}
+
+	while (size < count * 2) {
+		size <<= 1;
+	}
+
+	switch_zmalloc(snap, sizeof(*snap) + sizeof(conference_member_t *) * (count + size));
+	snap->members = (conference_member_t **) (snap + 1);
+	snap->hash = snap->members + count;
+	snap->hash_mask = size - 1;
+	snap->count = count;
+	snap->refs = 1;
+
+	for (member = conference->members; member; member = member->next) {
+		snap->members[i++] = member;
+
+		for (slot = conference_member_hash_slot(snap, member->id); snap->hash[slot]; slot = (slot + 1) & snap->hash_mask);
+		snap->hash[slot] = member;
+	}
+
+	switch_mutex_lock(conference->snapshot_mutex);
+	gen = snap->gen = ++conference->member_snapshot_gen;
+	old = conference->member_snapshot;
+	conference->member_snapshot = snap;
+	if (old) {
+		if (--old->refs) {
+			old->next_retired = conference->member_snapshots_retired;
+			conference->member_snapshots_retired = old;
+		} else {
+			free(old);
+		}
+	}
+	switch_mutex_unlock(conference->snapshot_mutex);
+
+	return gen;
+}
+
+static conference_member_snapshot_t *conference_member_snapshot_get(conference_obj_t *conference)
+{
+	conference_member_snapshot_t *snap;
+
+	switch_mutex_lock(conference->snapshot_mutex);
+	if ((snap = conference->member_snapshot)) {
+		snap->refs++;
+	}
+	switch_mutex_unlock(conference->snapshot_mutex);
+
+	return snap;
+}
+
+static void conference_member_snapshot_release(conference_obj_t *conference, conference_member_snapshot_t *snap)
+{
+	if (!snap) {
+		return;
+	}
+
+	switch_mutex_lock(conference->snapshot_mutex);
+	/* the current snapshot keeps the reference taken when it was published, only a replaced one can drop to 0 */
+	if (!--snap->refs) {
+		conference_member_snapshot_t **ptr;
+
+		for (ptr = &conference->member_snapshots_retired; *ptr; ptr = &(*ptr)->next_retired) {
+			if (*ptr == snap) {
+				*ptr = snap->next_retired;
+				break;
+			}
+		}
+		free(snap);
+	}
+	switch_mutex_unlock(conference->snapshot_mutex);
+}
+
+/* Wait until no reader holds a snapshot published before generation gen, newer ones never list what it dropped */
+static void conference_member_snapshot_sync(conference_obj_t *conference, uint32_t gen)
+{
+	for (;;) {
+		conference_member_snapshot_t *snap;
+		int older = 0;
+
+		switch_mutex_lock(conference->snapshot_mutex);
+		for (snap = conference->member_snapshots_retired; snap; snap = snap->next_retired) {
+			if ((int32_t) (snap->gen - gen) < 0) {
+				older++;
+				break;
+			}
+		}
+		switch_mutex_unlock(conference->snapshot_mutex);
+
+		if (!older) {
+			break;
+		}
+
+		switch_yield(1000);
+	}
+}
+
+static void conference_member_snapshot_destroy(conference_obj_t *conference)
+{
+	switch_mutex_lock(conference->snapshot_mutex);
+	if (conference->member_snapshot && !--conference->member_snapshot->refs) {
+		free(conference->member_snapshot);
+	}
+	conference->member_snapshot = NULL;
+	switch_mutex_unlock(conference->snapshot_mutex);
+}
+
 static conference_member_t *conference_member_get(conference_obj_t *conference, uint32_t id)
 {
 	conference_member_t *member = NULL;
+	conference_member_snapshot_t *snap;
+	uint32_t slot;
 
 	switch_assert(conference != NULL);
 	if (!id) {
 		return NULL;
 	}
 
-	switch_mutex_lock(conference->member_mutex);
-	for (member = conference->members; member; member = member->next) {
-
-		if (switch_test_flag(member, MFLAG_NOCHANNEL)) {
-			continue;
+	if ((snap = conference_member_snapshot_get(conference))) {
+		for (slot = conference_member_hash_slot(snap, id); (member = snap->hash[slot]); slot = (slot + 1) & snap->hash_mask) {
+			if (member->id == id) {
+				break;
+			}
 		}
+	}
 
-		if (member->id == id) {
-			break;
-		}
+	if (member && switch_test_flag(member, MFLAG_NOCHANNEL)) {
+		member = NULL;
 	}
 
 	if (member) {
@@ -791,7 +1132,7 @@ static conference_member_t *conference_member_get(conference_obj_t *conference,
 		}
 	}
 
-	switch_mutex_unlock(conference->member_mutex);
+	conference_member_snapshot_release(conference, snap);
 
 	return member;
 }
@@ -800,17 +1141,22 @@ static conference_member_t *conference_member_get(conference_obj_t *conference,
 static switch_status_t conference_record_stop(conference_obj_t *conference, char *path)
 {
 	conference_member_t *member = NULL;
+	conference_member_snapshot_t *snap;
+	uint32_t i;
 	int count = 0;
 
 	switch_assert(conference != NULL);
-	switch_mutex_lock(conference->member_mutex);
-	for (member = conference->members; member; member = member->next) {
-		if (switch_test_flag(member, MFLAG_NOCHANNEL) && (!path || !strcmp(path, member->rec_path))) {
+	if (!(snap = conference_member_snapshot_get(conference))) {
+		return 0;
+	}
+	for (i = 0; i < snap->count; i++) {
+		member = snap->members[i];
+		if (switch_test_flag(member, MFLAG_NOCHANNEL) && member->rec_path && (!path || !strcmp(path, member->rec_path))) {
 			switch_clear_flag_locked(member, MFLAG_RUNNING);
 			count++;
 		}
 	}
-	switch_mutex_unlock(conference->member_mutex);
+	conference_member_snapshot_release(conference, snap);
 	return count;
 }
 
@@ -829,6 +1175,7 @@ static conference_relationship_t *member_add_relationship(conference_member_t *m
 	lock_member(member);
 	switch_mutex_lock(member->conference->member_mutex);
 	member->conference->relationship_total++;
+	member->conference->relationship_gen++;
 	switch_mutex_unlock(member->conference->member_mutex);
 	rel->next = member->relationships;
 	member->relationships = rel;
@@ -860,6 +1207,7 @@ static switch_status_t member_del_relationship(conference_member_t *member, uint
 
 			switch_mutex_lock(member->conference->member_mutex);
 			member->conference->relationship_total--;
+			member->conference->relationship_gen++;
 			switch_mutex_unlock(member->conference->member_mutex);
 
 		}
@@ -897,7 +1245,9 @@ static switch_status_t conference_add_member(conference_obj_t *conference, confe
 	member->score_iir = 0;
 	member->verbose_events = conference->verbose_events;
 	conference->members = member;
+	conference->relationship_gen++;
 	switch_set_flag_locked(member, MFLAG_INTREE);
+	conference_member_snapshot_publish(conference);
 	switch_mutex_unlock(conference->member_mutex);
 	conference_cdr_add(member);
 
@@ -1028,6 +1378,7 @@ static switch_status_t conference_del_member(conference_obj_t *conference, confe
 	conference_file_node_t *member_fnode;
 	switch_speech_handle_t *member_sh;
 	const char *exit_sound = NULL;
+	uint32_t snapshot_gen;
 
 	switch_assert(conference != NULL);
 	switch_assert(member != NULL);
@@ -1073,6 +1424,25 @@ static switch_status_t conference_del_member(conference_obj_t *conference, confe
 		last = imember;
 	}
 
+	snapshot_gen = conference_member_snapshot_publish(conference);
+
+	if (member->active_speaker) {
+		conference->active_speakers_changed = 1;
+	}
+
+	/* the relationships leave with the member, other members may hold pointers to it in their exclusion lists */
+	{
+		conference_relationship_t *rel;
+
+		for (rel = member->relationships; rel; rel = rel->next) {
+			conference->relationship_total--;
+		}
+		member->relationships = NULL;
+	}
+	conference->relationship_gen++;
+	switch_safe_free(member->mix_exclude);
+	member->mix_exclude_count = member->mix_exclude_size = 0;
+
 	switch_thread_rwlock_unlock(member->rwlock);
 	
 	/* Close Unused Handles */
@@ -1112,8 +1482,6 @@ static switch_status_t conference_del_member(conference_obj_t *conference, confe
 		}
 	}
 
-	member->conference = NULL;
-
 	if (!switch_test_flag(member, MFLAG_NOCHANNEL)) {
 		conference->count--;
 
@@ -1143,7 +1511,6 @@ static switch_status_t conference_del_member(conference_obj_t *conference, confe
 		if (test_eflag(conference, EFLAG_DEL_MEMBER) &&
 			switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CONF_EVENT_MAINT) == SWITCH_STATUS_SUCCESS) {
 			conference_add_event_member_data(member, event);
-			conference_add_event_data(conference, event);
 			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Action", "del-member");
 			switch_event_fire(&event);
 		}
@@ -1153,6 +1520,11 @@ static switch_status_t conference_del_member(conference_obj_t *conference, confe
 	switch_mutex_unlock(member->audio_out_mutex);
 	switch_mutex_unlock(member->audio_in_mutex);
 	switch_mutex_unlock(conference->mutex);
+
+	/* API readers may still be walking a snapshot that lists the member, they read member->conference without member_mutex */
+	conference_member_snapshot_sync(conference, snapshot_gen);
+	member->conference = NULL;
+
 	status = SWITCH_STATUS_SUCCESS;
 
 	return status;
@@ -1170,6 +1542,7 @@ static void *SWITCH_THREAD_FUNC conference_video_bridge_thread_run(switch_thread
 	switch_frame_t *read_frame;
 	conference_obj_t *conference = vh->member_a->conference;
 	switch_core_session_message_t msg = { 0 };
+	switch_video_train_t *train = NULL;
 	
 	switch_thread_rwlock_rdlock(conference->rwlock);
 	switch_thread_rwlock_rdlock(vh->member_a->rwlock);
@@ -1184,6 +1557,8 @@ static void *SWITCH_THREAD_FUNC conference_video_bridge_thread_run(switch_thread
 	msg.from = __FILE__;
 	msg.message_id = SWITCH_MESSAGE_INDICATE_VIDEO_REFRESH_REQ;
 
+	switch_core_video_train_create(&train, switch_core_session_get_pool(session_a));
+
 	vh->up = 1;
 	while (vh->up == 1 && switch_test_flag(vh->member_a, MFLAG_RUNNING) && switch_test_flag(vh->member_b, MFLAG_RUNNING) &&
 		   switch_channel_ready(channel_a) && switch_channel_ready(channel_b))  {
@@ -1198,10 +1573,40 @@ static void *SWITCH_THREAD_FUNC conference_video_bridge_thread_run(switch_thread
 			break;
 		}
 
-		if (!switch_test_flag(read_frame, SFF_CNG)) {
+		/* a picture whose marker was lost goes out once the next one starts or it has waited too long */
+		if (train && switch_core_video_train_stale(train, switch_test_flag(read_frame, SFF_CNG) ? NULL : read_frame)) {
+			status = switch_core_session_write_video_train(session_b, train, SWITCH_IO_FLAG_NONE, 0);
+			switch_core_video_train_reset(train);
+			if (status != SWITCH_STATUS_SUCCESS) {
+				break;
+			}
+		}
+
+		if (switch_test_flag(read_frame, SFF_CNG)) {
+			continue;
+		}
+
+		if (!train) {
 			if (switch_core_session_write_video_frame(session_b, read_frame, SWITCH_IO_FLAG_NONE, 0) != SWITCH_STATUS_SUCCESS) {
 				break;
 			}
+			continue;
+		}
+
+		if (switch_core_video_train_push(train, read_frame) == SWITCH_STATUS_MEMERR) {
+			status = switch_core_session_write_video_train(session_b, train, SWITCH_IO_FLAG_NONE, 0);
+			switch_core_video_train_reset(train);
+			if (status != SWITCH_STATUS_SUCCESS) {
+				break;
+			}
+			switch_core_video_train_push(train, read_frame);
+		}
+
+		if (train->complete) {
+			if (switch_core_session_write_video_train(session_b, train, SWITCH_IO_FLAG_NONE, 0) != SWITCH_STATUS_SUCCESS) {
+				break;
+			}
+			switch_core_video_train_reset(train);
 		}
 	}
 
@@ -1220,25 +1625,130 @@ static void *SWITCH_THREAD_FUNC conference_video_bridge_thread_run(switch_thread
 }
 
 
+/* Stamp the cached keyframe so it reads as the picture right before next: contiguous sequence numbers and an earlier timestamp */
+static void conference_video_restamp(switch_video_train_t *keyframe, switch_video_train_t *next)
+{
+	uint16_t seq = (uint16_t) (next->frames[0].seq - keyframe->count);
+	uint32_t next_ts = (uint32_t) next->frames[0].timestamp;
+	uint32_t delta = next_ts - (uint32_t) keyframe->frames[0].timestamp;
+	uint32_t ts, i;
+
+	/* keep the real spacing unless the cached picture does not come before the next one (e.g. the floor changed) */
+	if (!delta || delta > 90000) {
+		delta = 3000;
+	}
+	ts = next_ts - delta;
+
+	for (i = 0; i < keyframe->count; i++) {
+		switch_frame_t *frame = &keyframe->frames[i];
+		uint8_t *packet = frame->packet;
+
+		frame->seq = seq++;
+		frame->timestamp = ts;
+
+		if (packet && frame->packetlen >= 12) {
+			packet[2] = (uint8_t) (frame->seq >> 8);
+			packet[3] = (uint8_t) frame->seq;
+			packet[4] = (uint8_t) (ts >> 24);
+			packet[5] = (uint8_t) (ts >> 16);
+			packet[6] = (uint8_t) (ts >> 8);
+			packet[7] = (uint8_t) ts;
+		}
+	}
+}
+
+/* Hand a finished access unit from the floor holder to every video member */
+static void conference_video_send_train(conference_obj_t *conference, switch_core_session_t *session, switch_video_train_t *train, uint32_t floor_id, int *has_vid)
+{
+	conference_member_t *imember;
+	switch_time_t now = switch_micro_time_now();
+	int want_refresh = 0;
+	switch_bool_t cached = SWITCH_FALSE, restamped = SWITCH_FALSE;
+
+	if (train->complete && train->keyframe && conference->video_keyframe) {
+		switch_core_video_train_copy(conference->video_keyframe, train);
+		conference->video_keyframe_member_id = floor_id;
+		conference->video_keyframe_time = now;
+		conference->video_keyframe_fresh = SWITCH_TRUE;
+	}
+
+	/* the cache only decodes on its own while nothing but the keyframe has been sent since, later pictures refer to the ones in between */
+	if (conference->video_keyframe && conference->video_keyframe_fresh && conference->video_keyframe_member_id == floor_id &&
+		now - conference->video_keyframe_time < CONF_VIDEO_KEYFRAME_MAX_AGE) {
+		cached = SWITCH_TRUE;
+	}
+
+	for (imember = conference->members; imember; imember = imember->next) {
+		switch_channel_t *ichannel = switch_core_session_get_channel(imember->session);
+
+		if (imember->session && switch_channel_test_flag(ichannel, CF_VIDEO)) {
+			(*has_vid)++;
+
+			/* a member new to the video gets the last keyframe straight from the cache instead of waiting for the speaker */
+			if (!imember->video_primed && imember->session != session) {
+				if (train->keyframe) {
+					imember->video_primed = now;
+				} else if (cached) {
+					if (!restamped) {
+						conference_video_restamp(conference->video_keyframe, train);
+						restamped = SWITCH_TRUE;
+					}
+					if (switch_core_session_write_video_train(imember->session, conference->video_keyframe, SWITCH_IO_FLAG_NONE, 0) == SWITCH_STATUS_SUCCESS) {
+						imember->video_primed = now;
+					}
+				} else {
+					/* nothing to replay, only a fresh keyframe from the speaker helps */
+					want_refresh++;
+				}
+			}
+
+			switch_core_session_write_video_train(imember->session, train, SWITCH_IO_FLAG_NONE, 0);
+		}
+
+		if (switch_channel_test_flag(ichannel, CF_VIDEO_REFRESH_REQ)) {
+			switch_channel_clear_flag(ichannel, CF_VIDEO_REFRESH_REQ);
+			if (!imember->video_primed || now - imember->video_primed > CONF_VIDEO_PRIME_GRACE) {
+				want_refresh++;
+			}
+		}
+	}
+
+	if (!train->keyframe) {
+		conference->video_keyframe_fresh = SWITCH_FALSE;
+	}
+
+	if (want_refresh) {
+		conference->video_refresh_pending = 1;
+	}
+
+	/* coalesce the members' requests so the speaker sees at most one per interval */
+	if (conference->video_refresh_pending && now >= conference->video_refresh_next) {
+		switch_core_session_message_t msg = { 0 };
+
+		msg.from = __FILE__;
+		msg.message_id = SWITCH_MESSAGE_INDICATE_VIDEO_REFRESH_REQ;
+		switch_core_session_receive_message(session, &msg);
+
+		conference->video_refresh_pending = 0;
+		conference->video_refresh_next = now + CONF_VIDEO_REFRESH_INTERVAL;
+	}
+}
+
 /* Main video monitor thread (1 per distinct conference room) */
 static void *SWITCH_THREAD_FUNC conference_video_thread_run(switch_thread_t *thread, void *obj)
 {
 	conference_obj_t *conference = (conference_obj_t *) obj;
-	conference_member_t *imember;
 	switch_frame_t *vid_frame;
 	switch_status_t status;
-	int has_vid = 1, want_refresh = 0;
+	int has_vid = 1;
 	int yield = 0;
+	uint32_t floor_id, train_id = 0;
 	switch_core_session_t *session;
-	switch_core_session_message_t msg = { 0 };
+	switch_video_train_t *train = conference->video_train;
 
 	conference->video_running = 1;
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Video thread started for conference %s\n", conference->name);
 
-	/* Tell the channel to request a fresh vid frame */
-	msg.from = __FILE__;
-	msg.message_id = SWITCH_MESSAGE_INDICATE_VIDEO_REFRESH_REQ;
-
 	while (has_vid && conference->video_running == 1 && globals.running && !switch_test_flag(conference, CFLAG_DESTRUCT)) {
 		if (yield) {
 			switch_yield(yield);
@@ -1258,6 +1768,7 @@ static void *SWITCH_THREAD_FUNC conference_video_thread_run(switch_thread_t *thr
 		}
 
 		session = conference->floor_holder->session;
+		floor_id = conference->floor_holder->id;
 
 		if ((status = switch_core_session_read_lock(session)) == SWITCH_STATUS_SUCCESS) {
 			switch_mutex_unlock(conference->mutex);
@@ -1270,45 +1781,1013 @@ static void *SWITCH_THREAD_FUNC conference_video_thread_run(switch_thread_t *thr
 			switch_core_session_rwunlock(session);
 		}
 
-		if (!SWITCH_READ_ACCEPTABLE(status)) {
-			yield = 100000;
-			goto do_continue;
+		if (!SWITCH_READ_ACCEPTABLE(status)) {
+			yield = 100000;
+			goto do_continue;
+		}
+
+		/* never splice packets of two speakers into one access unit */
+		if (floor_id != train_id) {
+			switch_core_video_train_reset(train);
+			train_id = floor_id;
+		}
+
+		/* a picture whose marker was lost goes out once the next one starts or it has waited too long */
+		if (switch_core_video_train_stale(train, switch_test_flag(vid_frame, SFF_CNG) ? NULL : vid_frame)) {
+			has_vid = 0;
+			conference_video_send_train(conference, session, train, floor_id, &has_vid);
+			switch_core_video_train_reset(train);
+		}
+
+		if (switch_test_flag(vid_frame, SFF_CNG)) {
+			goto do_continue;
+		}
+
+		if (switch_core_video_train_push(train, vid_frame) == SWITCH_STATUS_MEMERR) {
+			has_vid = 0;
+			conference_video_send_train(conference, session, train, floor_id, &has_vid);
+			switch_core_video_train_reset(train);
+			switch_core_video_train_push(train, vid_frame);
+		}
+
+		if (train->complete) {
+			has_vid = 0;
+			conference_video_send_train(conference, session, train, floor_id, &has_vid);
+			switch_core_video_train_reset(train);
+		}
+
+	do_continue:
+		
+		switch_mutex_unlock(conference->mutex);
+	}
+
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Video thread ending for conference %s\n", conference->name);
+	conference->video_running = 0;
+
+	return NULL;
+}
+
+/* true when listener must not hear speaker because of a relationship on either side */
+static int conference_member_excludes(conference_member_t *listener, conference_member_t *speaker)
+{
+	conference_relationship_t *rel;
+
+	for (rel = speaker->relationships; rel; rel = rel->next) {
+		if ((rel->id == listener->id || rel->id == 0) && !switch_test_flag(rel, RFLAG_CAN_SPEAK)) {
+			return 1;
+		}
+	}
+
+	for (rel = listener->relationships; rel; rel = rel->next) {
+		if ((rel->id == speaker->id || rel->id == 0) && !switch_test_flag(rel, RFLAG_CAN_HEAR)) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/* Turn the relationships into one exclusion list per listener, run by the mixer with conference->mutex held */
+static void conference_rebuild_mix_exclusions(conference_obj_t *conference)
+{
+	conference_member_t *omember, *imember;
+
+	conference->relationship_built = conference->relationship_gen;
+
+	for (omember = conference->members; omember; omember = omember->next) {
+		omember->mix_exclude_count = 0;
+
+		if (!conference->relationship_total) {
+			continue;
+		}
+
+		for (imember = conference->members; imember; imember = imember->next) {
+			if (imember == omember || !conference_member_excludes(omember, imember)) {
+				continue;
+			}
+
+			if (omember->mix_exclude_count == omember->mix_exclude_size) {
+				uint32_t size = omember->mix_exclude_size ? omember->mix_exclude_size * 2 : 8;
+				conference_member_t **tmp;
+
+				if (!(tmp = realloc(omember->mix_exclude, size * sizeof(*tmp)))) {
+					break;
+				}
+				omember->mix_exclude = tmp;
+				omember->mix_exclude_size = size;
+			}
+
+			omember->mix_exclude[omember->mix_exclude_count++] = imember;
+		}
+	}
+}
+
+/* Mixing kernels, plain loops over contiguous samples so the compiler can vectorize them */
+static void conference_mix_sub(int32_t *dst, const int16_t *src, uint32_t samples)
+{
+	uint32_t x;
+
+	for (x = 0; x < samples; x++) {
+		dst[x] -= src[x];
+	}
+}
+
+static void conference_mix_clamp(int16_t *dst, const int32_t *src, uint32_t samples)
+{
+	uint32_t x;
+
+	for (x = 0; x < samples; x++) {
+		int32_t z = src[x];
+		dst[x] = (int16_t) (z > SWITCH_SMAX ? SWITCH_SMAX : (z < SWITCH_SMIN ? SWITCH_SMIN : z));
+	}
+}
+
+/* Whether any member this listener must not hear put audio in the mix this tick */
+static int conference_member_excluded_audio(conference_member_t *member)
+{
+	uint32_t i;
+
+	for (i = 0; i < member->mix_exclude_count; i++) {
+		if (switch_test_flag(member->mix_exclude[i], MFLAG_HAS_AUDIO)) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static void *SWITCH_THREAD_FUNC conference_cascade_link_run(switch_thread_t *thread, void *obj);
+
+/* Split ip:port, returns the host part allocated from pool */
+static char *conference_cascade_parse_addr(const char *str, switch_port_t *port, switch_memory_pool_t *pool)
+{
+	char *host = switch_core_strdup(pool, str);
+	char *p;
+
+	if (!(p = strrchr(host, ':')) || !(*port = (switch_port_t) atoi(p + 1))) {
+		return NULL;
+	}
+	*p = '\0';
+
+	return host;
+}
+
+static conference_cascade_link_t *conference_cascade_link_get(const char *local)
+{
+	conference_cascade_link_t *link;
+	switch_memory_pool_t *pool = NULL;
+	switch_threadattr_t *thd_attr = NULL;
+	switch_port_t port = 0;
+	char *host;
+
+	switch_mutex_lock(globals.cascade_mutex);
+
+	if ((link = switch_core_hash_find(globals.cascade_links, local))) {
+		link->refs++;
+		goto end;
+	}
+
+	if (switch_core_new_memory_pool(&pool) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Pool Failure\n");
+		goto end;
+	}
+
+	link = switch_core_alloc(pool, sizeof(*link));
+	link->pool = pool;
+	link->key = switch_core_strdup(pool, local);
+
+	if (!(host = conference_cascade_parse_addr(local, &port, pool))) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Invalid cascade address [%s], expected ip:port\n", local);
+		goto fail;
+	}
+
+	if (switch_sockaddr_info_get(&link->local_addr, host, SWITCH_UNSPEC, port, 0, pool) != SWITCH_STATUS_SUCCESS ||
+		switch_socket_create(&link->sock, switch_sockaddr_get_family(link->local_addr), SOCK_DGRAM, 0, pool) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Cannot create cascade socket on [%s]\n", local);
+		goto fail;
+	}
+
+	switch_socket_opt_set(link->sock, SWITCH_SO_REUSEADDR, 1);
+
+	if (switch_socket_bind(link->sock, link->local_addr) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Cannot bind cascade socket to [%s]\n", local);
+		goto fail;
+	}
+
+	link->refs = 1;
+	link->running = 1;
+
+	switch_threadattr_create(&thd_attr, pool);
+	switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+	if (switch_thread_create(&link->thread, thd_attr, conference_cascade_link_run, link, pool) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Cannot start cascade thread on [%s]\n", local);
+		goto fail;
+	}
+
+	switch_core_hash_insert(globals.cascade_links, link->key, link);
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Cascade link up on %s\n", local);
+	goto end;
+
+  fail:
+
+	if (link->sock) {
+		switch_socket_close(link->sock);
+	}
+	switch_core_destroy_memory_pool(&pool);
+	link = NULL;
+
+  end:
+
+	switch_mutex_unlock(globals.cascade_mutex);
+
+	return link;
+}
+
+static void conference_cascade_link_release(conference_cascade_link_t *link)
+{
+	switch_memory_pool_t *pool = link->pool;
+	switch_status_t st;
+
+	switch_mutex_lock(globals.cascade_mutex);
+	if (--link->refs) {
+		switch_mutex_unlock(globals.cascade_mutex);
+		return;
+	}
+	switch_core_hash_delete(globals.cascade_links, link->key);
+	switch_mutex_unlock(globals.cascade_mutex);
+
+	link->running = 0;
+	switch_socket_shutdown(link->sock, SWITCH_SHUTDOWN_READWRITE);
+	switch_thread_join(&st, link->thread);
+	switch_socket_close(link->sock);
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Cascade link down on %s\n", link->key);
+	switch_core_destroy_memory_pool(&pool);
+}
+
+/* Packet layout: 12 byte RTP header (ssrc is the sending node), name length, conference name,
+   number of talkers in the mix, sample rate (32 bit), L16 samples in network order */
+static void conference_cascade_receive(switch_sockaddr_t *from, const uint8_t *packet, switch_size_t len)
+{
+	conference_obj_t *conference;
+	char name[256];
+	int16_t pcm[SWITCH_RECOMMENDED_BUFFER_SIZE / 2];
+	const uint8_t *payload;
+	uint32_t ssrc, rate, i;
+	uint16_t seq;
+	uint8_t name_len, talkers;
+	switch_size_t payload_len, samples;
+
+	if (len < 13 || (packet[0] & 0xC0) != 0x80 || (packet[1] & 0x7F) != CONF_CASCADE_PT) {
+		return;
+	}
+
+	memcpy(&seq, packet + 2, sizeof(seq));
+	seq = ntohs(seq);
+	memcpy(&ssrc, packet + 8, sizeof(ssrc));
+	ssrc = ntohl(ssrc);
+
+	/* our own traffic coming back */
+	if (ssrc == globals.cascade_node_id) {
+		return;
+	}
+
+	name_len = packet[12];
+	if (!name_len || len < (switch_size_t) 13 + name_len + 5) {
+		return;
+	}
+
+	memcpy(name, packet + 13, name_len);
+	name[name_len] = '\0';
+	talkers = packet[13 + name_len];
+	memcpy(&rate, packet + 14 + name_len, sizeof(rate));
+	rate = ntohl(rate);
+
+	payload = packet + 18 + name_len;
+	payload_len = len - 18 - name_len;
+	samples = payload_len / sizeof(int16_t);
+
+	if (!samples || samples > SWITCH_RECOMMENDED_BUFFER_SIZE / 2) {
+		return;
+	}
+
+	if (!(conference = conference_find(name))) {
+		return;
+	}
+
+	if (rate == conference->rate) {
+		switch_mutex_lock(conference->cascade_mutex);
+
+		for (i = 0; conference->cascade_running && i < conference->cascade_peer_count; i++) {
+			conference_cascade_peer_t *peer = &conference->cascade_peers[i];
+			conference_member_t *member = peer->member;
+			uint16_t gap;
+			uint32_t x;
+
+			if (!member || !switch_cmp_addr(from, peer->addr)) {
+				continue;
+			}
+
+			if (peer->have_seq) {
+				gap = (uint16_t) (seq - peer->last_seq - 1);
+
+				if (gap >= 0x8000) {
+					/* late or duplicate, the mix has moved on */
+					peer->rx_dropped++;
+					break;
+				}
+				peer->rx_lost += gap;
+			}
+			peer->have_seq = 1;
+			peer->last_seq = seq;
+			peer->last_rx = switch_micro_time_now();
+			peer->talkers = talkers;
+
+			for (x = 0; x < samples; x++) {
+				uint16_t v;
+				memcpy(&v, payload + x * 2, sizeof(v));
+				pcm[x] = (int16_t) ntohs(v);
+			}
+
+			if (switch_buffer_inuse(member->audio_buffer) > CONF_CASCADE_MAX_DELAY * samples * sizeof(int16_t) ||
+				!switch_buffer_write(member->audio_buffer, pcm, samples * sizeof(int16_t))) {
+				peer->rx_dropped++;
+			} else {
+				peer->rx_packets++;
+			}
+			break;
+		}
+
+		switch_mutex_unlock(conference->cascade_mutex);
+	}
+
+	switch_thread_rwlock_unlock(conference->rwlock);
+}
+
+static void *SWITCH_THREAD_FUNC conference_cascade_link_run(switch_thread_t *thread, void *obj)
+{
+	conference_cascade_link_t *link = (conference_cascade_link_t *) obj;
+	switch_sockaddr_t *from = NULL;
+	char *buf;
+
+	switch_zmalloc(buf, CONF_CASCADE_PACKET_MAX);
+	switch_sockaddr_info_get(&from, NULL, SWITCH_UNSPEC, 0, 0, link->pool);
+
+	while (link->running) {
+		switch_size_t len = CONF_CASCADE_PACKET_MAX;
+
+		if (switch_socket_recvfrom(from, link->sock, 0, buf, &len) != SWITCH_STATUS_SUCCESS) {
+			if (link->running) {
+				switch_yield(10000);
+			}
+			continue;
+		}
+
+		if (len && link->running) {
+			conference_cascade_receive(from, (uint8_t *) buf, len);
+		}
+	}
+
+	free(buf);
+
+	return NULL;
+}
+
+/* Send what this node mixed from its own talkers to every peer, run by the conference thread */
+static void conference_cascade_send(conference_obj_t *conference, const int32_t *mix, uint32_t samples, uint32_t talkers)
+{
+	uint8_t packet[CONF_CASCADE_PACKET_MAX];
+	size_t name_len = strlen(conference->name);
+	uint16_t seq = htons(conference->cascade_seq++);
+	uint32_t ts = htonl(conference->cascade_ts);
+	uint32_t ssrc = htonl(globals.cascade_node_id);
+	uint32_t rate = htonl(conference->rate);
+	uint32_t x, i;
+	uint8_t *payload;
+	switch_size_t len;
+
+	conference->cascade_ts += samples;
+
+	if (name_len > 255 || 18 + name_len + samples * sizeof(int16_t) > sizeof(packet)) {
+		return;
+	}
+
+	packet[0] = 0x80;
+	packet[1] = CONF_CASCADE_PT;
+	memcpy(packet + 2, &seq, sizeof(seq));
+	memcpy(packet + 4, &ts, sizeof(ts));
+	memcpy(packet + 8, &ssrc, sizeof(ssrc));
+	packet[12] = (uint8_t) name_len;
+	memcpy(packet + 13, conference->name, name_len);
+	packet[13 + name_len] = (uint8_t) (talkers > 255 ? 255 : talkers);
+	memcpy(packet + 14 + name_len, &rate, sizeof(rate));
+
+	payload = packet + 18 + name_len;
+	for (x = 0; x < samples; x++) {
+		int32_t z = mix[x];
+		uint16_t v = htons((uint16_t) (int16_t) (z > SWITCH_SMAX ? SWITCH_SMAX : (z < SWITCH_SMIN ? SWITCH_SMIN : z)));
+		memcpy(payload + x * 2, &v, sizeof(v));
+	}
+
+	for (i = 0; i < conference->cascade_peer_count; i++) {
+		if (!conference->cascade_peers[i].member) {
+			continue;
+		}
+		len = 18 + name_len + samples * sizeof(int16_t);
+		switch_socket_sendto(conference->cascade_link->sock, conference->cascade_peers[i].addr, 0, (char *) packet, &len);
+	}
+
+	conference->cascade_tx_packets++;
+}
+
+/* A member without a channel that plays what a peer node sends */
+static conference_member_t *conference_cascade_member_create(conference_obj_t *conference, conference_cascade_peer_t *peer)
+{
+	conference_member_t *member = switch_core_alloc(conference->pool, sizeof(*member));
+
+	member->flags = MFLAG_CAN_SPEAK | MFLAG_NOCHANNEL | MFLAG_RUNNING;
+	member->conference = conference;
+	member->native_rate = conference->rate;
+	member->id = next_member_id();
+	member->pool = conference->pool;
+	member->cascade_peer = peer;
+
+	member->frame_size = SWITCH_RECOMMENDED_BUFFER_SIZE;
+	member->frame = switch_core_alloc(member->pool, member->frame_size);
+
+	switch_mutex_init(&member->write_mutex, SWITCH_MUTEX_NESTED, member->pool);
+	switch_mutex_init(&member->flag_mutex, SWITCH_MUTEX_NESTED, member->pool);
+	switch_mutex_init(&member->fnode_mutex, SWITCH_MUTEX_NESTED, member->pool);
+	switch_mutex_init(&member->audio_in_mutex, SWITCH_MUTEX_NESTED, member->pool);
+	switch_mutex_init(&member->audio_out_mutex, SWITCH_MUTEX_NESTED, member->pool);
+	switch_mutex_init(&member->read_mutex, SWITCH_MUTEX_NESTED, member->pool);
+	switch_thread_rwlock_create(&member->rwlock, member->pool);
+
+	/* fed by the link thread, read by the mixer */
+	if (switch_buffer_create_ring(NULL, &member->audio_buffer, CONF_DBUFFER_SIZE) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Memory Error Creating Audio Buffer!\n");
+		return NULL;
+	}
+
+	if (conference_add_member(conference, member) != SWITCH_STATUS_SUCCESS) {
+		switch_buffer_destroy(&member->audio_buffer);
+		return NULL;
+	}
+
+	return member;
+}
+
+/* Link the conference to the conferences of the same name on the cascade-peers nodes */
+static void conference_cascade_start(conference_obj_t *conference)
+{
+	char *peers, *argv[CONF_CASCADE_MAX_PEERS] = { 0 };
+	int argc, x;
+
+	if (zstr(conference->cascade_local) || zstr(conference->cascade_peer_list)) {
+		return;
+	}
+
+	if (!(conference->cascade_link = conference_cascade_link_get(conference->cascade_local))) {
+		return;
+	}
+
+	peers = switch_core_strdup(conference->pool, conference->cascade_peer_list);
+	argc = switch_separate_string(peers, ',', argv, (sizeof(argv) / sizeof(argv[0])));
+	conference->cascade_peers = switch_core_alloc(conference->pool, sizeof(conference_cascade_peer_t) * argc);
+
+	for (x = 0; x < argc; x++) {
+		conference_cascade_peer_t *peer = &conference->cascade_peers[conference->cascade_peer_count];
+		switch_port_t port = 0;
+		char *host;
+
+		if (!(host = conference_cascade_parse_addr(argv[x], &port, conference->pool)) ||
+			switch_sockaddr_info_get(&peer->addr, host, SWITCH_UNSPEC, port, 0, conference->pool) != SWITCH_STATUS_SUCCESS) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Invalid cascade peer [%s], expected ip:port\n", argv[x]);
+			continue;
+		}
+
+		peer->name = switch_core_strdup(conference->pool, argv[x]);
+		if (!(peer->member = conference_cascade_member_create(conference, peer))) {
+			continue;
+		}
+
+		conference->cascade_peer_count++;
+	}
+
+	switch_mutex_lock(conference->cascade_mutex);
+	conference->cascade_running = conference->cascade_peer_count ? 1 : 0;
+	switch_mutex_unlock(conference->cascade_mutex);
+
+	if (!conference->cascade_running) {
+		conference_cascade_link_release(conference->cascade_link);
+		conference->cascade_link = NULL;
+	}
+}
+
+static void conference_cascade_stop(conference_obj_t *conference)
+{
+	uint32_t i;
+
+	if (!conference->cascade_link) {
+		return;
+	}
+
+	/* after this the link thread leaves the peer members alone */
+	switch_mutex_lock(conference->cascade_mutex);
+	conference->cascade_running = 0;
+	switch_mutex_unlock(conference->cascade_mutex);
+
+	for (i = 0; i < conference->cascade_peer_count; i++) {
+		conference_member_t *member = conference->cascade_peers[i].member;
+
+		if (member) {
+			conference_del_member(conference, member);
+			switch_buffer_destroy(&member->audio_buffer);
+			conference->cascade_peers[i].member = NULL;
+		}
+	}
+
+	conference_cascade_link_release(conference->cascade_link);
+	conference->cascade_link = NULL;
+}
+
+/* Whether the mixer has to build this member's audio itself */
+static int conference_member_wants_mix(conference_member_t *member)
+{
+	return switch_test_flag(member, MFLAG_RUNNING) && switch_test_flag(member, MFLAG_CAN_HEAR) && !switch_test_flag(member, MFLAG_SHARED_MIX);
+}
+
+/* Write one tick of audio into a listener's mux_buffer, write_frame is scratch space of the calling thread */
+static void conference_mix_listener(conference_member_t *member, const int32_t *main_frame, int16_t *shared_pcm, int16_t *write_frame, uint32_t bytes)
+{
+	conference_member_t *imember;
+	int16_t *out = shared_pcm;
+
+	if (switch_test_flag(member, MFLAG_HAS_AUDIO) || (member->mix_exclude_count && conference_member_excluded_audio(member))) {
+		int32_t mix[SWITCH_RECOMMENDED_BUFFER_SIZE / 2];
+		uint32_t i;
+
+		memcpy(mix, main_frame, (bytes / 2) * sizeof(mix[0]));
+
+		if (switch_test_flag(member, MFLAG_HAS_AUDIO)) {
+			conference_mix_sub(mix, (int16_t *) member->frame, member->read / 2 < bytes / 2 ? member->read / 2 : bytes / 2);
+		}
+
+		for (i = 0; i < member->mix_exclude_count; i++) {
+			imember = member->mix_exclude[i];
+			if (switch_test_flag(imember, MFLAG_HAS_AUDIO)) {
+				conference_mix_sub(mix, (int16_t *) imember->frame, imember->read / 2 < bytes / 2 ? imember->read / 2 : bytes / 2);
+			}
+		}
+
+		conference_mix_clamp(write_frame, mix, bytes / 2);
+		out = write_frame;
+	}
+
+	if (!switch_buffer_write(member->mux_buffer, out, bytes)) {
+		/* the ring is full, the output side has stalled so let it start over */
+		switch_set_flag_locked(member, MFLAG_FLUSH_BUFFER);
+	}
+}
+
+static void conference_mix_slice(conference_mix_pool_t *pool, uint32_t slice, int16_t *write_frame)
+{
+	uint32_t slices = pool->thread_count + 1;
+	uint32_t x = (uint32_t) (((uint64_t) pool->snapshot->count * slice) / slices);
+	uint32_t end = (uint32_t) (((uint64_t) pool->snapshot->count * (slice + 1)) / slices);
+
+	for (; x < end; x++) {
+		conference_member_t *member = pool->snapshot->members[x];
+
+		if (conference_member_wants_mix(member)) {
+			conference_mix_listener(member, pool->main_frame, pool->shared_pcm, write_frame, pool->bytes);
+		}
+	}
+}
+
+static void *SWITCH_THREAD_FUNC conference_mix_worker_run(switch_thread_t *thread, void *obj)
+{
+	conference_mix_worker_t *worker = (conference_mix_worker_t *) obj;
+	conference_mix_pool_t *pool = worker->pool;
+	int16_t write_frame[SWITCH_RECOMMENDED_BUFFER_SIZE / 2];
+	uint32_t gen = 0;
+
+	switch_mutex_lock(pool->mutex);
+	for (;;) {
+		while (pool->running && pool->gen == gen) {
+			switch_thread_cond_wait(pool->start_cond, pool->mutex);
+		}
+
+		if (!pool->running) {
+			break;
+		}
+
+		gen = pool->gen;
+		switch_mutex_unlock(pool->mutex);
+
+		conference_mix_slice(pool, worker->slice, write_frame);
+
+		switch_mutex_lock(pool->mutex);
+		if (!--pool->pending) {
+			switch_thread_cond_signal(pool->done_cond);
+		}
+	}
+	switch_mutex_unlock(pool->mutex);
+
+	return NULL;
+}
+
+/* Hand the listeners of this tick to the workers, do slice 0 on the calling thread and wait for the rest */
+static void conference_mix_pool_run(conference_mix_pool_t *pool, int16_t *write_frame)
+{
+	switch_mutex_lock(pool->mutex);
+	pool->pending = pool->thread_count;
+	pool->gen++;
+	switch_thread_cond_broadcast(pool->start_cond);
+	switch_mutex_unlock(pool->mutex);
+
+	conference_mix_slice(pool, 0, write_frame);
+
+	switch_mutex_lock(pool->mutex);
+	while (pool->pending) {
+		switch_thread_cond_wait(pool->done_cond, pool->mutex);
+	}
+	switch_mutex_unlock(pool->mutex);
+}
+
+static void conference_mix_pool_create(conference_obj_t *conference)
+{
+	conference_mix_pool_t *pool;
+	conference_mix_worker_t *worker;
+	switch_threadattr_t *thd_attr = NULL;
+	uint32_t i;
+
+	if (conference->mix_threads < 2) {
+		return;
+	}
+
+	pool = switch_core_alloc(conference->pool, sizeof(*pool));
+	pool->threads = switch_core_alloc(conference->pool, sizeof(switch_thread_t *) * (conference->mix_threads - 1));
+	switch_mutex_init(&pool->mutex, SWITCH_MUTEX_NESTED, conference->pool);
+	switch_thread_cond_create(&pool->start_cond, conference->pool);
+	switch_thread_cond_create(&pool->done_cond, conference->pool);
+	pool->running = 1;
+
+	switch_threadattr_create(&thd_attr, conference->pool);
+	switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+
+	for (i = 0; i < conference->mix_threads - 1; i++) {
+		worker = switch_core_alloc(conference->pool, sizeof(*worker));
+		worker->pool = pool;
+		worker->slice = i + 1;
+
+		if (switch_thread_create(&pool->threads[i], thd_attr, conference_mix_worker_run, worker, conference->pool) != SWITCH_STATUS_SUCCESS) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Conference %s could only start %u of %u mixer threads\n",
+							  conference->name, i + 1, conference->mix_threads);
+			break;
+		}
+	}
+
+	/* workers only look at thread_count once a tick is handed out */
+	pool->thread_count = i;
+
+	if (!pool->thread_count) {
+		switch_thread_cond_destroy(pool->start_cond);
+		switch_thread_cond_destroy(pool->done_cond);
+		return;
+	}
+
+	conference->mix_pool = pool;
+}
+
+static void conference_mix_pool_destroy(conference_obj_t *conference)
+{
+	conference_mix_pool_t *pool = conference->mix_pool;
+	switch_status_t st;
+	uint32_t i;
+
+	if (!pool) {
+		return;
+	}
+
+	switch_mutex_lock(pool->mutex);
+	pool->running = 0;
+	switch_thread_cond_broadcast(pool->start_cond);
+	switch_mutex_unlock(pool->mutex);
+
+	for (i = 0; i < pool->thread_count; i++) {
+		switch_thread_join(&st, pool->threads[i]);
+	}
+
+	switch_thread_cond_destroy(pool->start_cond);
+	switch_thread_cond_destroy(pool->done_cond);
+	conference->mix_pool = NULL;
+}
+
+static void conference_member_set_active_speaker(conference_member_t *member, uint8_t on)
+{
+	member->active_speaker = on;
+	member->active_hold = on ? member->conference->active_speaker_hold : 0;
+
+	if (member->session) {
+		switch_channel_set_variable(switch_core_session_get_channel(member->session), "conference_active_speaker", on ? "true" : "false");
+	}
+}
+
+/* Pick the members that make it into the mix this tick when max-active-speakers is set.
+   An active speaker keeps its slot while it has audio and for active_speaker_hold ticks after, once all slots are taken
+   a member only gets in by being CONF_ACTIVE_SPEAKER_MARGIN percent louder (score_iir) than the weakest active speaker.
+   Everybody else loses MFLAG_HAS_AUDIO for the tick so neither the mix nor the N-1 and shared mix paths see them.
+   Returns how many members were dropped.
+ */
+static uint32_t conference_select_active_speakers(conference_obj_t *conference)
+{
+	conference_member_t *imember, *weakest = NULL;
+	uint32_t selected = 0, dropped = 0;
+	int changed = conference->active_speakers_changed;
+	switch_event_t *event;
+
+	conference->active_speakers_changed = 0;
+
+	for (imember = conference->members; imember; imember = imember->next) {
+		if (!imember->active_speaker) {
+			continue;
+		}
+
+		if (switch_test_flag(imember, MFLAG_RUNNING) && switch_test_flag(imember, MFLAG_HAS_AUDIO)) {
+			imember->active_hold = conference->active_speaker_hold;
+		} else if (!imember->active_hold || !--imember->active_hold) {
+			conference_member_set_active_speaker(imember, 0);
+			changed = 1;
+			continue;
+		}
+
+		if (!weakest || imember->score_iir < weakest->score_iir) {
+			weakest = imember;
+		}
+		selected++;
+	}
+
+	for (imember = conference->members; imember; imember = imember->next) {
+		/* other nodes already limited their talkers */
+		if (imember->cascade_peer) {
+			continue;
+		}
+
+		if (imember->active_speaker || !switch_test_flag(imember, MFLAG_RUNNING) || !switch_test_flag(imember, MFLAG_HAS_AUDIO)) {
+			continue;
+		}
+
+		if (selected < conference->max_active_speakers) {
+			conference_member_set_active_speaker(imember, 1);
+			selected++;
+			changed = 1;
+		} else if (weakest && imember->score_iir > weakest->score_iir + (weakest->score_iir * CONF_ACTIVE_SPEAKER_MARGIN) / 100) {
+			conference_member_set_active_speaker(weakest, 0);
+			conference_member_set_active_speaker(imember, 1);
+			changed = 1;
+		} else {
+			continue;
+		}
+
+		if (selected == conference->max_active_speakers) {
+			conference_member_t *omember;
+
+			weakest = NULL;
+			for (omember = conference->members; omember; omember = omember->next) {
+				if (omember->active_speaker && (!weakest || omember->score_iir < weakest->score_iir)) {
+					weakest = omember;
+				}
+			}
+		}
+	}
+
+	for (imember = conference->members; imember; imember = imember->next) {
+		if (!imember->active_speaker && !imember->cascade_peer && switch_test_flag(imember, MFLAG_HAS_AUDIO)) {
+			switch_clear_flag_locked(imember, MFLAG_HAS_AUDIO);
+			dropped++;
+		}
+	}
+
+	conference->active_speaker_count = selected;
+
+	if (changed && test_eflag(conference, EFLAG_ACTIVE_SPEAKERS) &&
+		switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CONF_EVENT_MAINT) == SWITCH_STATUS_SUCCESS) {
+		switch_stream_handle_t stream = { 0 };
+
+		SWITCH_STANDARD_STREAM(stream);
+		for (imember = conference->members; imember; imember = imember->next) {
+			if (imember->active_speaker) {
+				stream.write_function(&stream, "%s%u", stream.data_len ? "," : "", imember->id);
+			}
+		}
+
+		conference_add_event_data(conference, event);
+		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Action", "active-speakers-change");
+		switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Active-Speaker-Count", "%u", selected);
+		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Active-Speakers", stream.data_len ? (char *) stream.data : "none");
+		switch_event_fire(&event);
+		switch_safe_free(stream.data);
+	}
+
+	return dropped;
+}
+
+/* Whether one encoder can feed every listener on this codec: each frame has to decode on its own, a codec that
+   carries state from frame to frame would hand late joiners a stream their decoder is not in step with */
+static switch_bool_t conference_codec_shareable(const switch_codec_implementation_t *impl)
+{
+	static const char *stateless[] = { "PCMU", "PCMA", "L16", NULL };
+	int i;
+
+	for (i = 0; impl->iananame && stateless[i]; i++) {
+		if (!strcasecmp(impl->iananame, stateless[i])) {
+			return SWITCH_TRUE;
+		}
+	}
+
+	return SWITCH_FALSE;
+}
+
+/* Attach a member to the shared mix group matching its write codec, creating the group on first use */
+static void conference_mix_group_join(conference_member_t *member)
+{
+	conference_obj_t *conference = member->conference;
+	switch_codec_implementation_t impl = { 0 };
+	switch_codec_t *session_codec;
+	conference_mix_group_t *group;
+	const char *fmtp;
+
+	if (!switch_test_flag(conference, CFLAG_SHARED_MIX)) {
+		return;
+	}
+
+	switch_core_session_get_write_impl(member->session, &impl);
+	session_codec = switch_core_session_get_write_codec(member->session);
+
+	/* group frames are produced on the conference clock so the ptime has to match it */
+	if (!impl.iananame || !session_codec || !session_codec->implementation || impl.microseconds_per_packet != conference->interval * 1000 ||
+		!conference_codec_shareable(&impl)) {
+		return;
+	}
+
+	fmtp = session_codec->fmtp_in;
+
+	switch_mutex_lock(conference->mutex);
+
+	/* the implementation pins codec, rate, ptime and channels, the fmtp has to match as well */
+	for (group = conference->mix_groups; group; group = group->next) {
+		if (group->codec.implementation == session_codec->implementation && !strcmp(switch_str_nil(group->fmtp), switch_str_nil(fmtp))) {
+			break;
+		}
+	}
+
+	if (!group && (group = switch_core_alloc(conference->pool, sizeof(*group)))) {
+		group->fmtp = fmtp ? switch_core_strdup(conference->pool, fmtp) : NULL;
+
+		if (switch_core_codec_init(&group->codec, impl.iananame, group->fmtp, impl.samples_per_second, impl.microseconds_per_packet / 1000,
+								   impl.number_of_channels, SWITCH_CODEC_FLAG_ENCODE | SWITCH_CODEC_FLAG_DECODE, NULL,
+								   conference->pool) != SWITCH_STATUS_SUCCESS) {
+			group = NULL;
+		} else if (group->codec.implementation != session_codec->implementation) {
+			/* a different implementation would be transcoded again on every member, no gain */
+			switch_core_codec_destroy(&group->codec);
+			group = NULL;
+		} else {
+			if (impl.actual_samples_per_second != conference->rate &&
+				switch_resample_create(&group->resampler, conference->rate, impl.actual_samples_per_second,
+									   SWITCH_RECOMMENDED_BUFFER_SIZE, SWITCH_RESAMPLE_QUALITY, 1) != SWITCH_STATUS_SUCCESS) {
+				group->resampler = NULL;
+			}
+			group->samples = impl.samples_per_packet;
+			switch_mutex_init(&group->mutex, SWITCH_MUTEX_NESTED, conference->pool);
+			group->next = conference->mix_groups;
+			conference->mix_groups = group;
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Conference %s: shared mix group %s@%uhz %dms created\n",
+							  conference->name, impl.iananame, impl.actual_samples_per_second, impl.microseconds_per_packet / 1000);
+		}
+	}
+
+	if (group) {
+		group->refs++;
+		member->mix_group = group;
+	}
+
+	switch_mutex_unlock(conference->mutex);
+}
+
+static void conference_mix_group_leave(conference_member_t *member)
+{
+	switch_mutex_lock(member->conference->mutex);
+	if (member->mix_group) {
+		member->mix_group->refs--;
+		member->mix_group = NULL;
+	}
+	switch_clear_flag_locked(member, MFLAG_SHARED_MIX);
+	switch_clear_flag_locked(member, MFLAG_SHARED_OK);
+	switch_mutex_unlock(member->conference->mutex);
+}
+
+/* Called by the mixer, returns true when the member is fed from its group this tick */
+static int conference_member_use_shared_mix(conference_obj_t *conference, conference_member_t *member)
+{
+	conference_mix_group_t *group = member->mix_group;
+
+	if (!group || !switch_test_flag(member, MFLAG_SHARED_OK) || switch_test_flag(member, MFLAG_HAS_AUDIO) ||
+		!switch_test_flag(member, MFLAG_CAN_HEAR) || conference_member_excluded_audio(member)) {
+		if (switch_test_flag(member, MFLAG_SHARED_MIX)) {
+			switch_clear_flag_locked(member, MFLAG_SHARED_MIX);
+		}
+		return 0;
+	}
+
+	if (!switch_test_flag(member, MFLAG_SHARED_MIX)) {
+		/* the first frame this member has not been given as PCM */
+		switch_mutex_lock(group->mutex);
+		member->shared_next = group->tick;
+		switch_mutex_unlock(group->mutex);
+		switch_set_flag_locked(member, MFLAG_SHARED_MIX);
+	}
+
+	group->active++;
+
+	return 1;
+}
+
+/* Encode the common mix once per group that has listeners this tick */
+static void conference_mix_groups_publish(conference_obj_t *conference, int16_t *pcm, uint32_t samples)
+{
+	conference_mix_group_t *group;
+	uint8_t encoded[SWITCH_RECOMMENDED_BUFFER_SIZE];
+
+	for (group = conference->mix_groups; group; group = group->next) {
+		int16_t *data = pcm;
+		uint32_t len = samples * 2, rate = conference->rate;
+		uint32_t enc_len = sizeof(encoded), enc_rate = group->codec.implementation->samples_per_second;
+		unsigned int flag = 0;
+
+		if (!group->active) {
+			continue;
+		}
+		group->active = 0;
+
+		if (group->resampler) {
+			switch_resample_process(group->resampler, pcm, samples);
+			data = group->resampler->to;
+			len = group->resampler->to_len * 2;
+			rate = group->resampler->to_rate;
 		}
 
+		if (switch_core_codec_encode(&group->codec, NULL, data, len, rate, encoded, &enc_len, &enc_rate, &flag) == SWITCH_STATUS_SUCCESS) {
+			uint32_t slot = group->tick % CONF_MIX_GROUP_DEPTH;
 
-		switch_mutex_unlock(conference->mutex);
-		switch_mutex_lock(conference->mutex);
-		has_vid = 0;
-		want_refresh = 0;
+			switch_mutex_lock(group->mutex);
+			memcpy(group->frames[slot], encoded, enc_len);
+			group->lens[slot] = enc_len;
+			group->tick++;
+			switch_mutex_unlock(group->mutex);
+		}
+	}
+}
 
-		for (imember = conference->members; imember; imember = imember->next) {
-			switch_channel_t *ichannel = switch_core_session_get_channel(imember->session);
+/* Called by the output thread, copies the next encoded group frame for this member */
+static switch_bool_t conference_mix_group_read(conference_member_t *member, switch_frame_t *frame)
+{
+	conference_mix_group_t *group = member->mix_group;
+	switch_bool_t r = SWITCH_FALSE;
 
-			if (switch_channel_test_flag(ichannel, CF_VIDEO_REFRESH_REQ)) {
-				want_refresh++;
-				switch_channel_clear_flag(ichannel, CF_VIDEO_REFRESH_REQ);
-			}
+	switch_mutex_lock(group->mutex);
+	if (member->shared_next < group->tick) {
+		uint32_t slot;
 
-			if (imember->session && switch_channel_test_flag(ichannel, CF_VIDEO)) {
-				has_vid++;
-				switch_core_session_write_video_frame(imember->session, vid_frame, SWITCH_IO_FLAG_NONE, 0);
-			}
-		}
-		
-		if (want_refresh) {
-			switch_core_session_receive_message(session, &msg);
-			want_refresh = 0;
+		if (group->tick - member->shared_next >= CONF_MIX_GROUP_DEPTH) {
+			/* fell too far behind, catch up with the newest frame */
+			member->shared_next = group->tick - 1;
 		}
 
-	do_continue:
-		
-		switch_mutex_unlock(conference->mutex);
+		slot = member->shared_next % CONF_MIX_GROUP_DEPTH;
+		memcpy(frame->data, group->frames[slot], group->lens[slot]);
+		frame->datalen = group->lens[slot];
+		frame->samples = group->samples;
+		frame->codec = &group->codec;
+		member->shared_next++;
+		r = SWITCH_TRUE;
 	}
+	switch_mutex_unlock(group->mutex);
 
-	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Video thread ending for conference %s\n", conference->name);
-	conference->video_running = 0;
+	return r;
+}
 
-	return NULL;
+static void conference_mix_groups_destroy(conference_obj_t *conference)
+{
+	conference_mix_group_t *group;
+
+	for (group = conference->mix_groups; group; group = group->next) {
+		switch_core_codec_destroy(&group->codec);
+		if (group->resampler) {
+			switch_resample_destroy(&group->resampler);
+		}
+	}
+	conference->mix_groups = NULL;
 }
 
 /* Main monitor thread (1 per distinct conference room) */
@@ -1350,6 +2829,9 @@ static void *SWITCH_THREAD_FUNC conference_thread_run(switch_thread_t *thread, v
 	conference->is_recording = 0;
 	conference->record_count = 0;
 
+	conference_mix_pool_create(conference);
+	conference_cascade_start(conference);
+
 	while (globals.running && !switch_test_flag(conference, CFLAG_DESTRUCT)) {
 		switch_size_t file_sample_len = samples;
 		switch_size_t file_data_len = samples * 2;
@@ -1357,6 +2839,11 @@ static void *SWITCH_THREAD_FUNC conference_thread_run(switch_thread_t *thread, v
 		uint32_t conf_energy = 0;
 		int nomoh = 0;
 		conference_member_t *floor_holder, *video_bridge_members[2] = { 0 };
+		uint32_t shared_members = 0;
+		int16_t shared_pcm[SWITCH_RECOMMENDED_BUFFER_SIZE / 2];
+		int have_shared_pcm = 0;
+		switch_time_t tick_start, tick_time;
+		uint32_t local_talkers = 0;
 		
 		/* Sync the conference to a single timing source */
 		if (switch_core_timer_next(&timer) != SWITCH_STATUS_SUCCESS) {
@@ -1364,9 +2851,15 @@ static void *SWITCH_THREAD_FUNC conference_thread_run(switch_thread_t *thread, v
 			break;
 		}
 
+		tick_start = switch_time_ref();
+
 		switch_mutex_lock(conference->mutex);
 		has_file_data = ready = total = 0;
 
+		if (conference->relationship_built != conference->relationship_gen) {
+			conference_rebuild_mix_exclusions(conference);
+		}
+
 		floor_holder = conference->floor_holder;
 		
 		/* Read one frame of audio from each member channel and save it for redistribution */
@@ -1401,18 +2894,36 @@ static void *SWITCH_THREAD_FUNC conference_thread_run(switch_thread_t *thread, v
 			}
 
 			switch_clear_flag_locked(imember, MFLAG_HAS_AUDIO);
-			switch_mutex_lock(imember->audio_in_mutex);
 
+			/* audio_buffer is a ring fed only by the member's input thread, no lock needed */
 			if (switch_buffer_inuse(imember->audio_buffer) >= bytes
 				&& (buf_read = (uint32_t) switch_buffer_read(imember->audio_buffer, imember->frame, bytes))) {
 				imember->read = buf_read;
 				switch_set_flag_locked(imember, MFLAG_HAS_AUDIO);
 				ready++;
 			}
-			switch_mutex_unlock(imember->audio_in_mutex);
 		}
-		
 
+		if (conference->max_active_speakers) {
+			ready -= conference_select_active_speakers(conference);
+
+			/* the floor goes to the loudest active speaker once the holder has lost its slot */
+			if (floor_holder && !floor_holder->active_speaker) {
+				conference_member_t *best = NULL;
+
+				for (imember = conference->members; imember; imember = imember->next) {
+					if (imember->active_speaker && (!best || imember->score_iir > best->score_iir) &&
+						(!switch_test_flag(conference, CFLAG_VID_FLOOR) ||
+						 switch_channel_test_flag(switch_core_session_get_channel(imember->session), CF_VIDEO))) {
+						best = imember;
+					}
+				}
+
+				if (best) {
+					floor_holder = best;
+				}
+			}
+		}
 
 		if (floor_holder != conference->floor_holder) {
 			switch_event_t *event = NULL;
@@ -1447,6 +2958,8 @@ static void *SWITCH_THREAD_FUNC conference_thread_run(switch_thread_t *thread, v
 					msg.message_id = SWITCH_MESSAGE_INDICATE_VIDEO_REFRESH_REQ;
 			
 					switch_core_session_receive_message(floor_holder->session, &msg);
+					conference->video_refresh_pending = 0;
+					conference->video_refresh_next = switch_micro_time_now() + CONF_VIDEO_REFRESH_INTERVAL;
 				}
 			}
 			
@@ -1603,6 +3116,15 @@ static void *SWITCH_THREAD_FUNC conference_thread_run(switch_thread_t *thread, v
 			}
 		}
 
+		/* listeners that add nothing to the mix all hear the same audio, they get it from their group encoded once */
+		if (conference->mix_groups) {
+			for (omember = conference->members; omember; omember = omember->next) {
+				if (switch_test_flag(omember, MFLAG_RUNNING) && conference_member_use_shared_mix(conference, omember)) {
+					shared_members++;
+				}
+			}
+		}
+
 		if (ready || has_file_data) {
 			/* Use more bits in the main_frame to preserve the exact sum of the audio samples. */
 			int main_frame[SWITCH_RECOMMENDED_BUFFER_SIZE / 2] = { 0 };
@@ -1624,6 +3146,7 @@ static void *SWITCH_THREAD_FUNC conference_thread_run(switch_thread_t *thread, v
 			member_score_sum = 0;
 			conference->mux_loop_count = 0;
 			conference->member_loop_count = 0;
+			local_talkers = 0;
 
 
 			/* Copy audio from every member known to be producing audio into the main frame. */
@@ -1641,12 +3164,33 @@ static void *SWITCH_THREAD_FUNC conference_thread_run(switch_thread_t *thread, v
 					}
 				}
 				
+				if (!omember->cascade_peer) {
+					local_talkers++;
+				}
+
 				bptr = (int16_t *) omember->frame;
 				for (x = 0; x < omember->read / 2; x++) {
 					main_frame[x] += (int32_t) bptr[x];
 				}
 			}
 
+			/* peers get what was mixed here, never what they sent themselves */
+			if (conference->cascade_running && (local_talkers || has_file_data)) {
+				int32_t local[SWITCH_RECOMMENDED_BUFFER_SIZE / 2];
+				uint32_t i;
+
+				memcpy(local, main_frame, (bytes / 2) * sizeof(local[0]));
+
+				for (i = 0; i < conference->cascade_peer_count; i++) {
+					imember = conference->cascade_peers[i].member;
+					if (imember && switch_test_flag(imember, MFLAG_HAS_AUDIO)) {
+						conference_mix_sub(local, (int16_t *) imember->frame, imember->read / 2 < bytes / 2 ? imember->read / 2 : bytes / 2);
+					}
+				}
+
+				conference_cascade_send(conference, local, bytes / 2, local_talkers);
+			}
+
 			if (conference->agc_level && conference->member_loop_count) {
 				conf_energy = 0;
 			
@@ -1662,74 +3206,52 @@ static void *SWITCH_THREAD_FUNC conference_thread_run(switch_thread_t *thread, v
 				conference->avg_score = conference->avg_tally / ++conference->avg_itt;
 				if (!conference->avg_itt) conference->avg_tally = conference->score;
 			}
+
+			/* what everybody hears who has nothing to take out of it */
+			conference_mix_clamp(shared_pcm, main_frame, bytes / 2);
+			have_shared_pcm = 1;
 			
-			/* Create write frame once per member who is not deaf for each sample in the main frame
-			   check if our audio is involved and if so, subtract it from the sample so we don't hear ourselves.
-			   Since main frame was 32 bit int, we did not lose any detail, now that we have to convert to 16 bit we can
-			   cut it off at the min and max range if need be and write the frame to the output buffer.
+			/* Create write frame once per member who is not deaf. A member hearing everything gets the common mix,
+			   otherwise its own audio and the audio of every member it must not hear (see conference_rebuild_mix_exclusions)
+			   is subtracted once from the 32 bit main frame before it is cut down to 16 bit.
 			 */
-			for (omember = conference->members; omember; omember = omember->next) {
-				switch_size_t ok = 1;
-
-				if (!switch_test_flag(omember, MFLAG_RUNNING)) {
-					continue;
-				}
-
-				if (!switch_test_flag(omember, MFLAG_CAN_HEAR)) {
-					continue;
-				}
-
-				bptr = (int16_t *) omember->frame;
-				for (x = 0; x < bytes / 2; x++) {
-					z = main_frame[x];
-					/* bptr[x] represents my own contribution to this audio sample */
-					if (switch_test_flag(omember, MFLAG_HAS_AUDIO) && x <= omember->read / 2) {
-						z -= (int32_t) bptr[x];
-					}
-
-					/* when there are relationships, we have to do more work by scouring all the members to see if there are any 
-					   reasons why we should not be hearing a paticular member, and if not, delete their samples as well.
-					 */
-					if (conference->relationship_total) {
-						for (imember = conference->members; imember; imember = imember->next) {
-							if (imember != omember && switch_test_flag(imember, MFLAG_HAS_AUDIO)) {
-								conference_relationship_t *rel;
-								switch_size_t found = 0;
-								int16_t *rptr = (int16_t *) imember->frame;
-								for (rel = imember->relationships; rel; rel = rel->next) {
-									if ((rel->id == omember->id || rel->id == 0) && !switch_test_flag(rel, RFLAG_CAN_SPEAK)) {
-										z -= (int32_t) rptr[x];
-										found = 1;
-										break;
-									}
-								}
-								if (!found) {
-									for (rel = omember->relationships; rel; rel = rel->next) {
-										if ((rel->id == imember->id || rel->id == 0) && !switch_test_flag(rel, RFLAG_CAN_HEAR)) {
-											z -= (int32_t) rptr[x];
-											break;
-										}
-									}
-								}
-
-							}
-						}
+			if (conference->mix_pool && conference->member_snapshot && conference->member_snapshot->count >= CONF_MIX_PARALLEL_MIN) {
+				conference_mix_pool_t *pool = conference->mix_pool;
+
+				/* joins and leaves replace the snapshot under conference->mutex so it holds still for the tick */
+				pool->snapshot = conference->member_snapshot;
+				pool->main_frame = main_frame;
+				pool->shared_pcm = shared_pcm;
+				pool->bytes = bytes;
+				conference_mix_pool_run(pool, write_frame);
+			} else {
+				for (omember = conference->members; omember; omember = omember->next) {
+					if (conference_member_wants_mix(omember)) {
+						conference_mix_listener(omember, main_frame, shared_pcm, write_frame, bytes);
 					}
-
-					/* Now we can convert to 16 bit. */
-					switch_normalize_to_16bit(z);
-					write_frame[x] = (int16_t) z;
 				}
-				
-				switch_mutex_lock(omember->audio_out_mutex);
-				ok = switch_buffer_write(omember->mux_buffer, write_frame, bytes);
-				switch_mutex_unlock(omember->audio_out_mutex);
+			}
+		}
 
-				if (!ok) {
-					switch_mutex_unlock(conference->mutex);
-					goto end;
+		if (shared_members) {
+			if (!have_shared_pcm) {
+				if (conference->comfort_noise_level) {
+					switch_generate_sln_silence(shared_pcm, samples, conference->comfort_noise_level);
+				} else {
+					memset(shared_pcm, 255, bytes);
 				}
 			}
+			conference_mix_groups_publish(conference, shared_pcm, samples);
+		}
+
+		tick_time = switch_time_ref() - tick_start;
+		conference->mix_time_last = (uint32_t) tick_time;
+		conference->mix_time_avg = conference->mix_time_avg ? (conference->mix_time_avg * 15 + conference->mix_time_last) / 16 : conference->mix_time_last;
+		if (conference->mix_time_last > conference->mix_time_max) {
+			conference->mix_time_max = conference->mix_time_last;
+		}
+		if (tick_time > (switch_time_t) conference->interval * 1000) {
+			conference->mix_deadline_misses++;
 		}
 
 		if (conference->async_fnode && conference->async_fnode->done) {
@@ -1766,7 +3288,6 @@ static void *SWITCH_THREAD_FUNC conference_thread_run(switch_thread_t *thread, v
 		switch_mutex_unlock(conference->mutex);
 	}
 	/* Rinse ... Repeat */
-  end:
 
 	if (switch_test_flag(conference, CFLAG_OUTCALL)) {
 		conference->cancel_cause = SWITCH_CAUSE_ORIGINATOR_CANCEL;
@@ -1852,6 +3373,9 @@ static void *SWITCH_THREAD_FUNC conference_thread_run(switch_thread_t *thread, v
 		}
 	}
 
+
+	conference_cascade_stop(conference);
+	conference_mix_pool_destroy(conference);
 	
 	switch_core_timer_destroy(&timer);
 	switch_mutex_lock(globals.hash_mutex);
@@ -1867,6 +3391,9 @@ static void *SWITCH_THREAD_FUNC conference_thread_run(switch_thread_t *thread, v
 	switch_thread_rwlock_unlock(conference->rwlock);
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Write Lock OFF\n");
 
+	conference_mix_groups_destroy(conference);
+	conference_member_snapshot_destroy(conference);
+
 	if (conference->sh) {
 		switch_speech_flag_t flags = SWITCH_SPEECH_FLAG_NONE;
 		switch_core_speech_close(&conference->lsh, &flags);
@@ -2404,6 +3931,11 @@ static int noise_gate_check(conference_member_t *member)
 		r = member->score > member->energy_level;
 	}
 
+	/* steady noise above the energy level is not talking either */
+	if (r && member->energy_level && member->conference->noise_floor_ratio) {
+		r = member->score > (member->noise_floor.level * member->conference->noise_floor_ratio) / 100;
+	}
+
 	return r;
 }
 
@@ -2486,7 +4018,8 @@ static void *SWITCH_THREAD_FUNC conference_loop_input(switch_thread_t *thread, v
 			break;
 		}
 
-		if (switch_test_flag(read_frame, SFF_CNG)) {
+		/* silence-aware legs hand us silent frames undecoded, treat them like CNG and keep them out of the mix */
+		if (switch_test_flag(read_frame, SFF_CNG) || switch_test_flag(read_frame, SFF_SILENCE)) {
 			if (member->conference->agc_level) {
 				member->nt_tally++;
 			}
@@ -2528,7 +4061,7 @@ static void *SWITCH_THREAD_FUNC conference_loop_input(switch_thread_t *thread, v
 		/* if the member can speak, compute the audio energy level and */
 		/* generate events when the level crosses the threshold        */
 		if ((switch_test_flag(member, MFLAG_CAN_SPEAK) || switch_test_flag(member, MFLAG_MUTE_DETECT))) {
-			uint32_t energy = 0, i = 0, samples = 0, j = 0;
+			uint32_t samples = 0;
 			int16_t *data;
 			int agc_period = (member->read_impl.actual_samples_per_second / member->read_impl.samples_per_packet) / 4;
 			
@@ -2544,13 +4077,9 @@ static void *SWITCH_THREAD_FUNC conference_loop_input(switch_thread_t *thread, v
 				switch_change_sln_volume_granular(read_frame->data, read_frame->datalen / 2, member->agc_volume_in_level);
 			}
 			
-			if ((samples = read_frame->datalen / sizeof(*data))) {
-				for (i = 0; i < samples; i++) {
-					energy += abs(data[j]);
-					j += member->read_impl.number_of_channels;
-				}
-				
-				member->score = energy / samples;
+			if ((samples = read_frame->datalen / sizeof(*data) / member->read_impl.number_of_channels)) {
+				member->score = switch_sln_energy(data, samples, member->read_impl.number_of_channels);
+				switch_sln_noise_floor_update(&member->noise_floor, member->score);
 			}
 
 			if (member->vol_period) {
@@ -2592,7 +4121,8 @@ static void *SWITCH_THREAD_FUNC conference_loop_input(switch_thread_t *thread, v
 				member->nt_tally++;
 			}
 
-			member->score_iir = (int) (((1.0 - SCORE_DECAY) * (float) member->score) + (SCORE_DECAY * (float) member->score_iir));
+			/* SCORE_DECAY of 0.8 in integer math */
+			member->score_iir = (member->score + 4 * member->score_iir) / 5;
 
 			if (member->score_iir > SCORE_MAX_IIR) {
 				member->score_iir = SCORE_MAX_IIR;
@@ -2692,16 +4222,20 @@ static void *SWITCH_THREAD_FUNC conference_loop_input(switch_thread_t *thread, v
 
 
 			if (datalen) {
-				switch_size_t ok = 1;
-
-				/* Write the audio into the input buffer */
-				switch_mutex_lock(member->audio_in_mutex);
-				ok = switch_buffer_write(member->audio_buffer, data, datalen);
-				switch_mutex_unlock(member->audio_in_mutex);
-				if (!ok) {
-					switch_mutex_unlock(member->read_mutex);
-					break;
+				/* Write the audio into the input buffer, if the conference thread has not drained it the oldest audio makes way */
+				if (switch_buffer_freespace(member->audio_buffer) < datalen) {
+					time_t now = switch_epoch_time_now(NULL);
+
+					member->input_dropped++;
+
+					if (now - member->input_dropped_logged >= CONF_INPUT_DROP_LOG_INTERVAL) {
+						switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(member->session), SWITCH_LOG_WARNING,
+										  "Conference %s member %u: input buffer full, %u frames dropped so far\n",
+										  member->conference->name, member->id, member->input_dropped);
+						member->input_dropped_logged = now;
+					}
 				}
+				switch_buffer_slide_write(member->audio_buffer, data, datalen);
 			}
 		}
 
@@ -2823,6 +4357,7 @@ static void conference_loop_output(conference_member_t *member)
 {
 	switch_channel_t *channel;
 	switch_frame_t write_frame = { 0 };
+	switch_frame_t shared_frame = { 0 };
 	uint8_t *data = NULL;
 	switch_timer_t timer = { 0 };
 	uint32_t interval;
@@ -2870,6 +4405,11 @@ static void conference_loop_output(conference_member_t *member)
 
 	write_frame.codec = &member->write_codec;
 
+	shared_frame.data = switch_core_session_alloc(member->session, SWITCH_RECOMMENDED_BUFFER_SIZE);
+	shared_frame.buflen = SWITCH_RECOMMENDED_BUFFER_SIZE;
+
+	conference_mix_group_join(member);
+
 	/* Start the input thread */
 	launch_conference_loop_input(member, switch_core_session_get_pool(member->session));
 
@@ -3012,6 +4552,21 @@ static void conference_loop_output(conference_member_t *member)
 			switch_ivr_dmachine_ping(member->dmachine, NULL);
 		}
 
+		if (member->mix_group) {
+			switch_codec_t *session_codec = switch_core_session_get_write_codec(member->session);
+
+			/* anything done to this member's audio alone (volume, files, bugs) needs its own mix */
+			int shared_ok = switch_test_flag(member, MFLAG_CAN_HEAR) && !member->volume_out_level && !member->fnode &&
+				session_codec && session_codec->implementation == member->mix_group->codec.implementation &&
+				!switch_core_media_bug_count(member->session, NULL);
+
+			if (shared_ok && !switch_test_flag(member, MFLAG_SHARED_OK)) {
+				switch_set_flag_locked(member, MFLAG_SHARED_OK);
+			} else if (!shared_ok && switch_test_flag(member, MFLAG_SHARED_OK)) {
+				switch_clear_flag_locked(member, MFLAG_SHARED_OK);
+			}
+		}
+
 		use_buffer = NULL;
 		mux_used = (uint32_t) switch_buffer_inuse(member->mux_buffer);
 		
@@ -3061,6 +4616,13 @@ static void conference_loop_output(conference_member_t *member)
 			}
 
 			switch_mutex_unlock(member->audio_out_mutex);
+		} else if (switch_test_flag(member, MFLAG_SHARED_MIX) && conference_mix_group_read(member, &shared_frame)) {
+			/* already encoded for every listener on this codec, the core passes it straight through */
+			shared_frame.timestamp = timer.samplecount;
+			if (switch_core_session_write_frame(member->session, &shared_frame, SWITCH_IO_FLAG_NONE, 0) != SWITCH_STATUS_SUCCESS) {
+				switch_channel_hangup(channel, SWITCH_CAUSE_DESTINATION_OUT_OF_ORDER);
+				break;
+			}
 		} else if (member->fnode) {
 			write_frame.datalen = bytes;
 			write_frame.samples = samples;
@@ -3098,99 +4660,331 @@ static void conference_loop_output(conference_member_t *member)
 			switch_clear_flag_locked(member, MFLAG_FLUSH_BUFFER);
 		}
 
-		switch_mutex_unlock(member->write_mutex);
+		switch_mutex_unlock(member->write_mutex);
+
+
+		if (switch_test_flag(member, MFLAG_INDICATE_MUTE)) {
+			if (!zstr(member->conference->muted_sound)) {
+				conference_member_play_file(member, member->conference->muted_sound, 0);
+			} else {
+				char msg[512];
+				
+				switch_snprintf(msg, sizeof(msg), "Muted");
+				conference_member_say(member, msg, 0);
+			}
+			switch_clear_flag(member, MFLAG_INDICATE_MUTE);
+		}
+
+		if (switch_test_flag(member, MFLAG_INDICATE_MUTE_DETECT)) {
+			if (!zstr(member->conference->mute_detect_sound)) {
+				conference_member_play_file(member, member->conference->mute_detect_sound, 0);
+			} else {
+				char msg[512];
+				
+				switch_snprintf(msg, sizeof(msg), "Currently Muted");
+				conference_member_say(member, msg, 0);
+			}
+			switch_clear_flag(member, MFLAG_INDICATE_MUTE_DETECT);
+		}
+		
+		if (switch_test_flag(member, MFLAG_INDICATE_UNMUTE)) {
+			if (!zstr(member->conference->unmuted_sound)) {
+				conference_member_play_file(member, member->conference->unmuted_sound, 0);
+			} else {
+				char msg[512];
+				
+				switch_snprintf(msg, sizeof(msg), "Un-Muted");
+				conference_member_say(member, msg, 0);
+			}
+			switch_clear_flag(member, MFLAG_INDICATE_UNMUTE);
+		}
+
+		if (switch_core_session_private_event_count(member->session)) {
+			switch_channel_set_app_flag(channel, CF_APP_TAGGED);
+			switch_ivr_parse_all_events(member->session);
+			switch_channel_clear_app_flag(channel, CF_APP_TAGGED);
+			switch_set_flag_locked(member, MFLAG_FLUSH_BUFFER);
+			switch_core_session_set_read_codec(member->session, &member->read_codec);
+		} else {
+			switch_ivr_parse_all_messages(member->session);
+		}
+
+		if (use_timer) {
+			switch_core_timer_next(&timer);
+		} else {
+			switch_cond_next();
+		}
+
+	} /* Rinse ... Repeat */
+
+ end:
+
+	switch_clear_flag_locked(member, MFLAG_RUNNING);
+	switch_core_timer_destroy(&timer);
+	conference_mix_group_leave(member);
+
+	switch_log_printf(SWITCH_CHANNEL_CHANNEL_LOG(channel), SWITCH_LOG_DEBUG, "Channel leaving conference, cause: %s\n",
+					  switch_channel_cause2str(switch_channel_get_cause(channel)));
+
+	/* if it's an outbound channel, store the release cause in the conference struct, we might need it */
+	if (switch_channel_direction(channel) == SWITCH_CALL_DIRECTION_OUTBOUND) {
+		member->conference->bridge_hangup_cause = switch_channel_get_cause(channel);
+	}
+
+	/* Wait for the input thread to end */
+	while (switch_test_flag(member, MFLAG_ITHREAD)) {
+		switch_cond_next();
+	}
+}
+
+static char *conference_record_segment_path(conference_record_t *rec)
+{
+	const char *slash, *dot;
+
+	if (!rec->segment_time) {
+		return rec->path;
+	}
+
+	/* rec.wav becomes rec-0001.wav, rec-0002.wav ... */
+	if (!(slash = strrchr(rec->path, '/'))) {
+		slash = rec->path;
+	}
+
+	if ((dot = strrchr(slash, '.'))) {
+		return switch_core_sprintf(rec->pool, "%.*s-%04u%s", (int) (dot - rec->path), rec->path, rec->segment, dot);
+	}
+
+	return switch_core_sprintf(rec->pool, "%s-%04u", rec->path, rec->segment);
+}
+
+static switch_status_t conference_record_open(conference_record_t *rec)
+{
+	conference_obj_t *conference = rec->conference;
+	switch_bool_t paused = switch_test_flag((&rec->fh), SWITCH_FILE_PAUSE) ? SWITCH_TRUE : SWITCH_FALSE;
+	char *vval;
+
+	memset(&rec->fh, 0, sizeof(rec->fh));
+	rec->fh.channels = 1;
+	rec->fh.samplerate = conference->rate;
+	rec->fh.pre_buffer_datalen = SWITCH_DEFAULT_FILE_BUFFER_LEN;
+	rec->segment_path = conference_record_segment_path(rec);
+	rec->segment_samples = 0;
+
+	if (switch_core_file_open(&rec->fh,
+							  rec->segment_path, (uint8_t) 1, conference->rate, SWITCH_FILE_FLAG_WRITE | SWITCH_FILE_DATA_SHORT,
+							  rec->pool) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error Opening File [%s]\n", rec->segment_path);
+		return SWITCH_STATUS_FALSE;
+	}
+
+	/* a paused recording stays paused across segments */
+	if (paused) {
+		switch_set_flag((&rec->fh), SWITCH_FILE_PAUSE);
+	}
+
+	if ((vval = switch_mprintf("Conference %s", conference->name))) {
+		switch_core_file_set_string(&rec->fh, SWITCH_AUDIO_COL_STR_TITLE, vval);
+		switch_safe_free(vval);
+	}
+
+	switch_core_file_set_string(&rec->fh, SWITCH_AUDIO_COL_STR_ARTIST, "FreeSWITCH mod_conference Software Conference Module");
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+/* Close the current segment and start the next one */
+static void conference_record_rotate(conference_record_t *rec)
+{
+	conference_obj_t *conference = rec->conference;
+	switch_event_t *event;
+	char *done = rec->segment_path;
+	switch_status_t status;
+
+	/* the record thread reads the handle's flags, keep it from seeing the handle half initialized */
+	switch_mutex_lock(rec->fh_mutex);
+	switch_core_file_close(&rec->fh);
+	rec->segment++;
+	status = conference_record_open(rec);
+	switch_mutex_unlock(rec->fh_mutex);
+
+	if (status != SWITCH_STATUS_SUCCESS) {
+		rec->failed = 1;
+		return;
+	}
+
+	if (test_eflag(conference, EFLAG_RECORD) &&
+		switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CONF_EVENT_MAINT) == SWITCH_STATUS_SUCCESS) {
+		conference_add_event_data(conference, event);
+		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Action", "record-segment");
+		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Path", rec->path);
+		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Closed-Segment", done);
+		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Segment", rec->segment_path);
+		switch_event_fire(&event);
+	}
+}
+
+static void conference_record_dropped(conference_record_t *rec, switch_size_t samples)
+{
+	switch_mutex_lock(rec->mutex);
+	rec->samples_dropped += samples;
+	switch_mutex_unlock(rec->mutex);
+}
+
+/* Encode everything the capture side has queued, only ever run by one thread at a time for a recording */
+static void conference_record_drain(conference_record_t *rec, int16_t *buf, switch_size_t buflen)
+{
+	switch_size_t segment_len = (switch_size_t) rec->segment_time * rec->conference->rate;
+
+	for (;;) {
+		switch_size_t want = buflen, len;
+		uint32_t rlen;
+
+		if (segment_len && !rec->failed) {
+			if (rec->segment_samples >= segment_len) {
+				conference_record_rotate(rec);
+			}
+
+			if ((segment_len - rec->segment_samples) * sizeof(int16_t) < want) {
+				want = (segment_len - rec->segment_samples) * sizeof(int16_t);
+			}
+		}
+
+		if (!(rlen = (uint32_t) switch_buffer_read(rec->ring, buf, want))) {
+			break;
+		}
+
+		len = (switch_size_t) rlen / sizeof(int16_t);
+
+		if (rec->failed) {
+			conference_record_dropped(rec, len);
+			continue;
+		}
+
+		if (switch_core_file_write(&rec->fh, buf, &len) != SWITCH_STATUS_SUCCESS) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Write Failed\n");
+			rec->failed = 1;
+			continue;
+		}
+
+		rec->samples_written += len;
+		rec->segment_samples += len;
+	}
+}
 
+static void *SWITCH_THREAD_FUNC conference_record_encoder_run(switch_thread_t *thread, void *obj)
+{
+	int16_t buf[CONF_RECORD_CHUNK];
+	void *pop;
 
-		if (switch_test_flag(member, MFLAG_INDICATE_MUTE)) {
-			if (!zstr(member->conference->muted_sound)) {
-				conference_member_play_file(member, member->conference->muted_sound, 0);
-			} else {
-				char msg[512];
-				
-				switch_snprintf(msg, sizeof(msg), "Muted");
-				conference_member_say(member, msg, 0);
-			}
-			switch_clear_flag(member, MFLAG_INDICATE_MUTE);
-		}
+	while (switch_queue_pop(globals.record_queue, &pop) == SWITCH_STATUS_SUCCESS) {
+		conference_record_t *rec = (conference_record_t *) pop;
 
-		if (switch_test_flag(member, MFLAG_INDICATE_MUTE_DETECT)) {
-			if (!zstr(member->conference->mute_detect_sound)) {
-				conference_member_play_file(member, member->conference->mute_detect_sound, 0);
-			} else {
-				char msg[512];
-				
-				switch_snprintf(msg, sizeof(msg), "Currently Muted");
-				conference_member_say(member, msg, 0);
-			}
-			switch_clear_flag(member, MFLAG_INDICATE_MUTE_DETECT);
+		if (!rec) {
+			break;
 		}
-		
-		if (switch_test_flag(member, MFLAG_INDICATE_UNMUTE)) {
-			if (!zstr(member->conference->unmuted_sound)) {
-				conference_member_play_file(member, member->conference->unmuted_sound, 0);
-			} else {
-				char msg[512];
-				
-				switch_snprintf(msg, sizeof(msg), "Un-Muted");
-				conference_member_say(member, msg, 0);
+
+		conference_record_drain(rec, buf, sizeof(buf));
+
+		/* the record thread may free rec as soon as it sees this */
+		switch_mutex_lock(rec->mutex);
+		rec->queued = 0;
+		switch_mutex_unlock(rec->mutex);
+	}
+
+	return NULL;
+}
+
+/* Grow the encoder pool to count threads, it never shrinks before the module unloads */
+static void conference_record_encoders_start(uint32_t count)
+{
+	switch_threadattr_t *thd_attr = NULL;
+
+	if (count > CONF_RECORD_MAX_ENCODERS) {
+		count = CONF_RECORD_MAX_ENCODERS;
+	}
+
+	switch_mutex_lock(globals.record_mutex);
+	if (globals.record_encoder_count < count) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Starting %u more recording encoders\n", count - globals.record_encoder_count);
+		switch_threadattr_create(&thd_attr, globals.conference_pool);
+		switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+		while (globals.record_encoder_count < count) {
+			if (switch_thread_create(&globals.record_encoders[globals.record_encoder_count], thd_attr, conference_record_encoder_run, NULL,
+									 globals.conference_pool) != SWITCH_STATUS_SUCCESS) {
+				break;
 			}
-			switch_clear_flag(member, MFLAG_INDICATE_UNMUTE);
+			globals.record_encoder_count++;
 		}
+	}
+	switch_mutex_unlock(globals.record_mutex);
+}
 
-		if (switch_core_session_private_event_count(member->session)) {
-			switch_channel_set_app_flag(channel, CF_APP_TAGGED);
-			switch_ivr_parse_all_events(member->session);
-			switch_channel_clear_app_flag(channel, CF_APP_TAGGED);
-			switch_set_flag_locked(member, MFLAG_FLUSH_BUFFER);
-			switch_core_session_set_read_codec(member->session, &member->read_codec);
-		} else {
-			switch_ivr_parse_all_messages(member->session);
+/* Hand a recording with pending audio to the encoder pool unless it is already there */
+static void conference_record_kick(conference_record_t *rec)
+{
+	switch_mutex_lock(rec->mutex);
+	if (!rec->queued) {
+		if (switch_queue_trypush(globals.record_queue, rec) == SWITCH_STATUS_SUCCESS) {
+			rec->queued = 1;
 		}
+	}
+	switch_mutex_unlock(rec->mutex);
+}
 
-		if (use_timer) {
-			switch_core_timer_next(&timer);
-		} else {
-			switch_cond_next();
-		}
+/* Wait until no encoder works on the recording or will pick it up */
+static void conference_record_wait_idle(conference_record_t *rec)
+{
+	for (;;) {
+		int queued;
 
-	} /* Rinse ... Repeat */
+		switch_mutex_lock(rec->mutex);
+		queued = rec->queued;
+		switch_mutex_unlock(rec->mutex);
 
- end:
+		if (!queued) {
+			break;
+		}
 
-	switch_clear_flag_locked(member, MFLAG_RUNNING);
-	switch_core_timer_destroy(&timer);
+		switch_yield(10000);
+	}
+}
 
-	switch_log_printf(SWITCH_CHANNEL_CHANNEL_LOG(channel), SWITCH_LOG_DEBUG, "Channel leaving conference, cause: %s\n",
-					  switch_channel_cause2str(switch_channel_get_cause(channel)));
+/* Queue captured audio for the encoders, a full backlog drops it and counts it */
+static void conference_record_capture(conference_record_t *rec, int16_t *data, switch_size_t len)
+{
+	switch_size_t backlog;
 
-	/* if it's an outbound channel, store the release cause in the conference struct, we might need it */
-	if (switch_channel_direction(channel) == SWITCH_CALL_DIRECTION_OUTBOUND) {
-		member->conference->bridge_hangup_cause = switch_channel_get_cause(channel);
+	if (!switch_buffer_write(rec->ring, data, len * sizeof(int16_t))) {
+		conference_record_dropped(rec, len);
 	}
 
-	/* Wait for the input thread to end */
-	while (switch_test_flag(member, MFLAG_ITHREAD)) {
-		switch_cond_next();
+	backlog = switch_buffer_inuse(rec->ring) / sizeof(int16_t);
+	if (backlog > rec->backlog_max) {
+		rec->backlog_max = backlog;
 	}
 }
 
-/* Sub-Routine called by a record entity inside a conference */
+/* Sub-Routine called by a record entity inside a conference.
+   This thread only moves the mix from the member's mux ring into the recording's backlog ring on the conference clock,
+   filling gaps with silence. Writing and encoding the file happens on the encoder pool (conference_record_encoder_run)
+   so a slow codec or disk can fall behind by up to CONF_RECORD_BACKLOG seconds before audio is dropped.
+ */
 static void *SWITCH_THREAD_FUNC conference_record_thread_run(switch_thread_t *thread, void *obj)
 {
 	int16_t *data_buf;
-	switch_file_handle_t fh = { 0 };
 	conference_member_t smember = { 0 }, *member;
 	conference_record_t *rec = (conference_record_t *) obj;
 	conference_obj_t *conference = rec->conference;
 	uint32_t samples = switch_samples_per_packet(conference->rate, conference->interval);
 	uint32_t mux_used;
-	char *vval;
 	switch_timer_t timer = { 0 };
 	uint32_t rlen;
 	switch_size_t data_buf_len;
 	switch_event_t *event;
 	int no_data = 0;
 	int lead_in = 20;
+	int batch = 0;
+	int paused = 0;
 	switch_size_t len = 0;
 
 	data_buf_len = samples * sizeof(int16_t);
@@ -3214,8 +5008,7 @@ static void *SWITCH_THREAD_FUNC conference_record_thread_run(switch_thread_t *th
 	member->native_rate = conference->rate;
 	member->rec_path = rec->path;
 	member->rec_time = switch_epoch_time_now(NULL);
-	fh.channels = 1;
-	fh.samplerate = conference->rate;
+	member->rec = rec;
 	member->id = next_member_id();
 	member->pool = rec->pool;
 
@@ -3231,30 +5024,33 @@ static void *SWITCH_THREAD_FUNC conference_record_thread_run(switch_thread_t *th
 	switch_mutex_init(&member->audio_out_mutex, SWITCH_MUTEX_NESTED, rec->pool);
 	switch_mutex_init(&member->read_mutex, SWITCH_MUTEX_NESTED, rec->pool);
 	switch_thread_rwlock_create(&member->rwlock, rec->pool);
+	switch_mutex_init(&rec->mutex, SWITCH_MUTEX_NESTED, rec->pool);
+	switch_mutex_init(&rec->fh_mutex, SWITCH_MUTEX_NESTED, rec->pool);
 
 	/* Setup an audio buffer for the incoming audio */
-	if (switch_buffer_create_dynamic(&member->audio_buffer, CONF_DBLOCK_SIZE, CONF_DBUFFER_SIZE, 0) != SWITCH_STATUS_SUCCESS) {
+	if (switch_buffer_create_ring(NULL, &member->audio_buffer, CONF_DBUFFER_SIZE) != SWITCH_STATUS_SUCCESS) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Memory Error Creating Audio Buffer!\n");
 		goto end;
 	}
 
 	/* Setup an audio buffer for the outgoing audio */
-	if (switch_buffer_create_dynamic(&member->mux_buffer, CONF_DBLOCK_SIZE, CONF_DBUFFER_SIZE, 0) != SWITCH_STATUS_SUCCESS) {
+	if (switch_buffer_create_ring(NULL, &member->mux_buffer, CONF_DBUFFER_SIZE) != SWITCH_STATUS_SUCCESS) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Memory Error Creating Audio Buffer!\n");
 		goto end;
 	}
 
+	/* Setup the backlog between this thread and the encoders */
+	if (switch_buffer_create_ring(NULL, &rec->ring, (switch_size_t) conference->rate * sizeof(int16_t) * CONF_RECORD_BACKLOG) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Memory Error Creating Record Buffer!\n");
+		goto end;
+	}
+
 	if (conference_add_member(conference, member) != SWITCH_STATUS_SUCCESS) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error Joining Conference\n");
 		goto end;
 	}
 
-	fh.pre_buffer_datalen = SWITCH_DEFAULT_FILE_BUFFER_LEN;
-
-	if (switch_core_file_open(&fh,
-							  rec->path, (uint8_t) 1, conference->rate, SWITCH_FILE_FLAG_WRITE | SWITCH_FILE_DATA_SHORT,
-							  rec->pool) != SWITCH_STATUS_SUCCESS) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error Opening File [%s]\n", rec->path);
+	if (conference_record_open(rec) != SWITCH_STATUS_SUCCESS) {
 		goto end;
 	}
 
@@ -3266,13 +5062,6 @@ static void *SWITCH_THREAD_FUNC conference_record_thread_run(switch_thread_t *th
 		goto end;
 	}
 
-	if ((vval = switch_mprintf("Conference %s", conference->name))) {
-		switch_core_file_set_string(&fh, SWITCH_AUDIO_COL_STR_TITLE, vval);
-		switch_safe_free(vval);
-	}
-
-	switch_core_file_set_string(&fh, SWITCH_AUDIO_COL_STR_ARTIST, "FreeSWITCH mod_conference Software Conference Module");
-
 	if (test_eflag(conference, EFLAG_RECORD) &&
 			switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CONF_EVENT_MAINT) == SWITCH_STATUS_SUCCESS) {
 		conference_add_event_data(conference, event);
@@ -3297,6 +5086,7 @@ static void *SWITCH_THREAD_FUNC conference_record_thread_run(switch_thread_t *th
 				switch_mutex_lock(member->audio_out_mutex);
 				switch_buffer_zero(member->mux_buffer);
 				switch_mutex_unlock(member->audio_out_mutex);
+				conference_record_dropped(rec, mux_used / sizeof(int16_t));
 				mux_used = 0;
 			}
 			switch_clear_flag_locked(member, MFLAG_FLUSH_BUFFER);
@@ -3304,13 +5094,19 @@ static void *SWITCH_THREAD_FUNC conference_record_thread_run(switch_thread_t *th
 
 	again:
 
-		if (switch_test_flag((&fh), SWITCH_FILE_PAUSE)) {
+		/* while an encoder opens the next segment keep the last answer instead of waiting on the disk */
+		if (switch_mutex_trylock(rec->fh_mutex) == SWITCH_STATUS_SUCCESS) {
+			paused = switch_test_flag((&rec->fh), SWITCH_FILE_PAUSE) ? 1 : 0;
+			switch_mutex_unlock(rec->fh_mutex);
+		}
+
+		if (paused) {
 			switch_set_flag_locked(member, MFLAG_FLUSH_BUFFER);
 			goto loop;
 		}
 
 		if (mux_used >= data_buf_len) {
-			/* Flush the output buffer and write all the data (presumably muxed) to the file */
+			/* Flush the output buffer and queue all the data (presumably muxed) for the file */
 			switch_mutex_lock(member->audio_out_mutex);
 			//low_count = 0;
 
@@ -3336,8 +5132,14 @@ static void *SWITCH_THREAD_FUNC conference_record_thread_run(switch_thread_t *th
 			len = (switch_size_t) samples;
 		}
 
-		if (!len || switch_core_file_write(&fh, data_buf, &len) != SWITCH_STATUS_SUCCESS) {
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Write Failed\n");
+		conference_record_capture(rec, data_buf, len);
+
+		if (++batch >= CONF_RECORD_BATCH) {
+			batch = 0;
+			conference_record_kick(rec);
+		}
+
+		if (rec->failed) {
 			switch_clear_flag_locked(member, MFLAG_RUNNING);
 		}
 		
@@ -3348,17 +5150,27 @@ static void *SWITCH_THREAD_FUNC conference_record_thread_run(switch_thread_t *th
 
   end:
 
-	while(!no_data) {
+	while(!no_data && member->mux_buffer && rec->ring) {
 		switch_mutex_lock(member->audio_out_mutex);
 		if ((rlen = (uint32_t) switch_buffer_read(member->mux_buffer, data_buf, data_buf_len))) {
 			len = (switch_size_t) rlen / sizeof(int16_t);
-			switch_core_file_write(&fh, data_buf, &len);
+			conference_record_capture(rec, data_buf, len);
 		} else {
 			no_data = 1;
 		}
 		switch_mutex_unlock(member->audio_out_mutex);
 	}
 
+	/* let the encoders finish, whatever they left behind is written from here */
+	if (rec->mutex) {
+		conference_record_wait_idle(rec);
+	}
+
+	if (rec->ring && switch_test_flag((&rec->fh), SWITCH_FILE_OPEN)) {
+		int16_t buf[CONF_RECORD_CHUNK];
+		conference_record_drain(rec, buf, sizeof(buf));
+	}
+
 	conference->is_recording = 0;
 	
 	switch_safe_free(data_buf);
@@ -3367,15 +5179,22 @@ static void *SWITCH_THREAD_FUNC conference_record_thread_run(switch_thread_t *th
 
 	switch_buffer_destroy(&member->audio_buffer);
 	switch_buffer_destroy(&member->mux_buffer);
+	switch_buffer_destroy(&rec->ring);
 	switch_clear_flag_locked(member, MFLAG_RUNNING);
-	if (switch_test_flag((&fh), SWITCH_FILE_OPEN)) {
-		switch_core_file_close(&fh);
+	if (switch_test_flag((&rec->fh), SWITCH_FILE_OPEN)) {
+		switch_core_file_close(&rec->fh);
 	}
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Recording of %s Stopped\n", rec->path);
 	if (switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CONF_EVENT_MAINT) == SWITCH_STATUS_SUCCESS) {
 		conference_add_event_data(conference, event);
 		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Action", "stop-recording");
 		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Path", rec->path);
+		switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Samples-Written", "%" SWITCH_SIZE_T_FMT, rec->samples_written);
+		switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Samples-Dropped", "%" SWITCH_SIZE_T_FMT, rec->samples_dropped);
+		switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Backlog-Max", "%" SWITCH_SIZE_T_FMT, rec->backlog_max);
+		if (rec->segment_time) {
+			switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Segments", "%u", rec->segment + 1);
+		}
 		switch_event_fire(&event);
 	}
 
@@ -3461,11 +5280,16 @@ static uint32_t conference_member_stop_file(conference_member_t *member, file_st
 static void conference_send_all_dtmf(conference_member_t *member, conference_obj_t *conference, const char *dtmf)
 {
 	conference_member_t *imember;
+	conference_member_snapshot_t *snap;
+	uint32_t i;
 
-	switch_mutex_lock(conference->mutex);
-	switch_mutex_lock(conference->member_mutex);
+	if (!(snap = conference_member_snapshot_get(conference))) {
+		return;
+	}
+
+	for (i = 0; i < snap->count; i++) {
+		imember = snap->members[i];
 
-	for (imember = conference->members; imember; imember = imember->next) {
 		/* don't send to self */
 		if (imember->id == member->id) {
 			continue;
@@ -3482,8 +5306,7 @@ static void conference_send_all_dtmf(conference_member_t *member, conference_obj
 		}
 	}
 
-	switch_mutex_unlock(conference->member_mutex);
-	switch_mutex_unlock(conference->mutex);
+	conference_member_snapshot_release(conference, snap);
 }
 
 /* Play a file in the conference room */
@@ -3860,13 +5683,19 @@ static switch_status_t conference_say(conference_obj_t *conference, const char *
 static void conference_member_itterator(conference_obj_t *conference, switch_stream_handle_t *stream, uint8_t non_mod, conf_api_member_cmd_t pfncallback, void *data)
 {
 	conference_member_t *member = NULL;
+	conference_member_snapshot_t *snap;
+	uint32_t i;
 
 	switch_assert(conference != NULL);
 	switch_assert(stream != NULL);
 	switch_assert(pfncallback != NULL);
 
-	switch_mutex_lock(conference->member_mutex);
-	for (member = conference->members; member; member = member->next) {
+	if (!(snap = conference_member_snapshot_get(conference))) {
+		return;
+	}
+
+	for (i = 0; i < snap->count; i++) {
+		member = snap->members[i];
 		if (!(non_mod && switch_test_flag(member, MFLAG_MOD))) {
 			if (member->session && !switch_test_flag(member, MFLAG_NOCHANNEL)) {
 				pfncallback(member, stream, data);
@@ -3875,7 +5704,8 @@ static void conference_member_itterator(conference_obj_t *conference, switch_str
 			stream->write_function(stream, "Skipping moderator (member id %d).\n", member->id);
 		}	
 	}
-	switch_mutex_unlock(conference->member_mutex);
+
+	conference_member_snapshot_release(conference, snap);
 }
 
 
@@ -3905,16 +5735,22 @@ static switch_status_t list_conferences(const char *line, const char *cursor, sw
 static void conference_list_pretty(conference_obj_t *conference, switch_stream_handle_t *stream)
 {
 	conference_member_t *member = NULL;
+	conference_member_snapshot_t *snap;
+	uint32_t i;
 
 	switch_assert(conference != NULL);
 	switch_assert(stream != NULL);
 
-	switch_mutex_lock(conference->member_mutex);
+	if (!(snap = conference_member_snapshot_get(conference))) {
+		return;
+	}
 
-	for (member = conference->members; member; member = member->next) {
+	for (i = 0; i < snap->count; i++) {
 		switch_channel_t *channel;
 		switch_caller_profile_t *profile;
 
+		member = snap->members[i];
+
 		if (switch_test_flag(member, MFLAG_NOCHANNEL)) {
 			continue;
 		}
@@ -3924,26 +5760,32 @@ static void conference_list_pretty(conference_obj_t *conference, switch_stream_h
 		stream->write_function(stream, "%u) %s (%s)\n", member->id, profile->caller_id_name, profile->caller_id_number);
 	}
 
-	switch_mutex_unlock(conference->member_mutex);
+	conference_member_snapshot_release(conference, snap);
 }
 
 static void conference_list(conference_obj_t *conference, switch_stream_handle_t *stream, char *delim)
 {
 	conference_member_t *member = NULL;
+	conference_member_snapshot_t *snap;
+	uint32_t i;
 
 	switch_assert(conference != NULL);
 	switch_assert(stream != NULL);
 	switch_assert(delim != NULL);
 
-	switch_mutex_lock(conference->member_mutex);
+	if (!(snap = conference_member_snapshot_get(conference))) {
+		return;
+	}
 
-	for (member = conference->members; member; member = member->next) {
+	for (i = 0; i < snap->count; i++) {
 		switch_channel_t *channel;
 		switch_caller_profile_t *profile;
 		char *uuid;
 		char *name;
 		uint32_t count = 0;
 
+		member = snap->members[i];
+
 		if (switch_test_flag(member, MFLAG_NOCHANNEL)) {
 			continue;
 		}
@@ -3981,6 +5823,11 @@ static void conference_list(conference_obj_t *conference, switch_stream_handle_t
 			count++;
 		}
 
+		if (member->active_speaker) {
+			stream->write_function(stream, "%s%s", count ? "|" : "", "active");
+			count++;
+		}
+
 		stream->write_function(stream, "%s%d%s%d%s%d%s%d\n", delim,
 							   member->volume_in_level, 
 							   delim,
@@ -3988,7 +5835,7 @@ static void conference_list(conference_obj_t *conference, switch_stream_handle_t
 							   delim, member->volume_out_level, delim, member->energy_level);
 	}
 
-	switch_mutex_unlock(conference->member_mutex);
+	conference_member_snapshot_release(conference, snap);
 }
 
 static void conference_list_count_only(conference_obj_t *conference, switch_stream_handle_t *stream)
@@ -4303,6 +6150,138 @@ static switch_status_t conf_api_sub_volume_out(conference_member_t *member, swit
 	return SWITCH_STATUS_SUCCESS;
 }
 
+/* Compare per member N-1 mixing and encoding with the shared mix for rooms of 10, 100 and 1000 PCMU members */
+static switch_status_t conf_api_mix_bench(switch_stream_handle_t *stream, int argc, char **argv)
+{
+	uint32_t sizes[] = { 10, 100, 1000 };
+	uint32_t talkers = 3, seconds = 10, ticks, i, t, m, x, samples, bytes, seed = 0x5eed;
+	switch_codec_t codec = { 0 };
+	int16_t *talk = NULL;
+	int16_t write_frame[SWITCH_RECOMMENDED_BUFFER_SIZE / 2];
+	uint8_t encoded[SWITCH_RECOMMENDED_BUFFER_SIZE], fanout[SWITCH_RECOMMENDED_BUFFER_SIZE];
+	int32_t z;
+
+	if (argc > 1 && atoi(argv[1]) > 0) {
+		talkers = atoi(argv[1]);
+	}
+
+	if (argc > 2 && atoi(argv[2]) > 0) {
+		seconds = atoi(argv[2]);
+		if (seconds > 600) {
+			seconds = 600;
+		}
+	}
+
+	if (switch_core_codec_init(&codec, "PCMU", NULL, 8000, 20, 1, SWITCH_CODEC_FLAG_ENCODE | SWITCH_CODEC_FLAG_DECODE, NULL, NULL) != SWITCH_STATUS_SUCCESS) {
+		stream->write_function(stream, "-ERR cannot load PCMU\n");
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	samples = codec.implementation->samples_per_packet;
+	bytes = samples * 2;
+	ticks = seconds * 50;
+
+	if (!(talk = malloc(talkers * bytes))) {
+		stream->write_function(stream, "-ERR out of memory\n");
+		goto end;
+	}
+
+	for (x = 0; x < talkers * samples; x++) {
+		seed = seed * 1103515245 + 12345;
+		talk[x] = (int16_t) ((int) ((seed >> 16) % 8001) - 4000);
+	}
+
+	stream->write_function(stream, "%u ticks of 20ms PCMU, %u talkers\n", ticks, talkers);
+	stream->write_function(stream, "%-8s %-14s %-14s %-10s %-10s %s\n", "members", "n-1 usec", "shared usec", "n-1 enc", "shared enc", "speedup");
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		uint32_t members = sizes[i], active = talkers < members ? talkers : members;
+		switch_time_t start, legacy_usec, shared_usec;
+		uint32_t len, rate, legacy_enc = 0, shared_enc = 0;
+		unsigned int flag;
+
+		/* every member gets its own mix minus its own audio and its own encode */
+		start = switch_time_now();
+		for (t = 0; t < ticks; t++) {
+			int main_frame[SWITCH_RECOMMENDED_BUFFER_SIZE / 2] = { 0 };
+
+			for (m = 0; m < active; m++) {
+				for (x = 0; x < samples; x++) {
+					main_frame[x] += talk[m * samples + x];
+				}
+			}
+
+			for (m = 0; m < members; m++) {
+				for (x = 0; x < samples; x++) {
+					z = main_frame[x];
+					if (m < active) {
+						z -= talk[m * samples + x];
+					}
+					switch_normalize_to_16bit(z);
+					write_frame[x] = (int16_t) z;
+				}
+				len = sizeof(encoded);
+				rate = 8000;
+				flag = 0;
+				switch_core_codec_encode(&codec, NULL, write_frame, bytes, 8000, encoded, &len, &rate, &flag);
+				legacy_enc++;
+			}
+		}
+		legacy_usec = switch_time_now() - start;
+
+		/* talkers still get their own mix, everybody else copies the one shared encoded frame */
+		start = switch_time_now();
+		for (t = 0; t < ticks; t++) {
+			int main_frame[SWITCH_RECOMMENDED_BUFFER_SIZE / 2] = { 0 };
+			uint32_t shared_len;
+
+			for (m = 0; m < active; m++) {
+				for (x = 0; x < samples; x++) {
+					main_frame[x] += talk[m * samples + x];
+				}
+			}
+
+			for (m = 0; m < active; m++) {
+				for (x = 0; x < samples; x++) {
+					z = main_frame[x] - talk[m * samples + x];
+					switch_normalize_to_16bit(z);
+					write_frame[x] = (int16_t) z;
+				}
+				len = sizeof(encoded);
+				rate = 8000;
+				flag = 0;
+				switch_core_codec_encode(&codec, NULL, write_frame, bytes, 8000, encoded, &len, &rate, &flag);
+				shared_enc++;
+			}
+
+			for (x = 0; x < samples; x++) {
+				z = main_frame[x];
+				switch_normalize_to_16bit(z);
+				write_frame[x] = (int16_t) z;
+			}
+			shared_len = sizeof(encoded);
+			rate = 8000;
+			flag = 0;
+			switch_core_codec_encode(&codec, NULL, write_frame, bytes, 8000, encoded, &shared_len, &rate, &flag);
+			shared_enc++;
+
+			for (m = active; m < members; m++) {
+				memcpy(fanout, encoded, shared_len);
+			}
+		}
+		shared_usec = switch_time_now() - start;
+
+		stream->write_function(stream, "%-8u %-14" SWITCH_TIME_T_FMT " %-14" SWITCH_TIME_T_FMT " %-10u %-10u %.1fx\n", members, legacy_usec, shared_usec,
+							   legacy_enc / ticks, shared_enc / ticks, shared_usec ? (double) legacy_usec / shared_usec : 0.0);
+	}
+
+  end:
+	switch_safe_free(talk);
+	switch_core_codec_destroy(&codec);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
 static switch_status_t conf_api_sub_list(conference_obj_t *conference, switch_stream_handle_t *stream, int argc, char **argv)
 {
 	int ret_status = SWITCH_STATUS_GENERR;
@@ -4344,10 +6323,11 @@ static switch_status_t conf_api_sub_list(conference_obj_t *conference, switch_st
 			switch_hash_this(hi, NULL, NULL, &val);
 			conference = (conference_obj_t *) val;
 
-			stream->write_function(stream, "Conference %s (%u member%s rate: %u%s)\n",
+			stream->write_function(stream, "Conference %s (%u member%s rate: %u%s mix: %u/%u/%uus late: %u)\n",
 								   conference->name,
 								   conference->count,
-								   conference->count == 1 ? "" : "s", conference->rate, switch_test_flag(conference, CFLAG_LOCKED) ? " locked" : "");
+								   conference->count == 1 ? "" : "s", conference->rate, switch_test_flag(conference, CFLAG_LOCKED) ? " locked" : "",
+								   conference->mix_time_last, conference->mix_time_avg, conference->mix_time_max, conference->mix_deadline_misses);
 			count++;
 			if (!summary) {
 				if (pretty) {
@@ -4400,6 +6380,8 @@ static switch_xml_t add_x_tag(switch_xml_t x_member, const char *name, const cha
 static void conference_xlist(conference_obj_t *conference, switch_xml_t x_conference, int off)
 {
 	conference_member_t *member = NULL;
+	conference_member_snapshot_t *snap;
+	uint32_t mi;
 	switch_xml_t x_member = NULL, x_members = NULL, x_flags;
 	int moff = 0;
 	char i[30] = "";
@@ -4466,6 +6448,21 @@ static void conference_xlist(conference_obj_t *conference, switch_xml_t x_confer
 	switch_snprintf(i, sizeof(i), "%d", switch_epoch_time_now(NULL) - conference->run_time);
 	switch_xml_set_attr_d(x_conference, "run_time", ival);
 
+	switch_snprintf(i, sizeof(i), "%u", conference->mix_threads > 1 && conference->mix_pool ? conference->mix_pool->thread_count + 1 : 1);
+	switch_xml_set_attr_d(x_conference, "mix_threads", ival);
+
+	switch_snprintf(i, sizeof(i), "%u", conference->mix_time_last);
+	switch_xml_set_attr_d(x_conference, "mix_time_last", ival);
+
+	switch_snprintf(i, sizeof(i), "%u", conference->mix_time_avg);
+	switch_xml_set_attr_d(x_conference, "mix_time_avg", ival);
+
+	switch_snprintf(i, sizeof(i), "%u", conference->mix_time_max);
+	switch_xml_set_attr_d(x_conference, "mix_time_max", ival);
+
+	switch_snprintf(i, sizeof(i), "%u", conference->mix_deadline_misses);
+	switch_xml_set_attr_d(x_conference, "mix_deadline_misses", ival);
+
 	if (conference->agc_level) {
 		char tmp[30] = "";
 		switch_snprintf(tmp, sizeof(tmp), "%d", conference->agc_level);
@@ -4475,9 +6472,9 @@ static void conference_xlist(conference_obj_t *conference, switch_xml_t x_confer
 	x_members = switch_xml_add_child_d(x_conference, "members", 0);
 	switch_assert(x_members);
 
-	switch_mutex_lock(conference->member_mutex);
+	snap = conference_member_snapshot_get(conference);
 
-	for (member = conference->members; member; member = member->next) {
+	for (mi = 0; snap && mi < snap->count; mi++) {
 		switch_channel_t *channel;
 		switch_caller_profile_t *profile;
 		char *uuid;
@@ -4487,6 +6484,8 @@ static void conference_xlist(conference_obj_t *conference, switch_xml_t x_confer
 		int toff = 0;
 		char tmp[50] = "";
 
+		member = snap->members[mi];
+
 		if (switch_test_flag(member, MFLAG_NOCHANNEL)) {
 			if (member->rec_path) {
 				x_member = switch_xml_add_child_d(x_members, "member", moff++);
@@ -4503,6 +6502,29 @@ static void conference_xlist(conference_obj_t *conference, switch_xml_t x_confer
 				switch_xml_set_attr_d(x_tag, "type", "UNIX-epoch");
 				switch_snprintf(i, sizeof(i), "%d", member->rec_time);
 				switch_xml_set_txt_d(x_tag, i);
+
+				if (member->rec) {
+					conference_record_t *rec = member->rec;
+
+					if (rec->segment_time && rec->segment_path) {
+						x_tag = switch_xml_add_child_d(x_member, "segment_path", count++);
+						switch_xml_set_txt_d(x_tag, rec->segment_path);
+					}
+
+					switch_snprintf(tmp, sizeof(tmp), "%" SWITCH_SIZE_T_FMT, rec->samples_written);
+					add_x_tag(x_member, "samples_written", tmp, count++);
+
+					switch_mutex_lock(rec->mutex);
+					switch_snprintf(tmp, sizeof(tmp), "%" SWITCH_SIZE_T_FMT, rec->samples_dropped);
+					switch_mutex_unlock(rec->mutex);
+					add_x_tag(x_member, "samples_dropped", tmp, count++);
+
+					switch_snprintf(tmp, sizeof(tmp), "%" SWITCH_SIZE_T_FMT, rec->ring ? switch_buffer_inuse(rec->ring) / sizeof(int16_t) : 0);
+					add_x_tag(x_member, "backlog_samples", tmp, count++);
+
+					switch_snprintf(tmp, sizeof(tmp), "%" SWITCH_SIZE_T_FMT, rec->backlog_max);
+					add_x_tag(x_member, "backlog_max", tmp, count++);
+				}
 			}
 			continue;
 		}
@@ -4560,6 +6582,9 @@ static void conference_xlist(conference_obj_t *conference, switch_xml_t x_confer
 		x_tag = switch_xml_add_child_d(x_flags, "has_floor", count++);
 		switch_xml_set_txt_d(x_tag, (member == member->conference->floor_holder) ? "true" : "false");
 
+		x_tag = switch_xml_add_child_d(x_flags, "active_speaker", count++);
+		switch_xml_set_txt_d(x_tag, member->active_speaker ? "true" : "false");
+
 		x_tag = switch_xml_add_child_d(x_flags, "is_moderator", count++);
 		switch_xml_set_txt_d(x_tag, switch_test_flag(member, MFLAG_MOD) ? "true" : "false");
 
@@ -4577,7 +6602,7 @@ static void conference_xlist(conference_obj_t *conference, switch_xml_t x_confer
 
 	}
 
-	switch_mutex_unlock(conference->member_mutex);
+	conference_member_snapshot_release(conference, snap);
 }
 static switch_status_t conf_api_sub_xml_list(conference_obj_t *conference, switch_stream_handle_t *stream, int argc, char **argv)
 {
@@ -4871,6 +6896,7 @@ static switch_status_t conf_api_sub_relate(conference_obj_t *conference, switch_
 				if (nohear) {
 					switch_clear_flag(rel, RFLAG_CAN_HEAR);
 				}
+				conference->relationship_gen++;
 				stream->write_function(stream, "ok %u->%u set\n", id, oid);
 			} else {
 				stream->write_function(stream, "error!\n");
@@ -4891,6 +6917,37 @@ static switch_status_t conf_api_sub_relate(conference_obj_t *conference, switch_
 	return SWITCH_STATUS_SUCCESS;
 }
 
+static switch_status_t conf_api_sub_cascade(conference_obj_t *conference, switch_stream_handle_t *stream, int argc, char **argv)
+{
+	switch_time_t now = switch_micro_time_now();
+	uint32_t i;
+
+	switch_assert(conference != NULL);
+	switch_assert(stream != NULL);
+
+	switch_mutex_lock(conference->cascade_mutex);
+
+	if (!conference->cascade_running) {
+		stream->write_function(stream, "Conference %s is not cascaded\n", conference->name);
+		switch_mutex_unlock(conference->cascade_mutex);
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	stream->write_function(stream, "Cascade %s node %08x sent %u\n", conference->cascade_local, globals.cascade_node_id, conference->cascade_tx_packets);
+
+	for (i = 0; i < conference->cascade_peer_count; i++) {
+		conference_cascade_peer_t *peer = &conference->cascade_peers[i];
+
+		stream->write_function(stream, "%s member %u talkers %u received %u lost %u dropped %u last %s%" SWITCH_TIME_T_FMT "ms\n",
+							   peer->name, peer->member ? peer->member->id : 0, peer->talkers, peer->rx_packets, peer->rx_lost, peer->rx_dropped,
+							   peer->last_rx ? "" : "never ", peer->last_rx ? (now - peer->last_rx) / 1000 : 0);
+	}
+
+	switch_mutex_unlock(conference->cascade_mutex);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
 static switch_status_t conf_api_sub_lock(conference_obj_t *conference, switch_stream_handle_t *stream, int argc, char **argv)
 {
 	switch_event_t *event;
@@ -5383,6 +7440,7 @@ static api_command_t conf_api_sub_commands[] = {
 	{"enter_sound", (void_fn_t) & conf_api_sub_enter_sound, CONF_API_SUB_ARGS_SPLIT, "enter_sound", "on|off|none|file <filename>"},
 	{"pin", (void_fn_t) & conf_api_sub_pin, CONF_API_SUB_ARGS_SPLIT, "pin", "<pin#>"},
 	{"nopin", (void_fn_t) & conf_api_sub_pin, CONF_API_SUB_ARGS_SPLIT, "nopin", ""},
+	{"cascade", (void_fn_t) & conf_api_sub_cascade, CONF_API_SUB_ARGS_SPLIT, "cascade", ""},
 	{"get", (void_fn_t) & conf_api_sub_get, CONF_API_SUB_ARGS_SPLIT, "get", "<parameter-name>"},
 	{"set", (void_fn_t) & conf_api_sub_set, CONF_API_SUB_ARGS_SPLIT, "set", "<parameter-name> <value>"},
 };
@@ -5435,16 +7493,15 @@ switch_status_t conf_api_dispatch(conference_obj_t *conference, switch_stream_ha
 					} else if (last) {
 						conference_member_t *member = NULL;
 						conference_member_t *last_member = NULL;
-
-						switch_mutex_lock(conference->member_mutex);
+						conference_member_snapshot_t *snap = conference_member_snapshot_get(conference);
+						uint32_t x;
 
 						/* find last (oldest) member */
-						member = conference->members;
-						while (member != NULL) {
+						for (x = 0; snap && x < snap->count; x++) {
+							member = snap->members[x];
 							if (last_member == NULL || member->id > last_member->id) {
 								last_member = member;
 							}
-							member = member->next;
 						}
 
 						/* exec functio on last (oldest) member */
@@ -5453,7 +7510,7 @@ switch_status_t conf_api_dispatch(conference_obj_t *conference, switch_stream_ha
 							pfn(last_member, stream, argv[argn + 2]);
 						}
 
-						switch_mutex_unlock(conference->member_mutex);
+						conference_member_snapshot_release(conference, snap);
 					} else if (id) {
 						conf_api_member_cmd_t pfn = (conf_api_member_cmd_t) conf_api_sub_commands[i].pfnapicmd;
 						conference_member_t *member = conference_member_get(conference, id);
@@ -5554,6 +7611,8 @@ SWITCH_STANDARD_API(conf_api_main)
 				conf_api_sub_list(NULL, stream, argc, argv);
 			} else if (strcasecmp(argv[0], "xml_list") == 0) {
 				conf_api_sub_xml_list(NULL, stream, argc, argv);
+			} else if (strcasecmp(argv[0], "mix_bench") == 0) {
+				conf_api_mix_bench(stream, argc, argv);
 			} else if (strcasecmp(argv[0], "help") == 0 || strcasecmp(argv[0], "commands") == 0) {
 				stream->write_function(stream, "%s\n", api_syntax);
 			} else if (argv[1] && strcasecmp(argv[1], "dial") == 0) {
@@ -5962,6 +8021,8 @@ static void set_cflags(const char *flags, uint32_t *f)
 				*f |= CFLAG_VID_FLOOR;
 			} else if (!strcasecmp(argv[i], "video-bridge")) {
 				*f |= CFLAG_VIDEO_BRIDGE;
+			} else if (!strcasecmp(argv[i], "shared-mix")) {
+				*f |= CFLAG_SHARED_MIX;
 			}
 		}		
 
@@ -6037,6 +8098,8 @@ static void clear_eflags(char *events, uint32_t *f)
 				*f &= ~EFLAG_FLOOR_CHANGE;
 			} else if (!strcmp(event, "record")) {
 				*f &= ~EFLAG_RECORD;
+			} else if (!strcmp(event, "active-speakers-change")) {
+				*f &= ~EFLAG_ACTIVE_SPEAKERS;
 			}
 
 			event = next;
@@ -6148,13 +8211,13 @@ static int setup_media(conference_member_t *member, conference_obj_t *conference
 	}
 
 	/* Setup an audio buffer for the incoming audio */
-	if (switch_buffer_create_dynamic(&member->audio_buffer, CONF_DBLOCK_SIZE, CONF_DBUFFER_SIZE, CONF_DBUFFER_MAX) != SWITCH_STATUS_SUCCESS) {
+	if (switch_buffer_create_ring(NULL, &member->audio_buffer, CONF_DBUFFER_SIZE) != SWITCH_STATUS_SUCCESS) {
 		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(member->session), SWITCH_LOG_CRIT, "Memory Error Creating Audio Buffer!\n");
 		goto codec_done1;
 	}
 
 	/* Setup an audio buffer for the outgoing audio */
-	if (switch_buffer_create_dynamic(&member->mux_buffer, CONF_DBLOCK_SIZE, CONF_DBUFFER_SIZE, CONF_DBUFFER_MAX) != SWITCH_STATUS_SUCCESS) {
+	if (switch_buffer_create_ring(NULL, &member->mux_buffer, CONF_DBUFFER_SIZE) != SWITCH_STATUS_SUCCESS) {
 		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(member->session), SWITCH_LOG_CRIT, "Memory Error Creating Audio Buffer!\n");
 		goto codec_done1;
 	}
@@ -6751,6 +8814,11 @@ static switch_thread_t *launch_thread_detached(switch_thread_start_t func, switc
 /* Create a video thread for the conference and launch it */
 static void launch_conference_video_thread(conference_obj_t *conference)
 {
+	if (!conference->video_train) {
+		switch_core_video_train_create(&conference->video_train, conference->pool);
+		switch_core_video_train_create(&conference->video_keyframe, conference->pool);
+	}
+
 	launch_thread_detached(conference_video_thread_run, conference->pool, conference);
 	conference->video_running = 1;
 }
@@ -6811,6 +8879,7 @@ static void launch_conference_record_thread(conference_obj_t *conference, char *
 	rec->conference = conference;
 	rec->path = switch_core_strdup(pool, path);
 	rec->pool = pool;
+	rec->segment_time = conference->record_segment_time;
 
 	switch_threadattr_create(&thd_attr, rec->pool);
 	switch_threadattr_detach_set(thd_attr, 1);
@@ -6930,6 +8999,7 @@ static conference_obj_t *conference_new(char *name, conf_xml_cfg_t cfg, switch_c
 	char *pin_sound = NULL;
 	char *bad_pin_sound = NULL;
 	char *energy_level = NULL;
+	char *noise_floor_ratio = NULL;
 	char *auto_gain_level = NULL;
 	char *caller_id_name = NULL;
 	char *caller_id_number = NULL;
@@ -6952,6 +9022,13 @@ static conference_obj_t *conference_new(char *name, conf_xml_cfg_t cfg, switch_c
 	char *auto_record = NULL;
 	char *conference_log_dir = NULL;
 	char *terminate_on_silence = NULL;
+	char *max_active_speakers = NULL;
+	char *mixer_threads = NULL;
+	char *record_encoder_threads = NULL;
+	char *record_segment_time = NULL;
+	char *cascade_local = NULL;
+	char *cascade_peers = NULL;
+	char *active_speaker_hold = NULL;
 	char *endconf_grace_time = NULL;
 	char uuid_str[SWITCH_UUID_FORMATTED_LENGTH+1];
 	switch_uuid_t uuid;
@@ -7102,6 +9179,8 @@ static conference_obj_t *conference_new(char *name, conf_xml_cfg_t cfg, switch_c
 				bad_pin_sound = val;
 			} else if (!strcasecmp(var, "energy-level") && !zstr(val)) {
 				energy_level = val;
+			} else if (!strcasecmp(var, "noise-floor-ratio") && !zstr(val)) {
+				noise_floor_ratio = val;
 			} else if (!strcasecmp(var, "auto-gain-level") && !zstr(val)) {
 				auto_gain_level = val;
 			} else if (!strcasecmp(var, "caller-id-name") && !zstr(val)) {
@@ -7162,6 +9241,20 @@ static conference_obj_t *conference_new(char *name, conf_xml_cfg_t cfg, switch_c
 				auto_record = val;
 			} else if (!strcasecmp(var, "terminate-on-silence") && !zstr(val)) {
 				terminate_on_silence = val;
+			} else if (!strcasecmp(var, "cascade-local") && !zstr(val)) {
+				cascade_local = val;
+			} else if (!strcasecmp(var, "cascade-peers") && !zstr(val)) {
+				cascade_peers = val;
+			} else if (!strcasecmp(var, "record-segment-time") && !zstr(val)) {
+				record_segment_time = val;
+			} else if (!strcasecmp(var, "mixer-threads") && !zstr(val)) {
+				mixer_threads = val;
+			} else if (!strcasecmp(var, "record-encoder-threads") && !zstr(val)) {
+				record_encoder_threads = val;
+			} else if (!strcasecmp(var, "max-active-speakers") && !zstr(val)) {
+				max_active_speakers = val;
+			} else if (!strcasecmp(var, "active-speaker-hold") && !zstr(val)) {
+				active_speaker_hold = val;
 			} else if (!strcasecmp(var, "endconf-grace-time") && !zstr(val)) {
 				endconf_grace_time = val;
 			}
@@ -7344,6 +9437,12 @@ static conference_obj_t *conference_new(char *name, conf_xml_cfg_t cfg, switch_c
 		}
 	}
 
+	conference->noise_floor_ratio = CONF_DEFAULT_NOISE_FLOOR_RATIO;
+	if (!zstr(noise_floor_ratio)) {
+		int tmp = atoi(noise_floor_ratio);
+		conference->noise_floor_ratio = tmp > 0 ? tmp : 0;
+	}
+
 	if (!zstr(auto_gain_level)) {
 		int level = 0;
 
@@ -7395,6 +9494,46 @@ static conference_obj_t *conference_new(char *name, conf_xml_cfg_t cfg, switch_c
 	if (!zstr(terminate_on_silence)) {
 		conference->terminate_on_silence = atoi(terminate_on_silence);
 	}
+	if (!zstr(max_active_speakers)) {
+		int tmp = atoi(max_active_speakers);
+		conference->max_active_speakers = tmp > 0 ? tmp : 0;
+	}
+	conference->active_speaker_hold = CONF_ACTIVE_SPEAKER_HOLD;
+	if (!zstr(active_speaker_hold)) {
+		int tmp = atoi(active_speaker_hold);
+		conference->active_speaker_hold = tmp > 0 ? tmp : 0;
+	}
+	conference->active_speaker_hold /= conference->interval;
+	if (!zstr(cascade_local)) {
+		conference->cascade_local = switch_core_strdup(conference->pool, cascade_local);
+	}
+	if (!zstr(cascade_peers)) {
+		conference->cascade_peer_list = switch_core_strdup(conference->pool, cascade_peers);
+	}
+	if (!zstr(record_segment_time)) {
+		int tmp = atoi(record_segment_time);
+		conference->record_segment_time = tmp > 0 ? tmp : 0;
+	}
+	if (!zstr(mixer_threads)) {
+		int tmp = atoi(mixer_threads);
+
+		if (tmp > CONF_MIX_MAX_THREADS) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "mixer-threads %d is too many, using %d\n", tmp, CONF_MIX_MAX_THREADS);
+			tmp = CONF_MIX_MAX_THREADS;
+		}
+		conference->mix_threads = tmp > 0 ? tmp : 0;
+	}
+	if (!zstr(record_encoder_threads)) {
+		int tmp = atoi(record_encoder_threads);
+
+		if (tmp > CONF_RECORD_MAX_ENCODERS) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "record-encoder-threads %d is too many, using %d\n", tmp, CONF_RECORD_MAX_ENCODERS);
+			tmp = CONF_RECORD_MAX_ENCODERS;
+		}
+		if (tmp > 0) {
+			conference_record_encoders_start((uint32_t) tmp);
+		}
+	}
 	if (!zstr(endconf_grace_time)) {
 		conference->endconf_grace_time = atoi(endconf_grace_time);
 	}
@@ -7417,6 +9556,8 @@ static conference_obj_t *conference_new(char *name, conf_xml_cfg_t cfg, switch_c
 	switch_mutex_init(&conference->flag_mutex, SWITCH_MUTEX_NESTED, conference->pool);
 	switch_thread_rwlock_create(&conference->rwlock, conference->pool);
 	switch_mutex_init(&conference->member_mutex, SWITCH_MUTEX_NESTED, conference->pool);
+	switch_mutex_init(&conference->snapshot_mutex, SWITCH_MUTEX_NESTED, conference->pool);
+	switch_mutex_init(&conference->cascade_mutex, SWITCH_MUTEX_NESTED, conference->pool);
 
 	switch_mutex_lock(globals.hash_mutex);
 	switch_set_flag(conference, CFLAG_INHASH);
@@ -7781,6 +9922,14 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_conference_load)
 	switch_mutex_init(&globals.id_mutex, SWITCH_MUTEX_NESTED, globals.conference_pool);
 	switch_mutex_init(&globals.hash_mutex, SWITCH_MUTEX_NESTED, globals.conference_pool);
 	switch_mutex_init(&globals.setup_mutex, SWITCH_MUTEX_NESTED, globals.conference_pool);
+	switch_mutex_init(&globals.cascade_mutex, SWITCH_MUTEX_NESTED, globals.conference_pool);
+	switch_core_hash_init(&globals.cascade_links, globals.conference_pool);
+	globals.cascade_node_id = (uint32_t) ((intptr_t) &globals ^ (uint32_t) switch_micro_time_now()) | 1;
+
+	/* Start the recording encoders */
+	switch_queue_create(&globals.record_queue, SWITCH_CORE_QUEUE_LEN, globals.conference_pool);
+	switch_mutex_init(&globals.record_mutex, SWITCH_MUTEX_NESTED, globals.conference_pool);
+	conference_record_encoders_start(CONF_RECORD_ENCODERS);
 
 	/* Subscribe to presence request events */
 	if (switch_event_bind_removable(modname, SWITCH_EVENT_PRESENCE_PROBE, SWITCH_EVENT_SUBCLASS_ANY, pres_event_handler, NULL, &globals.node) !=
@@ -7804,6 +9953,8 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_conference_load)
 
 SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_conference_shutdown)
 {
+	int i;
+
 	if (globals.running) {
 
 		/* signal all threads to shutdown */
@@ -7817,6 +9968,17 @@ SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_conference_shutdown)
 			switch_yield(100000);
 		}
 
+		/* one stop token per encoder, every recording is done by now */
+		for (i = 0; i < (int) globals.record_encoder_count; i++) {
+			switch_queue_push(globals.record_queue, NULL);
+		}
+		for (i = 0; i < (int) globals.record_encoder_count; i++) {
+			switch_status_t st;
+			if (globals.record_encoders[i]) {
+				switch_thread_join(&st, globals.record_encoders[i]);
+			}
+		}
+
 		switch_event_unbind(&globals.node);
 		switch_event_free_subclass(CONF_EVENT_MAINT);
 
@@ -7824,6 +9986,7 @@ SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_conference_shutdown)
 		switch_safe_free(api_syntax);
 	}
 	switch_core_hash_destroy(&globals.conference_hash);
+	switch_core_hash_destroy(&globals.cascade_links);
 
 	return SWITCH_STATUS_SUCCESS;
 }
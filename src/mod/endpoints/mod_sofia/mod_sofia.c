@@ -58,6 +58,7 @@ static switch_status_t sofia_read_frame(switch_core_session_t *session, switch_f
 static switch_status_t sofia_write_frame(switch_core_session_t *session, switch_frame_t *frame, switch_io_flag_t flags, int stream_id);
 static switch_status_t sofia_read_video_frame(switch_core_session_t *session, switch_frame_t **frame, switch_io_flag_t flags, int stream_id);
 static switch_status_t sofia_write_video_frame(switch_core_session_t *session, switch_frame_t *frame, switch_io_flag_t flags, int stream_id);
+static switch_status_t sofia_write_video_train(switch_core_session_t *session, switch_video_train_t *train, switch_io_flag_t flags, int stream_id);
 static switch_status_t sofia_kill_channel(switch_core_session_t *session, int sig);
 
 /* BODY OF THE MODULE */
@@ -943,6 +944,40 @@ static switch_status_t sofia_write_video_frame(switch_core_session_t *session, s
 	return wrote > 0 ? SWITCH_STATUS_SUCCESS : SWITCH_STATUS_GENERR;
 }
 
+static switch_status_t sofia_write_video_train(switch_core_session_t *session, switch_video_train_t *train, switch_io_flag_t flags, int stream_id)
+{
+	private_object_t *tech_pvt = (private_object_t *) switch_core_session_get_private(session);
+	switch_channel_t *channel = switch_core_session_get_channel(session);
+	int wrote = 0;
+
+	switch_assert(tech_pvt != NULL);
+
+	while (!(tech_pvt->video_read_codec.implementation && switch_rtp_ready(tech_pvt->video_rtp_session))) {
+		if (switch_channel_ready(channel)) {
+			switch_yield(10000);
+		} else {
+			return SWITCH_STATUS_GENERR;
+		}
+	}
+
+	if (sofia_test_flag(tech_pvt, TFLAG_HUP)) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	if (!sofia_test_flag(tech_pvt, TFLAG_RTP)) {
+		return SWITCH_STATUS_GENERR;
+	}
+
+	if (!sofia_test_flag(tech_pvt, TFLAG_IO)) {
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	/* trains never carry CNG, the whole access unit goes out under one lock */
+	wrote = switch_rtp_write_frames(tech_pvt->video_rtp_session, train->frames, train->count);
+
+	return wrote > 0 ? SWITCH_STATUS_SUCCESS : SWITCH_STATUS_GENERR;
+}
+
 static switch_status_t sofia_read_frame(switch_core_session_t *session, switch_frame_t **frame, switch_io_flag_t flags, int stream_id)
 {
 	private_object_t *tech_pvt = switch_core_session_get_private(session);
@@ -1529,9 +1564,10 @@ static switch_status_t sofia_receive_message(switch_core_session_t *session, swi
 					if (maxqlen < qlen) {
 						maxqlen = qlen * 5;
 					}
-					if (switch_rtp_activate_jitter_buffer(tech_pvt->rtp_session, qlen, maxqlen,
-														  tech_pvt->read_impl.samples_per_packet, 
-														  tech_pvt->read_impl.samples_per_second, max_drift) == SWITCH_STATUS_SUCCESS) {
+					if (switch_rtp_activate_jitter_buffer_ex(tech_pvt->rtp_session, qlen, maxqlen,
+														     tech_pvt->read_impl.samples_per_packet, 
+														     tech_pvt->read_impl.samples_per_second, max_drift,
+														     sofia_glue_get_jb_mode(tech_pvt)) == SWITCH_STATUS_SUCCESS) {
 						switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(tech_pvt->session), 
 										  SWITCH_LOG_DEBUG, "Setting Jitterbuffer to %dms (%d frames) (%d max frames) (%d max drift)\n", 
 										  len, qlen, maxqlen, max_drift);
@@ -4308,7 +4344,10 @@ switch_io_routines_t sofia_io_routines = {
 	/*.receive_event */ sofia_receive_event,
 	/*.state_change */ NULL,
 	/*.read_video_frame */ sofia_read_video_frame,
-	/*.write_video_frame */ sofia_write_video_frame
+	/*.write_video_frame */ sofia_write_video_frame,
+	/*.state_run */ NULL,
+	/*.resurrect_session */ NULL,
+	/*.write_video_train */ sofia_write_video_train
 };
 
 switch_state_handler_table_t sofia_event_handlers = {
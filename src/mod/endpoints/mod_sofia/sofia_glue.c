@@ -2743,6 +2743,11 @@ void sofia_glue_tech_absorb_sdp(private_object_t *tech_pvt)
 	switch_snprintf(var_val, sizeof(var_val), "%" SWITCH_SIZE_T_FMT, _i); \
 	switch_channel_set_variable(tech_pvt->channel, var_name, var_val)
 
+#define add_quality_stat(_i, _s)										\
+	switch_snprintf(var_name, sizeof(var_name), "rtp_%s_%s", switch_str_nil(prefix), _s) ; \
+	switch_snprintf(var_val, sizeof(var_val), "%0.2f", (double) _i);	\
+	switch_channel_set_variable(tech_pvt->channel, var_name, var_val)
+
 static void set_stats(switch_rtp_t *rtp_session, private_object_t *tech_pvt, const char *prefix)
 {
 	switch_rtp_stats_t *stats = switch_rtp_get_stats(rtp_session, NULL);
@@ -2760,6 +2765,9 @@ static void set_stats(switch_rtp_t *rtp_session, private_object_t *tech_pvt, con
 		add_stat(stats->inbound.cng_packet_count, "in_cng_packet_count");
 		add_stat(stats->inbound.flush_packet_count, "in_flush_packet_count");
 		add_stat(stats->inbound.largest_jb_size, "in_largest_jb_size");
+		add_stat(stats->inbound.jb_plc_packet_count, "in_jb_plc_packet_count");
+		add_stat(stats->inbound.jb_late_packet_count, "in_jb_late_packet_count");
+		add_stat(stats->inbound.jb_discard_packet_count, "in_jb_discard_packet_count");
 
 		add_stat(stats->outbound.raw_bytes, "out_raw_bytes");
 		add_stat(stats->outbound.media_bytes, "out_media_bytes");
@@ -2772,6 +2780,27 @@ static void set_stats(switch_rtp_t *rtp_session, private_object_t *tech_pvt, con
 		add_stat(stats->rtcp.packet_count, "rtcp_packet_count");
 		add_stat(stats->rtcp.octet_count, "rtcp_octet_count");
 
+		add_quality_stat(stats->quality.mos, "in_mos");
+		add_quality_stat(stats->quality.mos_lq, "in_mos_lq");
+		add_quality_stat(stats->quality.r_factor, "in_r_factor");
+		add_quality_stat(stats->quality.loss_rate, "in_loss_rate");
+		add_quality_stat(stats->quality.discard_rate, "in_discard_rate");
+		add_quality_stat(stats->quality.burst_density, "in_burst_density");
+		add_quality_stat(stats->quality.gap_density, "in_gap_density");
+		add_stat((switch_size_t) stats->quality.burst_duration, "in_burst_duration");
+		add_stat((switch_size_t) stats->quality.gap_duration, "in_gap_duration");
+		add_quality_stat(stats->quality.burst_ratio, "in_burst_ratio");
+		add_stat((switch_size_t) stats->quality.expected_packet_count, "in_expected_packet_count");
+		add_stat((switch_size_t) stats->quality.lost_packet_count, "in_lost_packet_count");
+		add_quality_stat(stats->quality.jitter, "in_jitter");
+		add_stat((switch_size_t) stats->quality.jitter_p50, "in_jitter_p50");
+		add_stat((switch_size_t) stats->quality.jitter_p95, "in_jitter_p95");
+		add_stat((switch_size_t) stats->quality.jitter_p99, "in_jitter_p99");
+		add_stat((switch_size_t) stats->quality.round_trip_delay, "rtcp_round_trip_delay");
+		add_quality_stat(stats->quality.remote_loss_rate, "out_loss_rate");
+		add_quality_stat(stats->quality.remote_jitter, "out_jitter");
+		add_quality_stat(stats->quality.remote_mos, "out_mos");
+
 	}
 }
 
@@ -2786,6 +2815,17 @@ void sofia_glue_set_rtp_stats(private_object_t *tech_pvt)
 	}
 }
 
+switch_rtp_jb_mode_t sofia_glue_get_jb_mode(private_object_t *tech_pvt)
+{
+	const char *val = switch_channel_get_variable(tech_pvt->channel, "jitterbuffer_mode");
+
+	if (!zstr(val) && !strcasecmp(val, "indexed")) {
+		return SWITCH_RTP_JB_INDEXED;
+	}
+
+	return SWITCH_RTP_JB_DEFAULT;
+}
+
 void sofia_glue_deactivate_rtp(private_object_t *tech_pvt)
 {
 	int loops = 0;
@@ -3427,10 +3467,26 @@ switch_status_t sofia_glue_activate_rtp(private_object_t *tech_pvt, switch_rtp_f
 									  "Invalid rtcp interval spec [%d] must be between 100 and 5000\n", interval);
 				} else {
 					switch_rtp_activate_rtcp(tech_pvt->rtp_session, interval, remote_port);
+					if (switch_true(switch_channel_get_variable(tech_pvt->channel, "rtcp_xr"))) {
+						switch_rtp_enable_rtcp_xr(tech_pvt->rtp_session, SWITCH_TRUE);
+					}
 				}
 			}
 		}
 
+		if ((val = switch_channel_get_variable(tech_pvt->channel, "rtp_quality_event_interval"))) {
+			int v = atoi(val);
+			if (v >= 0) {
+				switch_rtp_set_quality_event_interval(tech_pvt->rtp_session, v);
+			}
+		}
+
+		if (switch_true(switch_channel_get_variable(tech_pvt->channel, "silence_aware_media"))) {
+			switch_channel_set_flag(tech_pvt->channel, CF_SILENCE_AWARE);
+		} else {
+			switch_channel_clear_flag(tech_pvt->channel, CF_SILENCE_AWARE);
+		}
+
 		if ((val = switch_channel_get_variable(tech_pvt->channel, "jitterbuffer_msec")) || (val = tech_pvt->profile->jb_msec)) {
 			int jb_msec = atoi(val);
 			int maxlen = 0, max_drift = 0;
@@ -3464,9 +3520,10 @@ switch_status_t sofia_glue_activate_rtp(private_object_t *tech_pvt, switch_rtp_f
 				if (maxqlen < qlen) {
 					maxqlen = qlen * 5;
 				}
-				if (switch_rtp_activate_jitter_buffer(tech_pvt->rtp_session, qlen, maxqlen,
-													  tech_pvt->read_impl.samples_per_packet, 
-													  tech_pvt->read_impl.samples_per_second, max_drift) == SWITCH_STATUS_SUCCESS) {
+				if (switch_rtp_activate_jitter_buffer_ex(tech_pvt->rtp_session, qlen, maxqlen,
+													     tech_pvt->read_impl.samples_per_packet, 
+													     tech_pvt->read_impl.samples_per_second, max_drift,
+													     sofia_glue_get_jb_mode(tech_pvt)) == SWITCH_STATUS_SUCCESS) {
 					switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(tech_pvt->session), 
 									  SWITCH_LOG_DEBUG, "Setting Jitterbuffer to %dms (%d frames)\n", jb_msec, qlen);
 					switch_channel_set_flag(tech_pvt->channel, CF_JITTERBUFFER);
@@ -31,11 +31,29 @@
  */
 #ifdef HAVE_OPENSSL
 #include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <openssl/hmac.h>
 #endif
 #include <switch.h>
 
 #define MULTICAST_BUFFSIZE 65536
 
+/* Batched datagrams (packet-format batch), several events each:
+   "FSM2", flags, sender length, sender, boot id (4), sequence (8), event count (2),
+   [nonce (12)], payload, [tag (16)]
+   The boot id is drawn at random when the sender starts, a different one means it restarted and the sequence starts over.
+   The payload is a 4 byte length and the serialized text of each event, LZ4 compressed when that is smaller.
+   With a psk it is sealed with AES-256-GCM and everything in front of the nonce is authenticated along with it. */
+#define BATCH_MAGIC "FSM2"
+#define BATCH_FLAG_COMPRESSED (1 << 0)
+#define BATCH_FLAG_SEALED (1 << 1)
+#define BATCH_HEADER_MIN (4 + 1 + 1 + 4 + 8 + 2)
+#define BATCH_NONCE_LEN 12
+#define BATCH_TAG_LEN 16
+#define BATCH_MAX_BYTES 60000
+#define BATCH_DEFAULT_BYTES 1400
+#define BATCH_DEFAULT_DELAY_MS 20
+
 /* magic byte sequence */
 static unsigned char MAGIC[] = { 226, 132, 177, 197, 152, 198, 142, 211, 172, 197, 158, 208, 169, 208, 135, 197, 166, 207, 154, 196, 166 };
 static char *MARKER = "1";
@@ -62,11 +80,44 @@ static struct {
 	switch_mutex_t *mutex;
 	switch_hash_t *peer_hash;
 	int loopback;
+	int batch;
+	uint32_t batch_bytes;
+	uint32_t batch_delay;
+	int compress;
+	/* guards everything below, the events waiting to go out and the flush thread */
+	switch_mutex_t *batch_mutex;
+	switch_thread_cond_t *batch_cond;
+	switch_thread_t *batch_thread;
+	int batch_running;
+	char *batch_buf;
+	uint32_t batch_len;
+	uint16_t batch_count;
+	switch_time_t batch_started;
+	unsigned char *packet_buf;
+	uint32_t boot_id;
+	uint64_t seq;
+	/* receive side, only touched by the runtime thread */
+	unsigned char *inflate_buf;
+#ifdef HAVE_OPENSSL
+	unsigned char key[32];
+	uint32_t key_gen;
+	EVP_CIPHER_CTX *seal_ctx;
+	uint32_t seal_gen;
+	/* one for every peer, a packet is authenticated before we look at who claims to have sent it */
+	EVP_CIPHER_CTX *open_ctx;
+	uint32_t open_gen;
+#endif
 } globals;
 
 struct peer_status {
 	switch_bool_t active;
 	time_t lastseen;
+	/* batched packets from this peer */
+	uint32_t boot_id;
+	uint64_t last_seq;
+	uint64_t packets;
+	uint64_t missed;
+	uint64_t late;
 };
 
 SWITCH_DECLARE_GLOBAL_STRING_FUNC(set_global_address, globals.address);
@@ -77,6 +128,55 @@ SWITCH_DECLARE_GLOBAL_STRING_FUNC(set_global_psk, globals.psk);
 #define MULTICAST_EVENT "multicast::event"
 #define MULTICAST_PEERUP "multicast::peerup"
 #define MULTICAST_PEERDOWN "multicast::peerdown"
+#define MULTICAST_GAP "multicast::gap"
+
+#ifdef HAVE_OPENSSL
+#define KEY_SALT "mod_event_multicast"
+#define KEY_INFO "FSM2 AES-256-GCM"
+
+/* HKDF-SHA256 (RFC 5869) built on HMAC so it works with any OpenSSL, okm_len is at most 255 blocks and info at most 128 bytes */
+static switch_bool_t hkdf_sha256(const unsigned char *salt, size_t salt_len, const unsigned char *ikm, size_t ikm_len,
+								 const unsigned char *info, size_t info_len, unsigned char *okm, size_t okm_len)
+{
+	unsigned char prk[EVP_MAX_MD_SIZE], msg[EVP_MAX_MD_SIZE + 128 + 1], t[EVP_MAX_MD_SIZE];
+	unsigned int prk_len = 0, t_len = 0;
+	size_t msg_len, done = 0;
+	unsigned char i;
+
+	if (info_len > 128 || okm_len > 255 * 32) {
+		return SWITCH_FALSE;
+	}
+
+	HMAC(EVP_sha256(), salt, (int) salt_len, ikm, ikm_len, prk, &prk_len);
+
+	/* T(i) = HMAC(PRK, T(i - 1) | info | i) */
+	for (i = 1; done < okm_len; i++) {
+		msg_len = 0;
+		memcpy(msg, t, t_len);
+		msg_len += t_len;
+		memcpy(msg + msg_len, info, info_len);
+		msg_len += info_len;
+		msg[msg_len++] = i;
+
+		HMAC(EVP_sha256(), prk, (int) prk_len, msg, msg_len, t, &t_len);
+
+		memcpy(okm + done, t, okm_len - done < t_len ? okm_len - done : t_len);
+		done += t_len;
+	}
+
+	memset(prk, 0, sizeof(prk));
+	memset(t, 0, sizeof(t));
+
+	return SWITCH_TRUE;
+}
+
+static void derive_key(const char *psk, unsigned char key[32])
+{
+	hkdf_sha256((const unsigned char *) KEY_SALT, strlen(KEY_SALT), (const unsigned char *) psk, strlen(psk),
+				(const unsigned char *) KEY_INFO, strlen(KEY_INFO), key, 32);
+}
+#endif
+
 static switch_status_t load_config(void)
 {
 	switch_status_t status = SWITCH_STATUS_SUCCESS;
@@ -90,6 +190,10 @@ static switch_status_t load_config(void)
 	globals.ttl = 1;
 	globals.key_count = 0;
 	globals.loopback = 0;
+	globals.batch = 0;
+	globals.batch_bytes = BATCH_DEFAULT_BYTES;
+	globals.batch_delay = BATCH_DEFAULT_DELAY_MS;
+	globals.compress = 0;
 
 	if (!(xml = switch_xml_open_cfg(cf, &cfg, NULL))) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Open of %s failed\n", cf);
@@ -123,6 +227,32 @@ static switch_status_t load_config(void)
 				}
 			} else if (!strcasecmp(var, "loopback")) {
 				globals.loopback = switch_true(val);
+			} else if (!strcasecmp(var, "packet-format")) {
+				if (!strcasecmp(val, "batch")) {
+					globals.batch = 1;
+				} else if (!strcasecmp(val, "legacy")) {
+					globals.batch = 0;
+				} else {
+					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid packet-format '%s' specified, using legacy\n", val);
+				}
+			} else if (!strcasecmp(var, "batch-max-bytes")) {
+				int bytes = atoi(val);
+				if (bytes >= 512 && bytes <= BATCH_MAX_BYTES) {
+					globals.batch_bytes = (uint32_t) bytes;
+				} else {
+					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid batch-max-bytes '%s' specified, using default of %d\n",
+									  val, BATCH_DEFAULT_BYTES);
+				}
+			} else if (!strcasecmp(var, "batch-max-delay-ms")) {
+				int delay = atoi(val);
+				if (delay >= 0 && delay <= 1000) {
+					globals.batch_delay = (uint32_t) delay;
+				} else {
+					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid batch-max-delay-ms '%s' specified, using default of %d\n",
+									  val, BATCH_DEFAULT_DELAY_MS);
+				}
+			} else if (!strcasecmp(var, "compress")) {
+				globals.compress = switch_true(val);
 			}
 
 		}
@@ -130,6 +260,13 @@ static switch_status_t load_config(void)
 
 	switch_xml_free(xml);
 
+#ifdef HAVE_OPENSSL
+	if (globals.psk) {
+		/* batched packets are sealed with a key derived from the psk, the contexts pick it up by its generation */
+		derive_key(globals.psk, globals.key);
+		globals.key_gen++;
+	}
+#endif
 
 	if (globals.bindings) {
 		for (cur = globals.bindings; cur; count++) {
@@ -169,6 +306,389 @@ static switch_status_t load_config(void)
 
 }
 
+static struct peer_status *peer_get(const char *sender)
+{
+	struct peer_status *p;
+
+	switch_mutex_lock(globals.mutex);
+	if (!(p = switch_core_hash_find(globals.peer_hash, sender))) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Host %s not already in hash\n", sender);
+		p = switch_core_alloc(module_pool, sizeof(struct peer_status));
+		p->active = SWITCH_FALSE;
+		p->lastseen = 0;
+		switch_core_hash_insert(globals.peer_hash, sender, p);
+	}
+	switch_mutex_unlock(globals.mutex);
+
+	return p;
+}
+
+static void put_uint(unsigned char *p, uint64_t v, int bytes)
+{
+	while (bytes-- > 0) {
+		p[bytes] = (unsigned char) (v & 0xff);
+		v >>= 8;
+	}
+}
+
+static uint64_t get_uint(const unsigned char *p, int bytes)
+{
+	uint64_t v = 0;
+
+	while (bytes-- > 0) {
+		v = (v << 8) | *p++;
+	}
+
+	return v;
+}
+
+#define LZ4_HASH_LOG 12
+#define LZ4_MIN_MATCH 4
+#define LZ4_LAST_LITERALS 5
+#define LZ4_MFLIMIT 12
+
+static uint32_t lz4_hash(const unsigned char *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return (v * 2654435761U) >> (32 - LZ4_HASH_LOG);
+}
+
+static unsigned char *lz4_put_len(unsigned char *op, size_t len)
+{
+	for (; len >= 255; len -= 255) {
+		*op++ = 255;
+	}
+	*op++ = (unsigned char) len;
+
+	return op;
+}
+
+/* Greedy compressor writing the LZ4 block format, returns 0 when the result does not fit in dst_len */
+static size_t lz4_compress(const unsigned char *src, size_t src_len, unsigned char *dst, size_t dst_len)
+{
+	uint32_t table[1 << LZ4_HASH_LOG];
+	const unsigned char *ip = src, *anchor = src, *end = src + src_len;
+	const unsigned char *mflimit = end - LZ4_MFLIMIT, *matchlimit = end - LZ4_LAST_LITERALS;
+	unsigned char *op = dst, *oend = dst + dst_len, *token;
+	size_t lit, mlen;
+
+	memset(table, 0, sizeof(table));
+
+	if (src_len > LZ4_MFLIMIT) {
+		while (ip < mflimit) {
+			uint32_t h = lz4_hash(ip);
+			const unsigned char *ref = table[h] ? src + table[h] - 1 : NULL;
+
+			table[h] = (uint32_t) (ip - src) + 1;
+
+			if (!ref || ip - ref > 65535 || memcmp(ref, ip, LZ4_MIN_MATCH)) {
+				ip++;
+				continue;
+			}
+
+			for (mlen = LZ4_MIN_MATCH; ip + mlen < matchlimit && ref[mlen] == ip[mlen]; mlen++);
+
+			lit = ip - anchor;
+			if ((size_t) (oend - op) < 1 + lit / 255 + 1 + lit + 2 + mlen / 255 + 1) {
+				return 0;
+			}
+
+			token = op++;
+			*token = (unsigned char) ((lit >= 15 ? 15 : lit) << 4);
+			if (lit >= 15) {
+				op = lz4_put_len(op, lit - 15);
+			}
+			memcpy(op, anchor, lit);
+			op += lit;
+
+			*op++ = (unsigned char) ((ip - ref) & 0xff);
+			*op++ = (unsigned char) ((ip - ref) >> 8);
+
+			mlen -= LZ4_MIN_MATCH;
+			if (mlen >= 15) {
+				*token |= 15;
+				op = lz4_put_len(op, mlen - 15);
+			} else {
+				*token |= (unsigned char) mlen;
+			}
+
+			ip += mlen + LZ4_MIN_MATCH;
+			anchor = ip;
+		}
+	}
+
+	lit = end - anchor;
+	if ((size_t) (oend - op) < 1 + lit / 255 + 1 + lit) {
+		return 0;
+	}
+
+	token = op++;
+	*token = (unsigned char) ((lit >= 15 ? 15 : lit) << 4);
+	if (lit >= 15) {
+		op = lz4_put_len(op, lit - 15);
+	}
+	memcpy(op, anchor, lit);
+	op += lit;
+
+	return op - dst;
+}
+
+/* Returns the decompressed length, -1 on a malformed block or one that does not fit in dst_len */
+static int lz4_decompress(const unsigned char *src, size_t src_len, unsigned char *dst, size_t dst_len)
+{
+	const unsigned char *ip = src, *iend = src + src_len, *ref;
+	unsigned char *op = dst, *oend = dst + dst_len;
+	size_t lit, mlen, off;
+	unsigned char b;
+
+	while (ip < iend) {
+		unsigned char token = *ip++;
+
+		if ((lit = token >> 4) == 15) {
+			do {
+				if (ip >= iend) {
+					return -1;
+				}
+				lit += (b = *ip++);
+			} while (b == 255);
+		}
+
+		if (lit > (size_t) (iend - ip) || lit > (size_t) (oend - op)) {
+			return -1;
+		}
+		memcpy(op, ip, lit);
+		op += lit;
+		ip += lit;
+
+		/* the last sequence has no match */
+		if (ip == iend) {
+			break;
+		}
+
+		if (iend - ip < 2) {
+			return -1;
+		}
+		off = ip[0] | (ip[1] << 8);
+		ip += 2;
+
+		if (!off || off > (size_t) (op - dst)) {
+			return -1;
+		}
+
+		if ((mlen = token & 15) == 15) {
+			do {
+				if (ip >= iend) {
+					return -1;
+				}
+				mlen += (b = *ip++);
+			} while (b == 255);
+		}
+		mlen += LZ4_MIN_MATCH;
+
+		if (mlen > (size_t) (oend - op)) {
+			return -1;
+		}
+
+		/* byte by byte, the match may overlap what it is producing */
+		for (ref = op - off; mlen; mlen--) {
+			*op++ = *ref++;
+		}
+	}
+
+	return (int) (op - dst);
+}
+
+#ifdef HAVE_OPENSSL
+/* The key schedule is set up once per context and again only when the psk changed, each packet just sets its nonce */
+static switch_bool_t aead_ready(EVP_CIPHER_CTX **ctx, uint32_t *gen, int enc)
+{
+	switch_bool_t r = SWITCH_TRUE;
+
+	if (*ctx && *gen == globals.key_gen) {
+		return SWITCH_TRUE;
+	}
+
+	if (!*ctx && !(*ctx = EVP_CIPHER_CTX_new())) {
+		return SWITCH_FALSE;
+	}
+
+	switch_mutex_lock(globals.mutex);
+	if (!EVP_CipherInit_ex(*ctx, EVP_aes_256_gcm(), NULL, NULL, NULL, enc) ||
+		!EVP_CIPHER_CTX_ctrl(*ctx, EVP_CTRL_GCM_SET_IVLEN, BATCH_NONCE_LEN, NULL) ||
+		!EVP_CipherInit_ex(*ctx, NULL, NULL, globals.key, NULL, enc)) {
+		r = SWITCH_FALSE;
+	} else {
+		*gen = globals.key_gen;
+	}
+	switch_mutex_unlock(globals.mutex);
+
+	return r;
+}
+
+static switch_bool_t batch_seal(const unsigned char *aad, int aad_len, unsigned char *nonce, unsigned char *data, int len, unsigned char *tag)
+{
+	EVP_CIPHER_CTX *ctx;
+	int outl;
+
+	if (!aead_ready(&globals.seal_ctx, &globals.seal_gen, 1) || RAND_bytes(nonce, BATCH_NONCE_LEN) != 1) {
+		return SWITCH_FALSE;
+	}
+
+	ctx = globals.seal_ctx;
+
+	return EVP_EncryptInit_ex(ctx, NULL, NULL, NULL, nonce) &&
+		EVP_EncryptUpdate(ctx, NULL, &outl, aad, aad_len) &&
+		EVP_EncryptUpdate(ctx, data, &outl, data, len) &&
+		EVP_EncryptFinal_ex(ctx, data + outl, &outl) &&
+		EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, BATCH_TAG_LEN, tag) ? SWITCH_TRUE : SWITCH_FALSE;
+}
+
+static switch_bool_t batch_open(const unsigned char *aad, int aad_len, const unsigned char *nonce, unsigned char *data, int len, unsigned char *tag)
+{
+	EVP_CIPHER_CTX *ctx;
+	int outl;
+
+	if (!aead_ready(&globals.open_ctx, &globals.open_gen, 0)) {
+		return SWITCH_FALSE;
+	}
+
+	ctx = globals.open_ctx;
+
+	return EVP_DecryptInit_ex(ctx, NULL, NULL, NULL, nonce) &&
+		EVP_DecryptUpdate(ctx, NULL, &outl, aad, aad_len) &&
+		EVP_DecryptUpdate(ctx, data, &outl, data, len) &&
+		EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, BATCH_TAG_LEN, tag) &&
+		EVP_DecryptFinal_ex(ctx, data + outl, &outl) > 0 ? SWITCH_TRUE : SWITCH_FALSE;
+}
+#endif
+
+/* Called with the batch mutex held */
+static void batch_flush(void)
+{
+	unsigned char *out = globals.packet_buf, *p, *flags, *payload;
+	const char *sender = switch_core_get_switchname();
+	size_t slen, plen, len;
+	int sealed = 0;
+
+	if (!globals.batch_count) {
+		return;
+	}
+
+#ifdef HAVE_OPENSSL
+	sealed = globals.psk != NULL;
+#endif
+
+	if ((slen = strlen(sender)) > 255) {
+		slen = 255;
+	}
+
+	p = out;
+	memcpy(p, BATCH_MAGIC, 4);
+	p += 4;
+	flags = p++;
+	*flags = sealed ? BATCH_FLAG_SEALED : 0;
+	*p++ = (unsigned char) slen;
+	memcpy(p, sender, slen);
+	p += slen;
+	put_uint(p, globals.boot_id, 4);
+	p += 4;
+	put_uint(p, ++globals.seq, 8);
+	p += 8;
+	put_uint(p, globals.batch_count, 2);
+	p += 2;
+
+	payload = sealed ? p + BATCH_NONCE_LEN : p;
+
+	/* only worth it when it comes out smaller */
+	if (globals.compress && (plen = lz4_compress((unsigned char *) globals.batch_buf, globals.batch_len, payload, globals.batch_len - 1))) {
+		*flags |= BATCH_FLAG_COMPRESSED;
+	} else {
+		memcpy(payload, globals.batch_buf, globals.batch_len);
+		plen = globals.batch_len;
+	}
+
+	len = (payload - out) + plen;
+
+#ifdef HAVE_OPENSSL
+	if (sealed) {
+		if (!batch_seal(out, (int) (p - out), p, payload, (int) plen, payload + plen)) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Cannot seal packet %" SWITCH_UINT64_T_FMT ", %u events dropped\n",
+							  globals.seq, globals.batch_count);
+			goto end;
+		}
+		len += BATCH_TAG_LEN;
+	}
+#endif
+
+	switch_socket_sendto(globals.udp_socket, globals.addr, 0, (char *) out, &len);
+
+#ifdef HAVE_OPENSSL
+  end:
+#endif
+
+	globals.batch_len = 0;
+	globals.batch_count = 0;
+}
+
+static void batch_add(const char *packet)
+{
+	size_t plen = strlen(packet);
+
+	if (plen + 4 > BATCH_MAX_BYTES) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Event of %" SWITCH_SIZE_T_FMT " bytes is too big for a packet, dropped\n", plen);
+		return;
+	}
+
+	switch_mutex_lock(globals.batch_mutex);
+
+	if (globals.batch_count && (globals.batch_len + 4 + plen > globals.batch_bytes || globals.batch_count == 0xffff)) {
+		batch_flush();
+	}
+
+	put_uint((unsigned char *) globals.batch_buf + globals.batch_len, plen, 4);
+	memcpy(globals.batch_buf + globals.batch_len + 4, packet, plen);
+	globals.batch_len += (uint32_t) plen + 4;
+	globals.batch_count++;
+
+	if (!globals.batch_delay || globals.batch_len >= globals.batch_bytes) {
+		batch_flush();
+	} else if (globals.batch_count == 1) {
+		/* the delay bound starts with the oldest event of the packet */
+		globals.batch_started = switch_micro_time_now();
+		switch_thread_cond_signal(globals.batch_cond);
+	}
+
+	switch_mutex_unlock(globals.batch_mutex);
+}
+
+static void *SWITCH_THREAD_FUNC batch_thread_run(switch_thread_t *thread, void *obj)
+{
+	switch_mutex_lock(globals.batch_mutex);
+
+	while (globals.batch_running) {
+		if (!globals.batch_count) {
+			switch_thread_cond_wait(globals.batch_cond, globals.batch_mutex);
+		} else {
+			switch_time_t due = globals.batch_started + (switch_time_t) globals.batch_delay * 1000;
+			switch_time_t now = switch_micro_time_now();
+
+			if (now >= due) {
+				batch_flush();
+			} else {
+				switch_thread_cond_timedwait(globals.batch_cond, globals.batch_mutex, due - now);
+			}
+		}
+	}
+
+	batch_flush();
+
+	switch_mutex_unlock(globals.batch_mutex);
+
+	return NULL;
+}
+
 static void event_handler(switch_event_t *event)
 {
 	uint8_t send = 0;
@@ -178,21 +698,15 @@ static void event_handler(switch_event_t *event)
 	}
 
 	if (event->subclass_name && (!strcmp(event->subclass_name, MULTICAST_EVENT) ||
-								 !strcmp(event->subclass_name, MULTICAST_PEERUP) || !strcmp(event->subclass_name, MULTICAST_PEERDOWN))) {
+								 !strcmp(event->subclass_name, MULTICAST_PEERUP) || !strcmp(event->subclass_name, MULTICAST_PEERDOWN) ||
+								 !strcmp(event->subclass_name, MULTICAST_GAP))) {
 		char *event_name, *sender;
 		if ((event_name = switch_event_get_header(event, "orig-event-name")) &&
 			!strcasecmp(event_name, "HEARTBEAT") && (sender = switch_event_get_header(event, "orig-multicast-sender"))) {
 			struct peer_status *p;
 			time_t now = switch_epoch_time_now(NULL);
 
-			if (!(p = switch_core_hash_find(globals.peer_hash, sender))) {
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Host %s not already in hash\n", sender);
-				p = switch_core_alloc(module_pool, sizeof(struct peer_status));
-				p->active = SWITCH_FALSE;
-				p->lastseen = 0;
-				/*} else { */
-				/*switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "Host %s last seen %d seconds ago\n", sender, now - p->lastseen); */
-			}
+			p = peer_get(sender);
 
 			if (!p->active) {
 				switch_event_t *local_event;
@@ -212,8 +726,6 @@ static void event_handler(switch_event_t *event)
 			}
 			p->active = SWITCH_TRUE;
 			p->lastseen = now;
-
-			switch_core_hash_insert(globals.peer_hash, sender, p);
 		}
 
 		/* ignore our own events to avoid ping pong */
@@ -221,6 +733,9 @@ static void event_handler(switch_event_t *event)
 	}
 
 	if (event->event_id == SWITCH_EVENT_RELOADXML) {
+		/* what is waiting goes out with the settings it was batched under */
+		switch_mutex_lock(globals.batch_mutex);
+		batch_flush();
 		switch_mutex_lock(globals.mutex);
 		switch_core_hash_destroy(&globals.event_hash);
 		globals.event_hash = NULL;
@@ -236,6 +751,7 @@ static void event_handler(switch_event_t *event)
 			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "Event Multicast Reloaded\n");
 		}
 		switch_mutex_unlock(globals.mutex);
+		switch_mutex_unlock(globals.batch_mutex);
 	}
 
 	if (event->event_id == SWITCH_EVENT_HEARTBEAT) {
@@ -286,7 +802,12 @@ static void event_handler(switch_event_t *event)
 			return;
 		default:
 			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Multicast-Sender", switch_core_get_switchname());
-			if (switch_event_serialize(event, &packet, SWITCH_TRUE) == SWITCH_STATUS_SUCCESS) {
+			if (globals.batch) {
+				if (switch_event_serialize(event, &packet, SWITCH_TRUE) == SWITCH_STATUS_SUCCESS) {
+					batch_add(packet);
+					switch_safe_free(packet);
+				}
+			} else if (switch_event_serialize(event, &packet, SWITCH_TRUE) == SWITCH_STATUS_SUCCESS) {
 				size_t len;
 				char *buf;
 #ifdef HAVE_OPENSSL
@@ -356,7 +877,12 @@ SWITCH_STANDARD_API(multicast_peers)
 		host = (char *) key;
 		last = (struct peer_status *) value;
 
-		stream->write_function(stream, "Peer %s %s; last seen %d seconds ago\n", host, last->active ? "UP" : "DOWN", now - last->lastseen);
+		stream->write_function(stream, "Peer %s %s; last seen %d seconds ago", host, last->active ? "UP" : "DOWN", now - last->lastseen);
+		if (last->packets) {
+			stream->write_function(stream, "; %" SWITCH_UINT64_T_FMT " packets, %" SWITCH_UINT64_T_FMT " missed, %" SWITCH_UINT64_T_FMT " late",
+								   last->packets, last->missed, last->late);
+		}
+		stream->write_function(stream, "\n");
 		i++;
 	}
 
@@ -375,8 +901,21 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_event_multicast_load)
 	memset(&globals, 0, sizeof(globals));
 
 	switch_mutex_init(&globals.mutex, SWITCH_MUTEX_NESTED, pool);
+	switch_mutex_init(&globals.batch_mutex, SWITCH_MUTEX_DEFAULT, pool);
+	switch_thread_cond_create(&globals.batch_cond, pool);
 	module_pool = pool;
 
+	globals.batch_buf = switch_core_alloc(pool, BATCH_MAX_BYTES);
+	globals.packet_buf = switch_core_alloc(pool, MULTICAST_BUFFSIZE);
+	globals.inflate_buf = switch_core_alloc(pool, BATCH_MAX_BYTES + 1);
+	{
+		switch_uuid_t uuid;
+
+		/* random rather than the start time, two restarts within a second (or a clock set back) still look like one */
+		switch_uuid_get(&uuid);
+		memcpy(&globals.boot_id, uuid.data, sizeof(globals.boot_id));
+	}
+
 	switch_core_hash_init(&globals.event_hash, module_pool);
 	switch_core_hash_init(&globals.peer_hash, module_pool);
 
@@ -437,6 +976,20 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_event_multicast_load)
 		switch_goto_status(SWITCH_STATUS_GENERR, fail);
 	}
 
+	if (switch_event_reserve_subclass(MULTICAST_GAP) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Couldn't register subclass %s!\n", MULTICAST_GAP);
+		switch_goto_status(SWITCH_STATUS_GENERR, fail);
+	}
+
+	{
+		switch_threadattr_t *thd_attr = NULL;
+
+		globals.batch_running = 1;
+		switch_threadattr_create(&thd_attr, pool);
+		switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+		switch_thread_create(&globals.batch_thread, thd_attr, batch_thread_run, NULL, pool);
+	}
+
 	if (switch_event_bind(modname, SWITCH_EVENT_ALL, SWITCH_EVENT_SUBCLASS_ANY, event_handler, NULL) != SWITCH_STATUS_SUCCESS) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Couldn't bind!\n");
 		switch_goto_status(SWITCH_STATUS_GENERR, fail);
@@ -463,6 +1016,7 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_event_multicast_load)
 	switch_event_free_subclass(MULTICAST_EVENT);
 	switch_event_free_subclass(MULTICAST_PEERUP);
 	switch_event_free_subclass(MULTICAST_PEERDOWN);
+	switch_event_free_subclass(MULTICAST_GAP);
 
 	return status;
 
@@ -474,6 +1028,18 @@ SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_event_multicast_shutdown)
 	globals.running = 0;
 	switch_event_unbind_callback(event_handler);
 
+	if (globals.batch_thread) {
+		switch_status_t st;
+
+		/* the thread sends whatever is still waiting on its way out */
+		switch_mutex_lock(globals.batch_mutex);
+		globals.batch_running = 0;
+		switch_thread_cond_signal(globals.batch_cond);
+		switch_mutex_unlock(globals.batch_mutex);
+		switch_thread_join(&st, globals.batch_thread);
+		globals.batch_thread = NULL;
+	}
+
 	if (globals.udp_socket) {
 		switch_socket_shutdown(globals.udp_socket, 2);
 	}
@@ -481,6 +1047,19 @@ SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_event_multicast_shutdown)
 	switch_event_free_subclass(MULTICAST_EVENT);
 	switch_event_free_subclass(MULTICAST_PEERUP);
 	switch_event_free_subclass(MULTICAST_PEERDOWN);
+	switch_event_free_subclass(MULTICAST_GAP);
+
+#ifdef HAVE_OPENSSL
+	if (globals.seal_ctx) {
+		EVP_CIPHER_CTX_free(globals.seal_ctx);
+		globals.seal_ctx = NULL;
+	}
+
+	if (globals.open_ctx) {
+		EVP_CIPHER_CTX_free(globals.open_ctx);
+		globals.open_ctx = NULL;
+	}
+#endif
 
 	switch_core_hash_destroy(&globals.event_hash);
 
@@ -490,13 +1069,196 @@ SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_event_multicast_shutdown)
 	return SWITCH_STATUS_SUCCESS;
 }
 
-SWITCH_MODULE_RUNTIME_FUNCTION(mod_event_multicast_runtime)
+/* Turns the serialized text of a remote event into a local multicast::event, the text is taken apart in place */
+static void fire_remote_event(char *packet)
 {
 	switch_event_t *local_event;
+
+	/*switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "\nEVENT\n--------------------------------\n%s\n", packet); */
+	if (switch_event_create_subclass(&local_event, SWITCH_EVENT_CUSTOM, MULTICAST_EVENT) == SWITCH_STATUS_SUCCESS) {
+		char *var, *val, *term = NULL, tmpname[128];
+		switch_event_add_header_string(local_event, SWITCH_STACK_BOTTOM, "Multicast", "yes");
+		var = packet;
+		while (*var) {
+			if ((val = strchr(var, ':')) != 0) {
+				*val++ = '\0';
+				while (*val == ' ') {
+					val++;
+				}
+				if ((term = strchr(val, '\r')) != 0 || (term = strchr(val, '\n')) != 0) {
+					*term = '\0';
+					while (*term == '\r' || *term == '\n') {
+						term++;
+					}
+				}
+				switch_url_decode(val);
+				switch_snprintf(tmpname, sizeof(tmpname), "Orig-%s", var);
+				switch_event_add_header_string(local_event, SWITCH_STACK_BOTTOM, tmpname, val);
+				var = term + 1;
+			} else {
+				break;
+			}
+		}
+
+		if (var && strlen(var) > 1) {
+			switch_event_add_body(local_event, "%s", var);
+		}
+
+		switch_event_fire(&local_event);
+
+	}
+}
+
+/* Sequence numbers start over when the peer restarts (a different boot id). Returns SWITCH_FALSE for a packet
+   that is older than one already seen, it was counted as missed when the gap showed up. */
+static switch_bool_t peer_sequence(struct peer_status *p, const char *sender, uint32_t boot_id, uint64_t seq)
+{
+	if (!p->packets || p->boot_id != boot_id) {
+		if (p->packets) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "Peer %s restarted, sequence starts over at %" SWITCH_UINT64_T_FMT "\n",
+							  sender, seq);
+		}
+		p->boot_id = boot_id;
+		p->last_seq = seq;
+		p->packets++;
+		return SWITCH_TRUE;
+	}
+
+	if (seq <= p->last_seq) {
+		p->late++;
+		return SWITCH_FALSE;
+	}
+
+	if (seq > p->last_seq + 1) {
+		switch_event_t *local_event;
+		uint64_t missed = seq - p->last_seq - 1;
+
+		p->missed += missed;
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Lost %" SWITCH_UINT64_T_FMT " packets from peer %s\n", missed, sender);
+
+		if (switch_event_create_subclass(&local_event, SWITCH_EVENT_CUSTOM, MULTICAST_GAP) == SWITCH_STATUS_SUCCESS) {
+			switch_event_add_header_string(local_event, SWITCH_STACK_BOTTOM, "Peer", sender);
+			switch_event_add_header(local_event, SWITCH_STACK_BOTTOM, "Expected-Sequence", "%" SWITCH_UINT64_T_FMT, p->last_seq + 1);
+			switch_event_add_header(local_event, SWITCH_STACK_BOTTOM, "Received-Sequence", "%" SWITCH_UINT64_T_FMT, seq);
+			switch_event_add_header(local_event, SWITCH_STACK_BOTTOM, "Missed-Packets", "%" SWITCH_UINT64_T_FMT, missed);
+			switch_event_fire(&local_event);
+		}
+	}
+
+	p->last_seq = seq;
+	p->packets++;
+
+	return SWITCH_TRUE;
+}
+
+/* A packet-format batch datagram, buf has room for one more byte after len */
+static void batch_receive(unsigned char *buf, size_t len)
+{
+	unsigned char *p = buf + 4, *payload, *end;
+	char sender[256];
+	struct peer_status *peer;
+	uint8_t flags;
+	size_t slen, plen;
+	uint32_t boot_id;
+	uint64_t seq;
+	uint16_t count;
+
+	flags = *p++;
+	slen = *p++;
+
+	if (len < BATCH_HEADER_MIN + slen || !slen) {
+		return;
+	}
+
+	memcpy(sender, p, slen);
+	sender[slen] = '\0';
+	p += slen;
+	boot_id = (uint32_t) get_uint(p, 4);
+	p += 4;
+	seq = get_uint(p, 8);
+	p += 8;
+	count = (uint16_t) get_uint(p, 2);
+	p += 2;
+
+	payload = p;
+	plen = len - (p - buf);
+
+	if ((flags & BATCH_FLAG_SEALED)) {
+#ifdef HAVE_OPENSSL
+		if (!globals.psk) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Sealed packet from %s but no psk is configured\n", sender);
+			return;
+		}
+
+		if (plen < BATCH_NONCE_LEN + BATCH_TAG_LEN) {
+			return;
+		}
+
+		payload += BATCH_NONCE_LEN;
+		plen -= BATCH_NONCE_LEN + BATCH_TAG_LEN;
+
+		/* the sender is part of what is authenticated, a forged one must not get a peer entry */
+		if (!batch_open(buf, (int) (p - buf), p, payload, (int) plen, payload + plen)) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Dropping packet from %s that does not authenticate\n", sender);
+			return;
+		}
+
+		peer = peer_get(sender);
+#else
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Cannot open sealed packet from %s without OpenSSL support\n", sender);
+		return;
+#endif
+	} else if (globals.psk) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Dropping unsealed packet from %s, a psk is configured\n", sender);
+		return;
+	} else {
+		peer = peer_get(sender);
+	}
+
+	/* only after authentication, a forged sequence number must not move ours */
+	if (!peer_sequence(peer, sender, boot_id, seq)) {
+		return;
+	}
+
+	if ((flags & BATCH_FLAG_COMPRESSED)) {
+		int r;
+
+		if ((r = lz4_decompress(payload, plen, globals.inflate_buf, BATCH_MAX_BYTES)) < 0) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Dropping packet from %s that does not decompress\n", sender);
+			return;
+		}
+		payload = globals.inflate_buf;
+		plen = (size_t) r;
+	}
+
+	end = payload + plen;
+
+	/* each event is terminated in place for the parser, the byte it covers (the next length) is put back after */
+	for (p = payload; count && end - p >= 4; count--) {
+		size_t elen = (size_t) get_uint(p, 4);
+		unsigned char save;
+
+		if (elen > (size_t) (end - p - 4)) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Truncated packet from %s\n", sender);
+			break;
+		}
+
+		p += 4;
+		save = p[elen];
+		p[elen] = '\0';
+		fire_remote_event((char *) p);
+		p[elen] = save;
+		p += elen;
+	}
+}
+
+SWITCH_MODULE_RUNTIME_FUNCTION(mod_event_multicast_runtime)
+{
 	char *buf, *m;
 	switch_sockaddr_t *addr;
 
-	buf = (char *) malloc(MULTICAST_BUFFSIZE);
+	/* one more byte than a datagram can carry so the last event of a batch can be terminated in place */
+	buf = (char *) malloc(MULTICAST_BUFFSIZE + 1);
 	switch_assert(buf);
 	switch_sockaddr_info_get(&addr, NULL, SWITCH_UNSPEC, 0, 0, module_pool);
 	globals.running = 1;
@@ -522,6 +1284,11 @@ SWITCH_MODULE_RUNTIME_FUNCTION(mod_event_multicast_runtime)
 		}
 #endif
 
+		if (len >= BATCH_HEADER_MIN && !memcmp(buf, BATCH_MAGIC, 4)) {
+			batch_receive((unsigned char *) buf, len);
+			continue;
+		}
+
 		packet = buf;
 
 #ifdef HAVE_OPENSSL
@@ -568,39 +1335,7 @@ SWITCH_MODULE_RUNTIME_FUNCTION(mod_event_multicast_runtime)
 			continue;
 		}
 
-		/*switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "\nEVENT %d\n--------------------------------\n%s\n", (int) len, packet); */
-		if (switch_event_create_subclass(&local_event, SWITCH_EVENT_CUSTOM, MULTICAST_EVENT) == SWITCH_STATUS_SUCCESS) {
-			char *var, *val, *term = NULL, tmpname[128];
-			switch_event_add_header_string(local_event, SWITCH_STACK_BOTTOM, "Multicast", "yes");
-			var = packet;
-			while (*var) {
-				if ((val = strchr(var, ':')) != 0) {
-					*val++ = '\0';
-					while (*val == ' ') {
-						val++;
-					}
-					if ((term = strchr(val, '\r')) != 0 || (term = strchr(val, '\n')) != 0) {
-						*term = '\0';
-						while (*term == '\r' || *term == '\n') {
-							term++;
-						}
-					}
-					switch_url_decode(val);
-					switch_snprintf(tmpname, sizeof(tmpname), "Orig-%s", var);
-					switch_event_add_header_string(local_event, SWITCH_STACK_BOTTOM, tmpname, val);
-					var = term + 1;
-				} else {
-					break;
-				}
-			}
-
-			if (var && strlen(var) > 1) {
-				switch_event_add_body(local_event, "%s", var);
-			}
-
-			switch_event_fire(&local_event);
-
-		}
+		fire_remote_event(packet);
 
 	}
 
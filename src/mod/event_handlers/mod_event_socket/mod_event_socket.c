@@ -33,6 +33,14 @@
 #define CMD_BUFLEN 1024 * 1000
 #define MAX_QUEUE_LEN 25000
 #define MAX_MISSED 500
+#define SHARED_EVENT_LOCKS 16
+/* event loop mode: connections per reactor, queued output before a listener stops taking events,
+   events written per listener per pass and the deadline for the first command */
+#define REACTOR_MAX_CONNECTIONS 4096
+#define REACTOR_OUTPUT_HIGH_WATER (1024 * 1024)
+#define REACTOR_BATCH 64
+#define REACTOR_HANDSHAKE_TIMEOUT 25
+#define MAX_PACKET_LEN 10485760
 SWITCH_MODULE_LOAD_FUNCTION(mod_event_socket_load);
 SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_event_socket_shutdown);
 SWITCH_MODULE_RUNTIME_FUNCTION(mod_event_socket_runtime);
@@ -57,15 +65,38 @@ typedef enum {
 	LFLAG_RESUME = (1 << 13),
 	LFLAG_AUTH_EVENTS = (1 << 14),
 	LFLAG_ALL_EVENTS_AUTHED = (1 << 15),
-	LFLAG_ALLOW_LOG = (1 << 16)
+	LFLAG_ALLOW_LOG = (1 << 16),
+	LFLAG_COALESCE = (1 << 17)
 } event_flag_t;
 
+/* A filter line compiled when it is set, name_hash matches switch_event_header_t.hash */
+typedef struct listener_filter {
+	char *name;
+	unsigned long name_hash;
+	char *value;
+	int pos;
+	int is_regex;
+	switch_regex_t *re;
+	struct listener_filter *next;
+} listener_filter_t;
+
 typedef enum {
 	EVENT_FORMAT_PLAIN,
 	EVENT_FORMAT_XML,
-	EVENT_FORMAT_JSON
+	EVENT_FORMAT_JSON,
+	EVENT_FORMAT_BINARY
 } event_format_t;
 
+/* One copy of an event queued to every listener that wants it, each format is serialized once on first use */
+typedef struct shared_event {
+	switch_event_t *event;
+	/* Event-Sequence, 0 when the event has none */
+	uint64_t seq;
+	volatile switch_atomic_t refs;
+	char *body[EVENT_FORMAT_BINARY + 1];
+	switch_size_t body_len[EVENT_FORMAT_BINARY + 1];
+} shared_event_t;
+
 struct listener {
 	switch_socket_t *sock;
 	switch_queue_t *event_queue;
@@ -76,7 +107,6 @@ struct listener {
 	switch_mutex_t *filter_mutex;
 	uint32_t flags;
 	switch_log_level_t level;
-	char *ebuf;
 	uint8_t event_list[SWITCH_EVENT_ALL + 1];
 	uint8_t allowed_event_list[SWITCH_EVENT_ALL + 1];
 	switch_hash_t *event_hash;
@@ -94,16 +124,79 @@ struct listener {
 	char remote_ip[50];
 	switch_port_t remote_port;
 	switch_event_t *filters;
+	listener_filter_t *compiled_filters;
 	time_t linger_timeout;
 	struct listener *next;
+	/* next myevents listener of the same uuid in the subscription index */
+	struct listener *uuid_next;
+	/* event loop mode, NULL when the listener has its own thread */
+	struct reactor *reactor;
+	struct listener *reactor_next;
+	switch_pollfd_t *pollfd;
+	char *rbuf;
+	switch_size_t rbuf_size;
+	switch_size_t rbuf_used;
+	time_t handshake_deadline;
+	int session_locked;
+	int closing;
+	volatile int api_busy;
+	volatile switch_atomic_t api_pending;
+	switch_mutex_t *out_mutex;
+	switch_buffer_t *out_buffer;
+	/* backpressure: most output ever queued, passes that stopped at the high water mark, api calls */
+	switch_size_t out_high_water;
+	uint32_t out_stalls;
+	uint32_t api_queued;
+	uint32_t api_rejected;
+	/* coalesced delivery: first sequence the queue had no room for, the rest comes from the replay rings */
+	uint64_t behind_seq;
 };
 
 typedef struct listener listener_t;
 
+/* Recent events of one type (or CUSTOM subclass), oldest at (next - count) */
+typedef struct replay_ring {
+	shared_event_t **entries;
+	uint32_t next;
+	uint32_t count;
+	/* sequence of the newest event pushed out of the ring */
+	uint64_t dropped_seq;
+	/* allocated for a CUSTOM subclass rather than part of globals.replay */
+	int custom;
+	/* every ring that has recorded something, see globals.replay_rings */
+	struct replay_ring *next_ring;
+} replay_ring_t;
+
+/* One event loop thread serving many connections */
+typedef struct reactor {
+	uint32_t id;
+	switch_pollset_t *pollset;
+	switch_queue_t *adopt_queue;
+	listener_t *listeners;
+	/* guards count and commands, which event_socket_stats reads from other threads */
+	switch_mutex_t *mutex;
+	uint32_t count;
+	uint32_t commands;
+} reactor_t;
+
 static struct {
 	switch_mutex_t *listener_mutex;
 	switch_event_node_t *node;
 	int debug;
+	switch_mutex_t *serialize_mutex[SHARED_EVENT_LOCKS];
+	/* subscription index, rebuilt by event_handler under listener_mutex once it is dirty:
+	   listeners by event id (SWITCH_EVENT_ALL for those that want everything) and myevents listeners by uuid */
+	listener_t **by_event[SWITCH_EVENT_ALL + 1];
+	uint32_t by_event_count[SWITCH_EVENT_ALL + 1];
+	switch_hash_t *by_uuid;
+	volatile int index_dirty;
+	time_t last_expire_check;
+	replay_ring_t replay[SWITCH_EVENT_ALL + 1];
+	/* CUSTOM rings by subclass name */
+	switch_hash_t *replay_custom;
+	replay_ring_t *replay_rings;
+	/* newest Event-Sequence recorded */
+	uint64_t replay_seq;
 } globals;
 
 static struct {
@@ -126,8 +219,22 @@ static struct {
 	uint32_t acl_count;
 	uint32_t id;
 	int nat_map;
+	/* reactor-threads > 0 serves connections from an event loop pool instead of a thread each */
+	uint32_t reactor_threads;
+	uint32_t api_workers;
+	uint32_t api_queue_len;
+	/* events kept per event type for resume and coalesced delivery, 0 disables both */
+	uint32_t replay_size;
 } prefs;
 
+static struct {
+	reactor_t *reactors;
+	uint32_t count;
+	uint32_t next;
+	switch_queue_t *api_queue;
+	switch_memory_pool_t *pool;
+} reactors;
+
 
 static const char *format2str(event_format_t format)
 {
@@ -138,6 +245,8 @@ static const char *format2str(event_format_t format)
 		return "xml";
 	case EVENT_FORMAT_JSON:
 		return "json";
+	case EVENT_FORMAT_BINARY:
+		return "binary";
 	}
 
 	return "invalid";
@@ -146,6 +255,7 @@ static const char *format2str(event_format_t format)
 static void remove_listener(listener_t *listener);
 static void kill_listener(listener_t *l, const char *message);
 static void kill_all_listeners(void);
+static switch_status_t listener_send(listener_t *listener, const char *buf, switch_size_t *len);
 
 static uint32_t next_id(void)
 {
@@ -195,6 +305,170 @@ static switch_status_t socket_logger(const switch_log_node_t *node, switch_log_l
 	return SWITCH_STATUS_SUCCESS;
 }
 
+static shared_event_t *shared_event_create(switch_event_t **event)
+{
+	shared_event_t *se;
+
+	const char *seq;
+
+	switch_zmalloc(se, sizeof(*se));
+	se->event = *event;
+	*event = NULL;
+	switch_atomic_set(&se->refs, 1);
+
+	if ((seq = switch_event_get_header(se->event, "Event-Sequence"))) {
+		se->seq = (uint64_t) atoll(seq);
+	}
+
+	return se;
+}
+
+static shared_event_t *shared_event_ref(shared_event_t *se)
+{
+	switch_atomic_inc(&se->refs);
+	return se;
+}
+
+static void shared_event_release(shared_event_t **sep)
+{
+	shared_event_t *se = *sep;
+	int i;
+
+	*sep = NULL;
+
+	if (!se || switch_atomic_dec(&se->refs)) {
+		return;
+	}
+
+	for (i = 0; i <= EVENT_FORMAT_BINARY; i++) {
+		switch_safe_free(se->body[i]);
+	}
+
+	switch_event_destroy(&se->event);
+	free(se);
+}
+
+/* The serialized event, valid as long as the caller holds its reference */
+static const char *shared_event_body(shared_event_t *se, event_format_t format, switch_size_t *len)
+{
+	switch_mutex_t *mutex = globals.serialize_mutex[((uintptr_t) se / sizeof(*se)) % SHARED_EVENT_LOCKS];
+	char *body;
+	switch_size_t blen = 0;
+
+	switch_mutex_lock(mutex);
+
+	if (!(body = se->body[format])) {
+		if (format == EVENT_FORMAT_PLAIN) {
+			switch_event_serialize(se->event, &body, SWITCH_TRUE);
+		} else if (format == EVENT_FORMAT_BINARY) {
+			switch_event_serialize_binary(se->event, &body, &blen);
+		} else if (format == EVENT_FORMAT_JSON) {
+			switch_event_serialize_json(se->event, &body);
+		} else {
+			switch_xml_t xml;
+
+			if ((xml = switch_event_xmlize(se->event, SWITCH_VA_NONE))) {
+				body = switch_xml_toxml(xml, SWITCH_FALSE);
+				switch_xml_free(xml);
+			}
+		}
+
+		if (body) {
+			se->body[format] = body;
+			se->body_len[format] = format == EVENT_FORMAT_BINARY ? blen : strlen(body);
+		}
+	}
+
+	*len = se->body_len[format];
+
+	switch_mutex_unlock(mutex);
+
+	return body;
+}
+
+static void free_compiled_filters(listener_t *listener)
+{
+	listener_filter_t *f;
+
+	while ((f = listener->compiled_filters)) {
+		listener->compiled_filters = f->next;
+		switch_regex_safe_free(f->re);
+		free(f->name);
+		free(f->value);
+		free(f);
+	}
+}
+
+/* Turn listener->filters into listener_filter_t, called with filter_mutex held whenever the filters change */
+static void compile_filters(listener_t *listener)
+{
+	switch_event_header_t *hp;
+	listener_filter_t *f, *last = NULL;
+
+	free_compiled_filters(listener);
+
+	if (!listener->filters) {
+		return;
+	}
+
+	for (hp = listener->filters->headers; hp; hp = hp->next) {
+		const char *comp_to = hp->value;
+		switch_ssize_t hlen = -1;
+		int pos = 1;
+
+		while (comp_to && *comp_to) {
+			if (*comp_to == '+') {
+				pos = 1;
+			} else if (*comp_to == '-') {
+				pos = 0;
+			} else if (*comp_to != ' ') {
+				break;
+			}
+			comp_to++;
+		}
+
+		if (!comp_to) {
+			continue;
+		}
+
+		switch_zmalloc(f, sizeof(*f));
+		f->name = strdup(hp->name);
+		f->name_hash = switch_ci_hashfunc_default(hp->name, &hlen);
+		f->value = strdup(comp_to);
+		f->pos = pos;
+
+		if (*hp->value == '/') {
+			f->is_regex = 1;
+			f->re = switch_regex_compile_expression(comp_to);
+		}
+
+		if (last) {
+			last->next = f;
+		} else {
+			listener->compiled_filters = f;
+		}
+		last = f;
+	}
+}
+
+static const char *filter_header_value(switch_event_t *event, listener_filter_t *f)
+{
+	switch_event_header_t *hp;
+
+	for (hp = event->headers; hp; hp = hp->next) {
+		if ((!hp->hash || hp->hash == f->name_hash) && !strcasecmp(hp->name, f->name)) {
+			return hp->value;
+		}
+	}
+
+	/* same as switch_event_get_header(), a filter on _body matches the event body */
+	if (!strcmp(f->name, "_body")) {
+		return event->body;
+	}
+
+	return NULL;
+}
+
 static void flush_listener(listener_t *listener, switch_bool_t flush_log, switch_bool_t flush_events)
 {
 	void *pop;
@@ -210,10 +484,10 @@ static void flush_listener(listener_t *listener, switch_bool_t flush_log, switch
 
 	if (listener->event_queue) {
 		while (switch_queue_trypop(listener->event_queue, &pop) == SWITCH_STATUS_SUCCESS) {
-			switch_event_t *pevent = (switch_event_t *) pop;
+			shared_event_t *se = (shared_event_t *) pop;
 			if (!pop)
 				continue;
-			switch_event_destroy(&pevent);
+			shared_event_release(&se);
 		}
 	}
 }
@@ -252,6 +526,7 @@ static switch_status_t expire_listener(listener_t ** listener)
 	if (l->filters) {
 		switch_event_destroy(&l->filters);
 	}
+	free_compiled_filters(l);
 
 	switch_mutex_unlock(l->filter_mutex);
 	switch_thread_rwlock_unlock(l->rwlock);
@@ -261,24 +536,80 @@ static switch_status_t expire_listener(listener_t ** listener)
 	return SWITCH_STATUS_SUCCESS;
 }
 
-static void event_handler(switch_event_t *event)
+static void index_listeners(void)
 {
-	switch_event_t *clone = NULL;
-	listener_t *l, *lp, *last = NULL;
-	time_t now = switch_epoch_time_now(NULL);
+	listener_t *l;
+	uint32_t x;
 
-	switch_assert(event != NULL);
+	for (x = 0; x <= SWITCH_EVENT_ALL; x++) {
+		switch_safe_free(globals.by_event[x]);
+		globals.by_event_count[x] = 0;
+	}
 
-	if (!listen_list.ready) {
-		return;
+	if (globals.by_uuid) {
+		switch_core_hash_destroy(&globals.by_uuid);
 	}
+	switch_core_hash_init(&globals.by_uuid, NULL);
 
-	lp = listen_list.listeners;
+	for (l = listen_list.listeners; l; l = l->next) {
+		if (switch_test_flag(l, LFLAG_MYEVENTS) && l->session) {
+			const char *uuid = switch_core_session_get_uuid(l->session);
 
-	switch_mutex_lock(globals.listener_mutex);
-	while (lp) {
-		int send = 0;
+			l->uuid_next = switch_core_hash_find(globals.by_uuid, uuid);
+			switch_core_hash_insert(globals.by_uuid, uuid, l);
+		} else if (l->event_list[SWITCH_EVENT_ALL]) {
+			globals.by_event_count[SWITCH_EVENT_ALL]++;
+		} else {
+			for (x = 0; x < SWITCH_EVENT_ALL; x++) {
+				globals.by_event_count[x] += l->event_list[x] ? 1 : 0;
+			}
+		}
+	}
+
+	for (x = 0; x <= SWITCH_EVENT_ALL; x++) {
+		if (globals.by_event_count[x]) {
+			switch_zmalloc(globals.by_event[x], globals.by_event_count[x] * sizeof(listener_t *));
+			globals.by_event_count[x] = 0;
+		}
+	}
+
+	for (l = listen_list.listeners; l; l = l->next) {
+		if (switch_test_flag(l, LFLAG_MYEVENTS) && l->session) {
+			continue;
+		} else if (l->event_list[SWITCH_EVENT_ALL]) {
+			globals.by_event[SWITCH_EVENT_ALL][globals.by_event_count[SWITCH_EVENT_ALL]++] = l;
+		} else {
+			for (x = 0; x < SWITCH_EVENT_ALL; x++) {
+				if (l->event_list[x]) {
+					globals.by_event[x][globals.by_event_count[x]++] = l;
+				}
+			}
+		}
+	}
+
+	globals.index_dirty = 0;
+}
+
+static void destroy_listener_index(void)
+{
+	uint32_t x;
+
+	for (x = 0; x <= SWITCH_EVENT_ALL; x++) {
+		switch_safe_free(globals.by_event[x]);
+		globals.by_event_count[x] = 0;
+	}
 
+	if (globals.by_uuid) {
+		switch_core_hash_destroy(&globals.by_uuid);
+	}
+}
+
+/* Drop stateful listeners nobody polled in time, called with listener_mutex held */
+static void expire_listeners(time_t now)
+{
+	listener_t *l, *lp, *last = NULL;
+
+	for (lp = listen_list.listeners; lp;) {
 		l = lp;
 		lp = lp->next;
 
@@ -289,221 +620,615 @@ static void event_handler(switch_event_t *event)
 				} else {
 					listen_list.listeners = lp;
 				}
+				globals.index_dirty = 1;
 				continue;
 			}
 		}
 
-		if (l->expire_time || !switch_test_flag(l, LFLAG_EVENTS)) {
-			last = l;
-			continue;
-		}
+		last = l;
+	}
+}
+
+static int listener_wants_event(listener_t *l, switch_event_t *event)
+{
+	int send = 0;
+
+	if (l->expire_time || !switch_test_flag(l, LFLAG_EVENTS)) {
+		return 0;
+	}
 
-		if (l->event_list[SWITCH_EVENT_ALL]) {
+	if (l->event_list[SWITCH_EVENT_ALL]) {
+		send = 1;
+	} else if ((l->event_list[event->event_id])) {
+		if (event->event_id != SWITCH_EVENT_CUSTOM || !event->subclass_name || (switch_core_hash_find(l->event_hash, event->subclass_name))) {
 			send = 1;
-		} else if ((l->event_list[event->event_id])) {
-			if (event->event_id != SWITCH_EVENT_CUSTOM || !event->subclass_name || (switch_core_hash_find(l->event_hash, event->subclass_name))) {
-				send = 1;
-			}
 		}
+	}
 
-		if (send) {
-			switch_mutex_lock(l->filter_mutex);
+	if (send) {
+		switch_mutex_lock(l->filter_mutex);
 
-			if (l->filters && l->filters->headers) {
-				switch_event_header_t *hp;
-				const char *hval;
+		if (l->compiled_filters) {
+			listener_filter_t *f;
+			const char *hval;
 
-				send = 0;
-				
-				for (hp = l->filters->headers; hp; hp = hp->next) {
-					if ((hval = switch_event_get_header(event, hp->name))) {
-						const char *comp_to = hp->value;
-						int pos = 1, cmp = 0;
+			send = 0;
 
-						while (comp_to && *comp_to) {
-							if (*comp_to == '+') {
-								pos = 1;
-							} else if (*comp_to == '-') {
-								pos = 0;
-							} else if (*comp_to != ' ') {
-								break;
-							}
-							comp_to++;
-						}
+			for (f = l->compiled_filters; f; f = f->next) {
+				if ((hval = filter_header_value(event, f))) {
+					int cmp = 0;
 
-						if (send && pos) {
-							continue;
-						}
+					if (send && f->pos) {
+						continue;
+					}
 
-						if (!comp_to) {
-							continue;
-						}
+					if (f->is_regex) {
+						int ovector[30];
+						cmp = !!switch_regex_exec(f->re, hval, ovector, sizeof(ovector) / sizeof(ovector[0]));
+					} else {
+						cmp = !strcasecmp(hval, f->value);
+					}
 
-						if (*hp->value == '/') {
-							switch_regex_t *re = NULL;
-							int ovector[30];
-							cmp = !!switch_regex_perform(hval, comp_to, &re, ovector, sizeof(ovector) / sizeof(ovector[0]));
-							switch_regex_safe_free(re);
+					if (cmp) {
+						if (f->pos) {
+							send = 1;
 						} else {
-							cmp = !strcasecmp(hval, comp_to);
-						}
-
-						if (cmp) {
-							if (pos) {
-								send = 1;
-							} else {
-								send = 0;
-								break;
-							}
+							send = 0;
+							break;
 						}
 					}
 				}
 			}
-
-			switch_mutex_unlock(l->filter_mutex);
 		}
 
-		if (send && switch_test_flag(l, LFLAG_MYEVENTS)) {
-			char *uuid = switch_event_get_header(event, "unique-id");
-			if (!uuid || strcmp(uuid, switch_core_session_get_uuid(l->session))) {
-				send = 0;
-			}
-		}
+		switch_mutex_unlock(l->filter_mutex);
+	}
 
-		if (send) {
-			if (switch_event_dup(&clone, event) == SWITCH_STATUS_SUCCESS) {
-				if (switch_queue_trypush(l->event_queue, clone) == SWITCH_STATUS_SUCCESS) {
-					if (l->lost_events) {
-						int le = l->lost_events;
-						l->lost_events = 0;
-						switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(l->session), SWITCH_LOG_CRIT, "Lost %d events!\n", le);
-						clone = NULL;
-						if (switch_event_create(&clone, SWITCH_EVENT_TRAP) == SWITCH_STATUS_SUCCESS) {
-							switch_event_add_header(clone, SWITCH_STACK_BOTTOM, "info", "lost %d events", le);
-							switch_event_fire(&clone);
-						}
-					}
-				} else {
-					if (++l->lost_events > MAX_MISSED) {
-						kill_listener(l, NULL);
-					}
-					switch_event_destroy(&clone);
-				}
-			} else {
-				switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(l->session), SWITCH_LOG_ERROR, "Memory Error!\n");
-			}
+	if (send && switch_test_flag(l, LFLAG_MYEVENTS)) {
+		char *uuid = switch_event_get_header(event, "unique-id");
+		if (!uuid || strcmp(uuid, switch_core_session_get_uuid(l->session))) {
+			send = 0;
 		}
-		last = l;
 	}
-	switch_mutex_unlock(globals.listener_mutex);
+
+	return send;
 }
 
-SWITCH_STANDARD_APP(socket_function)
+static void queue_listener_event(listener_t *l, switch_event_t *event, shared_event_t **sep)
 {
-	char *host, *port_name, *path;
-	switch_socket_t *new_sock;
-	switch_sockaddr_t *sa;
-	switch_port_t port = 8084;
-	listener_t *listener;
-	int argc = 0, x = 0;
-	char *argv[80] = { 0 };
-	char *mydata;
-	switch_channel_t *channel = NULL;
+	switch_event_t *clone = NULL;
 
-	channel = switch_core_session_get_channel(session);
+	/* a listener catching up reads everything from the replay rings until it is current again */
+	if (l->behind_seq || !listener_wants_event(l, event)) {
+		return;
+	}
 
-	if (data && (mydata = switch_core_session_strdup(session, data))) {
-		argc = switch_separate_string(mydata, ' ', argv, (sizeof(argv) / sizeof(argv[0])));
+	/* copied once for the first listener, the others share it */
+	if (!*sep && switch_event_dup(&clone, event) == SWITCH_STATUS_SUCCESS) {
+		*sep = shared_event_create(&clone);
 	}
 
-	if (argc < 1) {
-		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Parse Error!\n");
-		return;
+	if (*sep) {
+		shared_event_t *qe = shared_event_ref(*sep);
+
+		if (switch_queue_trypush(l->event_queue, qe) == SWITCH_STATUS_SUCCESS) {
+			if (l->lost_events) {
+				int le = l->lost_events;
+				l->lost_events = 0;
+				switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(l->session), SWITCH_LOG_CRIT, "Lost %d events!\n", le);
+				clone = NULL;
+				if (switch_event_create(&clone, SWITCH_EVENT_TRAP) == SWITCH_STATUS_SUCCESS) {
+					switch_event_add_header(clone, SWITCH_STACK_BOTTOM, "info", "lost %d events", le);
+					switch_event_fire(&clone);
+				}
+			}
+		} else {
+			if (switch_test_flag(l, LFLAG_COALESCE) && qe->seq) {
+				l->behind_seq = qe->seq;
+			} else if (++l->lost_events > MAX_MISSED) {
+				kill_listener(l, NULL);
+			}
+			shared_event_release(&qe);
+		}
+	} else {
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(l->session), SWITCH_LOG_ERROR, "Memory Error!\n");
 	}
+}
 
-	host = argv[0];
+/* The ring an event is recorded in, CUSTOM events get one per subclass so a busy subclass does not push out the others.
+   Called with the listener mutex held */
+static replay_ring_t *replay_ring_get(switch_event_t *event)
+{
+	replay_ring_t *ring;
 
-	if (zstr(host)) {
-		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Missing Host!\n");
-		return;
-	}
+	if (event->event_id == SWITCH_EVENT_CUSTOM && event->subclass_name) {
+		if (!globals.replay_custom) {
+			switch_core_hash_init(&globals.replay_custom, NULL);
+		}
 
-	if ((port_name = strchr(host, ':'))) {
-		*port_name++ = '\0';
-		port = (switch_port_t) atoi(port_name);
-	}
+		if (!(ring = switch_core_hash_find(globals.replay_custom, event->subclass_name))) {
+			switch_zmalloc(ring, sizeof(*ring));
+			ring->custom = 1;
+			switch_core_hash_insert(globals.replay_custom, event->subclass_name, ring);
+		}
 
-	if ((path = strchr((port_name ? port_name : host), '/'))) {
-		*path++ = '\0';
-		switch_channel_set_variable(channel, "socket_path", path);
+		return ring;
 	}
 
-	switch_channel_set_variable(channel, "socket_host", host);
+	return &globals.replay[event->event_id < SWITCH_EVENT_ALL ? event->event_id : SWITCH_EVENT_ALL];
+}
 
-	if (switch_sockaddr_info_get(&sa, host, AF_INET, port, 0, switch_core_session_get_pool(session)) != SWITCH_STATUS_SUCCESS) {
-		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Socket Error!\n");
-		return;
-	}
+/* Called with the listener mutex held */
+static void replay_record(shared_event_t *se)
+{
+	replay_ring_t *ring = replay_ring_get(se->event);
 
-	if (switch_socket_create(&new_sock, AF_INET, SOCK_STREAM, SWITCH_PROTO_TCP, switch_core_session_get_pool(session))
-		!= SWITCH_STATUS_SUCCESS) {
-		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Socket Error!\n");
-		return;
+	if (!ring->entries) {
+		switch_zmalloc(ring->entries, prefs.replay_size * sizeof(*ring->entries));
+		ring->next_ring = globals.replay_rings;
+		globals.replay_rings = ring;
 	}
 
-	switch_socket_opt_set(new_sock, SWITCH_SO_KEEPALIVE, 1);
-	switch_socket_opt_set(new_sock, SWITCH_SO_TCP_NODELAY, 1);
+	if (ring->count == prefs.replay_size) {
+		shared_event_t *old = ring->entries[ring->next];
 
-	if (switch_socket_connect(new_sock, sa) != SWITCH_STATUS_SUCCESS) {
-		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Socket Error!\n");
-		return;
+		ring->dropped_seq = old->seq;
+		shared_event_release(&old);
+		ring->count--;
 	}
 
+	ring->entries[ring->next] = shared_event_ref(se);
+	ring->next = (ring->next + 1) % prefs.replay_size;
+	ring->count++;
 
-	if (!(listener = switch_core_session_alloc(session, sizeof(*listener)))) {
-		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Memory Error\n");
-		return;
+	if (se->seq > globals.replay_seq) {
+		globals.replay_seq = se->seq;
 	}
+}
 
-	switch_thread_rwlock_create(&listener->rwlock, switch_core_session_get_pool(session));
-	switch_queue_create(&listener->event_queue, MAX_QUEUE_LEN, switch_core_session_get_pool(session));
-	switch_queue_create(&listener->log_queue, MAX_QUEUE_LEN, switch_core_session_get_pool(session));
+static void replay_destroy(void)
+{
+	replay_ring_t *ring;
 
-	listener->sock = new_sock;
-	listener->pool = switch_core_session_get_pool(session);
-	listener->format = EVENT_FORMAT_PLAIN;
-	listener->session = session;
-	switch_set_flag(listener, LFLAG_ALLOW_LOG);
+	while ((ring = globals.replay_rings)) {
+		globals.replay_rings = ring->next_ring;
 
-	switch_mutex_init(&listener->flag_mutex, SWITCH_MUTEX_NESTED, listener->pool);
-	switch_mutex_init(&listener->filter_mutex, SWITCH_MUTEX_NESTED, listener->pool);
+		while (ring->count) {
+			shared_event_t *se = ring->entries[(ring->next + prefs.replay_size - ring->count) % prefs.replay_size];
+			shared_event_release(&se);
+			ring->count--;
+		}
 
-	switch_core_hash_init(&listener->event_hash, listener->pool);
-	switch_set_flag(listener, LFLAG_AUTHED);
-	switch_set_flag(listener, LFLAG_OUTBOUND);
-	for (x = 1; x < argc; x++) {
-		if (argv[x] && !strcasecmp(argv[x], "full")) {
-			switch_set_flag(listener, LFLAG_FULL);
-		} else if (argv[x] && !strcasecmp(argv[x], "async")) {
-			switch_set_flag(listener, LFLAG_ASYNC);
+		switch_safe_free(ring->entries);
+
+		if (ring->custom) {
+			free(ring);
+		} else {
+			memset(ring, 0, sizeof(*ring));
 		}
 	}
 
-	if (switch_test_flag(listener, LFLAG_ASYNC)) {
-		const char *var;
-
-		launch_listener_thread(listener);
+	if (globals.replay_custom) {
+		switch_core_hash_destroy(&globals.replay_custom);
+	}
 
-		while (switch_channel_ready(channel) && !switch_test_flag(listener, LFLAG_CONNECTED)) {
-			switch_cond_next();
-		}
+	globals.replay_seq = 0;
+}
 
-		switch_ivr_park(session, NULL);
+static int replay_cmp(const void *a, const void *b)
+{
+	const shared_event_t *x = *(shared_event_t * const *) a;
+	const shared_event_t *y = *(shared_event_t * const *) b;
 
-		switch_ivr_parse_all_events(session);
+	return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
 
-		if (switch_test_flag(listener, LFLAG_RESUME) || ((var = switch_channel_get_variable(channel, "socket_resume")) && switch_true(var))) {
-			switch_channel_set_state(channel, CS_EXECUTE);
+/* State events where only the newest one per channel matters to a client that is catching up */
+static switch_bool_t replay_coalesce_key(switch_event_t *event, char *key, switch_size_t len)
+{
+	const char *uuid;
+
+	switch (event->event_id) {
+	case SWITCH_EVENT_HEARTBEAT:
+		switch_snprintf(key, len, "%d", event->event_id);
+		return SWITCH_TRUE;
+	case SWITCH_EVENT_CHANNEL_STATE:
+	case SWITCH_EVENT_CHANNEL_CALLSTATE:
+	case SWITCH_EVENT_CALL_UPDATE:
+	case SWITCH_EVENT_SESSION_HEARTBEAT:
+	case SWITCH_EVENT_PRESENCE_IN:
+		if ((uuid = switch_event_get_header(event, "unique-id"))) {
+			switch_snprintf(key, len, "%d:%s", event->event_id, uuid);
+			return SWITCH_TRUE;
+		}
+		break;
+	default:
+		break;
+	}
+
+	return SWITCH_FALSE;
+}
+
+/* Drop all but the newest event per coalesce key, releasing the ones dropped */
+static uint32_t replay_coalesce(shared_event_t **list, uint32_t count)
+{
+	switch_hash_t *seen;
+	char key[128];
+	uint32_t i, n = 0;
+
+	switch_core_hash_init(&seen, NULL);
+
+	for (i = count; i-- > 0;) {
+		if (replay_coalesce_key(list[i]->event, key, sizeof(key))) {
+			if (switch_core_hash_find(seen, key)) {
+				shared_event_release(&list[i]);
+			} else {
+				switch_core_hash_insert(seen, key, list[i]);
+			}
+		}
+	}
+
+	switch_core_hash_destroy(&seen);
+
+	for (i = 0; i < count; i++) {
+		if (list[i]) {
+			list[n++] = list[i];
+		}
+	}
+
+	return n;
+}
+
+/* Called with the listener mutex held. A referenced copy of the recorded events from seq on that the listener wants,
+   in ring order; sort and coalesce it with replay_prepare() once the mutex is released.
+   *gap is set when a ring has already let go of an event the listener may have needed,
+   *upto is the newest sequence recorded so far for replay_queue() */
+static uint32_t replay_collect(listener_t *listener, uint64_t from, shared_event_t ***list, int *gap, uint64_t *upto)
+{
+	shared_event_t **out;
+	replay_ring_t *ring;
+	uint32_t i, total = 0, n = 0;
+
+	*list = NULL;
+	*upto = globals.replay_seq;
+
+	for (ring = globals.replay_rings; ring; ring = ring->next_ring) {
+		total += ring->count;
+	}
+
+	if (!total) {
+		return 0;
+	}
+
+	switch_zmalloc(out, total * sizeof(*out));
+
+	for (ring = globals.replay_rings; ring; ring = ring->next_ring) {
+		if (ring->dropped_seq >= from) {
+			*gap = 1;
+		}
+
+		for (i = 0; i < ring->count; i++) {
+			shared_event_t *se = ring->entries[(ring->next + prefs.replay_size - ring->count + i) % prefs.replay_size];
+
+			if (se->seq >= from && listener_wants_event(listener, se->event)) {
+				out[n++] = shared_event_ref(se);
+			}
+		}
+	}
+
+	*list = out;
+	return n;
+}
+
+/* Oldest first and coalesced when the listener asked for it, runs without the listener mutex */
+static uint32_t replay_prepare(listener_t *listener, shared_event_t **list, uint32_t count)
+{
+	if (count > 1) {
+		qsort(list, count, sizeof(*list), replay_cmp);
+
+		if (switch_test_flag(listener, LFLAG_COALESCE)) {
+			count = replay_coalesce(list, count);
+		}
+	}
+
+	return count;
+}
+
+/* Called with the listener mutex held. Queue as much of the list as fits, the queue takes over the references and
+   the rest is released. What does not fit is left to coalesced delivery or reported as incomplete, events recorded after
+   upto (while the list was prepared) are picked up by the next catch up */
+static uint32_t replay_queue(listener_t *listener, shared_event_t **list, uint32_t count, uint64_t upto)
+{
+	uint32_t i, queued;
+
+	for (i = 0; i < count; i++) {
+		if (switch_queue_trypush(listener->event_queue, list[i]) != SWITCH_STATUS_SUCCESS) {
+			break;
+		}
+	}
+
+	queued = i;
+
+	if (i < count && switch_test_flag(listener, LFLAG_COALESCE)) {
+		listener->behind_seq = list[i]->seq;
+	} else if (globals.replay_seq > upto) {
+		listener->behind_seq = upto + 1;
+	}
+
+	for (; i < count; i++) {
+		shared_event_release(&list[i]);
+	}
+
+	return queued;
+}
+
+/* Coalesced delivery, refill an empty queue from the replay rings */
+static void replay_catch_up(listener_t *listener)
+{
+	shared_event_t **list;
+	uint32_t count, queued;
+	uint64_t from, upto;
+	int gap = 0;
+
+	/* behind_seq stays set until the list is queued, so event_handler keeps leaving this listener to the rings */
+	switch_mutex_lock(globals.listener_mutex);
+	from = listener->behind_seq;
+	count = replay_collect(listener, from, &list, &gap, &upto);
+	switch_mutex_unlock(globals.listener_mutex);
+
+	count = replay_prepare(listener, list, count);
+
+	switch_mutex_lock(globals.listener_mutex);
+	listener->behind_seq = 0;
+	queued = replay_queue(listener, list, count, upto);
+	switch_mutex_unlock(globals.listener_mutex);
+
+	switch_safe_free(list);
+
+	if (gap) {
+		char buf[256];
+		switch_size_t len;
+
+		switch_snprintf(buf, sizeof(buf), "Content-Type: text/replay-gap\nReplay-From: %" SWITCH_UINT64_T_FMT "\n\n", from);
+		len = strlen(buf);
+		listener_send(listener, buf, &len);
+	}
+
+	if (globals.debug > 0) {
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(listener->session), SWITCH_LOG_DEBUG, "Catching up from %" SWITCH_UINT64_T_FMT
+						  ", %u of %u events queued%s\n", from, queued, count, gap ? ", some are gone" : "");
+	}
+}
+
+/* "resume <seq>": queue every recorded event after seq merged with what is already queued, so nothing is sent twice
+   or out of order. Returns the number queued, *total is how many there were */
+static uint32_t replay_resume(listener_t *listener, uint64_t from, int *gap, uint32_t *total)
+{
+	shared_event_t **list = NULL, **queued = NULL, **merged;
+	uint32_t count, qcount = 0, a = 0, b = 0, sent;
+	uint64_t upto;
+	void *pop;
+
+	switch_mutex_lock(globals.listener_mutex);
+
+	/* hold off event_handler until the replay is queued, what it records meanwhile is caught up afterwards */
+	listener->behind_seq = from;
+
+	if ((qcount = switch_queue_size(listener->event_queue))) {
+		switch_zmalloc(queued, qcount * sizeof(*queued));
+		qcount = 0;
+		while (switch_queue_trypop(listener->event_queue, &pop) == SWITCH_STATUS_SUCCESS) {
+			shared_event_t *se = (shared_event_t *) pop;
+
+			if (se->seq && se->seq < from) {
+				shared_event_release(&se);
+			} else {
+				queued[qcount++] = se;
+			}
+		}
+	}
+
+	count = replay_collect(listener, from, &list, gap, &upto);
+
+	switch_mutex_unlock(globals.listener_mutex);
+
+	count = replay_prepare(listener, list, count);
+
+	*total = 0;
+	switch_zmalloc(merged, (count + qcount + 1) * sizeof(*merged));
+	while (a < count || b < qcount) {
+		if (b == qcount || (a < count && list[a]->seq < queued[b]->seq)) {
+			merged[(*total)++] = list[a++];
+		} else {
+			if (a < count && list[a] == queued[b]) {
+				shared_event_release(&list[a++]);
+			}
+			merged[(*total)++] = queued[b++];
+		}
+	}
+
+	switch_mutex_lock(globals.listener_mutex);
+	listener->behind_seq = 0;
+	sent = replay_queue(listener, merged, *total, upto);
+	switch_mutex_unlock(globals.listener_mutex);
+
+	switch_safe_free(list);
+	switch_safe_free(queued);
+	free(merged);
+
+	return sent;
+}
+
+static void event_handler(switch_event_t *event)
+{
+	shared_event_t *se = NULL;
+	listener_t *l;
+	time_t now = switch_epoch_time_now(NULL);
+	const char *uuid;
+	uint32_t x;
+
+	switch_assert(event != NULL);
+
+	if (!listen_list.ready) {
+		return;
+	}
+
+	switch_mutex_lock(globals.listener_mutex);
+
+	if (now != globals.last_expire_check) {
+		globals.last_expire_check = now;
+		expire_listeners(now);
+	}
+
+	/* myevents listeners are indexed by the uuid their session had, switch_core_session_set_uuid() moves them */
+	if (event->event_id == SWITCH_EVENT_CHANNEL_UUID) {
+		globals.index_dirty = 1;
+	}
+
+	if (globals.index_dirty) {
+		index_listeners();
+	}
+
+	if (prefs.replay_size) {
+		switch_event_t *clone = NULL;
+
+		if (switch_event_dup(&clone, event) == SWITCH_STATUS_SUCCESS) {
+			se = shared_event_create(&clone);
+			if (se->seq) {
+				replay_record(se);
+			}
+		}
+	}
+
+	/* only the listeners subscribed to this event id, or to its uuid for myevents */
+	for (x = 0; x < globals.by_event_count[SWITCH_EVENT_ALL]; x++) {
+		queue_listener_event(globals.by_event[SWITCH_EVENT_ALL][x], event, &se);
+	}
+
+	if (event->event_id < SWITCH_EVENT_ALL) {
+		for (x = 0; x < globals.by_event_count[event->event_id]; x++) {
+			queue_listener_event(globals.by_event[event->event_id][x], event, &se);
+		}
+	}
+
+	if ((uuid = switch_event_get_header(event, "unique-id"))) {
+		for (l = switch_core_hash_find(globals.by_uuid, uuid); l; l = l->uuid_next) {
+			queue_listener_event(l, event, &se);
+		}
+	}
+
+	switch_mutex_unlock(globals.listener_mutex);
+
+	shared_event_release(&se);
+}
+
+SWITCH_STANDARD_APP(socket_function)
+{
+	char *host, *port_name, *path;
+	switch_socket_t *new_sock;
+	switch_sockaddr_t *sa;
+	switch_port_t port = 8084;
+	listener_t *listener;
+	int argc = 0, x = 0;
+	char *argv[80] = { 0 };
+	char *mydata;
+	switch_channel_t *channel = NULL;
+
+	channel = switch_core_session_get_channel(session);
+
+	if (data && (mydata = switch_core_session_strdup(session, data))) {
+		argc = switch_separate_string(mydata, ' ', argv, (sizeof(argv) / sizeof(argv[0])));
+	}
+
+	if (argc < 1) {
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Parse Error!\n");
+		return;
+	}
+
+	host = argv[0];
+
+	if (zstr(host)) {
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Missing Host!\n");
+		return;
+	}
+
+	if ((port_name = strchr(host, ':'))) {
+		*port_name++ = '\0';
+		port = (switch_port_t) atoi(port_name);
+	}
+
+	if ((path = strchr((port_name ? port_name : host), '/'))) {
+		*path++ = '\0';
+		switch_channel_set_variable(channel, "socket_path", path);
+	}
+
+	switch_channel_set_variable(channel, "socket_host", host);
+
+	if (switch_sockaddr_info_get(&sa, host, AF_INET, port, 0, switch_core_session_get_pool(session)) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Socket Error!\n");
+		return;
+	}
+
+	if (switch_socket_create(&new_sock, AF_INET, SOCK_STREAM, SWITCH_PROTO_TCP, switch_core_session_get_pool(session))
+		!= SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Socket Error!\n");
+		return;
+	}
+
+	switch_socket_opt_set(new_sock, SWITCH_SO_KEEPALIVE, 1);
+	switch_socket_opt_set(new_sock, SWITCH_SO_TCP_NODELAY, 1);
+
+	if (switch_socket_connect(new_sock, sa) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Socket Error!\n");
+		return;
+	}
+
+
+	if (!(listener = switch_core_session_alloc(session, sizeof(*listener)))) {
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Memory Error\n");
+		return;
+	}
+
+	switch_thread_rwlock_create(&listener->rwlock, switch_core_session_get_pool(session));
+	switch_queue_create(&listener->event_queue, MAX_QUEUE_LEN, switch_core_session_get_pool(session));
+	switch_queue_create(&listener->log_queue, MAX_QUEUE_LEN, switch_core_session_get_pool(session));
+
+	listener->sock = new_sock;
+	listener->pool = switch_core_session_get_pool(session);
+	listener->format = EVENT_FORMAT_PLAIN;
+	listener->session = session;
+	switch_set_flag(listener, LFLAG_ALLOW_LOG);
+
+	switch_mutex_init(&listener->flag_mutex, SWITCH_MUTEX_NESTED, listener->pool);
+	switch_mutex_init(&listener->filter_mutex, SWITCH_MUTEX_NESTED, listener->pool);
+	switch_mutex_init(&listener->out_mutex, SWITCH_MUTEX_NESTED, listener->pool);
+
+	switch_core_hash_init(&listener->event_hash, listener->pool);
+	switch_set_flag(listener, LFLAG_AUTHED);
+	switch_set_flag(listener, LFLAG_OUTBOUND);
+	for (x = 1; x < argc; x++) {
+		if (argv[x] && !strcasecmp(argv[x], "full")) {
+			switch_set_flag(listener, LFLAG_FULL);
+		} else if (argv[x] && !strcasecmp(argv[x], "async")) {
+			switch_set_flag(listener, LFLAG_ASYNC);
+		}
+	}
+
+	if (switch_test_flag(listener, LFLAG_ASYNC)) {
+		const char *var;
+
+		launch_listener_thread(listener);
+
+		while (switch_channel_ready(channel) && !switch_test_flag(listener, LFLAG_CONNECTED)) {
+			switch_cond_next();
+		}
+
+		switch_ivr_park(session, NULL);
+
+		switch_ivr_parse_all_events(session);
+
+		if (switch_test_flag(listener, LFLAG_RESUME) || ((var = switch_channel_get_variable(channel, "socket_resume")) && switch_true(var))) {
+			switch_channel_set_state(channel, CS_EXECUTE);
 		}
 
 		return;
@@ -552,6 +1277,16 @@ SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_event_socket_shutdown)
 
 	switch_event_unbind(&globals.node);
 
+	switch_mutex_lock(globals.listener_mutex);
+	destroy_listener_index();
+	replay_destroy();
+	switch_mutex_unlock(globals.listener_mutex);
+
+	if (reactors.pool && !prefs.threads) {
+		switch_core_destroy_memory_pool(&reactors.pool);
+	}
+	memset(&reactors, 0, sizeof(reactors));
+
 	switch_safe_free(prefs.ip);
 	switch_safe_free(prefs.password);
 
@@ -564,6 +1299,7 @@ static void add_listener(listener_t *listener)
 	switch_mutex_lock(globals.listener_mutex);
 	listener->next = listen_list.listeners;
 	listen_list.listeners = listener;
+	globals.index_dirty = 1;
 	switch_mutex_unlock(globals.listener_mutex);
 }
 
@@ -582,9 +1318,81 @@ static void remove_listener(listener_t *listener)
 		}
 		last = l;
 	}
+	globals.index_dirty = 1;
 	switch_mutex_unlock(globals.listener_mutex);
 }
 
+/* Called with out_mutex held, writes what the socket takes without blocking */
+static void listener_flush_output(listener_t *listener)
+{
+	const void *data;
+	switch_size_t len;
+	switch_status_t status;
+
+	while (listener->sock && (len = switch_buffer_peek_zerocopy(listener->out_buffer, &data))) {
+		status = switch_socket_send_nonblock(listener->sock, data, &len);
+
+		if (len) {
+			switch_buffer_toss(listener->out_buffer, len);
+		}
+
+		if (status != SWITCH_STATUS_SUCCESS) {
+			if (!SWITCH_STATUS_IS_BREAK(status)) {
+				listener->closing = 1;
+			}
+			break;
+		}
+	}
+}
+
+static switch_size_t listener_output_pending(listener_t *listener)
+{
+	switch_size_t pending = 0;
+
+	if (listener->reactor) {
+		switch_mutex_lock(listener->out_mutex);
+		pending = switch_buffer_inuse(listener->out_buffer);
+		switch_mutex_unlock(listener->out_mutex);
+	}
+
+	return pending;
+}
+
+/* Every write to a client goes through here under out_mutex so one message never interleaves with another,
+   in event loop mode it is queued and the reactor writes it out */
+static switch_status_t listener_sendv(listener_t *listener, const char **bufs, const switch_size_t *lens, uint32_t count, switch_size_t *len)
+{
+	switch_status_t status;
+	switch_size_t inuse;
+	uint32_t i;
+
+	if (!listener->reactor) {
+		switch_mutex_lock(listener->out_mutex);
+		status = switch_socket_sendv(listener->sock, bufs, lens, count, len);
+		switch_mutex_unlock(listener->out_mutex);
+		return status;
+	}
+
+	*len = 0;
+
+	switch_mutex_lock(listener->out_mutex);
+	for (i = 0; i < count; i++) {
+		*len += switch_buffer_write(listener->out_buffer, bufs[i], lens[i]);
+	}
+	if ((inuse = switch_buffer_inuse(listener->out_buffer)) > listener->out_high_water) {
+		listener->out_high_water = inuse;
+	}
+	listener_flush_output(listener);
+	switch_mutex_unlock(listener->out_mutex);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+static switch_status_t listener_send(listener_t *listener, const char *buf, switch_size_t *len)
+{
+	return listener_sendv(listener, &buf, len, 1, len);
+}
+
 static void send_disconnect(listener_t *listener, const char *message)
 {
 	
@@ -606,10 +1414,10 @@ static void send_disconnect(listener_t *listener, const char *message)
 	}
 	
 	len = strlen(disco_buf);
-	switch_socket_send(listener->sock, disco_buf, &len);
+	listener_send(listener, disco_buf, &len);
 	if (len > 0) {
 		len = mlen;
-		switch_socket_send(listener->sock, message, &len);
+		listener_send(listener, message, &len);
 	}
 }
 
@@ -623,7 +1431,10 @@ static void kill_listener(listener_t *l, const char *message)
 	switch_clear_flag(l, LFLAG_RUNNING);
 	if (l->sock) {
 		switch_socket_shutdown(l->sock, SWITCH_SHUTDOWN_READWRITE);
-		switch_socket_close(l->sock);
+		/* the reactor closes its own sockets once they are out of its pollset */
+		if (!l->reactor) {
+			switch_socket_close(l->sock);
+		}
 	}
 
 }
@@ -675,6 +1486,46 @@ static void xmlize_listener(listener_t *listener, switch_stream_handle_t *stream
 	stream->write_function(stream, " </listener>\n");
 }
 
+SWITCH_STANDARD_API(event_socket_stats_function)
+{
+	listener_t *l;
+	uint32_t x;
+
+	stream->write_function(stream, "mode: %s reactors: %u api-queue: %u/%u\n", reactors.count ? "reactor" : "thread", reactors.count,
+						   reactors.api_queue ? switch_queue_size(reactors.api_queue) : 0, prefs.api_queue_len);
+	for (x = 0; x < reactors.count; x++) {
+		reactor_t *reactor = &reactors.reactors[x];
+		uint32_t count, commands;
+
+		switch_mutex_lock(reactor->mutex);
+		count = reactor->count;
+		commands = reactor->commands;
+		switch_mutex_unlock(reactor->mutex);
+
+		stream->write_function(stream, "reactor %u: connections: %u commands: %u\n", x, count, commands);
+	}
+	stream->write_function(stream, "%-6s %-22s %-8s %8s %8s %10s %10s %8s %8s %8s\n",
+						   "id", "remote", "reactor", "queued", "lost", "pending", "highwater", "stalls", "api", "rejected");
+
+	switch_mutex_lock(globals.listener_mutex);
+	for (l = listen_list.listeners; l; l = l->next) {
+		char remote[80];
+		char rid[16] = "-";
+
+		switch_snprintf(remote, sizeof(remote), "%s:%d", l->remote_ip, l->remote_port);
+		if (l->reactor) {
+			switch_snprintf(rid, sizeof(rid), "%u", l->reactor->id);
+		}
+
+		stream->write_function(stream, "%-6u %-22s %-8s %8u %8d %10" SWITCH_SIZE_T_FMT " %10" SWITCH_SIZE_T_FMT " %8u %8u %8u\n",
+							   l->id, remote, rid, switch_queue_size(l->event_queue), l->lost_events,
+							   listener_output_pending(l), l->out_high_water, l->out_stalls, l->api_queued, l->api_rejected);
+	}
+	switch_mutex_unlock(globals.listener_mutex);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
 SWITCH_STANDARD_API(event_sink_function)
 {
 	char *http = NULL;
@@ -759,6 +1610,7 @@ SWITCH_STANDARD_API(event_sink_function)
 
 	  filter_end:
 
+		compile_filters(listener);
 		switch_mutex_unlock(listener->filter_mutex);
 
 	} else if (!strcasecmp(wcmd, "stop-logging")) {
@@ -832,6 +1684,7 @@ SWITCH_STANDARD_API(event_sink_function)
 		listener->format = EVENT_FORMAT_PLAIN;
 		switch_mutex_init(&listener->flag_mutex, SWITCH_MUTEX_NESTED, listener->pool);
 		switch_mutex_init(&listener->filter_mutex, SWITCH_MUTEX_NESTED, listener->pool);
+		switch_mutex_init(&listener->out_mutex, SWITCH_MUTEX_NESTED, listener->pool);
 
 		switch_core_hash_init(&listener->event_hash, listener->pool);
 		switch_set_flag(listener, LFLAG_AUTHED);
@@ -949,7 +1802,7 @@ SWITCH_STANDARD_API(event_sink_function)
 		char *id = switch_event_get_header(stream->param_event, "listen-id");
 		uint32_t idl = 0;
 		void *pop;
-		switch_event_t *pevent = NULL;
+		shared_event_t *se = NULL;
 
 		if (id) {
 			idl = (uint32_t) atol(id);
@@ -991,40 +1844,31 @@ SWITCH_STANDARD_API(event_sink_function)
 		stream->write_function(stream, "<events>\n");
 
 		while (switch_queue_trypop(listener->event_queue, &pop) == SWITCH_STATUS_SUCCESS) {
-			//char *etype;
-			pevent = (switch_event_t *) pop;
+			const char *body;
+			switch_size_t blen;
+
+			se = (shared_event_t *) pop;
 
 			if (listener->format == EVENT_FORMAT_PLAIN) {
-				//etype = "plain";
-				switch_event_serialize(pevent, &listener->ebuf, SWITCH_TRUE);
-				stream->write_function(stream, "<event type=\"plain\">\n%s</event>", listener->ebuf);
+				body = shared_event_body(se, EVENT_FORMAT_PLAIN, &blen);
+				stream->write_function(stream, "<event type=\"plain\">\n%s</event>", switch_str_nil(body));
 			} else if (listener->format == EVENT_FORMAT_JSON) {
-				//etype = "json";
-				switch_event_serialize_json(pevent, &listener->ebuf);
+				shared_event_body(se, EVENT_FORMAT_JSON, &blen);
 			} else {
-				switch_xml_t xml;
-				//etype = "xml";
-
-				if ((xml = switch_event_xmlize(pevent, SWITCH_VA_NONE))) {
-					listener->ebuf = switch_xml_toxml(xml, SWITCH_FALSE);
-					switch_xml_free(xml);
-				} else {
+				if (!(body = shared_event_body(se, EVENT_FORMAT_XML, &blen))) {
 					stream->write_function(stream, "<data><reply type=\"error\">XML Render Error</reply></data>\n");
 					break;
 				}
 
-				stream->write_function(stream, "%s\n", listener->ebuf);
+				stream->write_function(stream, "%s\n", body);
 			}
 
-			switch_safe_free(listener->ebuf);
-			switch_event_destroy(&pevent);
+			shared_event_release(&se);
 		}
 
 		stream->write_function(stream, " </events>\n</data>\n");
 
-		if (pevent) {
-			switch_event_destroy(&pevent);
-		}
+		shared_event_release(&se);
 
 		switch_thread_rwlock_unlock(listener->rwlock);
 	} else if (!strcasecmp(wcmd, "exec-fsapi")) {
@@ -1057,39 +1901,234 @@ SWITCH_STANDARD_API(event_sink_function)
 		stream->write_function(stream, "<data><reply type=\"error\">INVALID COMMAND!</reply></data\n");
 	}
 
-  end:
+  end:
+
+	stream->write_function(stream, "</root>\n\n");
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+
+SWITCH_MODULE_LOAD_FUNCTION(mod_event_socket_load)
+{
+	switch_application_interface_t *app_interface;
+	switch_api_interface_t *api_interface;
+	int x;
+
+	memset(&globals, 0, sizeof(globals));
+
+	switch_mutex_init(&globals.listener_mutex, SWITCH_MUTEX_NESTED, pool);
+	for (x = 0; x < SHARED_EVENT_LOCKS; x++) {
+		switch_mutex_init(&globals.serialize_mutex[x], SWITCH_MUTEX_NESTED, pool);
+	}
+
+	memset(&listen_list, 0, sizeof(listen_list));
+	switch_mutex_init(&listen_list.sock_mutex, SWITCH_MUTEX_NESTED, pool);
+
+	if (switch_event_bind_removable(modname, SWITCH_EVENT_ALL, SWITCH_EVENT_SUBCLASS_ANY, event_handler, NULL, &globals.node) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Couldn't bind!\n");
+		return SWITCH_STATUS_GENERR;
+	}
+
+	switch_log_bind_logger(socket_logger, SWITCH_LOG_DEBUG, SWITCH_FALSE);
+
+	/* connect my internal structure to the blank pointer passed to me */
+	*module_interface = switch_loadable_module_create_module_interface(pool, modname);
+	SWITCH_ADD_APP(app_interface, "socket", "Connect to a socket", "Connect to a socket", socket_function, "<ip>[:<port>]", SAF_SUPPORT_NOMEDIA);
+	SWITCH_ADD_API(api_interface, "event_sink", "event_sink", event_sink_function, "<web data>");
+	SWITCH_ADD_API(api_interface, "event_socket_stats", "Show per connection queue and backpressure counters", event_socket_stats_function, "");
+
+	/* indicate that the module should continue to be loaded */
+	return SWITCH_STATUS_SUCCESS;
+}
+
+/* Turn a received header block into a SOCKET_DATA event, returns the content-length of the body that follows */
+static int parse_packet_headers(char *mbuf, switch_event_t **event)
+{
+	char *next, *cur = mbuf;
+	int count = 0, clen = 0;
+
+	while (cur) {
+		if ((next = strchr(cur, '\r')) || (next = strchr(cur, '\n'))) {
+			while (*next == '\r' || *next == '\n') {
+				next++;
+			}
+		}
+		count++;
+		if (count == 1) {
+			switch_event_create(event, SWITCH_EVENT_SOCKET_DATA);
+			switch_event_add_header_string(*event, SWITCH_STACK_BOTTOM, "Command", mbuf);
+		} else if (cur) {
+			char *var, *val;
+			var = cur;
+			strip_cr(var);
+			if (!zstr(var)) {
+				if ((val = strchr(var, ':'))) {
+					*val++ = '\0';
+					while (*val == ' ') {
+						val++;
+					}
+				}
+				if (var && val) {
+					switch_event_add_header_string(*event, SWITCH_STACK_BOTTOM, var, val);
+					if (!strcasecmp(var, "content-length")) {
+						clen = atoi(val);
+					}
+				}
+			}
+		}
+
+		cur = next;
+	}
+
+	return clen;
+}
+
+/* Write out queued logs and events, sets *did_work when anything was sent */
+static void deliver_queued(listener_t *listener, uint8_t *did_work)
+{
+	char buf[1024] = "";
+	switch_size_t len;
+	void *pop;
+	uint32_t sent = 0;
+
+	if (switch_test_flag(listener, LFLAG_LOG)) {
+		if (switch_queue_trypop(listener->log_queue, &pop) == SWITCH_STATUS_SUCCESS) {
+			switch_log_node_t *dnode = (switch_log_node_t *) pop;
+
+			if (dnode->data) {
+				const char *bufs[2];
+				switch_size_t lens[2];
+
+				switch_snprintf(buf, sizeof(buf),
+								"Content-Type: log/data\n"
+								"Content-Length: %" SWITCH_SSIZE_T_FMT "\n"
+								"Log-Level: %d\n"
+								"Text-Channel: %d\n"
+								"Log-File: %s\n"
+								"Log-Func: %s\n"
+								"Log-Line: %d\n"
+								"User-Data: %s\n"
+								"\n",
+								strlen(dnode->data),
+								dnode->level, dnode->channel, dnode->file, dnode->func, dnode->line, switch_str_nil(dnode->userdata)
+					);
+				bufs[0] = buf;
+				lens[0] = strlen(buf);
+				bufs[1] = dnode->data;
+				lens[1] = strlen(dnode->data);
+				listener_sendv(listener, bufs, lens, 2, &len);
+			}
+
+			switch_log_node_free(&dnode);
+			*did_work = 1;
+		}
+	}
+
+
+	if (listener->session) {
+		switch_channel_t *chan = switch_core_session_get_channel(listener->session);
+		if (switch_channel_get_state(chan) < CS_HANGUP && switch_channel_test_flag(chan, CF_DIVERT_EVENTS)) {
+			switch_event_t *e = NULL;
+			while (switch_core_session_dequeue_event(listener->session, &e, SWITCH_TRUE) == SWITCH_STATUS_SUCCESS) {
+				shared_event_t *se = shared_event_create(&e);
+
+				if (switch_queue_trypush(listener->event_queue, se) != SWITCH_STATUS_SUCCESS) {
+					e = se->event;
+					se->event = NULL;
+					shared_event_release(&se);
+					switch_core_session_queue_event(listener->session, &e);
+					break;
+				}
+			}
+		}
+	}
+
+	if (switch_test_flag(listener, LFLAG_EVENTS)) {
+		if (listener->behind_seq && !switch_queue_size(listener->event_queue)) {
+			replay_catch_up(listener);
+		}
+
+		while (switch_queue_trypop(listener->event_queue, &pop) == SWITCH_STATUS_SUCCESS) {
+			char hbuf[512];
+			shared_event_t *se = (shared_event_t *) pop;
+			const char *etype, *bufs[2];
+			switch_size_t lens[2];
 
-	stream->write_function(stream, "</root>\n\n");
+			*did_work = 1;
+			if (listener->format == EVENT_FORMAT_PLAIN) {
+				etype = "plain";
+			} else if (listener->format == EVENT_FORMAT_JSON) {
+				etype = "json";
+			} else if (listener->format == EVENT_FORMAT_BINARY) {
+				etype = "binary";
+			} else {
+				etype = "xml";
+			}
 
-	return SWITCH_STATUS_SUCCESS;
-}
+			if (!(bufs[1] = shared_event_body(se, listener->format, &lens[1]))) {
+				switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(listener->session), SWITCH_LOG_ERROR, "%s ERROR!\n", etype);
+				goto endloop;
+			}
 
+			switch_snprintf(hbuf, sizeof(hbuf), "Content-Length: %" SWITCH_SSIZE_T_FMT "\n" "Content-Type: text/event-%s\n" "\n", lens[1], etype);
 
-SWITCH_MODULE_LOAD_FUNCTION(mod_event_socket_load)
-{
-	switch_application_interface_t *app_interface;
-	switch_api_interface_t *api_interface;
+			/* header and the shared body in one write, the body is never copied */
+			bufs[0] = hbuf;
+			lens[0] = strlen(hbuf);
+			listener_sendv(listener, bufs, lens, 2, &len);
 
-	memset(&globals, 0, sizeof(globals));
+		  endloop:
 
-	switch_mutex_init(&globals.listener_mutex, SWITCH_MUTEX_NESTED, pool);
+			shared_event_release(&se);
 
-	memset(&listen_list, 0, sizeof(listen_list));
-	switch_mutex_init(&listen_list.sock_mutex, SWITCH_MUTEX_NESTED, pool);
+			/* in event loop mode a slow reader keeps the rest queued, where MAX_MISSED eventually applies */
+			if (listener->reactor) {
+				if (listener_output_pending(listener) > REACTOR_OUTPUT_HIGH_WATER) {
+					listener->out_stalls++;
+					break;
+				}
+				if (++sent >= REACTOR_BATCH) {
+					break;
+				}
+			}
+		}
+	}
+}
 
-	if (switch_event_bind_removable(modname, SWITCH_EVENT_ALL, SWITCH_EVENT_SUBCLASS_ANY, event_handler, NULL, &globals.node) != SWITCH_STATUS_SUCCESS) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Couldn't bind!\n");
-		return SWITCH_STATUS_GENERR;
+/* Linger handling once the controlled channel is gone, SWITCH_STATUS_FALSE when the connection should close */
+static switch_status_t check_disconnect(listener_t *listener, switch_channel_t *channel)
+{
+	switch_size_t len, mlen;
+
+	if (switch_test_flag(listener, LFLAG_HANDLE_DISCO) && switch_epoch_time_now(NULL) > listener->linger_timeout) {
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(listener->session), SWITCH_LOG_DEBUG, "linger timeout, closing socket\n");
+		return SWITCH_STATUS_FALSE;
 	}
 
-	switch_log_bind_logger(socket_logger, SWITCH_LOG_DEBUG, SWITCH_FALSE);
+	if (channel && switch_channel_down(channel) && !switch_test_flag(listener, LFLAG_HANDLE_DISCO)) {
+		switch_set_flag_locked(listener, LFLAG_HANDLE_DISCO);
+		if (switch_test_flag(listener, LFLAG_LINGER)) {
+			char message[128] = "";
+			char disco_buf[512] = "";
 
-	/* connect my internal structure to the blank pointer passed to me */
-	*module_interface = switch_loadable_module_create_module_interface(pool, modname);
-	SWITCH_ADD_APP(app_interface, "socket", "Connect to a socket", "Connect to a socket", socket_function, "<ip>[:<port>]", SAF_SUPPORT_NOMEDIA);
-	SWITCH_ADD_API(api_interface, "event_sink", "event_sink", event_sink_function, "<web data>");
+			switch_snprintf(message, sizeof(message),
+							"Channel %s has disconnected, lingering by request from remote.\n", switch_channel_get_name(channel));
+			mlen = strlen(message);
+
+			switch_snprintf(disco_buf, sizeof(disco_buf), "Content-Type: text/disconnect-notice\n"
+							"Controlled-Session-UUID: %s\n"
+							"Content-Disposition: linger\n" "Content-Length: %d\n\n", switch_core_session_get_uuid(listener->session), (int) mlen);
+
+			len = strlen(disco_buf);
+			listener_send(listener, disco_buf, &len);
+			len = mlen;
+			listener_send(listener, message, &len);
+		} else {
+			return SWITCH_STATUS_FALSE;
+		}
+	}
 
-	/* indicate that the module should continue to be loaded */
 	return SWITCH_STATUS_SUCCESS;
 }
 
@@ -1097,16 +2136,12 @@ static switch_status_t read_packet(listener_t *listener, switch_event_t **event,
 {
 	switch_size_t mlen, bytes = 0;
 	char *mbuf = NULL;
-	char buf[1024] = "";
-	switch_size_t len;
 	switch_status_t status = SWITCH_STATUS_SUCCESS;
-	int count = 0;
 	uint32_t elapsed = 0;
 	time_t start = 0;
-	void *pop;
 	char *ptr;
 	uint8_t crcount = 0;
-	uint32_t max_len = 10485760, block_len = 2048, buf_len = 0;
+	uint32_t max_len = MAX_PACKET_LEN, block_len = 2048, buf_len = 0;
 	switch_channel_t *channel = NULL;
 	int clen = 0;
 
@@ -1174,72 +2209,31 @@ static switch_status_t read_packet(listener_t *listener, switch_event_t **event,
 			}
 
 			if (crcount == 2) {
-				char *next;
-				char *cur = mbuf;
 				bytes = 0;
-				while (cur) {
-					if ((next = strchr(cur, '\r')) || (next = strchr(cur, '\n'))) {
-						while (*next == '\r' || *next == '\n') {
-							next++;
-						}
-					}
-					count++;
-					if (count == 1) {
-						switch_event_create(event, SWITCH_EVENT_SOCKET_DATA);
-						switch_event_add_header_string(*event, SWITCH_STACK_BOTTOM, "Command", mbuf);
-					} else if (cur) {
-						char *var, *val;
-						var = cur;
-						strip_cr(var);
-						if (!zstr(var)) {
-							if ((val = strchr(var, ':'))) {
-								*val++ = '\0';
-								while (*val == ' ') {
-									val++;
-								}
-							}
-							if (var && val) {
-								switch_event_add_header_string(*event, SWITCH_STACK_BOTTOM, var, val);
-								if (!strcasecmp(var, "content-length")) {
-									clen = atoi(val);
-
-									if (clen > 0) {
-										char *body;
-										char *p;
-
-										switch_zmalloc(body, clen + 1);
-
-										p = body;
-										while (clen > 0) {
-											mlen = clen;
-
-											status = switch_socket_recv(listener->sock, p, &mlen);
-
-											if (prefs.done || (!SWITCH_STATUS_IS_BREAK(status) && status != SWITCH_STATUS_SUCCESS)) {
-												free(body);												
-												switch_goto_status(SWITCH_STATUS_FALSE, end);
-											}
-
-											/*
-											   if (channel && !switch_channel_ready(channel)) {
-											   status = SWITCH_STATUS_FALSE;
-											   break;
-											   }
-											 */
-
-											clen -= (int) mlen;
-											p += mlen;
-										}
-
-										switch_event_add_body(*event, "%s", body);
-										free(body);
-									}
-								}
-							}
+
+				if ((clen = parse_packet_headers(mbuf, event)) > 0) {
+					char *body;
+					char *p;
+
+					switch_zmalloc(body, clen + 1);
+
+					p = body;
+					while (clen > 0) {
+						mlen = clen;
+
+						status = switch_socket_recv(listener->sock, p, &mlen);
+
+						if (prefs.done || (!SWITCH_STATUS_IS_BREAK(status) && status != SWITCH_STATUS_SUCCESS)) {
+							free(body);
+							switch_goto_status(SWITCH_STATUS_FALSE, end);
 						}
+
+						clen -= (int) mlen;
+						p += mlen;
 					}
 
-					cur = next;
+					switch_event_add_body(*event, "%s", body);
+					free(body);
 				}
 				break;
 			}
@@ -1254,126 +2248,18 @@ static switch_status_t read_packet(listener_t *listener, switch_event_t **event,
 		}
 
 		if (!*mbuf) {
-			if (switch_test_flag(listener, LFLAG_LOG)) {
-				if (switch_queue_trypop(listener->log_queue, &pop) == SWITCH_STATUS_SUCCESS) {
-					switch_log_node_t *dnode = (switch_log_node_t *) pop;
-
-					if (dnode->data) {
-						switch_snprintf(buf, sizeof(buf),
-										"Content-Type: log/data\n"
-										"Content-Length: %" SWITCH_SSIZE_T_FMT "\n"
-										"Log-Level: %d\n"
-										"Text-Channel: %d\n"
-										"Log-File: %s\n"
-										"Log-Func: %s\n"
-										"Log-Line: %d\n"
-										"User-Data: %s\n"
-										"\n",
-										strlen(dnode->data),
-										dnode->level, dnode->channel, dnode->file, dnode->func, dnode->line, switch_str_nil(dnode->userdata)
-							);
-						len = strlen(buf);
-						switch_socket_send(listener->sock, buf, &len);
-						len = strlen(dnode->data);
-						switch_socket_send(listener->sock, dnode->data, &len);
-					}
-
-					switch_log_node_free(&dnode);
-					do_sleep = 0;
-				}
-			}
+			uint8_t did_work = 0;
 
-
-			if (listener->session) {
-				switch_channel_t *chan = switch_core_session_get_channel(listener->session);
-				if (switch_channel_get_state(chan) < CS_HANGUP && switch_channel_test_flag(chan, CF_DIVERT_EVENTS)) {
-					switch_event_t *e = NULL;
-					while (switch_core_session_dequeue_event(listener->session, &e, SWITCH_TRUE) == SWITCH_STATUS_SUCCESS) {
-						if (switch_queue_trypush(listener->event_queue, e) != SWITCH_STATUS_SUCCESS) {
-							switch_core_session_queue_event(listener->session, &e);
-							break;
-						}
-					}
-				}
-			}
-
-			if (switch_test_flag(listener, LFLAG_EVENTS)) {
-				while (switch_queue_trypop(listener->event_queue, &pop) == SWITCH_STATUS_SUCCESS) {
-					char hbuf[512];
-					switch_event_t *pevent = (switch_event_t *) pop;
-					char *etype;
-
-					do_sleep = 0;
-					if (listener->format == EVENT_FORMAT_PLAIN) {
-						etype = "plain";
-						switch_event_serialize(pevent, &listener->ebuf, SWITCH_TRUE);
-					} else if (listener->format == EVENT_FORMAT_JSON) {
-						etype = "json";
-						switch_event_serialize_json(pevent, &listener->ebuf);
-					} else {
-						switch_xml_t xml;
-						etype = "xml";
-
-						if ((xml = switch_event_xmlize(pevent, SWITCH_VA_NONE))) {
-							listener->ebuf = switch_xml_toxml(xml, SWITCH_FALSE);
-							switch_xml_free(xml);
-						} else {
-							switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(listener->session), SWITCH_LOG_ERROR, "XML ERROR!\n");
-							goto endloop;
-						}
-					}
-
-					switch_assert(listener->ebuf);
-
-					len = strlen(listener->ebuf);
-
-					switch_snprintf(hbuf, sizeof(hbuf), "Content-Length: %" SWITCH_SSIZE_T_FMT "\n" "Content-Type: text/event-%s\n" "\n", len, etype);
-
-					len = strlen(hbuf);
-					switch_socket_send(listener->sock, hbuf, &len);
-
-					len = strlen(listener->ebuf);
-					switch_socket_send(listener->sock, listener->ebuf, &len);
-
-					switch_safe_free(listener->ebuf);
-
-				  endloop:
-
-					switch_event_destroy(&pevent);
-				}
+			deliver_queued(listener, &did_work);
+			if (did_work) {
+				do_sleep = 0;
 			}
 		}
 
-		if (switch_test_flag(listener, LFLAG_HANDLE_DISCO) && switch_epoch_time_now(NULL) > listener->linger_timeout) {
-			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(listener->session), SWITCH_LOG_DEBUG, "linger timeout, closing socket\n");
-			status = SWITCH_STATUS_FALSE;
+		if ((status = check_disconnect(listener, channel)) != SWITCH_STATUS_SUCCESS) {
 			break;
 		}
 
-		if (channel && switch_channel_down(channel) && !switch_test_flag(listener, LFLAG_HANDLE_DISCO)) {
-			switch_set_flag_locked(listener, LFLAG_HANDLE_DISCO);
-			if (switch_test_flag(listener, LFLAG_LINGER)) {
-				char message[128] = "";
-				char disco_buf[512] = "";
-
-				switch_snprintf(message, sizeof(message),
-								"Channel %s has disconnected, lingering by request from remote.\n", switch_channel_get_name(channel));
-				mlen = strlen(message);
-
-				switch_snprintf(disco_buf, sizeof(disco_buf), "Content-Type: text/disconnect-notice\n"
-								"Controlled-Session-UUID: %s\n"
-								"Content-Disposition: linger\n" "Content-Length: %d\n\n", switch_core_session_get_uuid(listener->session), (int) mlen);
-
-				len = strlen(disco_buf);
-				switch_socket_send(listener->sock, disco_buf, &len);
-				len = mlen;
-				switch_socket_send(listener->sock, message, &len);
-			} else {
-				status = SWITCH_STATUS_FALSE;
-				break;
-			}
-		}
-
 		if (do_sleep) {
 			switch_cond_next();
 		}
@@ -1394,6 +2280,8 @@ struct api_command_struct {
 	int bg;
 	int ack;
 	int console_execute;
+	/* queued to the api workers, nobody waits for the ack */
+	int pooled;
 	switch_memory_pool_t *pool;
 };
 
@@ -1458,7 +2346,8 @@ static void *SWITCH_THREAD_FUNC api_exec(switch_thread_t *thread, void *obj)
 			switch_event_fire(&event);
 		}
 	} else {
-		switch_size_t rlen, blen;
+		switch_size_t rlen, len, lens[2];
+		const char *bufs[2];
 		char buf[1024] = "";
 
 		if (!(rlen = strlen(reply))) {
@@ -1467,9 +2356,13 @@ static void *SWITCH_THREAD_FUNC api_exec(switch_thread_t *thread, void *obj)
 		}
 
 		switch_snprintf(buf, sizeof(buf), "Content-Type: api/response\nContent-Length: %" SWITCH_SSIZE_T_FMT "\n\n", rlen);
-		blen = strlen(buf);
-		switch_socket_send(acs->listener->sock, buf, &blen);
-		switch_socket_send(acs->listener->sock, reply, &rlen);
+
+		/* one write, an event must not land between the reply header and its body */
+		bufs[0] = buf;
+		lens[0] = strlen(buf);
+		bufs[1] = reply;
+		lens[1] = rlen;
+		listener_sendv(acs->listener, bufs, lens, 2, &len);
 	}
 
 	switch_safe_free(stream.data);
@@ -1481,7 +2374,18 @@ static void *SWITCH_THREAD_FUNC api_exec(switch_thread_t *thread, void *obj)
 
   done:
 
-	if (acs->bg) {
+	if (acs->pooled) {
+		switch_memory_pool_t *pool = acs->pool;
+		listener_t *listener = acs->listener;
+
+		if (!acs->bg) {
+			listener->api_busy = 0;
+		}
+
+		acs = NULL;
+		switch_core_destroy_memory_pool(&pool);
+		switch_atomic_dec(&listener->api_pending);
+	} else if (acs->bg) {
 		switch_memory_pool_t *pool = acs->pool;
 		if (acs->ack == -1) {
 			int sanity = 2000;
@@ -1507,6 +2411,38 @@ static void *SWITCH_THREAD_FUNC api_exec(switch_thread_t *thread, void *obj)
 
 }
 
+/* Drop a queued job without running it, the listener stays open until its api_pending count is back to 0 */
+static void cancel_api_job(struct api_command_struct *acs)
+{
+	switch_memory_pool_t *pool = acs->pool;
+	listener_t *listener = acs->listener;
+
+	if (!acs->bg) {
+		listener->api_busy = 0;
+	}
+
+	switch_core_destroy_memory_pool(&pool);
+	switch_atomic_dec(&listener->api_pending);
+}
+
+/* Hand an api or bgapi job to the worker pool, the job's pool is destroyed when the queue is full */
+static switch_status_t queue_api_job(struct api_command_struct *acs)
+{
+	listener_t *listener = acs->listener;
+
+	acs->pooled = 1;
+	switch_atomic_inc(&listener->api_pending);
+
+	if (!reactors.api_queue || switch_queue_trypush(reactors.api_queue, acs) != SWITCH_STATUS_SUCCESS) {
+		cancel_api_job(acs);
+		listener->api_rejected++;
+		return SWITCH_STATUS_FALSE;
+	}
+
+	listener->api_queued++;
+	return SWITCH_STATUS_SUCCESS;
+}
+
 static switch_bool_t auth_api_command(listener_t *listener, const char *api_cmd, const char *arg)
 {
 	const char *check_cmd = api_cmd;
@@ -1842,11 +2778,56 @@ static switch_status_t parse_command(listener_t *listener, switch_event_t **even
 		} else {
 			switch_snprintf(reply, reply_len, "-ERR invalid syntax");
 		}
+		compile_filters(listener);
 		switch_mutex_unlock(listener->filter_mutex);
 
 		goto done;
 	}
 
+	if (!strncasecmp(cmd, "resume ", 7) && switch_is_number(cmd + 7)) {
+		uint64_t from = (uint64_t) atoll(cmd + 7) + 1;
+		uint32_t total = 0, sent;
+		int gap = 0;
+
+		if (!prefs.replay_size) {
+			switch_snprintf(reply, reply_len, "-ERR replay is disabled");
+			goto done;
+		}
+
+		if (!switch_test_flag(listener, LFLAG_EVENTS)) {
+			switch_snprintf(reply, reply_len, "-ERR not listening for events");
+			goto done;
+		}
+
+		sent = replay_resume(listener, from, &gap, &total);
+
+		switch_snprintf(reply, reply_len, "~Reply-Text: +OK replaying %u events\nReplay-From: %" SWITCH_UINT64_T_FMT "\n"
+						"Replay-Count: %u\nReplay-Gap: %s\nReplay-Complete: %s\n\n",
+						sent, from, sent, gap ? "true" : "false",
+						sent == total || switch_test_flag(listener, LFLAG_COALESCE) ? "true" : "false");
+		goto done;
+	}
+
+	if (!strncasecmp(cmd, "coalesce", 8)) {
+		char *arg = cmd + 8;
+
+		strip_cr(arg);
+		while (*arg == ' ') {
+			arg++;
+		}
+
+		if (!prefs.replay_size) {
+			switch_snprintf(reply, reply_len, "-ERR replay is disabled");
+		} else if (zstr(arg) || switch_true(arg)) {
+			switch_set_flag_locked(listener, LFLAG_COALESCE);
+			switch_snprintf(reply, reply_len, "+OK coalesced delivery enabled");
+		} else {
+			switch_clear_flag_locked(listener, LFLAG_COALESCE);
+			switch_snprintf(reply, reply_len, "+OK coalesced delivery disabled");
+		}
+		goto done;
+	}
+
 	if (listener->session && !strncasecmp(cmd, "resume", 6)) {
 		switch_set_flag_locked(listener, LFLAG_RESUME);
 		switch_channel_set_variable(switch_core_session_get_channel(listener->session), "socket_resume", "true");
@@ -1881,7 +2862,7 @@ static switch_status_t parse_command(listener_t *listener, switch_event_t **even
 			switch_event_serialize(call_event, &event_str, SWITCH_TRUE);
 			switch_assert(event_str);
 			len = strlen(event_str);
-			switch_socket_send(listener->sock, event_str, &len);
+			listener_send(listener, event_str, &len);
 			switch_safe_free(event_str);
 			switch_event_destroy(&call_event);
 			//switch_snprintf(reply, reply_len, "+OK");
@@ -1925,6 +2906,9 @@ static switch_status_t parse_command(listener_t *listener, switch_event_t **even
 						} else {
 							fmt = uuid;
 						}
+					} else {
+						/* switch_core_session_locate() took a read lock, listener_close() drops it */
+						listener->session_locked = 1;
 					}
 
 					if ((fmt = strchr(uuid, ' '))) {
@@ -1934,6 +2918,8 @@ static switch_status_t parse_command(listener_t *listener, switch_event_t **even
 							listener->format = EVENT_FORMAT_PLAIN;
 						} else if (!strcasecmp(fmt, "json")) {
 							listener->format = EVENT_FORMAT_JSON;
+						} else if (!strcasecmp(fmt, "binary")) {
+							listener->format = EVENT_FORMAT_BINARY;
 						}						
 					}
 
@@ -1969,12 +2955,16 @@ static switch_status_t parse_command(listener_t *listener, switch_event_t **even
 			listener->event_list[SWITCH_EVENT_TALK] = 1;
 			switch_set_flag_locked(listener, LFLAG_MYEVENTS);
 			switch_set_flag_locked(listener, LFLAG_EVENTS);
+			globals.index_dirty = 1;
 			if (strstr(cmd, "xml") || strstr(cmd, "XML")) {
 				listener->format = EVENT_FORMAT_XML;
 			}
 			if (strstr(cmd, "json") || strstr(cmd, "JSON")) {
 				listener->format = EVENT_FORMAT_JSON;
 			}
+			if (strstr(cmd, "binary") || strstr(cmd, "BINARY")) {
+				listener->format = EVENT_FORMAT_BINARY;
+			}
 			switch_snprintf(reply, reply_len, "+OK Events Enabled");
 			goto done;
 		}
@@ -2164,6 +3154,38 @@ static switch_status_t parse_command(listener_t *listener, switch_event_t **even
 		acs.arg = arg;
 		acs.bg = 0;
 
+		if (listener->reactor) {
+			struct api_command_struct *job;
+			switch_memory_pool_t *pool;
+
+			/* the reactor stops reading commands from this connection until the worker has replied */
+			switch_core_new_memory_pool(&pool);
+			job = switch_core_alloc(pool, sizeof(*job));
+			job->pool = pool;
+			job->listener = listener;
+			job->console_execute = acs.console_execute;
+			job->api_cmd = switch_core_strdup(pool, api_cmd);
+			if (arg) {
+				job->arg = switch_core_strdup(pool, arg);
+			}
+
+			listener->api_busy = 1;
+			if (queue_api_job(job) != SWITCH_STATUS_SUCCESS) {
+				const char *busy = "-ERR api queue full\n";
+				char hbuf[128];
+				switch_size_t len;
+
+				listener->api_busy = 0;
+				switch_snprintf(hbuf, sizeof(hbuf), "Content-Type: api/response\nContent-Length: %" SWITCH_SSIZE_T_FMT "\n\n", strlen(busy));
+				len = strlen(hbuf);
+				listener_send(listener, hbuf, &len);
+				len = strlen(busy);
+				listener_send(listener, busy, &len);
+			}
+
+			status = SWITCH_STATUS_SUCCESS;
+			goto done_noreply;
+		}
 
 		api_exec(NULL, (void *) &acs);
 
@@ -2220,6 +3242,15 @@ static switch_status_t parse_command(listener_t *listener, switch_event_t **even
 			switch_uuid_format(acs->uuid_str, &uuid);
 		}
 		switch_snprintf(reply, reply_len, "~Reply-Text: +OK Job-UUID: %s\nJob-UUID: %s\n\n", acs->uuid_str, acs->uuid_str);
+
+		if (listener->reactor) {
+			if (queue_api_job(acs) != SWITCH_STATUS_SUCCESS) {
+				switch_snprintf(reply, reply_len, "-ERR api queue full");
+			}
+			status = SWITCH_STATUS_SUCCESS;
+			goto done;
+		}
+
 		switch_thread_create(&thread, thd_attr, api_exec, acs, acs->pool);
 		sanity = 2000;
 		while (!acs->ack) {
@@ -2320,6 +3351,9 @@ static switch_status_t parse_command(listener_t *listener, switch_event_t **even
 					} else if (!strcasecmp(cur, "json")) {
 						listener->format = EVENT_FORMAT_JSON;
 						goto end;
+					} else if (!strcasecmp(cur, "binary")) {
+						listener->format = EVENT_FORMAT_BINARY;
+						goto end;
 					}
 				}
 
@@ -2367,6 +3401,7 @@ static switch_status_t parse_command(listener_t *listener, switch_event_t **even
 			switch_set_flag_locked(listener, LFLAG_EVENTS);
 		}
 
+		globals.index_dirty = 1;
 		switch_snprintf(reply, reply_len, "+OK event listener enabled %s", format2str(listener->format));
 
 	} else if (!strncasecmp(cmd, "nixevent", 8)) {
@@ -2421,6 +3456,7 @@ static switch_status_t parse_command(listener_t *listener, switch_event_t **even
 			switch_set_flag_locked(listener, LFLAG_EVENTS);
 		}
 
+		globals.index_dirty = 1;
 		switch_snprintf(reply, reply_len, "+OK events nixed");
 
 	} else if (!strncasecmp(cmd, "noevents", 8)) {
@@ -2435,6 +3471,7 @@ static switch_status_t parse_command(listener_t *listener, switch_event_t **even
 			/* wipe the hash */
 			switch_core_hash_destroy(&listener->event_hash);
 			switch_core_hash_init(&listener->event_hash, listener->pool);
+			globals.index_dirty = 1;
 			switch_snprintf(reply, reply_len, "+OK no longer listening for events");
 		} else {
 			switch_snprintf(reply, reply_len, "-ERR not listening for events");
@@ -2447,13 +3484,159 @@ static switch_status_t parse_command(listener_t *listener, switch_event_t **even
 		switch_snprintf(reply, reply_len, "-ERR command not found");
 	}
 
-  done_noreply:
+  done_noreply:
+
+	if (event) {
+		switch_event_destroy(event);
+	}
+
+	return status;
+}
+
+/* Everything a connection needs before its first command, SWITCH_STATUS_FALSE when it has to be closed right away */
+static switch_status_t listener_open(listener_t *listener)
+{
+	switch_core_session_t *session = listener->session;
+	char buf[1024];
+	switch_size_t len;
+
+	if (session) {
+		if (switch_core_session_read_lock(session) != SWITCH_STATUS_SUCCESS) {
+			return SWITCH_STATUS_FALSE;
+		}
+		listener->session_locked = 1;
+	}
+
+	switch_socket_opt_set(listener->sock, SWITCH_SO_TCP_NODELAY, TRUE);
+	switch_socket_opt_set(listener->sock, SWITCH_SO_NONBLOCK, TRUE);
+
+	if (prefs.acl_count && listener->sa && !zstr(listener->remote_ip)) {
+		uint32_t x = 0;
+
+		for (x = 0; x < prefs.acl_count; x++) {
+			if (!switch_check_network_list_ip(listener->remote_ip, prefs.acl[x])) {
+				const char message[] = "Access Denied, go away.\n";
+				int mlen = strlen(message);
+
+				switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_WARNING, "IP %s Rejected by acl \"%s\"\n", listener->remote_ip,
+								  prefs.acl[x]);
+
+				switch_snprintf(buf, sizeof(buf), "Content-Type: text/rude-rejection\nContent-Length: %d\n\n", mlen);
+				len = strlen(buf);
+				listener_send(listener, buf, &len);
+				len = mlen;
+				listener_send(listener, message, &len);
+				return SWITCH_STATUS_FALSE;
+			}
+		}
+	}
+
+	if (globals.debug > 0) {
+		if (zstr(listener->remote_ip)) {
+			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Connection Open\n");
+		} else {
+			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Connection Open from %s:%d\n", listener->remote_ip,
+							  listener->remote_port);
+		}
+	}
+
+	switch_socket_opt_set(listener->sock, SWITCH_SO_NONBLOCK, TRUE);
+	switch_set_flag_locked(listener, LFLAG_RUNNING);
+	add_listener(listener);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+/* Tear down a connection, the listener's pool is gone afterwards unless it belongs to a session */
+static void listener_close(listener_t *listener)
+{
+	switch_core_session_t *session = listener->session;
+	switch_channel_t *channel = NULL;
+	const char *var;
+
+	remove_listener(listener);
+
+	if (globals.debug > 0) {
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Session complete, waiting for children\n");
+	}
+
+	switch_thread_rwlock_wrlock(listener->rwlock);
+	flush_listener(listener, SWITCH_TRUE, SWITCH_TRUE);
+	switch_mutex_lock(listener->filter_mutex);
+	if (listener->filters) {
+		switch_event_destroy(&listener->filters);
+	}
+	free_compiled_filters(listener);
+	switch_mutex_unlock(listener->filter_mutex);
+
+	if (listener->session) {
+		channel = switch_core_session_get_channel(listener->session);
+	}
+
+	if (channel && (switch_test_flag(listener, LFLAG_RESUME) || ((var = switch_channel_get_variable(channel, "socket_resume")) && switch_true(var)))) {
+		switch_channel_set_state(channel, CS_RESET);
+	}
+
+	if (listener->sock) {
+		send_disconnect(listener, "Disconnected, goodbye.\nSee you at ClueCon! http://www.cluecon.com/\n");
+		close_socket(&listener->sock);
+	}
+
+	switch_thread_rwlock_unlock(listener->rwlock);
+
+	if (globals.debug > 0) {
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Connection Closed\n");
+	}
+
+	switch_core_hash_destroy(&listener->event_hash);
+
+	if (listener->allowed_event_hash) {
+		switch_core_hash_destroy(&listener->allowed_event_hash);
+	}
+
+	if (listener->allowed_api_hash) {
+		switch_core_hash_destroy(&listener->allowed_api_hash);
+	}
+
+	if (listener->out_buffer) {
+		switch_buffer_destroy(&listener->out_buffer);
+	}
+
+	switch_safe_free(listener->rbuf);
 
-	if (event) {
-		switch_event_destroy(event);
+	if (listener->session) {
+		/* an outbound listener lives in the pool of the session it controls, myevents <uuid> only watches one */
+		int outbound = listener->pool == switch_core_session_get_pool(listener->session);
+		switch_memory_pool_t *pool = outbound ? NULL : listener->pool;
+
+		if (outbound) {
+			switch_channel_clear_flag(switch_core_session_get_channel(listener->session), CF_CONTROLLED);
+		}
+		switch_clear_flag_locked(listener, LFLAG_SESSION);
+		if (listener->session_locked) {
+			switch_core_session_rwunlock(listener->session);
+		}
+		if (pool) {
+			switch_core_destroy_memory_pool(&pool);
+		}
+	} else if (listener->pool) {
+		switch_memory_pool_t *pool = listener->pool;
+		switch_core_destroy_memory_pool(&pool);
 	}
+}
 
-	return status;
+static void send_command_reply(listener_t *listener, const char *reply)
+{
+	char buf[1024];
+	switch_size_t len;
+
+	if (*reply == '~') {
+		switch_snprintf(buf, sizeof(buf), "Content-Type: command/reply\n%s", reply + 1);
+	} else {
+		switch_snprintf(buf, sizeof(buf), "Content-Type: command/reply\nReply-Text: %s\n\n", reply);
+	}
+	len = strlen(buf);
+	listener_send(listener, buf, &len);
 }
 
 static void *SWITCH_THREAD_FUNC listener_run(switch_thread_t *thread, void *obj)
@@ -2465,10 +3648,7 @@ static void *SWITCH_THREAD_FUNC listener_run(switch_thread_t *thread, void *obj)
 	switch_event_t *event;
 	char reply[512] = "";
 	switch_core_session_t *session = NULL;
-	switch_channel_t *channel = NULL;
 	switch_event_t *revent = NULL;
-	const char *var;
-	int locked = 1;
 
 	switch_mutex_lock(globals.listener_mutex);
 	prefs.threads++;
@@ -2476,50 +3656,12 @@ static void *SWITCH_THREAD_FUNC listener_run(switch_thread_t *thread, void *obj)
 
 	switch_assert(listener != NULL);
 
-	if ((session = listener->session)) {
-		if (switch_core_session_read_lock(session) != SWITCH_STATUS_SUCCESS) {
-			locked = 0;
-			goto done;
-		}
-	}
-
-	switch_socket_opt_set(listener->sock, SWITCH_SO_TCP_NODELAY, TRUE);
-	switch_socket_opt_set(listener->sock, SWITCH_SO_NONBLOCK, TRUE);
-
-	if (prefs.acl_count && listener->sa && !zstr(listener->remote_ip)) {
-		uint32_t x = 0;
-
-		for (x = 0; x < prefs.acl_count; x++) {
-			if (!switch_check_network_list_ip(listener->remote_ip, prefs.acl[x])) {
-				const char message[] = "Access Denied, go away.\n";
-				int mlen = strlen(message);
-
-				switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_WARNING, "IP %s Rejected by acl \"%s\"\n", listener->remote_ip,
-								  prefs.acl[x]);
-
-				switch_snprintf(buf, sizeof(buf), "Content-Type: text/rude-rejection\nContent-Length: %d\n\n", mlen);
-				len = strlen(buf);
-				switch_socket_send(listener->sock, buf, &len);
-				len = mlen;
-				switch_socket_send(listener->sock, message, &len);
-				goto done;
-			}
-		}
-	}
+	session = listener->session;
 
-	if (globals.debug > 0) {
-		if (zstr(listener->remote_ip)) {
-			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Connection Open\n");
-		} else {
-			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Connection Open from %s:%d\n", listener->remote_ip,
-							  listener->remote_port);
-		}
+	if (listener_open(listener) != SWITCH_STATUS_SUCCESS) {
+		goto done;
 	}
 
-	switch_socket_opt_set(listener->sock, SWITCH_SO_NONBLOCK, TRUE);
-	switch_set_flag_locked(listener, LFLAG_RUNNING);
-	add_listener(listener);
-
 	if (session && switch_test_flag(listener, LFLAG_AUTHED)) {
 		switch_event_t *ievent = NULL;
 
@@ -2543,7 +3685,7 @@ static void *SWITCH_THREAD_FUNC listener_run(switch_thread_t *thread, void *obj)
 		switch_snprintf(buf, sizeof(buf), "Content-Type: auth/request\n\n");
 
 		len = strlen(buf);
-		switch_socket_send(listener->sock, buf, &len);
+		listener_send(listener, buf, &len);
 
 		while (!switch_test_flag(listener, LFLAG_AUTHED)) {
 			status = read_packet(listener, &event, 25);
@@ -2559,21 +3701,13 @@ static void *SWITCH_THREAD_FUNC listener_run(switch_thread_t *thread, void *obj)
 				goto done;
 			}
 			if (*reply != '\0') {
-				if (*reply == '~') {
-					switch_snprintf(buf, sizeof(buf), "Content-Type: command/reply\n%s", reply + 1);
-				} else {
-					switch_snprintf(buf, sizeof(buf), "Content-Type: command/reply\nReply-Text: %s\n\n", reply);
-				}
-				len = strlen(buf);
-				switch_socket_send(listener->sock, buf, &len);
+				send_command_reply(listener, reply);
 			}
 			break;
 		}
 	}
 
 	while (!prefs.done && switch_test_flag(listener, LFLAG_RUNNING) && listen_list.ready) {
-		len = sizeof(buf);
-		memset(buf, 0, len);
 		status = read_packet(listener, &revent, 0);
 
 		if (status != SWITCH_STATUS_SUCCESS) {
@@ -2594,13 +3728,7 @@ static void *SWITCH_THREAD_FUNC listener_run(switch_thread_t *thread, void *obj)
 		}
 
 		if (*reply != '\0') {
-			if (*reply == '~') {
-				switch_snprintf(buf, sizeof(buf), "Content-Type: command/reply\n%s", reply + 1);
-			} else {
-				switch_snprintf(buf, sizeof(buf), "Content-Type: command/reply\nReply-Text: %s\n\n", reply);
-			}
-			len = strlen(buf);
-			switch_socket_send(listener->sock, buf, &len);
+			send_command_reply(listener, reply);
 		}
 
 	}
@@ -2611,58 +3739,302 @@ static void *SWITCH_THREAD_FUNC listener_run(switch_thread_t *thread, void *obj)
 		switch_event_destroy(&revent);
 	}
 
-	remove_listener(listener);
+	listener_close(listener);
 
-	if (globals.debug > 0) {
-		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Session complete, waiting for children\n");
+	switch_mutex_lock(globals.listener_mutex);
+	prefs.threads--;
+	switch_mutex_unlock(globals.listener_mutex);
+
+	return NULL;
+}
+
+/* Pull one complete command out of the read buffer, the same framing read_packet applies byte by byte */
+static switch_status_t reactor_frame(listener_t *listener, switch_event_t **event)
+{
+	char *p = listener->rbuf, *end, *mbuf, *body;
+	switch_size_t hlen, skip = 0;
+	uint8_t crcount = 0;
+	int clen;
+
+	*event = NULL;
+
+	while (skip < listener->rbuf_used && (p[skip] == '\r' || p[skip] == '\n')) {
+		skip++;
 	}
 
-	switch_thread_rwlock_wrlock(listener->rwlock);
-	flush_listener(listener, SWITCH_TRUE, SWITCH_TRUE);
-	switch_mutex_lock(listener->filter_mutex);
-	if (listener->filters) {
-		switch_event_destroy(&listener->filters);
+	if (skip) {
+		memmove(p, p + skip, listener->rbuf_used - skip);
+		listener->rbuf_used -= skip;
 	}
-	switch_mutex_unlock(listener->filter_mutex);
 
-	if (listener->session) {
-		channel = switch_core_session_get_channel(listener->session);
+	end = p + listener->rbuf_used;
+
+	for (; p < end; p++) {
+		if (*p == '\n') {
+			if (++crcount == 2) {
+				break;
+			}
+		} else if (*p != '\r') {
+			crcount = 0;
+		}
 	}
 
-	if (channel && (switch_test_flag(listener, LFLAG_RESUME) || ((var = switch_channel_get_variable(channel, "socket_resume")) && switch_true(var)))) {
-		switch_channel_set_state(channel, CS_RESET);
+	if (crcount != 2) {
+		if (listener->rbuf_used >= MAX_PACKET_LEN) {
+			listener->closing = 1;
+		}
+		return SWITCH_STATUS_FALSE;
 	}
 
-	if (listener->sock) {
-		send_disconnect(listener, "Disconnected, goodbye.\nSee you at ClueCon! http://www.cluecon.com/\n");
-		close_socket(&listener->sock);
+	hlen = (p - listener->rbuf) + 1;
+	switch_zmalloc(mbuf, hlen + 1);
+	memcpy(mbuf, listener->rbuf, hlen);
+
+	clen = parse_packet_headers(mbuf, event);
+	free(mbuf);
+
+	if (clen < 0 || clen > MAX_PACKET_LEN) {
+		switch_event_destroy(event);
+		listener->closing = 1;
+		return SWITCH_STATUS_FALSE;
 	}
 
-	switch_thread_rwlock_unlock(listener->rwlock);
+	if (listener->rbuf_used < hlen + clen) {
+		/* the body is still on its way, parse the headers again once it is here */
+		switch_event_destroy(event);
+		return SWITCH_STATUS_FALSE;
+	}
 
-	if (globals.debug > 0) {
-		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Connection Closed\n");
+	if (clen > 0) {
+		switch_zmalloc(body, clen + 1);
+		memcpy(body, listener->rbuf + hlen, clen);
+		switch_event_add_body(*event, "%s", body);
+		free(body);
 	}
 
-	switch_core_hash_destroy(&listener->event_hash);
+	listener->rbuf_used -= hlen + clen;
+	memmove(listener->rbuf, listener->rbuf + hlen + clen, listener->rbuf_used);
 
-	if (listener->allowed_event_hash) {
-		switch_core_hash_destroy(&listener->allowed_event_hash);
+	return SWITCH_STATUS_SUCCESS;
+}
+
+static void reactor_read(listener_t *listener)
+{
+	switch_status_t status;
+	switch_size_t len;
+
+	if (listener->rbuf_size - listener->rbuf_used < 1024) {
+		switch_size_t size = listener->rbuf_size ? listener->rbuf_size * 2 : 4096;
+		char *tmp;
+
+		if (size > MAX_PACKET_LEN * 2) {
+			listener->closing = 1;
+			return;
+		}
+
+		tmp = realloc(listener->rbuf, size);
+		switch_assert(tmp);
+		listener->rbuf = tmp;
+		listener->rbuf_size = size;
 	}
 
-	if (listener->allowed_api_hash) {
-		switch_core_hash_destroy(&listener->allowed_api_hash);
+	len = listener->rbuf_size - listener->rbuf_used;
+	status = switch_socket_recv(listener->sock, listener->rbuf + listener->rbuf_used, &len);
+	listener->rbuf_used += len;
+
+	if ((status != SWITCH_STATUS_SUCCESS && !SWITCH_STATUS_IS_BREAK(status)) || (status == SWITCH_STATUS_SUCCESS && !len)) {
+		listener->closing = 1;
 	}
+}
 
-	if (listener->session) {
-		switch_channel_clear_flag(switch_core_session_get_channel(listener->session), CF_CONTROLLED);
-		switch_clear_flag_locked(listener, LFLAG_SESSION);
-		if (locked) {
-			switch_core_session_rwunlock(listener->session);
+static void reactor_adopt(reactor_t *reactor, listener_t *listener)
+{
+	char buf[128];
+	switch_size_t len;
+
+	if (listener_open(listener) != SWITCH_STATUS_SUCCESS) {
+		listener_close(listener);
+		return;
+	}
+
+	switch_snprintf(buf, sizeof(buf), "Content-Type: auth/request\n\n");
+	len = strlen(buf);
+	listener_send(listener, buf, &len);
+
+	listener->handshake_deadline = switch_epoch_time_now(NULL) + REACTOR_HANDSHAKE_TIMEOUT;
+
+	if (switch_socket_create_pollfd(&listener->pollfd, listener->sock, SWITCH_POLLIN | SWITCH_POLLERR, listener, listener->pool) != SWITCH_STATUS_SUCCESS ||
+		switch_pollset_add(reactor->pollset, listener->pollfd) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Reactor %u cannot take connection from %s:%d\n",
+						  reactor->id, listener->remote_ip, listener->remote_port);
+		listener->pollfd = NULL;
+		listener_close(listener);
+		return;
+	}
+
+	listener->reactor_next = reactor->listeners;
+	reactor->listeners = listener;
+	switch_mutex_lock(reactor->mutex);
+	reactor->count++;
+	switch_mutex_unlock(reactor->mutex);
+}
+
+/* Commands, queued output and deadlines for one connection, called every pass of the loop */
+static void reactor_service(reactor_t *reactor, listener_t *listener, time_t now)
+{
+	switch_event_t *event;
+	char reply[512];
+	uint8_t did_work = 0;
+	int n = 0;
+
+	if (prefs.done || !switch_test_flag(listener, LFLAG_RUNNING)) {
+		listener->closing = 1;
+	}
+
+	while (!listener->closing && !listener->api_busy && n++ < REACTOR_BATCH && reactor_frame(listener, &event) == SWITCH_STATUS_SUCCESS) {
+		*reply = '\0';
+		switch_mutex_lock(reactor->mutex);
+		reactor->commands++;
+		switch_mutex_unlock(reactor->mutex);
+
+		if (parse_command(listener, &event, reply, sizeof(reply)) != SWITCH_STATUS_SUCCESS) {
+			switch_clear_flag_locked(listener, LFLAG_RUNNING);
+			listener->closing = 1;
+		} else if (*reply != '\0') {
+			send_command_reply(listener, reply);
 		}
-	} else if (listener->pool) {
-		switch_memory_pool_t *pool = listener->pool;
-		switch_core_destroy_memory_pool(&pool);
+
+		if (event) {
+			switch_event_destroy(&event);
+		}
+	}
+
+	if (!switch_test_flag(listener, LFLAG_AUTHED) && now > listener->handshake_deadline) {
+		listener->closing = 1;
+	}
+
+	if (!listener->closing) {
+		deliver_queued(listener, &did_work);
+
+		if (check_disconnect(listener, NULL) != SWITCH_STATUS_SUCCESS) {
+			listener->closing = 1;
+		}
+	}
+
+	switch_mutex_lock(listener->out_mutex);
+	listener_flush_output(listener);
+	switch_mutex_unlock(listener->out_mutex);
+}
+
+static void reactor_remove(reactor_t *reactor, listener_t *listener)
+{
+	switch_pollset_remove(reactor->pollset, listener->pollfd);
+	switch_mutex_lock(reactor->mutex);
+	reactor->count--;
+	switch_mutex_unlock(reactor->mutex);
+	listener_close(listener);
+}
+
+static void *SWITCH_THREAD_FUNC reactor_run(switch_thread_t *thread, void *obj)
+{
+	reactor_t *reactor = (reactor_t *) obj;
+	listener_t *listener, *last, *next;
+	void *pop;
+
+	switch_mutex_lock(globals.listener_mutex);
+	prefs.threads++;
+	switch_mutex_unlock(globals.listener_mutex);
+
+	while (!prefs.done) {
+		const switch_pollfd_t *fds;
+		int32_t numfds = 0, i;
+		time_t now;
+
+		while (switch_queue_trypop(reactor->adopt_queue, &pop) == SWITCH_STATUS_SUCCESS) {
+			reactor_adopt(reactor, (listener_t *) pop);
+		}
+
+		if (switch_pollset_poll(reactor->pollset, 10000, &numfds, &fds) == SWITCH_STATUS_SUCCESS) {
+			for (i = 0; i < numfds; i++) {
+				listener = (listener_t *) fds[i].client_data;
+
+				if ((fds[i].rtnevents & (SWITCH_POLLIN | SWITCH_POLLERR | SWITCH_POLLHUP)) && !listener->closing) {
+					reactor_read(listener);
+				}
+			}
+		} else if (!reactor->count) {
+			switch_yield(10000);
+		}
+
+		now = switch_epoch_time_now(NULL);
+		last = NULL;
+
+		for (listener = reactor->listeners; listener; listener = next) {
+			next = listener->reactor_next;
+
+			reactor_service(reactor, listener, now);
+
+			/* a connection with a job on the api workers is only closed once the job is done with it */
+			if (listener->closing && !switch_atomic_read(&listener->api_pending)) {
+				if (last) {
+					last->reactor_next = next;
+				} else {
+					reactor->listeners = next;
+				}
+				reactor_remove(reactor, listener);
+			} else {
+				last = listener;
+			}
+		}
+	}
+
+	while (switch_queue_trypop(reactor->adopt_queue, &pop) == SWITCH_STATUS_SUCCESS) {
+		listener = (listener_t *) pop;
+		close_socket(&listener->sock);
+		listener_close(listener);
+	}
+
+	/* listener_close() frees the pool a job still points at, so wait for every job to finish or be cancelled;
+	   a job this reactor queued after the api workers drained the queue is cancelled here */
+	for (listener = reactor->listeners; listener; listener = next) {
+		next = listener->reactor_next;
+
+		while (switch_atomic_read(&listener->api_pending)) {
+			if (switch_queue_trypop(reactors.api_queue, &pop) == SWITCH_STATUS_SUCCESS) {
+				cancel_api_job((struct api_command_struct *) pop);
+			} else {
+				switch_yield(10000);
+			}
+		}
+
+		reactor_remove(reactor, listener);
+	}
+	reactor->listeners = NULL;
+
+	switch_mutex_lock(globals.listener_mutex);
+	prefs.threads--;
+	switch_mutex_unlock(globals.listener_mutex);
+
+	return NULL;
+}
+
+static void *SWITCH_THREAD_FUNC api_worker_run(switch_thread_t *thread, void *obj)
+{
+	void *pop;
+
+	switch_mutex_lock(globals.listener_mutex);
+	prefs.threads++;
+	switch_mutex_unlock(globals.listener_mutex);
+
+	while (!prefs.done) {
+		if (switch_queue_pop_timeout(reactors.api_queue, &pop, 100000) == SWITCH_STATUS_SUCCESS) {
+			api_exec(NULL, pop);
+		}
+	}
+
+	/* nothing queued runs once we are shutting down, the reactors close each listener after its jobs are gone */
+	while (switch_queue_trypop(reactors.api_queue, &pop) == SWITCH_STATUS_SUCCESS) {
+		cancel_api_job((struct api_command_struct *) pop);
 	}
 
 	switch_mutex_lock(globals.listener_mutex);
@@ -2672,6 +4044,47 @@ static void *SWITCH_THREAD_FUNC listener_run(switch_thread_t *thread, void *obj)
 	return NULL;
 }
 
+static void start_reactors(void)
+{
+	switch_threadattr_t *thd_attr = NULL;
+	switch_thread_t *thread;
+	uint32_t x;
+
+	if (!prefs.reactor_threads) {
+		return;
+	}
+
+	switch_core_new_memory_pool(&reactors.pool);
+	reactors.reactors = switch_core_alloc(reactors.pool, sizeof(reactor_t) * prefs.reactor_threads);
+	switch_queue_create(&reactors.api_queue, prefs.api_queue_len, reactors.pool);
+
+	switch_threadattr_create(&thd_attr, reactors.pool);
+	switch_threadattr_detach_set(thd_attr, 1);
+	switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+
+	for (x = 0; x < prefs.api_workers; x++) {
+		switch_thread_create(&thread, thd_attr, api_worker_run, NULL, reactors.pool);
+	}
+
+	for (x = 0; x < prefs.reactor_threads; x++) {
+		reactor_t *reactor = &reactors.reactors[reactors.count];
+
+		reactor->id = x;
+
+		if (switch_pollset_create(&reactor->pollset, REACTOR_MAX_CONNECTIONS, reactors.pool, 0) != SWITCH_STATUS_SUCCESS) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Cannot create pollset for reactor %u\n", x);
+			break;
+		}
+
+		switch_queue_create(&reactor->adopt_queue, MAX_QUEUE_LEN, reactors.pool);
+		switch_mutex_init(&reactor->mutex, SWITCH_MUTEX_NESTED, reactors.pool);
+		switch_thread_create(&thread, thd_attr, reactor_run, reactor, reactors.pool);
+		reactors.count++;
+	}
+
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Serving connections from %u reactor threads and %u api workers\n",
+					  reactors.count, prefs.api_workers);
+}
 
 /* Create a thread for the socket and launch it */
 static void launch_listener_thread(listener_t *listener)
@@ -2679,6 +4092,23 @@ static void launch_listener_thread(listener_t *listener)
 	switch_thread_t *thread;
 	switch_threadattr_t *thd_attr = NULL;
 
+	/* outbound async sockets keep their own thread: their first frame must be "connect" rather than auth,
+	   check_disconnect() needs the channel for linger, and their pool is the session's, which the reactor
+	   would have to hold a read lock on until it closes the connection */
+	if (reactors.count && !listener->session) {
+		reactor_t *reactor = &reactors.reactors[reactors.next++ % reactors.count];
+
+		listener->reactor = reactor;
+		switch_buffer_create_dynamic(&listener->out_buffer, 4096, 8192, 0);
+
+		if (switch_queue_trypush(reactor->adopt_queue, listener) == SWITCH_STATUS_SUCCESS) {
+			return;
+		}
+
+		listener->reactor = NULL;
+		switch_buffer_destroy(&listener->out_buffer);
+	}
+
 	switch_threadattr_create(&thd_attr, listener->pool);
 	switch_threadattr_detach_set(thd_attr, 1);
 	switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
@@ -2712,6 +4142,14 @@ static int config(void)
 					prefs.port = (uint16_t) atoi(val);
 				} else if (!strcmp(var, "password")) {
 					set_pref_pass(val);
+				} else if (!strcasecmp(var, "reactor-threads")) {
+					prefs.reactor_threads = atoi(val);
+				} else if (!strcasecmp(var, "api-workers")) {
+					prefs.api_workers = atoi(val);
+				} else if (!strcasecmp(var, "api-queue-len")) {
+					prefs.api_queue_len = atoi(val);
+				} else if (!strcasecmp(var, "replay-events-per-type")) {
+					prefs.replay_size = atoi(val);
 				} else if (!strcasecmp(var, "apply-inbound-acl") && ! zstr(val)) {
 					if (prefs.acl_count < MAX_ACL) {
 						prefs.acl[prefs.acl_count++] = strdup(val);
@@ -2744,6 +4182,18 @@ static int config(void)
 		prefs.port = 8021;
 	}
 
+	if (prefs.reactor_threads > 64) {
+		prefs.reactor_threads = 64;
+	}
+
+	if (!prefs.api_workers) {
+		prefs.api_workers = 8;
+	}
+
+	if (!prefs.api_queue_len) {
+		prefs.api_queue_len = 1000;
+	}
+
 	return 0;
 }
 
@@ -2764,6 +4214,7 @@ SWITCH_MODULE_RUNTIME_FUNCTION(mod_event_socket_runtime)
 	}
 
 	config();
+	start_reactors();
 
 	while (!prefs.done) {
 		rv = switch_sockaddr_info_get(&sa, prefs.ip, SWITCH_INET, prefs.port, 0, pool);
@@ -2837,6 +4288,7 @@ SWITCH_MODULE_RUNTIME_FUNCTION(mod_event_socket_runtime)
 
 		switch_mutex_init(&listener->flag_mutex, SWITCH_MUTEX_NESTED, listener->pool);
 		switch_mutex_init(&listener->filter_mutex, SWITCH_MUTEX_NESTED, listener->pool);
+		switch_mutex_init(&listener->out_mutex, SWITCH_MUTEX_NESTED, listener->pool);
 
 		switch_core_hash_init(&listener->event_hash, listener->pool);
 
@@ -12,23 +12,46 @@ namespace mod_event_zmq {
 class ZmqEventPublisher {
 public:
 	ZmqEventPublisher(zmq::context_t &context) :
-		_publisher(context, ZMQ_PUB)
+		_publisher(context, ZMQ_PUB), _binary(false)
 	{
 		_publisher.bind("tcp://*:5556");
 
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Listening for clients\n");
 	}
 
-	void PublishEvent(const switch_event_t *event) {
-		// Serialize the event into a JSON string
-		char* pjson;
-		switch_event_serialize_json(const_cast<switch_event_t*>(event), &pjson);
+	// Publish the binary event format as it is instead of JSON, for subscribers built on libesl
+	void SetBinary(bool binary) {
+		_binary = binary;
+	}
 
-		// Use the JSON string as the message body
-		zmq::message_t msg(pjson, strlen(pjson), free_message_data, NULL);
-		
-		// Send the message
-		_publisher.send(msg);
+	void PublishBatch(switch_event_export_record_t **records, uint32_t count) {
+		// The core serialized each event already, one message per event
+		for (uint32_t i = 0; i < count; i++) {
+			if (_binary) {
+				zmq::message_t msg(records[i]->len);
+				memcpy(msg.data(), records[i]->data, records[i]->len);
+
+				// Send the message
+				_publisher.send(msg);
+			} else {
+				// Rebuild the event and serialize it into a JSON string, this runs on the sink thread not the dispatch one
+				switch_event_t *event;
+				char* pjson;
+
+				if (switch_event_create_binary(&event, records[i]->data, records[i]->len) != SWITCH_STATUS_SUCCESS) {
+					continue;
+				}
+
+				switch_event_serialize_json(event, &pjson);
+				switch_event_destroy(&event);
+
+				// Use the JSON string as the message body
+				zmq::message_t msg(pjson, strlen(pjson), free_message_data, NULL);
+
+				// Send the message
+				_publisher.send(msg);
+			}
+		}
 	}
 
 private:
@@ -37,6 +60,7 @@ private:
 	}
 
 	zmq::socket_t _publisher;
+	bool _binary;
 };
 
 class char_msg : public zmq::message_t {
@@ -61,11 +85,13 @@ public:
 		_term_rep.bind(TERM_URI);
 		_term_req.connect(TERM_URI);
 
-		// Subscribe to all switch events of any subclass
-		// Store a pointer to ourself in the user data
-		if (switch_event_bind_removable(modname, SWITCH_EVENT_ALL, SWITCH_EVENT_SUBCLASS_ANY, event_handler, static_cast<void*>(&_publisher), &_node)
+		LoadConfig();
+
+		// Export all switch events, the sink publishes them from its own thread
+		// Store a pointer to the publisher in the user data
+		if (switch_event_export_add_sink(modname, SWITCH_EVENT_ALL, 0, 0, export_handler, static_cast<void*>(&_publisher), &_sink)
 				!= SWITCH_STATUS_SUCCESS) {
-			throw std::runtime_error("Couldn't bind to switch events.");
+			throw std::runtime_error("Couldn't add an event export sink.");
 		}
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Subscribed to events\n");
 
@@ -114,25 +140,55 @@ public:
 	}
 
 	~ZmqModule() {
-		// Unsubscribe from the switch events
-		switch_event_unbind(&_node);
+		// Stop exporting the switch events
+		switch_event_export_remove_sink(&_sink);
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Module shut down\n");
 	}
 
 private:
-	// Dispatches events to the publisher
-	static void event_handler(switch_event_t *event) {
+	void LoadConfig() {
+		switch_xml_t cfg, xml, settings, param;
+
+		// The module runs with the defaults when it has no config file
+		if (!(xml = switch_xml_open_cfg("event_zmq.conf", &cfg, NULL))) {
+			return;
+		}
+
+		if ((settings = switch_xml_child(cfg, "settings"))) {
+			for (param = switch_xml_child(settings, "param"); param; param = param->next) {
+				const char *var = switch_xml_attr_soft(param, "name");
+				const char *val = switch_xml_attr_soft(param, "value");
+
+				if (!strcasecmp(var, "event-format")) {
+					if (!strcasecmp(val, "binary")) {
+						_publisher.SetBinary(true);
+					} else if (!strcasecmp(val, "json")) {
+						_publisher.SetBinary(false);
+					} else {
+						switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid event-format '%s' specified, using json\n", val);
+					}
+				}
+			}
+		}
+
+		switch_xml_free(xml);
+	}
+
+	// Dispatches batches of exported events to the publisher
+	static switch_status_t export_handler(switch_event_export_sink_t *sink, switch_event_export_record_t **records, uint32_t count, void *user_data) {
 		try {
-			ZmqEventPublisher *publisher = static_cast<ZmqEventPublisher*>(event->bind_user_data);
-			publisher->PublishEvent(event);
+			ZmqEventPublisher *publisher = static_cast<ZmqEventPublisher*>(user_data);
+			publisher->PublishBatch(records, count);
+			return SWITCH_STATUS_SUCCESS;
 		} catch(std::exception ex) {
 			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Error publishing event via 0MQ: %s\n", ex.what());
 		} catch(...) { // Exceptions must not propogate to C caller
 			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Unknown error publishing event via 0MQ\n");
 		}
+		return SWITCH_STATUS_FALSE;
 	}
 
-	switch_event_node_t *_node;
+	switch_event_export_sink_t *_sink;
 
 	zmq::context_t _context;
 	zmq::socket_t _term_rep;
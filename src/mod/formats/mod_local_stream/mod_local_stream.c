@@ -33,6 +33,8 @@
 #include <switch.h>
 /* for apr_pstrcat */
 #define DEFAULT_PREBUFFER_SIZE 1024 * 64
+/* frames of audio a handle may fall behind the source before the oldest are overwritten */
+#define HANDLE_BUFFER_FRAMES 10
 
 SWITCH_MODULE_LOAD_FUNCTION(mod_local_stream_load);
 SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_local_stream_shutdown);
@@ -51,7 +53,8 @@ static int THREADS = 0;
 
 struct local_stream_context {
 	struct local_stream_source *source;
-	switch_mutex_t *audio_mutex;
+	int leaking;
+	uint32_t dropped;
 	switch_buffer_t *audio_buffer;
 	int err;
 	const char *file;
@@ -296,15 +299,18 @@ static void *SWITCH_THREAD_FUNC read_stream_thread(switch_thread_t *thread, void
 							if (switch_test_flag(cp->handle, SWITCH_FILE_CALLBACK)) {
 								continue;
 							}
-							switch_mutex_lock(cp->audio_mutex);
-							if (switch_buffer_inuse(cp->audio_buffer) > source->samples * 768) {
-								switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Leaking stream handle! [%s() %s:%d]\n", cp->func, cp->file,
-												  cp->line);
-								switch_buffer_zero(cp->audio_buffer);
+							/* the ring only fills up when the reader has stopped draining it, the oldest audio makes way */
+							if (switch_buffer_freespace(cp->audio_buffer) >= used) {
+								cp->leaking = 0;
 							} else {
-								switch_buffer_write(cp->audio_buffer, dist_buf, used);
+								cp->dropped++;
+								if (!cp->leaking) {
+									switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Leaking stream handle! [%s() %s:%d]\n", cp->func, cp->file,
+													  cp->line);
+									cp->leaking = 1;
+								}
 							}
-							switch_mutex_unlock(cp->audio_mutex);
+							switch_buffer_slide_write(cp->audio_buffer, dist_buf, used);
 						}
 						switch_mutex_unlock(source->mutex);
 					}
@@ -420,8 +426,7 @@ static switch_status_t local_stream_file_open(switch_file_handle_t *handle, cons
 	handle->interval = source->interval;
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Opening Stream [%s] %dhz\n", path, handle->samplerate);
 
-	switch_mutex_init(&context->audio_mutex, SWITCH_MUTEX_NESTED, handle->memory_pool);
-	if (switch_buffer_create_dynamic(&context->audio_buffer, 512, 1024, 0) != SWITCH_STATUS_SUCCESS) {
+	if (switch_buffer_create_ring(NULL, &context->audio_buffer, source->samples * 2 * source->channels * HANDLE_BUFFER_FRAMES) != SWITCH_STATUS_SUCCESS) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Memory Error!\n");
 		status = SWITCH_STATUS_MEMERR;
 		goto end;
@@ -461,6 +466,12 @@ static switch_status_t local_stream_file_close(switch_file_handle_t *handle)
 	}
 	context->source->total--;
 	switch_mutex_unlock(context->source->mutex);
+
+	if (context->dropped) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Stream handle [%s() %s:%d] overran and dropped %u frames\n",
+						  context->func, context->file, context->line, context->dropped);
+	}
+
 	switch_buffer_destroy(&context->audio_buffer);
 	switch_thread_rwlock_unlock(context->source->rwlock);
 
@@ -478,7 +489,6 @@ static switch_status_t local_stream_file_read(switch_file_handle_t *handle, void
 		return SWITCH_STATUS_FALSE;
 	}
 
-	switch_mutex_lock(context->audio_mutex);
 	if ((bytes = switch_buffer_read(context->audio_buffer, data, need))) {
 		*len = bytes / 2;
 	} else {
@@ -488,7 +498,6 @@ static switch_status_t local_stream_file_read(switch_file_handle_t *handle, void
 		memset(data, 255, need);
 		*len = need / 2;
 	}
-	switch_mutex_unlock(context->audio_mutex);
 	handle->sample_count += *len;
 	return SWITCH_STATUS_SUCCESS;
 }
@@ -730,6 +730,67 @@ SWITCH_DECLARE(switch_status_t) switch_socket_send(switch_socket_t *sock, const
 	return status;
 }
 
+#define SENDV_MAX_VECS 16
+
+SWITCH_DECLARE(switch_status_t) switch_socket_sendv(switch_socket_t *sock, const char **bufs, const switch_size_t *lens, uint32_t count, switch_size_t *len)
+{
+	struct iovec vec[SENDV_MAX_VECS];
+	switch_status_t status = SWITCH_STATUS_SUCCESS;
+	switch_size_t wrote = 0, need;
+	uint32_t i, first = 0;
+	int to_count = 0;
+
+	*len = 0;
+
+	if (!sock || !bufs || !lens || count > SENDV_MAX_VECS) {
+		return SWITCH_STATUS_GENERR;
+	}
+
+	for (i = 0; i < count; i++) {
+		vec[i].iov_base = (void *) bufs[i];
+		vec[i].iov_len = lens[i];
+	}
+
+	while (first < count) {
+		if (!vec[first].iov_len) {
+			first++;
+			continue;
+		}
+
+		need = 0;
+		status = apr_socket_sendv(sock, vec + first, count - first, &need);
+		wrote += need;
+
+		/* skip what went out, a partial write leaves the rest of its vector in place */
+		while (need && first < count) {
+			if (need >= vec[first].iov_len) {
+				need -= vec[first].iov_len;
+				vec[first++].iov_len = 0;
+			} else {
+				vec[first].iov_base = (char *) vec[first].iov_base + need;
+				vec[first].iov_len -= need;
+				need = 0;
+			}
+		}
+
+		if (status == SWITCH_STATUS_BREAK || status == 730035 || status == 35) {
+			if (++to_count > 60000) {
+				status = SWITCH_STATUS_FALSE;
+				break;
+			}
+			switch_yield(10000);
+			status = SWITCH_STATUS_SUCCESS;
+		} else if (status != SWITCH_STATUS_SUCCESS) {
+			break;
+		} else {
+			to_count = 0;
+		}
+	}
+
+	*len = wrote;
+	return status;
+}
+
 SWITCH_DECLARE(switch_status_t) switch_socket_send_nonblock(switch_socket_t *sock, const char *buf, switch_size_t *len)
 {
 	if (!sock || !buf || !len) {
@@ -748,6 +809,75 @@ SWITCH_DECLARE(switch_status_t) switch_socket_sendto(switch_socket_t *sock, swit
 	return apr_socket_sendto(sock, where, flags, buf, len);
 }
 
+#define SENDTO_MULTI_BURST 64
+
+SWITCH_DECLARE(switch_status_t) switch_socket_sendto_multi(switch_socket_t *sock, switch_sockaddr_t *where, int32_t flags, const char **bufs,
+														   const switch_size_t *lens, uint32_t count, uint32_t *sent)
+{
+	uint32_t done = 0;
+	switch_status_t status = SWITCH_STATUS_SUCCESS;
+
+	if (!where || !bufs || !lens) {
+		return SWITCH_STATUS_GENERR;
+	}
+
+#if defined(HAVE_SENDMMSG) && defined(__linux__)
+	{
+		apr_os_sock_t fd;
+
+		if (apr_os_sock_get(&fd, sock) == APR_SUCCESS) {
+			struct mmsghdr msgs[SENDTO_MULTI_BURST];
+			struct iovec iov[SENDTO_MULTI_BURST];
+
+			while (done < count) {
+				uint32_t i, burst = count - done;
+				int r;
+
+				if (burst > SENDTO_MULTI_BURST) {
+					burst = SENDTO_MULTI_BURST;
+				}
+
+				memset(msgs, 0, sizeof(msgs[0]) * burst);
+
+				for (i = 0; i < burst; i++) {
+					iov[i].iov_base = (void *) bufs[done + i];
+					iov[i].iov_len = lens[done + i];
+					msgs[i].msg_hdr.msg_name = &where->sa;
+					msgs[i].msg_hdr.msg_namelen = where->salen;
+					msgs[i].msg_hdr.msg_iov = &iov[i];
+					msgs[i].msg_hdr.msg_iovlen = 1;
+				}
+
+				if ((r = sendmmsg(fd, msgs, burst, flags)) <= 0) {
+					if (r < 0 && errno == EINTR) {
+						continue;
+					}
+					/* let the per-datagram path below report the error */
+					break;
+				}
+
+				done += (uint32_t) r;
+			}
+		}
+	}
+#endif
+
+	while (done < count) {
+		switch_size_t len = lens[done];
+
+		if ((status = switch_socket_sendto(sock, where, flags, bufs[done], &len)) != SWITCH_STATUS_SUCCESS) {
+			break;
+		}
+		done++;
+	}
+
+	if (sent) {
+		*sent = done;
+	}
+
+	return status;
+}
+
 SWITCH_DECLARE(switch_status_t) switch_socket_recv(switch_socket_t *sock, char *buf, switch_size_t *len)
 {
 	switch_status_t r;
@@ -1223,6 +1353,15 @@ SWITCH_DECLARE(int) switch_atomic_dec(volatile switch_atomic_t *mem)
 #endif
 }
 
+SWITCH_DECLARE(uint32_t) switch_atomic_cas(volatile switch_atomic_t *mem, uint32_t with, uint32_t cmp)
+{
+#ifdef apr_atomic_t
+	return apr_atomic_cas((apr_atomic_t *)mem, with, cmp);
+#else
+	return apr_atomic_cas32((apr_uint32_t *)mem, with, cmp);
+#endif
+}
+
 
 /* For Emacs:
  * Local Variables:
@@ -35,9 +35,31 @@
 static uint32_t buffer_id = 0;
 
 typedef enum {
-	SWITCH_BUFFER_FLAG_DYNAMIC = (1 << 0)
+	SWITCH_BUFFER_FLAG_DYNAMIC = (1 << 0),
+	SWITCH_BUFFER_FLAG_RING = (1 << 1),
+	SWITCH_BUFFER_FLAG_MALLOC = (1 << 2)
 } switch_buffer_flag_t;
 
+/* Ring buffers are shared between exactly one producer and one consumer thread without a lock,
+   the index that one side publishes must not become visible before the data it covers. */
+#if defined(__GNUC__)
+#define switch_buffer_barrier() __sync_synchronize()
+#elif defined(_MSC_VER)
+#define switch_buffer_barrier() MemoryBarrier()
+#else
+#define switch_buffer_barrier()
+#endif
+
+/* The read position is also moved by the producer when switch_buffer_slide_write discards old data,
+   so both sides advance it with a compare and swap. */
+#if defined(__GNUC__)
+#define switch_buffer_cas(ptr, old, new) __sync_bool_compare_and_swap(ptr, old, new)
+#elif defined(_MSC_VER)
+#define switch_buffer_cas(ptr, old, new) (InterlockedCompareExchangePointer((PVOID volatile *) (ptr), (PVOID) (new), (PVOID) (old)) == (PVOID) (old))
+#else
+#define switch_buffer_cas(ptr, old, new) (*(ptr) == (old) ? (*(ptr) = (new), 1) : 0)
+#endif
+
 struct switch_buffer {
 	switch_byte_t *data;
 	switch_byte_t *head;
@@ -50,6 +72,9 @@ struct switch_buffer {
 	uint32_t flags;
 	uint32_t id;
 	int32_t loops;
+	volatile switch_size_t rpos;
+	volatile switch_size_t wpos;
+	switch_size_t mask;
 };
 
 SWITCH_DECLARE(switch_status_t) switch_buffer_create(switch_memory_pool_t *pool, switch_buffer_t **buffer, switch_size_t max_len)
@@ -96,6 +121,150 @@ SWITCH_DECLARE(switch_status_t) switch_buffer_create_dynamic(switch_buffer_t **b
 	return SWITCH_STATUS_MEMERR;
 }
 
+SWITCH_DECLARE(switch_status_t) switch_buffer_create_ring(switch_memory_pool_t *pool, switch_buffer_t **buffer, switch_size_t max_len)
+{
+	switch_buffer_t *new_buffer;
+	switch_size_t len = 1;
+
+	while (len < max_len) {
+		len <<= 1;
+	}
+
+	/* the data area is twice the ring size so peek_zerocopy can unwrap into the second half */
+	if (pool) {
+		if (!(new_buffer = switch_core_alloc(pool, sizeof(*new_buffer))) || !(new_buffer->data = switch_core_alloc(pool, len * 2))) {
+			return SWITCH_STATUS_MEMERR;
+		}
+	} else {
+		if (!(new_buffer = malloc(sizeof(*new_buffer)))) {
+			return SWITCH_STATUS_MEMERR;
+		}
+		memset(new_buffer, 0, sizeof(*new_buffer));
+
+		if (!(new_buffer->data = malloc(len * 2))) {
+			free(new_buffer);
+			return SWITCH_STATUS_MEMERR;
+		}
+		memset(new_buffer->data, 0, len * 2);
+		switch_set_flag(new_buffer, SWITCH_BUFFER_FLAG_MALLOC);
+	}
+
+	new_buffer->datalen = len;
+	new_buffer->mask = len - 1;
+	new_buffer->id = buffer_id++;
+	new_buffer->head = new_buffer->data;
+	switch_set_flag(new_buffer, SWITCH_BUFFER_FLAG_RING);
+
+	*buffer = new_buffer;
+	return SWITCH_STATUS_SUCCESS;
+}
+
+static switch_size_t ring_inuse(switch_buffer_t *buffer)
+{
+	switch_size_t used = buffer->wpos - buffer->rpos;
+	switch_buffer_barrier();
+	return used;
+}
+
+static void ring_copy_out(switch_buffer_t *buffer, switch_size_t rpos, void *data, switch_size_t datalen)
+{
+	switch_size_t off = rpos & buffer->mask;
+	switch_size_t first = buffer->datalen - off;
+
+	if (first >= datalen) {
+		memcpy(data, buffer->data + off, datalen);
+	} else {
+		memcpy(data, buffer->data + off, first);
+		memcpy((switch_byte_t *) data + first, buffer->data, datalen - first);
+	}
+}
+
+static switch_size_t ring_read(switch_buffer_t *buffer, void *data, switch_size_t datalen, switch_bool_t consume)
+{
+	switch_size_t rpos, reading;
+
+	for (;;) {
+		rpos = buffer->rpos;
+		reading = buffer->wpos - rpos;
+		switch_buffer_barrier();
+
+		if (!reading) {
+			return 0;
+		}
+
+		if (reading > datalen) {
+			reading = datalen;
+		}
+
+		if (data) {
+			ring_copy_out(buffer, rpos, data, reading);
+		}
+
+		switch_buffer_barrier();
+
+		/* if the producer slid the read position meanwhile, what was copied may have been overwritten */
+		if (consume) {
+			if (switch_buffer_cas(&buffer->rpos, rpos, rpos + reading)) {
+				return reading;
+			}
+		} else if (buffer->rpos == rpos) {
+			return reading;
+		}
+	}
+}
+
+static switch_size_t ring_write(switch_buffer_t *buffer, const void *data, switch_size_t datalen)
+{
+	switch_size_t used = ring_inuse(buffer);
+	switch_size_t off, first;
+
+	if (!datalen) {
+		return used;
+	}
+
+	if (buffer->datalen - used < datalen) {
+		return 0;
+	}
+
+	off = buffer->wpos & buffer->mask;
+	first = buffer->datalen - off;
+
+	if (first >= datalen) {
+		memcpy(buffer->data + off, data, datalen);
+	} else {
+		memcpy(buffer->data + off, data, first);
+		memcpy(buffer->data, (const switch_byte_t *) data + first, datalen - first);
+	}
+
+	switch_buffer_barrier();
+	buffer->wpos += datalen;
+
+	return used + datalen;
+}
+
+/* Make room by moving the read position past the oldest data, then write as usual */
+static switch_size_t ring_slide_write(switch_buffer_t *buffer, const void *data, switch_size_t datalen)
+{
+	switch_size_t rpos, avail;
+
+	if (datalen > buffer->datalen) {
+		data = (const switch_byte_t *) data + (datalen - buffer->datalen);
+		datalen = buffer->datalen;
+	}
+
+	for (;;) {
+		rpos = buffer->rpos;
+		avail = buffer->datalen - (buffer->wpos - rpos);
+		switch_buffer_barrier();
+
+		if (avail >= datalen || switch_buffer_cas(&buffer->rpos, rpos, rpos + (datalen - avail))) {
+			break;
+		}
+	}
+
+	return ring_write(buffer, data, datalen);
+}
+
 SWITCH_DECLARE(void) switch_buffer_add_mutex(switch_buffer_t *buffer, switch_mutex_t *mutex)
 {
 	buffer->mutex = mutex;
@@ -130,6 +299,10 @@ SWITCH_DECLARE(switch_size_t) switch_buffer_len(switch_buffer_t *buffer)
 
 SWITCH_DECLARE(switch_size_t) switch_buffer_freespace(switch_buffer_t *buffer)
 {
+	if (switch_test_flag(buffer, SWITCH_BUFFER_FLAG_RING)) {
+		return buffer->datalen - ring_inuse(buffer);
+	}
+
 	if (switch_test_flag(buffer, SWITCH_BUFFER_FLAG_DYNAMIC)) {
 		if (buffer->max_len) {
 			return (switch_size_t) (buffer->max_len - buffer->used);
@@ -142,6 +315,10 @@ SWITCH_DECLARE(switch_size_t) switch_buffer_freespace(switch_buffer_t *buffer)
 
 SWITCH_DECLARE(switch_size_t) switch_buffer_inuse(switch_buffer_t *buffer)
 {
+	if (switch_test_flag(buffer, SWITCH_BUFFER_FLAG_RING)) {
+		return ring_inuse(buffer);
+	}
+
 	return buffer->used;
 }
 
@@ -149,6 +326,11 @@ SWITCH_DECLARE(switch_size_t) switch_buffer_toss(switch_buffer_t *buffer, switch
 {
 	switch_size_t reading = 0;
 
+	if (switch_test_flag(buffer, SWITCH_BUFFER_FLAG_RING)) {
+		ring_read(buffer, NULL, datalen, SWITCH_TRUE);
+		return ring_inuse(buffer);
+	}
+
 	if (buffer->used < 1) {
 		buffer->used = 0;
 		return 0;
@@ -172,6 +354,12 @@ SWITCH_DECLARE(void) switch_buffer_set_loops(switch_buffer_t *buffer, int32_t lo
 SWITCH_DECLARE(switch_size_t) switch_buffer_read_loop(switch_buffer_t *buffer, void *data, switch_size_t datalen)
 {
 	switch_size_t len;
+
+	/* looping replays data that a ring has already handed back to the producer */
+	if (switch_test_flag(buffer, SWITCH_BUFFER_FLAG_RING)) {
+		return switch_buffer_read(buffer, data, datalen);
+	}
+
 	if ((len = switch_buffer_read(buffer, data, datalen)) == 0) {
 		if (buffer->loops > 0) {
 			buffer->loops--;
@@ -190,6 +378,10 @@ SWITCH_DECLARE(switch_size_t) switch_buffer_read(switch_buffer_t *buffer, void *
 {
 	switch_size_t reading = 0;
 
+	if (switch_test_flag(buffer, SWITCH_BUFFER_FLAG_RING)) {
+		return ring_read(buffer, data, datalen, SWITCH_TRUE);
+	}
+
 	if (buffer->used < 1) {
 		buffer->used = 0;
 		return 0;
@@ -210,6 +402,10 @@ SWITCH_DECLARE(switch_size_t) switch_buffer_peek(switch_buffer_t *buffer, void *
 {
 	switch_size_t reading = 0;
 
+	if (switch_test_flag(buffer, SWITCH_BUFFER_FLAG_RING)) {
+		return ring_read(buffer, data, datalen, SWITCH_FALSE);
+	}
+
 	if (buffer->used < 1) {
 		buffer->used = 0;
 		return 0;
@@ -228,6 +424,26 @@ SWITCH_DECLARE(switch_size_t) switch_buffer_peek_zerocopy(switch_buffer_t *buffe
 {
 	switch_size_t reading = 0;
 
+	if (switch_test_flag(buffer, SWITCH_BUFFER_FLAG_RING)) {
+		switch_size_t off, first;
+
+		if (!(reading = ring_inuse(buffer))) {
+			return 0;
+		}
+
+		off = buffer->rpos & buffer->mask;
+		first = buffer->datalen - off;
+
+		/* The producer never touches the second half of the data area, so the wrapped
+		   part can be mirrored there to hand back one contiguous region. */
+		if (first < reading) {
+			memcpy(buffer->data + buffer->datalen, buffer->data, reading - first);
+		}
+
+		*ptr = buffer->data + off;
+		return reading;
+	}
+
 	if (buffer->used < 1) {
 		buffer->used = 0;
 		return 0;
@@ -246,6 +462,10 @@ SWITCH_DECLARE(switch_size_t) switch_buffer_write(switch_buffer_t *buffer, const
 
 	switch_assert(buffer->data != NULL);
 
+	if (switch_test_flag(buffer, SWITCH_BUFFER_FLAG_RING)) {
+		return ring_write(buffer, data, datalen);
+	}
+
 	if (!datalen) {
 		return buffer->used;
 	}
@@ -297,6 +517,15 @@ SWITCH_DECLARE(void) switch_buffer_zero(switch_buffer_t *buffer)
 {
 	switch_assert(buffer->data != NULL);
 
+	if (switch_test_flag(buffer, SWITCH_BUFFER_FLAG_RING)) {
+		switch_size_t rpos;
+
+		do {
+			rpos = buffer->rpos;
+		} while (!switch_buffer_cas(&buffer->rpos, rpos, buffer->wpos));
+		return;
+	}
+
 	buffer->used = 0;
 	buffer->actually_used = 0;
 	buffer->head = buffer->data;
@@ -318,6 +547,10 @@ SWITCH_DECLARE(switch_size_t) switch_buffer_slide_write(switch_buffer_t *buffer,
 {
 	switch_size_t w;
 
+	if (switch_test_flag(buffer, SWITCH_BUFFER_FLAG_RING)) {
+		return ring_slide_write(buffer, data, datalen);
+	}
+
 	if (!(w = switch_buffer_write(buffer, data, datalen))) {
 		switch_buffer_toss(buffer, datalen);
 		return switch_buffer_write(buffer, data, datalen);
@@ -329,7 +562,7 @@ SWITCH_DECLARE(switch_size_t) switch_buffer_slide_write(switch_buffer_t *buffer,
 SWITCH_DECLARE(void) switch_buffer_destroy(switch_buffer_t **buffer)
 {
 	if (buffer && *buffer) {
-		if ((switch_test_flag((*buffer), SWITCH_BUFFER_FLAG_DYNAMIC))) {
+		if ((switch_test_flag((*buffer), SWITCH_BUFFER_FLAG_DYNAMIC)) || (switch_test_flag((*buffer), SWITCH_BUFFER_FLAG_MALLOC))) {
 			switch_safe_free((*buffer)->data);
 			free(*buffer);
 		}
@@ -1577,6 +1577,7 @@ static uint32_t d_30 = 30;
 
 static void switch_load_core_config(const char *file)
 {
+	static int export_started = 0;
 	switch_xml_t xml = NULL, cfg = NULL;
 
 	switch_core_hash_insert(runtime.ptimes, "ilbc", &d_30);
@@ -1584,6 +1585,9 @@ static void switch_load_core_config(const char *file)
 
 	if ((xml = switch_xml_open_cfg(file, &cfg, NULL))) {
 		switch_xml_t settings, param;
+		const char *export_file = NULL, *export_socket = NULL;
+		switch_size_t export_file_max_size = 100 * 1024 * 1024;
+		uint32_t export_file_keep = 5, export_queue_size = 0;
 
 		if ((settings = switch_xml_child(cfg, "default-ptimes"))) {
 			for (param = switch_xml_child(settings, "codec"); param; param = param->next) {
@@ -1774,6 +1778,8 @@ static void switch_load_core_config(const char *file)
 					switch_rtp_set_start_port((switch_port_t) atoi(val));
 				} else if (!strcasecmp(var, "rtp-end-port") && !zstr(val)) {
 					switch_rtp_set_end_port((switch_port_t) atoi(val));
+				} else if (!strcasecmp(var, "rtp-port-quarantine") && !zstr(val)) {
+					switch_rtp_set_port_quarantine((uint32_t) atoi(val));
 				} else if (!strcasecmp(var, "core-db-name") && !zstr(val)) {
 					runtime.dbname = switch_core_strdup(runtime.memory_pool, val);
 				} else if (!strcasecmp(var, "core-db-dsn") && !zstr(val)) {
@@ -1803,10 +1809,39 @@ static void switch_load_core_config(const char *file)
                 } else if (!strcasecmp(var, "switchname") && !zstr(val)) {
 					runtime.switchname = switch_core_strdup(runtime.memory_pool, val);
                     switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "Set switchname to %s\n", runtime.switchname);
+				} else if (!strcasecmp(var, "event-export-file") && !zstr(val)) {
+					export_file = val;
+				} else if (!strcasecmp(var, "event-export-file-max-size") && !zstr(val)) {
+					export_file_max_size = (switch_size_t) switch_atoul(val) * 1024 * 1024;
+				} else if (!strcasecmp(var, "event-export-file-keep") && !zstr(val)) {
+					export_file_keep = switch_atoul(val);
+				} else if (!strcasecmp(var, "event-export-socket") && !zstr(val)) {
+					export_socket = val;
+				} else if (!strcasecmp(var, "event-export-queue-size") && !zstr(val)) {
+					export_queue_size = switch_atoul(val);
 				}
 			}
 		}
 
+		/* post_load_switch.conf is often the same document as switch.conf, only the first one that names a sink starts it */
+		if ((export_file || export_socket) && !export_started) {
+			export_started = 1;
+		} else {
+			export_file = export_socket = NULL;
+		}
+
+		if (export_file) {
+			char *path = switch_is_file_path(export_file) ? strdup(export_file) :
+				switch_mprintf("%s%s%s", SWITCH_GLOBAL_dirs.log_dir, SWITCH_PATH_SEPARATOR, export_file);
+
+			switch_event_export_file(path, export_file_max_size, export_file_keep, export_queue_size);
+			switch_safe_free(path);
+		}
+
+		if (export_socket) {
+			switch_event_export_socket(export_socket, export_queue_size);
+		}
+
 		if ((settings = switch_xml_child(cfg, "variables"))) {
 			for (param = switch_xml_child(settings, "variable"); param; param = param->next) {
 				const char *var = switch_xml_attr_soft(param, "name");
@@ -57,6 +57,262 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_write_video_frame(switch_cor
 	return status;
 }
 
+SWITCH_DECLARE(switch_status_t) switch_core_session_write_video_train(switch_core_session_t *session, switch_video_train_t *train, switch_io_flag_t flags,
+																	  int stream_id)
+{
+	switch_io_event_hook_video_write_frame_t *ptr;
+	switch_status_t status = SWITCH_STATUS_FALSE;
+	uint32_t i;
+
+	if (switch_channel_down_nosig(session->channel)) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	if (!train->count) {
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	if (!session->endpoint_interface->io_routines->write_video_train) {
+		for (i = 0; i < train->count; i++) {
+			if ((status = switch_core_session_write_video_frame(session, &train->frames[i], flags, stream_id)) != SWITCH_STATUS_SUCCESS) {
+				break;
+			}
+		}
+		return status;
+	}
+
+	if ((status = session->endpoint_interface->io_routines->write_video_train(session, train, flags, stream_id)) == SWITCH_STATUS_SUCCESS) {
+		for (ptr = session->event_hooks.video_write_frame; ptr; ptr = ptr->next) {
+			for (i = 0; i < train->count; i++) {
+				if ((status = ptr->video_write_frame(session, &train->frames[i], flags, stream_id)) != SWITCH_STATUS_SUCCESS) {
+					return status;
+				}
+			}
+		}
+	}
+
+	return status;
+}
+
+SWITCH_DECLARE(switch_status_t) switch_core_video_train_create(switch_video_train_t **train, switch_memory_pool_t *pool)
+{
+	switch_video_train_t *new_train;
+
+	if (!(new_train = switch_core_alloc(pool, sizeof(*new_train)))) {
+		return SWITCH_STATUS_MEMERR;
+	}
+
+	if (!(new_train->arena = switch_core_alloc(pool, SWITCH_VIDEO_TRAIN_ARENA_SIZE))) {
+		return SWITCH_STATUS_MEMERR;
+	}
+
+	*train = new_train;
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+SWITCH_DECLARE(void) switch_core_video_train_reset(switch_video_train_t *train)
+{
+	train->count = 0;
+	train->arena_used = 0;
+	train->complete = SWITCH_FALSE;
+	train->keyframe = SWITCH_FALSE;
+	train->started = 0;
+}
+
+SWITCH_DECLARE(switch_bool_t) switch_core_video_train_stale(switch_video_train_t *train, switch_frame_t *next)
+{
+	if (!train->count || train->complete) {
+		return SWITCH_FALSE;
+	}
+
+	/* a packet of the next picture means the marker went missing */
+	if (next && next->timestamp != train->frames[0].timestamp) {
+		return SWITCH_TRUE;
+	}
+
+	return switch_micro_time_now() - train->started > SWITCH_VIDEO_TRAIN_TIMEOUT ? SWITCH_TRUE : SWITCH_FALSE;
+}
+
+static switch_bool_t h264_is_keyframe(const uint8_t *data, uint32_t len)
+{
+	uint8_t nal;
+	uint32_t off;
+
+	if (len < 1) {
+		return SWITCH_FALSE;
+	}
+
+	nal = data[0] & 0x1f;
+
+	switch (nal) {
+	case 5:						/* IDR slice */
+	case 7:						/* SPS */
+		return SWITCH_TRUE;
+	case 24:					/* STAP-A */
+		for (off = 1; off + 2 < len;) {
+			uint32_t size = (data[off] << 8) | data[off + 1];
+			nal = data[off + 2] & 0x1f;
+			if (nal == 5 || nal == 7) {
+				return SWITCH_TRUE;
+			}
+			off += 2 + size;
+		}
+		break;
+	case 28:					/* FU-A, only the first fragment tells */
+		if (len > 1 && (data[1] & 0x80) && (data[1] & 0x1f) == 5) {
+			return SWITCH_TRUE;
+		}
+		break;
+	default:
+		break;
+	}
+
+	return SWITCH_FALSE;
+}
+
+static switch_bool_t vp8_is_keyframe(const uint8_t *data, uint32_t len)
+{
+	uint32_t off = 1;
+
+	if (len < 2) {
+		return SWITCH_FALSE;
+	}
+
+	/* start of partition 0 */
+	if (!(data[0] & 0x10) || (data[0] & 0x07)) {
+		return SWITCH_FALSE;
+	}
+
+	if (data[0] & 0x80) {
+		uint8_t x = data[off++];
+
+		if (x & 0x80) {
+			if (off < len && (data[off] & 0x80)) {
+				off++;
+			}
+			off++;
+		}
+		if (x & 0x40) {
+			off++;
+		}
+		if (x & 0x30) {
+			off++;
+		}
+	}
+
+	/* the P bit of the payload header is clear on key frames */
+	return (off < len && !(data[off] & 0x01)) ? SWITCH_TRUE : SWITCH_FALSE;
+}
+
+SWITCH_DECLARE(switch_bool_t) switch_core_video_frame_is_keyframe(switch_frame_t *frame)
+{
+	const char *iananame;
+
+	if (!frame->data || !frame->datalen || !frame->codec || !frame->codec->implementation ||
+		!(iananame = frame->codec->implementation->iananame)) {
+		return SWITCH_FALSE;
+	}
+
+	if (!strcasecmp(iananame, "H264")) {
+		return h264_is_keyframe(frame->data, frame->datalen);
+	}
+
+	if (!strcasecmp(iananame, "VP8")) {
+		return vp8_is_keyframe(frame->data, frame->datalen);
+	}
+
+	return SWITCH_FALSE;
+}
+
+SWITCH_DECLARE(switch_status_t) switch_core_video_train_push(switch_video_train_t *train, switch_frame_t *frame)
+{
+	switch_frame_t *dst;
+	uint8_t *packet = frame->packet, *data = frame->data;
+	switch_bool_t data_in_packet = packet && data >= packet && data < packet + frame->packetlen;
+	uint32_t need = 0;
+
+	if (train->complete) {
+		switch_core_video_train_reset(train);
+	}
+
+	if (packet && frame->packetlen) {
+		need += frame->packetlen;
+	}
+
+	if (data && frame->datalen && !data_in_packet) {
+		need += frame->datalen;
+	}
+
+	if (train->count >= SWITCH_VIDEO_TRAIN_MAX_PACKETS || train->arena_used + need > SWITCH_VIDEO_TRAIN_ARENA_SIZE) {
+		return SWITCH_STATUS_MEMERR;
+	}
+
+	if (!train->count) {
+		train->started = switch_micro_time_now();
+	}
+
+	dst = &train->frames[train->count++];
+	*dst = *frame;
+
+	if (packet && frame->packetlen) {
+		dst->packet = train->arena + train->arena_used;
+		memcpy(dst->packet, packet, frame->packetlen);
+		train->arena_used += frame->packetlen;
+
+		if (data_in_packet) {
+			dst->data = (uint8_t *) dst->packet + (data - packet);
+		}
+	} else {
+		dst->packet = NULL;
+		dst->packetlen = 0;
+	}
+
+	if (data && frame->datalen && !data_in_packet) {
+		dst->data = train->arena + train->arena_used;
+		memcpy(dst->data, data, frame->datalen);
+		train->arena_used += frame->datalen;
+	}
+
+	dst->buflen = dst->datalen;
+
+	if (!train->keyframe && switch_core_video_frame_is_keyframe(dst)) {
+		train->keyframe = SWITCH_TRUE;
+	}
+
+	if (frame->m || train->count == SWITCH_VIDEO_TRAIN_MAX_PACKETS) {
+		train->complete = SWITCH_TRUE;
+		return SWITCH_STATUS_BREAK;
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+SWITCH_DECLARE(void) switch_core_video_train_copy(switch_video_train_t *dst, const switch_video_train_t *src)
+{
+	uint32_t i;
+
+	memcpy(dst->arena, src->arena, src->arena_used);
+	dst->arena_used = src->arena_used;
+	dst->count = src->count;
+	dst->complete = src->complete;
+	dst->keyframe = src->keyframe;
+	dst->started = src->started;
+
+	for (i = 0; i < src->count; i++) {
+		const switch_frame_t *s = &src->frames[i];
+		switch_frame_t *d = &dst->frames[i];
+
+		*d = *s;
+		if (s->packet) {
+			d->packet = dst->arena + ((uint8_t *) s->packet - src->arena);
+		}
+		if (s->data) {
+			d->data = dst->arena + ((uint8_t *) s->data - src->arena);
+		}
+	}
+}
+
 SWITCH_DECLARE(switch_status_t) switch_core_session_read_video_frame(switch_core_session_t *session, switch_frame_t **frame, switch_io_flag_t flags,
 																	 int stream_id)
 {
@@ -99,6 +355,53 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_read_video_frame(switch_core
 	return status;
 }
 
+static uint32_t silence_decoded_len(const switch_codec_implementation_t *impl, uint32_t datalen)
+{
+	if (impl->encoded_bytes_per_packet && datalen && !(datalen % impl->encoded_bytes_per_packet)) {
+		return (datalen / impl->encoded_bytes_per_packet) * impl->decoded_bytes_per_packet;
+	}
+
+	return impl->decoded_bytes_per_packet;
+}
+
+/* Encode one packet of digital silence with the given codec the first time it is needed
+   and replay it afterwards so silent frames cost a memcpy instead of an encoder run. */
+static switch_status_t silence_encode(switch_codec_t *codec, const switch_codec_implementation_t **impl, uint8_t *cache, uint32_t *cache_len,
+									  switch_frame_t *out)
+{
+	if (*impl != codec->implementation) {
+		int16_t pcm[SWITCH_RECOMMENDED_BUFFER_SIZE / 2];
+		uint32_t bytes = codec->implementation->decoded_bytes_per_packet;
+		uint32_t rate = codec->implementation->actual_samples_per_second;
+		uint32_t len = SWITCH_RECOMMENDED_BUFFER_SIZE;
+		unsigned int flag = 0;
+
+		*impl = NULL;
+
+		if (!bytes || bytes > sizeof(pcm)) {
+			return SWITCH_STATUS_FALSE;
+		}
+
+		memset(pcm, 0, bytes);
+
+		if (switch_core_codec_encode(codec, NULL, pcm, bytes, rate, cache, &len, &rate, &flag) != SWITCH_STATUS_SUCCESS || !len) {
+			return SWITCH_STATUS_FALSE;
+		}
+
+		*cache_len = len;
+		*impl = codec->implementation;
+	}
+
+	if (*cache_len > out->buflen) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	memcpy(out->data, cache, *cache_len);
+	out->datalen = *cache_len;
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
 SWITCH_DECLARE(switch_status_t) switch_core_session_read_frame(switch_core_session_t *session, switch_frame_t **frame, switch_io_flag_t flags,
 															   int stream_id)
 {
@@ -272,6 +575,22 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_read_frame(switch_core_sessi
 		need_codec = 0;
 	}
 
+	if (switch_channel_test_flag(session->channel, CF_SILENCE_AWARE) && !is_cng &&
+		!((*frame)->flags & (SFF_NOT_AUDIO | SFF_PLC | SFF_RFC2833))) {
+		if (!session->silence_threshold) {
+			const char *var = switch_channel_get_variable(session->channel, "silence_aware_threshold");
+			int tmp = var ? atoi(var) : 0;
+
+			session->silence_threshold = tmp > 0 ? (uint32_t) tmp : SWITCH_DEFAULT_SILENCE_THRESHOLD;
+		}
+
+		if (switch_core_codec_frame_is_silent(&codec_impl, (*frame)->data, (*frame)->datalen, session->silence_threshold)) {
+			switch_set_flag((*frame), SFF_SILENCE);
+		} else {
+			switch_clear_flag((*frame), SFF_SILENCE);
+		}
+	}
+
 
 	if (switch_test_flag(session, SSF_READ_TRANSCODE) && !need_codec && switch_core_codec_ready(session->read_codec)) {
 		switch_core_session_t *other_session;
@@ -357,6 +676,13 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_read_frame(switch_core_sessi
 					session->raw_read_frame.samples = session->raw_read_frame.datalen / sizeof(int16_t);
 					memset(session->raw_read_frame.data, 255, session->raw_read_frame.datalen);
 					status = SWITCH_STATUS_SUCCESS;
+				} else if (switch_test_flag(read_frame, SFF_SILENCE) &&
+						   silence_decoded_len(read_frame->codec->implementation, read_frame->datalen) <= session->raw_read_frame.buflen) {
+					/* nothing audible to decode, hand downstream digital silence */
+					session->raw_read_frame.datalen = silence_decoded_len(read_frame->codec->implementation, read_frame->datalen);
+					session->raw_read_frame.rate = read_frame->codec->implementation->actual_samples_per_second;
+					memset(session->raw_read_frame.data, 0, session->raw_read_frame.datalen);
+					status = SWITCH_STATUS_SUCCESS;
 				} else {
 					switch_thread_rwlock_rdlock(session->bug_rwlock);
 					status = switch_core_codec_decode(use_codec->implementation?use_codec:read_frame->codec,
@@ -426,6 +752,9 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_read_frame(switch_core_sessi
 				if (switch_test_flag(read_frame, SFF_PLC)) {
 					session->raw_read_frame.flags |= SFF_PLC;
 				}
+				if (switch_test_flag(read_frame, SFF_SILENCE)) {
+					session->raw_read_frame.flags |= SFF_SILENCE;
+				}
 				read_frame = &session->raw_read_frame;
 				break;
 			case SWITCH_STATUS_NOOP:
@@ -488,6 +817,11 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_read_frame(switch_core_sessi
 				if (bp->ready && switch_test_flag(bp, SMBF_READ_STREAM)) {
 					switch_mutex_lock(bp->read_mutex);
 					switch_buffer_write(bp->raw_read_buffer, read_frame->data, read_frame->datalen);
+					if (switch_test_flag(read_frame, SFF_SILENCE)) {
+						bp->read_silence += read_frame->datalen;
+					} else {
+						bp->read_silence = 0;
+					}
 
 					if (bp->callback) {
 						ok = bp->callback(bp, bp->user_data, SWITCH_ABC_TYPE_READ);
@@ -569,17 +903,28 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_read_frame(switch_core_sessi
 				switch_assert(enc_frame != NULL);
 				switch_assert(enc_frame->data != NULL);
 
-				status = switch_core_codec_encode(session->read_codec,
-												  enc_frame->codec,
-												  enc_frame->data,
-												  enc_frame->datalen,
-												  session->read_impl.actual_samples_per_second,
-												  session->enc_read_frame.data, &session->enc_read_frame.datalen, &session->enc_read_frame.rate, &flag);
+				if (perfect && switch_test_flag(enc_frame, SFF_SILENCE) &&
+					silence_encode(session->read_codec, &session->silence_read_impl, session->silence_read_buf, &session->silence_read_len,
+								   &session->enc_read_frame) == SWITCH_STATUS_SUCCESS) {
+					status = SWITCH_STATUS_SUCCESS;
+				} else {
+					status = switch_core_codec_encode(session->read_codec,
+													  enc_frame->codec,
+													  enc_frame->data,
+													  enc_frame->datalen,
+													  session->read_impl.actual_samples_per_second,
+													  session->enc_read_frame.data, &session->enc_read_frame.datalen, &session->enc_read_frame.rate, &flag);
+				}
 
 				switch (status) {
 				case SWITCH_STATUS_RESAMPLE:
 					switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Fixme 1\n");
 				case SWITCH_STATUS_SUCCESS:
+					if (perfect && switch_test_flag(enc_frame, SFF_SILENCE)) {
+						switch_set_flag((&session->enc_read_frame), SFF_SILENCE);
+					} else {
+						switch_clear_flag((&session->enc_read_frame), SFF_SILENCE);
+					}
 					session->enc_read_frame.samples = session->read_impl.decoded_bytes_per_packet / sizeof(int16_t);
 					if (perfect) {
 						if (enc_frame->codec->implementation->samples_per_packet != session->read_impl.samples_per_packet) {
@@ -691,6 +1036,11 @@ static switch_status_t perform_write(switch_core_session_t *session, switch_fram
 	switch_io_event_hook_write_frame_t *ptr;
 	switch_status_t status = SWITCH_STATUS_FALSE;
 
+	if (switch_test_flag(frame, SFF_SILENCE) && !switch_channel_test_flag(session->channel, CF_SILENCE_AWARE)) {
+		/* only legs that opted in may turn silence into CN/DTX on the wire */
+		switch_clear_flag(frame, SFF_SILENCE);
+	}
+
 	if (session->endpoint_interface->io_routines->write_frame) {
 
 		if ((status = session->endpoint_interface->io_routines->write_frame(session, frame, flags, stream_id)) == SWITCH_STATUS_SUCCESS) {
@@ -847,12 +1197,22 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_write_frame(switch_core_sess
 
 	if (frame->codec) {
 		session->raw_write_frame.datalen = session->raw_write_frame.buflen;
-		status = switch_core_codec_decode(frame->codec,
-										  session->write_codec,
-										  frame->data,
-										  frame->datalen,
-										  session->write_impl.actual_samples_per_second,
-										  session->raw_write_frame.data, &session->raw_write_frame.datalen, &session->raw_write_frame.rate, &frame->flags);
+
+		if (switch_test_flag(frame, SFF_SILENCE) &&
+			silence_decoded_len(frame->codec->implementation, frame->datalen) <= session->raw_write_frame.buflen) {
+			/* nothing audible to decode, go straight to digital silence */
+			session->raw_write_frame.datalen = silence_decoded_len(frame->codec->implementation, frame->datalen);
+			session->raw_write_frame.rate = frame->codec->implementation->actual_samples_per_second;
+			memset(session->raw_write_frame.data, 0, session->raw_write_frame.datalen);
+			status = SWITCH_STATUS_SUCCESS;
+		} else {
+			status = switch_core_codec_decode(frame->codec,
+											  session->write_codec,
+											  frame->data,
+											  frame->datalen,
+											  session->write_impl.actual_samples_per_second,
+											  session->raw_write_frame.data, &session->raw_write_frame.datalen, &session->raw_write_frame.rate, &frame->flags);
+		}
 
 		if (do_resample && status == SWITCH_STATUS_SUCCESS) {
 			status = SWITCH_STATUS_RESAMPLE;
@@ -863,6 +1223,11 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_write_frame(switch_core_sess
 			resample++;
 			write_frame = &session->raw_write_frame;
 			write_frame->rate = frame->codec->implementation->actual_samples_per_second;
+			if (switch_test_flag(frame, SFF_SILENCE)) {
+				switch_set_flag(write_frame, SFF_SILENCE);
+			} else {
+				switch_clear_flag(write_frame, SFF_SILENCE);
+			}
 			if (!session->write_resampler) {
 				switch_mutex_lock(session->resample_mutex);
 				status = switch_resample_create(&session->write_resampler,
@@ -889,6 +1254,9 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_write_frame(switch_core_sess
 			if (switch_test_flag(frame, SFF_PLC)) {
 				session->raw_write_frame.flags |= SFF_PLC;
 			}
+			if (switch_test_flag(frame, SFF_SILENCE)) {
+				session->raw_write_frame.flags |= SFF_SILENCE;
+			}
 
 			write_frame = &session->raw_write_frame;
 			break;
@@ -975,6 +1343,11 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_write_frame(switch_core_sess
 			if (switch_test_flag(bp, SMBF_WRITE_STREAM)) {
 				switch_mutex_lock(bp->write_mutex);
 				switch_buffer_write(bp->raw_write_buffer, write_frame->data, write_frame->datalen);
+				if (switch_test_flag(write_frame, SFF_SILENCE)) {
+					bp->write_silence += write_frame->datalen;
+				} else {
+					bp->write_silence = 0;
+				}
 				switch_mutex_unlock(bp->write_mutex);
 				
 				if (bp->callback) {
@@ -1033,12 +1406,19 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_write_frame(switch_core_sess
 			enc_frame = write_frame;
 			session->enc_write_frame.datalen = session->enc_write_frame.buflen;
 
-			status = switch_core_codec_encode(session->write_codec,
-											  frame->codec,
-											  enc_frame->data,
-											  enc_frame->datalen,
-											  session->write_impl.actual_samples_per_second,
-											  session->enc_write_frame.data, &session->enc_write_frame.datalen, &session->enc_write_frame.rate, &flag);
+			if (switch_test_flag(enc_frame, SFF_SILENCE) &&
+				silence_encode(session->write_codec, &session->silence_write_impl, session->silence_write_buf, &session->silence_write_len,
+							   &session->enc_write_frame) == SWITCH_STATUS_SUCCESS) {
+				session->enc_write_frame.rate = session->write_impl.actual_samples_per_second;
+				status = SWITCH_STATUS_SUCCESS;
+			} else {
+				status = switch_core_codec_encode(session->write_codec,
+												  frame->codec,
+												  enc_frame->data,
+												  enc_frame->datalen,
+												  session->write_impl.actual_samples_per_second,
+												  session->enc_write_frame.data, &session->enc_write_frame.datalen, &session->enc_write_frame.rate, &flag);
+			}
 
 
 
@@ -1060,6 +1440,9 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_write_frame(switch_core_sess
 				session->enc_write_frame.ssrc = frame->ssrc;
 				session->enc_write_frame.seq = frame->seq;
 				session->enc_write_frame.flags = 0;
+				if (switch_test_flag(enc_frame, SFF_SILENCE)) {
+					session->enc_write_frame.flags |= SFF_SILENCE;
+				}
 				write_frame = &session->enc_write_frame;
 				break;
 			case SWITCH_STATUS_NOOP:
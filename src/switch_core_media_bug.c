@@ -118,12 +118,14 @@ SWITCH_DECLARE(void) switch_core_media_bug_flush(switch_media_bug_t *bug)
 	if (bug->raw_read_buffer) {
 		switch_mutex_lock(bug->read_mutex);
 		switch_buffer_zero(bug->raw_read_buffer);
+		bug->read_silence = 0;
 		switch_mutex_unlock(bug->read_mutex);
 	}
 
 	if (bug->raw_write_buffer) {
 		switch_mutex_lock(bug->write_mutex);
 		switch_buffer_zero(bug->raw_write_buffer);
+		bug->write_silence = 0;
 		switch_mutex_unlock(bug->write_mutex);
 	}
 }
@@ -164,8 +166,9 @@ SWITCH_DECLARE(switch_status_t) switch_core_media_bug_read(switch_media_bug_t *b
 	uint32_t blen;
 	switch_codec_implementation_t read_impl = { 0 };
 	int16_t *tp;
-	switch_size_t do_read = 0, do_write = 0;
+	switch_size_t do_read = 0, do_write = 0, inuse;
 	int fill_read = 0, fill_write = 0;
+	int read_silent = 1, write_silent = 1;
 
 
 	switch_core_session_get_read_impl(bug->session, &read_impl);
@@ -245,6 +248,10 @@ SWITCH_DECLARE(switch_status_t) switch_core_media_bug_read(switch_media_bug_t *b
 	
 	if (do_read) {
 		switch_mutex_lock(bug->read_mutex);
+		/* read_silence counts the silent bytes at the tail of the buffer, so the chunk
+		   at the head is silent only when the whole buffer is */
+		inuse = switch_buffer_inuse(bug->raw_read_buffer);
+		read_silent = bug->read_silence >= inuse;
 		frame->datalen = (uint32_t) switch_buffer_read(bug->raw_read_buffer, frame->data, do_read);
 		if (frame->datalen != do_read) {
 			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(switch_core_media_bug_get_session(bug)), SWITCH_LOG_ERROR, "Framing Error Reading!\n");
@@ -252,6 +259,9 @@ SWITCH_DECLARE(switch_status_t) switch_core_media_bug_read(switch_media_bug_t *b
 			switch_mutex_unlock(bug->read_mutex);
 			return SWITCH_STATUS_FALSE;
 		}
+		if (bug->read_silence > inuse - do_read) {
+			bug->read_silence = inuse - do_read;
+		}
 		switch_mutex_unlock(bug->read_mutex);
 	} else if (fill_read) {
 		frame->datalen = bytes;
@@ -261,6 +271,8 @@ SWITCH_DECLARE(switch_status_t) switch_core_media_bug_read(switch_media_bug_t *b
 	if (do_write) {
 		switch_assert(bug->raw_write_buffer);
 		switch_mutex_lock(bug->write_mutex);
+		inuse = switch_buffer_inuse(bug->raw_write_buffer);
+		write_silent = bug->write_silence >= inuse;
 		datalen = (uint32_t) switch_buffer_read(bug->raw_write_buffer, bug->data, do_write);
 		if (datalen != do_write) {
 			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(switch_core_media_bug_get_session(bug)), SWITCH_LOG_ERROR, "Framing Error Writing!\n");
@@ -268,6 +280,9 @@ SWITCH_DECLARE(switch_status_t) switch_core_media_bug_read(switch_media_bug_t *b
 			switch_mutex_unlock(bug->write_mutex);
 			return SWITCH_STATUS_FALSE;
 		}
+		if (bug->write_silence > inuse - do_write) {
+			bug->write_silence = inuse - do_write;
+		}
 		switch_mutex_unlock(bug->write_mutex);
 	} else if (fill_write) {
 		datalen = bytes;
@@ -281,7 +296,11 @@ SWITCH_DECLARE(switch_status_t) switch_core_media_bug_read(switch_media_bug_t *b
 	wlen = datalen / 2;
 	blen = bytes / 2;
 
-	if (switch_test_flag(bug, SMBF_STEREO)) {
+	if (read_silent && write_silent) {
+		/* neither direction carried anything audible, skip the mix and tell the consumer */
+		memset(frame->data, 0, switch_test_flag(bug, SMBF_STEREO) ? bytes * 2 : bytes);
+		frame->flags |= SFF_SILENCE;
+	} else if (switch_test_flag(bug, SMBF_STEREO)) {
 		int16_t *left, *right;
 		size_t left_len, right_len;
 		if (switch_test_flag(bug, SMBF_STEREO_SWAP)) {
@@ -562,6 +581,24 @@ SWITCH_DECLARE(switch_status_t) switch_core_media_bug_enumerate(switch_core_sess
 	return SWITCH_STATUS_SUCCESS;
 }
 
+SWITCH_DECLARE(uint32_t) switch_core_media_bug_count(switch_core_session_t *session, const char *function)
+{
+	switch_media_bug_t *bp;
+	uint32_t x = 0;
+
+	if (session->bugs) {
+		switch_thread_rwlock_rdlock(session->bug_rwlock);
+		for (bp = session->bugs; bp; bp = bp->next) {
+			if (!function || (bp->function && !strcmp(bp->function, function))) {
+				x++;
+			}
+		}
+		switch_thread_rwlock_unlock(session->bug_rwlock);
+	}
+
+	return x;
+}
+
 SWITCH_DECLARE(switch_status_t) switch_core_media_bug_remove_all(switch_core_session_t *session)
 {
 	switch_media_bug_t *bp;
@@ -35,13 +35,38 @@
 #include <switch.h>
 #include "private/switch_core_pvt.h"
 
+#define PORT_QUARANTINE_MS 2000
+
+typedef enum {
+	PORT_FREE,
+	PORT_USED,
+	PORT_QUARANTINE
+} port_state_t;
+
+/*
+ * Every usable port (or RTP/RTCP pair) is a slot.  Free slots live in an unordered array, a request takes a random
+ * entry and moves the last one into its place, so it is O(1) no matter how full the range is.  Released slots sit in a
+ * FIFO with their release time and only go back on the free list once the quarantine has passed.
+ */
 struct switch_core_port_allocator {
 	switch_port_t start;
 	switch_port_t end;
-	switch_port_t next;
+	switch_port_t step;
 	int8_t *track;
 	uint32_t track_len;
 	uint32_t track_used;
+	uint32_t *free_list;
+	uint32_t free_len;
+	uint32_t *quarantine;
+	switch_time_t *released;
+	uint32_t quarantine_head;
+	uint32_t quarantine_len;
+	switch_time_t quarantine_time;
+	uint32_t seed;
+	uint32_t high_water;
+	uint64_t requests;
+	uint64_t failures;
+	uint64_t reclaimed;
 	switch_port_flag_t flags;
 	switch_mutex_t *mutex;
 	switch_memory_pool_t *pool;
@@ -54,6 +79,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_port_allocator_new(switch_port_t sta
 	switch_memory_pool_t *pool;
 	switch_core_port_allocator_t *alloc;
 	int even, odd;
+	uint32_t x;
 
 	if ((status = switch_core_new_memory_pool(&pool)) != SWITCH_STATUS_SUCCESS) {
 		return status;
@@ -67,6 +93,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_port_allocator_new(switch_port_t sta
 	alloc->flags = flags;
 	even = switch_test_flag(alloc, SPF_EVEN);
 	odd = switch_test_flag(alloc, SPF_ODD);
+	alloc->step = 1;
 
 	if (!(even && odd)) {
 		if (even) {
@@ -78,6 +105,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_port_allocator_new(switch_port_t sta
 				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Rounding odd end port %d to %d\n", end, end - 1);
 				end--;
 			}
+			alloc->step = 2;
 		} else if (odd) {
 			if ((start % 2) == 0) {
 				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Rounding even start port %d to %d\n", start, start + 1);
@@ -87,21 +115,38 @@ SWITCH_DECLARE(switch_status_t) switch_core_port_allocator_new(switch_port_t sta
 				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Rounding even end port %d to %d\n", end, end - 1);
 				end--;
 			}
+			alloc->step = 2;
 		}
 	}
 
-	alloc->track_len = (end - start) + 2;
-
-	if (!(even && odd)) {
-		alloc->track_len /= 2;
+	if (end < start) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Invalid port range %d-%d\n", start, end);
+		switch_core_destroy_memory_pool(&pool);
+		return SWITCH_STATUS_FALSE;
 	}
 
-	alloc->track = switch_core_alloc(pool, (alloc->track_len + 2) * sizeof(switch_byte_t));
+	alloc->track_len = ((end - start) / alloc->step) + 1;
+
+	alloc->track = switch_core_alloc(pool, alloc->track_len * sizeof(int8_t));
+	alloc->free_list = switch_core_alloc(pool, alloc->track_len * sizeof(uint32_t));
+	alloc->quarantine = switch_core_alloc(pool, alloc->track_len * sizeof(uint32_t));
+	alloc->released = switch_core_alloc(pool, alloc->track_len * sizeof(switch_time_t));
+
+	for (x = 0; x < alloc->track_len; x++) {
+		alloc->track[x] = PORT_FREE;
+		alloc->free_list[x] = x;
+	}
+	alloc->free_len = alloc->track_len;
 
 	alloc->start = start;
-	alloc->next = start;
 	alloc->end = end;
+	alloc->quarantine_time = PORT_QUARANTINE_MS * 1000;
 
+	switch_rtp_get_random(&alloc->seed, sizeof(alloc->seed));
+	alloc->seed ^= (uint32_t) (intptr_t) alloc ^ (uint32_t) switch_micro_time_now();
+	if (!alloc->seed) {
+		alloc->seed = 0x9e3779b9;
+	}
 
 	switch_mutex_init(&alloc->mutex, SWITCH_MUTEX_NESTED, pool);
 	alloc->pool = pool;
@@ -110,51 +155,76 @@ SWITCH_DECLARE(switch_status_t) switch_core_port_allocator_new(switch_port_t sta
 	return SWITCH_STATUS_SUCCESS;
 }
 
+static inline uint32_t port_random(switch_core_port_allocator_t *alloc)
+{
+	/* xorshift32, seeded from the srtp rng so the port sequence can not be guessed from the clock */
+	uint32_t x = alloc->seed;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+
+	return alloc->seed = x;
+}
+
+static inline void port_release_quarantine(switch_core_port_allocator_t *alloc, switch_time_t now, int force)
+{
+	while (alloc->quarantine_len) {
+		uint32_t index = alloc->quarantine[alloc->quarantine_head];
+
+		if (!force && now - alloc->released[index] < alloc->quarantine_time) {
+			break;
+		}
+
+		if (++alloc->quarantine_head == alloc->track_len) {
+			alloc->quarantine_head = 0;
+		}
+		alloc->quarantine_len--;
+
+		alloc->track[index] = PORT_FREE;
+		alloc->free_list[alloc->free_len++] = index;
+
+		if (force) {
+			alloc->reclaimed++;
+			break;
+		}
+	}
+}
+
 SWITCH_DECLARE(switch_status_t) switch_core_port_allocator_request_port(switch_core_port_allocator_t *alloc, switch_port_t *port_ptr)
 {
 	switch_port_t port = 0;
 	switch_status_t status = SWITCH_STATUS_FALSE;
-	int even = switch_test_flag(alloc, SPF_EVEN);
-	int odd = switch_test_flag(alloc, SPF_ODD);
+	uint32_t pick, index;
 
 	switch_mutex_lock(alloc->mutex);
-	srand((unsigned) ((unsigned) (intptr_t) port_ptr + (unsigned) (intptr_t) switch_thread_self() + switch_micro_time_now()));
 
-	while (alloc->track_used < alloc->track_len) {
-		uint32_t index;
-		uint32_t tries = 0;
+	alloc->requests++;
 
-		/* randomly pick a port */
-		index = rand() % alloc->track_len;
+	if (alloc->quarantine_len) {
+		port_release_quarantine(alloc, switch_time_ref(), 0);
 
-		/* if it is used walk up the list to find a free one */
-		while (alloc->track[index] && tries < alloc->track_len) {
-			tries++;
-			if (alloc->track[index] < 0) {
-				alloc->track[index]++;
-			}
-			if (++index >= alloc->track_len) {
-				index = 0;
-			}
+		if (!alloc->free_len) {
+			/* out of ports, rather reuse the oldest quarantined port early than fail the call */
+			port_release_quarantine(alloc, 0, 1);
 		}
+	}
 
-		if (tries < alloc->track_len) {
-			alloc->track[index] = 1;
-			alloc->track_used++;
-			status = SWITCH_STATUS_SUCCESS;
+	if (alloc->free_len) {
+		pick = port_random(alloc) % alloc->free_len;
+		index = alloc->free_list[pick];
+		alloc->free_list[pick] = alloc->free_list[--alloc->free_len];
 
-			if ((even && odd)) {
-				port = (switch_port_t) (index + alloc->start);
-			} else {
-				port = (switch_port_t) (index + (alloc->start / 2));
-				port *= 2;
-			}
-			goto end;
+		alloc->track[index] = PORT_USED;
+		if (++alloc->track_used > alloc->high_water) {
+			alloc->high_water = alloc->track_used;
 		}
-	}
-
 
-  end:
+		port = (switch_port_t) (alloc->start + index * alloc->step);
+		status = SWITCH_STATUS_SUCCESS;
+	} else {
+		alloc->failures++;
+	}
 
 	switch_mutex_unlock(alloc->mutex);
 
@@ -172,17 +242,26 @@ SWITCH_DECLARE(switch_status_t) switch_core_port_allocator_request_port(switch_c
 SWITCH_DECLARE(switch_status_t) switch_core_port_allocator_free_port(switch_core_port_allocator_t *alloc, switch_port_t port)
 {
 	switch_status_t status = SWITCH_STATUS_FALSE;
-	int even = switch_test_flag(alloc, SPF_EVEN);
-	int odd = switch_test_flag(alloc, SPF_ODD);
-	int index = port - alloc->start;
+	uint32_t index;
 
-	if (!(even && odd)) {
-		index /= 2;
+	if (port < alloc->start || port > alloc->end || (port - alloc->start) % alloc->step) {
+		return SWITCH_STATUS_FALSE;
 	}
 
+	index = (port - alloc->start) / alloc->step;
+
 	switch_mutex_lock(alloc->mutex);
-	if (alloc->track[index] > 0) {
-		alloc->track[index] = -4;
+	if (alloc->track[index] == PORT_USED) {
+		uint32_t tail = alloc->quarantine_head + alloc->quarantine_len;
+
+		if (tail >= alloc->track_len) {
+			tail -= alloc->track_len;
+		}
+
+		alloc->track[index] = PORT_QUARANTINE;
+		alloc->released[index] = switch_time_ref();
+		alloc->quarantine[tail] = index;
+		alloc->quarantine_len++;
 		alloc->track_used--;
 		status = SWITCH_STATUS_SUCCESS;
 	}
@@ -191,6 +270,30 @@ SWITCH_DECLARE(switch_status_t) switch_core_port_allocator_free_port(switch_core
 	return status;
 }
 
+SWITCH_DECLARE(void) switch_core_port_allocator_set_quarantine(switch_core_port_allocator_t *alloc, uint32_t ms)
+{
+	switch_mutex_lock(alloc->mutex);
+	alloc->quarantine_time = (switch_time_t) ms * 1000;
+	switch_mutex_unlock(alloc->mutex);
+}
+
+SWITCH_DECLARE(void) switch_core_port_allocator_get_stats(switch_core_port_allocator_t *alloc, switch_port_allocator_stats_t *stats)
+{
+	switch_mutex_lock(alloc->mutex);
+	port_release_quarantine(alloc, switch_time_ref(), 0);
+	stats->start = alloc->start;
+	stats->end = alloc->end;
+	stats->total = alloc->track_len;
+	stats->used = alloc->track_used;
+	stats->quarantined = alloc->quarantine_len;
+	stats->available = alloc->free_len;
+	stats->high_water = alloc->high_water;
+	stats->requests = alloc->requests;
+	stats->failures = alloc->failures;
+	stats->reclaimed = alloc->reclaimed;
+	switch_mutex_unlock(alloc->mutex);
+}
+
 SWITCH_DECLARE(void) switch_core_port_allocator_destroy(switch_core_port_allocator_t **alloc)
 {
 	switch_memory_pool_t *pool = (*alloc)->pool;
@@ -1019,6 +1019,20 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_queue_private_event(switch_c
 	return status;
 }
 
+SWITCH_DECLARE(switch_bool_t) switch_core_session_media_tapped(switch_core_session_t *session)
+{
+	switch_io_event_hooks_t *hooks = &session->event_hooks;
+
+	if (session->bugs || session->dmachine[0] || session->dmachine[1] ||
+		hooks->read_frame || hooks->write_frame || hooks->recv_dtmf || hooks->send_dtmf ||
+		(session->real_read_codec && session->read_codec != session->real_read_codec) ||
+		(session->real_write_codec && session->write_codec != session->real_write_codec)) {
+		return SWITCH_TRUE;
+	}
+
+	return SWITCH_FALSE;
+}
+
 #define check_media(session)											\
 	{																	\
 		if (switch_channel_test_flag(session->channel, CF_BROADCAST_DROP_MEDIA)) { \
@@ -1620,6 +1634,7 @@ SWITCH_DECLARE(switch_core_session_t *) switch_core_session_request_xml(switch_e
 	flags[CF_DIALPLAN] = 0;
 	flags[CF_BLOCK_BROADCAST_UNTIL_MEDIA] = 0;
 	flags[CF_CNG_PLC] = 0;
+	flags[CF_SILENCE_AWARE] = 0;
 	flags[CF_ATTENDED_TRANSFER] = 0;
 	flags[CF_LAZY_ATTENDED_TRANSFER] = 0;
 	flags[CF_SIGNAL_DATA] = 0;
@@ -34,6 +34,9 @@
 
 #include <switch.h>
 #include <switch_event.h>
+#ifndef WIN32
+#include <sys/un.h>
+#endif
 //#define SWITCH_EVENT_RECYCLE
 #define DISPATCH_QUEUE_LEN 10000
 //#define DEBUG_DISPATCH_QUEUES
@@ -86,11 +89,13 @@ static switch_hash_t *CUSTOM_HASH = NULL;
 static int THREAD_COUNT = 0;
 static int SYSTEM_RUNNING = 0;
 static uint64_t EVENT_SEQUENCE_NR = 0;
+static switch_event_export_sink_t *EXPORT_SINKS = NULL;
 #ifdef SWITCH_EVENT_RECYCLE
 static switch_queue_t *EVENT_RECYCLE_QUEUE = NULL;
 static switch_queue_t *EVENT_HEADER_RECYCLE_QUEUE = NULL;
 #endif
 static void launch_dispatch_threads(uint32_t max, int len, switch_memory_pool_t *pool);
+static void export_event(switch_event_t *event);
 
 static char *my_dup(const char *s)
 {
@@ -394,6 +399,10 @@ SWITCH_DECLARE(void) switch_event_deliver(switch_event_t **event)
 				break;
 			}
 		}
+
+		if (EXPORT_SINKS) {
+			export_event(*event);
+		}
 		switch_thread_rwlock_unlock(RWLOCK);
 	}
 
@@ -567,6 +576,11 @@ SWITCH_DECLARE(switch_status_t) switch_event_shutdown(void)
 		}
 	}
 
+	while (EXPORT_SINKS) {
+		switch_event_export_sink_t *sink = EXPORT_SINKS;
+		switch_event_export_remove_sink(&sink);
+	}
+
 	for (hi = switch_hash_first(NULL, CUSTOM_HASH); hi; hi = switch_hash_next(hi)) {
 		switch_event_subclass_t *subclass;
 		switch_hash_this(hi, &var, NULL, &val);
@@ -616,6 +630,8 @@ static void launch_dispatch_threads(uint32_t max, int len, switch_memory_pool_t
 	SOFT_MAX_DISPATCH = index;
 }
 
+static void binary_header_index_init(void);
+
 SWITCH_DECLARE(switch_status_t) switch_event_init(switch_memory_pool_t *pool)
 {
 	switch_threadattr_t *thd_attr;;
@@ -635,6 +651,7 @@ SWITCH_DECLARE(switch_status_t) switch_event_init(switch_memory_pool_t *pool)
 	switch_mutex_init(&POOL_LOCK, SWITCH_MUTEX_NESTED, RUNTIME_POOL);
 	switch_mutex_init(&EVENT_QUEUE_MUTEX, SWITCH_MUTEX_NESTED, RUNTIME_POOL);
 	switch_core_hash_init(&CUSTOM_HASH, RUNTIME_POOL);
+	binary_header_index_init();
 
 	switch_mutex_lock(EVENT_QUEUE_MUTEX);
 	SYSTEM_RUNNING = -1;
@@ -1599,6 +1616,829 @@ SWITCH_DECLARE(switch_status_t) switch_event_create_json(switch_event_t **event,
 	return SWITCH_STATUS_SUCCESS;
 }
 
+/* Header names the binary format sends as a one byte code (the index into this table).
+   Keep it identical to BINARY_HEADER_NAMES in libs/esl/src/esl_event.c and only ever append to it.
+*/
+static const char *BINARY_HEADER_NAMES[] = {
+	NULL,
+	"Event-Name", "Core-UUID", "FreeSWITCH-Hostname", "FreeSWITCH-Switchname", "FreeSWITCH-IPv4", "FreeSWITCH-IPv6",
+	"Event-Date-Local", "Event-Date-GMT", "Event-Date-Timestamp", "Event-Calling-File", "Event-Calling-Function",
+	"Event-Calling-Line-Number", "Event-Sequence", "Event-Subclass", "Event-Info", "Unique-ID", "Channel-State",
+	"Channel-Call-State", "Channel-State-Number", "Channel-Name", "Channel-Call-UUID", "Call-Direction",
+	"Presence-Call-Direction", "Channel-HIT-Dialplan", "Channel-Presence-ID", "Channel-Presence-Data", "Answer-State",
+	"Original-Channel-Call-State", "Channel-Read-Codec-Name", "Channel-Read-Codec-Rate", "Channel-Read-Codec-Bit-Rate",
+	"Channel-Write-Codec-Name", "Channel-Write-Codec-Rate", "Channel-Write-Codec-Bit-Rate", "Caller-Direction",
+	"Caller-Username", "Caller-Dialplan", "Caller-Caller-ID-Name", "Caller-Caller-ID-Number", "Caller-Callee-ID-Name",
+	"Caller-Callee-ID-Number", "Caller-Network-Addr", "Caller-ANI", "Caller-ANI-II", "Caller-Destination-Number",
+	"Caller-Unique-ID", "Caller-Source", "Caller-Transfer-Source", "Caller-Context", "Caller-RDNIS",
+	"Caller-Channel-Name", "Caller-Profile-Index", "Caller-Profile-Created-Time", "Caller-Channel-Created-Time",
+	"Caller-Channel-Answered-Time", "Caller-Channel-Progress-Time", "Caller-Channel-Progress-Media-Time",
+	"Caller-Channel-Hangup-Time", "Caller-Channel-Transfer-Time", "Caller-Screen-Bit", "Caller-Privacy-Hide-Name",
+	"Caller-Privacy-Hide-Number", "Other-Type", "Other-Leg-Direction", "Other-Leg-Unique-ID",
+	"Other-Leg-Caller-ID-Name", "Other-Leg-Caller-ID-Number", "Other-Leg-Destination-Number", "Other-Leg-Channel-Name",
+	"Bridge-A-Unique-ID", "Bridge-B-Unique-ID", "Hangup-Cause", "Application", "Application-Data",
+	"Application-Response", "Application-UUID", "Job-UUID", "Job-Command", "Job-Command-Arg", "DTMF-Digit",
+	"DTMF-Duration", "Up-Time", "Session-Count", "Max-Sessions", "Session-Per-Sec", "Session-Since-Startup",
+	"Idle-CPU", "Heartbeat-Interval"
+};
+
+#define BINARY_HEADER_SLOTS 512
+
+static struct {
+	unsigned long hash;
+	uint8_t code;
+} BINARY_HEADER_INDEX[BINARY_HEADER_SLOTS];
+
+static void binary_header_index_init(void)
+{
+	uint8_t code;
+
+	memset(BINARY_HEADER_INDEX, 0, sizeof(BINARY_HEADER_INDEX));
+
+	for (code = 1; code < switch_arraylen(BINARY_HEADER_NAMES); code++) {
+		switch_ssize_t hlen = -1;
+		unsigned long hash = switch_ci_hashfunc_default(BINARY_HEADER_NAMES[code], &hlen);
+		uint32_t slot = hash % BINARY_HEADER_SLOTS;
+
+		while (BINARY_HEADER_INDEX[slot].code) {
+			slot = (slot + 1) % BINARY_HEADER_SLOTS;
+		}
+
+		BINARY_HEADER_INDEX[slot].hash = hash;
+		BINARY_HEADER_INDEX[slot].code = code;
+	}
+}
+
+static uint8_t binary_header_code(switch_event_header_t *hp)
+{
+	uint32_t slot = hp->hash % BINARY_HEADER_SLOTS;
+	uint8_t code;
+
+	while ((code = BINARY_HEADER_INDEX[slot].code)) {
+		if (BINARY_HEADER_INDEX[slot].hash == hp->hash && !strcasecmp(BINARY_HEADER_NAMES[code], hp->name)) {
+			return code;
+		}
+		slot = (slot + 1) % BINARY_HEADER_SLOTS;
+	}
+
+	return 0;
+}
+
+static uint8_t *binary_put_len(uint8_t *p, switch_size_t len)
+{
+	while (len >= 0x80) {
+		*p++ = (uint8_t) (len | 0x80);
+		len >>= 7;
+	}
+	*p++ = (uint8_t) len;
+
+	return p;
+}
+
+SWITCH_DECLARE(switch_status_t) switch_event_serialize_binary(switch_event_t *event, char **str, switch_size_t *len)
+{
+	switch_event_header_t *hp;
+	switch_size_t size = 4 + 10 + 10, count = 0, blen = 0;
+	uint8_t *buf, *p;
+
+	*str = NULL;
+	*len = 0;
+
+	for (hp = event->headers; hp; hp = hp->next) {
+		size += 1 + 10 + strlen(hp->name) + 10 + strlen(hp->value);
+		count++;
+	}
+
+	if (event->body) {
+		blen = strlen(event->body);
+		size += blen;
+	}
+
+	if (!(buf = malloc(size))) {
+		abort();
+	}
+
+	p = buf;
+	*p++ = 'F';
+	*p++ = 'S';
+	*p++ = 'B';
+	*p++ = SWITCH_EVENT_BINARY_VERSION;
+	p = binary_put_len(p, count);
+
+	for (hp = event->headers; hp; hp = hp->next) {
+		switch_size_t vlen = strlen(hp->value);
+		uint8_t code = binary_header_code(hp);
+
+		*p++ = code;
+
+		if (!code) {
+			switch_size_t nlen = strlen(hp->name);
+
+			p = binary_put_len(p, nlen);
+			memcpy(p, hp->name, nlen);
+			p += nlen;
+		}
+
+		p = binary_put_len(p, vlen);
+		memcpy(p, hp->value, vlen);
+		p += vlen;
+	}
+
+	p = binary_put_len(p, blen);
+	if (blen) {
+		memcpy(p, event->body, blen);
+		p += blen;
+	}
+
+	*str = (char *) buf;
+	*len = p - buf;
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+static int binary_get_len(const uint8_t **pp, const uint8_t *end, switch_size_t *len)
+{
+	const uint8_t *p = *pp;
+	switch_size_t val = 0;
+	int shift = 0;
+
+	while (p < end && shift < 35) {
+		val |= (switch_size_t) (*p & 0x7f) << shift;
+		if (!(*p++ & 0x80)) {
+			if (val > (switch_size_t) (end - p)) {
+				return -1;
+			}
+			*pp = p;
+			*len = val;
+			return 0;
+		}
+		shift += 7;
+	}
+
+	return -1;
+}
+
+SWITCH_DECLARE(switch_status_t) switch_event_create_binary(switch_event_t **event, const char *data, switch_size_t len)
+{
+	const uint8_t *p = (const uint8_t *) data, *end = p + len;
+	switch_event_t *new_event;
+	switch_size_t count, i, vlen, nlen;
+	char name[256];
+	char *val;
+
+	*event = NULL;
+
+	if (len < 5 || p[0] != 'F' || p[1] != 'S' || p[2] != 'B' || p[3] != SWITCH_EVENT_BINARY_VERSION) {
+		return SWITCH_STATUS_FALSE;
+	}
+	p += 4;
+
+	if (binary_get_len(&p, end, &count)) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	if (switch_event_create(&new_event, SWITCH_EVENT_CLONE) != SWITCH_STATUS_SUCCESS) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	for (i = 0; i < count; i++) {
+		const char *hname;
+		uint8_t code;
+
+		if (p >= end) {
+			goto fail;
+		}
+
+		if ((code = *p++)) {
+			if (code >= switch_arraylen(BINARY_HEADER_NAMES)) {
+				goto fail;
+			}
+			hname = BINARY_HEADER_NAMES[code];
+		} else {
+			if (binary_get_len(&p, end, &nlen) || !nlen || nlen >= sizeof(name)) {
+				goto fail;
+			}
+			memcpy(name, p, nlen);
+			name[nlen] = '\0';
+			p += nlen;
+			hname = name;
+		}
+
+		if (binary_get_len(&p, end, &vlen)) {
+			goto fail;
+		}
+
+		/* the value is already the exact length so the event takes this copy instead of duplicating it again */
+		switch_malloc(val, vlen + 1);
+		memcpy(val, p, vlen);
+		val[vlen] = '\0';
+		p += vlen;
+
+		if (code == 1) {
+			switch_name_event(val, &new_event->event_id);
+		}
+
+		switch_event_add_header_string(new_event, SWITCH_STACK_BOTTOM | SWITCH_STACK_NODUP, hname, val);
+	}
+
+	/* the body ends the record, anything after it means the lengths before it were wrong */
+	if (binary_get_len(&p, end, &vlen) || vlen != (switch_size_t) (end - p)) {
+		goto fail;
+	}
+
+	if (vlen) {
+		switch_malloc(new_event->body, vlen + 1);
+		memcpy(new_event->body, p, vlen);
+		new_event->body[vlen] = '\0';
+	}
+
+	*event = new_event;
+	return SWITCH_STATUS_SUCCESS;
+
+ fail:
+
+	switch_event_destroy(&new_event);
+	return SWITCH_STATUS_FALSE;
+}
+
+/*
+  Event export: every delivered event is serialized once with switch_event_serialize_binary and the record is
+  offered to each sink's ring. The rings are bounded and lock free for the dispatch threads that fill them, each
+  sink drains its own on its own thread in batches, when a ring is full the record is dropped for that sink only.
+*/
+
+#define EXPORT_QUEUE_SIZE 65536
+#define EXPORT_BATCH_SIZE 256
+#define EXPORT_FLUSH_MS 100
+
+typedef struct {
+	switch_event_export_record_t record;
+	switch_atomic_t refs;
+} export_record_t;
+
+typedef struct {
+	switch_atomic_t seq;
+	export_record_t *volatile rec;
+} export_cell_t;
+
+typedef void (*export_cleanup_t) (void *user_data);
+
+struct switch_event_export_sink {
+	char *name;
+	switch_event_types_t event_id;
+	switch_event_export_write_t write;
+	export_cleanup_t cleanup;
+	void *user_data;
+	export_cell_t *cells;
+	uint32_t mask;
+	switch_atomic_t head;
+	uint32_t tail;
+	uint32_t batch_size;
+	export_record_t **held;
+	switch_event_export_record_t **batch;
+	int running;
+	switch_atomic_t dropped;
+	uint64_t written;
+	uint64_t failed;
+	switch_mutex_t *mutex;
+	switch_thread_cond_t *cond;
+	switch_thread_t *thread;
+	switch_memory_pool_t *pool;
+	struct switch_event_export_sink *next;
+};
+
+static void export_release(export_record_t *rec)
+{
+	if (!switch_atomic_dec(&rec->refs)) {
+		free(rec->record.data);
+		free(rec);
+	}
+}
+
+/* Any number of dispatch threads may push at once, a slot is claimed by moving head past it */
+static switch_bool_t export_push(switch_event_export_sink_t *sink, export_record_t *rec)
+{
+	export_cell_t *cell;
+	uint32_t pos = switch_atomic_read(&sink->head), seq;
+
+	for (;;) {
+		cell = &sink->cells[pos & sink->mask];
+		seq = switch_atomic_read(&cell->seq);
+
+		if (seq == pos) {
+			if (switch_atomic_cas(&sink->head, pos + 1, pos) == pos) {
+				break;
+			}
+		} else if ((int32_t) (seq - pos) < 0) {
+			return SWITCH_FALSE;
+		}
+
+		pos = switch_atomic_read(&sink->head);
+	}
+
+	cell->rec = rec;
+	switch_atomic_cas(&cell->seq, pos + 1, pos);
+
+	/* a full batch is waiting, the sink would otherwise pick it up on its next flush. Signal under the mutex so the
+	   wakeup cannot land between the sink thread draining the ring and starting to wait */
+	if (pos + 1 - sink->tail == sink->batch_size) {
+		switch_mutex_lock(sink->mutex);
+		switch_thread_cond_signal(sink->cond);
+		switch_mutex_unlock(sink->mutex);
+	}
+
+	return SWITCH_TRUE;
+}
+
+/* Only the sink thread pops */
+static export_record_t *export_pop(switch_event_export_sink_t *sink)
+{
+	export_cell_t *cell = &sink->cells[sink->tail & sink->mask];
+	export_record_t *rec;
+
+	if (switch_atomic_read(&cell->seq) != sink->tail + 1) {
+		return NULL;
+	}
+
+	rec = cell->rec;
+	switch_atomic_cas(&cell->seq, sink->tail + sink->mask + 1, sink->tail + 1);
+	sink->tail++;
+
+	return rec;
+}
+
+/* Called by switch_event_deliver with RWLOCK held for reading */
+static void export_event(switch_event_t *event)
+{
+	switch_event_export_sink_t *sink;
+	export_record_t *rec = NULL;
+
+	for (sink = EXPORT_SINKS; sink; sink = sink->next) {
+		if (sink->event_id != SWITCH_EVENT_ALL && sink->event_id != event->event_id) {
+			continue;
+		}
+
+		if (!rec) {
+			switch_zmalloc(rec, sizeof(*rec));
+			rec->record.event_id = event->event_id;
+			switch_event_serialize_binary(event, &rec->record.data, &rec->record.len);
+			switch_atomic_set(&rec->refs, 1);
+		}
+
+		switch_atomic_inc(&rec->refs);
+
+		if (!export_push(sink, rec)) {
+			switch_atomic_dec(&rec->refs);
+			switch_atomic_inc(&sink->dropped);
+		}
+	}
+
+	if (rec) {
+		export_release(rec);
+	}
+}
+
+static void *SWITCH_THREAD_FUNC export_sink_thread(switch_thread_t *thread, void *obj)
+{
+	switch_event_export_sink_t *sink = (switch_event_export_sink_t *) obj;
+	export_record_t *rec;
+	uint32_t count, x;
+	int last = 0;
+
+	for (;;) {
+		switch_mutex_lock(sink->mutex);
+		last = !sink->running;
+		switch_mutex_unlock(sink->mutex);
+
+		for (count = 0; count < sink->batch_size && (rec = export_pop(sink)); count++) {
+			sink->held[count] = rec;
+			sink->batch[count] = &rec->record;
+		}
+
+		if (count) {
+			if (sink->write(sink, sink->batch, count, sink->user_data) == SWITCH_STATUS_SUCCESS) {
+				sink->written += count;
+			} else {
+				sink->failed += count;
+			}
+
+			for (x = 0; x < count; x++) {
+				export_release(sink->held[x]);
+			}
+
+			if (count == sink->batch_size || last) {
+				continue;
+			}
+		}
+
+		if (last) {
+			break;
+		}
+
+		switch_mutex_lock(sink->mutex);
+		/* a full batch may have been pushed since the ring was drained, its signal came before this wait */
+		if (sink->running && switch_atomic_read(&sink->head) - sink->tail < sink->batch_size) {
+			switch_thread_cond_timedwait(sink->cond, sink->mutex, EXPORT_FLUSH_MS * 1000);
+		}
+		switch_mutex_unlock(sink->mutex);
+	}
+
+	return NULL;
+}
+
+static switch_status_t export_sink_add(const char *name, switch_event_types_t event_id, uint32_t queue_size, uint32_t batch_size,
+									   switch_event_export_write_t write, export_cleanup_t cleanup, void *user_data,
+									   switch_event_export_sink_t **sinkp)
+{
+	switch_event_export_sink_t *sink;
+	switch_memory_pool_t *pool;
+	switch_threadattr_t *thd_attr;
+	uint32_t size = 1024, x;
+
+	if (sinkp) {
+		*sinkp = NULL;
+	}
+
+	if (!RWLOCK || zstr(name) || !write) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	if (!queue_size) {
+		queue_size = EXPORT_QUEUE_SIZE;
+	}
+
+	while (size < queue_size && size < 0x40000000) {
+		size <<= 1;
+	}
+
+	if (!batch_size) {
+		batch_size = EXPORT_BATCH_SIZE;
+	}
+
+	if (batch_size > size / 2) {
+		batch_size = size / 2;
+	}
+
+	switch_thread_rwlock_wrlock(RWLOCK);
+
+	for (sink = EXPORT_SINKS; sink; sink = sink->next) {
+		if (!strcasecmp(sink->name, name)) {
+			switch_thread_rwlock_unlock(RWLOCK);
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Event export sink %s already exists\n", name);
+			return SWITCH_STATUS_FALSE;
+		}
+	}
+
+	switch_core_new_memory_pool(&pool);
+	sink = switch_core_alloc(pool, sizeof(*sink));
+	sink->pool = pool;
+	sink->name = switch_core_strdup(pool, name);
+	sink->event_id = event_id;
+	sink->write = write;
+	sink->cleanup = cleanup;
+	sink->user_data = user_data;
+	sink->mask = size - 1;
+	sink->batch_size = batch_size;
+	sink->cells = switch_core_alloc(pool, size * sizeof(*sink->cells));
+	sink->held = switch_core_alloc(pool, batch_size * sizeof(*sink->held));
+	sink->batch = switch_core_alloc(pool, batch_size * sizeof(*sink->batch));
+	sink->running = 1;
+
+	for (x = 0; x < size; x++) {
+		sink->cells[x].seq = x;
+	}
+
+	switch_mutex_init(&sink->mutex, SWITCH_MUTEX_NESTED, pool);
+	switch_thread_cond_create(&sink->cond, pool);
+
+	switch_threadattr_create(&thd_attr, pool);
+	switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+	switch_thread_create(&sink->thread, thd_attr, export_sink_thread, sink, pool);
+
+	sink->next = EXPORT_SINKS;
+	EXPORT_SINKS = sink;
+
+	switch_thread_rwlock_unlock(RWLOCK);
+
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "Event export sink %s started, queue %u batch %u\n", name, size, batch_size);
+
+	if (sinkp) {
+		*sinkp = sink;
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+SWITCH_DECLARE(switch_status_t) switch_event_export_add_sink(const char *name, switch_event_types_t event_id, uint32_t queue_size,
+															 uint32_t batch_size, switch_event_export_write_t write, void *user_data,
+															 switch_event_export_sink_t **sink)
+{
+	return export_sink_add(name, event_id, queue_size, batch_size, write, NULL, user_data, sink);
+}
+
+SWITCH_DECLARE(switch_status_t) switch_event_export_remove_sink(switch_event_export_sink_t **sinkp)
+{
+	switch_event_export_sink_t *sink, *sp, *last = NULL;
+	switch_memory_pool_t *pool;
+	switch_status_t st;
+
+	if (!sinkp || !(sink = *sinkp)) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	switch_thread_rwlock_wrlock(RWLOCK);
+	for (sp = EXPORT_SINKS; sp && sp != sink; sp = sp->next) {
+		last = sp;
+	}
+
+	if (sp) {
+		if (last) {
+			last->next = sp->next;
+		} else {
+			EXPORT_SINKS = sp->next;
+		}
+	}
+	switch_thread_rwlock_unlock(RWLOCK);
+
+	if (!sp) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	switch_mutex_lock(sink->mutex);
+	sink->running = 0;
+	switch_thread_cond_signal(sink->cond);
+	switch_mutex_unlock(sink->mutex);
+
+	switch_thread_join(&st, sink->thread);
+
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "Event export sink %s stopped, %" SWITCH_UINT64_T_FMT " written %"
+					  SWITCH_UINT64_T_FMT " failed %u dropped\n", sink->name, sink->written, sink->failed, switch_atomic_read(&sink->dropped));
+
+	if (sink->cleanup) {
+		sink->cleanup(sink->user_data);
+	}
+
+	pool = sink->pool;
+	switch_core_destroy_memory_pool(&pool);
+	*sinkp = NULL;
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+/* Lay the batch out as records framed by their 4 byte network order length */
+static switch_size_t export_frame(char **buf, switch_size_t *buf_len, switch_event_export_record_t **records, uint32_t count)
+{
+	switch_size_t need = 0;
+	uint32_t x, n;
+	char *p;
+
+	for (x = 0; x < count; x++) {
+		need += 4 + records[x]->len;
+	}
+
+	if (need > *buf_len) {
+		*buf = realloc(*buf, need);
+		switch_assert(*buf);
+		*buf_len = need;
+	}
+
+	for (p = *buf, x = 0; x < count; x++) {
+		n = htonl((uint32_t) records[x]->len);
+		memcpy(p, &n, 4);
+		memcpy(p + 4, records[x]->data, records[x]->len);
+		p += 4 + records[x]->len;
+	}
+
+	return need;
+}
+
+typedef struct {
+	char *path;
+	switch_file_t *fd;
+	switch_size_t size;
+	switch_size_t max_size;
+	uint32_t keep;
+	char *buf;
+	switch_size_t buf_len;
+	switch_memory_pool_t *pool;
+} export_file_t;
+
+static switch_status_t export_file_open(export_file_t *ef)
+{
+	if (switch_file_open(&ef->fd, ef->path, SWITCH_FOPEN_CREATE | SWITCH_FOPEN_WRITE | SWITCH_FOPEN_APPEND,
+						 SWITCH_FPROT_UREAD | SWITCH_FPROT_UWRITE | SWITCH_FPROT_GREAD, ef->pool) != SWITCH_STATUS_SUCCESS) {
+		ef->fd = NULL;
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Cannot open event export file %s\n", ef->path);
+		return SWITCH_STATUS_FALSE;
+	}
+
+	ef->size = switch_file_get_size(ef->fd);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+static void export_file_rotate(export_file_t *ef)
+{
+	char from[1024], to[1024];
+	uint32_t x;
+
+	switch_file_close(ef->fd);
+	ef->fd = NULL;
+
+	for (x = ef->keep; x > 1; x--) {
+		switch_snprintf(from, sizeof(from), "%s.%u", ef->path, x - 1);
+		switch_snprintf(to, sizeof(to), "%s.%u", ef->path, x);
+		switch_file_rename(from, to, ef->pool);
+	}
+
+	if (ef->keep) {
+		switch_snprintf(to, sizeof(to), "%s.1", ef->path);
+		switch_file_rename(ef->path, to, ef->pool);
+	} else {
+		switch_file_remove(ef->path, ef->pool);
+	}
+}
+
+static switch_status_t export_file_write(switch_event_export_sink_t *sink, switch_event_export_record_t **records, uint32_t count, void *user_data)
+{
+	export_file_t *ef = (export_file_t *) user_data;
+	switch_size_t len, nbytes;
+
+	len = export_frame(&ef->buf, &ef->buf_len, records, count);
+
+	if (ef->fd && ef->max_size && ef->size && ef->size + len > ef->max_size) {
+		export_file_rotate(ef);
+	}
+
+	if (!ef->fd && export_file_open(ef) != SWITCH_STATUS_SUCCESS) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	nbytes = len;
+	if (switch_file_write(ef->fd, ef->buf, &nbytes) != SWITCH_STATUS_SUCCESS || nbytes != len) {
+		switch_file_close(ef->fd);
+		ef->fd = NULL;
+		return SWITCH_STATUS_FALSE;
+	}
+
+	ef->size += len;
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+static void export_file_destroy(void *user_data)
+{
+	export_file_t *ef = (export_file_t *) user_data;
+	switch_memory_pool_t *pool = ef->pool;
+
+	if (ef->fd) {
+		switch_file_close(ef->fd);
+	}
+
+	switch_safe_free(ef->buf);
+	switch_core_destroy_memory_pool(&pool);
+}
+
+SWITCH_DECLARE(switch_status_t) switch_event_export_file(const char *path, switch_size_t max_size, uint32_t keep, uint32_t queue_size)
+{
+	switch_memory_pool_t *pool;
+	export_file_t *ef;
+	char name[1024];
+
+	if (zstr(path)) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	switch_core_new_memory_pool(&pool);
+	ef = switch_core_alloc(pool, sizeof(*ef));
+	ef->pool = pool;
+	ef->path = switch_core_strdup(pool, path);
+	ef->max_size = max_size;
+	ef->keep = keep;
+
+	switch_snprintf(name, sizeof(name), "file:%s", path);
+
+	if (export_file_open(ef) != SWITCH_STATUS_SUCCESS ||
+		export_sink_add(name, SWITCH_EVENT_ALL, queue_size, 0, export_file_write, export_file_destroy, ef, NULL) != SWITCH_STATUS_SUCCESS) {
+		export_file_destroy(ef);
+		return SWITCH_STATUS_FALSE;
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+#ifndef WIN32
+typedef struct {
+	char *path;
+	int sock;
+	time_t retry;
+	char *buf;
+	switch_size_t buf_len;
+} export_socket_t;
+
+static void export_socket_close(export_socket_t *es)
+{
+	close(es->sock);
+	es->sock = -1;
+	es->retry = switch_epoch_time_now(NULL) + 1;
+}
+
+static switch_status_t export_socket_write(switch_event_export_sink_t *sink, switch_event_export_record_t **records, uint32_t count, void *user_data)
+{
+	export_socket_t *es = (export_socket_t *) user_data;
+	switch_size_t len;
+	ssize_t r;
+	char *p;
+
+	if (es->sock < 0) {
+		struct sockaddr_un sun;
+		struct timeval tv = { 5, 0 };
+
+		if (switch_epoch_time_now(NULL) < es->retry) {
+			return SWITCH_STATUS_FALSE;
+		}
+
+		memset(&sun, 0, sizeof(sun));
+		sun.sun_family = AF_UNIX;
+		switch_copy_string(sun.sun_path, es->path, sizeof(sun.sun_path));
+
+		if ((es->sock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+			es->retry = switch_epoch_time_now(NULL) + 1;
+			return SWITCH_STATUS_FALSE;
+		}
+
+		/* a stalled reader only holds up this sink, but never for long enough to wedge a shutdown */
+		setsockopt(es->sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+		if (connect(es->sock, (struct sockaddr *) &sun, sizeof(sun)) < 0) {
+			export_socket_close(es);
+			return SWITCH_STATUS_FALSE;
+		}
+
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Event export connected to %s\n", es->path);
+	}
+
+	len = export_frame(&es->buf, &es->buf_len, records, count);
+
+	for (p = es->buf; len; p += r, len -= r) {
+#ifdef MSG_NOSIGNAL
+		r = send(es->sock, p, len, MSG_NOSIGNAL);
+#else
+		r = send(es->sock, p, len, 0);
+#endif
+		if (r <= 0) {
+			/* the reader lost the framing with the partial record, start it over on a new connection */
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Event export to %s failed: %s\n", es->path, strerror(errno));
+			export_socket_close(es);
+			return SWITCH_STATUS_FALSE;
+		}
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+static void export_socket_destroy(void *user_data)
+{
+	export_socket_t *es = (export_socket_t *) user_data;
+
+	if (es->sock > -1) {
+		close(es->sock);
+	}
+
+	switch_safe_free(es->buf);
+	switch_safe_free(es->path);
+	free(es);
+}
+#endif
+
+SWITCH_DECLARE(switch_status_t) switch_event_export_socket(const char *path, uint32_t queue_size)
+{
+#ifndef WIN32
+	export_socket_t *es;
+	char name[1024];
+
+	if (zstr(path)) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	switch_zmalloc(es, sizeof(*es));
+	es->path = strdup(path);
+	es->sock = -1;
+
+	switch_snprintf(name, sizeof(name), "socket:%s", path);
+
+	if (export_sink_add(name, SWITCH_EVENT_ALL, queue_size, 0, export_socket_write, export_socket_destroy, es, NULL) != SWITCH_STATUS_SUCCESS) {
+		export_socket_destroy(es);
+		return SWITCH_STATUS_FALSE;
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+#else
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Event export to a UNIX socket is not available on this platform\n");
+	return SWITCH_STATUS_FALSE;
+#endif
+}
+
 SWITCH_DECLARE(switch_status_t) switch_event_serialize_json(switch_event_t *event, char **str)
 {
 	switch_event_header_t *hp;
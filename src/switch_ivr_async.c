@@ -991,6 +991,7 @@ struct record_helper {
 	uint32_t packet_len;
 	int min_sec;
 	switch_bool_t hangup_on_error;
+	switch_size_t silence_samples;
 };
 
 static switch_bool_t record_callback(switch_media_bug_t *bug, void *user_data, switch_abc_type_t type)
@@ -1031,6 +1032,10 @@ static switch_bool_t record_callback(switch_media_bug_t *bug, void *user_data, s
 				while (switch_core_media_bug_read(bug, &frame, SWITCH_TRUE) == SWITCH_STATUS_SUCCESS) {
 					len = (switch_size_t) frame.datalen / 2;
 
+					if (switch_test_flag((&frame), SFF_SILENCE)) {
+						rh->silence_samples += len;
+					}
+
 					if (len && switch_core_file_write(rh->fh, data, &len) != SWITCH_STATUS_SUCCESS && rh->hangup_on_error) {
 						switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Error writing %s\n", rh->file);
 						switch_channel_hangup(channel, SWITCH_CAUSE_DESTINATION_OUT_OF_ORDER);
@@ -1048,9 +1053,14 @@ static switch_bool_t record_callback(switch_media_bug_t *bug, void *user_data, s
 				}
 			}
 
+			if (rh->silence_samples) {
+				switch_channel_set_variable_printf(channel, "RECORD_SILENCE_SAMPLES", "%" SWITCH_SIZE_T_FMT, rh->silence_samples);
+			}
+
 			if (switch_event_create(&event, SWITCH_EVENT_RECORD_STOP) == SWITCH_STATUS_SUCCESS) {
 				switch_channel_event_set_data(channel, event);
 				switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Record-File-Path", rh->file);
+				switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Record-Silence-Samples", "%" SWITCH_SIZE_T_FMT, rh->silence_samples);
 				switch_event_fire(&event);
 			}
 
@@ -1108,6 +1118,12 @@ static switch_bool_t record_callback(switch_media_bug_t *bug, void *user_data, s
 			if (status == SWITCH_STATUS_SUCCESS || status == SWITCH_STATUS_BREAK) {
 				len = (switch_size_t) frame.datalen / 2;
 
+				/* the bug already produced the zeros without mixing; the file still
+				   needs them to keep time, just account for them */
+				if (switch_test_flag((&frame), SFF_SILENCE)) {
+					rh->silence_samples += len;
+				}
+
 				if (len && switch_core_file_write(rh->fh, data, &len) != SWITCH_STATUS_SUCCESS && rh->hangup_on_error) {
 					switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Error writing %s\n", rh->file);
 					switch_channel_hangup(channel, SWITCH_CAUSE_DESTINATION_OUT_OF_ORDER);
@@ -53,6 +53,10 @@ static void *SWITCH_THREAD_FUNC video_bridge_thread(switch_thread_t *thread, voi
 	switch_channel_t *b_channel = switch_core_session_get_channel(vh->session_b);
 	switch_status_t status;
 	switch_frame_t *read_frame;
+	switch_video_train_t *train = NULL;
+
+	/* collect each access unit and hand it to the other leg in one write */
+	switch_core_video_train_create(&train, switch_core_session_get_pool(vh->session_a));
 
 	vh->up = 1;
 	while (switch_channel_ready(channel) && switch_channel_ready(b_channel) && vh->up == 1) {
@@ -61,12 +65,41 @@ static void *SWITCH_THREAD_FUNC video_bridge_thread(switch_thread_t *thread, voi
 			break;
 		}
 
-		if (!switch_test_flag(read_frame, SFF_CNG)) {
+		/* a picture whose marker was lost goes out once the next one starts or it has waited too long */
+		if (train && switch_core_video_train_stale(train, switch_test_flag(read_frame, SFF_CNG) ? NULL : read_frame)) {
+			status = switch_core_session_write_video_train(vh->session_b, train, SWITCH_IO_FLAG_NONE, 0);
+			switch_core_video_train_reset(train);
+			if (status != SWITCH_STATUS_SUCCESS) {
+				break;
+			}
+		}
+
+		if (switch_test_flag(read_frame, SFF_CNG)) {
+			continue;
+		}
+
+		if (!train) {
 			if (switch_core_session_write_video_frame(vh->session_b, read_frame, SWITCH_IO_FLAG_NONE, 0) != SWITCH_STATUS_SUCCESS) {
 				break;
 			}
+			continue;
 		}
 
+		if (switch_core_video_train_push(train, read_frame) == SWITCH_STATUS_MEMERR) {
+			status = switch_core_session_write_video_train(vh->session_b, train, SWITCH_IO_FLAG_NONE, 0);
+			switch_core_video_train_reset(train);
+			if (status != SWITCH_STATUS_SUCCESS) {
+				break;
+			}
+			switch_core_video_train_push(train, read_frame);
+		}
+
+		if (train->complete) {
+			if (switch_core_session_write_video_train(vh->session_b, train, SWITCH_IO_FLAG_NONE, 0) != SWITCH_STATUS_SUCCESS) {
+				break;
+			}
+			switch_core_video_train_reset(train);
+		}
 	}
 
 	switch_core_session_kill_channel(vh->session_b, SWITCH_SIG_BREAK);
@@ -158,6 +191,35 @@ struct switch_ivr_bridge_data {
 };
 typedef struct switch_ivr_bridge_data switch_ivr_bridge_data_t;
 
+static switch_bool_t bridge_relay_allowed(switch_core_session_t *session_a, switch_core_session_t *session_b, switch_input_callback_function_t input_callback)
+{
+	switch_channel_t *chan_a = switch_core_session_get_channel(session_a);
+	switch_channel_t *chan_b = switch_core_session_get_channel(session_b);
+	switch_codec_implementation_t read_impl = { 0 };
+	switch_codec_implementation_t write_impl = { 0 };
+
+	/* anything that wants to look at the frames or the dtmf keeps the call on the media path */
+	if (input_callback || switch_channel_has_dtmf(chan_a) || !switch_channel_media_ready(chan_a) || !switch_channel_media_ready(chan_b) ||
+		switch_channel_test_flag(chan_a, CF_HOLD) || switch_channel_test_flag(chan_a, CF_SUSPEND) || switch_channel_test_flag(chan_b, CF_SUSPEND) ||
+		switch_channel_test_flag(chan_a, CF_BRIDGE_NOWRITE) || switch_channel_test_flag(chan_a, CF_PROXY_MODE) || switch_channel_test_flag(chan_b, CF_PROXY_MODE) ||
+		switch_core_session_media_tapped(session_a) || switch_core_session_media_tapped(session_b)) {
+		return SWITCH_FALSE;
+	}
+
+	if (switch_core_session_get_read_impl(session_a, &read_impl) != SWITCH_STATUS_SUCCESS ||
+		switch_core_session_get_write_impl(session_b, &write_impl) != SWITCH_STATUS_SUCCESS) {
+		return SWITCH_FALSE;
+	}
+
+	if (zstr(read_impl.iananame) || zstr(write_impl.iananame) || strcasecmp(read_impl.iananame, write_impl.iananame) ||
+		read_impl.samples_per_second != write_impl.samples_per_second || read_impl.number_of_channels != write_impl.number_of_channels ||
+		read_impl.microseconds_per_packet != write_impl.microseconds_per_packet) {
+		return SWITCH_FALSE;
+	}
+
+	return SWITCH_TRUE;
+}
+
 static void *audio_bridge_thread(switch_thread_t *thread, void *obj)
 {
 	switch_ivr_bridge_data_t *data = obj;
@@ -182,6 +244,9 @@ static void *audio_bridge_thread(switch_thread_t *thread, void *obj)
 	time_t answer_limit = 0;
 	const char *exec_app = NULL;
 	const char *exec_data = NULL;
+	int relay_media = 0;
+	uint32_t relay_wait = 0;
+	switch_rtp_t *relay_rtp = NULL;
 
 #ifdef SWITCH_VIDEO_IN_THREADS
 	switch_thread_t *vid_thread = NULL;
@@ -208,6 +273,8 @@ static void *audio_bridge_thread(switch_thread_t *thread, void *obj)
 		exec_data = switch_channel_get_variable(chan_a, "bridge_pre_execute_data");
 	}
 
+	relay_media = switch_true(switch_channel_get_variable(chan_a, "bridge_relay_media"));
+
 	bypass_media_after_bridge = switch_channel_test_flag(chan_a, CF_BYPASS_MEDIA_AFTER_BRIDGE);
 	switch_channel_clear_flag(chan_a, CF_BYPASS_MEDIA_AFTER_BRIDGE);
 
@@ -476,6 +543,39 @@ static void *audio_bridge_thread(switch_thread_t *thread, void *obj)
 		}
 #endif
 
+		if (relay_media) {
+			switch_rtp_t *rtp_a = switch_channel_get_private(chan_a, SWITCH_RTP_AUDIO_PRIVATE);
+
+			if (relay_rtp && (relay_rtp != rtp_a || !switch_rtp_relay_active(relay_rtp) || !bridge_relay_allowed(session_a, session_b, input_callback))) {
+				switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session_a), SWITCH_LOG_DEBUG, "%s falling back to the media path\n", switch_channel_get_name(chan_a));
+				switch_rtp_relay_stop(relay_rtp);
+				relay_rtp = NULL;
+				relay_wait = 0;
+			}
+
+			/* (re)try every few frames so dtmf and codec changes settle on the media path first */
+			if (!relay_rtp && !silence_val && ans_a && ++relay_wait > DEFAULT_LEAD_FRAMES) {
+				switch_rtp_t *rtp_b = switch_channel_get_private(chan_b, SWITCH_RTP_AUDIO_PRIVATE);
+
+				relay_wait = 0;
+
+				if (rtp_a && rtp_b && bridge_relay_allowed(session_a, session_b, input_callback) &&
+					switch_rtp_relay_start(rtp_a, rtp_b) == SWITCH_STATUS_SUCCESS) {
+					switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session_a), SWITCH_LOG_DEBUG, "%s relaying media to %s\n",
+									  switch_channel_get_name(chan_a), switch_channel_get_name(chan_b));
+					relay_rtp = rtp_a;
+				}
+			}
+
+			if (relay_rtp) {
+				switch_codec_implementation_t read_impl = { 0 };
+
+				switch_core_session_get_read_impl(session_a, &read_impl);
+				switch_yield(read_impl.microseconds_per_packet ? read_impl.microseconds_per_packet : 20000);
+				continue;
+			}
+		}
+
 		/* read audio from 1 channel and write it to the other */
 		status = switch_core_session_read_frame(session_a, &read_frame, SWITCH_IO_FLAG_NONE, stream_id);
 
@@ -509,6 +609,11 @@ static void *audio_bridge_thread(switch_thread_t *thread, void *obj)
 
   end_of_bridge_loop:
 
+	if (relay_rtp) {
+		switch_rtp_relay_stop(relay_rtp);
+		relay_rtp = NULL;
+	}
+
 #ifdef SWITCH_VIDEO_IN_THREADS
 	if (vid_thread) {
 		vh.up = -1;
@@ -703,17 +703,10 @@ SWITCH_DECLARE(switch_status_t) switch_ivr_record_file(switch_core_session_t *se
 
 		if (!asis && fh->thresh) {
 			int16_t *fdata = (int16_t *) read_frame->data;
-			uint32_t samples = read_frame->datalen / sizeof(*fdata);
-			uint32_t score, count = 0, j = 0;
-			double energy = 0;
+			uint32_t samples = read_frame->datalen / sizeof(*fdata) / read_impl.number_of_channels;
+			uint32_t score;
 
-
-			for (count = 0; count < samples; count++) {
-				energy += abs(fdata[j]);
-				j += read_impl.number_of_channels;
-			}
-
-			score = (uint32_t) (energy / (samples / divisor));
+			score = switch_sln_energy(fdata, samples, read_impl.number_of_channels) * divisor;
 
 			if (score < fh->thresh) {
 				if (!--fh->silence_hits) {
@@ -1729,8 +1722,7 @@ SWITCH_DECLARE(switch_status_t) switch_ivr_play_file(switch_core_session_t *sess
 SWITCH_DECLARE(switch_status_t) switch_ivr_wait_for_silence(switch_core_session_t *session, uint32_t thresh,
 															uint32_t silence_hits, uint32_t listen_hits, uint32_t timeout_ms, const char *file)
 {
-	uint32_t score, count = 0, j = 0;
-	double energy = 0;
+	uint32_t score;
 	switch_channel_t *channel = switch_core_session_get_channel(session);
 	int divisor = 0;
 	uint32_t org_silence_hits = silence_hits;
@@ -1781,7 +1773,9 @@ SWITCH_DECLARE(switch_status_t) switch_ivr_wait_for_silence(switch_core_session_
 
 	write_frame.codec = &raw_codec;
 
-	divisor = read_impl.actual_samples_per_second / 8000;
+	if (!(divisor = read_impl.actual_samples_per_second / 8000)) {
+		divisor = 1;
+	}
 	channels = read_impl.number_of_channels;
 
 	switch_core_session_set_read_codec(session, &raw_codec);
@@ -1825,12 +1819,7 @@ SWITCH_DECLARE(switch_status_t) switch_ivr_wait_for_silence(switch_core_session_
 
 		data = (int16_t *) read_frame->data;
 
-		for (energy = 0, j = 0, count = 0; count < read_frame->samples; count++) {
-			energy += abs(data[j++]);
-			j += channels;
-		}
-
-		score = (uint32_t) (energy / (read_frame->samples / divisor));
+		score = switch_sln_energy(data, read_frame->samples, channels) * divisor;
 
 		if (score >= thresh) {
 			listening++;
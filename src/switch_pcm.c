@@ -267,6 +267,64 @@ static switch_status_t switch_g711a_destroy(switch_codec_t *codec)
 	return SWITCH_STATUS_SUCCESS;
 }
 
+SWITCH_DECLARE(switch_bool_t) switch_core_codec_frame_is_silent(const switch_codec_implementation_t *impl, const void *data, uint32_t datalen,
+																uint32_t threshold)
+{
+	uint32_t x, loud = 0, limit;
+
+	if (!impl || !data || !datalen) {
+		return SWITCH_FALSE;
+	}
+
+	if (!threshold) {
+		threshold = SWITCH_DEFAULT_SILENCE_THRESHOLD;
+	} else if (threshold > 32767) {
+		threshold = 32767;
+	}
+
+	/* Both companding laws store sign + 3 bit segment + 4 bit mantissa, so once the
+	   ulaw complement or the alaw even bit inversion is undone the low 7 bits grow
+	   with the amplitude and the threshold can be compared without decoding. */
+	if (impl->ianacode == 0 || impl->ianacode == 8) {
+		const uint8_t *p = (const uint8_t *) data;
+		uint8_t level;
+
+		if (impl->ianacode == 0) {
+			level = (uint8_t) (~linear_to_ulaw((int) threshold)) & 0x7f;
+			for (x = 0; x < datalen; x++) {
+				if (((uint8_t) ~p[x] & 0x7f) > level) {
+					loud++;
+				}
+			}
+		} else {
+			level = (linear_to_alaw((int) threshold) ^ 0x55) & 0x7f;
+			for (x = 0; x < datalen; x++) {
+				if (((p[x] ^ 0x55) & 0x7f) > level) {
+					loud++;
+				}
+			}
+		}
+
+		limit = datalen / 16;
+	} else if (impl->iananame && !strcasecmp(impl->iananame, "L16")) {
+		const int16_t *p = (const int16_t *) data;
+		uint32_t samples = datalen / sizeof(int16_t);
+
+		for (x = 0; x < samples; x++) {
+			if ((uint32_t) abs(p[x]) > threshold) {
+				loud++;
+			}
+		}
+
+		limit = samples / 16;
+	} else {
+		return SWITCH_FALSE;
+	}
+
+	/* tolerate a few stray clicks per frame */
+	return loud <= limit ? SWITCH_TRUE : SWITCH_FALSE;
+}
+
 
 static void mod_g711_load(switch_loadable_module_interface_t ** module_interface, switch_memory_pool_t *pool)
 {
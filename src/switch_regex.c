@@ -52,18 +52,17 @@ SWITCH_DECLARE(void) switch_regex_free(void *data)
 
 }
 
-SWITCH_DECLARE(int) switch_regex_perform(const char *field, const char *expression, switch_regex_t **new_re, int *ovector, uint32_t olen)
+SWITCH_DECLARE(switch_regex_t *) switch_regex_compile_expression(const char *expression)
 {
 	const char *error = NULL;
 	int erroffset = 0;
 	pcre *re = NULL;
-	int match_count = 0;
 	char *tmp = NULL;
 	uint32_t flags = 0;
 	char abuf[256] = "";
 
-	if (!(field && expression)) {
-		return 0;
+	if (!expression) {
+		return NULL;
 	}
 
 	if (*expression == '_') {
@@ -100,10 +99,22 @@ SWITCH_DECLARE(int) switch_regex_perform(const char *field, const char *expressi
 	if (error) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "COMPILE ERROR: %d [%s][%s]\n", erroffset, error, expression);
 		switch_regex_safe_free(re);
-		goto end;
 	}
 
-	match_count = pcre_exec(re,	/* result of pcre_compile() */
+  end:
+	switch_safe_free(tmp);
+	return (switch_regex_t *) re;
+}
+
+SWITCH_DECLARE(int) switch_regex_exec(switch_regex_t *re, const char *field, int *ovector, uint32_t olen)
+{
+	int match_count;
+
+	if (!(re && field)) {
+		return 0;
+	}
+
+	match_count = pcre_exec((pcre *) re,	/* result of pcre_compile() */
 							NULL,	/* we didn't study the pattern */
 							field,	/* the subject string */
 							(int) strlen(field),	/* the length of the subject string */
@@ -112,16 +123,28 @@ SWITCH_DECLARE(int) switch_regex_perform(const char *field, const char *expressi
 							ovector,	/* vector of integers for substring information */
 							olen);	/* number of elements (NOT size in bytes) */
 
+	return match_count > 0 ? match_count : 0;
+}
 
-	if (match_count <= 0) {
+SWITCH_DECLARE(int) switch_regex_perform(const char *field, const char *expression, switch_regex_t **new_re, int *ovector, uint32_t olen)
+{
+	switch_regex_t *re = NULL;
+	int match_count = 0;
+
+	if (!(field && expression)) {
+		return 0;
+	}
+
+	if (!(re = switch_regex_compile_expression(expression))) {
+		return 0;
+	}
+
+	if (!(match_count = switch_regex_exec(re, field, ovector, olen))) {
 		switch_regex_safe_free(re);
-		match_count = 0;
 	}
 
-	*new_re = (switch_regex_t *) re;
+	*new_re = re;
 
-  end:
-	switch_safe_free(tmp);
 	return match_count;
 }
 
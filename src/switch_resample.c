@@ -274,6 +274,57 @@ SWITCH_DECLARE(void) switch_mux_channels(int16_t *data, switch_size_t samples, u
 
 }
 
+SWITCH_DECLARE(uint32_t) switch_sln_energy(const int16_t *data, uint32_t samples, uint32_t channels)
+{
+	uint32_t a0 = 0, a1 = 0, a2 = 0, a3 = 0;
+	uint32_t x = 0;
+
+	if (!samples) {
+		return 0;
+	}
+
+	if (channels <= 1) {
+		/* independent accumulators let the compiler keep several lanes busy */
+		for (; x + 4 <= samples; x += 4) {
+			a0 += (uint32_t) abs(data[x]);
+			a1 += (uint32_t) abs(data[x + 1]);
+			a2 += (uint32_t) abs(data[x + 2]);
+			a3 += (uint32_t) abs(data[x + 3]);
+		}
+		for (; x < samples; x++) {
+			a0 += (uint32_t) abs(data[x]);
+		}
+	} else {
+		for (; x < samples; x++) {
+			a0 += (uint32_t) abs(data[x * channels]);
+		}
+	}
+
+	return (a0 + a1 + a2 + a3) / samples;
+}
+
+/* number of frames the estimate follows the input closely before settling */
+#define NOISE_FLOOR_WARMUP 10
+
+SWITCH_DECLARE(uint32_t) switch_sln_noise_floor_update(switch_noise_floor_t *nf, uint32_t energy)
+{
+	if (nf->frames < NOISE_FLOOR_WARMUP) {
+		nf->level = nf->frames ? (nf->level + energy) / 2 : energy;
+		nf->frames++;
+	} else if (energy < nf->level) {
+		/* drop quickly when it gets quieter */
+		nf->level -= (nf->level - energy + 3) / 4;
+	} else if (energy <= nf->level * 2) {
+		/* follow noise that fluctuates or slowly gets louder */
+		nf->level += ((energy - nf->level) >> 4) + (energy > nf->level);
+	} else {
+		/* anything louder is likely speech, only creep up so a lasting change is picked up eventually */
+		nf->level++;
+	}
+
+	return nf->level;
+}
+
 SWITCH_DECLARE(void) switch_change_sln_volume_granular(int16_t *data, uint32_t samples, int32_t vol)
 {
 	double newrate = 0;
@@ -58,14 +58,24 @@
 #define rtp_header_len 12
 #define RTP_START_PORT 16384
 #define RTP_END_PORT 32768
+#define RTP_PORT_QUARANTINE_MS 2000
 #define MASTER_KEY_LEN   30
 #define RTP_MAGIC_NUMBER 42
 #define MAX_SRTP_ERRS 10
 #define RTP_TS_RESET 1
+#define RTP_SILENCE_CN_INTERVAL 50
+#define RTP_TRAIN_SLACK 64
+#define RTP_TRAIN_ARENA_SIZE (SWITCH_VIDEO_TRAIN_ARENA_SIZE + SWITCH_VIDEO_TRAIN_MAX_PACKETS * (RTP_TRAIN_SLACK + 12))
+
+/* per stage latency histograms of the read/write loops, build with -DSWITCH_RTP_NO_LATENCY_STATS to drop them */
+#ifndef SWITCH_RTP_NO_LATENCY_STATS
+#define RTP_LATENCY_STATS
+#endif
 
 static switch_port_t START_PORT = RTP_START_PORT;
 static switch_port_t END_PORT = RTP_END_PORT;
 static switch_port_t NEXT_PORT = RTP_START_PORT;
+static uint32_t PORT_QUARANTINE_MS = RTP_PORT_QUARANTINE_MS;
 static switch_mutex_t *port_lock = NULL;
 
 typedef srtp_hdr_t rtp_hdr_t;
@@ -87,6 +97,259 @@ static int zrtp_on = 0;
 #define ENABLE_SRTP
 #endif
 
+#ifdef ENABLE_SRTP
+#include <aes_icm.h>
+#ifdef HAVE_OPENSSL
+#include <openssl/opensslv.h>
+#if OPENSSL_VERSION_NUMBER >= 0x10001000L
+#include <openssl/evp.h>
+#define SWITCH_HAVE_SRTP_OPENSSL
+#endif
+#endif
+
+/*
+ * libsrtp 1.4 only ships its own table driven AES, so the AES_CM keystream is routed through a small engine
+ * layer installed over the aes_icm cipher type.  libsrtp compares cipher types by address and calls
+ * aes_icm_set_iv() on the cipher state directly, so every engine context starts with a real aes_icm_ctx_t
+ * and only the keystream generation is handed to the selected backend.  The backend is picked per context
+ * when the srtp stream is created, each stream owns its own crypto state so nothing is shared across cores.
+ */
+
+extern cipher_type_t aes_icm;
+
+typedef enum {
+	SRTP_ENGINE_BUILTIN,
+	SRTP_ENGINE_OPENSSL
+} srtp_engine_t;
+
+static const char *SRTP_ENGINE_NAMES[] = { "builtin", "openssl" };
+
+typedef struct {
+	aes_icm_ctx_t icm;
+#ifdef SWITCH_HAVE_SRTP_OPENSSL
+	EVP_CIPHER_CTX *evp;
+	/* kept so the context can be moved to another engine after srtp_create() */
+	uint8_t key[16];
+#endif
+} srtp_engine_ctx_t;
+
+static struct {
+	cipher_type_t builtin;
+	srtp_engine_t engine;
+	int have_openssl;
+	int installed;
+} srtp_engine_globals;
+
+static err_status_t srtp_engine_alloc(cipher_t **c, int key_len)
+{
+	uint8_t *pointer;
+	int len = sizeof(cipher_t) + sizeof(srtp_engine_ctx_t);
+
+	if (key_len != MASTER_KEY_LEN) {
+		return err_status_bad_param;
+	}
+
+	if (!(pointer = crypto_alloc(len))) {
+		return err_status_alloc_fail;
+	}
+
+	memset(pointer, 0, len);
+
+	*c = (cipher_t *) pointer;
+	(*c)->type = &aes_icm;
+	(*c)->state = pointer + sizeof(cipher_t);
+	(*c)->key_len = key_len;
+
+#ifdef SWITCH_HAVE_SRTP_OPENSSL
+	if (srtp_engine_globals.engine == SRTP_ENGINE_OPENSSL) {
+		srtp_engine_ctx_t *ctx = (srtp_engine_ctx_t *) (*c)->state;
+
+		if (!(ctx->evp = EVP_CIPHER_CTX_new())) {
+			crypto_free(pointer);
+			return err_status_alloc_fail;
+		}
+	}
+#endif
+
+	aes_icm.ref_count++;
+
+	return err_status_ok;
+}
+
+static err_status_t srtp_engine_dealloc(cipher_t *c)
+{
+#ifdef SWITCH_HAVE_SRTP_OPENSSL
+	srtp_engine_ctx_t *ctx = (srtp_engine_ctx_t *) c->state;
+
+	if (ctx->evp) {
+		EVP_CIPHER_CTX_free(ctx->evp);
+	}
+#endif
+
+	octet_string_set_to_zero((uint8_t *) c, sizeof(cipher_t) + sizeof(srtp_engine_ctx_t));
+	crypto_free(c);
+	aes_icm.ref_count--;
+
+	return err_status_ok;
+}
+
+static err_status_t srtp_engine_init(void *state, const uint8_t *key, cipher_direction_t dir)
+{
+	srtp_engine_ctx_t *ctx = (srtp_engine_ctx_t *) state;
+	err_status_t status;
+
+	if ((status = srtp_engine_globals.builtin.init(&ctx->icm, key, dir))) {
+		return status;
+	}
+
+#ifdef SWITCH_HAVE_SRTP_OPENSSL
+	memcpy(ctx->key, key, sizeof(ctx->key));
+
+	/* AES_CM is the same keystream in both directions, the salt lives in the counter block set by aes_icm_set_iv() */
+	if (ctx->evp && !EVP_EncryptInit_ex(ctx->evp, EVP_aes_128_ctr(), NULL, key, NULL)) {
+		return err_status_init_fail;
+	}
+#endif
+
+	return err_status_ok;
+}
+
+static err_status_t srtp_engine_encrypt(void *state, uint8_t *buf, unsigned int *bytes)
+{
+	srtp_engine_ctx_t *ctx = (srtp_engine_ctx_t *) state;
+
+#ifdef SWITCH_HAVE_SRTP_OPENSSL
+	if (ctx->evp) {
+		int outl = 0;
+
+		/* same limit as aes_icm_encrypt(), the low 16 bits of the counter may not wrap */
+		if ((*bytes + ntohs(ctx->icm.counter.v16[7])) > 0xffff) {
+			return err_status_terminus;
+		}
+
+		/* aes_icm_set_iv() empties the keystream buffer, restart the evp counter from the new block */
+		if (!ctx->icm.bytes_in_buffer) {
+			if (!EVP_EncryptInit_ex(ctx->evp, NULL, NULL, NULL, ctx->icm.counter.v8)) {
+				return err_status_cipher_fail;
+			}
+			ctx->icm.bytes_in_buffer = 1;
+		}
+
+		if (!EVP_EncryptUpdate(ctx->evp, buf, &outl, buf, (int) *bytes) || outl != (int) *bytes) {
+			return err_status_cipher_fail;
+		}
+
+		return err_status_ok;
+	}
+#endif
+
+	return srtp_engine_globals.builtin.encrypt(&ctx->icm, buf, bytes);
+}
+
+static switch_status_t srtp_engine_lookup(const char *name, srtp_engine_t *engine)
+{
+	if (!strcasecmp(name, SRTP_ENGINE_NAMES[SRTP_ENGINE_OPENSSL])) {
+		if (!srtp_engine_globals.have_openssl) {
+			return SWITCH_STATUS_FALSE;
+		}
+		*engine = SRTP_ENGINE_OPENSSL;
+	} else if (!strcasecmp(name, SRTP_ENGINE_NAMES[SRTP_ENGINE_BUILTIN])) {
+		*engine = SRTP_ENGINE_BUILTIN;
+	} else {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+static switch_status_t srtp_engine_select(const char *name)
+{
+	return srtp_engine_lookup(name, &srtp_engine_globals.engine);
+}
+
+/* Move one stream cipher to an engine, whatever engine new streams get */
+static switch_status_t srtp_engine_bind(cipher_t *c, srtp_engine_t engine)
+{
+	srtp_engine_ctx_t *ctx;
+
+	/* a null cipher has no engine to move */
+	if (!c || c->type != &aes_icm) {
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	ctx = (srtp_engine_ctx_t *) c->state;
+
+#ifdef SWITCH_HAVE_SRTP_OPENSSL
+	if (engine == SRTP_ENGINE_OPENSSL) {
+		if (!ctx->evp) {
+			if (!(ctx->evp = EVP_CIPHER_CTX_new())) {
+				return SWITCH_STATUS_MEMERR;
+			}
+
+			if (!EVP_EncryptInit_ex(ctx->evp, EVP_aes_128_ctr(), NULL, ctx->key, NULL)) {
+				EVP_CIPHER_CTX_free(ctx->evp);
+				ctx->evp = NULL;
+				return SWITCH_STATUS_FALSE;
+			}
+		}
+	} else if (ctx->evp) {
+		EVP_CIPHER_CTX_free(ctx->evp);
+		ctx->evp = NULL;
+	}
+
+	/* the counter block is reloaded on the next packet */
+	ctx->icm.bytes_in_buffer = 0;
+
+	return SWITCH_STATUS_SUCCESS;
+#else
+	return engine == SRTP_ENGINE_BUILTIN ? SWITCH_STATUS_SUCCESS : SWITCH_STATUS_FALSE;
+#endif
+}
+
+static void srtp_engine_install(const char *name, switch_memory_pool_t *pool)
+{
+	srtp_engine_globals.builtin = aes_icm;
+	aes_icm.alloc = (cipher_alloc_func_t) srtp_engine_alloc;
+	aes_icm.dealloc = (cipher_dealloc_func_t) srtp_engine_dealloc;
+	aes_icm.init = srtp_engine_init;
+	aes_icm.encrypt = srtp_engine_encrypt;
+	aes_icm.decrypt = srtp_engine_encrypt;
+	srtp_engine_globals.installed = 1;
+
+	srtp_engine_globals.engine = SRTP_ENGINE_BUILTIN;
+
+	if (cipher_type_self_test(&aes_icm)) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "SRTP engine self test failed, using libsrtp AES_CM.\n");
+		aes_icm = srtp_engine_globals.builtin;
+		srtp_engine_globals.installed = 0;
+		return;
+	}
+
+#ifdef SWITCH_HAVE_SRTP_OPENSSL
+	srtp_engine_globals.engine = SRTP_ENGINE_OPENSSL;
+
+	if (cipher_type_self_test(&aes_icm)) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "OpenSSL AES_CM self test failed, disabling the openssl SRTP engine.\n");
+	} else {
+		srtp_engine_globals.have_openssl = 1;
+	}
+
+	srtp_engine_globals.engine = SRTP_ENGINE_BUILTIN;
+#endif
+
+	if (!name) {
+		name = SRTP_ENGINE_NAMES[srtp_engine_globals.have_openssl ? SRTP_ENGINE_OPENSSL : SRTP_ENGINE_BUILTIN];
+	}
+
+	if (srtp_engine_select(name) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "SRTP engine [%s] is not available, using [%s]\n",
+						  name, SRTP_ENGINE_NAMES[srtp_engine_globals.engine]);
+	}
+
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "SRTP engine [%s]\n", SRTP_ENGINE_NAMES[srtp_engine_globals.engine]);
+}
+#endif
+
 static switch_hash_t *alloc_hash = NULL;
 
 typedef struct {
@@ -149,6 +412,61 @@ struct switch_rtp_rfc2833_data {
 	uint8_t in_digit_queued;
 };
 
+#define RTP_QUALITY_GMIN 16
+#define RTP_QUALITY_MAX_DROPOUT 3000
+#define RTP_QUALITY_MAX_MISORDER 100
+#define RTP_QUALITY_JITTER_BINS 64
+
+/* receive side quality accounting, a fixed amount of state per leg that is updated once per packet */
+struct switch_rtp_quality_data {
+	uint8_t started;
+	uint16_t max_seq;
+	uint32_t ssrc;
+	uint32_t expected;
+	uint32_t received;
+	uint32_t expected_prior;
+	uint32_t received_prior;
+	uint32_t cycles;
+	/* RFC 3550 A.8 interarrival jitter in timestamp units, scaled by 16 */
+	uint32_t last_transit;
+	uint32_t jitter_q4;
+	uint32_t jitter_hist[RTP_QUALITY_JITTER_BINS];
+	uint32_t jitter_samples;
+	/* RFC 3611 A.2 burst/gap counters */
+	uint32_t pkt;
+	uint32_t lost;
+	uint32_t c11, c13, c14, c22, c23, c33;
+	/* loss state transitions for the burst ratio */
+	uint8_t last_lost;
+	uint32_t rr, rl, lr, ll;
+	/* last SR from the far end, for LSR/DLSR */
+	uint32_t lsr;
+	switch_time_t lsr_time;
+	/* what the far end reported about us */
+	uint32_t rtt_ms;
+	uint8_t remote_fraction_lost;
+	uint32_t remote_jitter;
+	uint8_t remote_xr;
+	uint8_t remote_r_factor;
+	uint8_t remote_mos_lq;
+	uint32_t jb_nominal_ms;
+	uint32_t jb_max_ms;
+	uint32_t event_interval;
+	switch_time_t next_event;
+};
+
+struct switch_rtp_relay;
+
+/* outbound packets held back while a packet train is written, they leave in one burst */
+struct rtp_train_queue {
+	uint8_t active;
+	uint32_t count;
+	const char *bufs[SWITCH_VIDEO_TRAIN_MAX_PACKETS];
+	switch_size_t lens[SWITCH_VIDEO_TRAIN_MAX_PACKETS];
+	uint8_t arena[RTP_TRAIN_ARENA_SIZE];
+	uint32_t arena_used;
+};
+
 struct switch_rtp {
 	/* 
 	 * Two sockets are needed because we might be transcoding protocol families
@@ -225,6 +543,8 @@ struct switch_rtp {
 	switch_payload_t te;
 	switch_payload_t recv_te;
 	switch_payload_t cng_pt;
+	uint32_t silence_frames;
+	struct rtp_train_queue *train;
 	switch_mutex_t *flag_mutex;
 	switch_mutex_t *read_mutex;
 	switch_mutex_t *write_mutex;
@@ -262,8 +582,166 @@ struct switch_rtp {
 	uint16_t last_seq;
 	switch_time_t last_read_time;
 	switch_size_t last_flush_packet_count;
+	struct switch_rtp_quality_data quality;
+	uint8_t rtcp_xr;
+	struct switch_rtp_relay *relay_rx;
+	struct switch_rtp_relay *relay_tx;
+#ifdef RTP_LATENCY_STATS
+	switch_rtp_latency_t latency;
+	switch_time_t lat_timer_wake;
+	struct switch_rtp *lat_next;
+	struct switch_rtp *lat_prev;
+#endif
+};
+
+#define RTP_RELAY_MAX_LEGS 8192
+#define RTP_RELAY_POLL_USEC 10000
+#define RTP_RELAY_BURST 16
+
+struct switch_rtp_relay {
+	switch_rtp_t *from;
+	switch_rtp_t *to;
+	switch_pollfd_t pollfd;
+	uint16_t seq_offset;
+	uint32_t ts_offset;
+	uint8_t synced;
+	uint8_t polled;
+	uint8_t dead;
+	switch_size_t packets;
+	switch_size_t dropped;
+	struct switch_rtp_relay *next;
 };
 
+static struct {
+	switch_memory_pool_t *pool;
+	switch_mutex_t *mutex;
+	switch_thread_t *thread;
+	switch_pollset_t *pollset;
+	struct switch_rtp_relay *list;
+	uint32_t legs;
+	uint32_t sync_gen;
+	int running;
+	switch_size_t packets;
+	rtp_msg_t msg;
+} relay_globals;
+
+#ifdef RTP_LATENCY_STATS
+/* live legs are summed on demand, legs that went away are folded into retired */
+static struct {
+	switch_mutex_t *mutex;
+	switch_rtp_t *list;
+	switch_rtp_latency_t retired;
+} latency_globals;
+
+static inline uint32_t rtp_latency_bucket(uint32_t usec)
+{
+	uint32_t msb = 0, v = usec, idx;
+
+	if (usec < 4) {
+		return usec;
+	}
+
+	while (v >>= 1) {
+		msb++;
+	}
+
+	idx = ((msb - 1) << 2) + ((usec >> (msb - 2)) & 3);
+
+	return idx < SWITCH_RTP_HISTOGRAM_BUCKETS ? idx : SWITCH_RTP_HISTOGRAM_BUCKETS - 1;
+}
+
+static inline void rtp_latency_add(switch_rtp_histogram_t *h, switch_time_t usec)
+{
+	uint32_t v = usec < 0 ? 0 : (usec > 0xffffffff ? 0xffffffff : (uint32_t) usec);
+
+	h->counts[rtp_latency_bucket(v)]++;
+	h->count++;
+	h->total_usec += v;
+	if (v > h->max_usec) {
+		h->max_usec = v;
+	}
+}
+
+static void rtp_latency_merge(switch_rtp_latency_t *to, const switch_rtp_latency_t *from)
+{
+	int x, y;
+
+	for (x = 0; x < SWITCH_RTP_LAT_MAX; x++) {
+		const switch_rtp_histogram_t *f = &from->stage[x];
+		switch_rtp_histogram_t *t = &to->stage[x];
+
+		if (!f->count) {
+			continue;
+		}
+
+		for (y = 0; y < SWITCH_RTP_HISTOGRAM_BUCKETS; y++) {
+			t->counts[y] += f->counts[y];
+		}
+		t->count += f->count;
+		t->total_usec += f->total_usec;
+		if (f->max_usec > t->max_usec) {
+			t->max_usec = f->max_usec;
+		}
+	}
+}
+
+static void rtp_latency_register(switch_rtp_t *rtp_session)
+{
+	switch_mutex_lock(latency_globals.mutex);
+	rtp_session->lat_prev = NULL;
+	if ((rtp_session->lat_next = latency_globals.list)) {
+		latency_globals.list->lat_prev = rtp_session;
+	}
+	latency_globals.list = rtp_session;
+	switch_mutex_unlock(latency_globals.mutex);
+}
+
+static void rtp_latency_unregister(switch_rtp_t *rtp_session)
+{
+	switch_mutex_lock(latency_globals.mutex);
+	if (rtp_session->lat_prev || latency_globals.list == rtp_session) {
+		if (rtp_session->lat_prev) {
+			rtp_session->lat_prev->lat_next = rtp_session->lat_next;
+		} else {
+			latency_globals.list = rtp_session->lat_next;
+		}
+		if (rtp_session->lat_next) {
+			rtp_session->lat_next->lat_prev = rtp_session->lat_prev;
+		}
+		rtp_session->lat_next = rtp_session->lat_prev = NULL;
+		rtp_latency_merge(&latency_globals.retired, &rtp_session->latency);
+	}
+	switch_mutex_unlock(latency_globals.mutex);
+}
+
+static void rtp_latency_timer(switch_rtp_t *rtp_session, int synced)
+{
+	switch_time_t now;
+
+	if (synced) {
+		rtp_session->lat_timer_wake = 0;
+		return;
+	}
+
+	now = switch_time_now();
+
+	if (rtp_session->lat_timer_wake) {
+		switch_time_t due = rtp_session->lat_timer_wake + (rtp_session->timer.interval * 1000);
+		rtp_latency_add(&rtp_session->latency.stage[SWITCH_RTP_LAT_TIMER_SLIP], now > due ? now - due : 0);
+	}
+
+	rtp_session->lat_timer_wake = now;
+}
+
+#define RTP_LAT_MARK(_v) _v = switch_time_now()
+#define RTP_LAT_ADD(_rtp, _stage, _v) rtp_latency_add(&(_rtp)->latency.stage[_stage], switch_time_now() - (_v))
+#define RTP_LAT_TIMER(_rtp, _synced) rtp_latency_timer(_rtp, _synced)
+#else
+#define RTP_LAT_MARK(_v) (void) (_v)
+#define RTP_LAT_ADD(_rtp, _stage, _v) (void) (_v)
+#define RTP_LAT_TIMER(_rtp, _synced)
+#endif
+
 struct switch_rtcp_senderinfo {
 	unsigned ssrc:32;
 	unsigned ntp_msw:32;
@@ -871,8 +1349,17 @@ SWITCH_DECLARE(void) switch_rtp_init(switch_memory_pool_t *pool)
 #endif
 #ifdef ENABLE_SRTP
 	srtp_init();
+	srtp_engine_install(switch_core_get_variable_pdup("srtp_engine", pool), pool);
 #endif
 	switch_mutex_init(&port_lock, SWITCH_MUTEX_NESTED, pool);
+	relay_globals.pool = pool;
+	switch_mutex_init(&relay_globals.mutex, SWITCH_MUTEX_NESTED, pool);
+#ifdef RTP_LATENCY_STATS
+	switch_mutex_init(&latency_globals.mutex, SWITCH_MUTEX_NESTED, pool);
+#endif
+	if (switch_event_reserve_subclass(SWITCH_RTP_QUALITY_EVENT) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Couldn't register subclass %s!\n", SWITCH_RTP_QUALITY_EVENT);
+	}
 	global_init = 1;
 }
 
@@ -886,1643 +1373,2919 @@ SWITCH_DECLARE(void) switch_rtp_get_random(void *buf, uint32_t len)
 }
 
 
-SWITCH_DECLARE(void) switch_rtp_shutdown(void)
+SWITCH_DECLARE(const char *) switch_rtp_get_srtp_engine(void)
 {
-	switch_core_port_allocator_t *alloc = NULL;
-	switch_hash_index_t *hi;
-	const void *var;
-	void *val;
+#ifdef ENABLE_SRTP
+	if (srtp_engine_globals.installed) {
+		return SRTP_ENGINE_NAMES[srtp_engine_globals.engine];
+	}
+#endif
+	return "none";
+}
 
-	if (!global_init) {
-		return;
+SWITCH_DECLARE(switch_status_t) switch_rtp_srtp_bench(const char *engine, switch_rtp_crypto_key_type_t type,
+													  uint32_t packets, switch_size_t payload_len, double *pps)
+{
+#ifndef ENABLE_SRTP
+	return SWITCH_STATUS_NOTIMPL;
+#else
+	srtp_policy_t policy;
+	srtp_t ctx = NULL;
+	srtp_stream_ctx_t *stream;
+	srtp_engine_t bench_engine;
+	err_status_t stat;
+	unsigned char key[MASTER_KEY_LEN];
+	rtp_msg_t *plain = NULL, *packet = NULL;
+	uint32_t ssrc = 0, x;
+	switch_time_t start, elapsed;
+	switch_status_t status = SWITCH_STATUS_SUCCESS;
+
+	if (!srtp_engine_globals.installed || !packets || payload_len > SWITCH_RTP_MAX_BUF_LEN - SRTP_MAX_TRAILER_LEN) {
+		return SWITCH_STATUS_FALSE;
 	}
 
-	switch_mutex_lock(port_lock);
+	if (srtp_engine_lookup(engine, &bench_engine) != SWITCH_STATUS_SUCCESS) {
+		return SWITCH_STATUS_FALSE;
+	}
 
-	for (hi = switch_hash_first(NULL, alloc_hash); hi; hi = switch_hash_next(hi)) {
-		switch_hash_this(hi, &var, NULL, &val);
-		if ((alloc = (switch_core_port_allocator_t *) val)) {
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Destroy port allocator for %s\n", (char *) var);
-			switch_core_port_allocator_destroy(&alloc);
+	memset(&policy, 0, sizeof(policy));
+
+	switch (type) {
+	case AES_CM_128_HMAC_SHA1_80:
+		crypto_policy_set_aes_cm_128_hmac_sha1_80(&policy.rtp);
+		break;
+	case AES_CM_128_HMAC_SHA1_32:
+		crypto_policy_set_aes_cm_128_hmac_sha1_32(&policy.rtp);
+		break;
+	case AES_CM_128_NULL_AUTH:
+		crypto_policy_set_aes_cm_128_null_auth(&policy.rtp);
+		break;
+	default:
+		return SWITCH_STATUS_FALSE;
+	}
+
+	crypto_policy_set_rtcp_default(&policy.rtcp);
+	policy.rtcp.sec_serv = sec_serv_none;
+
+	switch_rtp_get_random(key, sizeof(key));
+	switch_rtp_get_random(&ssrc, sizeof(ssrc));
+	policy.key = key;
+	policy.ssrc.type = ssrc_specific;
+	policy.ssrc.value = ssrc;
+	policy.next = NULL;
+
+	if ((stat = srtp_create(&ctx, &policy))) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error allocating srtp [%d]\n", stat);
+		return SWITCH_STATUS_FALSE;
+	}
+
+	/* the stream got the engine of the running calls, rebind only the bench's own ciphers */
+	for (stream = ctx->stream_list; stream; stream = stream->next) {
+		if (srtp_engine_bind(stream->rtp_cipher, bench_engine) != SWITCH_STATUS_SUCCESS ||
+			srtp_engine_bind(stream->rtcp_cipher, bench_engine) != SWITCH_STATUS_SUCCESS) {
+			srtp_dealloc(ctx);
+			return SWITCH_STATUS_FALSE;
 		}
 	}
 
-	switch_core_hash_destroy(&alloc_hash);
-	switch_mutex_unlock(port_lock);
+	switch_zmalloc(plain, sizeof(*plain));
+	switch_zmalloc(packet, sizeof(*packet));
 
-#ifdef ENABLE_ZRTP
-	if (zrtp_on) {
-		zrtp_status_t status = zrtp_status_ok;
+	plain->header.version = 2;
+	plain->header.ssrc = htonl(ssrc);
+	switch_rtp_get_random(plain->body, (uint32_t) payload_len);
 
-		status = zrtp_def_cache_store(zrtp_global);
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Saving ZRTP cache: %s\n", zrtp_status_ok == status ? "OK" : "FAIL");
-		zrtp_down(zrtp_global);
+	start = switch_time_ref();
+
+	for (x = 0; x < packets; x++) {
+		int len = (int) (rtp_header_len + payload_len);
+
+		memcpy(packet, plain, len);
+		packet->header.seq = htons((uint16_t) x);
+		packet->header.ts = htonl(x * 160);
+
+		if ((stat = srtp_protect(ctx, &packet->header, &len))) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error: SRTP protection failed with code %d\n", stat);
+			status = SWITCH_STATUS_FALSE;
+			break;
+		}
 	}
-#endif
-#ifdef ENABLE_SRTP
-	crypto_kernel_shutdown();
-#endif
 
+	elapsed = switch_time_ref() - start;
+
+	srtp_dealloc(ctx);
+	free(plain);
+	free(packet);
+
+	if (status == SWITCH_STATUS_SUCCESS && pps) {
+		*pps = elapsed > 0 ? (double) packets * 1000000 / (double) elapsed : 0;
+	}
+
+	return status;
+#endif
 }
 
-SWITCH_DECLARE(switch_port_t) switch_rtp_set_start_port(switch_port_t port)
+
+/* only ever called from the relay thread so the pollset has a single owner */
+static void rtp_relay_sync(switch_bool_t flush)
 {
-	if (port) {
-		if (port_lock) {
-			switch_mutex_lock(port_lock);
-		}
-		if (NEXT_PORT == START_PORT) {
-			NEXT_PORT = port;
+	struct switch_rtp_relay *relay, *next, *last = NULL;
+
+	switch_mutex_lock(relay_globals.mutex);
+
+	for (relay = relay_globals.list; relay; relay = next) {
+		next = relay->next;
+
+		if (flush && !relay->dead) {
+			relay->from->relay_rx = NULL;
+			relay->to->relay_tx = NULL;
+			relay->to->need_mark = 1;
+			relay->dead = 1;
 		}
-		START_PORT = port;
-		if (NEXT_PORT < START_PORT) {
-			NEXT_PORT = START_PORT;
+
+		if (relay->dead) {
+			if (relay->polled) {
+				switch_pollset_remove(relay_globals.pollset, &relay->pollfd);
+			}
+			if (last) {
+				last->next = next;
+			} else {
+				relay_globals.list = next;
+			}
+			relay_globals.legs--;
+			free(relay);
+			continue;
 		}
-		if (port_lock) {
-			switch_mutex_unlock(port_lock);
+
+		if (!relay->polled) {
+			if (switch_pollset_add(relay_globals.pollset, &relay->pollfd) == SWITCH_STATUS_SUCCESS) {
+				relay->polled = 1;
+			} else {
+				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Cannot poll relay socket, falling back to the media path.\n");
+				relay->from->relay_rx = NULL;
+				relay->to->relay_tx = NULL;
+				relay->dead = 1;
+			}
 		}
+
+		last = relay;
 	}
-	return START_PORT;
+
+	relay_globals.sync_gen++;
+	switch_mutex_unlock(relay_globals.mutex);
 }
 
-SWITCH_DECLARE(switch_port_t) switch_rtp_set_end_port(switch_port_t port)
+static void rtp_relay_forward(struct switch_rtp_relay *relay)
 {
-	if (port) {
-		if (port_lock) {
-			switch_mutex_lock(port_lock);
+	switch_rtp_t *from = relay->from, *to = relay->to;
+	rtp_msg_t *msg = &relay_globals.msg;
+	switch_size_t bytes;
+	switch_payload_t pt;
+	uint16_t seq;
+	uint32_t ts;
+	int x;
+
+	for (x = 0; x < RTP_RELAY_BURST; x++) {
+		bytes = sizeof(*msg);
+
+		if (switch_socket_recvfrom(from->from_addr, from->sock_input, 0, (void *) msg, &bytes) != SWITCH_STATUS_SUCCESS || !bytes) {
+			break;
 		}
-		END_PORT = port;
-		if (NEXT_PORT > END_PORT) {
-			NEXT_PORT = START_PORT;
+
+		from->stats.inbound.raw_bytes += bytes;
+		from->stats.inbound.packet_count++;
+
+		if (bytes < rtp_header_len || msg->header.version != 2 || !switch_rtp_ready(to)) {
+			relay->dropped++;
+			continue;
 		}
-		if (port_lock) {
-			switch_mutex_unlock(port_lock);
+
+		if (msg->header.pt == from->rpayload) {
+			pt = to->payload;
+			from->stats.inbound.media_packet_count++;
+			from->stats.inbound.media_bytes += bytes;
+		} else if (from->recv_te && msg->header.pt == from->recv_te) {
+			pt = to->te;
+			from->stats.inbound.dtmf_packet_count++;
+		} else if (from->cng_pt && to->cng_pt && msg->header.pt == from->cng_pt) {
+			pt = to->cng_pt;
+			from->stats.inbound.cng_packet_count++;
+		} else {
+			relay->dropped++;
+			continue;
+		}
+
+		seq = ntohs((uint16_t) msg->header.seq);
+		ts = ntohl(msg->header.ts);
+
+		if (!relay->synced) {
+			/* continue the outbound stream of the other leg where its own writer left it */
+			relay->seq_offset = (uint16_t) (to->seq + 1 - seq);
+			relay->ts_offset = to->ts + to->samples_per_interval - ts;
+			msg->header.m = 1;
+			relay->synced = 1;
+		}
+
+		seq = (uint16_t) (seq + relay->seq_offset);
+		ts += relay->ts_offset;
+
+		msg->header.pt = pt;
+		msg->header.ssrc = htonl(to->ssrc);
+		msg->header.seq = htons(seq);
+		msg->header.ts = htonl(ts);
+
+		switch_mutex_lock(to->write_mutex);
+		if (to->remote_addr && to->sock_output &&
+			switch_socket_sendto(to->sock_output, to->remote_addr, 0, (void *) msg, &bytes) == SWITCH_STATUS_SUCCESS) {
+			to->seq = seq;
+			to->ts = to->last_write_ts = ts;
+			to->stats.outbound.raw_bytes += bytes;
+			to->stats.outbound.packet_count++;
+			to->stats.outbound.media_bytes += bytes;
+			to->stats.outbound.media_packet_count++;
+			relay->packets++;
+			relay_globals.packets++;
+		} else {
+			relay->dropped++;
 		}
+		switch_mutex_unlock(to->write_mutex);
 	}
-	return END_PORT;
 }
 
-SWITCH_DECLARE(void) switch_rtp_release_port(const char *ip, switch_port_t port)
+static void *SWITCH_THREAD_FUNC rtp_relay_thread(switch_thread_t *thread, void *obj)
 {
-	switch_core_port_allocator_t *alloc = NULL;
+	while (relay_globals.running) {
+		const switch_pollfd_t *ready = NULL;
+		int32_t i, num = 0;
+		switch_status_t status;
 
-	if (!ip) {
-		return;
-	}
+		rtp_relay_sync(SWITCH_FALSE);
 
-	switch_mutex_lock(port_lock);
-	if ((alloc = switch_core_hash_find(alloc_hash, ip))) {
-		switch_core_port_allocator_free_port(alloc, port);
+		if ((status = switch_pollset_poll(relay_globals.pollset, RTP_RELAY_POLL_USEC, &num, &ready)) != SWITCH_STATUS_SUCCESS) {
+			if (status != SWITCH_STATUS_TIMEOUT) {
+				switch_cond_next();
+			}
+			continue;
+		}
+
+		switch_mutex_lock(relay_globals.mutex);
+		for (i = 0; i < num; i++) {
+			struct switch_rtp_relay *relay = (struct switch_rtp_relay *) ready[i].client_data;
+
+			if (!relay->dead) {
+				rtp_relay_forward(relay);
+			}
+		}
+		switch_mutex_unlock(relay_globals.mutex);
 	}
-	switch_mutex_unlock(port_lock);
 
+	rtp_relay_sync(SWITCH_TRUE);
+
+	return NULL;
 }
 
-SWITCH_DECLARE(switch_port_t) switch_rtp_request_port(const char *ip)
+static void rtp_relay_release(struct switch_rtp_relay *relay)
 {
-	switch_port_t port = 0;
-	switch_core_port_allocator_t *alloc = NULL;
+	uint32_t gen;
 
-	switch_mutex_lock(port_lock);
-	alloc = switch_core_hash_find(alloc_hash, ip);
-	if (!alloc) {
-		if (switch_core_port_allocator_new(START_PORT, END_PORT, SPF_EVEN, &alloc) != SWITCH_STATUS_SUCCESS) {
-			abort();
-		}
+	relay->from->relay_rx = NULL;
+	relay->to->relay_tx = NULL;
+	relay->to->need_mark = 1;
+	relay->to->last_write_timestamp = switch_micro_time_now();
+	relay->dead = 1;
 
-		switch_core_hash_insert(alloc_hash, ip, alloc);
-	}
+	/* the relay thread drops the socket from its pollset on its next pass, wait for it so the caller may close the socket */
+	gen = relay_globals.sync_gen;
 
-	if (switch_core_port_allocator_request_port(alloc, &port) != SWITCH_STATUS_SUCCESS) {
-		port = 0;
+	while (relay_globals.running && relay_globals.sync_gen == gen) {
+		switch_mutex_unlock(relay_globals.mutex);
+		switch_yield(1000);
+		switch_mutex_lock(relay_globals.mutex);
 	}
-
-	switch_mutex_unlock(port_lock);
-	return port;
 }
 
-SWITCH_DECLARE(void) switch_rtp_intentional_bugs(switch_rtp_t *rtp_session, switch_rtp_bug_flag_t bugs)
+SWITCH_DECLARE(switch_status_t) switch_rtp_relay_start(switch_rtp_t *from, switch_rtp_t *to)
 {
-	rtp_session->rtp_bugs = bugs;
+	struct switch_rtp_relay *relay;
+	switch_status_t status = SWITCH_STATUS_FALSE;
 
-	if ((rtp_session->rtp_bugs & RTP_BUG_START_SEQ_AT_ZERO)) {
-		rtp_session->seq = 0;
+	if (!global_init || !from || !to || from == to || !switch_rtp_ready(from) || !switch_rtp_ready(to) || !from->sock_input || !to->remote_addr) {
+		return SWITCH_STATUS_FALSE;
 	}
 
-}
+	if (switch_test_flag(from, SWITCH_RTP_FLAG_VIDEO) || switch_test_flag(to, SWITCH_RTP_FLAG_VIDEO) ||
+		switch_test_flag(from, SWITCH_RTP_FLAG_PROXY_MEDIA) || switch_test_flag(to, SWITCH_RTP_FLAG_PROXY_MEDIA) ||
+		switch_test_flag(from, SWITCH_RTP_FLAG_UDPTL) || switch_test_flag(to, SWITCH_RTP_FLAG_UDPTL) ||
+		switch_test_flag(from, SWITCH_RTP_FLAG_SECURE_RECV) || switch_test_flag(to, SWITCH_RTP_FLAG_SECURE_SEND) ||
+		switch_test_flag(from, SWITCH_ZRTP_FLAG_SECURE_RECV) || switch_test_flag(to, SWITCH_ZRTP_FLAG_SECURE_SEND) ||
+		switch_test_flag(from, SWITCH_RTP_FLAG_BYTESWAP) || switch_test_flag(to, SWITCH_RTP_FLAG_VAD) ||
+		!switch_test_flag(from, SWITCH_RTP_FLAG_NOBLOCK)) {
+		return SWITCH_STATUS_FALSE;
+	}
 
+	/* identical framing and a place to put telephone-events, anything else needs the media path */
+	if (from->samples_per_interval != to->samples_per_interval || from->ms_per_packet != to->ms_per_packet || (from->recv_te && !to->te)) {
+		return SWITCH_STATUS_FALSE;
+	}
 
-static switch_status_t enable_remote_rtcp_socket(switch_rtp_t *rtp_session, const char **err) {
-	
-	switch_status_t status = SWITCH_STATUS_SUCCESS;
+	if (to->sending_dtmf || switch_queue_size(to->dtmf_data.dtmf_queue)) {
+		return SWITCH_STATUS_FALSE;
+	}
 
-	if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_ENABLE_RTCP)) {
+	switch_mutex_lock(relay_globals.mutex);
 
-		if (switch_sockaddr_info_get(&rtp_session->rtcp_remote_addr, rtp_session->eff_remote_host_str, SWITCH_UNSPEC, 
-									 rtp_session->remote_rtcp_port, 0, rtp_session->pool) != SWITCH_STATUS_SUCCESS || !rtp_session->rtcp_remote_addr) {
-			*err = "RTCP Remote Address Error!";
-			return SWITCH_STATUS_FALSE;
-		} else {
-			const char *host;
-			char bufa[30];
-			host = switch_get_addr(bufa, sizeof(bufa), rtp_session->rtcp_remote_addr);
+	if (from->relay_rx || to->relay_tx) {
+		status = (from->relay_rx && from->relay_rx->to == to) ? SWITCH_STATUS_SUCCESS : SWITCH_STATUS_FALSE;
+		goto end;
+	}
 
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Setting RTCP remote addr to %s:%d\n", host, rtp_session->remote_rtcp_port);
-		}
+	if (relay_globals.legs >= RTP_RELAY_MAX_LEGS) {
+		goto end;
+	}
 
-		if (!(rtp_session->rtcp_sock_input && rtp_session->rtcp_sock_output)) {
-			if (rtp_session->rtcp_sock_input && switch_sockaddr_get_family(rtp_session->rtcp_remote_addr) == 
-				switch_sockaddr_get_family(rtp_session->rtcp_local_addr)) {
-				rtp_session->rtcp_sock_output = rtp_session->rtcp_sock_input;
-			} else {
-				if (rtp_session->rtcp_sock_output && rtp_session->rtcp_sock_output != rtp_session->rtcp_sock_input) {
-					switch_socket_close(rtp_session->rtcp_sock_output);
-				}
-				if ((status = switch_socket_create(&rtp_session->rtcp_sock_output,
-												   switch_sockaddr_get_family(rtp_session->rtcp_remote_addr),
-												   SOCK_DGRAM, 0, rtp_session->pool)) != SWITCH_STATUS_SUCCESS) {
-					*err = "RTCP Socket Error!";
-				}
-			}
+	if (!relay_globals.pollset) {
+		if (switch_pollset_create(&relay_globals.pollset, RTP_RELAY_MAX_LEGS, relay_globals.pool, 0) != SWITCH_STATUS_SUCCESS) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Cannot create RTP relay pollset\n");
+			goto end;
 		}
-	} else {
-		*err = "RTCP NOT ACTIVE!";
 	}
-	
-	return status;
-	
-}
 
-static switch_status_t enable_local_rtcp_socket(switch_rtp_t *rtp_session, const char **err) {
-
-	const char *host = rtp_session->local_host_str;
-	switch_port_t port = rtp_session->local_port;
-	switch_socket_t *rtcp_new_sock = NULL, *rtcp_old_sock = NULL;
-	switch_status_t status = SWITCH_STATUS_SUCCESS;
-	char bufa[30];
+	if (!relay_globals.thread) {
+		switch_threadattr_t *thd_attr = NULL;
 
-	if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_ENABLE_RTCP)) {
-		if (switch_sockaddr_info_get(&rtp_session->rtcp_local_addr, host, SWITCH_UNSPEC, port+1, 0, rtp_session->pool) != SWITCH_STATUS_SUCCESS) {
-			*err = "RTCP Local Address Error!";
-			goto done;
-		}
-		
-		if (switch_socket_create(&rtcp_new_sock, switch_sockaddr_get_family(rtp_session->rtcp_local_addr), SOCK_DGRAM, 0, rtp_session->pool) != SWITCH_STATUS_SUCCESS) {
-			*err = "RTCP Socket Error!";
-			goto done;
-		}
-		
-		if (switch_socket_opt_set(rtcp_new_sock, SWITCH_SO_REUSEADDR, 1) != SWITCH_STATUS_SUCCESS) {
-			*err = "RTCP Socket Error!";
-			goto done;
-		}
-		
-		if (switch_socket_bind(rtcp_new_sock, rtp_session->rtcp_local_addr) != SWITCH_STATUS_SUCCESS) {
-			*err = "RTCP Bind Error!";
-			goto done;
-		}
-		
-		if (switch_sockaddr_info_get(&rtp_session->rtcp_from_addr, switch_get_addr(bufa, sizeof(bufa), rtp_session->from_addr),
-											 SWITCH_UNSPEC, switch_sockaddr_get_port(rtp_session->from_addr) + 1, 0, rtp_session->pool) != SWITCH_STATUS_SUCCESS) {
-			*err = "RTCP From Address Error!";
-			goto done;
+		relay_globals.running = 1;
+		switch_threadattr_create(&thd_attr, relay_globals.pool);
+		switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+		switch_threadattr_priority_increase(thd_attr);
+		if (switch_thread_create(&relay_globals.thread, thd_attr, rtp_relay_thread, NULL, relay_globals.pool) != SWITCH_STATUS_SUCCESS) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Cannot start RTP relay thread\n");
+			relay_globals.running = 0;
+			relay_globals.thread = NULL;
+			goto end;
 		}
+	}
 
-		rtcp_old_sock = rtp_session->rtcp_sock_input;
-		rtp_session->rtcp_sock_input = rtcp_new_sock;
-		rtcp_new_sock = NULL;
+	switch_zmalloc(relay, sizeof(*relay));
+	relay->from = from;
+	relay->to = to;
+	relay->pollfd.desc_type = SWITCH_POLL_SOCKET;
+	relay->pollfd.reqevents = SWITCH_POLLIN | SWITCH_POLLERR;
+	relay->pollfd.desc.s = from->sock_input;
+	relay->pollfd.client_data = relay;
+	relay->next = relay_globals.list;
+	relay_globals.list = relay;
+	relay_globals.legs++;
 
-		switch_socket_create_pollset(&rtp_session->rtcp_read_pollfd, rtp_session->rtcp_sock_input, SWITCH_POLLIN | SWITCH_POLLERR, rtp_session->pool);
+	from->relay_rx = relay;
+	to->relay_tx = relay;
+	status = SWITCH_STATUS_SUCCESS;
 
- done:
-		
-		if (*err) {
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error allocating rtcp [%s]\n", *err);
-			status = SWITCH_STATUS_FALSE;
-		}
+ end:
 
-		if (rtcp_new_sock) {
-			switch_socket_close(rtcp_new_sock);
-		}
-			
-		if (rtcp_old_sock) {
-			switch_socket_close(rtcp_old_sock);
-		}
-	} else {
-		status = SWITCH_STATUS_FALSE;
-	}
+	switch_mutex_unlock(relay_globals.mutex);
 
 	return status;
 }
 
-SWITCH_DECLARE(switch_status_t) switch_rtp_set_local_address(switch_rtp_t *rtp_session, const char *host, switch_port_t port, const char **err)
+SWITCH_DECLARE(void) switch_rtp_relay_stop(switch_rtp_t *rtp_session)
 {
-	switch_socket_t *new_sock = NULL, *old_sock = NULL;
-	switch_status_t status = SWITCH_STATUS_FALSE;
-#ifndef WIN32
-	char o[5] = "TEST", i[5] = "";
-	switch_size_t len, ilen = 0;
-	int x;
-#endif
-
-	if (rtp_session->ready != 1) {
-		if (!switch_rtp_ready(rtp_session)) {
-			return SWITCH_STATUS_FALSE;
-		}
+	if (!global_init || !rtp_session || !rtp_session->relay_rx) {
+		return;
+	}
 
-		WRITE_INC(rtp_session);
-		READ_INC(rtp_session);
+	switch_mutex_lock(relay_globals.mutex);
+	if (rtp_session->relay_rx) {
+		rtp_relay_release(rtp_session->relay_rx);
+	}
+	switch_mutex_unlock(relay_globals.mutex);
+}
 
-		if (!switch_rtp_ready(rtp_session)) {
-			goto done;
-		}
+static void rtp_relay_detach(switch_rtp_t *rtp_session)
+{
+	if (!global_init || !(rtp_session->relay_rx || rtp_session->relay_tx)) {
+		return;
 	}
 
+	switch_mutex_lock(relay_globals.mutex);
+	if (rtp_session->relay_rx) {
+		rtp_relay_release(rtp_session->relay_rx);
+	}
+	if (rtp_session->relay_tx) {
+		rtp_relay_release(rtp_session->relay_tx);
+	}
+	switch_mutex_unlock(relay_globals.mutex);
+}
 
-	*err = NULL;
+SWITCH_DECLARE(switch_bool_t) switch_rtp_relay_active(switch_rtp_t *rtp_session)
+{
+	return (rtp_session && rtp_session->relay_rx) ? SWITCH_TRUE : SWITCH_FALSE;
+}
 
-	if (zstr(host) || !port) {
-		*err = "Address Error";
-		goto done;
+SWITCH_DECLARE(void) switch_rtp_relay_get_stats(uint32_t *legs, switch_size_t *packets)
+{
+	if (!global_init) {
+		*legs = 0;
+		*packets = 0;
+		return;
 	}
 
+	switch_mutex_lock(relay_globals.mutex);
+	*legs = relay_globals.legs;
+	*packets = relay_globals.packets;
+	switch_mutex_unlock(relay_globals.mutex);
+}
 
-	rtp_session->local_host_str = switch_core_strdup(rtp_session->pool, host);
-	rtp_session->local_port = port;
+#define RTP_RELAY_BENCH_BASE_SSRC 0x52000000
+#define RTP_RELAY_BENCH_WINDOW 512
 
+SWITCH_DECLARE(switch_status_t) switch_rtp_relay_bench(const char *ip, uint32_t calls, uint32_t seconds,
+													   switch_size_t *packets, switch_size_t *errors, double *pps)
+{
+	switch_memory_pool_t *pool = NULL;
+	switch_rtp_t **legs = NULL;
+	switch_sockaddr_t **dest = NULL;
+	switch_socket_t *src = NULL, *sink = NULL;
+	switch_sockaddr_t *sink_addr = NULL, *from_addr = NULL;
+	switch_pollfd_t *sink_poll = NULL;
+	switch_port_t sink_port;
+	rtp_msg_t out, in;
+	const char *err = NULL;
+	uint32_t x, made = 0, *src_ssrc = NULL;
+	switch_size_t sent = 0, received = 0, bad = 0, lost = 0, bytes;
+	switch_time_t start, now, last_rx;
+	switch_status_t status = SWITCH_STATUS_FALSE;
 
-	if (switch_sockaddr_info_get(&rtp_session->local_addr, host, SWITCH_UNSPEC, port, 0, rtp_session->pool) != SWITCH_STATUS_SUCCESS) {
-		*err = "Local Address Error!";
-		goto done;
+	if (!global_init || zstr(ip) || !calls || !seconds || calls * 2 > RTP_RELAY_MAX_LEGS) {
+		return SWITCH_STATUS_FALSE;
 	}
 
-	
-	if (rtp_session->sock_input) {
-		switch_rtp_kill_socket(rtp_session);
+	if (switch_core_new_memory_pool(&pool) != SWITCH_STATUS_SUCCESS) {
+		return SWITCH_STATUS_MEMERR;
 	}
 
-	if (switch_socket_create(&new_sock, switch_sockaddr_get_family(rtp_session->local_addr), SOCK_DGRAM, 0, rtp_session->pool) != SWITCH_STATUS_SUCCESS) {
-		*err = "Socket Error!";
-		goto done;
-	}
+	legs = switch_core_alloc(pool, sizeof(*legs) * calls * 2);
+	dest = switch_core_alloc(pool, sizeof(*dest) * calls);
+	src_ssrc = switch_core_alloc(pool, sizeof(*src_ssrc) * calls);
 
-	if (switch_socket_opt_set(new_sock, SWITCH_SO_REUSEADDR, 1) != SWITCH_STATUS_SUCCESS) {
-		*err = "Socket Error!";
-		goto done;
-	}
-	
-	if (switch_socket_bind(new_sock, rtp_session->local_addr) != SWITCH_STATUS_SUCCESS) {
-		char *em = switch_core_sprintf(rtp_session->pool, "Bind Error! %s:%d", host, port);
-		*err = em;
-		goto done;
+	if (switch_sockaddr_info_get(&sink_addr, ip, SWITCH_UNSPEC, 0, 0, pool) != SWITCH_STATUS_SUCCESS ||
+		switch_socket_create(&sink, switch_sockaddr_get_family(sink_addr), SOCK_DGRAM, 0, pool) != SWITCH_STATUS_SUCCESS ||
+		switch_socket_bind(sink, sink_addr) != SWITCH_STATUS_SUCCESS ||
+		switch_socket_create(&src, switch_sockaddr_get_family(sink_addr), SOCK_DGRAM, 0, pool) != SWITCH_STATUS_SUCCESS ||
+		switch_socket_addr_get(&sink_addr, SWITCH_FALSE, sink) != SWITCH_STATUS_SUCCESS ||
+		switch_sockaddr_info_get(&from_addr, NULL, SWITCH_UNSPEC, 0, 0, pool) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Cannot create relay bench sockets on %s\n", ip);
+		goto end;
 	}
 
-#ifndef WIN32
-	len = sizeof(i);
-	switch_socket_opt_set(new_sock, SWITCH_SO_NONBLOCK, TRUE);
+	sink_port = switch_sockaddr_get_port(sink_addr);
+	switch_socket_opt_set(sink, SWITCH_SO_RCVBUF, 4 * 1024 * 1024);
+	switch_socket_opt_set(sink, SWITCH_SO_NONBLOCK, TRUE);
+	switch_socket_create_pollset(&sink_poll, sink, SWITCH_POLLIN | SWITCH_POLLERR, pool);
 
-	switch_socket_sendto(new_sock, rtp_session->local_addr, 0, (void *) o, &len);
+	/* every call is an inbound leg that receives from the generator relayed to an outbound leg that sends to the sink */
+	for (made = 0; made < calls * 2; made++) {
+		switch_port_t port = switch_rtp_request_port(ip);
 
-	x = 0;
-	while (!ilen) {
-		switch_status_t status;
-		ilen = len;
-		status = switch_socket_recvfrom(rtp_session->from_addr, new_sock, 0, (void *) i, &ilen);
+		if (!port || (!(made % 2) && switch_sockaddr_info_get(&dest[made / 2], ip, SWITCH_UNSPEC, port, 0, pool) != SWITCH_STATUS_SUCCESS) ||
+			!(legs[made] = switch_rtp_new(ip, port, ip, sink_port, 0, 160, 20000, 0, NULL, &err, pool))) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Cannot create relay bench leg %u: %s\n", made, switch_str_nil(err));
+			if (port) {
+				switch_rtp_release_port(ip, port);
+			}
+			goto end;
+		}
 
-		if (status != SWITCH_STATUS_SUCCESS && status != SWITCH_STATUS_BREAK) {
-			break;
+		switch_rtp_set_flag(legs[made], SWITCH_RTP_FLAG_NOBLOCK);
+		switch_socket_opt_set(legs[made]->sock_input, SWITCH_SO_RCVBUF, 256 * 1024);
+
+		if (made % 2) {
+			switch_rtp_set_ssrc(legs[made], RTP_RELAY_BENCH_BASE_SSRC + made / 2);
 		}
+	}
 
-		if (++x > 1000) {
-			break;
+	for (x = 0; x < calls; x++) {
+		if (switch_rtp_relay_start(legs[x * 2], legs[x * 2 + 1]) != SWITCH_STATUS_SUCCESS) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Cannot relay bench call %u\n", x);
+			goto end;
 		}
-		switch_cond_next();
+		switch_rtp_get_random(&src_ssrc[x], sizeof(src_ssrc[x]));
 	}
-	switch_socket_opt_set(new_sock, SWITCH_SO_NONBLOCK, FALSE);
 
-#endif
+	memset(&out, 0, sizeof(out));
+	out.header.version = 2;
+	memset(out.body, 0xff, 160);
 
-	old_sock = rtp_session->sock_input;
-	rtp_session->sock_input = new_sock;
-	new_sock = NULL;
+	start = last_rx = switch_micro_time_now();
 
-	if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_USE_TIMER) || switch_test_flag(rtp_session, SWITCH_RTP_FLAG_NOBLOCK)) {
-		switch_socket_opt_set(rtp_session->sock_input, SWITCH_SO_NONBLOCK, TRUE);
-		switch_set_flag_locked(rtp_session, SWITCH_RTP_FLAG_NOBLOCK);
-	}
+	for (;;) {
+		int32_t fdr = 0;
 
-	switch_socket_create_pollset(&rtp_session->read_pollfd, rtp_session->sock_input, SWITCH_POLLIN | SWITCH_POLLERR, rtp_session->pool);
+		now = switch_micro_time_now();
 
-	if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_ENABLE_RTCP)) {
-		if ((status = enable_local_rtcp_socket(rtp_session, err)) == SWITCH_STATUS_SUCCESS) {
-			*err = "Success";
+		if (now - start >= (switch_time_t) seconds * 1000000) {
+			break;
 		}
-	} else {
-		status = SWITCH_STATUS_SUCCESS;
-		*err = "Success";
+
+		if ((int64_t) sent - (int64_t) received - (int64_t) lost < RTP_RELAY_BENCH_WINDOW) {
+			x = (uint32_t) (sent % calls);
+			out.header.ssrc = htonl(src_ssrc[x]);
+			out.header.seq = htons((uint16_t) (sent / calls));
+			out.header.ts = htonl((uint32_t) (sent / calls) * 160);
+			bytes = rtp_header_len + 160;
+			switch_socket_sendto(src, dest[x], 0, (void *) &out, &bytes);
+			sent++;
+			continue;
+		}
+
+		if (switch_poll(sink_poll, 1, &fdr, 1000) != SWITCH_STATUS_SUCCESS) {
+			if (now - last_rx > 100000 && sent > received) {
+				/* the window is stuck on packets the kernel dropped */
+				lost = sent - received;
+				last_rx = now;
+			}
+			continue;
+		}
+
+		for (;;) {
+			uint32_t ssrc;
+
+			bytes = sizeof(in);
+			if (switch_socket_recvfrom(from_addr, sink, 0, (void *) &in, &bytes) != SWITCH_STATUS_SUCCESS || !bytes) {
+				break;
+			}
+
+			received++;
+			ssrc = ntohl(in.header.ssrc);
+
+			if (bytes != rtp_header_len + 160 || in.header.version != 2 || in.header.pt != 0 ||
+				ssrc < RTP_RELAY_BENCH_BASE_SSRC || ssrc >= RTP_RELAY_BENCH_BASE_SSRC + calls) {
+				bad++;
+			}
+		}
+
+		last_rx = now;
 	}
-	
-	switch_set_flag_locked(rtp_session, SWITCH_RTP_FLAG_IO);
 
- done:
+	now = switch_micro_time_now();
 
-	if (new_sock) {
-		switch_socket_close(new_sock);
+	if (packets) {
+		*packets = received;
+	}
+	if (errors) {
+		*errors = bad;
+	}
+	if (pps) {
+		*pps = now > start ? (double) received * 1000000 / (double) (now - start) : 0;
 	}
 
-	if (old_sock) {
-		switch_socket_close(old_sock);
+	status = SWITCH_STATUS_SUCCESS;
+
+ end:
+
+	for (x = 0; x < made; x++) {
+		switch_rtp_destroy(&legs[x]);
 	}
 
+	if (src) {
+		switch_socket_close(src);
+	}
 
-	if (rtp_session->ready != 1) {
-		WRITE_DEC(rtp_session);
-		READ_DEC(rtp_session);
+	if (sink) {
+		switch_socket_close(sink);
 	}
 
+	switch_core_destroy_memory_pool(&pool);
+
 	return status;
 }
 
-SWITCH_DECLARE(void) switch_rtp_set_max_missed_packets(switch_rtp_t *rtp_session, uint32_t max)
+SWITCH_DECLARE(void) switch_rtp_shutdown(void)
 {
-	if (rtp_session->missed_count >= max) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING,
-						  "new max missed packets(%d->%d) greater than current missed packets(%d). RTP will timeout.\n",
-						  rtp_session->missed_count, max, rtp_session->missed_count);
+	switch_core_port_allocator_t *alloc = NULL;
+	switch_hash_index_t *hi;
+	const void *var;
+	void *val;
+
+	if (!global_init) {
+		return;
 	}
 
-	rtp_session->max_missed_packets = max;
-}
+	switch_mutex_lock(port_lock);
+
+	for (hi = switch_hash_first(NULL, alloc_hash); hi; hi = switch_hash_next(hi)) {
+		switch_hash_this(hi, &var, NULL, &val);
+		if ((alloc = (switch_core_port_allocator_t *) val)) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Destroy port allocator for %s\n", (char *) var);
+			switch_core_port_allocator_destroy(&alloc);
+		}
+	}
+
+	switch_core_hash_destroy(&alloc_hash);
+	switch_mutex_unlock(port_lock);
+
+	if (relay_globals.thread) {
+		switch_status_t st;
+
+		relay_globals.running = 0;
+		switch_thread_join(&st, relay_globals.thread);
+		relay_globals.thread = NULL;
+	}
+
+#ifdef ENABLE_ZRTP
+	if (zrtp_on) {
+		zrtp_status_t status = zrtp_status_ok;
+
+		status = zrtp_def_cache_store(zrtp_global);
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Saving ZRTP cache: %s\n", zrtp_status_ok == status ? "OK" : "FAIL");
+		zrtp_down(zrtp_global);
+	}
+#endif
+#ifdef ENABLE_SRTP
+	crypto_kernel_shutdown();
+#endif
+
+	switch_event_free_subclass(SWITCH_RTP_QUALITY_EVENT);
 
-SWITCH_DECLARE(void) switch_rtp_reset_media_timer(switch_rtp_t *rtp_session)
-{
-	rtp_session->missed_count = 0;
 }
 
-SWITCH_DECLARE(char *) switch_rtp_get_remote_host(switch_rtp_t *rtp_session)
+SWITCH_DECLARE(switch_port_t) switch_rtp_set_start_port(switch_port_t port)
 {
-	return zstr(rtp_session->remote_host_str) ? "0.0.0.0" : rtp_session->remote_host_str;
+	if (port) {
+		if (port_lock) {
+			switch_mutex_lock(port_lock);
+		}
+		if (NEXT_PORT == START_PORT) {
+			NEXT_PORT = port;
+		}
+		START_PORT = port;
+		if (NEXT_PORT < START_PORT) {
+			NEXT_PORT = START_PORT;
+		}
+		if (port_lock) {
+			switch_mutex_unlock(port_lock);
+		}
+	}
+	return START_PORT;
 }
 
-SWITCH_DECLARE(switch_port_t) switch_rtp_get_remote_port(switch_rtp_t *rtp_session)
+SWITCH_DECLARE(switch_port_t) switch_rtp_set_end_port(switch_port_t port)
 {
-	return rtp_session->remote_port;
+	if (port) {
+		if (port_lock) {
+			switch_mutex_lock(port_lock);
+		}
+		END_PORT = port;
+		if (NEXT_PORT > END_PORT) {
+			NEXT_PORT = START_PORT;
+		}
+		if (port_lock) {
+			switch_mutex_unlock(port_lock);
+		}
+	}
+	return END_PORT;
 }
 
-static void ping_socket(switch_rtp_t *rtp_session)
+SWITCH_DECLARE(uint32_t) switch_rtp_set_port_quarantine(uint32_t ms)
 {
-	uint32_t o = UINT_MAX;
-	switch_size_t len = sizeof(o);
-	switch_socket_sendto(rtp_session->sock_input, rtp_session->local_addr, 0, (void *) &o, &len);
+	switch_hash_index_t *hi;
+	void *val;
 
-	if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_ENABLE_RTCP) && rtp_session->rtcp_sock_input) {
-		switch_socket_sendto(rtp_session->rtcp_sock_input, rtp_session->rtcp_local_addr, 0, (void *) &o, &len);
+	if (port_lock) {
+		switch_mutex_lock(port_lock);
+	}
+	PORT_QUARANTINE_MS = ms;
+	if (alloc_hash) {
+		for (hi = switch_hash_first(NULL, alloc_hash); hi; hi = switch_hash_next(hi)) {
+			switch_hash_this(hi, NULL, NULL, &val);
+			switch_core_port_allocator_set_quarantine((switch_core_port_allocator_t *) val, ms);
+		}
+	}
+	if (port_lock) {
+		switch_mutex_unlock(port_lock);
 	}
+	return PORT_QUARANTINE_MS;
 }
 
-SWITCH_DECLARE(switch_status_t) switch_rtp_udptl_mode(switch_rtp_t *rtp_session) 
+SWITCH_DECLARE(int) switch_rtp_port_stats(const char *ip, switch_rtp_port_stats_callback_t callback, void *user_data)
 {
-	switch_socket_t *sock;
+	switch_core_port_allocator_t *alloc = NULL;
+	switch_port_allocator_stats_t stats;
+	switch_hash_index_t *hi;
+	const void *var;
+	void *val;
+	int count = 0;
 
-	READ_INC(rtp_session);
-	WRITE_INC(rtp_session);
+	if (!global_init) {
+		return 0;
+	}
 
-	if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_USE_TIMER) || rtp_session->timer.timer_interface) {
-		switch_core_timer_destroy(&rtp_session->timer);
-		memset(&rtp_session->timer, 0, sizeof(rtp_session->timer));
-		switch_clear_flag_locked(rtp_session, SWITCH_RTP_FLAG_USE_TIMER);
+	switch_mutex_lock(port_lock);
+	if (ip) {
+		if ((alloc = switch_core_hash_find(alloc_hash, ip))) {
+			switch_core_port_allocator_get_stats(alloc, &stats);
+			callback(ip, &stats, user_data);
+			count++;
+		}
+	} else {
+		for (hi = switch_hash_first(NULL, alloc_hash); hi; hi = switch_hash_next(hi)) {
+			switch_hash_this(hi, &var, NULL, &val);
+			if ((alloc = (switch_core_port_allocator_t *) val)) {
+				switch_core_port_allocator_get_stats(alloc, &stats);
+				callback((const char *) var, &stats, user_data);
+				count++;
+			}
+		}
 	}
+	switch_mutex_unlock(port_lock);
 
-	switch_clear_flag(rtp_session, SWITCH_RTP_FLAG_ENABLE_RTCP);
+	return count;
+}
 
-	if (rtp_session->rtcp_sock_input) {
-		ping_socket(rtp_session);
-		switch_socket_shutdown(rtp_session->rtcp_sock_input, SWITCH_SHUTDOWN_READWRITE);
+SWITCH_DECLARE(void) switch_rtp_release_port(const char *ip, switch_port_t port)
+{
+	switch_core_port_allocator_t *alloc = NULL;
+
+	if (!ip) {
+		return;
 	}
 
-	if (rtp_session->rtcp_sock_output && rtp_session->rtcp_sock_output != rtp_session->rtcp_sock_input) {
-		switch_socket_shutdown(rtp_session->rtcp_sock_output, SWITCH_SHUTDOWN_READWRITE);
+	switch_mutex_lock(port_lock);
+	if ((alloc = switch_core_hash_find(alloc_hash, ip))) {
+		switch_core_port_allocator_free_port(alloc, port);
 	}
+	switch_mutex_unlock(port_lock);
 
-	if ((sock = rtp_session->rtcp_sock_input)) {
-		rtp_session->rtcp_sock_input = NULL;
-		switch_socket_close(sock);
+}
 
-		if (rtp_session->rtcp_sock_output && rtp_session->rtcp_sock_output != sock) {
-			if ((sock = rtp_session->rtcp_sock_output)) {
-				rtp_session->rtcp_sock_output = NULL;
-				switch_socket_close(sock);
-			}
-		}
-	}
+SWITCH_DECLARE(switch_port_t) switch_rtp_request_port(const char *ip)
+{
+	switch_port_t port = 0;
+	switch_core_port_allocator_t *alloc = NULL;
 
-	switch_set_flag_locked(rtp_session, SWITCH_RTP_FLAG_UDPTL);
-	switch_set_flag_locked(rtp_session, SWITCH_RTP_FLAG_PROXY_MEDIA);
-	switch_socket_opt_set(rtp_session->sock_input, SWITCH_SO_NONBLOCK, FALSE);
-	switch_clear_flag_locked(rtp_session, SWITCH_RTP_FLAG_NOBLOCK);
-		
-	WRITE_DEC(rtp_session);
-	READ_DEC(rtp_session);
+	switch_mutex_lock(port_lock);
+	alloc = switch_core_hash_find(alloc_hash, ip);
+	if (!alloc) {
+		if (switch_core_port_allocator_new(START_PORT, END_PORT, SPF_EVEN, &alloc) != SWITCH_STATUS_SUCCESS) {
+			abort();
+		}
+		switch_core_port_allocator_set_quarantine(alloc, PORT_QUARANTINE_MS);
 
-	switch_clear_flag_locked(rtp_session, SWITCH_RTP_FLAG_STICKY_FLUSH);
-	switch_clear_flag_locked(rtp_session, SWITCH_RTP_FLAG_FLUSH);
+		switch_core_hash_insert(alloc_hash, ip, alloc);
+	}
 
-	switch_rtp_break(rtp_session);
-	
-	return SWITCH_STATUS_SUCCESS;
+	if (switch_core_port_allocator_request_port(alloc, &port) != SWITCH_STATUS_SUCCESS) {
+		port = 0;
+	}
 
+	switch_mutex_unlock(port_lock);
+	return port;
 }
 
-
-SWITCH_DECLARE(switch_status_t) switch_rtp_set_remote_address(switch_rtp_t *rtp_session, const char *host, switch_port_t port, switch_port_t remote_rtcp_port,
-															  switch_bool_t change_adv_addr, const char **err)
+SWITCH_DECLARE(void) switch_rtp_intentional_bugs(switch_rtp_t *rtp_session, switch_rtp_bug_flag_t bugs)
 {
-	switch_sockaddr_t *remote_addr;
-	switch_status_t status = SWITCH_STATUS_SUCCESS;
-	*err = "Success";
+	rtp_session->rtp_bugs = bugs;
 
-	if (switch_sockaddr_info_get(&remote_addr, host, SWITCH_UNSPEC, port, 0, rtp_session->pool) != SWITCH_STATUS_SUCCESS || !remote_addr) {
-		*err = "Remote Address Error!";
-		return SWITCH_STATUS_FALSE;
+	if ((rtp_session->rtp_bugs & RTP_BUG_START_SEQ_AT_ZERO)) {
+		rtp_session->seq = 0;
 	}
 
+}
 
-	switch_mutex_lock(rtp_session->write_mutex);
 
-	rtp_session->remote_addr = remote_addr;
+static switch_status_t enable_remote_rtcp_socket(switch_rtp_t *rtp_session, const char **err) {
+	
+	switch_status_t status = SWITCH_STATUS_SUCCESS;
 
-	if (change_adv_addr) {
-		rtp_session->remote_host_str = switch_core_strdup(rtp_session->pool, host);
-		rtp_session->remote_port = port;
-	}
+	if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_ENABLE_RTCP)) {
 
-	rtp_session->eff_remote_host_str = switch_core_strdup(rtp_session->pool, host);
-	rtp_session->eff_remote_port = port;
+		if (switch_sockaddr_info_get(&rtp_session->rtcp_remote_addr, rtp_session->eff_remote_host_str, SWITCH_UNSPEC, 
+									 rtp_session->remote_rtcp_port, 0, rtp_session->pool) != SWITCH_STATUS_SUCCESS || !rtp_session->rtcp_remote_addr) {
+			*err = "RTCP Remote Address Error!";
+			return SWITCH_STATUS_FALSE;
+		} else {
+			const char *host;
+			char bufa[30];
+			host = switch_get_addr(bufa, sizeof(bufa), rtp_session->rtcp_remote_addr);
 
-	if (rtp_session->sock_input && switch_sockaddr_get_family(rtp_session->remote_addr) == switch_sockaddr_get_family(rtp_session->local_addr)) {
-		rtp_session->sock_output = rtp_session->sock_input;
-	} else {
-		if (rtp_session->sock_output && rtp_session->sock_output != rtp_session->sock_input) {
-			switch_socket_close(rtp_session->sock_output);
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Setting RTCP remote addr to %s:%d\n", host, rtp_session->remote_rtcp_port);
 		}
-		if ((status = switch_socket_create(&rtp_session->sock_output,
-										   switch_sockaddr_get_family(rtp_session->remote_addr),
-										   SOCK_DGRAM, 0, rtp_session->pool)) != SWITCH_STATUS_SUCCESS) {
-			*err = "Socket Error!";
+
+		if (!(rtp_session->rtcp_sock_input && rtp_session->rtcp_sock_output)) {
+			if (rtp_session->rtcp_sock_input && switch_sockaddr_get_family(rtp_session->rtcp_remote_addr) == 
+				switch_sockaddr_get_family(rtp_session->rtcp_local_addr)) {
+				rtp_session->rtcp_sock_output = rtp_session->rtcp_sock_input;
+			} else {
+				if (rtp_session->rtcp_sock_output && rtp_session->rtcp_sock_output != rtp_session->rtcp_sock_input) {
+					switch_socket_close(rtp_session->rtcp_sock_output);
+				}
+				if ((status = switch_socket_create(&rtp_session->rtcp_sock_output,
+												   switch_sockaddr_get_family(rtp_session->rtcp_remote_addr),
+												   SOCK_DGRAM, 0, rtp_session->pool)) != SWITCH_STATUS_SUCCESS) {
+					*err = "RTCP Socket Error!";
+				}
+			}
 		}
+	} else {
+		*err = "RTCP NOT ACTIVE!";
 	}
+	
+	return status;
+	
+}
 
-	if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_ENABLE_RTCP)) {	
-		if (remote_rtcp_port) {
-			rtp_session->remote_rtcp_port = remote_rtcp_port;
-		} else {
-			rtp_session->remote_rtcp_port = rtp_session->eff_remote_port + 1;
+static switch_status_t enable_local_rtcp_socket(switch_rtp_t *rtp_session, const char **err) {
+
+	const char *host = rtp_session->local_host_str;
+	switch_port_t port = rtp_session->local_port;
+	switch_socket_t *rtcp_new_sock = NULL, *rtcp_old_sock = NULL;
+	switch_status_t status = SWITCH_STATUS_SUCCESS;
+	char bufa[30];
+
+	if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_ENABLE_RTCP)) {
+		if (switch_sockaddr_info_get(&rtp_session->rtcp_local_addr, host, SWITCH_UNSPEC, port+1, 0, rtp_session->pool) != SWITCH_STATUS_SUCCESS) {
+			*err = "RTCP Local Address Error!";
+			goto done;
+		}
+		
+		if (switch_socket_create(&rtcp_new_sock, switch_sockaddr_get_family(rtp_session->rtcp_local_addr), SOCK_DGRAM, 0, rtp_session->pool) != SWITCH_STATUS_SUCCESS) {
+			*err = "RTCP Socket Error!";
+			goto done;
+		}
+		
+		if (switch_socket_opt_set(rtcp_new_sock, SWITCH_SO_REUSEADDR, 1) != SWITCH_STATUS_SUCCESS) {
+			*err = "RTCP Socket Error!";
+			goto done;
+		}
+		
+		if (switch_socket_bind(rtcp_new_sock, rtp_session->rtcp_local_addr) != SWITCH_STATUS_SUCCESS) {
+			*err = "RTCP Bind Error!";
+			goto done;
+		}
+		
+		if (switch_sockaddr_info_get(&rtp_session->rtcp_from_addr, switch_get_addr(bufa, sizeof(bufa), rtp_session->from_addr),
+											 SWITCH_UNSPEC, switch_sockaddr_get_port(rtp_session->from_addr) + 1, 0, rtp_session->pool) != SWITCH_STATUS_SUCCESS) {
+			*err = "RTCP From Address Error!";
+			goto done;
 		}
-		status = enable_remote_rtcp_socket(rtp_session, err);
-	}
 
-	switch_mutex_unlock(rtp_session->write_mutex);
+		rtcp_old_sock = rtp_session->rtcp_sock_input;
+		rtp_session->rtcp_sock_input = rtcp_new_sock;
+		rtcp_new_sock = NULL;
+
+		switch_socket_create_pollset(&rtp_session->rtcp_read_pollfd, rtp_session->rtcp_sock_input, SWITCH_POLLIN | SWITCH_POLLERR, rtp_session->pool);
+
+ done:
+		
+		if (*err) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error allocating rtcp [%s]\n", *err);
+			status = SWITCH_STATUS_FALSE;
+		}
+
+		if (rtcp_new_sock) {
+			switch_socket_close(rtcp_new_sock);
+		}
+			
+		if (rtcp_old_sock) {
+			switch_socket_close(rtcp_old_sock);
+		}
+	} else {
+		status = SWITCH_STATUS_FALSE;
+	}
 
 	return status;
 }
 
-SWITCH_DECLARE(switch_status_t) switch_rtp_add_crypto_key(switch_rtp_t *rtp_session,
-														  switch_rtp_crypto_direction_t direction,
-														  uint32_t index, switch_rtp_crypto_key_type_t type, unsigned char *key, switch_size_t keylen)
+SWITCH_DECLARE(switch_status_t) switch_rtp_set_local_address(switch_rtp_t *rtp_session, const char *host, switch_port_t port, const char **err)
 {
-#ifndef ENABLE_SRTP
-	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "SRTP NOT SUPPORTED IN THIS BUILD!\n");
-	return SWITCH_STATUS_FALSE;
-#else
-	switch_rtp_crypto_key_t *crypto_key;
-	srtp_policy_t *policy;
-	err_status_t stat;
-	switch_status_t status = SWITCH_STATUS_SUCCESS;
-	switch_core_session_t *session = switch_core_memory_pool_get_data(rtp_session->pool, "__session");
-	switch_channel_t *channel = switch_core_session_get_channel(session);
-	switch_event_t *fsevent = NULL;
+	switch_socket_t *new_sock = NULL, *old_sock = NULL;
+	switch_status_t status = SWITCH_STATUS_FALSE;
+#ifndef WIN32
+	char o[5] = "TEST", i[5] = "";
+	switch_size_t len, ilen = 0;
+	int x;
+#endif
 
-	if (direction >= SWITCH_RTP_CRYPTO_MAX || keylen > SWITCH_RTP_MAX_CRYPTO_LEN) {
-		return SWITCH_STATUS_FALSE;
+	rtp_relay_detach(rtp_session);
+
+	if (rtp_session->ready != 1) {
+		if (!switch_rtp_ready(rtp_session)) {
+			return SWITCH_STATUS_FALSE;
+		}
+
+		WRITE_INC(rtp_session);
+		READ_INC(rtp_session);
+
+		if (!switch_rtp_ready(rtp_session)) {
+			goto done;
+		}
 	}
 
-	crypto_key = switch_core_alloc(rtp_session->pool, sizeof(*crypto_key));
 
-	if (direction == SWITCH_RTP_CRYPTO_RECV) {
-		policy = &rtp_session->recv_policy;
-	} else {
-		policy = &rtp_session->send_policy;
+	*err = NULL;
+
+	if (zstr(host) || !port) {
+		*err = "Address Error";
+		goto done;
 	}
 
-	crypto_key->type = type;
-	crypto_key->index = index;
-	memcpy(crypto_key->key, key, keylen);
-	crypto_key->next = rtp_session->crypto_keys[direction];
-	rtp_session->crypto_keys[direction] = crypto_key;
 
-	memset(policy, 0, sizeof(*policy));
+	rtp_session->local_host_str = switch_core_strdup(rtp_session->pool, host);
+	rtp_session->local_port = port;
 
-	switch (crypto_key->type) {
-	case AES_CM_128_HMAC_SHA1_80:
-		crypto_policy_set_aes_cm_128_hmac_sha1_80(&policy->rtp);
-		if (switch_channel_direction(channel) == SWITCH_CALL_DIRECTION_OUTBOUND) {
-			switch_channel_set_variable(channel, "sip_has_crypto", "AES_CM_128_HMAC_SHA1_80");
-		}
-		break;
-	case AES_CM_128_HMAC_SHA1_32:
-		crypto_policy_set_aes_cm_128_hmac_sha1_32(&policy->rtp);
-		if (switch_channel_direction(channel) == SWITCH_CALL_DIRECTION_OUTBOUND) {
-			switch_channel_set_variable(channel, "sip_has_crypto", "AES_CM_128_HMAC_SHA1_32");
+
+	if (switch_sockaddr_info_get(&rtp_session->local_addr, host, SWITCH_UNSPEC, port, 0, rtp_session->pool) != SWITCH_STATUS_SUCCESS) {
+		*err = "Local Address Error!";
+		goto done;
+	}
+
+	
+	if (rtp_session->sock_input) {
+		switch_rtp_kill_socket(rtp_session);
+	}
+
+	if (switch_socket_create(&new_sock, switch_sockaddr_get_family(rtp_session->local_addr), SOCK_DGRAM, 0, rtp_session->pool) != SWITCH_STATUS_SUCCESS) {
+		*err = "Socket Error!";
+		goto done;
+	}
+
+	if (switch_socket_opt_set(new_sock, SWITCH_SO_REUSEADDR, 1) != SWITCH_STATUS_SUCCESS) {
+		*err = "Socket Error!";
+		goto done;
+	}
+	
+	if (switch_socket_bind(new_sock, rtp_session->local_addr) != SWITCH_STATUS_SUCCESS) {
+		char *em = switch_core_sprintf(rtp_session->pool, "Bind Error! %s:%d", host, port);
+		*err = em;
+		goto done;
+	}
+
+#ifndef WIN32
+	len = sizeof(i);
+	switch_socket_opt_set(new_sock, SWITCH_SO_NONBLOCK, TRUE);
+
+	switch_socket_sendto(new_sock, rtp_session->local_addr, 0, (void *) o, &len);
+
+	x = 0;
+	while (!ilen) {
+		switch_status_t status;
+		ilen = len;
+		status = switch_socket_recvfrom(rtp_session->from_addr, new_sock, 0, (void *) i, &ilen);
+
+		if (status != SWITCH_STATUS_SUCCESS && status != SWITCH_STATUS_BREAK) {
+			break;
 		}
-		break;
-	case AES_CM_128_NULL_AUTH:
-		crypto_policy_set_aes_cm_128_null_auth(&policy->rtp);
-		if (switch_channel_direction(channel) == SWITCH_CALL_DIRECTION_OUTBOUND) {
-			switch_channel_set_variable(channel, "sip_has_crypto", "AES_CM_128_NULL_AUTH");
+
+		if (++x > 1000) {
+			break;
 		}
-		break;
-	default:
-		break;
+		switch_cond_next();
+	}
+	switch_socket_opt_set(new_sock, SWITCH_SO_NONBLOCK, FALSE);
+
+#endif
+
+	old_sock = rtp_session->sock_input;
+	rtp_session->sock_input = new_sock;
+	new_sock = NULL;
+
+	if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_USE_TIMER) || switch_test_flag(rtp_session, SWITCH_RTP_FLAG_NOBLOCK)) {
+		switch_socket_opt_set(rtp_session->sock_input, SWITCH_SO_NONBLOCK, TRUE);
+		switch_set_flag_locked(rtp_session, SWITCH_RTP_FLAG_NOBLOCK);
 	}
 
-	policy->next = NULL;
-	policy->key = (uint8_t *) crypto_key->key;
+	switch_socket_create_pollset(&rtp_session->read_pollfd, rtp_session->sock_input, SWITCH_POLLIN | SWITCH_POLLERR, rtp_session->pool);
 
 	if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_ENABLE_RTCP)) {
-		crypto_policy_set_rtcp_default(&policy->rtcp);
-		policy->rtcp.sec_serv = sec_serv_none;
+		if ((status = enable_local_rtcp_socket(rtp_session, err)) == SWITCH_STATUS_SUCCESS) {
+			*err = "Success";
+		}
+	} else {
+		status = SWITCH_STATUS_SUCCESS;
+		*err = "Success";
+	}
+	
+	switch_set_flag_locked(rtp_session, SWITCH_RTP_FLAG_IO);
+
+ done:
+
+	if (new_sock) {
+		switch_socket_close(new_sock);
+	}
+
+	if (old_sock) {
+		switch_socket_close(old_sock);
+	}
+
+
+	if (rtp_session->ready != 1) {
+		WRITE_DEC(rtp_session);
+		READ_DEC(rtp_session);
+	}
+
+	return status;
+}
+
+SWITCH_DECLARE(void) switch_rtp_set_max_missed_packets(switch_rtp_t *rtp_session, uint32_t max)
+{
+	if (rtp_session->missed_count >= max) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING,
+						  "new max missed packets(%d->%d) greater than current missed packets(%d). RTP will timeout.\n",
+						  rtp_session->missed_count, max, rtp_session->missed_count);
+	}
+
+	rtp_session->max_missed_packets = max;
+}
+
+SWITCH_DECLARE(void) switch_rtp_reset_media_timer(switch_rtp_t *rtp_session)
+{
+	rtp_session->missed_count = 0;
+}
+
+SWITCH_DECLARE(char *) switch_rtp_get_remote_host(switch_rtp_t *rtp_session)
+{
+	return zstr(rtp_session->remote_host_str) ? "0.0.0.0" : rtp_session->remote_host_str;
+}
+
+SWITCH_DECLARE(switch_port_t) switch_rtp_get_remote_port(switch_rtp_t *rtp_session)
+{
+	return rtp_session->remote_port;
+}
+
+static void ping_socket(switch_rtp_t *rtp_session)
+{
+	uint32_t o = UINT_MAX;
+	switch_size_t len = sizeof(o);
+	switch_socket_sendto(rtp_session->sock_input, rtp_session->local_addr, 0, (void *) &o, &len);
+
+	if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_ENABLE_RTCP) && rtp_session->rtcp_sock_input) {
+		switch_socket_sendto(rtp_session->rtcp_sock_input, rtp_session->rtcp_local_addr, 0, (void *) &o, &len);
+	}
+}
+
+SWITCH_DECLARE(switch_status_t) switch_rtp_udptl_mode(switch_rtp_t *rtp_session) 
+{
+	switch_socket_t *sock;
+
+	READ_INC(rtp_session);
+	WRITE_INC(rtp_session);
+
+	if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_USE_TIMER) || rtp_session->timer.timer_interface) {
+		switch_core_timer_destroy(&rtp_session->timer);
+		memset(&rtp_session->timer, 0, sizeof(rtp_session->timer));
+		switch_clear_flag_locked(rtp_session, SWITCH_RTP_FLAG_USE_TIMER);
+	}
+
+	switch_clear_flag(rtp_session, SWITCH_RTP_FLAG_ENABLE_RTCP);
+
+	if (rtp_session->rtcp_sock_input) {
+		ping_socket(rtp_session);
+		switch_socket_shutdown(rtp_session->rtcp_sock_input, SWITCH_SHUTDOWN_READWRITE);
+	}
+
+	if (rtp_session->rtcp_sock_output && rtp_session->rtcp_sock_output != rtp_session->rtcp_sock_input) {
+		switch_socket_shutdown(rtp_session->rtcp_sock_output, SWITCH_SHUTDOWN_READWRITE);
+	}
+
+	if ((sock = rtp_session->rtcp_sock_input)) {
+		rtp_session->rtcp_sock_input = NULL;
+		switch_socket_close(sock);
+
+		if (rtp_session->rtcp_sock_output && rtp_session->rtcp_sock_output != sock) {
+			if ((sock = rtp_session->rtcp_sock_output)) {
+				rtp_session->rtcp_sock_output = NULL;
+				switch_socket_close(sock);
+			}
+		}
+	}
+
+	switch_set_flag_locked(rtp_session, SWITCH_RTP_FLAG_UDPTL);
+	switch_set_flag_locked(rtp_session, SWITCH_RTP_FLAG_PROXY_MEDIA);
+	switch_socket_opt_set(rtp_session->sock_input, SWITCH_SO_NONBLOCK, FALSE);
+	switch_clear_flag_locked(rtp_session, SWITCH_RTP_FLAG_NOBLOCK);
+		
+	WRITE_DEC(rtp_session);
+	READ_DEC(rtp_session);
+
+	switch_clear_flag_locked(rtp_session, SWITCH_RTP_FLAG_STICKY_FLUSH);
+	switch_clear_flag_locked(rtp_session, SWITCH_RTP_FLAG_FLUSH);
+
+	switch_rtp_break(rtp_session);
+	
+	return SWITCH_STATUS_SUCCESS;
+
+}
+
+
+SWITCH_DECLARE(switch_status_t) switch_rtp_set_remote_address(switch_rtp_t *rtp_session, const char *host, switch_port_t port, switch_port_t remote_rtcp_port,
+															  switch_bool_t change_adv_addr, const char **err)
+{
+	switch_sockaddr_t *remote_addr;
+	switch_status_t status = SWITCH_STATUS_SUCCESS;
+	*err = "Success";
+
+	if (switch_sockaddr_info_get(&remote_addr, host, SWITCH_UNSPEC, port, 0, rtp_session->pool) != SWITCH_STATUS_SUCCESS || !remote_addr) {
+		*err = "Remote Address Error!";
+		return SWITCH_STATUS_FALSE;
+	}
+
+
+	switch_mutex_lock(rtp_session->write_mutex);
+
+	rtp_session->remote_addr = remote_addr;
+
+	if (change_adv_addr) {
+		rtp_session->remote_host_str = switch_core_strdup(rtp_session->pool, host);
+		rtp_session->remote_port = port;
+	}
+
+	rtp_session->eff_remote_host_str = switch_core_strdup(rtp_session->pool, host);
+	rtp_session->eff_remote_port = port;
+
+	if (rtp_session->sock_input && switch_sockaddr_get_family(rtp_session->remote_addr) == switch_sockaddr_get_family(rtp_session->local_addr)) {
+		rtp_session->sock_output = rtp_session->sock_input;
+	} else {
+		if (rtp_session->sock_output && rtp_session->sock_output != rtp_session->sock_input) {
+			switch_socket_close(rtp_session->sock_output);
+		}
+		if ((status = switch_socket_create(&rtp_session->sock_output,
+										   switch_sockaddr_get_family(rtp_session->remote_addr),
+										   SOCK_DGRAM, 0, rtp_session->pool)) != SWITCH_STATUS_SUCCESS) {
+			*err = "Socket Error!";
+		}
+	}
+
+	if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_ENABLE_RTCP)) {	
+		if (remote_rtcp_port) {
+			rtp_session->remote_rtcp_port = remote_rtcp_port;
+		} else {
+			rtp_session->remote_rtcp_port = rtp_session->eff_remote_port + 1;
+		}
+		status = enable_remote_rtcp_socket(rtp_session, err);
+	}
+
+	switch_mutex_unlock(rtp_session->write_mutex);
+
+	return status;
+}
+
+SWITCH_DECLARE(switch_status_t) switch_rtp_add_crypto_key(switch_rtp_t *rtp_session,
+														  switch_rtp_crypto_direction_t direction,
+														  uint32_t index, switch_rtp_crypto_key_type_t type, unsigned char *key, switch_size_t keylen)
+{
+#ifndef ENABLE_SRTP
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "SRTP NOT SUPPORTED IN THIS BUILD!\n");
+	return SWITCH_STATUS_FALSE;
+#else
+	switch_rtp_crypto_key_t *crypto_key;
+	srtp_policy_t *policy;
+	err_status_t stat;
+	switch_status_t status = SWITCH_STATUS_SUCCESS;
+	switch_core_session_t *session = switch_core_memory_pool_get_data(rtp_session->pool, "__session");
+	switch_channel_t *channel = switch_core_session_get_channel(session);
+	switch_event_t *fsevent = NULL;
+
+	if (direction >= SWITCH_RTP_CRYPTO_MAX || keylen > SWITCH_RTP_MAX_CRYPTO_LEN) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	crypto_key = switch_core_alloc(rtp_session->pool, sizeof(*crypto_key));
+
+	if (direction == SWITCH_RTP_CRYPTO_RECV) {
+		policy = &rtp_session->recv_policy;
+	} else {
+		policy = &rtp_session->send_policy;
+	}
+
+	crypto_key->type = type;
+	crypto_key->index = index;
+	memcpy(crypto_key->key, key, keylen);
+	crypto_key->next = rtp_session->crypto_keys[direction];
+	rtp_session->crypto_keys[direction] = crypto_key;
+
+	memset(policy, 0, sizeof(*policy));
+
+	switch (crypto_key->type) {
+	case AES_CM_128_HMAC_SHA1_80:
+		crypto_policy_set_aes_cm_128_hmac_sha1_80(&policy->rtp);
+		if (switch_channel_direction(channel) == SWITCH_CALL_DIRECTION_OUTBOUND) {
+			switch_channel_set_variable(channel, "sip_has_crypto", "AES_CM_128_HMAC_SHA1_80");
+		}
+		break;
+	case AES_CM_128_HMAC_SHA1_32:
+		crypto_policy_set_aes_cm_128_hmac_sha1_32(&policy->rtp);
+		if (switch_channel_direction(channel) == SWITCH_CALL_DIRECTION_OUTBOUND) {
+			switch_channel_set_variable(channel, "sip_has_crypto", "AES_CM_128_HMAC_SHA1_32");
+		}
+		break;
+	case AES_CM_128_NULL_AUTH:
+		crypto_policy_set_aes_cm_128_null_auth(&policy->rtp);
+		if (switch_channel_direction(channel) == SWITCH_CALL_DIRECTION_OUTBOUND) {
+			switch_channel_set_variable(channel, "sip_has_crypto", "AES_CM_128_NULL_AUTH");
+		}
+		break;
+	default:
+		break;
+	}
+
+	policy->next = NULL;
+	policy->key = (uint8_t *) crypto_key->key;
+
+	if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_ENABLE_RTCP)) {
+		crypto_policy_set_rtcp_default(&policy->rtcp);
+		policy->rtcp.sec_serv = sec_serv_none;
+	}
+
+	policy->rtp.sec_serv = sec_serv_conf_and_auth;
+	switch (direction) {
+	case SWITCH_RTP_CRYPTO_RECV:
+		policy->ssrc.type = ssrc_any_inbound;
+
+		if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_SECURE_RECV)) {
+			switch_set_flag(rtp_session, SWITCH_RTP_FLAG_SECURE_RECV_RESET);
+		} else {
+			if ((stat = srtp_create(&rtp_session->recv_ctx, policy))) {
+				status = SWITCH_STATUS_FALSE;
+			}
+
+			if (status == SWITCH_STATUS_SUCCESS) {
+				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "Activating Secure RTP RECV\n");
+				switch_set_flag(rtp_session, SWITCH_RTP_FLAG_SECURE_RECV);
+			} else {
+				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error allocating srtp [%d]\n", stat);
+				return status;
+			}
+		}
+		break;
+	case SWITCH_RTP_CRYPTO_SEND:
+		policy->ssrc.type = ssrc_specific;
+		policy->ssrc.value = rtp_session->ssrc;
+
+		if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_SECURE_SEND)) {
+			switch_set_flag(rtp_session, SWITCH_RTP_FLAG_SECURE_SEND_RESET);
+		} else {
+			if ((stat = srtp_create(&rtp_session->send_ctx, policy))) {
+				status = SWITCH_STATUS_FALSE;
+			}
+
+			if (status == SWITCH_STATUS_SUCCESS) {
+				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "Activating Secure RTP SEND\n");
+				switch_set_flag(rtp_session, SWITCH_RTP_FLAG_SECURE_SEND);
+			} else {
+				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error allocating SRTP [%d]\n", stat);
+				return status;
+			}
+		}
+
+		break;
+	default:
+		abort();
+		break;
+	}
+
+	if (switch_event_create(&fsevent, SWITCH_EVENT_CALL_SECURE) == SWITCH_STATUS_SUCCESS) {
+		switch_event_add_header(fsevent, SWITCH_STACK_BOTTOM, "secure_type", "srtp:%s", switch_channel_get_variable(channel, "sip_has_crypto"));
+		switch_event_add_header_string(fsevent, SWITCH_STACK_BOTTOM, "caller-unique-id", switch_channel_get_uuid(channel));
+		switch_event_fire(&fsevent);
+	}
+
+
+	return SWITCH_STATUS_SUCCESS;
+#endif
+}
+
+SWITCH_DECLARE(switch_status_t) switch_rtp_set_interval(switch_rtp_t *rtp_session, uint32_t ms_per_packet, uint32_t samples_per_interval)
+{
+	rtp_session->ms_per_packet = ms_per_packet;
+	rtp_session->samples_per_interval = rtp_session->conf_samples_per_interval = samples_per_interval;
+	rtp_session->missed_count = 0;
+	rtp_session->samples_per_second =
+		(uint32_t) ((double) (1000.0f / (double) (rtp_session->ms_per_packet / 1000)) * (double) rtp_session->samples_per_interval);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+SWITCH_DECLARE(switch_status_t) switch_rtp_change_interval(switch_rtp_t *rtp_session, uint32_t ms_per_packet, uint32_t samples_per_interval)
+{
+	switch_status_t status = SWITCH_STATUS_SUCCESS;
+	int change_timer = 0;
+
+	if (rtp_session->ms_per_packet && rtp_session->ms_per_packet != ms_per_packet) {
+		change_timer = 1;
+	}
+
+	switch_rtp_set_interval(rtp_session, ms_per_packet, samples_per_interval);
+
+	if (change_timer && rtp_session->timer_name) {
+		READ_INC(rtp_session);
+		WRITE_INC(rtp_session);
+
+		if (rtp_session->timer.timer_interface) {
+			switch_core_timer_destroy(&rtp_session->timer);
+		}
+		if ((status = switch_core_timer_init(&rtp_session->timer,
+											 rtp_session->timer_name, ms_per_packet / 1000,
+											 samples_per_interval, rtp_session->pool)) == SWITCH_STATUS_SUCCESS) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG,
+							  "RE-Starting timer [%s] %d bytes per %dms\n", rtp_session->timer_name, samples_per_interval, ms_per_packet / 1000);
+		} else {
+			memset(&rtp_session->timer, 0, sizeof(rtp_session->timer));
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR,
+							  "Problem RE-Starting timer [%s] %d bytes per %dms\n", rtp_session->timer_name, samples_per_interval, ms_per_packet / 1000);
+		}
+
+		WRITE_DEC(rtp_session);
+		READ_DEC(rtp_session);
+	}
+
+	return status;
+}
+
+SWITCH_DECLARE(switch_status_t) switch_rtp_set_ssrc(switch_rtp_t *rtp_session, uint32_t ssrc) 
+{
+	rtp_session->ssrc = ssrc;
+	rtp_session->send_msg.header.ssrc = htonl(rtp_session->ssrc);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+SWITCH_DECLARE(switch_status_t) switch_rtp_create(switch_rtp_t **new_rtp_session,
+												  switch_payload_t payload,
+												  uint32_t samples_per_interval,
+												  uint32_t ms_per_packet,
+												  switch_rtp_flag_t flags, char *timer_name, const char **err, switch_memory_pool_t *pool)
+{
+	switch_rtp_t *rtp_session = NULL;
+	switch_core_session_t *session = switch_core_memory_pool_get_data(pool, "__session");
+	switch_channel_t *channel = NULL;
+
+	if (session) channel = switch_core_session_get_channel(session);
+
+	*new_rtp_session = NULL;
+
+	if (samples_per_interval > SWITCH_RTP_MAX_BUF_LEN) {
+		*err = "Packet Size Too Large!";
+		return SWITCH_STATUS_FALSE;
+	}
+
+	if (!(rtp_session = switch_core_alloc(pool, sizeof(*rtp_session)))) {
+		*err = "Memory Error!";
+		return SWITCH_STATUS_MEMERR;
+	}
+
+	rtp_session->pool = pool;
+	rtp_session->te = 101;
+	rtp_session->recv_te = 101;
+
+	switch_mutex_init(&rtp_session->flag_mutex, SWITCH_MUTEX_NESTED, pool);
+	switch_mutex_init(&rtp_session->read_mutex, SWITCH_MUTEX_NESTED, pool);
+	switch_mutex_init(&rtp_session->write_mutex, SWITCH_MUTEX_NESTED, pool);
+	switch_mutex_init(&rtp_session->dtmf_data.dtmf_mutex, SWITCH_MUTEX_NESTED, pool);
+	switch_queue_create(&rtp_session->dtmf_data.dtmf_queue, 100, rtp_session->pool);
+	switch_queue_create(&rtp_session->dtmf_data.dtmf_inqueue, 100, rtp_session->pool);
+
+	switch_rtp_set_flag(rtp_session, flags);
+
+	/* for from address on recvfrom calls */
+	switch_sockaddr_create(&rtp_session->from_addr, pool);
+
+	if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_ENABLE_RTCP)) {
+		switch_sockaddr_create(&rtp_session->rtcp_from_addr, pool);
+	}
+	rtp_session->seq = (uint16_t) rand();
+	rtp_session->ssrc = (uint32_t) ((intptr_t) rtp_session + (uint32_t) switch_epoch_time_now(NULL));
+
+	rtp_session->send_msg.header.ssrc = htonl(rtp_session->ssrc);
+	rtp_session->send_msg.header.ts = 0;
+	rtp_session->send_msg.header.m = 0;
+	rtp_session->send_msg.header.pt = (switch_payload_t) htonl(payload);
+	rtp_session->send_msg.header.version = 2;
+	rtp_session->send_msg.header.p = 0;
+	rtp_session->send_msg.header.x = 0;
+	rtp_session->send_msg.header.cc = 0;
+
+	rtp_session->recv_msg.header.ssrc = 0;
+	rtp_session->recv_msg.header.ts = 0;
+	rtp_session->recv_msg.header.seq = 0;
+	rtp_session->recv_msg.header.m = 0;
+	rtp_session->recv_msg.header.pt = (switch_payload_t) htonl(payload);
+	rtp_session->recv_msg.header.version = 2;
+	rtp_session->recv_msg.header.p = 0;
+	rtp_session->recv_msg.header.x = 0;
+	rtp_session->recv_msg.header.cc = 0;
+
+	rtp_session->payload = payload;
+	rtp_session->rpayload = payload;
+
+	rtp_session->rtcp_send_msg.header.version = 2;
+	rtp_session->rtcp_send_msg.header.p = 0;
+	rtp_session->rtcp_send_msg.header.type = 200;
+	rtp_session->rtcp_send_msg.header.count = 0;
+	rtp_session->rtcp_send_msg.header.length = htons(6); 
+
+
+	switch_rtp_set_interval(rtp_session, ms_per_packet, samples_per_interval);
+	rtp_session->conf_samples_per_interval = samples_per_interval;
+
+	if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_USE_TIMER) && zstr(timer_name)) {
+		timer_name = "soft";
+	}
+
+	if (!zstr(timer_name) && !strcasecmp(timer_name, "none")) {
+		timer_name = NULL;
+	}
+
+	if (!zstr(timer_name)) {
+		rtp_session->timer_name = switch_core_strdup(pool, timer_name);
+		switch_set_flag_locked(rtp_session, SWITCH_RTP_FLAG_USE_TIMER);
+		switch_set_flag_locked(rtp_session, SWITCH_RTP_FLAG_NOBLOCK);
+
+		if (switch_core_timer_init(&rtp_session->timer, timer_name, ms_per_packet / 1000, samples_per_interval, pool) == SWITCH_STATUS_SUCCESS) {
+			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG,
+							  "Starting timer [%s] %d bytes per %dms\n", timer_name, samples_per_interval, ms_per_packet / 1000);
+		} else {
+			memset(&rtp_session->timer, 0, sizeof(rtp_session->timer));
+			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Error starting timer [%s], async RTP disabled\n", timer_name);
+			switch_clear_flag_locked(rtp_session, SWITCH_RTP_FLAG_USE_TIMER);
+		}
+	} else {
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Not using a timer\n");
+		switch_clear_flag_locked(rtp_session, SWITCH_RTP_FLAG_USE_TIMER);
+		switch_clear_flag_locked(rtp_session, SWITCH_RTP_FLAG_NOBLOCK);
+	}
+
+	if (channel && !switch_test_flag(rtp_session, SWITCH_RTP_FLAG_VIDEO)) {
+		switch_channel_set_private(channel, SWITCH_RTP_AUDIO_PRIVATE, rtp_session);
+	}
+
+#ifdef ENABLE_ZRTP
+	if (zrtp_on && !switch_test_flag(rtp_session, SWITCH_RTP_FLAG_PROXY_MEDIA)) {
+		switch_rtp_t *master_rtp_session = NULL;
+
+		int initiator = 0;
+		const char *zrtp_enabled = switch_channel_get_variable(channel, "zrtp_secure_media");
+		const char *srtp_enabled = switch_channel_get_variable(channel, "sip_secure_media");
+
+		if (switch_true(srtp_enabled) && switch_true(zrtp_enabled)) {
+			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_WARNING,
+							  "You can not have ZRTP and SRTP enabled simultaneously, ZRTP will be disabled for this call!\n");
+			switch_channel_set_variable(channel, "zrtp_secure_media", NULL);
+			zrtp_enabled = NULL;
+		}
+
+
+		if (switch_true(zrtp_enabled)) {
+			if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_VIDEO)) {
+				switch_channel_set_private(channel, "__zrtp_video_rtp_session", rtp_session);
+				master_rtp_session = switch_channel_get_private(channel, "__zrtp_audio_rtp_session");
+			} else {
+				switch_channel_set_private(channel, "__zrtp_audio_rtp_session", rtp_session);
+				master_rtp_session = rtp_session;
+			}
+
+
+			if (switch_channel_direction(channel) == SWITCH_CALL_DIRECTION_OUTBOUND) {
+				initiator = 1;
+			}
+
+			if (rtp_session == master_rtp_session) {
+				rtp_session->zrtp_profile = switch_core_alloc(rtp_session->pool, sizeof(*rtp_session->zrtp_profile));
+				zrtp_profile_defaults(rtp_session->zrtp_profile, zrtp_global);
+
+				rtp_session->zrtp_profile->allowclear = 0;
+				rtp_session->zrtp_profile->disclose_bit = 0;
+				rtp_session->zrtp_profile->cache_ttl = -1;
+
+				if (zrtp_status_ok != zrtp_session_init(zrtp_global, rtp_session->zrtp_profile, zid, initiator, &rtp_session->zrtp_session)) {
+					switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Error! zRTP INIT Failed\n");
+					zrtp_session_down(rtp_session->zrtp_session);
+					rtp_session->zrtp_session = NULL;
+					goto end;
+				}
+
+				zrtp_session_set_userdata(rtp_session->zrtp_session, session);
+
+
+				if (zrtp_status_ok != zrtp_stream_attach(master_rtp_session->zrtp_session, &rtp_session->zrtp_stream)) {
+					abort();
+				}
+
+				zrtp_stream_set_userdata(rtp_session->zrtp_stream, rtp_session);
+
+				if (switch_true(switch_channel_get_variable(channel, "zrtp_enrollment"))) {
+					zrtp_stream_registration_start(rtp_session->zrtp_stream, rtp_session->ssrc);
+				} else {
+					zrtp_stream_start(rtp_session->zrtp_stream, rtp_session->ssrc);
+				}
+			}
+
+		}
+	}
+
+ end:
+
+#endif
+
+#ifdef RTP_LATENCY_STATS
+	rtp_latency_register(rtp_session);
+#endif
+
+	rtp_session->ready = 1;
+	*new_rtp_session = rtp_session;
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+SWITCH_DECLARE(switch_rtp_t *) switch_rtp_new(const char *rx_host,
+											  switch_port_t rx_port,
+											  const char *tx_host,
+											  switch_port_t tx_port,
+											  switch_payload_t payload,
+											  uint32_t samples_per_interval,
+											  uint32_t ms_per_packet,
+											  switch_rtp_flag_t flags, char *timer_name, const char **err, switch_memory_pool_t *pool)
+{
+	switch_rtp_t *rtp_session = NULL;
+
+	if (zstr(rx_host)) {
+		*err = "Missing local host";
+		goto end;
+	}
+
+	if (!rx_port) {
+		*err = "Missing local port";
+		goto end;
+	}
+
+	if (zstr(tx_host)) {
+		*err = "Missing remote host";
+		goto end;
+	}
+
+	if (!tx_port) {
+		*err = "Missing remote port";
+		goto end;
+	}
+
+	if (switch_rtp_create(&rtp_session, payload, samples_per_interval, ms_per_packet, flags, timer_name, err, pool) != SWITCH_STATUS_SUCCESS) {
+		goto end;
+	}
+
+	switch_mutex_lock(rtp_session->flag_mutex);
+
+	if (switch_rtp_set_local_address(rtp_session, rx_host, rx_port, err) != SWITCH_STATUS_SUCCESS) {
+		switch_mutex_unlock(rtp_session->flag_mutex);
+#ifdef RTP_LATENCY_STATS
+		rtp_latency_unregister(rtp_session);
+#endif
+		rtp_session = NULL;
+		goto end;
+	}
+
+	if (switch_rtp_set_remote_address(rtp_session, tx_host, tx_port, 0, SWITCH_TRUE, err) != SWITCH_STATUS_SUCCESS) {
+		switch_mutex_unlock(rtp_session->flag_mutex);
+#ifdef RTP_LATENCY_STATS
+		rtp_latency_unregister(rtp_session);
+#endif
+		rtp_session = NULL;
+		goto end;
+	}
+
+ end:
+
+	if (rtp_session) {
+		switch_mutex_unlock(rtp_session->flag_mutex);
+		rtp_session->ready = 2;
+		rtp_session->rx_host = switch_core_strdup(rtp_session->pool, rx_host);
+		rtp_session->rx_port = rx_port;
+	} else {
+		switch_rtp_release_port(rx_host, rx_port);
+	}
+
+	return rtp_session;
+}
+
+SWITCH_DECLARE(void) switch_rtp_set_telephony_event(switch_rtp_t *rtp_session, switch_payload_t te)
+{
+	if (te > 95) {
+		rtp_session->te = te;
+	}
+}
+
+
+SWITCH_DECLARE(void) switch_rtp_set_telephony_recv_event(switch_rtp_t *rtp_session, switch_payload_t te)
+{
+	if (te > 95) {
+		rtp_session->recv_te = te;
 	}
+}
 
-	policy->rtp.sec_serv = sec_serv_conf_and_auth;
-	switch (direction) {
-	case SWITCH_RTP_CRYPTO_RECV:
-		policy->ssrc.type = ssrc_any_inbound;
+SWITCH_DECLARE(void) switch_rtp_set_recv_pt(switch_rtp_t *rtp_session, switch_payload_t pt)
+{
+	rtp_session->rpayload = pt;
+}
 
-		if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_SECURE_RECV)) {
-			switch_set_flag(rtp_session, SWITCH_RTP_FLAG_SECURE_RECV_RESET);
-		} else {
-			if ((stat = srtp_create(&rtp_session->recv_ctx, policy))) {
-				status = SWITCH_STATUS_FALSE;
-			}
 
-			if (status == SWITCH_STATUS_SUCCESS) {
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "Activating Secure RTP RECV\n");
-				switch_set_flag(rtp_session, SWITCH_RTP_FLAG_SECURE_RECV);
-			} else {
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error allocating srtp [%d]\n", stat);
-				return status;
-			}
-		}
-		break;
-	case SWITCH_RTP_CRYPTO_SEND:
-		policy->ssrc.type = ssrc_specific;
-		policy->ssrc.value = rtp_session->ssrc;
+SWITCH_DECLARE(void) switch_rtp_set_cng_pt(switch_rtp_t *rtp_session, switch_payload_t pt)
+{
+	rtp_session->cng_pt = pt;
+	switch_set_flag(rtp_session, SWITCH_RTP_FLAG_AUTO_CNG);
+}
 
-		if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_SECURE_SEND)) {
-			switch_set_flag(rtp_session, SWITCH_RTP_FLAG_SECURE_SEND_RESET);
-		} else {
-			if ((stat = srtp_create(&rtp_session->send_ctx, policy))) {
-				status = SWITCH_STATUS_FALSE;
-			}
+SWITCH_DECLARE(switch_status_t) switch_rtp_activate_stun_ping(switch_rtp_t *rtp_session, const char *stun_ip, switch_port_t stun_port,
+															  uint32_t packet_count, switch_bool_t funny)
+{
 
-			if (status == SWITCH_STATUS_SUCCESS) {
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "Activating Secure RTP SEND\n");
-				switch_set_flag(rtp_session, SWITCH_RTP_FLAG_SECURE_SEND);
-			} else {
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error allocating SRTP [%d]\n", stat);
-				return status;
-			}
-		}
+	if (switch_sockaddr_info_get(&rtp_session->remote_stun_addr, stun_ip, SWITCH_UNSPEC,
+								 stun_port, 0, rtp_session->pool) != SWITCH_STATUS_SUCCESS || !rtp_session->remote_stun_addr) {
 
-		break;
-	default:
-		abort();
-		break;
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error resolving stun ping addr\n");
+		return SWITCH_STATUS_FALSE;
 	}
 
-	if (switch_event_create(&fsevent, SWITCH_EVENT_CALL_SECURE) == SWITCH_STATUS_SUCCESS) {
-		switch_event_add_header(fsevent, SWITCH_STACK_BOTTOM, "secure_type", "srtp:%s", switch_channel_get_variable(channel, "sip_has_crypto"));
-		switch_event_add_header_string(fsevent, SWITCH_STACK_BOTTOM, "caller-unique-id", switch_channel_get_uuid(channel));
-		switch_event_fire(&fsevent);
+	if (funny) {
+		rtp_session->funny_stun++;
 	}
 
+	rtp_session->stun_port = stun_port;
+
+	rtp_session->default_stuncount = packet_count;
 
+	rtp_session->stun_ip = switch_core_strdup(rtp_session->pool, stun_ip);
 	return SWITCH_STATUS_SUCCESS;
-#endif
 }
 
-SWITCH_DECLARE(switch_status_t) switch_rtp_set_interval(switch_rtp_t *rtp_session, uint32_t ms_per_packet, uint32_t samples_per_interval)
+static void jb_callback(stfu_instance_t *i, void *udata)
 {
-	rtp_session->ms_per_packet = ms_per_packet;
-	rtp_session->samples_per_interval = rtp_session->conf_samples_per_interval = samples_per_interval;
-	rtp_session->missed_count = 0;
-	rtp_session->samples_per_second =
-		(uint32_t) ((double) (1000.0f / (double) (rtp_session->ms_per_packet / 1000)) * (double) rtp_session->samples_per_interval);
+	switch_core_session_t *session = (switch_core_session_t *) udata;
+	stfu_report_t r = { 0 };
+
+	stfu_n_report(i, &r);
+
+	switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG8, 
+					  "%s JB REPORT:\nlen: %u\nin: %u\nclean: %u\ngood: %u\nbad: %u\n",
+					  switch_core_session_get_name(session),
+					  r.qlen,
+					  r.packet_in_count,
+					  r.clean_count,
+					  r.consecutive_good_count,
+					  r.consecutive_bad_count
+					  );
 
-	return SWITCH_STATUS_SUCCESS;
 }
 
-SWITCH_DECLARE(switch_status_t) switch_rtp_change_interval(switch_rtp_t *rtp_session, uint32_t ms_per_packet, uint32_t samples_per_interval)
+SWITCH_DECLARE(switch_status_t) switch_rtp_pause_jitter_buffer(switch_rtp_t *rtp_session, switch_bool_t pause)
 {
-	switch_status_t status = SWITCH_STATUS_SUCCESS;
-	int change_timer = 0;
-
-	if (rtp_session->ms_per_packet && rtp_session->ms_per_packet != ms_per_packet) {
-		change_timer = 1;
+	
+	if (!switch_rtp_ready(rtp_session) || !rtp_session->jb) {
+		return SWITCH_STATUS_FALSE;
 	}
 
-	switch_rtp_set_interval(rtp_session, ms_per_packet, samples_per_interval);
-
-	if (change_timer && rtp_session->timer_name) {
-		READ_INC(rtp_session);
-		WRITE_INC(rtp_session);
-
-		if (rtp_session->timer.timer_interface) {
-			switch_core_timer_destroy(&rtp_session->timer);
-		}
-		if ((status = switch_core_timer_init(&rtp_session->timer,
-											 rtp_session->timer_name, ms_per_packet / 1000,
-											 samples_per_interval, rtp_session->pool)) == SWITCH_STATUS_SUCCESS) {
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG,
-							  "RE-Starting timer [%s] %d bytes per %dms\n", rtp_session->timer_name, samples_per_interval, ms_per_packet / 1000);
-		} else {
-			memset(&rtp_session->timer, 0, sizeof(rtp_session->timer));
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR,
-							  "Problem RE-Starting timer [%s] %d bytes per %dms\n", rtp_session->timer_name, samples_per_interval, ms_per_packet / 1000);
-		}
+	if (!!pause == !!rtp_session->pause_jb) {
+		return SWITCH_STATUS_FALSE;
+	}
 
-		WRITE_DEC(rtp_session);
-		READ_DEC(rtp_session);
+	if (rtp_session->pause_jb && !pause) {
+		stfu_n_reset(rtp_session->jb);
 	}
 
-	return status;
+	rtp_session->pause_jb = pause ? 1 : 0;
+	
+	return SWITCH_STATUS_SUCCESS;
 }
 
-SWITCH_DECLARE(switch_status_t) switch_rtp_set_ssrc(switch_rtp_t *rtp_session, uint32_t ssrc) 
+SWITCH_DECLARE(switch_status_t) switch_rtp_deactivate_jitter_buffer(switch_rtp_t *rtp_session)
 {
-	rtp_session->ssrc = ssrc;
-	rtp_session->send_msg.header.ssrc = htonl(rtp_session->ssrc);
+	
+	if (!switch_rtp_ready(rtp_session) || !rtp_session->jb) {
+		return SWITCH_STATUS_FALSE;
+	}
 
+	READ_INC(rtp_session);
+	stfu_n_destroy(&rtp_session->jb);
+	READ_DEC(rtp_session);
+	
 	return SWITCH_STATUS_SUCCESS;
 }
 
-SWITCH_DECLARE(switch_status_t) switch_rtp_create(switch_rtp_t **new_rtp_session,
-												  switch_payload_t payload,
-												  uint32_t samples_per_interval,
-												  uint32_t ms_per_packet,
-												  switch_rtp_flag_t flags, char *timer_name, const char **err, switch_memory_pool_t *pool)
+static void jb_logger(const char *file, const char *func, int line, int level, const char *fmt, ...)
 {
-	switch_rtp_t *rtp_session = NULL;
-	switch_core_session_t *session = switch_core_memory_pool_get_data(pool, "__session");
-	switch_channel_t *channel = NULL;
+	int ret;
+	char *data;
+	va_list ap;
 
-	if (session) channel = switch_core_session_get_channel(session);
+	va_start(ap, fmt);
+	ret = switch_vasprintf(&data, fmt, ap);
+	if (ret != -1) {
+		switch_log_printf(SWITCH_CHANNEL_LOG_CLEAN, SWITCH_LOG_CONSOLE, "%s", data);
+		free(data);
+	}
 
-	*new_rtp_session = NULL;
+	//switch_log_printf(SWITCH_CHANNEL_ID_LOG_CLEAN, file, func, line, NULL, level, fmt, ap);
+	va_end(ap);
+}
 
-	if (samples_per_interval > SWITCH_RTP_MAX_BUF_LEN) {
-		*err = "Packet Size Too Large!";
-		return SWITCH_STATUS_FALSE;
-	}
+SWITCH_DECLARE(switch_status_t) switch_rtp_debug_jitter_buffer(switch_rtp_t *rtp_session, const char *name)
+{
 
-	if (!(rtp_session = switch_core_alloc(pool, sizeof(*rtp_session)))) {
-		*err = "Memory Error!";
-		return SWITCH_STATUS_MEMERR;
+	if (!switch_rtp_ready(rtp_session) || !rtp_session->jb) {
+		return SWITCH_STATUS_FALSE;
 	}
+	
+	stfu_n_debug(rtp_session->jb, name);
+	stfu_global_set_logger(jb_logger);
 
-	rtp_session->pool = pool;
-	rtp_session->te = 101;
-	rtp_session->recv_te = 101;
-
-	switch_mutex_init(&rtp_session->flag_mutex, SWITCH_MUTEX_NESTED, pool);
-	switch_mutex_init(&rtp_session->read_mutex, SWITCH_MUTEX_NESTED, pool);
-	switch_mutex_init(&rtp_session->write_mutex, SWITCH_MUTEX_NESTED, pool);
-	switch_mutex_init(&rtp_session->dtmf_data.dtmf_mutex, SWITCH_MUTEX_NESTED, pool);
-	switch_queue_create(&rtp_session->dtmf_data.dtmf_queue, 100, rtp_session->pool);
-	switch_queue_create(&rtp_session->dtmf_data.dtmf_inqueue, 100, rtp_session->pool);
+	return SWITCH_STATUS_SUCCESS;
+}
 
-	switch_rtp_set_flag(rtp_session, flags);
+SWITCH_DECLARE(switch_status_t) switch_rtp_activate_jitter_buffer(switch_rtp_t *rtp_session, 
+																  uint32_t queue_frames, 
+																  uint32_t max_queue_frames, 
+																  uint32_t samples_per_packet, 
+																  uint32_t samples_per_second,
+																  uint32_t max_drift)
+{
+	return switch_rtp_activate_jitter_buffer_ex(rtp_session, queue_frames, max_queue_frames, samples_per_packet, samples_per_second, max_drift,
+												SWITCH_RTP_JB_DEFAULT);
+}
 
-	/* for from address on recvfrom calls */
-	switch_sockaddr_create(&rtp_session->from_addr, pool);
+SWITCH_DECLARE(switch_status_t) switch_rtp_activate_jitter_buffer_ex(switch_rtp_t *rtp_session,
+																	 uint32_t queue_frames,
+																	 uint32_t max_queue_frames,
+																	 uint32_t samples_per_packet,
+																	 uint32_t samples_per_second,
+																	 uint32_t max_drift,
+																	 switch_rtp_jb_mode_t jb_mode)
+{
 
-	if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_ENABLE_RTCP)) {
-		switch_sockaddr_create(&rtp_session->rtcp_from_addr, pool);
+	if (!switch_rtp_ready(rtp_session)) {
+		return SWITCH_STATUS_FALSE;
 	}
-	rtp_session->seq = (uint16_t) rand();
-	rtp_session->ssrc = (uint32_t) ((intptr_t) rtp_session + (uint32_t) switch_epoch_time_now(NULL));
 
-	rtp_session->send_msg.header.ssrc = htonl(rtp_session->ssrc);
-	rtp_session->send_msg.header.ts = 0;
-	rtp_session->send_msg.header.m = 0;
-	rtp_session->send_msg.header.pt = (switch_payload_t) htonl(payload);
-	rtp_session->send_msg.header.version = 2;
-	rtp_session->send_msg.header.p = 0;
-	rtp_session->send_msg.header.x = 0;
-	rtp_session->send_msg.header.cc = 0;
+	if (queue_frames < 1) {
+		queue_frames = 3;
+	}
 
-	rtp_session->recv_msg.header.ssrc = 0;
-	rtp_session->recv_msg.header.ts = 0;
-	rtp_session->recv_msg.header.seq = 0;
-	rtp_session->recv_msg.header.m = 0;
-	rtp_session->recv_msg.header.pt = (switch_payload_t) htonl(payload);
-	rtp_session->recv_msg.header.version = 2;
-	rtp_session->recv_msg.header.p = 0;
-	rtp_session->recv_msg.header.x = 0;
-	rtp_session->recv_msg.header.cc = 0;
+	if (max_queue_frames < queue_frames) {
+		max_queue_frames = queue_frames * 3;
+	}
 
-	rtp_session->payload = payload;
-	rtp_session->rpayload = payload;
+	READ_INC(rtp_session);
+	if (rtp_session->jb) {
+		stfu_n_resize(rtp_session->jb, queue_frames);
+	} else {
+		rtp_session->jb = stfu_n_init_ex(queue_frames, max_queue_frames ? max_queue_frames : 50, samples_per_packet, samples_per_second, max_drift,
+										 jb_mode == SWITCH_RTP_JB_INDEXED ? STFU_FLAG_INDEXED : STFU_FLAG_NONE);
+	}
+	READ_DEC(rtp_session);
+	
+	if (rtp_session->jb) {
+		switch_core_session_t *session = switch_core_memory_pool_get_data(rtp_session->pool, "__session");
+		stfu_n_call_me(rtp_session->jb, jb_callback, session);
 
-	rtp_session->rtcp_send_msg.header.version = 2;
-	rtp_session->rtcp_send_msg.header.p = 0;
-	rtp_session->rtcp_send_msg.header.type = 200;
-	rtp_session->rtcp_send_msg.header.count = 0;
-	rtp_session->rtcp_send_msg.header.length = htons(6); 
+		return SWITCH_STATUS_SUCCESS;
+	}
 
+	return SWITCH_STATUS_FALSE;
+}
 
-	switch_rtp_set_interval(rtp_session, ms_per_packet, samples_per_interval);
-	rtp_session->conf_samples_per_interval = samples_per_interval;
+SWITCH_DECLARE(switch_status_t) switch_rtp_activate_rtcp(switch_rtp_t *rtp_session, int send_rate, switch_port_t remote_port)
+{
+	const char *err = NULL;
 
-	if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_USE_TIMER) && zstr(timer_name)) {
-		timer_name = "soft";
+	if (!rtp_session->ms_per_packet) {
+		return SWITCH_STATUS_FALSE;
 	}
+	
+	switch_set_flag(rtp_session, SWITCH_RTP_FLAG_ENABLE_RTCP);
 
-	if (!zstr(timer_name) && !strcasecmp(timer_name, "none")) {
-		timer_name = NULL;
+	if (!(rtp_session->remote_rtcp_port = remote_port)) {
+		rtp_session->remote_rtcp_port = rtp_session->remote_port + 1;
 	}
-
-	if (!zstr(timer_name)) {
-		rtp_session->timer_name = switch_core_strdup(pool, timer_name);
-		switch_set_flag_locked(rtp_session, SWITCH_RTP_FLAG_USE_TIMER);
-		switch_set_flag_locked(rtp_session, SWITCH_RTP_FLAG_NOBLOCK);
-
-		if (switch_core_timer_init(&rtp_session->timer, timer_name, ms_per_packet / 1000, samples_per_interval, pool) == SWITCH_STATUS_SUCCESS) {
-			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG,
-							  "Starting timer [%s] %d bytes per %dms\n", timer_name, samples_per_interval, ms_per_packet / 1000);
-		} else {
-			memset(&rtp_session->timer, 0, sizeof(rtp_session->timer));
-			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Error starting timer [%s], async RTP disabled\n", timer_name);
-			switch_clear_flag_locked(rtp_session, SWITCH_RTP_FLAG_USE_TIMER);
-		}
+	
+	if (send_rate == -1) {
+		switch_set_flag(rtp_session, SWITCH_RTP_FLAG_RTCP_PASSTHRU);
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "RTCP passthru enabled. Remote Port: %d\n", rtp_session->remote_rtcp_port);
 	} else {
-		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Not using a timer\n");
-		switch_clear_flag_locked(rtp_session, SWITCH_RTP_FLAG_USE_TIMER);
-		switch_clear_flag_locked(rtp_session, SWITCH_RTP_FLAG_NOBLOCK);
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "RTCP send rate is: %d and packet rate is: %d Remote Port: %d\n", 
+						  send_rate, rtp_session->ms_per_packet, rtp_session->remote_rtcp_port);
+		rtp_session->rtcp_interval = send_rate/(rtp_session->ms_per_packet/1000);
 	}
 
-	if (channel) {
-		switch_channel_set_private(channel, "__rtcp_audio_rtp_session", rtp_session);
-	}
+	return enable_local_rtcp_socket(rtp_session, &err) || enable_remote_rtcp_socket(rtp_session, &err);
 
-#ifdef ENABLE_ZRTP
-	if (zrtp_on && !switch_test_flag(rtp_session, SWITCH_RTP_FLAG_PROXY_MEDIA)) {
-		switch_rtp_t *master_rtp_session = NULL;
+}
 
-		int initiator = 0;
-		const char *zrtp_enabled = switch_channel_get_variable(channel, "zrtp_secure_media");
-		const char *srtp_enabled = switch_channel_get_variable(channel, "sip_secure_media");
+SWITCH_DECLARE(switch_status_t) switch_rtp_activate_ice(switch_rtp_t *rtp_session, char *login, char *rlogin)
+{
+	char ice_user[80];
+	char user_ice[80];
 
-		if (switch_true(srtp_enabled) && switch_true(zrtp_enabled)) {
-			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_WARNING,
-							  "You can not have ZRTP and SRTP enabled simultaneously, ZRTP will be disabled for this call!\n");
-			switch_channel_set_variable(channel, "zrtp_secure_media", NULL);
-			zrtp_enabled = NULL;
+	switch_snprintf(ice_user, sizeof(ice_user), "%s%s", login, rlogin);
+	switch_snprintf(user_ice, sizeof(user_ice), "%s%s", rlogin, login);
+	rtp_session->ice_user = switch_core_strdup(rtp_session->pool, ice_user);
+	rtp_session->user_ice = switch_core_strdup(rtp_session->pool, user_ice);
+	rtp_session->default_stuncount = 25;
+
+	if (rtp_session->ice_user) {
+		if (ice_out(rtp_session) != SWITCH_STATUS_SUCCESS) {
+			return SWITCH_STATUS_FALSE;
 		}
+	}
 
+	return SWITCH_STATUS_SUCCESS;
+}
 
-		if (switch_true(zrtp_enabled)) {
-			if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_VIDEO)) {
-				switch_channel_set_private(channel, "__zrtp_video_rtp_session", rtp_session);
-				master_rtp_session = switch_channel_get_private(channel, "__zrtp_audio_rtp_session");
-			} else {
-				switch_channel_set_private(channel, "__zrtp_audio_rtp_session", rtp_session);
-				master_rtp_session = rtp_session;
-			}
+SWITCH_DECLARE(void) switch_rtp_break(switch_rtp_t *rtp_session)
+{
+	if (!switch_rtp_ready(rtp_session)) {
+		return;
+	}
 
+	switch_mutex_lock(rtp_session->flag_mutex);
+	switch_set_flag(rtp_session, SWITCH_RTP_FLAG_BREAK);
+	switch_set_flag(rtp_session, SWITCH_RTP_FLAG_FLUSH);
 
-			if (switch_channel_direction(channel) == SWITCH_CALL_DIRECTION_OUTBOUND) {
-				initiator = 1;
+	if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_NOBLOCK)) {
+		switch_mutex_unlock(rtp_session->flag_mutex);
+		return;
+	}
+
+	if (rtp_session->sock_input) {
+		ping_socket(rtp_session);
+	}
+	switch_mutex_unlock(rtp_session->flag_mutex);
+}
+
+SWITCH_DECLARE(void) switch_rtp_kill_socket(switch_rtp_t *rtp_session)
+{
+	switch_assert(rtp_session != NULL);
+	switch_mutex_lock(rtp_session->flag_mutex);
+	if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_IO)) {
+		switch_clear_flag(rtp_session, SWITCH_RTP_FLAG_IO);
+		if (rtp_session->sock_input) {
+			ping_socket(rtp_session);
+			switch_socket_shutdown(rtp_session->sock_input, SWITCH_SHUTDOWN_READWRITE);
+		}
+		if (rtp_session->sock_output && rtp_session->sock_output != rtp_session->sock_input) {
+			switch_socket_shutdown(rtp_session->sock_output, SWITCH_SHUTDOWN_READWRITE);
+		}
+		
+		if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_ENABLE_RTCP)) {
+			if (rtp_session->rtcp_sock_input) {
+				ping_socket(rtp_session);
+				switch_socket_shutdown(rtp_session->rtcp_sock_input, SWITCH_SHUTDOWN_READWRITE);
 			}
+			if (rtp_session->rtcp_sock_output && rtp_session->rtcp_sock_output != rtp_session->rtcp_sock_input) {
+				switch_socket_shutdown(rtp_session->rtcp_sock_output, SWITCH_SHUTDOWN_READWRITE);
+			}
+		}
+	}
+	switch_mutex_unlock(rtp_session->flag_mutex);
+}
 
-			if (rtp_session == master_rtp_session) {
-				rtp_session->zrtp_profile = switch_core_alloc(rtp_session->pool, sizeof(*rtp_session->zrtp_profile));
-				zrtp_profile_defaults(rtp_session->zrtp_profile, zrtp_global);
+SWITCH_DECLARE(uint8_t) switch_rtp_ready(switch_rtp_t *rtp_session)
+{
+	uint8_t ret;
 
-				rtp_session->zrtp_profile->allowclear = 0;
-				rtp_session->zrtp_profile->disclose_bit = 0;
-				rtp_session->zrtp_profile->cache_ttl = -1;
+	if (!rtp_session || !rtp_session->flag_mutex || switch_test_flag(rtp_session, SWITCH_RTP_FLAG_SHUTDOWN)) {
+		return 0;
+	}
 
-				if (zrtp_status_ok != zrtp_session_init(zrtp_global, rtp_session->zrtp_profile, zid, initiator, &rtp_session->zrtp_session)) {
-					switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Error! zRTP INIT Failed\n");
-					zrtp_session_down(rtp_session->zrtp_session);
-					rtp_session->zrtp_session = NULL;
-					goto end;
-				}
+	switch_mutex_lock(rtp_session->flag_mutex);
+	ret = (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_IO) && rtp_session->sock_input && rtp_session->sock_output && rtp_session->remote_addr
+		   && rtp_session->ready == 2) ? 1 : 0;
+	switch_mutex_unlock(rtp_session->flag_mutex);
 
-				zrtp_session_set_userdata(rtp_session->zrtp_session, session);
+	return ret;
+}
 
+SWITCH_DECLARE(void) switch_rtp_destroy(switch_rtp_t **rtp_session)
+{
+	void *pop;
+	switch_socket_t *sock;
+	switch_core_session_t *session;
 
-				if (zrtp_status_ok != zrtp_stream_attach(master_rtp_session->zrtp_session, &rtp_session->zrtp_stream)) {
-					abort();
-				}
+	if (!rtp_session || !*rtp_session || !(*rtp_session)->ready) {
+		return;
+	}
 
-				zrtp_stream_set_userdata(rtp_session->zrtp_stream, rtp_session);
+	switch_set_flag_locked((*rtp_session), SWITCH_RTP_FLAG_SHUTDOWN);
 
-				if (switch_true(switch_channel_get_variable(channel, "zrtp_enrollment"))) {
-					zrtp_stream_registration_start(rtp_session->zrtp_stream, rtp_session->ssrc);
-				} else {
-					zrtp_stream_start(rtp_session->zrtp_stream, rtp_session->ssrc);
-				}
-			}
+	rtp_relay_detach(*rtp_session);
+
+	if ((session = switch_core_memory_pool_get_data((*rtp_session)->pool, "__session"))) {
+		switch_channel_t *channel = switch_core_session_get_channel(session);
 
+		if (switch_channel_get_private(channel, SWITCH_RTP_AUDIO_PRIVATE) == *rtp_session) {
+			switch_channel_set_private(channel, SWITCH_RTP_AUDIO_PRIVATE, NULL);
 		}
 	}
 
- end:
+	READ_INC((*rtp_session));
+	WRITE_INC((*rtp_session));
+
+	(*rtp_session)->ready = 0;
+
+	READ_DEC((*rtp_session));
+	WRITE_DEC((*rtp_session));
 
+#ifdef RTP_LATENCY_STATS
+	rtp_latency_unregister(*rtp_session);
 #endif
 
-	rtp_session->ready = 1;
-	*new_rtp_session = rtp_session;
+	switch_mutex_lock((*rtp_session)->flag_mutex);
 
-	return SWITCH_STATUS_SUCCESS;
-}
+	switch_rtp_kill_socket(*rtp_session);
 
-SWITCH_DECLARE(switch_rtp_t *) switch_rtp_new(const char *rx_host,
-											  switch_port_t rx_port,
-											  const char *tx_host,
-											  switch_port_t tx_port,
-											  switch_payload_t payload,
-											  uint32_t samples_per_interval,
-											  uint32_t ms_per_packet,
-											  switch_rtp_flag_t flags, char *timer_name, const char **err, switch_memory_pool_t *pool)
-{
-	switch_rtp_t *rtp_session = NULL;
+	while (switch_queue_trypop((*rtp_session)->dtmf_data.dtmf_inqueue, &pop) == SWITCH_STATUS_SUCCESS) {
+		switch_safe_free(pop);
+	}
 
-	if (zstr(rx_host)) {
-		*err = "Missing local host";
-		goto end;
+	while (switch_queue_trypop((*rtp_session)->dtmf_data.dtmf_queue, &pop) == SWITCH_STATUS_SUCCESS) {
+		switch_safe_free(pop);
 	}
 
-	if (!rx_port) {
-		*err = "Missing local port";
-		goto end;
+	if ((*rtp_session)->jb) {
+		stfu_n_destroy(&(*rtp_session)->jb);
 	}
 
-	if (zstr(tx_host)) {
-		*err = "Missing remote host";
-		goto end;
+	sock = (*rtp_session)->sock_input;
+	(*rtp_session)->sock_input = NULL;
+	switch_socket_close(sock);
+
+	if ((*rtp_session)->sock_output != sock) {
+		sock = (*rtp_session)->sock_output;
+		(*rtp_session)->sock_output = NULL;
+		switch_socket_close(sock);
 	}
 
-	if (!tx_port) {
-		*err = "Missing remote port";
-		goto end;
+	if ((sock = (*rtp_session)->rtcp_sock_input)) {
+		(*rtp_session)->rtcp_sock_input = NULL;
+		switch_socket_close(sock);
+
+		if ((*rtp_session)->rtcp_sock_output && (*rtp_session)->rtcp_sock_output != sock) {
+			if ((sock = (*rtp_session)->rtcp_sock_output)) {
+				(*rtp_session)->rtcp_sock_output = NULL;
+				switch_socket_close(sock);
+			}
+		}
 	}
 
-	if (switch_rtp_create(&rtp_session, payload, samples_per_interval, ms_per_packet, flags, timer_name, err, pool) != SWITCH_STATUS_SUCCESS) {
-		goto end;
+	if (switch_test_flag((*rtp_session), SWITCH_RTP_FLAG_VAD)) {
+		switch_rtp_disable_vad(*rtp_session);
 	}
 
-	switch_mutex_lock(rtp_session->flag_mutex);
+#ifdef ENABLE_SRTP
+	if (switch_test_flag((*rtp_session), SWITCH_RTP_FLAG_SECURE_SEND)) {
+		srtp_dealloc((*rtp_session)->send_ctx);
+		(*rtp_session)->send_ctx = NULL;
+		switch_clear_flag((*rtp_session), SWITCH_RTP_FLAG_SECURE_SEND);
+	}
 
-	if (switch_rtp_set_local_address(rtp_session, rx_host, rx_port, err) != SWITCH_STATUS_SUCCESS) {
-		switch_mutex_unlock(rtp_session->flag_mutex);
-		rtp_session = NULL;
-		goto end;
+	if (switch_test_flag((*rtp_session), SWITCH_RTP_FLAG_SECURE_RECV)) {
+		srtp_dealloc((*rtp_session)->recv_ctx);
+		(*rtp_session)->recv_ctx = NULL;
+		switch_clear_flag((*rtp_session), SWITCH_RTP_FLAG_SECURE_RECV);
 	}
+#endif
+
+#ifdef ENABLE_ZRTP
+	/* ZRTP */
+	if (zrtp_on && !switch_test_flag((*rtp_session), SWITCH_RTP_FLAG_PROXY_MEDIA)) {
+
+		if ((*rtp_session)->zrtp_stream != NULL) {
+			zrtp_stream_stop((*rtp_session)->zrtp_stream);
+		}
 
-	if (switch_rtp_set_remote_address(rtp_session, tx_host, tx_port, 0, SWITCH_TRUE, err) != SWITCH_STATUS_SUCCESS) {
-		switch_mutex_unlock(rtp_session->flag_mutex);
-		rtp_session = NULL;
-		goto end;
-	}
+		if (switch_test_flag((*rtp_session), SWITCH_ZRTP_FLAG_SECURE_SEND)) {
+			switch_clear_flag((*rtp_session), SWITCH_ZRTP_FLAG_SECURE_SEND);
+		}
 
- end:
+		if (switch_test_flag((*rtp_session), SWITCH_ZRTP_FLAG_SECURE_RECV)) {
+			switch_clear_flag((*rtp_session), SWITCH_ZRTP_FLAG_SECURE_RECV);
+		}
 
-	if (rtp_session) {
-		switch_mutex_unlock(rtp_session->flag_mutex);
-		rtp_session->ready = 2;
-		rtp_session->rx_host = switch_core_strdup(rtp_session->pool, rx_host);
-		rtp_session->rx_port = rx_port;
-	} else {
-		switch_rtp_release_port(rx_host, rx_port);
+		if ((*rtp_session)->zrtp_session) {
+			zrtp_session_down((*rtp_session)->zrtp_session);
+			(*rtp_session)->zrtp_session = NULL;
+		}
+	}
+#endif
+	if ((*rtp_session)->timer.timer_interface) {
+		switch_core_timer_destroy(&(*rtp_session)->timer);
 	}
 
-	return rtp_session;
-}
+	switch_rtp_release_port((*rtp_session)->rx_host, (*rtp_session)->rx_port);
+	switch_mutex_unlock((*rtp_session)->flag_mutex);
 
-SWITCH_DECLARE(void) switch_rtp_set_telephony_event(switch_rtp_t *rtp_session, switch_payload_t te)
-{
-	if (te > 95) {
-		rtp_session->te = te;
-	}
+	return;
 }
 
-
-SWITCH_DECLARE(void) switch_rtp_set_telephony_recv_event(switch_rtp_t *rtp_session, switch_payload_t te)
+SWITCH_DECLARE(switch_socket_t *) switch_rtp_get_rtp_socket(switch_rtp_t *rtp_session)
 {
-	if (te > 95) {
-		rtp_session->recv_te = te;
-	}
+	return rtp_session->sock_input;
 }
 
-SWITCH_DECLARE(void) switch_rtp_set_recv_pt(switch_rtp_t *rtp_session, switch_payload_t pt)
+SWITCH_DECLARE(uint32_t) switch_rtp_get_default_samples_per_interval(switch_rtp_t *rtp_session)
 {
-	rtp_session->rpayload = pt;
+	return rtp_session->samples_per_interval;
 }
 
-
-SWITCH_DECLARE(void) switch_rtp_set_cng_pt(switch_rtp_t *rtp_session, switch_payload_t pt)
+SWITCH_DECLARE(void) switch_rtp_set_default_payload(switch_rtp_t *rtp_session, switch_payload_t payload)
 {
-	rtp_session->cng_pt = pt;
-	switch_set_flag(rtp_session, SWITCH_RTP_FLAG_AUTO_CNG);
+	rtp_session->payload = payload;
 }
 
-SWITCH_DECLARE(switch_status_t) switch_rtp_activate_stun_ping(switch_rtp_t *rtp_session, const char *stun_ip, switch_port_t stun_port,
-															  uint32_t packet_count, switch_bool_t funny)
+SWITCH_DECLARE(uint32_t) switch_rtp_get_default_payload(switch_rtp_t *rtp_session)
 {
-
-	if (switch_sockaddr_info_get(&rtp_session->remote_stun_addr, stun_ip, SWITCH_UNSPEC,
-								 stun_port, 0, rtp_session->pool) != SWITCH_STATUS_SUCCESS || !rtp_session->remote_stun_addr) {
-
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error resolving stun ping addr\n");
-		return SWITCH_STATUS_FALSE;
-	}
-
-	if (funny) {
-		rtp_session->funny_stun++;
-	}
-
-	rtp_session->stun_port = stun_port;
-
-	rtp_session->default_stuncount = packet_count;
-
-	rtp_session->stun_ip = switch_core_strdup(rtp_session->pool, stun_ip);
-	return SWITCH_STATUS_SUCCESS;
+	return rtp_session->payload;
 }
 
-static void jb_callback(stfu_instance_t *i, void *udata)
+SWITCH_DECLARE(void) switch_rtp_set_invald_handler(switch_rtp_t *rtp_session, switch_rtp_invalid_handler_t on_invalid)
 {
-	switch_core_session_t *session = (switch_core_session_t *) udata;
-	stfu_report_t r = { 0 };
-
-	stfu_n_report(i, &r);
-
-	switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG8, 
-					  "%s JB REPORT:\nlen: %u\nin: %u\nclean: %u\ngood: %u\nbad: %u\n",
-					  switch_core_session_get_name(session),
-					  r.qlen,
-					  r.packet_in_count,
-					  r.clean_count,
-					  r.consecutive_good_count,
-					  r.consecutive_bad_count
-					  );
-
+	rtp_session->invalid_handler = on_invalid;
 }
 
-SWITCH_DECLARE(switch_status_t) switch_rtp_pause_jitter_buffer(switch_rtp_t *rtp_session, switch_bool_t pause)
+SWITCH_DECLARE(void) switch_rtp_set_flag(switch_rtp_t *rtp_session, switch_rtp_flag_t flags)
 {
-	
-	if (!switch_rtp_ready(rtp_session) || !rtp_session->jb) {
-		return SWITCH_STATUS_FALSE;
-	}
-
-	if (!!pause == !!rtp_session->pause_jb) {
-		return SWITCH_STATUS_FALSE;
-	}
-
-	if (rtp_session->pause_jb && !pause) {
-		stfu_n_reset(rtp_session->jb);
+	switch_set_flag_locked(rtp_session, flags);
+	if (flags & SWITCH_RTP_FLAG_AUTOADJ) {
+		rtp_session->autoadj_window = 20;
+		rtp_session->autoadj_tally = 0;
+		rtp_flush_read_buffer(rtp_session, SWITCH_RTP_FLUSH_ONCE);
+	} else if (flags & SWITCH_RTP_FLAG_NOBLOCK) {
+		switch_socket_opt_set(rtp_session->sock_input, SWITCH_SO_NONBLOCK, TRUE);
 	}
 
-	rtp_session->pause_jb = pause ? 1 : 0;
-	
-	return SWITCH_STATUS_SUCCESS;
 }
 
-SWITCH_DECLARE(switch_status_t) switch_rtp_deactivate_jitter_buffer(switch_rtp_t *rtp_session)
+SWITCH_DECLARE(uint32_t) switch_rtp_test_flag(switch_rtp_t *rtp_session, switch_rtp_flag_t flags)
 {
-	
-	if (!switch_rtp_ready(rtp_session) || !rtp_session->jb) {
-		return SWITCH_STATUS_FALSE;
-	}
-
-	READ_INC(rtp_session);
-	stfu_n_destroy(&rtp_session->jb);
-	READ_DEC(rtp_session);
-	
-	return SWITCH_STATUS_SUCCESS;
+	return (uint32_t) switch_test_flag(rtp_session, flags);
 }
 
-static void jb_logger(const char *file, const char *func, int line, int level, const char *fmt, ...)
+SWITCH_DECLARE(void) switch_rtp_clear_flag(switch_rtp_t *rtp_session, switch_rtp_flag_t flags)
 {
-	int ret;
-	char *data;
-	va_list ap;
+	switch_clear_flag_locked(rtp_session, flags);
 
-	va_start(ap, fmt);
-	ret = switch_vasprintf(&data, fmt, ap);
-	if (ret != -1) {
-		switch_log_printf(SWITCH_CHANNEL_LOG_CLEAN, SWITCH_LOG_CONSOLE, "%s", data);
-		free(data);
+	if (flags & SWITCH_RTP_FLAG_NOBLOCK) {
+		switch_socket_opt_set(rtp_session->sock_input, SWITCH_SO_NONBLOCK, FALSE);
 	}
-
-	//switch_log_printf(SWITCH_CHANNEL_ID_LOG_CLEAN, file, func, line, NULL, level, fmt, ap);
-	va_end(ap);
 }
 
-SWITCH_DECLARE(switch_status_t) switch_rtp_debug_jitter_buffer(switch_rtp_t *rtp_session, const char *name)
+static void set_dtmf_delay(switch_rtp_t *rtp_session, uint32_t ms, uint32_t max_ms)
 {
-
-	if (!switch_rtp_ready(rtp_session) || !rtp_session->jb) {
-		return SWITCH_STATUS_FALSE;
-	}
+	int upsamp, max_upsamp;
 	
-	stfu_n_debug(rtp_session->jb, name);
-	stfu_global_set_logger(jb_logger);
+	if (!max_ms) max_ms = ms;
 
-	return SWITCH_STATUS_SUCCESS;
-}
+	upsamp = ms * (rtp_session->samples_per_second / 1000);
+	max_upsamp = max_ms * (rtp_session->samples_per_second / 1000);
 
-SWITCH_DECLARE(switch_status_t) switch_rtp_activate_jitter_buffer(switch_rtp_t *rtp_session, 
-																  uint32_t queue_frames, 
-																  uint32_t max_queue_frames, 
-																  uint32_t samples_per_packet, 
-																  uint32_t samples_per_second,
-																  uint32_t max_drift)
-{
+	rtp_session->queue_delay = upsamp;
 
-	if (!switch_rtp_ready(rtp_session)) {
-		return SWITCH_STATUS_FALSE;
+	if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_USE_TIMER)) {
+		rtp_session->max_next_write_samplecount = rtp_session->timer.samplecount + max_upsamp;
 	}
 
-	if (queue_frames < 1) {
-		queue_frames = 3;
-	}
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Queue digit delay of %dms\n", ms);	
+}
 
-	if (max_queue_frames < queue_frames) {
-		max_queue_frames = queue_frames * 3;
-	}
+static void do_2833_send(switch_rtp_t *rtp_session, switch_core_session_t *session)
+{
+	switch_frame_flag_t flags = 0;
+	uint32_t samples = rtp_session->samples_per_interval;
 
-	READ_INC(rtp_session);
-	if (rtp_session->jb) {
-		stfu_n_resize(rtp_session->jb, queue_frames);
-	} else {
-		rtp_session->jb = stfu_n_init(queue_frames, max_queue_frames ? max_queue_frames : 50, samples_per_packet, samples_per_second, max_drift);
+	if (rtp_session->sending_dtmf > 1) {
+		rtp_session->sending_dtmf--;
+		return;
 	}
-	READ_DEC(rtp_session);
-	
-	if (rtp_session->jb) {
-		switch_core_session_t *session = switch_core_memory_pool_get_data(rtp_session->pool, "__session");
-		stfu_n_call_me(rtp_session->jb, jb_callback, session);
 
-		return SWITCH_STATUS_SUCCESS;
+	if (!rtp_session->last_write_ts) {
+		return;
 	}
+	
+	if (rtp_session->dtmf_data.out_digit_dur > 0) {
+		int x, loops = 1;
 
-	return SWITCH_STATUS_FALSE;
-}
+		rtp_session->dtmf_data.out_digit_sofar += samples;
+		rtp_session->dtmf_data.out_digit_sub_sofar += samples;
 
-SWITCH_DECLARE(switch_status_t) switch_rtp_activate_rtcp(switch_rtp_t *rtp_session, int send_rate, switch_port_t remote_port)
-{
-	const char *err = NULL;
+		if (rtp_session->dtmf_data.out_digit_sub_sofar > 0xFFFF) {
+			rtp_session->dtmf_data.out_digit_sub_sofar = samples;
+			rtp_session->dtmf_data.timestamp_dtmf += 0xFFFF;
+		}
 
-	if (!rtp_session->ms_per_packet) {
-		return SWITCH_STATUS_FALSE;
-	}
-	
-	switch_set_flag(rtp_session, SWITCH_RTP_FLAG_ENABLE_RTCP);
+		if (rtp_session->dtmf_data.out_digit_sofar >= rtp_session->dtmf_data.out_digit_dur) {
+			rtp_session->dtmf_data.out_digit_packet[1] |= 0x80;
+			loops = 3;
+		}
 
-	if (!(rtp_session->remote_rtcp_port = remote_port)) {
-		rtp_session->remote_rtcp_port = rtp_session->remote_port + 1;
-	}
-	
-	if (send_rate == -1) {
-		switch_set_flag(rtp_session, SWITCH_RTP_FLAG_RTCP_PASSTHRU);
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "RTCP passthru enabled. Remote Port: %d\n", rtp_session->remote_rtcp_port);
-	} else {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "RTCP send rate is: %d and packet rate is: %d Remote Port: %d\n", 
-						  send_rate, rtp_session->ms_per_packet, rtp_session->remote_rtcp_port);
-		rtp_session->rtcp_interval = send_rate/(rtp_session->ms_per_packet/1000);
-	}
+		rtp_session->dtmf_data.out_digit_packet[2] = (unsigned char) (rtp_session->dtmf_data.out_digit_sub_sofar >> 8);
+		rtp_session->dtmf_data.out_digit_packet[3] = (unsigned char) rtp_session->dtmf_data.out_digit_sub_sofar;
 
-	return enable_local_rtcp_socket(rtp_session, &err) || enable_remote_rtcp_socket(rtp_session, &err);
+		for (x = 0; x < loops; x++) {
+			switch_size_t wrote = switch_rtp_write_manual(rtp_session,
+														  rtp_session->dtmf_data.out_digit_packet, 4, 0,
+														  rtp_session->te, rtp_session->dtmf_data.timestamp_dtmf, &flags);
 
-}
+			rtp_session->stats.outbound.raw_bytes += wrote;
+			rtp_session->stats.outbound.dtmf_packet_count++;
 
-SWITCH_DECLARE(switch_status_t) switch_rtp_activate_ice(switch_rtp_t *rtp_session, char *login, char *rlogin)
-{
-	char ice_user[80];
-	char user_ice[80];
+			if (loops == 1) {
+				rtp_session->last_write_ts += samples;
 
-	switch_snprintf(ice_user, sizeof(ice_user), "%s%s", login, rlogin);
-	switch_snprintf(user_ice, sizeof(user_ice), "%s%s", rlogin, login);
-	rtp_session->ice_user = switch_core_strdup(rtp_session->pool, ice_user);
-	rtp_session->user_ice = switch_core_strdup(rtp_session->pool, user_ice);
-	rtp_session->default_stuncount = 25;
+				if (rtp_session->rtp_bugs & RTP_BUG_SONUS_SEND_INVALID_TIMESTAMP_2833) {
+					rtp_session->dtmf_data.timestamp_dtmf = rtp_session->last_write_ts;
+				}
+			}
 
-	if (rtp_session->ice_user) {
-		if (ice_out(rtp_session) != SWITCH_STATUS_SUCCESS) {
-			return SWITCH_STATUS_FALSE;
+			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Send %s packet for [%c] ts=%u dur=%d/%d/%d seq=%d lw=%d\n",
+							  loops == 1 ? "middle" : "end", rtp_session->dtmf_data.out_digit,
+							  rtp_session->dtmf_data.timestamp_dtmf,
+							  rtp_session->dtmf_data.out_digit_sofar,
+							  rtp_session->dtmf_data.out_digit_sub_sofar, rtp_session->dtmf_data.out_digit_dur, rtp_session->seq, rtp_session->last_write_ts);
 		}
-	}
 
-	return SWITCH_STATUS_SUCCESS;
-}
+		if (loops != 1) {
+			rtp_session->sending_dtmf = 0;
+			rtp_session->need_mark = 1;
+			
+			if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_USE_TIMER)) {
+				rtp_session->last_write_samplecount = rtp_session->timer.samplecount;
+			}
 
-SWITCH_DECLARE(void) switch_rtp_break(switch_rtp_t *rtp_session)
-{
-	if (!switch_rtp_ready(rtp_session)) {
-		return;
+			rtp_session->dtmf_data.out_digit_dur = 0;
+			set_dtmf_delay(rtp_session, 40, 500);
+			return;
+		}
 	}
 
-	switch_mutex_lock(rtp_session->flag_mutex);
-	switch_set_flag(rtp_session, SWITCH_RTP_FLAG_BREAK);
-	switch_set_flag(rtp_session, SWITCH_RTP_FLAG_FLUSH);
+	if (!rtp_session->dtmf_data.out_digit_dur && rtp_session->dtmf_data.dtmf_queue && switch_queue_size(rtp_session->dtmf_data.dtmf_queue)) {
+		void *pop;
 
-	if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_NOBLOCK)) {
-		switch_mutex_unlock(rtp_session->flag_mutex);
-		return;
-	}
+		if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_USE_TIMER)) {
+			if (rtp_session->timer.samplecount < rtp_session->max_next_write_samplecount) {
+				return;
+			}
 
-	if (rtp_session->sock_input) {
-		ping_socket(rtp_session);
-	}
-	switch_mutex_unlock(rtp_session->flag_mutex);
-}
+			if (rtp_session->timer.samplecount >= rtp_session->max_next_write_samplecount) {
+				rtp_session->queue_delay = 0;
+			}
 
-SWITCH_DECLARE(void) switch_rtp_kill_socket(switch_rtp_t *rtp_session)
-{
-	switch_assert(rtp_session != NULL);
-	switch_mutex_lock(rtp_session->flag_mutex);
-	if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_IO)) {
-		switch_clear_flag(rtp_session, SWITCH_RTP_FLAG_IO);
-		if (rtp_session->sock_input) {
-			ping_socket(rtp_session);
-			switch_socket_shutdown(rtp_session->sock_input, SWITCH_SHUTDOWN_READWRITE);
-		}
-		if (rtp_session->sock_output && rtp_session->sock_output != rtp_session->sock_input) {
-			switch_socket_shutdown(rtp_session->sock_output, SWITCH_SHUTDOWN_READWRITE);
-		}
-		
-		if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_ENABLE_RTCP)) {
-			if (rtp_session->rtcp_sock_input) {
-				ping_socket(rtp_session);
-				switch_socket_shutdown(rtp_session->rtcp_sock_input, SWITCH_SHUTDOWN_READWRITE);
+		} else if (rtp_session->queue_delay) {
+			if (rtp_session->delay_samples >= rtp_session->samples_per_interval) {
+				rtp_session->delay_samples -= rtp_session->samples_per_interval;
+			} else {
+				rtp_session->delay_samples = 0;
 			}
-			if (rtp_session->rtcp_sock_output && rtp_session->rtcp_sock_output != rtp_session->rtcp_sock_input) {
-				switch_socket_shutdown(rtp_session->rtcp_sock_output, SWITCH_SHUTDOWN_READWRITE);
+
+			if (!rtp_session->delay_samples) {
+				rtp_session->queue_delay = 0;
 			}
 		}
-	}
-	switch_mutex_unlock(rtp_session->flag_mutex);
-}
-
-SWITCH_DECLARE(uint8_t) switch_rtp_ready(switch_rtp_t *rtp_session)
-{
-	uint8_t ret;
-
-	if (!rtp_session || !rtp_session->flag_mutex || switch_test_flag(rtp_session, SWITCH_RTP_FLAG_SHUTDOWN)) {
-		return 0;
-	}
-
-	switch_mutex_lock(rtp_session->flag_mutex);
-	ret = (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_IO) && rtp_session->sock_input && rtp_session->sock_output && rtp_session->remote_addr
-		   && rtp_session->ready == 2) ? 1 : 0;
-	switch_mutex_unlock(rtp_session->flag_mutex);
+		
+		if (rtp_session->queue_delay) {
+			return;
+		}
 
-	return ret;
-}
 
-SWITCH_DECLARE(void) switch_rtp_destroy(switch_rtp_t **rtp_session)
-{
-	void *pop;
-	switch_socket_t *sock;
+		if (!rtp_session->sending_dtmf) {
+			rtp_session->sending_dtmf = 2;
+			return;
+		}
 
-	if (!rtp_session || !*rtp_session || !(*rtp_session)->ready) {
-		return;
-	}
+		if (switch_queue_trypop(rtp_session->dtmf_data.dtmf_queue, &pop) == SWITCH_STATUS_SUCCESS) {
+			switch_dtmf_t *rdigit = pop;
+			switch_size_t wrote;
 
-	switch_set_flag_locked((*rtp_session), SWITCH_RTP_FLAG_SHUTDOWN);
+			if (rdigit->digit == 'w') {
+				set_dtmf_delay(rtp_session, 500, 0);
+				free(rdigit);
+				return;
+			}
 
-	READ_INC((*rtp_session));
-	WRITE_INC((*rtp_session));
+			if (rdigit->digit == 'W') {
+				set_dtmf_delay(rtp_session, 1000, 0);
+				free(rdigit);
+				return;
+			}
+			
 
-	(*rtp_session)->ready = 0;
+			
+			memset(rtp_session->dtmf_data.out_digit_packet, 0, 4);
+			rtp_session->dtmf_data.out_digit_sofar = samples;
+			rtp_session->dtmf_data.out_digit_sub_sofar = samples;
+			rtp_session->dtmf_data.out_digit_dur = rdigit->duration;
+			rtp_session->dtmf_data.out_digit = rdigit->digit;
+			rtp_session->dtmf_data.out_digit_packet[0] = (unsigned char) switch_char_to_rfc2833(rdigit->digit);
+			rtp_session->dtmf_data.out_digit_packet[1] = 7;
+			rtp_session->dtmf_data.out_digit_packet[2] = (unsigned char) (rtp_session->dtmf_data.out_digit_sub_sofar >> 8);
+			rtp_session->dtmf_data.out_digit_packet[3] = (unsigned char) rtp_session->dtmf_data.out_digit_sub_sofar;
 
-	READ_DEC((*rtp_session));
-	WRITE_DEC((*rtp_session));
 
-	switch_mutex_lock((*rtp_session)->flag_mutex);
+			rtp_session->dtmf_data.timestamp_dtmf = rtp_session->last_write_ts + samples;
+			rtp_session->last_write_ts = rtp_session->dtmf_data.timestamp_dtmf;
+			
+			wrote = switch_rtp_write_manual(rtp_session,
+											rtp_session->dtmf_data.out_digit_packet,
+											4,
+											rtp_session->rtp_bugs & RTP_BUG_CISCO_SKIP_MARK_BIT_2833 ? 0 : 1,
+											rtp_session->te, rtp_session->dtmf_data.timestamp_dtmf, &flags);
 
-	switch_rtp_kill_socket(*rtp_session);
+			
+			rtp_session->stats.outbound.raw_bytes += wrote;
+			rtp_session->stats.outbound.dtmf_packet_count++;
+			
+			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Send start packet for [%c] ts=%u dur=%d/%d/%d seq=%d lw=%d\n",
+							  rtp_session->dtmf_data.out_digit,
+							  rtp_session->dtmf_data.timestamp_dtmf,
+							  rtp_session->dtmf_data.out_digit_sofar,
+							  rtp_session->dtmf_data.out_digit_sub_sofar, rtp_session->dtmf_data.out_digit_dur, rtp_session->seq, rtp_session->last_write_ts);
 
-	while (switch_queue_trypop((*rtp_session)->dtmf_data.dtmf_inqueue, &pop) == SWITCH_STATUS_SUCCESS) {
-		switch_safe_free(pop);
+			free(rdigit);
+		}
 	}
+}
 
-	while (switch_queue_trypop((*rtp_session)->dtmf_data.dtmf_queue, &pop) == SWITCH_STATUS_SUCCESS) {
-		switch_safe_free(pop);
-	}
+static void do_2833(switch_rtp_t *rtp_session, switch_core_session_t *session)
+{
+	switch_time_t lat_start = 0;
+	int active = rtp_session->dtmf_data.out_digit_dur > 0 || switch_queue_size(rtp_session->dtmf_data.dtmf_queue);
 
-	if ((*rtp_session)->jb) {
-		stfu_n_destroy(&(*rtp_session)->jb);
+	/* only time the passes that actually have a digit to send */
+	if (active) {
+		RTP_LAT_MARK(lat_start);
 	}
 
-	sock = (*rtp_session)->sock_input;
-	(*rtp_session)->sock_input = NULL;
-	switch_socket_close(sock);
+	do_2833_send(rtp_session, session);
 
-	if ((*rtp_session)->sock_output != sock) {
-		sock = (*rtp_session)->sock_output;
-		(*rtp_session)->sock_output = NULL;
-		switch_socket_close(sock);
+	if (active) {
+		RTP_LAT_ADD(rtp_session, SWITCH_RTP_LAT_DTMF, lat_start);
 	}
+}
 
-	if ((sock = (*rtp_session)->rtcp_sock_input)) {
-		(*rtp_session)->rtcp_sock_input = NULL;
-		switch_socket_close(sock);
+SWITCH_DECLARE(void) rtp_flush_read_buffer(switch_rtp_t *rtp_session, switch_rtp_flush_t flush)
+{
 
-		if ((*rtp_session)->rtcp_sock_output && (*rtp_session)->rtcp_sock_output != sock) {
-			if ((sock = (*rtp_session)->rtcp_sock_output)) {
-				(*rtp_session)->rtcp_sock_output = NULL;
-				switch_socket_close(sock);
+	if (switch_rtp_ready(rtp_session)) {
+		rtp_session->last_write_ts = RTP_TS_RESET;
+	
+		if (!switch_test_flag(rtp_session, SWITCH_RTP_FLAG_PROXY_MEDIA) && 
+			!switch_test_flag(rtp_session, SWITCH_RTP_FLAG_VIDEO)) {
+			switch_set_flag_locked(rtp_session, SWITCH_RTP_FLAG_FLUSH);
+			switch (flush) {
+			case SWITCH_RTP_FLUSH_STICK:
+				switch_set_flag_locked(rtp_session, SWITCH_RTP_FLAG_STICKY_FLUSH);
+				break;
+			case SWITCH_RTP_FLUSH_UNSTICK:
+				switch_clear_flag_locked(rtp_session, SWITCH_RTP_FLAG_STICKY_FLUSH);
+				break;
+			default:
+				break;
 			}
 		}
 	}
+}
 
-	if (switch_test_flag((*rtp_session), SWITCH_RTP_FLAG_VAD)) {
-		switch_rtp_disable_vad(*rtp_session);
-	}
+static void do_flush(switch_rtp_t *rtp_session)
+{
+	int was_blocking = 0;
+	switch_size_t bytes;
 
-#ifdef ENABLE_SRTP
-	if (switch_test_flag((*rtp_session), SWITCH_RTP_FLAG_SECURE_SEND)) {
-		srtp_dealloc((*rtp_session)->send_ctx);
-		(*rtp_session)->send_ctx = NULL;
-		switch_clear_flag((*rtp_session), SWITCH_RTP_FLAG_SECURE_SEND);
+	if (!switch_rtp_ready(rtp_session) || 
+		switch_test_flag(rtp_session, SWITCH_RTP_FLAG_PROXY_MEDIA) || 
+		switch_test_flag(rtp_session, SWITCH_RTP_FLAG_VIDEO) 
+		) {
+		return;
 	}
 
-	if (switch_test_flag((*rtp_session), SWITCH_RTP_FLAG_SECURE_RECV)) {
-		srtp_dealloc((*rtp_session)->recv_ctx);
-		(*rtp_session)->recv_ctx = NULL;
-		switch_clear_flag((*rtp_session), SWITCH_RTP_FLAG_SECURE_RECV);
-	}
-#endif
+	READ_INC(rtp_session);
+
+	if (switch_rtp_ready(rtp_session)) {
+		uint32_t flushed = 0;
+		
+		if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_DEBUG_RTP_READ)) {
+			switch_core_session_t *session = switch_core_memory_pool_get_data(rtp_session->pool, "__session");
+			if (!session) {
+				switch_clear_flag(rtp_session, SWITCH_RTP_FLAG_DEBUG_RTP_READ);
+				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "RTP HAS NO SESSION!\n");
+			} else {
+				switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session),
+								  SWITCH_LOG_CONSOLE, "%s FLUSH\n", switch_channel_get_name(switch_core_session_get_channel(session))
+								  );
+			}
+		}
+
+		if (!switch_test_flag(rtp_session, SWITCH_RTP_FLAG_NOBLOCK)) {
+			was_blocking = 1;
+			switch_set_flag_locked(rtp_session, SWITCH_RTP_FLAG_NOBLOCK);
+			switch_socket_opt_set(rtp_session->sock_input, SWITCH_SO_NONBLOCK, TRUE);
+		}
+
+		do {
+			if (switch_rtp_ready(rtp_session)) {
+				bytes = sizeof(rtp_msg_t);
+				switch_socket_recvfrom(rtp_session->from_addr, rtp_session->sock_input, 0, (void *) &rtp_session->recv_msg, &bytes);
+				if (bytes) {
+					int do_cng = 0;
 
-#ifdef ENABLE_ZRTP
-	/* ZRTP */
-	if (zrtp_on && !switch_test_flag((*rtp_session), SWITCH_RTP_FLAG_PROXY_MEDIA)) {
+					/* Make sure to handle RFC2833 packets, even if we're flushing the packets */
+					if (bytes > rtp_header_len && rtp_session->recv_te && rtp_session->recv_msg.header.pt == rtp_session->recv_te) {
+						handle_rfc2833(rtp_session, bytes, &do_cng);
+#ifdef DEBUG_2833
+						switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "*** RTP packet handled in flush loop %d ***\n", do_cng);
+#endif
+					}
 
-		if ((*rtp_session)->zrtp_stream != NULL) {
-			zrtp_stream_stop((*rtp_session)->zrtp_stream);
-		}
+					flushed++;
 
-		if (switch_test_flag((*rtp_session), SWITCH_ZRTP_FLAG_SECURE_SEND)) {
-			switch_clear_flag((*rtp_session), SWITCH_ZRTP_FLAG_SECURE_SEND);
-		}
+					rtp_session->stats.inbound.raw_bytes += bytes;
+					rtp_session->stats.inbound.flush_packet_count++;
+					rtp_session->stats.inbound.packet_count++;
+				}
+			} else {
+				break;
+			}
+		} while (bytes > 0);
 
-		if (switch_test_flag((*rtp_session), SWITCH_ZRTP_FLAG_SECURE_RECV)) {
-			switch_clear_flag((*rtp_session), SWITCH_ZRTP_FLAG_SECURE_RECV);
+		if (rtp_session->jb && flushed) {
+			stfu_n_sync(rtp_session->jb, flushed);
 		}
 
-		if ((*rtp_session)->zrtp_session) {
-			zrtp_session_down((*rtp_session)->zrtp_session);
-			(*rtp_session)->zrtp_session = NULL;
+		if (was_blocking && switch_rtp_ready(rtp_session)) {
+			switch_clear_flag_locked(rtp_session, SWITCH_RTP_FLAG_NOBLOCK);
+			switch_socket_opt_set(rtp_session->sock_input, SWITCH_SO_NONBLOCK, FALSE);
 		}
 	}
-#endif
-	if ((*rtp_session)->timer.timer_interface) {
-		switch_core_timer_destroy(&(*rtp_session)->timer);
-	}
 
-	switch_rtp_release_port((*rtp_session)->rx_host, (*rtp_session)->rx_port);
-	switch_mutex_unlock((*rtp_session)->flag_mutex);
+	READ_DEC(rtp_session);
+}
 
-	return;
+static inline uint32_t rtp_quality_get32(const uint8_t *p)
+{
+	return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | p[3];
 }
 
-SWITCH_DECLARE(switch_socket_t *) switch_rtp_get_rtp_socket(switch_rtp_t *rtp_session)
+static inline void rtp_quality_put32(uint8_t *p, uint32_t v)
 {
-	return rtp_session->sock_input;
+	p[0] = (uint8_t) (v >> 24);
+	p[1] = (uint8_t) (v >> 16);
+	p[2] = (uint8_t) (v >> 8);
+	p[3] = (uint8_t) v;
 }
 
-SWITCH_DECLARE(uint32_t) switch_rtp_get_default_samples_per_interval(switch_rtp_t *rtp_session)
+static inline void rtp_quality_put16(uint8_t *p, uint32_t v)
 {
-	return rtp_session->samples_per_interval;
+	if (v > 0xffff) {
+		v = 0xffff;
+	}
+	p[0] = (uint8_t) (v >> 8);
+	p[1] = (uint8_t) v;
 }
 
-SWITCH_DECLARE(void) switch_rtp_set_default_payload(switch_rtp_t *rtp_session, switch_payload_t payload)
+static inline uint8_t rtp_quality_scale256(double pct)
 {
-	rtp_session->payload = payload;
+	double v = pct * 256 / 100;
+
+	return (uint8_t) (v > 255 ? 255 : v);
 }
 
-SWITCH_DECLARE(uint32_t) switch_rtp_get_default_payload(switch_rtp_t *rtp_session)
+/* middle 32 bits of the NTP timestamp as used in LSR, in 1/65536 seconds */
+static inline uint32_t rtp_quality_ntp_middle(switch_time_t now)
 {
-	return rtp_session->payload;
+	uint32_t sec = (uint32_t) (now / 1000000 + 2208988800UL);
+	uint32_t frac = (uint32_t) (((now % 1000000) << 16) / 1000000);
+
+	return (sec << 16) | frac;
 }
 
-SWITCH_DECLARE(void) switch_rtp_set_invald_handler(switch_rtp_t *rtp_session, switch_rtp_invalid_handler_t on_invalid)
+/* 1ms bins up to 32ms then 8ms bins up to 280ms */
+static inline uint32_t rtp_quality_jitter_bin(uint32_t ms)
 {
-	rtp_session->invalid_handler = on_invalid;
+	if (ms < 32) {
+		return ms;
+	}
+
+	ms = 32 + (ms - 32) / 8;
+
+	return ms < RTP_QUALITY_JITTER_BINS ? ms : RTP_QUALITY_JITTER_BINS - 1;
 }
 
-SWITCH_DECLARE(void) switch_rtp_set_flag(switch_rtp_t *rtp_session, switch_rtp_flag_t flags)
+static uint32_t rtp_quality_percentile(struct switch_rtp_quality_data *q, uint32_t pct)
 {
-	switch_set_flag_locked(rtp_session, flags);
-	if (flags & SWITCH_RTP_FLAG_AUTOADJ) {
-		rtp_session->autoadj_window = 20;
-		rtp_session->autoadj_tally = 0;
-		rtp_flush_read_buffer(rtp_session, SWITCH_RTP_FLUSH_ONCE);
-	} else if (flags & SWITCH_RTP_FLAG_NOBLOCK) {
-		switch_socket_opt_set(rtp_session->sock_input, SWITCH_SO_NONBLOCK, TRUE);
+	uint32_t want, sum = 0, bin;
+
+	if (!q->jitter_samples) {
+		return 0;
 	}
 
+	want = (uint32_t) (((uint64_t) q->jitter_samples * pct + 99) / 100);
+
+	for (bin = 0; bin < RTP_QUALITY_JITTER_BINS; bin++) {
+		if ((sum += q->jitter_hist[bin]) >= want) {
+			break;
+		}
+	}
+
+	return bin < 32 ? bin : 32 + (bin - 32) * 8 + 7;
 }
 
-SWITCH_DECLARE(uint32_t) switch_rtp_test_flag(switch_rtp_t *rtp_session, switch_rtp_flag_t flags)
+static inline void rtp_quality_receipt(struct switch_rtp_quality_data *q)
 {
-	return (uint32_t) switch_test_flag(rtp_session, flags);
+	q->pkt++;
+
+	if (q->last_lost) {
+		q->lr++;
+	} else {
+		q->rr++;
+	}
+	q->last_lost = 0;
 }
 
-SWITCH_DECLARE(void) switch_rtp_clear_flag(switch_rtp_t *rtp_session, switch_rtp_flag_t flags)
+/* RFC 3611 A.2, a gap ends once Gmin packets in a row were received, count lost packets in a row are folded in at once */
+static void rtp_quality_loss(struct switch_rtp_quality_data *q, uint32_t count)
 {
-	switch_clear_flag_locked(rtp_session, flags);
+	if (q->pkt >= RTP_QUALITY_GMIN) {
+		if (q->lost == 1) {
+			q->c14++;
+		} else {
+			q->c13++;
+		}
+		q->lost = 1;
+		q->c11 += q->pkt;
+	} else {
+		q->lost++;
+		if (q->pkt == 0) {
+			q->c33++;
+		} else {
+			q->c23++;
+			q->c22 += q->pkt - 1;
+		}
+	}
+	q->pkt = 0;
 
-	if (flags & SWITCH_RTP_FLAG_NOBLOCK) {
-		switch_socket_opt_set(rtp_session->sock_input, SWITCH_SO_NONBLOCK, FALSE);
+	if (count > 1) {
+		q->lost += count - 1;
+		q->c33 += count - 1;
 	}
+
+	if (q->last_lost) {
+		q->ll += count;
+	} else {
+		q->rl++;
+		q->ll += count - 1;
+	}
+	q->last_lost = 1;
 }
 
-static void set_dtmf_delay(switch_rtp_t *rtp_session, uint32_t ms, uint32_t max_ms)
+static void rtp_quality_transit(switch_rtp_t *rtp_session, struct switch_rtp_quality_data *q, uint32_t ts, switch_time_t now, int reset)
 {
-	int upsamp, max_upsamp;
-	
-	if (!max_ms) max_ms = ms;
+	uint32_t rate = rtp_session->samples_per_second ? rtp_session->samples_per_second : 8000;
+	uint32_t arrival = (uint32_t) ((now / 1000000) * rate + ((now % 1000000) * rate) / 1000000);
+	uint32_t transit = arrival - ts;
 
-	upsamp = ms * (rtp_session->samples_per_second / 1000);
-	max_upsamp = max_ms * (rtp_session->samples_per_second / 1000);
+	if (!reset) {
+		int32_t d = (int32_t) (transit - q->last_transit);
 
-	rtp_session->queue_delay = upsamp;
+		if (d < 0) {
+			d = -d;
+		}
 
-	if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_USE_TIMER)) {
-		rtp_session->max_next_write_samplecount = rtp_session->timer.samplecount + max_upsamp;
+		q->jitter_q4 += (uint32_t) d - ((q->jitter_q4 + 8) >> 4);
+		q->jitter_hist[rtp_quality_jitter_bin((uint32_t) (((uint64_t) d * 1000) / rate))]++;
+		q->jitter_samples++;
 	}
 
-	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Queue digit delay of %dms\n", ms);	
+	q->last_transit = transit;
 }
 
-static void do_2833(switch_rtp_t *rtp_session, switch_core_session_t *session)
+static void rtp_quality_refresh_jb(switch_rtp_t *rtp_session)
 {
-	switch_frame_flag_t flags = 0;
-	uint32_t samples = rtp_session->samples_per_interval;
+	stfu_report_t r = { 0 };
+	uint32_t ptime = rtp_session->ms_per_packet / 1000;
 
-	if (rtp_session->sending_dtmf > 1) {
-		rtp_session->sending_dtmf--;
+	if (!rtp_session->jb) {
 		return;
 	}
 
-	if (!rtp_session->last_write_ts) {
-		return;
-	}
-	
-	if (rtp_session->dtmf_data.out_digit_dur > 0) {
-		int x, loops = 1;
+	stfu_n_report(rtp_session->jb, &r);
+	rtp_session->stats.inbound.largest_jb_size = stfu_n_get_most_qlen(rtp_session->jb);
+	rtp_session->stats.inbound.jb_plc_packet_count = r.plc_count;
+	rtp_session->stats.inbound.jb_late_packet_count = r.late_count;
+	rtp_session->stats.inbound.jb_discard_packet_count = r.discard_count;
 
-		rtp_session->dtmf_data.out_digit_sofar += samples;
-		rtp_session->dtmf_data.out_digit_sub_sofar += samples;
+	rtp_session->quality.jb_nominal_ms = r.qlen * ptime;
+	rtp_session->quality.jb_max_ms = (uint32_t) rtp_session->stats.inbound.largest_jb_size * ptime;
+}
 
-		if (rtp_session->dtmf_data.out_digit_sub_sofar > 0xFFFF) {
-			rtp_session->dtmf_data.out_digit_sub_sofar = samples;
-			rtp_session->dtmf_data.timestamp_dtmf += 0xFFFF;
-		}
+/* codec impairment and packet loss robustness from ITU-T G.113 Appendix I, dynamic payloads get the G.711 values */
+static void rtp_quality_codec_impairment(switch_payload_t pt, double *ie, double *bpl)
+{
+	switch (pt) {
+	case 3:
+		*ie = 20;
+		*bpl = 10;
+		break;
+	case 4:
+		*ie = 15;
+		*bpl = 16.1;
+		break;
+	case 18:
+		*ie = 11;
+		*bpl = 19;
+		break;
+	default:
+		*ie = 0;
+		*bpl = 25.1;
+		break;
+	}
+}
 
-		if (rtp_session->dtmf_data.out_digit_sofar >= rtp_session->dtmf_data.out_digit_dur) {
-			rtp_session->dtmf_data.out_digit_packet[1] |= 0x80;
-			loops = 3;
-		}
+static double rtp_quality_r_to_mos(double r)
+{
+	if (r <= 0) {
+		return 1;
+	}
 
-		rtp_session->dtmf_data.out_digit_packet[2] = (unsigned char) (rtp_session->dtmf_data.out_digit_sub_sofar >> 8);
-		rtp_session->dtmf_data.out_digit_packet[3] = (unsigned char) rtp_session->dtmf_data.out_digit_sub_sofar;
+	if (r >= 100) {
+		return 4.5;
+	}
 
-		for (x = 0; x < loops; x++) {
-			switch_size_t wrote = switch_rtp_write_manual(rtp_session,
-														  rtp_session->dtmf_data.out_digit_packet, 4, 0,
-														  rtp_session->te, rtp_session->dtmf_data.timestamp_dtmf, &flags);
+	return 1 + 0.035 * r + r * (r - 60) * (100 - r) * 7.0e-6;
+}
 
-			rtp_session->stats.outbound.raw_bytes += wrote;
-			rtp_session->stats.outbound.dtmf_packet_count++;
+static void rtp_quality_calc(switch_rtp_t *rtp_session, switch_rtp_quality_t *out)
+{
+	struct switch_rtp_quality_data *q = &rtp_session->quality;
+	uint32_t ptime = rtp_session->ms_per_packet ? rtp_session->ms_per_packet / 1000 : 20;
+	uint32_t rate = rtp_session->samples_per_second ? rtp_session->samples_per_second : 8000;
+	uint32_t lost = q->expected > q->received ? q->expected - q->received : 0;
+	switch_size_t discarded = rtp_session->stats.inbound.jb_late_packet_count + rtp_session->stats.inbound.jb_discard_packet_count;
+	double c11 = q->c11 + q->pkt, c13 = q->c13, c14 = q->c14, c22 = q->c22, c23 = q->c23, c33 = q->c33;
+	double c31 = c13, c32 = c23, ctotal, p23, p32, p, pq, ppl, ie, bpl, ie_eff, delay, id;
+
+	memset(out, 0, sizeof(*out));
+
+	out->expected_packet_count = q->expected;
+	out->lost_packet_count = lost;
+
+	if (q->expected) {
+		out->loss_rate = (double) lost * 100 / q->expected;
+		out->discard_rate = (double) discarded * 100 / q->expected;
+		if (out->discard_rate > 100) {
+			out->discard_rate = 100;
+		}
+	}
+
+	/* RFC 3611 A.2 */
+	if (c13 + c14 + c23 + c33 > 0) {
+		ctotal = c11 + c14 + c13 + c22 + c23 + c31 + c32 + c33;
+		p32 = (c31 + c32 + c33) > 0 ? c32 / (c31 + c32 + c33) : 0;
+		p23 = (c22 + c23) < 1 ? 1 : 1 - c22 / (c22 + c23);
+		out->burst_density = (p23 + p32) > 0 ? 100 * p23 / (p23 + p32) : 0;
+		out->gap_density = (c11 + c14) > 0 ? 100 * c14 / (c11 + c14) : 0;
+		if (c13 > 0) {
+			out->gap_duration = (uint32_t) ((c11 + c14 + c13) * ptime / c13);
+			out->burst_duration = (uint32_t) (ctotal * ptime / c13) - out->gap_duration;
+		} else {
+			out->gap_duration = (uint32_t) ((c11 + c14) * ptime);
+		}
+	} else {
+		out->gap_duration = (uint32_t) (c11 * ptime);
+	}
 
-			if (loops == 1) {
-				rtp_session->last_write_ts += samples;
+	p = (q->rr + q->rl) ? (double) q->rl / (q->rr + q->rl) : 0;
+	pq = (q->lr + q->ll) ? (double) q->lr / (q->lr + q->ll) : 0;
+	out->burst_ratio = (p + pq) > 0 ? 1 / (p + pq) : 1;
 
-				if (rtp_session->rtp_bugs & RTP_BUG_SONUS_SEND_INVALID_TIMESTAMP_2833) {
-					rtp_session->dtmf_data.timestamp_dtmf = rtp_session->last_write_ts;
-				}
-			}
+	out->jitter = (double) (q->jitter_q4 >> 4) * 1000 / rate;
+	out->jitter_p50 = rtp_quality_percentile(q, 50);
+	out->jitter_p95 = rtp_quality_percentile(q, 95);
+	out->jitter_p99 = rtp_quality_percentile(q, 99);
+	out->round_trip_delay = q->rtt_ms;
 
-			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Send %s packet for [%c] ts=%u dur=%d/%d/%d seq=%d lw=%d\n",
-							  loops == 1 ? "middle" : "end", rtp_session->dtmf_data.out_digit,
-							  rtp_session->dtmf_data.timestamp_dtmf,
-							  rtp_session->dtmf_data.out_digit_sofar,
-							  rtp_session->dtmf_data.out_digit_sub_sofar, rtp_session->dtmf_data.out_digit_dur, rtp_session->seq, rtp_session->last_write_ts);
-		}
+	/* E-model: R = 93.2 - Id - Ie,eff with the one way delay taken as half the RTT plus packetization and dejittering */
+	rtp_quality_codec_impairment(rtp_session->rpayload, &ie, &bpl);
+	ppl = out->loss_rate + out->discard_rate;
+	ie_eff = ie + (95 - ie) * ppl / (ppl / out->burst_ratio + bpl);
+	delay = q->rtt_ms / 2 + ptime + (q->jb_nominal_ms ? q->jb_nominal_ms : out->jitter_p95);
+	id = 0.024 * delay + (delay > 177.3 ? 0.11 * (delay - 177.3) : 0);
 
-		if (loops != 1) {
-			rtp_session->sending_dtmf = 0;
-			rtp_session->need_mark = 1;
-			
-			if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_USE_TIMER)) {
-				rtp_session->last_write_samplecount = rtp_session->timer.samplecount;
-			}
+	out->r_factor = 93.2 - id - ie_eff;
+	if (out->r_factor < 0) {
+		out->r_factor = 0;
+	}
+	out->mos = rtp_quality_r_to_mos(out->r_factor);
+	out->mos_lq = rtp_quality_r_to_mos(93.2 - ie_eff);
 
-			rtp_session->dtmf_data.out_digit_dur = 0;
-			set_dtmf_delay(rtp_session, 40, 500);
-			return;
-		}
+	out->remote_loss_rate = (double) q->remote_fraction_lost * 100 / 256;
+	out->remote_jitter = (double) q->remote_jitter * 1000 / rate;
+	if (q->remote_xr) {
+		out->remote_mos = q->remote_mos_lq == 127 ? 0 : (double) q->remote_mos_lq / 10;
+		out->remote_r_factor = q->remote_r_factor == 127 ? 0 : q->remote_r_factor;
 	}
+}
 
-	if (!rtp_session->dtmf_data.out_digit_dur && rtp_session->dtmf_data.dtmf_queue && switch_queue_size(rtp_session->dtmf_data.dtmf_queue)) {
-		void *pop;
+static void rtp_quality_add_headers(switch_event_t *event, switch_rtp_quality_t *quality)
+{
+	switch_event_add_header(event, SWITCH_STACK_BOTTOM, "RTP-Quality-MOS", "%0.2f", quality->mos);
+	switch_event_add_header(event, SWITCH_STACK_BOTTOM, "RTP-Quality-MOS-LQ", "%0.2f", quality->mos_lq);
+	switch_event_add_header(event, SWITCH_STACK_BOTTOM, "RTP-Quality-R-Factor", "%0.1f", quality->r_factor);
+	switch_event_add_header(event, SWITCH_STACK_BOTTOM, "RTP-Quality-Loss-Rate", "%0.2f", quality->loss_rate);
+	switch_event_add_header(event, SWITCH_STACK_BOTTOM, "RTP-Quality-Discard-Rate", "%0.2f", quality->discard_rate);
+	switch_event_add_header(event, SWITCH_STACK_BOTTOM, "RTP-Quality-Burst-Density", "%0.2f", quality->burst_density);
+	switch_event_add_header(event, SWITCH_STACK_BOTTOM, "RTP-Quality-Gap-Density", "%0.2f", quality->gap_density);
+	switch_event_add_header(event, SWITCH_STACK_BOTTOM, "RTP-Quality-Burst-Duration", "%u", quality->burst_duration);
+	switch_event_add_header(event, SWITCH_STACK_BOTTOM, "RTP-Quality-Gap-Duration", "%u", quality->gap_duration);
+	switch_event_add_header(event, SWITCH_STACK_BOTTOM, "RTP-Quality-Burst-Ratio", "%0.2f", quality->burst_ratio);
+	switch_event_add_header(event, SWITCH_STACK_BOTTOM, "RTP-Quality-Expected-Packets", "%u", quality->expected_packet_count);
+	switch_event_add_header(event, SWITCH_STACK_BOTTOM, "RTP-Quality-Lost-Packets", "%u", quality->lost_packet_count);
+	switch_event_add_header(event, SWITCH_STACK_BOTTOM, "RTP-Quality-Jitter", "%0.2f", quality->jitter);
+	switch_event_add_header(event, SWITCH_STACK_BOTTOM, "RTP-Quality-Jitter-P50", "%u", quality->jitter_p50);
+	switch_event_add_header(event, SWITCH_STACK_BOTTOM, "RTP-Quality-Jitter-P95", "%u", quality->jitter_p95);
+	switch_event_add_header(event, SWITCH_STACK_BOTTOM, "RTP-Quality-Jitter-P99", "%u", quality->jitter_p99);
+	switch_event_add_header(event, SWITCH_STACK_BOTTOM, "RTP-Quality-Round-Trip-Delay", "%u", quality->round_trip_delay);
+	switch_event_add_header(event, SWITCH_STACK_BOTTOM, "RTP-Quality-Remote-Loss-Rate", "%0.2f", quality->remote_loss_rate);
+	switch_event_add_header(event, SWITCH_STACK_BOTTOM, "RTP-Quality-Remote-Jitter", "%0.2f", quality->remote_jitter);
+	switch_event_add_header(event, SWITCH_STACK_BOTTOM, "RTP-Quality-Remote-MOS", "%0.2f", quality->remote_mos);
+	switch_event_add_header(event, SWITCH_STACK_BOTTOM, "RTP-Quality-Remote-R-Factor", "%u", quality->remote_r_factor);
+}
 
-		if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_USE_TIMER)) {
-			if (rtp_session->timer.samplecount < rtp_session->max_next_write_samplecount) {
-				return;
-			}
+#ifdef RTP_LATENCY_STATS
+static const char *RTP_LATENCY_HEADER_NAMES[] = {
+	"Socket-Wait",
+	"Jitter-Buffer",
+	"SRTP-Unprotect",
+	"DTMF",
+	"Timer-Slip",
+	"SRTP-Protect",
+	"Send",
+	"Write"
+};
 
-			if (rtp_session->timer.samplecount >= rtp_session->max_next_write_samplecount) {
-				rtp_session->queue_delay = 0;
-			}
+static void rtp_latency_add_headers(switch_event_t *event, switch_rtp_latency_t *latency)
+{
+	char name[80];
+	int x;
 
-		} else if (rtp_session->queue_delay) {
-			if (rtp_session->delay_samples >= rtp_session->samples_per_interval) {
-				rtp_session->delay_samples -= rtp_session->samples_per_interval;
-			} else {
-				rtp_session->delay_samples = 0;
-			}
+	for (x = 0; x < SWITCH_RTP_LAT_MAX; x++) {
+		switch_rtp_histogram_t *h = &latency->stage[x];
 
-			if (!rtp_session->delay_samples) {
-				rtp_session->queue_delay = 0;
-			}
-		}
-		
-		if (rtp_session->queue_delay) {
-			return;
+		if (!h->count) {
+			continue;
 		}
 
+		switch_snprintf(name, sizeof(name), "RTP-Latency-%s-Count", RTP_LATENCY_HEADER_NAMES[x]);
+		switch_event_add_header(event, SWITCH_STACK_BOTTOM, name, "%" SWITCH_UINT64_T_FMT, h->count);
+		switch_snprintf(name, sizeof(name), "RTP-Latency-%s-P50", RTP_LATENCY_HEADER_NAMES[x]);
+		switch_event_add_header(event, SWITCH_STACK_BOTTOM, name, "%u", switch_rtp_histogram_percentile(h, 50));
+		switch_snprintf(name, sizeof(name), "RTP-Latency-%s-P99", RTP_LATENCY_HEADER_NAMES[x]);
+		switch_event_add_header(event, SWITCH_STACK_BOTTOM, name, "%u", switch_rtp_histogram_percentile(h, 99));
+		switch_snprintf(name, sizeof(name), "RTP-Latency-%s-Max", RTP_LATENCY_HEADER_NAMES[x]);
+		switch_event_add_header(event, SWITCH_STACK_BOTTOM, name, "%u", h->max_usec);
+	}
+}
+#endif
+
+static void rtp_quality_fire_event(switch_rtp_t *rtp_session)
+{
+	switch_core_session_t *session = switch_core_memory_pool_get_data(rtp_session->pool, "__session");
+	switch_rtp_quality_t quality;
+	switch_event_t *event;
 
-		if (!rtp_session->sending_dtmf) {
-			rtp_session->sending_dtmf = 2;
-			return;
+	rtp_quality_refresh_jb(rtp_session);
+	rtp_quality_calc(rtp_session, &quality);
+
+	if (switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, SWITCH_RTP_QUALITY_EVENT) == SWITCH_STATUS_SUCCESS) {
+		if (session) {
+			switch_channel_event_set_data(switch_core_session_get_channel(session), event);
 		}
+		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "RTP-Media", switch_test_flag(rtp_session, SWITCH_RTP_FLAG_VIDEO) ? "video" : "audio");
+		switch_event_add_header(event, SWITCH_STACK_BOTTOM, "RTP-Remote-SSRC", "%u", rtp_session->quality.ssrc);
+		rtp_quality_add_headers(event, &quality);
+#ifdef RTP_LATENCY_STATS
+		rtp_latency_add_headers(event, &rtp_session->latency);
+#endif
+		switch_event_fire(&event);
+	}
+}
 
-		if (switch_queue_trypop(rtp_session->dtmf_data.dtmf_queue, &pop) == SWITCH_STATUS_SUCCESS) {
-			switch_dtmf_t *rdigit = pop;
-			switch_size_t wrote;
+/* called for every RTP packet that made it past decryption, DTMF is accounted for but not timed */
+static void rtp_quality_update(switch_rtp_t *rtp_session, switch_time_t now)
+{
+	struct switch_rtp_quality_data *q = &rtp_session->quality;
+	uint16_t seq = ntohs((uint16_t) rtp_session->recv_msg.header.seq);
+	uint32_t ts = ntohl(rtp_session->recv_msg.header.ts);
+	uint16_t udelta;
 
-			if (rdigit->digit == 'w') {
-				set_dtmf_delay(rtp_session, 500, 0);
-				free(rdigit);
-				return;
-			}
+	q->ssrc = ntohl(rtp_session->recv_msg.header.ssrc);
 
-			if (rdigit->digit == 'W') {
-				set_dtmf_delay(rtp_session, 1000, 0);
-				free(rdigit);
-				return;
-			}
-			
+	if (!q->started) {
+		q->started = 1;
+		q->max_seq = seq;
+		q->expected = q->received = 1;
+		rtp_quality_receipt(q);
+		rtp_quality_transit(rtp_session, q, ts, now, 1);
+		goto periodic;
+	}
 
-			
-			memset(rtp_session->dtmf_data.out_digit_packet, 0, 4);
-			rtp_session->dtmf_data.out_digit_sofar = samples;
-			rtp_session->dtmf_data.out_digit_sub_sofar = samples;
-			rtp_session->dtmf_data.out_digit_dur = rdigit->duration;
-			rtp_session->dtmf_data.out_digit = rdigit->digit;
-			rtp_session->dtmf_data.out_digit_packet[0] = (unsigned char) switch_char_to_rfc2833(rdigit->digit);
-			rtp_session->dtmf_data.out_digit_packet[1] = 7;
-			rtp_session->dtmf_data.out_digit_packet[2] = (unsigned char) (rtp_session->dtmf_data.out_digit_sub_sofar >> 8);
-			rtp_session->dtmf_data.out_digit_packet[3] = (unsigned char) rtp_session->dtmf_data.out_digit_sub_sofar;
+	udelta = seq - q->max_seq;
 
+	if (udelta == 0) {
+		return;
+	}
 
-			rtp_session->dtmf_data.timestamp_dtmf = rtp_session->last_write_ts + samples;
-			rtp_session->last_write_ts = rtp_session->dtmf_data.timestamp_dtmf;
-			
-			wrote = switch_rtp_write_manual(rtp_session,
-											rtp_session->dtmf_data.out_digit_packet,
-											4,
-											rtp_session->rtp_bugs & RTP_BUG_CISCO_SKIP_MARK_BIT_2833 ? 0 : 1,
-											rtp_session->te, rtp_session->dtmf_data.timestamp_dtmf, &flags);
+	if (udelta < RTP_QUALITY_MAX_DROPOUT) {
+		if (seq < q->max_seq) {
+			q->cycles += 65536;
+		}
+		if (udelta > 1) {
+			rtp_quality_loss(q, udelta - 1);
+		}
+		q->expected += udelta;
+		q->received++;
+		q->max_seq = seq;
+		rtp_quality_receipt(q);
+		rtp_quality_transit(rtp_session, q, ts, now, 0);
+	} else if (udelta <= 65536 - RTP_QUALITY_MAX_MISORDER) {
+		/* the sender jumped, follow the new sequence without counting the jump as loss */
+		q->expected++;
+		q->received++;
+		q->max_seq = seq;
+		rtp_quality_receipt(q);
+		rtp_quality_transit(rtp_session, q, ts, now, 1);
+	} else if (q->received < q->expected) {
+		/* reordered, it was counted as lost when the gap was seen */
+		q->received++;
+	}
 
-			
-			rtp_session->stats.outbound.raw_bytes += wrote;
-			rtp_session->stats.outbound.dtmf_packet_count++;
-			
-			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Send start packet for [%c] ts=%u dur=%d/%d/%d seq=%d lw=%d\n",
-							  rtp_session->dtmf_data.out_digit,
-							  rtp_session->dtmf_data.timestamp_dtmf,
-							  rtp_session->dtmf_data.out_digit_sofar,
-							  rtp_session->dtmf_data.out_digit_sub_sofar, rtp_session->dtmf_data.out_digit_dur, rtp_session->seq, rtp_session->last_write_ts);
+  periodic:
 
-			free(rdigit);
+	if (!(q->received & 63)) {
+		rtp_quality_refresh_jb(rtp_session);
+	}
+
+	if (q->event_interval && now >= q->next_event) {
+		if (q->next_event) {
+			rtp_quality_fire_event(rtp_session);
 		}
+		q->next_event = now + (switch_time_t) q->event_interval * 1000000;
 	}
 }
 
-SWITCH_DECLARE(void) rtp_flush_read_buffer(switch_rtp_t *rtp_session, switch_rtp_flush_t flush)
+/* one reception report block about the stream we receive and optionally an RTCP-XR VoIP metrics block after our SR */
+static switch_size_t rtcp_quality_build(switch_rtp_t *rtp_session, switch_time_t now)
 {
+	struct switch_rtp_quality_data *q = &rtp_session->quality;
+	uint8_t *p = (uint8_t *) rtp_session->rtcp_send_msg.body + sizeof(struct switch_rtcp_senderinfo);
+	uint32_t expected_interval, received_interval, fraction = 0;
+	int32_t lost_interval, cumulative;
+	switch_size_t len = 0;
 
-	if (switch_rtp_ready(rtp_session)) {
-		rtp_session->last_write_ts = RTP_TS_RESET;
-	
-		if (!switch_test_flag(rtp_session, SWITCH_RTP_FLAG_PROXY_MEDIA) && 
-			!switch_test_flag(rtp_session, SWITCH_RTP_FLAG_VIDEO)) {
-			switch_set_flag_locked(rtp_session, SWITCH_RTP_FLAG_FLUSH);
-			switch (flush) {
-			case SWITCH_RTP_FLUSH_STICK:
-				switch_set_flag_locked(rtp_session, SWITCH_RTP_FLAG_STICKY_FLUSH);
-				break;
-			case SWITCH_RTP_FLUSH_UNSTICK:
-				switch_clear_flag_locked(rtp_session, SWITCH_RTP_FLAG_STICKY_FLUSH);
-				break;
-			default:
-				break;
-			}
-		}
+	rtp_session->rtcp_send_msg.header.count = 0;
+	rtp_session->rtcp_send_msg.header.length = htons(6);
+
+	if (!q->started) {
+		return 0;
 	}
+
+	expected_interval = q->expected - q->expected_prior;
+	received_interval = q->received - q->received_prior;
+	q->expected_prior = q->expected;
+	q->received_prior = q->received;
+	lost_interval = (int32_t) (expected_interval - received_interval);
+
+	if (expected_interval && lost_interval > 0) {
+		fraction = ((uint32_t) lost_interval << 8) / expected_interval;
+	}
+
+	cumulative = (int32_t) (q->expected - q->received);
+	if (cumulative > 0x7fffff) {
+		cumulative = 0x7fffff;
+	}
+
+	rtp_quality_put32(p, q->ssrc);
+	rtp_quality_put32(p + 4, ((fraction > 255 ? 255 : fraction) << 24) | ((uint32_t) cumulative & 0xffffff));
+	rtp_quality_put32(p + 8, q->cycles + q->max_seq);
+	rtp_quality_put32(p + 12, q->jitter_q4 >> 4);
+	rtp_quality_put32(p + 16, q->lsr);
+	rtp_quality_put32(p + 20, q->lsr_time ? (uint32_t) (((now - q->lsr_time) << 16) / 1000000) : 0);
+	len = 24;
+
+	rtp_session->rtcp_send_msg.header.count = 1;
+	rtp_session->rtcp_send_msg.header.length = htons(12);
+
+	if (rtp_session->rtcp_xr) {
+		uint8_t *x = p + len, *b = x + 8;
+		switch_rtp_quality_t quality;
+		uint32_t delay;
+
+		rtp_quality_calc(rtp_session, &quality);
+		delay = (rtp_session->ms_per_packet / 1000) + (q->jb_nominal_ms ? q->jb_nominal_ms : quality.jitter_p95);
+
+		memset(x, 0, 44);
+		x[0] = 0x80;
+		x[1] = 207;
+		rtp_quality_put16(x + 2, 10);
+		rtp_quality_put32(x + 4, ntohl(rtp_session->send_msg.header.ssrc));
+
+		b[0] = 7;
+		rtp_quality_put16(b + 2, 8);
+		rtp_quality_put32(b + 4, q->ssrc);
+		b[8] = rtp_quality_scale256(quality.loss_rate);
+		b[9] = rtp_quality_scale256(quality.discard_rate);
+		b[10] = rtp_quality_scale256(quality.burst_density);
+		b[11] = rtp_quality_scale256(quality.gap_density);
+		rtp_quality_put16(b + 12, quality.burst_duration);
+		rtp_quality_put16(b + 14, quality.gap_duration);
+		rtp_quality_put16(b + 16, quality.round_trip_delay);
+		rtp_quality_put16(b + 18, delay);
+		b[20] = 127;
+		b[21] = 127;
+		b[22] = 127;
+		b[23] = RTP_QUALITY_GMIN;
+		b[24] = (uint8_t) quality.r_factor;
+		b[25] = 127;
+		b[26] = (uint8_t) (quality.mos_lq * 10);
+		b[27] = (uint8_t) (quality.mos * 10);
+		b[28] = rtp_session->jb ? (3 << 4) : 0;
+		rtp_quality_put16(b + 30, q->jb_nominal_ms);
+		rtp_quality_put16(b + 32, q->jb_max_ms);
+		rtp_quality_put16(b + 34, q->jb_max_ms);
+		len += 44;
+	}
+
+	return len;
 }
 
-static void do_flush(switch_rtp_t *rtp_session)
+/* walk a received compound packet for the SR timestamp, report blocks about our stream and RTCP-XR VoIP metrics */
+static void rtcp_quality_parse(switch_rtp_t *rtp_session, switch_size_t bytes, switch_time_t now)
 {
-	int was_blocking = 0;
-	switch_size_t bytes;
+	struct switch_rtp_quality_data *q = &rtp_session->quality;
+	uint8_t *p = (uint8_t *) &rtp_session->rtcp_recv_msg;
+	uint32_t our_ssrc = ntohl(rtp_session->send_msg.header.ssrc);
 
-	if (!switch_rtp_ready(rtp_session) || 
-		switch_test_flag(rtp_session, SWITCH_RTP_FLAG_PROXY_MEDIA) || 
-		switch_test_flag(rtp_session, SWITCH_RTP_FLAG_VIDEO) 
-		) {
-		return;
-	}
+	while (bytes >= 8) {
+		uint32_t len = (((uint32_t) p[2] << 8 | p[3]) + 1) * 4;
+		uint8_t count = p[0] & 0x1f;
+		uint8_t *b = NULL, *end = p + len;
 
-	READ_INC(rtp_session);
+		if ((p[0] >> 6) != 2 || len > bytes) {
+			break;
+		}
 
-	if (switch_rtp_ready(rtp_session)) {
-		uint32_t flushed = 0;
-		
-		if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_DEBUG_RTP_READ)) {
-			switch_core_session_t *session = switch_core_memory_pool_get_data(rtp_session->pool, "__session");
-			if (!session) {
-				switch_clear_flag(rtp_session, SWITCH_RTP_FLAG_DEBUG_RTP_READ);
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "RTP HAS NO SESSION!\n");
-			} else {
-				switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session),
-								  SWITCH_LOG_CONSOLE, "%s FLUSH\n", switch_channel_get_name(switch_core_session_get_channel(session))
-								  );
+		if (p[1] == 200 && len >= 28) {
+			q->lsr = (rtp_quality_get32(p + 8) << 16) | (rtp_quality_get32(p + 12) >> 16);
+			q->lsr_time = now;
+			b = p + 28;
+		} else if (p[1] == 201) {
+			b = p + 8;
+		} else if (p[1] == 207) {
+			uint8_t *x = p + 8;
+
+			while (x + 4 <= end) {
+				uint32_t blen = (((uint32_t) x[2] << 8 | x[3]) + 1) * 4;
+
+				if (x + blen > end) {
+					break;
+				}
+
+				if (x[0] == 7 && blen >= 36 && rtp_quality_get32(x + 4) == our_ssrc) {
+					q->remote_xr = 1;
+					q->remote_r_factor = x[24];
+					q->remote_mos_lq = x[26];
+				}
+
+				x += blen;
 			}
 		}
 
-		if (!switch_test_flag(rtp_session, SWITCH_RTP_FLAG_NOBLOCK)) {
-			was_blocking = 1;
-			switch_set_flag_locked(rtp_session, SWITCH_RTP_FLAG_NOBLOCK);
-			switch_socket_opt_set(rtp_session->sock_input, SWITCH_SO_NONBLOCK, TRUE);
-		}
+		for (; b && count && b + 24 <= end; count--, b += 24) {
+			uint32_t lsr, dlsr;
 
-		do {
-			if (switch_rtp_ready(rtp_session)) {
-				bytes = sizeof(rtp_msg_t);
-				switch_socket_recvfrom(rtp_session->from_addr, rtp_session->sock_input, 0, (void *) &rtp_session->recv_msg, &bytes);
-				if (bytes) {
-					int do_cng = 0;
+			if (rtp_quality_get32(b) != our_ssrc) {
+				continue;
+			}
 
-					/* Make sure to handle RFC2833 packets, even if we're flushing the packets */
-					if (bytes > rtp_header_len && rtp_session->recv_te && rtp_session->recv_msg.header.pt == rtp_session->recv_te) {
-						handle_rfc2833(rtp_session, bytes, &do_cng);
-#ifdef DEBUG_2833
-						switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "*** RTP packet handled in flush loop %d ***\n", do_cng);
-#endif
-					}
+			q->remote_fraction_lost = b[4];
+			q->remote_jitter = rtp_quality_get32(b + 12);
 
-					flushed++;
+			if ((lsr = rtp_quality_get32(b + 16))) {
+				int32_t rtt;
 
-					rtp_session->stats.inbound.raw_bytes += bytes;
-					rtp_session->stats.inbound.flush_packet_count++;
-					rtp_session->stats.inbound.packet_count++;
+				dlsr = rtp_quality_get32(b + 20);
+				rtt = (int32_t) (rtp_quality_ntp_middle(now) - lsr - dlsr);
+
+				if (rtt >= 0 && rtt < 65536 * 10) {
+					q->rtt_ms = (uint32_t) (((uint64_t) rtt * 1000) >> 16);
 				}
-			} else {
-				break;
 			}
-		} while (bytes > 0);
-
-		if (rtp_session->jb && flushed) {
-			stfu_n_sync(rtp_session->jb, flushed);
 		}
 
-		if (was_blocking && switch_rtp_ready(rtp_session)) {
-			switch_clear_flag_locked(rtp_session, SWITCH_RTP_FLAG_NOBLOCK);
-			switch_socket_opt_set(rtp_session->sock_input, SWITCH_SO_NONBLOCK, FALSE);
-		}
+		p += len;
+		bytes -= len;
 	}
-
-	READ_DEC(rtp_session);
 }
 
 #define return_cng_frame() do_cng = 1; goto timer_check
@@ -2532,11 +4295,17 @@ static switch_status_t read_rtp_packet(switch_rtp_t *rtp_session, switch_size_t
 	switch_status_t status = SWITCH_STATUS_FALSE;
 	stfu_frame_t *jb_frame;
 	uint32_t ts;
+	switch_time_t lat_start = 0;
 
 	switch_assert(bytes);
  more:
 	*bytes = sizeof(rtp_msg_t);
+	RTP_LAT_MARK(lat_start);
 	status = switch_socket_recvfrom(rtp_session->from_addr, rtp_session->sock_input, 0, (void *) &rtp_session->recv_msg, bytes);
+	if (*bytes && switch_test_flag(rtp_session, SWITCH_RTP_FLAG_USE_TIMER)) {
+		/* without a timer the wait is the poll in rtp_common_read */
+		RTP_LAT_ADD(rtp_session, SWITCH_RTP_LAT_SOCKET_WAIT, lat_start);
+	}
 	ts = ntohl(rtp_session->recv_msg.header.ts);
 
 	if (*bytes) {
@@ -2650,7 +4419,9 @@ static switch_status_t read_rtp_packet(switch_rtp_t *rtp_session, switch_size_t
 				}
 
 				if (!(*flags & SFF_PLC)) {
+					RTP_LAT_MARK(lat_start);
 					stat = srtp_unprotect(rtp_session->recv_ctx, &rtp_session->recv_msg.header, &sbytes);
+					RTP_LAT_ADD(rtp_session, SWITCH_RTP_LAT_SRTP_UNPROTECT, lat_start);
 				}
 
 				if (stat && rtp_session->recv_msg.header.pt != rtp_session->recv_te && rtp_session->recv_msg.header.pt != rtp_session->cng_pt) {
@@ -2682,13 +4453,17 @@ static switch_status_t read_rtp_packet(switch_rtp_t *rtp_session, switch_size_t
 
 
 	rtp_session->last_read_ts = ts;
-	
+
+	if (*bytes && rtp_session->recv_msg.header.version == 2) {
+		rtp_quality_update(rtp_session, rtp_session->last_read_time);
+	}
 	
 	if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_BYTESWAP) && rtp_session->recv_msg.header.pt == rtp_session->rpayload) {
 		switch_swap_linear((int16_t *)rtp_session->recv_msg.body, (int) *bytes - rtp_header_len);
 	}
 
 	if (rtp_session->jb && !rtp_session->pause_jb && rtp_session->recv_msg.header.version == 2 && *bytes) {
+		RTP_LAT_MARK(lat_start);
 		if (rtp_session->recv_msg.header.m && rtp_session->recv_msg.header.pt != rtp_session->recv_te && 
 			!switch_test_flag(rtp_session, SWITCH_RTP_FLAG_VIDEO) && !(rtp_session->rtp_bugs & RTP_BUG_IGNORE_MARK_BIT)) {
 			stfu_n_reset(rtp_session->jb);
@@ -2701,10 +4476,11 @@ static switch_status_t read_rtp_packet(switch_rtp_t *rtp_session, switch_size_t
 		if (stfu_n_eat(rtp_session->jb, rtp_session->last_read_ts, 
 					   rtp_session->recv_msg.header.pt,
 					   rtp_session->recv_msg.body, *bytes - rtp_header_len, rtp_session->timer.samplecount) == STFU_ITS_TOO_LATE) {
-			
+			RTP_LAT_ADD(rtp_session, SWITCH_RTP_LAT_JITTER_BUFFER, lat_start);
 			goto more;
 		}
 
+		RTP_LAT_ADD(rtp_session, SWITCH_RTP_LAT_JITTER_BUFFER, lat_start);
 		status = SWITCH_STATUS_FALSE;
 		if (!return_jb_packet) {
 			return status;
@@ -2713,7 +4489,11 @@ static switch_status_t read_rtp_packet(switch_rtp_t *rtp_session, switch_size_t
 	}
 
 	if (rtp_session->jb && !rtp_session->pause_jb) {
-		if ((jb_frame = stfu_n_read_a_frame(rtp_session->jb))) {
+		RTP_LAT_MARK(lat_start);
+		jb_frame = stfu_n_read_a_frame(rtp_session->jb);
+		RTP_LAT_ADD(rtp_session, SWITCH_RTP_LAT_JITTER_BUFFER, lat_start);
+
+		if (jb_frame) {
 			memcpy(rtp_session->recv_msg.body, jb_frame->data, jb_frame->dlen);
 
 			if (jb_frame->plc) {
@@ -2751,8 +4531,11 @@ static switch_status_t read_rtcp_packet(switch_rtp_t *rtp_session, switch_size_t
 	if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_SECURE_RECV)) {
 		int sbytes = (int) *bytes;
 		err_status_t stat = 0;
+		switch_time_t lat_start = 0;
 
+		RTP_LAT_MARK(lat_start);
 		stat = srtp_unprotect_rtcp(rtp_session->recv_ctx, &rtp_session->rtcp_recv_msg.header, &sbytes);
+		RTP_LAT_ADD(rtp_session, SWITCH_RTP_LAT_SRTP_UNPROTECT, lat_start);
 		
 		if (stat) {
 			if (++rtp_session->srtp_errs >= MAX_SRTP_ERRS) {
@@ -2833,6 +4616,8 @@ static switch_status_t read_rtcp_packet(switch_rtp_t *rtp_session, switch_size_t
 								  ntohl(sr->pc),
 								  ntohl(sr->oc));
 			}
+
+			rtcp_quality_parse(rtp_session, *bytes, switch_micro_time_now());
 		} else {
 			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Received an unsupported RTCP packet version %d\nn", rtp_session->rtcp_recv_msg.header.version);
 		}
@@ -2860,6 +4645,9 @@ static int rtp_common_read(switch_rtp_t *rtp_session, switch_payload_t *payload_
 	int rtcp_fdr = 0;
 	int hot_socket = 0;
 	int read_loops = 0;
+	switch_time_t lat_start = 0;
+	handle_rfc2833_result_t rfc2833_result;
+	int rfc2833_packet;
 
 	if (session) {
 		channel = switch_core_session_get_channel(session);
@@ -2880,6 +4668,12 @@ static int rtp_common_read(switch_rtp_t *rtp_session, switch_payload_t *payload_
 		int read_pretriggered = 0;
 		bytes = 0;
 
+		if (rtp_session->relay_rx) {
+			/* the relay thread owns the socket, hand back comfort noise at the packet rate */
+			switch_yield(rtp_session->ms_per_packet);
+			return_cng_frame();
+		}
+
 		if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_USE_TIMER)) {
 			if ((switch_test_flag(rtp_session, SWITCH_RTP_FLAG_AUTOFLUSH) || switch_test_flag(rtp_session, SWITCH_RTP_FLAG_STICKY_FLUSH)) &&
 				rtp_session->read_pollfd) {
@@ -2911,6 +4705,7 @@ static int rtp_common_read(switch_rtp_t *rtp_session, switch_payload_t *payload_
 			if (hot_socket) {
 				rtp_session->sync_packets++;
 				switch_core_timer_sync(&rtp_session->timer);
+				RTP_LAT_TIMER(rtp_session, 1);
 			} else {
 				if (rtp_session->sync_packets) {
 #if 0
@@ -2921,6 +4716,7 @@ static int rtp_common_read(switch_rtp_t *rtp_session, switch_payload_t *payload_
 					rtp_session->sync_packets = 0;
 				}
 				switch_core_timer_next(&rtp_session->timer);
+				RTP_LAT_TIMER(rtp_session, 0);
 			}
 		}
 
@@ -2949,7 +4745,9 @@ static int rtp_common_read(switch_rtp_t *rtp_session, switch_payload_t *payload_
 				pt = 0;
 			}
 
+			RTP_LAT_MARK(lat_start);
 			poll_status = switch_poll(rtp_session->read_pollfd, 1, &fdr, pt);
+			RTP_LAT_ADD(rtp_session, SWITCH_RTP_LAT_SOCKET_WAIT, lat_start);
 
 			if (rtp_session->dtmf_data.out_digit_dur > 0) {
 				return_cng_frame();
@@ -3010,7 +4808,7 @@ static int rtp_common_read(switch_rtp_t *rtp_session, switch_payload_t *payload_
 
 						if ((other_session = switch_core_session_locate(uuid))) {
 							switch_channel_t *other_channel = switch_core_session_get_channel(other_session);					
-							if ((other_rtp_session = switch_channel_get_private(other_channel, "__rtcp_audio_rtp_session")) && 
+							if ((other_rtp_session = switch_channel_get_private(other_channel, SWITCH_RTP_AUDIO_PRIVATE)) && 
 								other_rtp_session->rtcp_sock_output &&
 								switch_test_flag(other_rtp_session, SWITCH_RTP_FLAG_ENABLE_RTCP)) {
 								*other_rtp_session->rtcp_send_msg.body = *rtp_session->rtcp_recv_msg.body;
@@ -3288,7 +5086,18 @@ static int rtp_common_read(switch_rtp_t *rtp_session, switch_payload_t *payload_
 
 
 		/* Handle incoming RFC2833 packets */
-		switch (handle_rfc2833(rtp_session, bytes, &do_cng)) {
+		rfc2833_packet = bytes > rtp_header_len && rtp_session->recv_te && rtp_session->recv_msg.header.pt == rtp_session->recv_te;
+		if (rfc2833_packet) {
+			RTP_LAT_MARK(lat_start);
+		}
+
+		rfc2833_result = handle_rfc2833(rtp_session, bytes, &do_cng);
+
+		if (rfc2833_packet) {
+			RTP_LAT_ADD(rtp_session, SWITCH_RTP_LAT_DTMF, lat_start);
+		}
+
+		switch (rfc2833_result) {
 		case RESULT_GOTO_END:
 			goto end;
 		case RESULT_GOTO_RECVFROM:
@@ -3661,6 +5470,73 @@ SWITCH_DECLARE(switch_status_t) switch_rtp_zerocopy_read(switch_rtp_t *rtp_sessi
 	return SWITCH_STATUS_SUCCESS;
 }
 
+static int rtp_train_flush(switch_rtp_t *rtp_session)
+{
+	struct rtp_train_queue *train = rtp_session->train;
+	uint32_t sent = 0;
+	int ret = 0;
+	switch_time_t lat_start = 0;
+
+	if (!train->count) {
+		train->arena_used = 0;
+		return 0;
+	}
+
+	RTP_LAT_MARK(lat_start);
+	if (switch_socket_sendto_multi(rtp_session->sock_output, rtp_session->remote_addr, 0, train->bufs, train->lens, train->count, &sent) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Packet train cut short, %u of %u packets sent\n", sent, train->count);
+		ret = -1;
+	}
+	RTP_LAT_ADD(rtp_session, SWITCH_RTP_LAT_SEND, lat_start);
+
+	train->count = 0;
+	train->arena_used = 0;
+
+	return ret;
+}
+
+/* reserve room in the train arena, the slack leaves space for the SRTP trailer */
+static void *rtp_train_reserve(switch_rtp_t *rtp_session, switch_size_t len)
+{
+	struct rtp_train_queue *train = rtp_session->train;
+	void *ptr;
+
+	if (train->count >= SWITCH_VIDEO_TRAIN_MAX_PACKETS - 1 || train->arena_used + len + RTP_TRAIN_SLACK > sizeof(train->arena)) {
+		rtp_train_flush(rtp_session);
+	}
+
+	if (train->arena_used + len + RTP_TRAIN_SLACK > sizeof(train->arena)) {
+		return NULL;
+	}
+
+	ptr = train->arena + train->arena_used;
+	train->arena_used += (uint32_t) (len + RTP_TRAIN_SLACK);
+
+	return ptr;
+}
+
+static void rtp_train_queue(switch_rtp_t *rtp_session, rtp_msg_t *send_msg, switch_size_t bytes)
+{
+	struct rtp_train_queue *train = rtp_session->train;
+	const char *buf = (const char *) send_msg;
+
+	if (buf < (const char *) train->arena || buf >= (const char *) train->arena + sizeof(train->arena)) {
+		/* the message lives in a buffer that is reused for the next packet, keep a copy */
+		char *copy;
+
+		if (!(copy = rtp_train_reserve(rtp_session, bytes))) {
+			switch_socket_sendto(rtp_session->sock_output, rtp_session->remote_addr, 0, buf, &bytes);
+			return;
+		}
+		memcpy(copy, buf, bytes);
+		buf = copy;
+	}
+
+	train->bufs[train->count] = buf;
+	train->lens[train->count] = bytes;
+	train->count++;
+}
+
 static int rtp_common_write(switch_rtp_t *rtp_session,
 							rtp_msg_t *send_msg, void *data, uint32_t datalen, switch_payload_t payload, uint32_t timestamp, switch_frame_flag_t *flags)
 {
@@ -3668,12 +5544,19 @@ static int rtp_common_write(switch_rtp_t *rtp_session,
 	uint8_t send = 1;
 	uint32_t this_ts = 0;
 	int ret;
-	switch_time_t now;
+	switch_time_t now, write_start = 0, lat_start = 0;
 
 	if (!switch_rtp_ready(rtp_session)) {
 		return SWITCH_STATUS_FALSE;
 	}
 
+	if (rtp_session->relay_tx) {
+		/* the relay thread owns the outbound stream */
+		return (int) datalen;
+	}
+
+	RTP_LAT_MARK(write_start);
+
 	WRITE_INC(rtp_session);
 
 	if (send_msg) {
@@ -3902,7 +5785,9 @@ static int rtp_common_write(switch_rtp_t *rtp_session,
 			}
 
 
+			RTP_LAT_MARK(lat_start);
 			stat = srtp_protect(rtp_session->send_ctx, &send_msg->header, &sbytes);
+			RTP_LAT_ADD(rtp_session, SWITCH_RTP_LAT_SRTP_PROTECT, lat_start);
 			if (stat) {
 				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error: SRTP protection failed with code %d\n", stat);
 			}
@@ -3977,10 +5862,16 @@ static int rtp_common_write(switch_rtp_t *rtp_session,
 		}
 
 
-		if (switch_socket_sendto(rtp_session->sock_output, rtp_session->remote_addr, 0, (void *) send_msg, &bytes) != SWITCH_STATUS_SUCCESS) {
-			rtp_session->seq--;
-			ret = -1;
-			goto end;
+		if (rtp_session->train && rtp_session->train->active) {
+			rtp_train_queue(rtp_session, send_msg, bytes);
+		} else {
+			RTP_LAT_MARK(lat_start);
+			if (switch_socket_sendto(rtp_session->sock_output, rtp_session->remote_addr, 0, (void *) send_msg, &bytes) != SWITCH_STATUS_SUCCESS) {
+				rtp_session->seq--;
+				ret = -1;
+				goto end;
+			}
+			RTP_LAT_ADD(rtp_session, SWITCH_RTP_LAT_SEND, lat_start);
 		}
 		rtp_session->last_write_ts = this_ts;
 
@@ -4019,7 +5910,7 @@ static int rtp_common_write(switch_rtp_t *rtp_session,
 			sr->pc = htonl(rtp_session->stats.outbound.packet_count);
 			sr->oc = htonl((rtp_session->stats.outbound.raw_bytes - rtp_session->stats.outbound.packet_count * sizeof(srtp_hdr_t)));
 
-			rtcp_bytes = sizeof(switch_rtcp_hdr_t) + sizeof(struct switch_rtcp_senderinfo);
+			rtcp_bytes = sizeof(switch_rtcp_hdr_t) + sizeof(struct switch_rtcp_senderinfo) + rtcp_quality_build(rtp_session, switch_micro_time_now());
 #ifdef ENABLE_SRTP
 			if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_SECURE_SEND)) {
 				int sbytes = (int) rtcp_bytes;
@@ -4080,6 +5971,8 @@ static int rtp_common_write(switch_rtp_t *rtp_session,
 
  end:
 
+	RTP_LAT_ADD(rtp_session, SWITCH_RTP_LAT_WRITE, write_start);
+
 	WRITE_DEC(rtp_session);
 
 	return ret;
@@ -4253,6 +6146,26 @@ SWITCH_DECLARE(int) switch_rtp_write_frame(switch_rtp_t *rtp_session, switch_fra
 
 	switch_assert(frame != NULL);
 
+	if (!fwd && rtp_session->cng_pt && switch_test_flag(frame, SFF_SILENCE) && !switch_test_flag(rtp_session, SWITCH_RTP_FLAG_VIDEO)) {
+		/* RFC 3389 DTX: announce the pause with a CN packet, refresh it now and then and stay quiet in between */
+		if (!(rtp_session->silence_frames++ % RTP_SILENCE_CN_INTERVAL)) {
+			uint8_t data[2] = { 65, 0 };
+			switch_frame_flag_t frame_flags = SFF_NONE;
+
+			rtp_session->cn++;
+			return rtp_common_write(rtp_session, NULL, (void *) data, 2, rtp_session->cng_pt, 0, &frame_flags);
+		}
+
+		if (!switch_test_flag(rtp_session, SWITCH_RTP_FLAG_USE_TIMER) || (rtp_session->rtp_bugs & RTP_BUG_SEND_LINEAR_TIMESTAMPS)) {
+			/* keep the media clock running across the packets we do not send */
+			rtp_session->ts += rtp_session->samples_per_interval;
+		}
+
+		return (int) frame->datalen;
+	}
+
+	rtp_session->silence_frames = 0;
+
 	if (switch_test_flag(frame, SFF_CNG)) {
 		if (rtp_session->cng_pt) {
 			payload = rtp_session->cng_pt;
@@ -4296,10 +6209,100 @@ SWITCH_DECLARE(int) switch_rtp_write_frame(switch_rtp_t *rtp_session, switch_fra
 	return rtp_common_write(rtp_session, send_msg, data, len, payload, ts, &frame->flags);
 }
 
+SWITCH_DECLARE(int) switch_rtp_write_frames(switch_rtp_t *rtp_session, switch_frame_t *frames, uint32_t count)
+{
+	struct rtp_train_queue *train;
+	uint32_t i;
+	int bytes = 0, ret = 0;
+
+	if (!switch_rtp_ready(rtp_session) || !rtp_session->remote_addr) {
+		return -1;
+	}
+
+	if (!switch_test_flag(rtp_session, SWITCH_RTP_FLAG_VIDEO) || count < 2 || switch_test_flag(rtp_session, SWITCH_RTP_FLAG_PROXY_MEDIA) ||
+		switch_test_flag(rtp_session, SWITCH_RTP_FLAG_UDPTL) || rtp_session->relay_tx) {
+		goto one_by_one;
+	}
+
+	/* one lock for the whole access unit, rtp_common_write nests inside it */
+	WRITE_INC(rtp_session);
+
+	/* the arena is big, only sessions that are actually handed trains get one */
+	if (!(train = rtp_session->train) && (train = switch_core_alloc(rtp_session->pool, sizeof(*train)))) {
+		rtp_session->train = train;
+	}
+
+	if (!train) {
+		WRITE_DEC(rtp_session);
+		goto one_by_one;
+	}
+
+	train->active = 1;
+
+	for (i = 0; i < count; i++) {
+		switch_frame_t *frame = &frames[i];
+		switch_frame_t copy;
+
+		if (switch_test_flag(frame, SFF_RAW_RTP) && switch_test_flag(rtp_session, SWITCH_RTP_FLAG_RAW_WRITE) && frame->packet && frame->packetlen) {
+			void *packet;
+
+			/* forwarded packets are rewritten in place (ssrc, pt, SRTP) so work on a private copy of the caller's packet */
+			if ((packet = rtp_train_reserve(rtp_session, frame->packetlen))) {
+				memcpy(packet, frame->packet, frame->packetlen);
+				copy = *frame;
+				copy.packet = packet;
+				if ((uint8_t *) frame->data >= (uint8_t *) frame->packet && (uint8_t *) frame->data < (uint8_t *) frame->packet + frame->packetlen) {
+					copy.data = (uint8_t *) packet + ((uint8_t *) frame->data - (uint8_t *) frame->packet);
+				}
+				frame = &copy;
+			}
+		}
+
+		if ((ret = switch_rtp_write_frame(rtp_session, frame)) < 0) {
+			break;
+		}
+		bytes += ret;
+	}
+
+	if (rtp_train_flush(rtp_session) < 0) {
+		ret = -1;
+	}
+
+	train->active = 0;
+	WRITE_DEC(rtp_session);
+
+	return ret < 0 ? ret : bytes;
+
+  one_by_one:
+
+	for (i = 0; i < count; i++) {
+		if ((ret = switch_rtp_write_frame(rtp_session, &frames[i])) < 0) {
+			return ret;
+		}
+		bytes += ret;
+	}
+
+	return bytes;
+}
+
+SWITCH_DECLARE(void) switch_rtp_set_quality_event_interval(switch_rtp_t *rtp_session, uint32_t seconds)
+{
+	rtp_session->quality.event_interval = seconds;
+	rtp_session->quality.next_event = 0;
+}
+
+SWITCH_DECLARE(void) switch_rtp_enable_rtcp_xr(switch_rtp_t *rtp_session, switch_bool_t enable)
+{
+	rtp_session->rtcp_xr = enable ? 1 : 0;
+}
+
 SWITCH_DECLARE(switch_rtp_stats_t *) switch_rtp_get_stats(switch_rtp_t *rtp_session, switch_memory_pool_t *pool)
 {
 	switch_rtp_stats_t *s;
 
+	rtp_quality_refresh_jb(rtp_session);
+	rtp_quality_calc(rtp_session, &rtp_session->stats.quality);
+
 	if (pool) {
 		s = switch_core_alloc(pool, sizeof(*s));
 		*s = rtp_session->stats;
@@ -4307,11 +6310,84 @@ SWITCH_DECLARE(switch_rtp_stats_t *) switch_rtp_get_stats(switch_rtp_t *rtp_sess
 		s = &rtp_session->stats;
 	}
 
-	if (rtp_session->jb) {
-		s->inbound.largest_jb_size = stfu_n_get_most_qlen(rtp_session->jb);
+	return s;
+}
+
+static const char *RTP_LATENCY_STAGE_NAMES[] = {
+	"socket_wait",
+	"jitter_buffer",
+	"srtp_unprotect",
+	"dtmf",
+	"timer_slip",
+	"srtp_protect",
+	"send",
+	"write"
+};
+
+SWITCH_DECLARE(const char *) switch_rtp_latency_stage_name(switch_rtp_latency_stage_t stage)
+{
+	if ((int) stage < 0 || stage >= SWITCH_RTP_LAT_MAX) {
+		return "unknown";
 	}
 
-	return s;
+	return RTP_LATENCY_STAGE_NAMES[stage];
+}
+
+SWITCH_DECLARE(uint32_t) switch_rtp_histogram_percentile(const switch_rtp_histogram_t *histogram, double percentile)
+{
+	uint64_t want, seen = 0;
+	uint32_t upper;
+	int x;
+
+	if (!histogram->count) {
+		return 0;
+	}
+
+	if (percentile >= 100) {
+		return histogram->max_usec;
+	}
+
+	want = (uint64_t) ((histogram->count * (percentile < 0 ? 0 : percentile)) / 100);
+	if (want < 1) {
+		want = 1;
+	}
+
+	for (x = 0; x < SWITCH_RTP_HISTOGRAM_BUCKETS - 1; x++) {
+		if ((seen += histogram->counts[x]) >= want) {
+			break;
+		}
+	}
+
+	/* lowest value of the next bucket minus one, the inverse of rtp_latency_bucket() */
+	x++;
+	upper = x < 4 ? (uint32_t) x : ((uint32_t) (4 + (x & 3)) << ((x >> 2) - 1));
+	upper--;
+
+	return upper < histogram->max_usec ? upper : histogram->max_usec;
+}
+
+SWITCH_DECLARE(switch_status_t) switch_rtp_get_latency(switch_rtp_t *rtp_session, switch_rtp_latency_t *latency)
+{
+#ifdef RTP_LATENCY_STATS
+	switch_rtp_t *rp;
+
+	if (rtp_session) {
+		*latency = rtp_session->latency;
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	switch_mutex_lock(latency_globals.mutex);
+	*latency = latency_globals.retired;
+	for (rp = latency_globals.list; rp; rp = rp->lat_next) {
+		rtp_latency_merge(latency, &rp->latency);
+	}
+	switch_mutex_unlock(latency_globals.mutex);
+
+	return SWITCH_STATUS_SUCCESS;
+#else
+	memset(latency, 0, sizeof(*latency));
+	return SWITCH_STATUS_FALSE;
+#endif
 }
 
 SWITCH_DECLARE(int) switch_rtp_write_manual(switch_rtp_t *rtp_session,
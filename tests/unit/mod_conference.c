@@ -0,0 +1,401 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2012, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ *
+ * mod_conference.c -- shared mix groups, the recording encoder pool and the cascade link of mod_conference run against a minimal core
+ *
+ * The module is compiled into the test so its static helpers can be called directly.
+ */
+
+#include "../../src/mod/applications/mod_conference/mod_conference.c"
+#include "test.h"
+
+#define SAMPLES 160
+
+static void test_shareable(void)
+{
+	static const char *yes[] = { "PCMU", "PCMA", "L16", "pcmu", NULL };
+	static const char *no[] = { "G722", "OPUS", "iLBC", "SPEEX", "G729", NULL };
+	switch_codec_implementation_t impl = { 0 };
+	int i;
+
+	for (i = 0; yes[i]; i++) {
+		impl.iananame = (char *) yes[i];
+		check(conference_codec_shareable(&impl), "%s can not be shared", yes[i]);
+	}
+
+	for (i = 0; no[i]; i++) {
+		impl.iananame = (char *) no[i];
+		check(!conference_codec_shareable(&impl), "%s carries state from frame to frame but can be shared", no[i]);
+	}
+
+	impl.iananame = NULL;
+	check(!conference_codec_shareable(&impl), "a codec without a name can be shared");
+}
+
+static conference_member_t *test_member(conference_obj_t *conference, conference_mix_group_t *group, uint32_t flags)
+{
+	conference_member_t *member = switch_core_alloc(conference->pool, sizeof(*member));
+
+	member->conference = conference;
+	member->pool = conference->pool;
+	member->mix_group = group;
+	member->flags = flags;
+	switch_mutex_init(&member->flag_mutex, SWITCH_MUTEX_NESTED, conference->pool);
+
+	return member;
+}
+
+/* publish one tick the way the mixer does: pick the listeners, then encode once for the group */
+static int test_tick(conference_obj_t *conference, conference_member_t **members, int16_t *pcm)
+{
+	int i, shared = 0;
+
+	for (i = 0; members[i]; i++) {
+		shared += conference_member_use_shared_mix(conference, members[i]);
+	}
+
+	conference_mix_groups_publish(conference, pcm, SAMPLES);
+
+	return shared;
+}
+
+static void test_group(switch_memory_pool_t *pool)
+{
+	conference_obj_t *conference = switch_core_alloc(pool, sizeof(*conference));
+	conference_mix_group_t *group = switch_core_alloc(pool, sizeof(*group));
+	conference_member_t *listener, *tapped, *talker, *members[4];
+	switch_frame_t frame = { 0 };
+	uint8_t data[SWITCH_RECOMMENDED_BUFFER_SIZE];
+	int16_t pcm[SAMPLES], decoded[SWITCH_RECOMMENDED_BUFFER_SIZE / 2];
+	uint32_t decoded_len = sizeof(decoded), rate = 8000, flag = 0, tick;
+	int i;
+
+	conference->pool = pool;
+	conference->rate = 8000;
+	conference->interval = 20;
+
+	if (switch_core_codec_init(&group->codec, "PCMU", NULL, 8000, 20, 1, SWITCH_CODEC_FLAG_ENCODE | SWITCH_CODEC_FLAG_DECODE, NULL,
+							   pool) != SWITCH_STATUS_SUCCESS) {
+		check(0, "no PCMU codec");
+		return;
+	}
+	group->samples = SAMPLES;
+	switch_mutex_init(&group->mutex, SWITCH_MUTEX_NESTED, pool);
+	conference->mix_groups = group;
+
+	members[0] = listener = test_member(conference, group, MFLAG_RUNNING | MFLAG_CAN_HEAR | MFLAG_SHARED_OK);
+	members[1] = tapped = test_member(conference, group, MFLAG_RUNNING | MFLAG_CAN_HEAR);
+	members[2] = talker = test_member(conference, group, MFLAG_RUNNING | MFLAG_CAN_HEAR | MFLAG_SHARED_OK | MFLAG_HAS_AUDIO);
+	members[3] = NULL;
+
+	for (i = 0; i < SAMPLES; i++) {
+		pcm[i] = i & 1 ? 1000 : -1000;
+	}
+
+	/* only the listener with nothing of its own is fed from the group */
+	check(test_tick(conference, members, pcm) == 1, "the wrong members were fed from the group");
+	check(switch_test_flag(listener, MFLAG_SHARED_MIX) && !conference_member_wants_mix(listener), "the listener still gets its own mix");
+	check(!switch_test_flag(tapped, MFLAG_SHARED_MIX) && conference_member_wants_mix(tapped), "a member the output thread did not clear was shared");
+	check(!switch_test_flag(talker, MFLAG_SHARED_MIX), "a talker was fed from the group");
+
+	/* the listener started on the tick just published and gets it once */
+	frame.data = data;
+	check(conference_mix_group_read(listener, &frame), "the published frame could not be read");
+	check(frame.datalen == SAMPLES && frame.samples == SAMPLES && frame.codec == &group->codec, "the frame is %u bytes of %u samples",
+		  frame.datalen, frame.samples);
+	check(!conference_mix_group_read(listener, &frame), "the same frame was read twice");
+
+	switch_core_codec_decode(&group->codec, NULL, data, SAMPLES, 8000, decoded, &decoded_len, &rate, &flag);
+	check(decoded_len == SAMPLES * 2, "decoded %u bytes", decoded_len);
+	for (i = 0; i < SAMPLES && decoded_len == SAMPLES * 2; i++) {
+		if (abs(decoded[i] - pcm[i]) > 64) {
+			check(0, "sample %d decoded as %d, was %d", i, decoded[i], pcm[i]);
+			break;
+		}
+	}
+
+	/* nobody shared, nothing encoded */
+	tick = group->tick;
+	conference_mix_groups_publish(conference, pcm, SAMPLES);
+	check(group->tick == tick, "a tick without listeners was encoded");
+
+	/* a listener that falls further behind than the ring skips to the newest frame */
+	for (i = 0; i < CONF_MIX_GROUP_DEPTH + 2; i++) {
+		test_tick(conference, members, pcm);
+	}
+	check(conference_mix_group_read(listener, &frame) && listener->shared_next == group->tick, "a stalled listener resumed at %u of %u",
+		  listener->shared_next, group->tick);
+
+	/* starting to talk takes the listener off the group on the next tick */
+	switch_set_flag_locked(listener, MFLAG_HAS_AUDIO);
+	check(test_tick(conference, members, pcm) == 0 && !switch_test_flag(listener, MFLAG_SHARED_MIX), "a talking listener stayed on the group");
+
+	conference_mix_groups_destroy(conference);
+}
+
+static void *SWITCH_THREAD_FUNC test_drop_run(switch_thread_t *thread, void *obj)
+{
+	int i;
+
+	for (i = 0; i < 100000; i++) {
+		conference_record_dropped((conference_record_t *) obj, 2);
+	}
+
+	return NULL;
+}
+
+static void test_record_encoders(switch_memory_pool_t *pool)
+{
+	conference_record_t *rec = switch_core_alloc(pool, sizeof(*rec));
+	switch_thread_t *threads[4];
+	switch_threadattr_t *thd_attr = NULL;
+	switch_status_t st;
+	uint32_t i;
+
+	switch_queue_create(&globals.record_queue, SWITCH_CORE_QUEUE_LEN, pool);
+	switch_mutex_init(&globals.record_mutex, SWITCH_MUTEX_NESTED, pool);
+
+	/* the pool only grows, and not past CONF_RECORD_MAX_ENCODERS */
+	conference_record_encoders_start(CONF_RECORD_ENCODERS);
+	check(globals.record_encoder_count == CONF_RECORD_ENCODERS, "started %u encoders", globals.record_encoder_count);
+	conference_record_encoders_start(1);
+	check(globals.record_encoder_count == CONF_RECORD_ENCODERS, "asking for fewer left %u encoders", globals.record_encoder_count);
+	conference_record_encoders_start(CONF_RECORD_MAX_ENCODERS + 10);
+	check(globals.record_encoder_count == CONF_RECORD_MAX_ENCODERS, "asking for too many started %u encoders", globals.record_encoder_count);
+
+	for (i = 0; i < globals.record_encoder_count; i++) {
+		switch_queue_push(globals.record_queue, NULL);
+	}
+	for (i = 0; i < globals.record_encoder_count; i++) {
+		switch_thread_join(&st, globals.record_encoders[i]);
+	}
+
+	/* drops are counted from the record thread and every encoder at once */
+	switch_mutex_init(&rec->mutex, SWITCH_MUTEX_NESTED, pool);
+	switch_threadattr_create(&thd_attr, pool);
+	for (i = 0; i < 4; i++) {
+		switch_thread_create(&threads[i], thd_attr, test_drop_run, rec, pool);
+	}
+	for (i = 0; i < 4; i++) {
+		switch_thread_join(&st, threads[i]);
+	}
+	check(rec->samples_dropped == 800000, "counted %" SWITCH_SIZE_T_FMT " of 800000 dropped samples", rec->samples_dropped);
+}
+
+/* one packet the way another node's conference_cascade_send frames it */
+static void test_peer_send(switch_socket_t *sock, switch_sockaddr_t *to, uint16_t seq, uint32_t ssrc, uint32_t rate, const char *name, int16_t value)
+{
+	uint8_t packet[CONF_CASCADE_PACKET_MAX];
+	size_t name_len = strlen(name);
+	switch_size_t len = 18 + name_len + SAMPLES * sizeof(int16_t);
+	uint16_t nseq = htons(seq), v = htons((uint16_t) value);
+	uint32_t nssrc = htonl(ssrc), nrate = htonl(rate), ts = 0;
+	int x;
+
+	packet[0] = 0x80;
+	packet[1] = CONF_CASCADE_PT;
+	memcpy(packet + 2, &nseq, sizeof(nseq));
+	memcpy(packet + 4, &ts, sizeof(ts));
+	memcpy(packet + 8, &nssrc, sizeof(nssrc));
+	packet[12] = (uint8_t) name_len;
+	memcpy(packet + 13, name, name_len);
+	packet[13 + name_len] = 1;
+	memcpy(packet + 14 + name_len, &nrate, sizeof(nrate));
+	for (x = 0; x < SAMPLES; x++) {
+		memcpy(packet + 18 + name_len + x * 2, &v, sizeof(v));
+	}
+
+	switch_socket_sendto(sock, to, 0, (char *) packet, &len);
+}
+
+/* wait for the link thread to account for the packets sent so far */
+static void test_peer_wait(conference_obj_t *conference, conference_cascade_peer_t *peer, uint32_t seen)
+{
+	int i;
+
+	for (i = 0; i < 200; i++) {
+		uint32_t n;
+
+		switch_mutex_lock(conference->cascade_mutex);
+		n = peer->rx_packets + peer->rx_dropped;
+		switch_mutex_unlock(conference->cascade_mutex);
+
+		if (n >= seen) {
+			break;
+		}
+		switch_yield(10000);
+	}
+}
+
+/* one conference cascaded over 127.0.0.1 to a socket standing in for the other node */
+static void test_cascade(switch_memory_pool_t *pool)
+{
+	conference_obj_t *conference = switch_core_alloc(pool, sizeof(*conference));
+	conference_cascade_peer_t *peer;
+	conference_member_t *member;
+	switch_socket_t *sock = NULL;
+	switch_sockaddr_t *local = NULL, *node = NULL, *from = NULL;
+	switch_port_t port = (switch_port_t) (30000 + getpid() % 10000);
+	uint8_t packet[CONF_CASCADE_PACKET_MAX];
+	int32_t mix[SAMPLES];
+	int16_t pcm[SAMPLES];
+	char addr[64];
+	switch_size_t len;
+	uint16_t v;
+	uint32_t rate;
+	int x;
+
+	conference->name = "cascade-test";
+	conference->pool = pool;
+	conference->rate = 8000;
+	switch_thread_rwlock_create(&conference->rwlock, pool);
+	switch_mutex_init(&conference->cascade_mutex, SWITCH_MUTEX_NESTED, pool);
+	switch_core_hash_insert(globals.conference_hash, conference->name, conference);
+
+	switch_snprintf(addr, sizeof(addr), "127.0.0.1:%u", port);
+	if (!(conference->cascade_link = conference_cascade_link_get(addr))) {
+		check(0, "cannot bind the cascade link to %s", addr);
+		return;
+	}
+
+	/* the other node */
+	switch_sockaddr_info_get(&node, "127.0.0.1", SWITCH_UNSPEC, port + 1, 0, pool);
+	switch_sockaddr_info_get(&local, "127.0.0.1", SWITCH_UNSPEC, port, 0, pool);
+	switch_sockaddr_info_get(&from, NULL, SWITCH_UNSPEC, 0, 0, pool);
+	switch_socket_create(&sock, AF_INET, SOCK_DGRAM, 0, pool);
+	if (switch_socket_bind(sock, node) != SWITCH_STATUS_SUCCESS) {
+		check(0, "cannot bind the peer socket to 127.0.0.1:%u", port + 1);
+		conference_cascade_link_release(conference->cascade_link);
+		return;
+	}
+	switch_socket_timeout_set(sock, 1000000);
+
+	member = switch_core_alloc(pool, sizeof(*member));
+	switch_buffer_create_ring(NULL, &member->audio_buffer, CONF_DBUFFER_SIZE);
+	conference->cascade_peers = peer = switch_core_alloc(pool, sizeof(*peer));
+	peer->addr = node;
+	peer->member = member;
+	conference->cascade_peer_count = 1;
+	conference->cascade_running = 1;
+
+	/* what this node sends is its own mix, clipped to 16 bit, in network order */
+	for (x = 0; x < SAMPLES; x++) {
+		mix[x] = (x % 3 == 0) ? 40000 : (x % 3 == 1) ? -40000 : x * 10;
+	}
+	conference_cascade_send(conference, mix, SAMPLES, 3);
+
+	len = sizeof(packet);
+	check(switch_socket_recvfrom(from, sock, 0, (char *) packet, &len) == SWITCH_STATUS_SUCCESS && len == 18 + strlen(conference->name) + SAMPLES * 2,
+		  "the peer got %d bytes", (int) len);
+	if (len == 18 + strlen(conference->name) + SAMPLES * 2) {
+		size_t name_len = strlen(conference->name);
+
+		check(packet[1] == CONF_CASCADE_PT && packet[12] == name_len && !memcmp(packet + 13, conference->name, name_len) && packet[13 + name_len] == 3,
+			  "the packet header is wrong");
+		memcpy(&rate, packet + 14 + name_len, sizeof(rate));
+		check(ntohl(rate) == 8000, "the packet says %u hz", ntohl(rate));
+		for (x = 0; x < SAMPLES; x++) {
+			int16_t want = (int16_t) (mix[x] > SWITCH_SMAX ? SWITCH_SMAX : mix[x] < SWITCH_SMIN ? SWITCH_SMIN : mix[x]);
+
+			memcpy(&v, packet + 18 + name_len + x * 2, sizeof(v));
+			if ((int16_t) ntohs(v) != want) {
+				check(0, "sample %d was sent as %d, expected %d", x, (int16_t) ntohs(v), want);
+				break;
+			}
+		}
+	}
+
+	/* what the peer sends is played by its member in order */
+	test_peer_send(sock, local, 1, 0x1234, 8000, conference->name, 100);
+	test_peer_send(sock, local, 2, 0x1234, 8000, conference->name, 200);
+	test_peer_wait(conference, peer, 2);
+	check(peer->rx_packets == 2 && !peer->rx_lost && !peer->rx_dropped, "received %u lost %u dropped %u", peer->rx_packets, peer->rx_lost,
+		  peer->rx_dropped);
+	check(switch_buffer_read(member->audio_buffer, pcm, sizeof(pcm)) == sizeof(pcm) && pcm[0] == 100 && pcm[SAMPLES - 1] == 100, "the first frame was %d",
+		  pcm[0]);
+	check(switch_buffer_read(member->audio_buffer, pcm, sizeof(pcm)) == sizeof(pcm) && pcm[0] == 200, "the second frame was %d", pcm[0]);
+
+	/* a gap counts as loss, the packet that turns up late is dropped */
+	test_peer_send(sock, local, 4, 0x1234, 8000, conference->name, 400);
+	test_peer_send(sock, local, 3, 0x1234, 8000, conference->name, 300);
+	test_peer_wait(conference, peer, 4);
+	check(peer->rx_packets == 3 && peer->rx_lost == 1 && peer->rx_dropped == 1, "after a gap received %u lost %u dropped %u", peer->rx_packets,
+		  peer->rx_lost, peer->rx_dropped);
+	check(switch_buffer_read(member->audio_buffer, pcm, sizeof(pcm)) == sizeof(pcm) && pcm[0] == 400, "after a gap the frame was %d", pcm[0]);
+	check(!switch_buffer_inuse(member->audio_buffer), "the late packet was played");
+
+	/* our own traffic, another rate and another conference are ignored */
+	test_peer_send(sock, local, 5, globals.cascade_node_id, 8000, conference->name, 1);
+	test_peer_send(sock, local, 6, 0x1234, 16000, conference->name, 1);
+	test_peer_send(sock, local, 7, 0x1234, 8000, "another", 1);
+
+	/* a peer that bursts is capped at CONF_CASCADE_MAX_DELAY frames */
+	for (x = 0; x < CONF_CASCADE_MAX_DELAY + 3; x++) {
+		test_peer_send(sock, local, (uint16_t) (8 + x), 0x1234, 8000, conference->name, 800);
+	}
+	test_peer_wait(conference, peer, 4 + CONF_CASCADE_MAX_DELAY + 3);
+	check(switch_buffer_inuse(member->audio_buffer) <= (CONF_CASCADE_MAX_DELAY + 1) * sizeof(pcm), "%d bytes buffered from a burst",
+		  (int) switch_buffer_inuse(member->audio_buffer));
+	check(peer->rx_dropped > 1, "a burst of %d frames dropped nothing", CONF_CASCADE_MAX_DELAY + 3);
+	check(switch_buffer_read(member->audio_buffer, pcm, sizeof(pcm)) == sizeof(pcm) && pcm[0] == 800, "ignored packets were played (%d)", pcm[0]);
+
+	switch_mutex_lock(conference->cascade_mutex);
+	conference->cascade_running = 0;
+	switch_mutex_unlock(conference->cascade_mutex);
+	conference_cascade_link_release(conference->cascade_link);
+	switch_socket_close(sock);
+	switch_core_hash_delete(globals.conference_hash, conference->name);
+	switch_buffer_destroy(&member->audio_buffer);
+}
+
+int main(int argc, char *argv[])
+{
+	switch_memory_pool_t *pool = NULL;
+
+	if (!test_core_init()) {
+		return 1;
+	}
+
+	/* the core PCM codecs */
+	switch_loadable_module_init(SWITCH_FALSE);
+	switch_core_new_memory_pool(&pool);
+
+	globals.conference_pool = pool;
+	switch_core_hash_init(&globals.conference_hash, pool);
+	switch_mutex_init(&globals.hash_mutex, SWITCH_MUTEX_NESTED, pool);
+	switch_core_hash_init(&globals.cascade_links, pool);
+	switch_mutex_init(&globals.cascade_mutex, SWITCH_MUTEX_NESTED, pool);
+	globals.cascade_node_id = 0x5678;
+
+	test_shareable();
+	test_group(pool);
+	test_record_encoders(pool);
+	test_cascade(pool);
+
+	switch_core_destroy_memory_pool(&pool);
+
+	return test_done("mod_conference");
+}
@@ -0,0 +1,277 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2012, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ *
+ * mod_event_multicast.c -- the LZ4 block decoder, key derivation and sealing of packet-format batch datagrams
+ *
+ * The module is compiled into the test so its static helpers can be called directly.
+ */
+
+#include "../../src/mod/event_handlers/mod_event_multicast/mod_event_multicast.c"
+#include "test.h"
+
+static void test_lz4_round_trip(void)
+{
+	unsigned char src[4000], packed[4100], out[4000];
+	size_t len, i;
+	int r;
+
+	/* compressible, the way a batch of event text is */
+	for (len = 0; len + 64 < sizeof(src); len += 64) {
+		switch_snprintf((char *) src + len, 65, "Event-Name: HEARTBEAT\nEvent-Sequence: %08u\nCore-UUID: 4f2a\n\n", (unsigned) len);
+	}
+
+	check((len = lz4_compress(src, sizeof(src), packed, sizeof(packed))) > 0 && len < sizeof(src) / 2, "text packed to %d bytes", (int) len);
+	r = lz4_decompress(packed, len, out, sizeof(out));
+	check(r == (int) sizeof(src) && !memcmp(src, out, sizeof(src)), "text came back %d bytes", r);
+
+	/* a block must be decoded into a buffer at least as big as what it holds */
+	check(lz4_decompress(packed, len, out, sizeof(out) - 1) == -1, "a block was decoded into a buffer one byte short");
+
+	/* no matches at all, the whole block is one literal run */
+	for (i = 0; i < sizeof(src); i++) {
+		src[i] = (unsigned char) (i * 7919 >> 3 ^ i);
+	}
+	if ((len = lz4_compress(src, sizeof(src), packed, sizeof(packed)))) {
+		r = lz4_decompress(packed, len, out, sizeof(out));
+		check(r == (int) sizeof(src) && !memcmp(src, out, sizeof(src)), "noise came back %d bytes", r);
+	}
+}
+
+static void test_lz4_malformed(void)
+{
+	unsigned char out[64];
+	/* 5 literals promised, 3 there */
+	static const unsigned char short_literals[] = { 0x50, 'a', 'b', 'c' };
+	/* 15 + 20 literals promised through the length bytes, 2 there */
+	static const unsigned char short_long_literals[] = { 0xf0, 20, 'a', 'b' };
+	/* a length that runs off the end */
+	static const unsigned char open_length[] = { 0xf0, 255, 255 };
+	/* one literal then a match 2 bytes back */
+	static const unsigned char before_start[] = { 0x10, 'a', 0x02, 0x00, 0x10, 'b' };
+	/* offset 0 */
+	static const unsigned char zero_offset[] = { 0x10, 'a', 0x00, 0x00, 0x10, 'b' };
+	/* a match without its offset */
+	static const unsigned char no_offset[] = { 0x10, 'a', 0x01 };
+	/* one literal repeated 4 + 15 + 100 times, more than out holds */
+	static const unsigned char overlong_match[] = { 0x1f, 'a', 0x01, 0x00, 100, 0x00 };
+	/* the same with a length byte missing */
+	static const unsigned char open_match[] = { 0x1f, 'a', 0x01, 0x00, 255 };
+	/* what a good one of those looks like: "a" then 4 + 2 more, then "b" */
+	static const unsigned char good[] = { 0x12, 'a', 0x01, 0x00, 0x10, 'b' };
+
+	check(lz4_decompress(short_literals, sizeof(short_literals), out, sizeof(out)) == -1, "truncated literals were accepted");
+	check(lz4_decompress(short_long_literals, sizeof(short_long_literals), out, sizeof(out)) == -1, "truncated long literals were accepted");
+	check(lz4_decompress(open_length, sizeof(open_length), out, sizeof(out)) == -1, "an unterminated literal length was accepted");
+	check(lz4_decompress(before_start, sizeof(before_start), out, sizeof(out)) == -1, "an offset before the start was accepted");
+	check(lz4_decompress(zero_offset, sizeof(zero_offset), out, sizeof(out)) == -1, "a zero offset was accepted");
+	check(lz4_decompress(no_offset, sizeof(no_offset), out, sizeof(out)) == -1, "a match without an offset was accepted");
+	check(lz4_decompress(overlong_match, sizeof(overlong_match), out, sizeof(out)) == -1, "an overlong match was accepted");
+	check(lz4_decompress(open_match, sizeof(open_match), out, sizeof(out)) == -1, "an unterminated match length was accepted");
+
+	check(lz4_decompress(good, sizeof(good), out, sizeof(out)) == 8 && !memcmp(out, "aaaaaaab", 8), "a good block did not decode");
+}
+
+#ifdef HAVE_OPENSSL
+/* RFC 5869 A.1, two blocks of output */
+static void test_hkdf(void)
+{
+	static const unsigned char salt[] = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c };
+	static const unsigned char info[] = { 0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9 };
+	static const unsigned char want[42] = {
+		0x3c, 0xb2, 0x5f, 0x25, 0xfa, 0xac, 0xd5, 0x7a, 0x90, 0x43, 0x4f, 0x64, 0xd0, 0x36, 0x2f, 0x2a,
+		0x2d, 0x2d, 0x0a, 0x90, 0xcf, 0x1a, 0x5a, 0x4c, 0x5d, 0xb0, 0x2d, 0x56, 0xec, 0xc4, 0xc5, 0xbf,
+		0x34, 0x00, 0x72, 0x08, 0xd5, 0xb8, 0x87, 0x18, 0x58, 0x65
+	};
+	unsigned char ikm[22], okm[42], key[32];
+
+	memset(ikm, 0x0b, sizeof(ikm));
+	check(hkdf_sha256(salt, sizeof(salt), ikm, sizeof(ikm), info, sizeof(info), okm, sizeof(okm)), "hkdf refused the RFC 5869 input");
+	check(!memcmp(okm, want, sizeof(want)), "hkdf does not match RFC 5869 A.1");
+
+	/* the packet key is the first block of the same construction */
+	derive_key("ClueCon", key);
+	hkdf_sha256((const unsigned char *) KEY_SALT, strlen(KEY_SALT), (const unsigned char *) "ClueCon", 7,
+				(const unsigned char *) KEY_INFO, strlen(KEY_INFO), okm, sizeof(okm));
+	check(!memcmp(key, okm, sizeof(key)), "derive_key is not the first 32 bytes of the hkdf output");
+}
+
+static void test_set_psk(const char *psk)
+{
+	switch_safe_free(globals.psk);
+	globals.psk = strdup(psk);
+	derive_key(globals.psk, globals.key);
+	globals.key_gen++;
+}
+
+static void test_aead(void)
+{
+	unsigned char aad[] = "FSM2 header", nonce[BATCH_NONCE_LEN], tag[BATCH_TAG_LEN], data[64], sealed[64];
+	const char *text = "Event-Name: CUSTOM\nEvent-Subclass: multicast::test\n\n";
+	int len = (int) strlen(text);
+
+	test_set_psk("ClueCon");
+
+	memcpy(data, text, len);
+	check(batch_seal(aad, sizeof(aad), nonce, data, len, tag), "seal failed");
+	check(memcmp(data, text, len), "sealing left the text as it was");
+	memcpy(sealed, data, len);
+
+	check(batch_open(aad, sizeof(aad), nonce, data, len, tag) && !memcmp(data, text, len), "a sealed payload did not open");
+
+	memcpy(data, sealed, len);
+	data[len / 2] ^= 1;
+	check(!batch_open(aad, sizeof(aad), nonce, data, len, tag), "a changed payload opened");
+
+	memcpy(data, sealed, len);
+	aad[0] ^= 1;
+	check(!batch_open(aad, sizeof(aad), nonce, data, len, tag), "a changed header opened");
+	aad[0] ^= 1;
+
+	memcpy(data, sealed, len);
+	tag[0] ^= 1;
+	check(!batch_open(aad, sizeof(aad), nonce, data, len, tag), "a changed tag opened");
+	tag[0] ^= 1;
+
+	memcpy(data, sealed, len);
+	nonce[0] ^= 1;
+	check(!batch_open(aad, sizeof(aad), nonce, data, len, tag), "a changed nonce opened");
+	nonce[0] ^= 1;
+
+	/* a new psk rekeys the contexts already set up */
+	test_set_psk("not ClueCon");
+	memcpy(data, sealed, len);
+	check(!batch_open(aad, sizeof(aad), nonce, data, len, tag), "opened with the wrong psk");
+
+	test_set_psk("ClueCon");
+	memcpy(data, sealed, len);
+	check(batch_open(aad, sizeof(aad), nonce, data, len, tag) && !memcmp(data, text, len), "did not open after going back to the psk");
+}
+
+/* an empty sealed batch the way batch_flush() lays it out */
+static size_t test_packet(unsigned char *out, const char *sender, uint32_t boot_id, uint64_t seq)
+{
+	unsigned char *p = out;
+	size_t slen = strlen(sender);
+
+	memcpy(p, BATCH_MAGIC, 4);
+	p += 4;
+	*p++ = BATCH_FLAG_SEALED;
+	*p++ = (unsigned char) slen;
+	memcpy(p, sender, slen);
+	p += slen;
+	put_uint(p, boot_id, 4);
+	p += 4;
+	put_uint(p, seq, 8);
+	p += 8;
+	put_uint(p, 0, 2);
+	p += 2;
+
+	batch_seal(out, (int) (p - out), p, p + BATCH_NONCE_LEN, 0, p + BATCH_NONCE_LEN);
+
+	return (p - out) + BATCH_NONCE_LEN + BATCH_TAG_LEN;
+}
+
+static struct peer_status *test_peer(const char *sender)
+{
+	return (struct peer_status *) switch_core_hash_find(globals.peer_hash, sender);
+}
+
+static void test_receive(void)
+{
+	unsigned char buf[128];
+	struct peer_status *peer;
+	size_t len;
+
+	test_set_psk("ClueCon");
+
+	batch_receive(buf, test_packet(buf, "alice", 7, 10));
+	check((peer = test_peer("alice")) && peer->packets == 1 && peer->last_seq == 10, "an authentic packet did not make a peer");
+
+	/* nothing that fails authentication gets a peer entry */
+	len = test_packet(buf, "mallory", 7, 1);
+	buf[len - 1] ^= 1;
+	batch_receive(buf, len);
+	check(!test_peer("mallory"), "a packet with a bad tag made a peer");
+
+	len = test_packet(buf, "alice", 7, 11);
+	buf[6 + 4] = 'f';
+	batch_receive(buf, len);
+	check(!test_peer("alicf"), "a packet with a changed sender made a peer");
+	check(peer && peer->last_seq == 10, "a packet with a changed sender moved the sequence");
+
+	test_set_psk("not ClueCon");
+	len = test_packet(buf, "bob", 7, 1);
+	test_set_psk("ClueCon");
+	batch_receive(buf, len);
+	check(!test_peer("bob"), "a packet sealed with another psk made a peer");
+
+	if (!peer) {
+		return;
+	}
+
+	/* any other boot id is a restart, lower or higher */
+	batch_receive(buf, test_packet(buf, "alice", 3, 1));
+	check(peer->boot_id == 3 && peer->last_seq == 1 && !peer->late, "a lower boot id was not taken as a restart");
+
+	batch_receive(buf, test_packet(buf, "alice", 3, 1));
+	check(peer->late == 1, "a repeated sequence was not counted late");
+
+	batch_receive(buf, test_packet(buf, "alice", 0xfffffff0, 5));
+	check(peer->boot_id == 0xfffffff0 && peer->last_seq == 5, "a higher boot id was not taken as a restart");
+}
+#endif
+
+int main(int argc, char *argv[])
+{
+	switch_memory_pool_t *pool = NULL;
+
+	if (!test_core_init()) {
+		return 1;
+	}
+
+	switch_core_new_memory_pool(&pool);
+	module_pool = pool;
+	switch_mutex_init(&globals.mutex, SWITCH_MUTEX_NESTED, pool);
+	switch_core_hash_init(&globals.peer_hash, pool);
+	globals.inflate_buf = switch_core_alloc(pool, BATCH_MAX_BYTES + 1);
+
+	test_lz4_round_trip();
+	test_lz4_malformed();
+#ifdef HAVE_OPENSSL
+	test_hkdf();
+	test_aead();
+	test_receive();
+
+	EVP_CIPHER_CTX_free(globals.seal_ctx);
+	EVP_CIPHER_CTX_free(globals.open_ctx);
+	switch_safe_free(globals.psk);
+#endif
+
+	switch_core_hash_destroy(&globals.peer_hash);
+	switch_core_destroy_memory_pool(&pool);
+
+	return test_done("mod_event_multicast");
+}
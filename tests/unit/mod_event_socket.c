@@ -0,0 +1,237 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2012, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ *
+ * mod_event_socket.c -- listener internals of mod_event_socket run against a minimal core
+ *
+ * The module is compiled into the test so its static helpers can be called directly.
+ */
+
+#include "../../src/mod/event_handlers/mod_event_socket/mod_event_socket.c"
+#include "test.h"
+
+static listener_t *test_listener(switch_memory_pool_t *pool)
+{
+	listener_t *l = switch_core_alloc(pool, sizeof(*l));
+
+	l->pool = pool;
+	switch_mutex_init(&l->filter_mutex, SWITCH_MUTEX_NESTED, pool);
+	switch_mutex_init(&l->out_mutex, SWITCH_MUTEX_NESTED, pool);
+	switch_set_flag(l, LFLAG_EVENTS);
+	l->event_list[SWITCH_EVENT_ALL] = 1;
+
+	return l;
+}
+
+static void test_filter(listener_t *l, const char *name, const char *value)
+{
+	if (!l->filters) {
+		switch_event_create_plain(&l->filters, SWITCH_EVENT_CLONE);
+	}
+	switch_event_add_header_string(l->filters, SWITCH_STACK_BOTTOM, name, value);
+	compile_filters(l);
+}
+
+static void test_filter_clear(listener_t *l)
+{
+	switch_event_destroy(&l->filters);
+	compile_filters(l);
+}
+
+/* a filter on _body looks at the event body, like switch_event_get_header() does */
+static void test_body_filter(switch_memory_pool_t *pool)
+{
+	listener_t *l = test_listener(pool);
+	switch_event_t *event;
+
+	switch_event_create(&event, SWITCH_EVENT_CUSTOM);
+	switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Action", "test");
+	switch_event_set_body(event, "hello world");
+
+	test_filter(l, "_body", "hello world");
+	check(listener_wants_event(l, event), "a _body filter did not match the body");
+	test_filter_clear(l);
+
+	test_filter(l, "_body", "/^hello/");
+	check(listener_wants_event(l, event), "a _body regex did not match the body");
+	test_filter_clear(l);
+
+	test_filter(l, "_body", "goodbye");
+	check(!listener_wants_event(l, event), "a _body filter matched another body");
+	test_filter_clear(l);
+
+	test_filter(l, "Action", "test");
+	test_filter(l, "_body", "-hello world");
+	check(!listener_wants_event(l, event), "a negative _body filter did not drop the event");
+	test_filter_clear(l);
+
+	switch_event_destroy(&event);
+
+	/* no body, nothing to match */
+	switch_event_create(&event, SWITCH_EVENT_CUSTOM);
+	test_filter(l, "_body", "hello world");
+	check(!listener_wants_event(l, event), "a _body filter matched an event without a body");
+	test_filter_clear(l);
+	switch_event_destroy(&event);
+
+	free_compiled_filters(l);
+}
+
+/* an event as event_handler records it, Event-Sequence is what replay orders by */
+static void test_record(uint64_t seq, switch_event_types_t id, const char *subclass, const char *uuid)
+{
+	switch_event_t *event;
+	shared_event_t *se;
+
+	if (subclass) {
+		switch_event_create_subclass(&event, id, subclass);
+	} else {
+		switch_event_create(&event, id);
+	}
+	switch_event_del_header(event, "Event-Sequence");
+	switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Event-Sequence", "%" SWITCH_UINT64_T_FMT, seq);
+	if (uuid) {
+		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Unique-ID", uuid);
+	}
+
+	se = shared_event_create(&event);
+	switch_mutex_lock(globals.listener_mutex);
+	replay_record(se);
+	switch_mutex_unlock(globals.listener_mutex);
+	shared_event_release(&se);
+}
+
+/* pop the listener's queue and compare the sequences with the expected ones, 0 terminated */
+static void test_expect(listener_t *l, const char *what, const uint64_t *seqs)
+{
+	void *pop;
+	int i = 0;
+
+	while (switch_queue_trypop(l->event_queue, &pop) == SWITCH_STATUS_SUCCESS) {
+		shared_event_t *se = (shared_event_t *) pop;
+
+		check(seqs[i] && se->seq == seqs[i], "%s: event %d is %" SWITCH_UINT64_T_FMT ", expected %" SWITCH_UINT64_T_FMT, what, i, se->seq, seqs[i]);
+		if (seqs[i]) {
+			i++;
+		}
+		shared_event_release(&se);
+	}
+
+	check(!seqs[i], "%s: only %d events were queued", what, i);
+}
+
+static void test_resume(switch_memory_pool_t *pool)
+{
+	listener_t *l = test_listener(pool);
+	shared_event_t *se;
+	switch_event_t *event;
+	uint32_t sent, total;
+	int gap = 0;
+	static const uint64_t all[] = { 2, 3, 4, 5, 6, 0 };
+	static const uint64_t merged[] = { 4, 5, 6, 7, 0 };
+	static const uint64_t coalesced[] = { 3, 4, 5, 7, 0 };
+	static const uint64_t first[] = { 3, 4, 0 };
+	static const uint64_t rest[] = { 5, 7, 0 };
+	static const uint64_t subclass[] = { 20, 27, 28, 29, 30, 0 };
+
+	prefs.replay_size = 4;
+	switch_queue_create(&l->event_queue, 16, pool);
+
+	test_record(1, SWITCH_EVENT_CHANNEL_STATE, NULL, "a");
+	test_record(2, SWITCH_EVENT_CHANNEL_STATE, NULL, "a");
+	test_record(3, SWITCH_EVENT_CUSTOM, "test::one", NULL);
+	test_record(4, SWITCH_EVENT_CHANNEL_STATE, NULL, "b");
+	test_record(5, SWITCH_EVENT_CHANNEL_STATE, NULL, "a");
+	test_record(6, SWITCH_EVENT_HEARTBEAT, NULL, NULL);
+
+	/* everything after 1, oldest first across the rings */
+	sent = replay_resume(l, 2, &gap, &total);
+	check(sent == 5 && total == 5 && !gap, "resume from 2 queued %u of %u, gap %d", sent, total, gap);
+	test_expect(l, "resume", all);
+
+	/* what is already queued is merged in, not sent twice */
+	switch_event_create(&event, SWITCH_EVENT_HEARTBEAT);
+	switch_event_del_header(event, "Event-Sequence");
+	switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Event-Sequence", "7");
+	se = shared_event_create(&event);
+	switch_queue_push(l->event_queue, se);
+	switch_mutex_lock(globals.listener_mutex);
+	replay_record(se);
+	switch_mutex_unlock(globals.listener_mutex);
+	sent = replay_resume(l, 4, &gap, &total);
+	check(sent == 4 && total == 4, "resume from 4 with 7 queued gave %u of %u", sent, total);
+	test_expect(l, "merge", merged);
+
+	/* coalesced, only the newest state of each channel and the newest heartbeat are left */
+	switch_set_flag(l, LFLAG_COALESCE);
+	sent = replay_resume(l, 1, &gap, &total);
+	check(sent == 4 && total == 4, "coalesced resume gave %u of %u", sent, total);
+	test_expect(l, "coalesce", coalesced);
+	check(!l->behind_seq, "a complete replay left the listener behind at %" SWITCH_UINT64_T_FMT, l->behind_seq);
+
+	/* a full queue leaves the rest to catch up once the client has read what was queued */
+	switch_queue_create(&l->event_queue, 2, pool);
+	sent = replay_resume(l, 3, &gap, &total);
+	check(sent == 2 && total == 4 && l->behind_seq == 5, "a short queue took %u of %u, behind at %" SWITCH_UINT64_T_FMT, sent, total, l->behind_seq);
+	test_expect(l, "first half", first);
+	replay_catch_up(l);
+	check(!l->behind_seq, "catch up left the listener behind at %" SWITCH_UINT64_T_FMT, l->behind_seq);
+	test_expect(l, "catch up", rest);
+	switch_clear_flag(l, LFLAG_COALESCE);
+	switch_queue_create(&l->event_queue, 16, pool);
+
+	/* a busy CUSTOM subclass does not push the others out of their ring */
+	test_record(20, SWITCH_EVENT_CUSTOM, "test::quiet", NULL);
+	for (total = 21; total <= 30; total++) {
+		test_record(total, SWITCH_EVENT_CUSTOM, "test::busy", NULL);
+	}
+	gap = 0;
+	sent = replay_resume(l, 20, &gap, &total);
+	check(gap, "the busy subclass dropped events but no gap was reported");
+	test_expect(l, "subclass", subclass);
+
+	switch_mutex_lock(globals.listener_mutex);
+	replay_destroy();
+	switch_mutex_unlock(globals.listener_mutex);
+	prefs.replay_size = 0;
+}
+
+int main(int argc, char *argv[])
+{
+	switch_memory_pool_t *pool = NULL;
+	if (!test_core_init()) {
+		return 1;
+	}
+
+	switch_core_new_memory_pool(&pool);
+	switch_mutex_init(&globals.listener_mutex, SWITCH_MUTEX_NESTED, pool);
+
+	test_body_filter(pool);
+	test_resume(pool);
+
+	switch_core_destroy_memory_pool(&pool);
+
+	return test_done("mod_event_socket");
+}
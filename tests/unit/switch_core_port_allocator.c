@@ -0,0 +1,125 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2012, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ *
+ * switch_core_port_allocator.c -- which ports a range hands out with and without SPF_EVEN / SPF_ODD
+ */
+
+#include "test.h"
+
+/* take every port the allocator has, check each one against the expected set and that the next request fails */
+static void test_range(const char *what, switch_port_t start, switch_port_t end, switch_port_flag_t flags, switch_port_t first, switch_port_t last,
+					   switch_port_t step)
+{
+	switch_core_port_allocator_t *alloc = NULL;
+	switch_port_allocator_stats_t stats;
+	uint8_t seen[64] = { 0 };
+	switch_port_t port;
+	uint32_t want = (last - first) / step + 1, got = 0;
+
+	if (switch_core_port_allocator_new(start, end, flags, &alloc) != SWITCH_STATUS_SUCCESS) {
+		check(0, "%s: %u-%u was refused", what, start, end);
+		return;
+	}
+
+	while (switch_core_port_allocator_request_port(alloc, &port) == SWITCH_STATUS_SUCCESS) {
+		check(port >= first && port <= last && !((port - first) % step), "%s: handed out %u", what, port);
+		if (port >= first && port - first < sizeof(seen)) {
+			check(!seen[port - first], "%s: handed out %u twice", what, port);
+			seen[port - first] = 1;
+		}
+		got++;
+	}
+
+	check(got == want, "%s: handed out %u ports, expected %u", what, got, want);
+	check(port == 0, "%s: a failed request returned port %u", what, port);
+
+	switch_core_port_allocator_get_stats(alloc, &stats);
+	check(stats.total == want && stats.used == want && stats.failures == 1, "%s: stats total %u used %u failures %" SWITCH_UINT64_T_FMT,
+		  what, stats.total, stats.used, stats.failures);
+
+	switch_core_port_allocator_destroy(&alloc);
+}
+
+static void test_ranges(void)
+{
+	/* odd and even sized ranges, both ends even, both ends odd */
+	test_range("any 10000-10009", 10000, 10009, SPF_NONE, 10000, 10009, 1);
+	test_range("any 10001-10005", 10001, 10005, SPF_NONE, 10001, 10005, 1);
+	test_range("even 10000-10010", 10000, 10010, SPF_EVEN, 10000, 10010, 2);
+	test_range("even 10000-10009", 10000, 10009, SPF_EVEN, 10000, 10008, 2);
+	test_range("even 10001-10011", 10001, 10011, SPF_EVEN, 10002, 10010, 2);
+	test_range("even 10001-10010", 10001, 10010, SPF_EVEN, 10002, 10010, 2);
+	test_range("odd 10001-10011", 10001, 10011, SPF_ODD, 10001, 10011, 2);
+	test_range("odd 10000-10010", 10000, 10010, SPF_ODD, 10001, 10009, 2);
+	test_range("even and odd 10000-10009", 10000, 10009, SPF_EVEN | SPF_ODD, 10000, 10009, 1);
+	test_range("even 10000-10000", 10000, 10000, SPF_EVEN, 10000, 10000, 2);
+}
+
+static void test_free(void)
+{
+	switch_core_port_allocator_t *alloc = NULL;
+	switch_port_allocator_stats_t stats;
+	switch_port_t port, again;
+
+	switch_core_port_allocator_new(20000, 20003, SPF_EVEN, &alloc);
+
+	check(switch_core_port_allocator_request_port(alloc, &port) == SWITCH_STATUS_SUCCESS, "no port from 20000-20003");
+	check(switch_core_port_allocator_free_port(alloc, port + 1) != SWITCH_STATUS_SUCCESS, "freed the odd port %u", port + 1);
+	check(switch_core_port_allocator_free_port(alloc, 20004) != SWITCH_STATUS_SUCCESS, "freed 20004 outside the range");
+	check(switch_core_port_allocator_free_port(alloc, port) == SWITCH_STATUS_SUCCESS, "could not free %u", port);
+	check(switch_core_port_allocator_free_port(alloc, port) != SWITCH_STATUS_SUCCESS, "freed %u twice", port);
+
+	/* the released port sits out its quarantine while the other one is free */
+	check(switch_core_port_allocator_request_port(alloc, &again) == SWITCH_STATUS_SUCCESS && again != port,
+		  "got %u back while it was quarantined", again);
+
+	/* with nothing else left the quarantined port is reused early rather than failing */
+	check(switch_core_port_allocator_request_port(alloc, &again) == SWITCH_STATUS_SUCCESS && again == port, "quarantined %u was not reused, got %u",
+		  port, again);
+
+	switch_core_port_allocator_get_stats(alloc, &stats);
+	check(stats.reclaimed == 1 && stats.high_water == 2, "reclaimed %" SWITCH_UINT64_T_FMT " high water %u", stats.reclaimed, stats.high_water);
+
+	switch_core_port_allocator_destroy(&alloc);
+}
+
+int main(int argc, char *argv[])
+{
+	switch_memory_pool_t *pool = NULL;
+
+	if (!test_core_init()) {
+		return 1;
+	}
+
+	/* the allocator seeds itself from the rtp rng */
+	switch_core_new_memory_pool(&pool);
+	switch_rtp_init(pool);
+
+	test_ranges();
+	test_free();
+
+	return test_done("switch_core_port_allocator");
+}
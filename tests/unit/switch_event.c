@@ -0,0 +1,310 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2012, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ *
+ * switch_event.c -- switch_event_serialize_binary and switch_event_create_binary round trips and bad records,
+ * and delivery through the event export stage
+ */
+
+#include "test.h"
+
+static void check_same(switch_event_t *a, switch_event_t *b)
+{
+	switch_event_header_t *ha, *hb;
+
+	for (ha = a->headers, hb = b->headers; ha && hb; ha = ha->next, hb = hb->next) {
+		check(!strcmp(ha->name, hb->name), "header %s came back as %s", ha->name, hb->name);
+		check(!strcmp(ha->value, hb->value), "header %s was '%s' and came back '%s'", ha->name, ha->value, hb->value);
+		check(ha->idx == hb->idx, "header %s had %d values and came back with %d", ha->name, ha->idx, hb->idx);
+	}
+
+	check(!ha && !hb, "the events do not have the same number of headers");
+	check(a->event_id == b->event_id, "event id %d came back as %d", a->event_id, b->event_id);
+	check(!a->body == !b->body && (!a->body || !strcmp(a->body, b->body)), "the body did not survive");
+}
+
+/* interned and literal header names, values the text formats would escape, an array and a body */
+static void test_round_trip(void)
+{
+	switch_event_t *event, *back;
+	char *data;
+	switch_size_t len;
+	char big[1000];
+
+	memset(big, 'x', sizeof(big) - 1);
+	big[sizeof(big) - 1] = '\0';
+
+	switch_event_create(&event, SWITCH_EVENT_CHANNEL_ANSWER);
+	switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Unique-ID", "2f5b5b5e-4a0e-4a6e-9c3e-0d2d7f1e9a11");
+	switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "variable_sip_from_display", "Jos\xc3\xa9 \"The\" Caller\r\nX: y");
+	switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "variable_long", big);
+	switch_event_add_header_string(event, SWITCH_STACK_PUSH, "variable_list", "one");
+	switch_event_add_header_string(event, SWITCH_STACK_PUSH, "variable_list", "two");
+	switch_event_set_body(event, "line one\nline two\n");
+
+	check(switch_event_serialize_binary(event, &data, &len) == SWITCH_STATUS_SUCCESS, "serialize failed");
+	check(switch_event_create_binary(&back, data, len) == SWITCH_STATUS_SUCCESS, "create failed");
+
+	if (back) {
+		check_same(event, back);
+		switch_event_destroy(&back);
+	}
+
+	/* every truncation of a good event is refused */
+	for (; len > 0; len--) {
+		back = NULL;
+		if (switch_event_create_binary(&back, data, len - 1) == SWITCH_STATUS_SUCCESS) {
+			check(0, "a body cut to %d bytes was accepted", (int) (len - 1));
+			switch_event_destroy(&back);
+		}
+	}
+
+	free(data);
+	switch_event_destroy(&event);
+}
+
+static void test_no_body(void)
+{
+	switch_event_t *event, *back;
+	char *data;
+	switch_size_t len;
+
+	switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, "test::binary");
+	switch_event_serialize_binary(event, &data, &len);
+
+	check(switch_event_create_binary(&back, data, len) == SWITCH_STATUS_SUCCESS, "create failed");
+
+	if (back) {
+		check_same(event, back);
+		check(!strcmp(switch_str_nil(switch_event_get_header(back, "Event-Subclass")), "test::binary"), "the subclass did not survive");
+		switch_event_destroy(&back);
+	}
+
+	free(data);
+	switch_event_destroy(&event);
+
+	check(switch_event_create_binary(&back, "FSB\x02\x00\x00", 6) != SWITCH_STATUS_SUCCESS, "an unknown version was accepted");
+	check(switch_event_create_binary(&back, "FSX\x01\x00\x00", 6) != SWITCH_STATUS_SUCCESS, "a bad magic was accepted");
+}
+
+static switch_event_t *test_event(void)
+{
+	switch_event_t *event;
+
+	switch_event_create(&event, SWITCH_EVENT_CHANNEL_HANGUP);
+	switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Unique-ID", "9b1f0a44-7c1e-4f0b-8d55-3c2a7e6d0b21");
+	switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Hangup-Cause", "NORMAL_CLEARING");
+	switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "variable_sip_user_agent", "phone/1.0 (a: b; c=d%)");
+	switch_event_add_header_string(event, SWITCH_STACK_PUSH, "variable_codecs", "PCMU");
+	switch_event_add_header_string(event, SWITCH_STACK_PUSH, "variable_codecs", "G722");
+	switch_event_set_body(event, "bye\n");
+
+	return event;
+}
+
+/* a binary round trip renders the same text, plain and url encoded, as the event it came from */
+static void test_text_round_trip(void)
+{
+	switch_event_t *event = test_event(), *back = NULL;
+	char *data, *a, *b;
+	switch_size_t len;
+	int encode;
+
+	switch_event_serialize_binary(event, &data, &len);
+	check(switch_event_create_binary(&back, data, len) == SWITCH_STATUS_SUCCESS, "create failed");
+
+	for (encode = 0; back && encode < 2; encode++) {
+		switch_event_serialize(event, &a, encode ? SWITCH_TRUE : SWITCH_FALSE);
+		switch_event_serialize(back, &b, encode ? SWITCH_TRUE : SWITCH_FALSE);
+		check(!strcmp(a, b), "%s text differs:\n%s\n--\n%s", encode ? "encoded" : "plain", a, b);
+		free(a);
+		free(b);
+	}
+
+	if (back) {
+		switch_event_destroy(&back);
+	}
+	free(data);
+	switch_event_destroy(&event);
+}
+
+#define REFUSE(_lit) _lit, sizeof(_lit) - 1
+
+static void check_refused(const char *what, const char *data, switch_size_t len)
+{
+	switch_event_t *back = NULL;
+
+	if (switch_event_create_binary(&back, data, len) == SWITCH_STATUS_SUCCESS) {
+		check(0, "%s was accepted", what);
+		switch_event_destroy(&back);
+	}
+}
+
+static void test_corrupted(void)
+{
+	switch_event_t *event = test_event(), *back;
+	char *data, *bad;
+	switch_size_t len, i;
+	int bit;
+
+	/* one header each: an unknown name code, a zero length literal name, a value running past the end,
+	   then a count that never ends, more headers than the record has and a byte left over after the body */
+	check_refused("an unknown header code", REFUSE("FSB\x01\x01\xff\x00\x00"));
+	check_refused("an empty header name", REFUSE("FSB\x01\x01\x00\x00\x00\x00"));
+	check_refused("a value past the end", REFUSE("FSB\x01\x01\x02\x05" "abc\x00"));
+	check_refused("an unterminated length", REFUSE("FSB\x01\x80\x80\x80\x80\x80\x80\x01"));
+	check_refused("a missing header", REFUSE("FSB\x01\x02\x02\x01x\x00"));
+	check_refused("a byte after the body", REFUSE("FSB\x01\x00\x01xy"));
+	check_refused("an empty record", "", 0);
+
+	/* a literal name of 300 bytes, longer than the parser takes */
+	switch_malloc(bad, 4 + 1 + 1 + 2 + 300 + 2);
+	memcpy(bad, "FSB\x01\x01\x00\xac\x02", 8);
+	memset(bad + 8, 'n', 300);
+	memcpy(bad + 308, "\x00\x00", 2);
+	check_refused("a 300 byte header name", bad, 310);
+	free(bad);
+
+	switch_event_serialize_binary(event, &data, &len);
+	switch_malloc(bad, len + 1);
+
+	memcpy(bad, data, len);
+	bad[len] = 'x';
+	check_refused("a good record with a byte appended", bad, len + 1);
+
+	/* every single bit flip is either refused or parses to something that can be destroyed */
+	for (i = 0; i < len; i++) {
+		for (bit = 0; bit < 8; bit++) {
+			memcpy(bad, data, len);
+			bad[i] ^= (char) (1 << bit);
+			back = NULL;
+			if (switch_event_create_binary(&back, bad, len) == SWITCH_STATUS_SUCCESS) {
+				check(back != NULL, "bit %d of byte %d: success without an event", bit, (int) i);
+				switch_event_destroy(&back);
+			} else {
+				check(back == NULL, "bit %d of byte %d: failure left an event behind", bit, (int) i);
+			}
+		}
+	}
+
+	free(bad);
+	free(data);
+	switch_event_destroy(&event);
+}
+
+static struct {
+	switch_mutex_t *mutex;
+	int records;
+	int repeated;
+	int bad;
+	uint8_t seen[1001];
+} exported;
+
+static switch_status_t test_export_write(switch_event_export_sink_t *sink, switch_event_export_record_t **records, uint32_t count, void *user_data)
+{
+	uint32_t i;
+
+	switch_mutex_lock(exported.mutex);
+	for (i = 0; i < count; i++) {
+		switch_event_t *event = NULL;
+		const char *n;
+
+		if (records[i]->event_id != SWITCH_EVENT_CUSTOM || switch_event_create_binary(&event, records[i]->data, records[i]->len) != SWITCH_STATUS_SUCCESS) {
+			exported.bad++;
+			continue;
+		}
+
+		if (!(n = switch_event_get_header(event, "Test-Number")) || atoi(n) < 1 || atoi(n) > 1000) {
+			exported.bad++;
+		} else if (exported.seen[atoi(n)]++) {
+			exported.repeated++;
+		} else {
+			exported.records++;
+		}
+		switch_event_destroy(&event);
+	}
+	switch_mutex_unlock(exported.mutex);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+/* every fired event of the sink's type reaches it once and parses back, more than one dispatch thread may deliver
+   so the order is not checked */
+static void test_export(void)
+{
+	switch_event_export_sink_t *sink = NULL;
+	switch_memory_pool_t *pool = NULL;
+	switch_event_t *event;
+	int i, n = 1000, sanity = 500, got = 0;
+
+	switch_core_new_memory_pool(&pool);
+	switch_mutex_init(&exported.mutex, SWITCH_MUTEX_NESTED, pool);
+
+	check(switch_event_export_add_sink("unit", SWITCH_EVENT_CUSTOM, 4096, 64, test_export_write, NULL, &sink) == SWITCH_STATUS_SUCCESS,
+		  "add_sink failed");
+	check(switch_event_export_add_sink("unit", SWITCH_EVENT_CUSTOM, 4096, 64, test_export_write, NULL, NULL) != SWITCH_STATUS_SUCCESS,
+		  "a second sink with the same name was added");
+
+	for (i = 1; i <= n; i++) {
+		switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, "test::export");
+		switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Test-Number", "%d", i);
+		switch_event_fire(&event);
+
+		/* not for this sink */
+		switch_event_create(&event, SWITCH_EVENT_TRAP);
+		switch_event_fire(&event);
+	}
+
+	while (--sanity > 0) {
+		switch_mutex_lock(exported.mutex);
+		got = exported.records + exported.repeated + exported.bad;
+		switch_mutex_unlock(exported.mutex);
+		if (got >= n) {
+			break;
+		}
+		switch_yield(10000);
+	}
+
+	check(switch_event_export_remove_sink(&sink) == SWITCH_STATUS_SUCCESS && !sink, "remove_sink failed");
+	check(exported.records == n && !exported.bad, "%d of %d records arrived, %d did not parse", exported.records, n, exported.bad);
+	check(!exported.repeated, "%d records arrived twice", exported.repeated);
+
+	switch_core_destroy_memory_pool(&pool);
+}
+
+int main(int argc, char *argv[])
+{
+	if (!test_core_init()) {
+		return 1;
+	}
+
+	test_round_trip();
+	test_no_body();
+	test_text_round_trip();
+	test_corrupted();
+	test_export();
+
+	return test_done("switch_event");
+}
@@ -0,0 +1,159 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2012, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ *
+ * switch_sln.c -- switch_sln_energy and switch_sln_noise_floor_update against speech and noise vectors
+ *
+ * The vectors are synthetic and deterministic: white noise from a fixed seed and "speech"
+ * made of 300Hz-ish syllables (a square-ish wave under an on/off envelope) on top of it,
+ * cut into 20ms frames at 8kHz the way the conference feeds them.
+ */
+
+#include "test.h"
+
+#define FRAME 160
+
+static uint32_t seed;
+static int16_t noise_sample(int16_t amp)
+{
+	seed = seed * 1103515245 + 12345;
+	return (int16_t) ((int32_t) ((seed >> 16) % (2 * amp + 1)) - amp);
+}
+
+static void noise_frame(int16_t *frame, int16_t amp)
+{
+	int x;
+
+	for (x = 0; x < FRAME; x++) {
+		frame[x] = noise_sample(amp);
+	}
+}
+
+static void speech_frame(int16_t *frame, int16_t amp, int16_t noise_amp, uint32_t n)
+{
+	int x;
+
+	for (x = 0; x < FRAME; x++) {
+		/* about 300Hz at 8kHz */
+		int32_t v = ((n * FRAME + x) / 13) & 1 ? amp : -amp;
+		v += noise_sample(noise_amp);
+		frame[x] = (int16_t) v;
+	}
+}
+
+static void test_energy(void)
+{
+	int16_t data[FRAME * 2];
+	int16_t odd[] = { 1, -2, 3, -4, 5 };
+	int16_t min[] = { -32768 };
+	int x;
+
+	memset(data, 0, sizeof(data));
+	check(switch_sln_energy(data, FRAME, 1) == 0, "silence has energy");
+	check(switch_sln_energy(data, 0, 1) == 0, "an empty frame has energy");
+
+	for (x = 0; x < FRAME; x++) {
+		data[x] = x & 1 ? 1000 : -1000;
+	}
+	check(switch_sln_energy(data, FRAME, 1) == 1000, "+-1000 measured %u", switch_sln_energy(data, FRAME, 1));
+
+	/* a length that is not a multiple of the unrolled loop */
+	check(switch_sln_energy(odd, 5, 1) == 3, "1..5 measured %u", switch_sln_energy(odd, 5, 1));
+	check(switch_sln_energy(min, 1, 1) == 32768, "-32768 measured %u", switch_sln_energy(min, 1, 1));
+
+	/* only the first channel of interleaved audio counts */
+	for (x = 0; x < FRAME; x++) {
+		data[x * 2] = 500;
+		data[x * 2 + 1] = 20000;
+	}
+	check(switch_sln_energy(data, FRAME, 2) == 500, "stereo measured %u", switch_sln_energy(data, FRAME, 2));
+
+	seed = 1;
+	noise_frame(data, 100);
+	x = (int) switch_sln_energy(data, FRAME, 1);
+	check(x > 35 && x < 65, "noise of amplitude 100 measured %d", x);
+}
+
+static void test_noise_floor(void)
+{
+	switch_noise_floor_t nf = { 0 };
+	int16_t frame[FRAME];
+	uint32_t n, level = 0, noise = 0, max_level = 0, e;
+
+	seed = 2;
+
+	/* 4s of steady noise, the estimate settles on it */
+	for (n = 0; n < 200; n++) {
+		noise_frame(frame, 100);
+		noise = switch_sln_energy(frame, FRAME, 1);
+		level = switch_sln_noise_floor_update(&nf, noise);
+	}
+	check(level > 35 && level < 65, "floor %u over noise of energy ~50", level);
+
+	/* 10s of talking in 1s bursts with 0.5s pauses, the floor must not chase the speech */
+	for (n = 0; n < 500; n++) {
+		if (n % 75 < 50) {
+			speech_frame(frame, 2000, 100, n);
+		} else {
+			noise_frame(frame, 100);
+		}
+		e = switch_sln_energy(frame, FRAME, 1);
+		level = switch_sln_noise_floor_update(&nf, e);
+		if (level > max_level) {
+			max_level = level;
+		}
+	}
+	check(max_level < 120, "floor rose to %u while talking over noise of energy ~50", max_level);
+	check(max_level * 2 < 2000, "speech no longer beats twice the floor (%u)", max_level);
+
+	/* the room gets louder (fan, traffic), after 5s the floor has followed */
+	for (n = 0; n < 250; n++) {
+		noise_frame(frame, 400);
+		level = switch_sln_noise_floor_update(&nf, switch_sln_energy(frame, FRAME, 1));
+	}
+	check(level > 150 && level < 250, "floor %u after the noise rose to energy ~200", level);
+
+	/* and quiet again, the floor drops within half a second */
+	for (n = 0; n < 25; n++) {
+		noise_frame(frame, 100);
+		level = switch_sln_noise_floor_update(&nf, switch_sln_energy(frame, FRAME, 1));
+	}
+	check(level < 65, "floor %u half a second after the noise dropped back to energy ~50", level);
+
+	/* digital silence pulls it all the way down */
+	memset(frame, 0, sizeof(frame));
+	for (n = 0; n < 50; n++) {
+		level = switch_sln_noise_floor_update(&nf, switch_sln_energy(frame, FRAME, 1));
+	}
+	check(level == 0, "floor %u over silence", level);
+}
+
+int main(int argc, char *argv[])
+{
+	test_energy();
+	test_noise_floor();
+
+	return test_done("switch_sln");
+}
@@ -0,0 +1,112 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2012, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ *
+ * test.h -- the check() harness shared by the tests/unit programs
+ *
+ * Each program includes this once, runs its test_*() functions and returns test_done().
+ * Programs that need the core call test_core_init() first; it starts a minimal core with
+ * its conf and log directories in a scratch directory, so nothing has to be installed.
+ */
+
+#ifndef SWITCH_UNIT_TEST_H
+#define SWITCH_UNIT_TEST_H
+
+#include <switch.h>
+
+static int failures;
+static int test_core_up;
+static char test_dir[256];
+
+#define check(_expr, ...) do { if (!(_expr)) { fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); fprintf(stderr, __VA_ARGS__); fprintf(stderr, "\n"); failures++; } } while (0)
+
+static inline int test_core_init(void)
+{
+	const char *tmp = getenv("TMPDIR");
+	const char *err = NULL;
+	char path[512];
+	FILE *f;
+
+	switch_snprintf(test_dir, sizeof(test_dir), "%s/fs_unit_XXXXXX", zstr(tmp) ? "/tmp" : tmp);
+
+	if (!mkdtemp(test_dir)) {
+		fprintf(stderr, "Cannot create %s\n", test_dir);
+		return 0;
+	}
+
+	switch_snprintf(path, sizeof(path), "%s/freeswitch.xml", test_dir);
+
+	if (!(f = fopen(path, "w"))) {
+		fprintf(stderr, "Cannot write %s\n", path);
+		return 0;
+	}
+
+	fprintf(f, "<?xml version=\"1.0\"?>\n<document type=\"freeswitch/xml\">\n  <section name=\"configuration\"/>\n</document>\n");
+	fclose(f);
+
+	/* the core frees these on shutdown */
+	SWITCH_GLOBAL_dirs.conf_dir = strdup(test_dir);
+	SWITCH_GLOBAL_dirs.log_dir = strdup(test_dir);
+
+	if (switch_core_init(SCF_MINIMAL, SWITCH_FALSE, &err) != SWITCH_STATUS_SUCCESS) {
+		fprintf(stderr, "Cannot start the core: %s\n", switch_str_nil(err));
+		return 0;
+	}
+
+	test_core_up = 1;
+
+	return 1;
+}
+
+/* shuts the core down if test_core_init() started it and reports, the result is the exit status */
+static inline int test_done(const char *name)
+{
+	static const char *files[] = { "freeswitch.xml", "freeswitch.xml.fsxml", "freeswitch.serial", NULL };
+	char path[512];
+	int i;
+
+	if (test_core_up) {
+		switch_core_destroy();
+		test_core_up = 0;
+	}
+
+	if (*test_dir) {
+		for (i = 0; files[i]; i++) {
+			switch_snprintf(path, sizeof(path), "%s/%s", test_dir, files[i]);
+			unlink(path);
+		}
+		rmdir(test_dir);
+	}
+
+	if (failures) {
+		fprintf(stderr, "%s: %d check(s) failed\n", name, failures);
+		return 1;
+	}
+
+	printf("%s: ok\n", name);
+	return 0;
+}
+
+#endif